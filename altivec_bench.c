@@ -0,0 +1,212 @@
+/*
+ * altivec_bench.c — check and time the AltiVec runtime library
+ *
+ * Every dispatch table this build has is first checked against libc
+ * (and the C table's hash) at every pair of 16-byte misalignments, then
+ * timed on short, page-sized and cache-busting blocks next to libc. On
+ * Linux, or on any build without -maltivec, that is the C table alone.
+ *
+ *   gcc -std=c99 -O2 -o altivec_bench altivec_bench.c rust_altivec_core.c
+ *   gcc -std=c99 -O2 -mcpu=7450 -maltivec -o altivec_bench altivec_bench.c rust_altivec_core.c
+ *   ./altivec_bench [MB per measurement, default 64]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "rust_altivec_core.h"
+
+#define MAX_LEN 300
+#define BUF_SIZE (MAX_LEN + 64)
+
+static int failures;
+static volatile size_t sink;
+
+static void fail(const AltivecOps* ops, const char* what, size_t n, int a, int b) {
+    if (failures++ < 10) printf("FAIL: %s %s, length %lu, offsets %d/%d\n", ops->name, what, (unsigned long)n, a, b);
+}
+
+static void random_bytes(unsigned char* p, size_t n, int nonzero) {
+    for (size_t i = 0; i < n; i++) {
+        p[i] = (unsigned char)rand();
+        if (nonzero && !p[i]) p[i] = 1;
+    }
+}
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+static const unsigned char* naive_search(const unsigned char* hay, size_t hay_len,
+                                         const unsigned char* needle, size_t needle_len) {
+    for (size_t i = 0; i + needle_len <= hay_len; i++) {
+        if (memcmp(hay + i, needle, needle_len) == 0) return hay + i;
+    }
+    return NULL;
+}
+
+static void check_at(const AltivecOps* ops, size_t n, int a, int b) {
+    static unsigned char src_buf[BUF_SIZE + 16], dst_buf[BUF_SIZE + 16], want[BUF_SIZE + 16];
+    unsigned char* src = src_buf + 16 + a;
+    unsigned char* dst = dst_buf + 16 + b;
+    int c;
+
+    /* copy and fill may not touch a byte outside the run */
+    random_bytes(src_buf, sizeof src_buf, 0);
+    random_bytes(dst_buf, sizeof dst_buf, 0);
+    memcpy(want, dst_buf, sizeof want);
+    memcpy(want + (dst - dst_buf), src, n);
+    if (ops->copy(dst, src, n) != dst || memcmp(dst_buf, want, sizeof want) != 0) fail(ops, "copy", n, a, b);
+    c = rand() & 0xFF;
+    memset(want + (dst - dst_buf), c, n);
+    if (ops->fill(dst, c, n) != dst || memcmp(dst_buf, want, sizeof want) != 0) fail(ops, "fill", n, a, b);
+
+    memcpy(dst, src, n);
+    if (ops->compare(dst, src, n) != 0) fail(ops, "compare (equal)", n, a, b);
+    if (n) {
+        size_t at = (size_t)rand() % n;
+        dst[at] ^= (unsigned char)(1 + rand() % 255);
+        if (sign(ops->compare(dst, src, n)) != sign(memcmp(dst, src, n))) fail(ops, "compare", n, a, b);
+        if (sign(ops->compare(src, dst, n)) != sign(memcmp(src, dst, n))) fail(ops, "compare", n, a, b);
+    }
+
+    c = n && rand() % 4 ? src[(size_t)rand() % n] : rand() & 0xFF;
+    if (ops->find_byte(src, c, n) != memchr(src, c, n)) fail(ops, "find_byte", n, a, b);
+
+    random_bytes(src, n, 1);
+    src[n] = 0;
+    if (ops->length((const char*)src) != n) fail(ops, "length", n, a, b);
+
+    if (ops->hash(src, n) != altivec_scalar_ops.hash(src, n)) fail(ops, "hash", n, a, b);
+    memmove(dst, src, n);
+    if (ops->hash(dst, n) != ops->hash(src, n)) fail(ops, "hash (moved)", n, a, b);
+
+    /* a needle cut from the haystack, with its bytes narrowed to a few
+     * values so near misses are common */
+    for (size_t i = 0; i < n; i++) src[i] = (unsigned char)('a' + src[i] % 3);
+    for (size_t len = 0; len <= 5 && len <= n; len++) {
+        const unsigned char* needle = src + (n - len) / 2;
+        if (ops->search(src, n, needle, len) != naive_search(src, n, needle, len)) fail(ops, "search", n, a, b);
+    }
+    if (ops->search(src, n, "abcab", 5) != naive_search(src, n, (const unsigned char*)"abcab", 5)) {
+        fail(ops, "search", n, a, b);
+    }
+}
+
+static void check(const AltivecOps* ops) {
+    static const unsigned char known[] = "The quick brown fox jumps over the lazy dog";
+    int before = failures;
+
+    for (size_t n = 0; n <= MAX_LEN; n += n < 80 ? 1 : 37) {
+        for (int a = 0; a < 16; a++) {
+            for (int b = 0; b < 16; b++) check_at(ops, n, a, b);
+        }
+    }
+    /* fixed values: the hash is the same on every host and table */
+    if (ops->hash("", 0) != 0x1660AAC7u || ops->hash(known, sizeof known - 1) != 0x5926DFFBu) {
+        fail(ops, "hash (known values)", sizeof known - 1, 0, 0);
+    }
+    printf("%s: %s\n", ops->name, failures == before ? "all checks passed" : "FAILED");
+}
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+enum { COPY, FILL, COMPARE, FIND_BYTE, LENGTH, HASH, SEARCH, OP_COUNT };
+static const char* op_names[] = { "memcpy", "memset", "memcmp", "memchr", "strlen", "hash", "memmem" };
+
+/* libc, for scale; there is no libc hash, and Tiger has no memmem */
+static void* libc_copy(void* d, const void* s, size_t n) { return memcpy(d, s, n); }
+static void* libc_fill(void* d, int c, size_t n) { return memset(d, c, n); }
+static int libc_compare(const void* a, const void* b, size_t n) { return memcmp(a, b, n); }
+static void* libc_find_byte(const void* s, int c, size_t n) { return memchr(s, c, n); }
+static size_t libc_length(const char* s) { return strlen(s); }
+
+static const AltivecOps libc_ops = {
+    "libc", libc_copy, libc_fill, libc_compare, libc_find_byte, libc_length, NULL, NULL,
+};
+
+/* MB/s of one op over blocks of size bytes; the data never matches
+ * early, so each call runs the whole block */
+static double measure(const AltivecOps* ops, int op, unsigned char* a, unsigned char* b, size_t size,
+                      double total) {
+    size_t calls = (size_t)(total / size) + 1;
+    double start = now(), elapsed;
+
+    for (size_t i = 0; i < calls; i++) {
+        switch (op) {
+        case COPY: ops->copy(a, b, size); break;
+        case FILL: ops->fill(a, (int)i, size); break;
+        case COMPARE: sink += (size_t)ops->compare(a, b, size); break;
+        case FIND_BYTE: sink += (size_t)ops->find_byte(a, 0, size); break;
+        case LENGTH: sink += ops->length((const char*)a); break;
+        case HASH: sink += ops->hash(a, size); break;
+        case SEARCH: sink += (size_t)ops->search(a, size, "zz", 2); break;
+        }
+    }
+    elapsed = now() - start;
+    return elapsed > 0 ? calls * (double)size / elapsed / 1e6 : 0.0;
+}
+
+static void bench(const AltivecOps* const* tables, int count, double total) {
+    static const size_t sizes[] = { 64, 4096, 4 << 20 };
+    size_t biggest = sizes[2];
+    unsigned char* a = malloc(biggest + 16);
+    unsigned char* b = malloc(biggest + 16);
+
+    if (!a || !b) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    printf("\n%-8s %9s", "", "bytes");
+    for (int t = 0; t < count; t++) printf(" %12s", tables[t]->name);
+    printf("   (MB/s)\n");
+    for (int op = 0; op < OP_COUNT; op++) {
+        for (int s = 0; s < 3; s++) {
+            size_t size = sizes[s];
+            printf("%-8s %9lu", op_names[op], (unsigned long)size);
+            for (int t = 0; t < count; t++) {
+                if ((op == HASH && !tables[t]->hash) || (op == SEARCH && !tables[t]->search)) {
+                    printf(" %12s", "-");
+                    continue;
+                }
+                /* no zero bytes, no 'z', equal buffers, one terminator */
+                memset(a, 'a', size);
+                memset(b, 'a', size);
+                a[size] = 0;
+                printf(" %12.1f", measure(tables[t], op, a, b, size, total));
+                fflush(stdout);
+            }
+            printf("\n");
+        }
+    }
+    free(a);
+    free(b);
+}
+
+int main(int argc, char** argv) {
+    double total = (argc > 1 ? atof(argv[1]) : 64) * 1e6;
+    const AltivecOps* tables[3];
+    int count = 0;
+
+    srand(1);
+    printf("selected: %s (AltiVec %s)\n", altivec_runtime_ops()->name,
+           altivec_available() ? "available" : "not available");
+    tables[count++] = &altivec_scalar_ops;
+#ifdef __ALTIVEC__
+    if (altivec_available()) tables[count++] = &altivec_vector_ops;
+#endif
+    for (int t = 0; t < count; t++) check(tables[t]);
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    tables[count++] = &libc_ops;
+    bench(tables, count, total);
+    return 0;
+}
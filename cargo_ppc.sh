@@ -9,6 +9,8 @@
 SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
 RUSTC_PPC="$SCRIPT_DIR/rustc_ppc"
 BUILD_SYSTEM="$SCRIPT_DIR/rustc_build_system"
+# Socket of the resident compiler started by "cargo_ppc serve"
+SERVER_SOCKET="${RUSTC_PPC_SERVER:-${TMPDIR:-/tmp}/rustc_ppc.$(id -u).sock}"
 
 # Ensure our tools are built
 if [ ! -x "$RUSTC_PPC" ]; then
@@ -39,7 +41,10 @@ case "$1" in
             exit 1
         fi
 
-        # Use our build system
+        # Use our build system; it talks to the compile server if one is up
+        if [ -S "$SERVER_SOCKET" ]; then
+            export RUSTC_PPC_SERVER="$SERVER_SOCKET"
+        fi
         "$BUILD_SYSTEM" build "$PROJECT_DIR" "$@"
         ;;
 
@@ -147,9 +152,32 @@ EOF
         ;;
 
     rustc)
-        # Direct rustc passthrough
+        # Direct rustc passthrough, via the compile server when it is up
         shift
-        "$RUSTC_PPC" "$@"
+        if [ -S "$SERVER_SOCKET" ]; then
+            "$RUSTC_PPC" --client "$SERVER_SOCKET" "$@"
+        else
+            "$RUSTC_PPC" "$@"
+        fi
+        ;;
+
+    serve)
+        # Start a resident rustc_ppc so builds skip the per-file spawn
+        if [ -S "$SERVER_SOCKET" ]; then
+            echo "; compile server already running on $SERVER_SOCKET"
+        else
+            nohup "$RUSTC_PPC" --serve "$SERVER_SOCKET" >/dev/null 2>&1 &
+            echo "; compile server started on $SERVER_SOCKET (pid $!)"
+        fi
+        ;;
+
+    serve-stop)
+        if [ -S "$SERVER_SOCKET" ]; then
+            python3 -c 'import socket,sys; s=socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); s.sendall(b"shutdown\n"); s.recv(64)' "$SERVER_SOCKET"
+            echo "; compile server stopped"
+        else
+            echo "; no compile server on $SERVER_SOCKET"
+        fi
         ;;
 
     version|--version|-V)
@@ -174,6 +202,7 @@ EOF
         echo "  vendor    Fetch deps, skip platform-incompatible crates"
         echo "  deps      Show dependency summary"
         echo "  rustc     Direct rustc_ppc invocation"
+        echo "  serve     Start a resident compile server (serve-stop to end it)"
         echo "  version   Show version info"
         echo ""
         echo "Target: powerpc-apple-darwin8 (Tiger/Leopard)"
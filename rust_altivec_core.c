@@ -0,0 +1,439 @@
+/*
+ * rust_altivec_core.c — AltiVec runtime library behind the _altivec_*
+ * symbols that rustc_ppc output calls
+ *
+ * Compiled with: gcc -std=c99 -O2 -mcpu=7450 -maltivec -c rust_altivec_core.c
+ * (without -maltivec only the portable C table is built)
+ *
+ * Sections:
+ *  1. Portable C: word-at-a-time where both sides line up
+ *  2. The hash, shared by both tables
+ *  3. AltiVec: a scalar head to a 16-byte boundary, whole quadwords,
+ *     a scalar tail; misaligned sources realigned with lvsl/vperm
+ *  4. Dispatch and the entry points
+ */
+
+#if defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "rust_altivec_core.h"
+
+#if defined(__ALTIVEC__) && !defined(__APPLE_ALTIVEC__)
+#include <altivec.h>
+#endif
+
+/* ============================================================
+ * 1. PORTABLE C
+ * ============================================================ */
+
+#if defined(__GNUC__)
+typedef unsigned long __attribute__((__may_alias__)) rt_word;
+#else
+typedef unsigned long rt_word;
+#endif
+
+#define WORD_BYTES sizeof(rt_word)
+#define WORD_ONES ((rt_word)-1 / 0xFF)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+#define HAS_ZERO_BYTE(x) (((x) - WORD_ONES) & ~(x) & WORD_HIGHS)
+#define MISALIGNMENT(p, n) ((size_t)(p) & ((n) - 1))
+
+static void* scalar_copy(void* dst, const void* src, size_t n) {
+    unsigned char* d = dst;
+    const unsigned char* s = src;
+
+    if (n >= 2 * WORD_BYTES && MISALIGNMENT(d, WORD_BYTES) == MISALIGNMENT(s, WORD_BYTES)) {
+        for (; MISALIGNMENT(d, WORD_BYTES); n--) *d++ = *s++;
+        for (; n >= WORD_BYTES; n -= WORD_BYTES, d += WORD_BYTES, s += WORD_BYTES) {
+            *(rt_word*)d = *(const rt_word*)s;
+        }
+    }
+    for (; n; n--) *d++ = *s++;
+    return dst;
+}
+
+static void* scalar_fill(void* dst, int c, size_t n) {
+    unsigned char* d = dst;
+    unsigned char byte = (unsigned char)c;
+
+    if (n >= 2 * WORD_BYTES) {
+        rt_word pattern = WORD_ONES * byte;
+        for (; MISALIGNMENT(d, WORD_BYTES); n--) *d++ = byte;
+        for (; n >= WORD_BYTES; n -= WORD_BYTES, d += WORD_BYTES) *(rt_word*)d = pattern;
+    }
+    for (; n; n--) *d++ = byte;
+    return dst;
+}
+
+static int scalar_compare(const void* a, const void* b, size_t n) {
+    const unsigned char* p = a;
+    const unsigned char* q = b;
+
+    if (n >= 2 * WORD_BYTES && MISALIGNMENT(p, WORD_BYTES) == MISALIGNMENT(q, WORD_BYTES)) {
+        for (; MISALIGNMENT(p, WORD_BYTES); n--, p++, q++) {
+            if (*p != *q) return *p - *q;
+        }
+        /* the byte loop below finds where the first unequal word differs */
+        for (; n >= WORD_BYTES && *(const rt_word*)p == *(const rt_word*)q; n -= WORD_BYTES) {
+            p += WORD_BYTES;
+            q += WORD_BYTES;
+        }
+    }
+    for (; n; n--, p++, q++) {
+        if (*p != *q) return *p - *q;
+    }
+    return 0;
+}
+
+static void* scalar_find_byte(const void* s, int c, size_t n) {
+    const unsigned char* p = s;
+    unsigned char byte = (unsigned char)c;
+    rt_word pattern = WORD_ONES * byte;
+
+    for (; n && MISALIGNMENT(p, WORD_BYTES); n--, p++) {
+        if (*p == byte) return (void*)p;
+    }
+    for (; n >= WORD_BYTES; n -= WORD_BYTES, p += WORD_BYTES) {
+        rt_word x = *(const rt_word*)p ^ pattern;
+        if (HAS_ZERO_BYTE(x)) break;
+    }
+    for (; n; n--, p++) {
+        if (*p == byte) return (void*)p;
+    }
+    return NULL;
+}
+
+static size_t scalar_length(const char* s) {
+    const char* p = s;
+
+    for (; MISALIGNMENT(p, WORD_BYTES); p++) {
+        if (!*p) return (size_t)(p - s);
+    }
+    /* an aligned word never straddles a page, so reading past the
+     * terminator cannot fault */
+    while (!HAS_ZERO_BYTE(*(const rt_word*)p)) p += WORD_BYTES;
+    while (*p) p++;
+    return (size_t)(p - s);
+}
+
+/* ============================================================
+ * 2. THE HASH
+ * Four word lanes, seeded from the length; each 16-byte block is added
+ * in as big-endian words, then every lane is rotated by 13, multiplied
+ * by 9 (x + x << 3) and xor-shifted right by 11 -- steps vadduwm,
+ * vrlw, vslw and vsrw do on all lanes at once. A short last block is
+ * zero-padded and the lanes are folded through MurmurHash3's finalizer.
+ * ============================================================ */
+
+static uint32_t load_be32(const unsigned char* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void hash_seed(uint32_t lanes[4], size_t n) {
+    lanes[0] = 0x243F6A88u ^ (uint32_t)n;
+    lanes[1] = 0x85A308D3u ^ (uint32_t)n;
+    lanes[2] = 0x13198A2Eu ^ (uint32_t)n;
+    lanes[3] = 0x03707344u ^ (uint32_t)n;
+}
+
+static void hash_block(uint32_t lanes[4], const unsigned char* p) {
+    for (int i = 0; i < 4; i++) {
+        uint32_t x = lanes[i] + load_be32(p + 4 * i);
+        x = x << 13 | x >> 19;
+        x += x << 3;
+        lanes[i] = x ^ x >> 11;
+    }
+}
+
+static uint32_t fmix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    return h ^ h >> 16;
+}
+
+static uint32_t hash_finish(uint32_t lanes[4], const unsigned char* tail, size_t n) {
+    if (n) {
+        unsigned char last[16] = { 0 };
+        for (size_t i = 0; i < n; i++) last[i] = tail[i];
+        hash_block(lanes, last);
+    }
+    return fmix32(lanes[0] ^ fmix32(lanes[1] ^ fmix32(lanes[2] ^ fmix32(lanes[3]))));
+}
+
+static uint32_t scalar_hash(const void* key, size_t n) {
+    const unsigned char* p = key;
+    uint32_t lanes[4];
+
+    hash_seed(lanes, n);
+    for (; n >= 16; n -= 16, p += 16) hash_block(lanes, p);
+    return hash_finish(lanes, p, n);
+}
+
+/* First byte through find_byte, the rest through compare */
+static void* search_with(const AltivecOps* ops, const void* hay, size_t hay_len,
+                         const void* needle, size_t needle_len) {
+    const unsigned char* h = hay;
+    const unsigned char* first = needle;
+
+    if (needle_len == 0) return (void*)hay;
+    while (hay_len >= needle_len) {
+        const unsigned char* hit = ops->find_byte(h, *first, hay_len - needle_len + 1);
+        if (!hit) return NULL;
+        if (ops->compare(hit + 1, first + 1, needle_len - 1) == 0) return (void*)hit;
+        hay_len -= (size_t)(hit + 1 - h);
+        h = hit + 1;
+    }
+    return NULL;
+}
+
+static void* scalar_search(const void* hay, size_t hay_len, const void* needle, size_t needle_len) {
+    return search_with(&altivec_scalar_ops, hay, hay_len, needle, needle_len);
+}
+
+const AltivecOps altivec_scalar_ops = {
+    "scalar",
+    scalar_copy,
+    scalar_fill,
+    scalar_compare,
+    scalar_find_byte,
+    scalar_length,
+    scalar_hash,
+    scalar_search,
+};
+
+/* ============================================================
+ * 3. ALTIVEC
+ * Below VECTOR_MIN bytes the head and tail would be all there is, so
+ * the byte loops do the whole job. lvx/stvx ignore the low four address
+ * bits; a misaligned source is read as the two quadwords at +0 and +15
+ * (the same one when it is aligned, so nothing past the run is touched)
+ * and vperm'd with lvsl's control vector.
+ * ============================================================ */
+
+#ifdef __ALTIVEC__
+
+typedef vector unsigned char vu8;
+typedef vector unsigned int vu32;
+
+#define VECTOR_MIN 32
+
+static void store_be32(unsigned char* p, uint32_t x) {
+    p[0] = (unsigned char)(x >> 24);
+    p[1] = (unsigned char)(x >> 16);
+    p[2] = (unsigned char)(x >> 8);
+    p[3] = (unsigned char)x;
+}
+
+static vu8 splat_byte(unsigned char byte) {
+    unsigned char lanes[16] __attribute__((aligned(16)));
+    for (int i = 0; i < 16; i++) lanes[i] = byte;
+    return vec_ld(0, lanes);
+}
+
+static void* vector_copy(void* dst, const void* src, size_t n) {
+    unsigned char* d = dst;
+    const unsigned char* s = src;
+
+    if (n >= VECTOR_MIN) {
+        for (; MISALIGNMENT(d, 16); n--) *d++ = *s++;
+        if (MISALIGNMENT(s, 16) == 0) {
+            for (; n >= 16; n -= 16, d += 16, s += 16) vec_st(vec_ld(0, s), 0, d);
+        } else {
+            vu8 realign = vec_lvsl(0, s);
+            for (; n >= 16; n -= 16, d += 16, s += 16) {
+                vec_st(vec_perm(vec_ld(0, s), vec_ld(15, s), realign), 0, d);
+            }
+        }
+    }
+    for (; n; n--) *d++ = *s++;
+    return dst;
+}
+
+static void* vector_fill(void* dst, int c, size_t n) {
+    unsigned char* d = dst;
+    unsigned char byte = (unsigned char)c;
+
+    if (n >= VECTOR_MIN) {
+        vu8 pattern = splat_byte(byte);
+        for (; MISALIGNMENT(d, 16); n--) *d++ = byte;
+        for (; n >= 16; n -= 16, d += 16) vec_st(pattern, 0, d);
+    }
+    for (; n; n--) *d++ = byte;
+    return dst;
+}
+
+static int vector_compare(const void* a, const void* b, size_t n) {
+    const unsigned char* p = a;
+    const unsigned char* q = b;
+
+    if (n >= VECTOR_MIN) {
+        vu8 realign;
+        for (; MISALIGNMENT(p, 16); n--, p++, q++) {
+            if (*p != *q) return *p - *q;
+        }
+        realign = vec_lvsl(0, q);
+        for (; n >= 16; n -= 16, p += 16, q += 16) {
+            if (!vec_all_eq(vec_ld(0, p), vec_perm(vec_ld(0, q), vec_ld(15, q), realign))) break;
+        }
+    }
+    for (; n; n--, p++, q++) {
+        if (*p != *q) return *p - *q;
+    }
+    return 0;
+}
+
+static void* vector_find_byte(const void* s, int c, size_t n) {
+    const unsigned char* p = s;
+    unsigned char byte = (unsigned char)c;
+
+    if (n >= VECTOR_MIN) {
+        vu8 pattern = splat_byte(byte);
+        for (; MISALIGNMENT(p, 16); n--, p++) {
+            if (*p == byte) return (void*)p;
+        }
+        for (; n >= 16; n -= 16, p += 16) {
+            if (vec_any_eq(vec_ld(0, p), pattern)) break;
+        }
+    }
+    for (; n; n--, p++) {
+        if (*p == byte) return (void*)p;
+    }
+    return NULL;
+}
+
+static size_t vector_length(const char* s) {
+    const unsigned char* p = (const unsigned char*)s;
+    vu8 zero = vec_splat_u8(0);
+
+    for (; MISALIGNMENT(p, 16); p++) {
+        if (!*p) return (size_t)((const char*)p - s);
+    }
+    /* as with words: an aligned quadword never straddles a page */
+    while (!vec_any_eq(vec_ld(0, p), zero)) p += 16;
+    while (*p) p++;
+    return (size_t)((const char*)p - s);
+}
+
+static uint32_t vector_hash(const void* key, size_t n) {
+    const unsigned char* p = key;
+    unsigned char bytes[16] __attribute__((aligned(16)));
+    uint32_t lanes[4];
+    int i;
+
+    hash_seed(lanes, n);
+    if (n >= VECTOR_MIN) {
+        vu32 state, rot = vec_splat_u32(13), mul = vec_splat_u32(3), shift = vec_splat_u32(11);
+        vu8 realign = vec_lvsl(0, p);
+        for (i = 0; i < 4; i++) store_be32(bytes + 4 * i, lanes[i]);
+        state = (vu32)vec_ld(0, bytes);
+        for (; n >= 16; n -= 16, p += 16) {
+            vu8 block = vec_perm(vec_ld(0, p), vec_ld(15, p), realign);
+            state = vec_rl(vec_add(state, (vu32)block), rot);
+            state = vec_add(state, vec_sl(state, mul));
+            state = vec_xor(state, vec_sr(state, shift));
+        }
+        vec_st((vu8)state, 0, bytes);
+        for (i = 0; i < 4; i++) lanes[i] = load_be32(bytes + 4 * i);
+    }
+    for (; n >= 16; n -= 16, p += 16) hash_block(lanes, p);
+    return hash_finish(lanes, p, n);
+}
+
+static void* vector_search(const void* hay, size_t hay_len, const void* needle, size_t needle_len) {
+    return search_with(&altivec_vector_ops, hay, hay_len, needle, needle_len);
+}
+
+const AltivecOps altivec_vector_ops = {
+    "altivec",
+    vector_copy,
+    vector_fill,
+    vector_compare,
+    vector_find_byte,
+    vector_length,
+    vector_hash,
+    vector_search,
+};
+
+#endif /* __ALTIVEC__ */
+
+/* ============================================================
+ * 4. DISPATCH AND ENTRY POINTS
+ * ============================================================ */
+
+#ifndef PPC_FEATURE_HAS_ALTIVEC
+#define PPC_FEATURE_HAS_ALTIVEC 0x10000000
+#endif
+
+/* Set once; threads racing to pick it pick the same table */
+static const AltivecOps* selected_ops;
+
+int altivec_available(void) {
+#if !defined(__ALTIVEC__)
+    return 0;
+#elif defined(__APPLE__)
+    int has = 0;
+    size_t len = sizeof has;
+    return sysctlbyname("hw.optional.altivec", &has, &len, NULL, 0) == 0 && has;
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & PPC_FEATURE_HAS_ALTIVEC) != 0;
+#else
+    return 1;
+#endif
+}
+
+const AltivecOps* altivec_runtime_ops(void) {
+    if (!selected_ops) {
+        const char* env = getenv("RUST_ALTIVEC");
+        const AltivecOps* ops = &altivec_scalar_ops;
+#ifdef __ALTIVEC__
+        if (altivec_available() && !(env && strcmp(env, "0") == 0)) ops = &altivec_vector_ops;
+#endif
+        (void)env;
+        selected_ops = ops;
+    }
+    return selected_ops;
+}
+
+void altivec_runtime_select(const AltivecOps* ops) {
+    selected_ops = ops;
+}
+
+void* altivec_memcpy(void* dst, const void* src, size_t n) {
+    return altivec_runtime_ops()->copy(dst, src, n);
+}
+
+void* altivec_memset(void* dst, int c, size_t n) {
+    return altivec_runtime_ops()->fill(dst, c, n);
+}
+
+int altivec_memcmp(const void* a, const void* b, size_t n) {
+    return altivec_runtime_ops()->compare(a, b, n);
+}
+
+void* altivec_memchr(const void* s, int c, size_t n) {
+    return altivec_runtime_ops()->find_byte(s, c, n);
+}
+
+size_t altivec_strlen(const char* s) {
+    return altivec_runtime_ops()->length(s);
+}
+
+uint32_t altivec_hash(const void* key, size_t n) {
+    return altivec_runtime_ops()->hash(key, n);
+}
+
+void* altivec_memmem(const void* hay, size_t hay_len, const void* needle, size_t needle_len) {
+    return altivec_runtime_ops()->search(hay, hay_len, needle, needle_len);
+}
+
+int altivec_match_slice(const void* data, const void* pattern, size_t n) {
+    return altivec_runtime_ops()->compare(data, pattern, n) == 0;
+}
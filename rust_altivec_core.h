@@ -0,0 +1,61 @@
+/*
+ * rust_altivec_core.h — AltiVec runtime library for rustc_ppc output
+ *
+ * The calls rustc_altivec_codegen.c emits (_altivec_memcpy,
+ * _altivec_strlen, _altivec_hash, _altivec_match_slice) land here, along
+ * with memset/memcmp/memchr and a byte-string search. Each entry point
+ * goes through a dispatch table: the AltiVec one when the library was
+ * built with -maltivec (or -faltivec) and the CPU has a vector unit, the
+ * portable C one otherwise. Both compute the same results, hashes
+ * included, on any host.
+ *
+ * Implemented in rust_altivec_core.c; altivec_bench.c checks and times
+ * both tables.
+ */
+
+#ifndef RUST_ALTIVEC_CORE_H
+#define RUST_ALTIVEC_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char* name;
+    void* (*copy)(void* dst, const void* src, size_t n);
+    void* (*fill)(void* dst, int c, size_t n);
+    int (*compare)(const void* a, const void* b, size_t n);
+    void* (*find_byte)(const void* s, int c, size_t n);
+    size_t (*length)(const char* s);
+    uint32_t (*hash)(const void* key, size_t n);
+    void* (*search)(const void* hay, size_t hay_len, const void* needle, size_t needle_len);
+} AltivecOps;
+
+extern const AltivecOps altivec_scalar_ops;
+#ifdef __ALTIVEC__
+extern const AltivecOps altivec_vector_ops;
+#endif
+
+/* The table the entry points use: picked on first use, from the CPU and
+ * RUST_ALTIVEC=0 in the environment to force the C one */
+const AltivecOps* altivec_runtime_ops(void);
+void altivec_runtime_select(const AltivecOps* ops);
+int altivec_available(void);
+
+/* Entry points, with the usual libc contracts */
+void* altivec_memcpy(void* dst, const void* src, size_t n);
+void* altivec_memset(void* dst, int c, size_t n);
+int altivec_memcmp(const void* a, const void* b, size_t n);
+void* altivec_memchr(const void* s, int c, size_t n);
+size_t altivec_strlen(const char* s);
+
+/* 32-bit hash of n bytes, consuming 16-byte blocks as four word lanes */
+uint32_t altivec_hash(const void* key, size_t n);
+
+/* First occurrence of needle in hay, NULL if none (hay itself for an
+ * empty needle) */
+void* altivec_memmem(const void* hay, size_t hay_len, const void* needle, size_t needle_len);
+
+/* Nonzero when the n bytes at data and pattern are equal */
+int altivec_match_slice(const void* data, const void* pattern, size_t n);
+
+#endif /* RUST_ALTIVEC_CORE_H */
@@ -2,6 +2,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 /* PowerPC Rust Compiler - 100% Modern Rust Support
  * Complete implementation for porting Firefox to PowerPC
@@ -39,89 +50,129 @@ typedef enum {
 } RustType;
 
 typedef struct Variable {
-    char name[64];
+    const char* name;           /* interned */
     RustType type;
     int offset;
     int size;
-    char lifetime[32];
-    char generic_params[128];
+    const char* lifetime;
+    const char* generic_params;
     int is_mut;
     int ref_count;  // For Rc/Arc
     struct Variable* drop_chain;  // For RAII
+    int sym;        /* interned name */
+    int shadow;     /* index of the binding this one shadows, -1 if none */
+    int reg;        /* GPR holding the value instead of the slot, 0 if none */
+    RustType elem;  /* TYPE_SLICE: element type; the slot holds ptr, len */
 } Variable;
 
+/* One fn item with a body, recorded by Pass 1 in source order */
 typedef struct {
-    char name[64];
-    char params[256];
-    char return_type[64];
-    char where_clause[256];
-    char generic_params[128];
+    const char* name;           /* interned */
+    const char* label;          /* deduplicated asm label, without the '_' */
+    const char* owner;          /* impl self type, NULL for free functions */
+    int owner_struct;           /* structs[] index of owner, -1 if none */
+    int fn_tok;                 /* token index of "fn" */
+    int body_tok;               /* token index of the body's '{' */
+    int body_end_tok;           /* ... and of its matching '}' */
+    int has_self;
+    int param_count;            /* including self */
+    const char** param_names;   /* interned, NULL for pattern params */
+    const char* return_type;
     int is_async;
     int is_unsafe;
     int is_const;
+    int is_pub;                 /* plain pub: visible to other crates */
+    int inline_hint;            /* INLINE_*, from #[inline(...)] */
 } Function;
 
+/* #[inline] hints on a fn item */
+enum { INLINE_AUTO, INLINE_HINT, INLINE_ALWAYS, INLINE_NEVER };
+enum { FP_CONTRACT_OFF, FP_CONTRACT_ON, FP_CONTRACT_FAST };
+
 typedef struct {
-    char name[32];
+    const char* name;           /* interned */
     RustType type;
     int offset;
     int size;
 } StructField;
 
 typedef struct {
-    char name[64];
-    StructField fields[32];
+    const char* name;           /* interned */
+    StructField* fields;
     int field_count;
-    char generics[128];
+    int field_capacity;
+    const char* generics;
     /* derives not needed for codegen */
     int size;
     int alignment;
 } Struct;
 
 typedef struct {
-    char name[64];
-    char methods[2048];
-    char assoc_types[512];
-    char assoc_consts[512];
-    char supertraits[256];
+    const char* name;           /* interned */
+    const char* methods;
+    const char* assoc_types;
+    const char* assoc_consts;
+    const char* supertraits;
 } Trait;
 
 typedef struct {
-    char struct_name[64];
-    char trait_name[64];
-    char methods[2048];
-    char where_clause[256];
+    const char* struct_name;
+    const char* trait_name;     /* "" for inherent impls */
+    const char* methods;
+    const char* where_clause;
 } ImplBlock;
 
 typedef struct {
-    char name[64];
-    char expansion[1024];
+    const char* name;
+    const char* expansion;
     int is_builtin;
 } Macro;
 
-/* Global compiler state */
-Variable vars[500];
-Function functions[200];
-Struct structs[100];
-Trait traits[100];
-ImplBlock impls[200];
-Macro macros[50];
-
-int var_count = 0;
-int func_count = 0;
-int struct_count = 0;
-int string_label_count = 0;  /* Global string label counter - never resets */
-int trait_count = 0;
-int impl_count = 0;
-int macro_count = 0;
-int current_impl_struct = -1;  /* Index into structs[] for self.field resolution */
-int stack_offset = 72;  /* Past PPC linkage area (24) + param save area (8*4=32) + padding (16) */
-int heap_offset = 0;
-int async_context_size = 0;
-
-char* pos;
-int in_unsafe_block = 0;
-int in_async_block = 0;
+/* A const or static item, recorded by Pass 1 and evaluated at compile
+ * time on first use (const_item_eval) */
+enum { CONST_PENDING, CONST_BUSY, CONST_KNOWN, CONST_UNKNOWN };
+
+typedef struct {
+    int sym;
+    int type_tok;               /* first token of the declared type */
+    int init_tok;               /* first token of the initializer ... */
+    int end_tok;                /* ... and its ';' */
+    int is_static;
+    int is_mut;
+    int state;                  /* CONST_* */
+    RustType type;              /* scalar type, or the element type of an array */
+    int is_array;
+    long long value;
+    long long* elems;           /* is_array: elem_count values */
+    int elem_count;
+} ConstItem;
+
+/* A let binding or parameter inside a const fn being evaluated */
+typedef struct {
+    int sym;
+    long long value;
+    RustType type;
+    int typed;
+} ConstBinding;
+
+/* An f32/f64 constant the code loads from the literal pool, Lfconst_N */
+typedef struct {
+    unsigned long long bits;    /* IEEE encoding; an f32's in the low word */
+    int single;
+} FloatConst;
+
+/* Compilation arena: every table and string that lives for one
+ * compilation is bump-allocated here and released in one shot by
+ * arena_release(), so memory use follows the input size and there
+ * are no fixed table limits. */
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaChunk;
+
+#define ARENA_CHUNK_SIZE (256 * 1024)
 
 /* Memory management */
 typedef struct HeapBlock {
@@ -131,413 +182,1474 @@ typedef struct HeapBlock {
     struct HeapBlock* next;
 } HeapBlock;
 
-HeapBlock* heap_blocks = NULL;
+/* Lexer: the source is tokenized once up front. Every pass walks the
+ * token array instead of re-skipping comments, strings and whitespace
+ * in the raw text. Tokens keep their byte offset into the source so the
+ * character-level sub-parsers (types, expressions) can still work from
+ * pos; identifiers are interned so keyword tests are integer compares.
+ */
+typedef enum {
+    TOK_EOF, TOK_IDENT, TOK_INT, TOK_FLOAT, TOK_STRING, TOK_CHAR,
+    TOK_LIFETIME, TOK_PUNCT
+} TokenKind;
+
+/* Keyword IDs double as the symbol IDs of the keywords: they are the
+ * first strings interned, in this order, so sym < KW_COUNT is a keyword. */
+typedef enum {
+    KW_AS, KW_ASYNC, KW_BREAK, KW_CONST, KW_CONTINUE, KW_CRATE, KW_DYN,
+    KW_ELSE, KW_ENUM, KW_EXTERN, KW_FALSE, KW_FN, KW_FOR, KW_IF, KW_IMPL,
+    KW_IN, KW_LET, KW_LOOP, KW_MATCH, KW_MOD, KW_MOVE, KW_MUT, KW_PUB,
+    KW_REF, KW_RETURN, KW_SELF, KW_SELF_TYPE, KW_STATIC, KW_STRUCT,
+    KW_SUPER, KW_TRAIT, KW_TRUE, KW_TYPE, KW_UNSAFE, KW_USE, KW_WHERE,
+    KW_WHILE,
+    KW_COUNT
+} Keyword;
+
+static const char* keyword_names[KW_COUNT] = {
+    "as", "async", "break", "const", "continue", "crate", "dyn",
+    "else", "enum", "extern", "false", "fn", "for", "if", "impl",
+    "in", "let", "loop", "match", "mod", "move", "mut", "pub",
+    "ref", "return", "self", "Self", "static", "struct",
+    "super", "trait", "true", "type", "unsafe", "use", "where",
+    "while"
+};
+
+/* Non-keyword names the passes test for, interned right after the keywords */
+enum {
+    SYM_MAIN = KW_COUNT, SYM_PRINTLN, SYM_ASSERT, SYM_MACRO_RULES,
+    SYM_INLINE, SYM_ALWAYS, SYM_NEVER,
+    SYM_WELL_KNOWN_END
+};
+
+static const char* well_known_names[SYM_WELL_KNOWN_END - KW_COUNT] = {
+    "main", "println", "assert", "macro_rules",
+    "inline", "always", "never"
+};
+
+typedef struct {
+    unsigned char kind;  /* TokenKind */
+    char ch;             /* punctuation character for TOK_PUNCT */
+    int start;           /* byte offset into the source */
+    int len;
+    int sym;             /* interned ID for identifiers, -1 otherwise */
+} Token;
+
+/* Identifier interner: open-addressed hash of string -> dense ID.
+ * Names live in the compilation arena so sym_name() pointers stay valid. */
+typedef struct {
+    unsigned int hash;
+    const char* name;
+    int len;
+    /* Bindings hang off the symbol so resolution is one hash lookup */
+    int var;             /* innermost live variable, -1 if none */
+    int struct_idx;      /* structs[] index, -1 if none */
+    int trait_idx;       /* traits[] index, -1 if none */
+    int const_idx;       /* consts[] index, -1 if none */
+    int const_fn;        /* functions[] index of a const fn, -1 if none */
+    int free_fn;         /* functions[] index of the first free fn, -1 if none */
+    int label_uses;      /* times emitted as a function label (dedup) */
+} SymEntry;
+
+/* Per-file label counters for the statement compilers */
+typedef struct {
+    int if_label;
+    int while_label;
+    int for_label;
+    int loop_label;
+    int match_let;      /* let x = match ... */
+    int match_stmt;     /* match as a statement */
+    int cond;           /* short-circuit targets inside conditions */
+    int wide;           /* 64-bit compares: past the low-word compare */
+    int fp;             /* float to integer conversions */
+} LabelCounters;
+
+/* Per-compilation options from -C / -Z */
+typedef struct {
+    int opt_level;          /* -C opt-level: 0-3 (s and z count as 2) */
+    int target_cpu;         /* -C target-cpu: index into target_cpus[] */
+    int altivec;            /* -C target-feature: +1 / -1, 0 = the CPU's default */
+    int symtab_stats;       /* -Z symtab-stats */
+    int peephole_stats;     /* -Z peephole-stats */
+    int time_passes;        /* -Z time-passes */
+    int emit_ir;            /* --emit=ir: print the IR instead of assembly */
+    int emit_metadata;      /* --emit=metadata: write NAME.rmeta beside the output */
+    int match_stats;        /* -Z match-stats */
+    int schedule_stats;     /* -Z schedule-stats */
+    int inline_threshold;   /* -C inline-threshold: IR instructions, 0 = INLINE_THRESHOLD */
+    int fp_contract;        /* -C fp-contract: FP_CONTRACT_*; on or fast fuse a * b + c into fmadd */
+    const char* externs[32];    /* --extern NAME=PATH: dependency metadata */
+    int extern_count;
+} CompileOptions;
+
+/* Pipelines the scheduler models, sched_models[] */
+enum { SCHED_750, SCHED_7400, SCHED_7450, SCHED_970 };
+
+/* -C target-cpu names. Entry 0 is the default when none is given; it
+ * schedules for the 7400, which neither the G3 nor the G4e minds. */
+typedef struct {
+    const char* name;
+    const char* machine;    /* .machine directive, NULL for none */
+    int altivec;
+    int sched;              /* SCHED_* pipeline to schedule for */
+} TargetCpu;
+
+static const TargetCpu target_cpus[] = {
+    { "generic", NULL,      0, SCHED_7400 },
+    { "750",     "ppc750",  0, SCHED_750 },
+    { "g3",      "ppc750",  0, SCHED_750 },
+    { "7400",    "ppc7400", 1, SCHED_7400 },
+    { "g4",      "ppc7400", 1, SCHED_7400 },
+    { "7450",    "ppc7450", 1, SCHED_7450 },
+    { "970",     "ppc970",  1, SCHED_970 },
+    { "g5",      "ppc970",  1, SCHED_970 },
+};
+#define TARGET_CPU_COUNT ((int)(sizeof(target_cpus) / sizeof(target_cpus[0])))
+
+/* Whether AltiVec code may be emitted: an explicit +/-altivec wins over
+ * what the CPU has */
+static int target_altivec(const CompileOptions* o) {
+    return o->altivec ? o->altivec > 0 : target_cpus[o->target_cpu].altivec;
+}
+
+/* The .machine the assembler needs; +altivec on a CPU without it asks
+ * for the first one that has it */
+static const char* target_machine(const CompileOptions* o) {
+    const TargetCpu* cpu = &target_cpus[o->target_cpu];
+    return (target_altivec(o) && !cpu->altivec) ? "ppc7400" : cpu->machine;
+}
+
+#define OUT_BUF_SIZE (256 * 1024)
+
+/* Everything one compilation reads or writes. The parser and emitter
+ * take it as their first argument instead of sharing globals, so
+ * several files can compile at once on different threads (-j); Tiger's
+ * gcc 4.0 has no __thread to make globals per-thread instead. */
+typedef struct CompilerContext {
+    /* Compilation arena */
+    ArenaChunk* arena_chunks;
+    size_t arena_bytes;          /* total chunk bytes held */
+
+    /* Arena-backed tables. Each table always has a free slot at [count]
+     * that the parsers fill in before *_declare(). */
+    Variable* vars;
+    Function* functions;
+    Struct* structs;
+    Trait* traits;
+    ImplBlock* impls;
+    Macro* macros;
+    ConstItem* consts;
+    ConstBinding* const_env;     /* bindings of the const fn calls in progress */
+    FloatConst* float_consts;
+    int var_capacity;
+    int func_capacity;
+    int struct_capacity;
+    int trait_capacity;
+    int impl_capacity;
+    int macro_capacity;
+    int const_capacity;
+    int const_env_capacity;
+    int float_const_capacity;
+    int var_count;
+    int func_count;
+    int struct_count;
+    int trait_count;
+    int impl_count;
+    int macro_count;
+    int const_count;
+    int const_env_count;
+    int float_const_count;
+
+    /* Interner */
+    SymEntry* sym_entries;
+    int sym_count;
+    int sym_capacity;
+    int* sym_buckets;            /* entry index + 1, 0 = empty */
+    int sym_bucket_count;        /* power of two */
+    long sym_lookups;            /* -Z symtab-stats: hash lookups ... */
+    long sym_probes;             /* ... and buckets examined by them */
+
+    /* Token stream */
+    Token* tokens;
+    int tok_count;
+    int tok_capacity;
+    int tok_cursor;              /* last token returned by tok_at(), speeds up forward scans */
+    char* src_base;              /* start of the source the tokens index into */
+    char* pos;                   /* character-level parse position */
+
+    /* Code generation */
+    int string_label_count;      /* string literal labels, per file */
+    int current_impl_struct;     /* index into structs[] for self.field resolution */
+    RustType return_type;        /* integer or float return type of the fn being compiled, TYPE_I32 if none */
+    int block_depth;             /* compile_function_body nesting; 1 = function body */
+    int loop_regs;               /* volatile GPRs (r12 down) held by enclosing counted loops */
+    int ctr_busy;                /* an enclosing counted loop owns CTR */
+    int fpr_live;                /* f1 up to this hold an enclosing float expression's values */
+    LabelCounters labels;
+    int stack_offset;            /* past linkage area (24) + param save area (32) + padding (16) */
+    int heap_offset;
+    int async_context_size;
+    int in_unsafe_block;
+    int in_async_block;
+    HeapBlock* heap_blocks;
+    unsigned int current_file_hash;
+    char label_buf[256];         /* sanitize_label() result */
+
+    /* Output */
+    char* out_buf;
+    size_t out_len;
+    size_t out_cap;              /* OUT_BUF_SIZE unless grown while held */
+    int out_hold;                /* keep the whole file buffered for the peephole pass */
+    FILE* out_file;              /* NULL = stdout */
+    char meta_path[2048];        /* --emit=metadata output */
+
+    CompileOptions opts;
+    char error[1024];            /* last failure, for --serve and -j reports */
+    const char* input;           /* the file being compiled, for errors */
+    int error_count;             /* errors reported while compiling it */
+    int error_toks[32];          /* operators const_expr_at() reported errors at */
+    int error_tok_count;
+} CompilerContext;
+
+static ArenaChunk* arena_new_chunk(CompilerContext* cx, size_t size) {
+    ArenaChunk* c = malloc(sizeof(ArenaChunk) + size);
+    if (!c) {
+        fprintf(stderr, "rustc_ppc: out of memory\n");
+        exit(1);
+    }
+    c->used = 0;
+    c->size = size;
+    cx->arena_bytes += size;
+    return c;
+}
+
+/* Zeroed, 8-byte aligned */
+void* arena_alloc(CompilerContext* cx, size_t size) {
+    void* p;
+    size = (size + 7) & ~(size_t)7;
+    if (size > ARENA_CHUNK_SIZE / 4) {
+        /* Big tables get a chunk of their own, linked behind the current
+         * one so the current chunk keeps bumping */
+        ArenaChunk* c = arena_new_chunk(cx, size);
+        c->used = size;
+        if (cx->arena_chunks) {
+            c->next = cx->arena_chunks->next;
+            cx->arena_chunks->next = c;
+        } else {
+            c->next = NULL;
+            cx->arena_chunks = c;
+        }
+        p = c->data;
+    } else {
+        if (!cx->arena_chunks || cx->arena_chunks->used + size > cx->arena_chunks->size) {
+            ArenaChunk* c = arena_new_chunk(cx, ARENA_CHUNK_SIZE);
+            c->next = cx->arena_chunks;
+            cx->arena_chunks = c;
+        }
+        p = cx->arena_chunks->data + cx->arena_chunks->used;
+        cx->arena_chunks->used += size;
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+char* arena_strndup(CompilerContext* cx, const char* s, int len) {
+    char* d = arena_alloc(cx, len + 1);
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+char* arena_strdup(CompilerContext* cx, const char* s) {
+    return arena_strndup(cx, s, strlen(s));
+}
+
+/* Ensure table[count] exists, doubling into fresh arena space. The old
+ * copy is reclaimed with the rest of the arena. */
+void* table_reserve(CompilerContext* cx, void* table, int count, int* capacity, size_t elem_size) {
+    if (count < *capacity) return table;
+    int new_cap = *capacity ? *capacity * 2 : 16;
+    while (new_cap <= count) new_cap *= 2;
+    void* grown = arena_alloc(cx, (size_t)new_cap * elem_size);
+    if (count > 0) memcpy(grown, table, (size_t)count * elem_size);
+    *capacity = new_cap;
+    return grown;
+}
+
+/* Assembly output. Instructions are formatted straight into one large
+ * buffer by a small printf subset (%d %i %u %x %X %o %s %c %%, with
+ * width, 0-padding and l) and written out in big fwrite()s; stdio's
+ * vfprintf was a large share of per-file compile time. -o picks the
+ * output file, stdout otherwise. */
+void emit_flush(CompilerContext* cx) {
+    if (cx->out_len > 0) {
+        fwrite(cx->out_buf, 1, cx->out_len, cx->out_file ? cx->out_file : stdout);
+        cx->out_len = 0;
+    }
+}
+
+/* While output is held nothing is written; the buffer doubles instead */
+static void emit_grow(CompilerContext* cx, size_t need) {
+    size_t cap = cx->out_cap * 2;
+    while (cap < need) cap *= 2;
+    cx->out_buf = realloc(cx->out_buf, cap);
+    if (!cx->out_buf) {
+        fprintf(stderr, "rustc_ppc: out of memory\n");
+        exit(1);
+    }
+    cx->out_cap = cap;
+}
+
+void emit_raw(CompilerContext* cx, const char* s, size_t n) {
+    if (cx->out_len + n > cx->out_cap) {
+        if (cx->out_hold) {
+            emit_grow(cx, cx->out_len + n);
+        } else {
+            emit_flush(cx);
+            if (n > cx->out_cap) {
+                fwrite(s, 1, n, cx->out_file ? cx->out_file : stdout);
+                return;
+            }
+        }
+    }
+    memcpy(cx->out_buf + cx->out_len, s, n);
+    cx->out_len += n;
+}
+
+void emit_char(CompilerContext* cx, char c) {
+    if (cx->out_len == cx->out_cap) {
+        if (cx->out_hold) emit_grow(cx, cx->out_len + 1);
+        else emit_flush(cx);
+    }
+    cx->out_buf[cx->out_len++] = c;
+}
+
+/* Digits of v in base, right-aligned in width with pad */
+static void emit_uint(CompilerContext* cx, unsigned long v, int base, int upper, int width, char pad) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[32];
+    int n = sizeof(tmp);
+    do {
+        tmp[--n] = digits[v % base];
+        v /= base;
+    } while (v);
+    while (n > 0 && (int)sizeof(tmp) - n < width) tmp[--n] = pad;
+    emit_raw(cx, tmp + n, sizeof(tmp) - n);
+}
+
+static void emit_sint(CompilerContext* cx, long v, int width, char pad) {
+    if (v >= 0 && v < 10 && width <= 1) {
+        /* Register numbers and small immediates: the common case */
+        emit_char(cx, '0' + (char)v);
+    } else if (v < 0) {
+        if (pad == '0') {
+            emit_char(cx, '-');
+            emit_uint(cx, -(unsigned long)v, 10, 0, width - 1, pad);
+        } else {
+            char tmp[32];
+            int n = sizeof(tmp);
+            unsigned long u = -(unsigned long)v;
+            do { tmp[--n] = '0' + u % 10; u /= 10; } while (u);
+            tmp[--n] = '-';
+            while (n > 0 && (int)sizeof(tmp) - n < width) tmp[--n] = ' ';
+            emit_raw(cx, tmp + n, sizeof(tmp) - n);
+        }
+    } else {
+        emit_uint(cx, (unsigned long)v, 10, 0, width, pad);
+    }
+}
+
+void emit(CompilerContext* cx, const char* fmt, ...) {
+    va_list ap;
+    const char* p = fmt;
+    va_start(ap, fmt);
+    while (*p) {
+        const char* lit = p;
+        while (*p && *p != '%') p++;
+        if (p > lit) emit_raw(cx, lit, p - lit);
+        if (!*p) break;
+        p++;
+
+        char pad = ' ';
+        int width = 0;
+        int is_long = 0;
+        if (*p == '0') { pad = '0'; p++; }
+        while (*p >= '0' && *p <= '9') width = width * 10 + (*p++ - '0');
+        if (*p == 'l') { is_long = 1; p++; }
+
+        switch (*p) {
+            case 'd': case 'i':
+                emit_sint(cx, is_long ? va_arg(ap, long) : va_arg(ap, int), width, pad);
+                break;
+            case 'u': case 'x': case 'X': case 'o': {
+                unsigned long v = is_long ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int);
+                int base = (*p == 'u') ? 10 : (*p == 'o') ? 8 : 16;
+                emit_uint(cx, v, base, *p == 'X', width, pad);
+                break;
+            }
+            case 's': {
+                const char* s = va_arg(ap, const char*);
+                size_t n;
+                if (!s) s = "(null)";
+                n = strlen(s);
+                while ((int)n < width--) emit_char(cx, ' ');
+                emit_raw(cx, s, n);
+                break;
+            }
+            case 'c':
+                emit_char(cx, (char)va_arg(ap, int));
+                break;
+            case '%':
+                emit_char(cx, '%');
+                break;
+            default:
+                /* Not part of the subset — print the directive as-is */
+                emit_char(cx, '%');
+                if (*p) emit_char(cx, *p);
+                break;
+        }
+        if (*p) p++;
+    }
+    va_end(ap);
+}
+
+static unsigned int sym_hash(const char* s, int len) {
+    unsigned int h = 2166136261u;
+    int i;
+    for (i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void sym_rehash(CompilerContext* cx, int new_count) {
+    cx->sym_buckets = arena_alloc(cx, new_count * sizeof(int));
+    cx->sym_bucket_count = new_count;
+    int i;
+    for (i = 0; i < cx->sym_count; i++) {
+        unsigned int b = cx->sym_entries[i].hash & (new_count - 1);
+        while (cx->sym_buckets[b]) b = (b + 1) & (new_count - 1);
+        cx->sym_buckets[b] = i + 1;
+    }
+}
+
+/* Probe for a name; returns its ID, or -1 with *slot set to the empty
+ * bucket where it would go */
+static int sym_probe(CompilerContext* cx, const char* s, int len, unsigned int h, unsigned int* slot) {
+    unsigned int b = h & (cx->sym_bucket_count - 1);
+    cx->sym_lookups++;
+    cx->sym_probes++;
+    while (cx->sym_buckets[b]) {
+        SymEntry* e = &cx->sym_entries[cx->sym_buckets[b] - 1];
+        if (e->hash == h && e->len == len && memcmp(e->name, s, len) == 0) {
+            return cx->sym_buckets[b] - 1;
+        }
+        b = (b + 1) & (cx->sym_bucket_count - 1);
+        cx->sym_probes++;
+    }
+    *slot = b;
+    return -1;
+}
+
+/* Return the ID for a name, adding it on first sight */
+int intern(CompilerContext* cx, const char* s, int len) {
+    if (cx->sym_count * 2 >= cx->sym_bucket_count) {
+        sym_rehash(cx, cx->sym_bucket_count ? cx->sym_bucket_count * 2 : 1024);
+    }
+    unsigned int h = sym_hash(s, len);
+    unsigned int b;
+    int found = sym_probe(cx, s, len, h, &b);
+    if (found >= 0) return found;
+    cx->sym_entries = table_reserve(cx, cx->sym_entries, cx->sym_count, &cx->sym_capacity, sizeof(SymEntry));
+    cx->sym_entries[cx->sym_count].hash = h;
+    cx->sym_entries[cx->sym_count].name = arena_strndup(cx, s, len);
+    cx->sym_entries[cx->sym_count].len = len;
+    cx->sym_entries[cx->sym_count].var = -1;
+    cx->sym_entries[cx->sym_count].struct_idx = -1;
+    cx->sym_entries[cx->sym_count].trait_idx = -1;
+    cx->sym_entries[cx->sym_count].const_idx = -1;
+    cx->sym_entries[cx->sym_count].const_fn = -1;
+    cx->sym_entries[cx->sym_count].free_fn = -1;
+    cx->sym_entries[cx->sym_count].label_uses = 0;
+    cx->sym_buckets[b] = cx->sym_count + 1;
+    return cx->sym_count++;
+}
+
+/* Look a name up without interning it; -1 if it was never seen */
+int sym_find(CompilerContext* cx, const char* s, int len) {
+    unsigned int b;
+    if (cx->sym_bucket_count == 0) return -1;
+    return sym_probe(cx, s, len, sym_hash(s, len), &b);
+}
+
+const char* sym_name(CompilerContext* cx, int sym) {
+    return (sym >= 0 && sym < cx->sym_count) ? cx->sym_entries[sym].name : "";
+}
+
+const char* intern_str(CompilerContext* cx, const char* s) {
+    return sym_name(cx, intern(cx, s, strlen(s)));
+}
+
+/* Scoped name resolution. Each symbol holds its innermost variable
+ * binding and every Variable remembers the binding it shadows, so a
+ * lookup is one hash probe and leaving a scope just unlinks the vars
+ * declared since the scope's mark (compile_function_body's
+ * saved_var_count). Later bindings win, as in Rust. */
+void var_declare(CompilerContext* cx, const char* name) {
+    Variable* v = &cx->vars[cx->var_count];
+    v->sym = intern(cx, name, strlen(name));
+    v->name = sym_name(cx, v->sym);
+    v->reg = 0;
+    v->shadow = cx->sym_entries[v->sym].var;
+    cx->sym_entries[v->sym].var = cx->var_count++;
+    cx->vars = table_reserve(cx, cx->vars, cx->var_count, &cx->var_capacity, sizeof(Variable));
+}
+
+Variable* var_lookup(CompilerContext* cx, const char* name) {
+    int sym = sym_find(cx, name, strlen(name));
+    if (sym < 0 || cx->sym_entries[sym].var < 0) return NULL;
+    return &cx->vars[cx->sym_entries[sym].var];
+}
+
+/* i64/u64: a register pair, the high word in the slot's first four bytes */
+static int type_wide(RustType t) {
+    return t == TYPE_I64 || t == TYPE_U64;
+}
+
+/* f32/f64: one FPR, a 4- or 8-byte slot */
+static int type_float(RustType t) {
+    return t == TYPE_F32 || t == TYPE_F64;
+}
+
+/* Load v into reg from wherever it lives; note follows "load NAME". An
+ * i64/u64 in one register is its low word, as `as u32` would give. */
+void emit_var_load(CompilerContext* cx, int reg, const Variable* v, const char* note) {
+    if (v->reg) emit(cx, "    mr r%d, r%d        ; load %s%s\n", reg, v->reg, v->name, note);
+    else if (type_wide(v->type)) emit(cx, "    lwz r%d, %d(r1)   ; load %s%s (low)\n", reg, v->offset + 4, v->name, note);
+    else emit(cx, "    lwz r%d, %d(r1)   ; load %s%s\n", reg, v->offset, v->name, note);
+}
+
+void scope_pop(CompilerContext* cx, int mark) {
+    while (cx->var_count > mark) {
+        Variable* v = &cx->vars[--cx->var_count];
+        cx->sym_entries[v->sym].var = v->shadow;
+    }
+}
+
+/* Structs (and enums) and traits live in one namespace per kind; the
+ * first definition of a name wins, matching the old first-match scan. */
+int struct_lookup(CompilerContext* cx, const char* name) {
+    int sym = sym_find(cx, name, strlen(name));
+    return sym < 0 ? -1 : cx->sym_entries[sym].struct_idx;
+}
+
+void struct_declare(CompilerContext* cx) {
+    int sym = intern(cx, cx->structs[cx->struct_count].name, strlen(cx->structs[cx->struct_count].name));
+    if (cx->sym_entries[sym].struct_idx < 0) cx->sym_entries[sym].struct_idx = cx->struct_count;
+    cx->struct_count++;
+    cx->structs = table_reserve(cx, cx->structs, cx->struct_count, &cx->struct_capacity, sizeof(Struct));
+}
+
+void struct_add_field(CompilerContext* cx, Struct* s, const char* name, RustType type, int offset, int size) {
+    s->fields = table_reserve(cx, s->fields, s->field_count, &s->field_capacity, sizeof(StructField));
+    StructField* f = &s->fields[s->field_count++];
+    f->name = intern_str(cx, name);
+    f->type = type;
+    f->offset = offset;
+    f->size = size;
+}
+
+void trait_declare(CompilerContext* cx) {
+    int sym = intern(cx, cx->traits[cx->trait_count].name, strlen(cx->traits[cx->trait_count].name));
+    if (cx->sym_entries[sym].trait_idx < 0) cx->sym_entries[sym].trait_idx = cx->trait_count;
+    cx->trait_count++;
+    cx->traits = table_reserve(cx, cx->traits, cx->trait_count, &cx->trait_capacity, sizeof(Trait));
+}
+
+void impl_declare(CompilerContext* cx, const char* struct_name, const char* trait_name) {
+    cx->impls[cx->impl_count].struct_name = intern_str(cx, struct_name);
+    cx->impls[cx->impl_count].trait_name = trait_name[0] ? intern_str(cx, trait_name) : "";
+    cx->impl_count++;
+    cx->impls = table_reserve(cx, cx->impls, cx->impl_count, &cx->impl_capacity, sizeof(ImplBlock));
+}
+
+void macro_declare(CompilerContext* cx, const char* name, int is_builtin) {
+    cx->macros[cx->macro_count].name = arena_strdup(cx, name);
+    cx->macros[cx->macro_count].is_builtin = is_builtin;
+    cx->macro_count++;
+    cx->macros = table_reserve(cx, cx->macros, cx->macro_count, &cx->macro_capacity, sizeof(Macro));
+}
+
+/* Give every table its free slot; called before each compilation */
+void compiler_state_init(CompilerContext* cx) {
+    cx->vars = table_reserve(cx, cx->vars, 0, &cx->var_capacity, sizeof(Variable));
+    cx->functions = table_reserve(cx, cx->functions, 0, &cx->func_capacity, sizeof(Function));
+    cx->structs = table_reserve(cx, cx->structs, 0, &cx->struct_capacity, sizeof(Struct));
+    cx->traits = table_reserve(cx, cx->traits, 0, &cx->trait_capacity, sizeof(Trait));
+    cx->impls = table_reserve(cx, cx->impls, 0, &cx->impl_capacity, sizeof(ImplBlock));
+    cx->macros = table_reserve(cx, cx->macros, 0, &cx->macro_capacity, sizeof(Macro));
+    cx->consts = table_reserve(cx, cx->consts, 0, &cx->const_capacity, sizeof(ConstItem));
+    cx->const_env = table_reserve(cx, cx->const_env, 0, &cx->const_env_capacity, sizeof(ConstBinding));
+    cx->float_consts = table_reserve(cx, cx->float_consts, 0, &cx->float_const_capacity, sizeof(FloatConst));
+}
+
+/* Drop everything the compilation allocated in one go */
+void arena_release(CompilerContext* cx) {
+    while (cx->arena_chunks) {
+        ArenaChunk* next = cx->arena_chunks->next;
+        free(cx->arena_chunks);
+        cx->arena_chunks = next;
+    }
+    cx->arena_bytes = 0;
+    cx->vars = NULL; cx->functions = NULL; cx->structs = NULL;
+    cx->traits = NULL; cx->impls = NULL; cx->macros = NULL;
+    cx->consts = NULL; cx->const_env = NULL; cx->float_consts = NULL;
+    cx->var_capacity = cx->func_capacity = cx->struct_capacity = 0;
+    cx->trait_capacity = cx->impl_capacity = cx->macro_capacity = 0;
+    cx->const_capacity = cx->const_env_capacity = cx->float_const_capacity = 0;
+    cx->var_count = cx->func_count = cx->struct_count = 0;
+    cx->trait_count = cx->impl_count = cx->macro_count = 0;
+    cx->const_count = cx->const_env_count = cx->float_const_count = 0;
+    cx->sym_entries = NULL; cx->sym_buckets = NULL;
+    cx->sym_count = cx->sym_capacity = cx->sym_bucket_count = 0;
+    cx->tokens = NULL;
+    cx->tok_count = cx->tok_capacity = cx->tok_cursor = 0;
+}
+
+static void tok_push(CompilerContext* cx, TokenKind kind, const char* start, int len, int sym) {
+    cx->tokens = table_reserve(cx, cx->tokens, cx->tok_count, &cx->tok_capacity, sizeof(Token));
+    Token* t = &cx->tokens[cx->tok_count++];
+    t->kind = (unsigned char)kind;
+    t->ch = (kind == TOK_PUNCT) ? *start : 0;
+    t->start = (int)(start - cx->src_base);
+    t->len = len;
+    t->sym = sym;
+}
+
+static int is_ident_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || (unsigned char)c >= 0x80;
+}
+
+/* Tokenize the whole source once. Comments and whitespace are dropped;
+ * a TOK_EOF sentinel is always appended. */
+void lex_source(CompilerContext* cx, char* source) {
+    char* p = source;
+    cx->src_base = source;
+    cx->tok_count = 0;
+    cx->tok_cursor = 0;
+
+    if (cx->sym_count == 0) {
+        int k;
+        for (k = 0; k < KW_COUNT; k++) {
+            intern(cx, keyword_names[k], strlen(keyword_names[k]));
+        }
+        for (k = KW_COUNT; k < SYM_WELL_KNOWN_END; k++) {
+            intern(cx, well_known_names[k - KW_COUNT], strlen(well_known_names[k - KW_COUNT]));
+        }
+    }
+
+    while (*p) {
+        char c = *p;
+        if (isspace((unsigned char)c)) { p++; continue; }
+
+        if (c == '/' && p[1] == '/') {
+            while (*p && *p != '\n') p++;
+            continue;
+        }
+        if (c == '/' && p[1] == '*') {
+            /* Rust block comments nest */
+            int depth = 1;
+            p += 2;
+            while (*p && depth > 0) {
+                if (*p == '/' && p[1] == '*') { depth++; p += 2; }
+                else if (*p == '*' && p[1] == '/') { depth--; p += 2; }
+                else p++;
+            }
+            continue;
+        }
+
+        char* start = p;
+
+        /* Raw strings r"..." / r#"..."# and byte strings b"..." / br"..." */
+        if ((c == 'r' && (p[1] == '"' || (p[1] == '#' && (p[2] == '"' || p[2] == '#')))) ||
+            (c == 'b' && p[1] == 'r' && (p[2] == '"' || p[2] == '#'))) {
+            p += (c == 'b') ? 2 : 1;
+            int hashes = 0;
+            while (*p == '#') { hashes++; p++; }
+            if (*p == '"') {
+                p++;
+                while (*p) {
+                    if (*p == '"') {
+                        int h = 0;
+                        while (h < hashes && p[1 + h] == '#') h++;
+                        if (h == hashes) { p += 1 + hashes; break; }
+                    }
+                    p++;
+                }
+                tok_push(cx, TOK_STRING, start, (int)(p - start), -1);
+                continue;
+            }
+            p = start; /* r#ident — fall through to identifier handling */
+        }
+        if (c == '"' || (c == 'b' && p[1] == '"')) {
+            if (c == 'b') p++;
+            p++;
+            while (*p && *p != '"') {
+                if (*p == '\\' && p[1]) p++;
+                p++;
+            }
+            if (*p == '"') p++;
+            tok_push(cx, TOK_STRING, start, (int)(p - start), -1);
+            continue;
+        }
+
+        /* Char literal 'x' / '\n' / b'x' versus lifetime 'a */
+        if (c == '\'' || (c == 'b' && p[1] == '\'')) {
+            char* q = (c == 'b') ? p + 2 : p + 1;
+            if (*q == '\\') {
+                q += 2;
+                while (*q && *q != '\'' && *q != '\n') q++;
+                if (*q == '\'') q++;
+                tok_push(cx, TOK_CHAR, start, (int)(q - start), -1);
+                p = q;
+                continue;
+            }
+            /* Skip one (possibly multi-byte UTF-8) character */
+            char* after = q;
+            if (*after) {
+                after++;
+                while (((unsigned char)*after & 0xC0) == 0x80) after++;
+            }
+            if (*after == '\'') {
+                tok_push(cx, TOK_CHAR, start, (int)(after + 1 - start), -1);
+                p = after + 1;
+                continue;
+            }
+            if (c == '\'') {
+                p++;
+                while (is_ident_char(*p)) p++;
+                tok_push(cx, TOK_LIFETIME, start, (int)(p - start), -1);
+                continue;
+            }
+        }
+
+        if (isdigit((unsigned char)c)) {
+            TokenKind kind = TOK_INT;
+            if (c == '0' && (p[1] == 'x' || p[1] == 'o' || p[1] == 'b')) p += 2;
+            while (isalnum((unsigned char)*p) || *p == '_') p++;
+            /* 1.5 is a float, 0..10 is a range */
+            if (*p == '.' && isdigit((unsigned char)p[1])) {
+                kind = TOK_FLOAT;
+                p++;
+                while (isalnum((unsigned char)*p) || *p == '_') p++;
+            }
+            tok_push(cx, kind, start, (int)(p - start), -1);
+            continue;
+        }
+
+        if (is_ident_char(c)) {
+            /* r#ident raw identifiers intern as the bare name */
+            char* name = p;
+            if (c == 'r' && p[1] == '#' && is_ident_char(p[2])) {
+                p += 2;
+                name = p;
+            }
+            while (is_ident_char(*p)) p++;
+            tok_push(cx, TOK_IDENT, start, (int)(p - start), intern(cx, name, (int)(p - name)));
+            continue;
+        }
+
+        tok_push(cx, TOK_PUNCT, p, 1, -1);
+        p++;
+    }
+    tok_push(cx, TOK_EOF, p, 0, -1);
+    cx->tok_count--; /* sentinel stays addressable at tokens[tok_count] */
+}
+
+/* Keyword ID of a token, or -1 */
+static int tok_kw(const Token* t) {
+    return (t->kind == TOK_IDENT && t->sym < KW_COUNT) ? t->sym : -1;
+}
+
+static int tok_is_punct(const Token* t, char c) {
+    return t->kind == TOK_PUNCT && t->ch == c;
+}
+
+static char* tok_ptr(CompilerContext* cx, const Token* t) {
+    return cx->src_base + t->start;
+}
+
+static char* tok_end(CompilerContext* cx, const Token* t) {
+    return cx->src_base + t->start + t->len;
+}
+
+/* Index of the first token starting at or after p. Parsers mostly move
+ * forward, so try a short walk from the cursor before bisecting. */
+int tok_index_at(CompilerContext* cx, const char* p) {
+    int off = (int)(p - cx->src_base);
+    int i = cx->tok_cursor;
+    if (i > cx->tok_count) i = cx->tok_count;
+    if (cx->tokens[i].start >= off && (i == 0 || cx->tokens[i - 1].start < off)) {
+        return i;
+    }
+    if (cx->tokens[i].start < off) {
+        int steps = 0;
+        while (i < cx->tok_count && cx->tokens[i].start < off && steps < 16) { i++; steps++; }
+        if (cx->tokens[i].start >= off && (i == 0 || cx->tokens[i - 1].start < off)) {
+            cx->tok_cursor = i;
+            return i;
+        }
+    }
+    int lo = 0, hi = cx->tok_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cx->tokens[mid].start < off) lo = mid + 1;
+        else hi = mid;
+    }
+    cx->tok_cursor = lo;
+    return lo;
+}
+
+Token* tok_at(CompilerContext* cx, const char* p) {
+    return &cx->tokens[tok_index_at(cx, p)];
+}
+
+/* Move pos past whitespace and comments to the next token */
+void skip_trivia(CompilerContext* cx) {
+    cx->pos = tok_ptr(cx, tok_at(cx, cx->pos));
+}
+
+/* Index of the token matching the opener at index i ({ ( [), or tok_count */
+int tok_match_close(CompilerContext* cx, int i) {
+    char open = cx->tokens[i].ch;
+    char close = (open == '(') ? ')' : (open == '[') ? ']' : '}';
+    int depth = 0;
+    for (; i < cx->tok_count; i++) {
+        if (cx->tokens[i].kind != TOK_PUNCT) continue;
+        if (cx->tokens[i].ch == open) depth++;
+        else if (cx->tokens[i].ch == close && --depth == 0) return i;
+    }
+    return cx->tok_count;
+}
+
+/* Index just past a generic argument list starting at i ('<'), or i */
+static int tok_skip_angles(CompilerContext* cx, int i) {
+    int depth = 0;
+    if (!tok_is_punct(&cx->tokens[i], '<')) return i;
+    for (; i < cx->tok_count; i++) {
+        if (cx->tokens[i].kind != TOK_PUNCT) continue;
+        if (cx->tokens[i].ch == '<') depth++;
+        else if (cx->tokens[i].ch == '>' && !tok_is_punct(&cx->tokens[i - 1], '-') && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return cx->tok_count;
+}
+
+/* Parse a type path (a::b::C<..>, &T, dyn T) at i. *sym gets the last
+ * segment's symbol, -1 if there is none. Returns the index after it. */
+static int tok_type_path(CompilerContext* cx, int i, int* sym) {
+    *sym = -1;
+    while (tok_is_punct(&cx->tokens[i], '&') || tok_kw(&cx->tokens[i]) == KW_DYN ||
+           tok_kw(&cx->tokens[i]) == KW_MUT) {
+        i++;
+    }
+    while (cx->tokens[i].kind == TOK_IDENT) {
+        int kw = tok_kw(&cx->tokens[i]);
+        if (kw >= 0 && kw != KW_CRATE && kw != KW_SUPER && kw != KW_SELF_TYPE) break;
+        *sym = cx->tokens[i].sym;
+        i++;
+        if (tok_is_punct(&cx->tokens[i], ':') && tok_is_punct(&cx->tokens[i + 1], ':')) i += 2;
+        else break;
+    }
+    return tok_skip_angles(cx, i);
+}
+
+/* "impl [<..>] Path [for Path]" at token ti: returns the implementing
+ * type's symbol and stores the trait's in *trait_sym (-1 if inherent) */
+int impl_header(CompilerContext* cx, int ti, int* trait_sym) {
+    int first, second;
+    int i = tok_type_path(cx, tok_skip_angles(cx, ti + 1), &first);
+    if (tok_kw(&cx->tokens[i]) == KW_FOR) {
+        tok_type_path(cx, i + 1, &second);
+        *trait_sym = first;
+        return second;
+    }
+    *trait_sym = -1;
+    return first;
+}
+
+/* impl in item position, as opposed to `-> impl Trait` / `x: impl Trait` */
+static int tok_is_impl_item(CompilerContext* cx, int ti) {
+    const Token* prev;
+    if (ti == 0) return 1;
+    prev = &cx->tokens[ti - 1];
+    return tok_is_punct(prev, '{') || tok_is_punct(prev, '}') || tok_is_punct(prev, ';') ||
+           tok_is_punct(prev, ']') || tok_kw(prev) == KW_UNSAFE;
+}
+
+/* Record the fn item at token ti (`fn name ...`) in functions[]; owner is
+ * the symbol of the enclosing impl's self type or -1. Returns the index,
+ * or -1 for a bodiless declaration. */
+int function_declare(CompilerContext* cx, int ti, int owner) {
+    Function* fn = &cx->functions[cx->func_count];
+    int i = tok_skip_angles(cx, ti + 2);
+    int k;
+
+    memset(fn, 0, sizeof(*fn));
+    fn->name = sym_name(cx, cx->tokens[ti + 1].sym);
+    fn->owner = owner >= 0 ? sym_name(cx, owner) : NULL;
+    fn->owner_struct = -1;
+    fn->fn_tok = ti;
+
+    /* Qualifiers: [pub[(..)]] [const] [async] [unsafe] [extern "C"] fn */
+    for (k = ti - 1; k >= 0; k--) {
+        int kw = tok_kw(&cx->tokens[k]);
+        if (kw == KW_ASYNC) fn->is_async = 1;
+        else if (kw == KW_UNSAFE) fn->is_unsafe = 1;
+        else if (kw == KW_CONST) fn->is_const = 1;
+        else if (kw == KW_PUB) fn->is_pub = 1;
+        else if (tok_is_punct(&cx->tokens[k], ')') && k >= 3 && tok_kw(&cx->tokens[k - 3]) == KW_PUB
+                 && tok_is_punct(&cx->tokens[k - 2], '(')) k -= 3;    /* pub(crate): not exported */
+        else if (kw != KW_EXTERN && cx->tokens[k].kind != TOK_STRING) break;
+    }
+
+    /* Attributes ahead of them: #[inline], #[inline(always)], #[inline(never)] */
+    while (k >= 2 && tok_is_punct(&cx->tokens[k], ']')) {
+        int open = k - 1, depth = 0;
+        while (open > 0 && !(depth == 0 && tok_is_punct(&cx->tokens[open], '['))) {
+            if (tok_is_punct(&cx->tokens[open], ']')) depth++;
+            else if (tok_is_punct(&cx->tokens[open], '[')) depth--;
+            open--;
+        }
+        if (open < 1 || !tok_is_punct(&cx->tokens[open - 1], '#')) break;
+        if (cx->tokens[open + 1].sym == SYM_INLINE) {
+            const Token* arg = &cx->tokens[open + 3];
+            fn->inline_hint = !tok_is_punct(arg - 1, '(') ? INLINE_HINT
+                            : arg->sym == SYM_ALWAYS ? INLINE_ALWAYS
+                            : arg->sym == SYM_NEVER ? INLINE_NEVER : INLINE_HINT;
+        }
+        k = open - 2;
+    }
+
+    /* Parameters: one per top-level comma-separated segment */
+    if (tok_is_punct(&cx->tokens[i], '(')) {
+        int close = tok_match_close(cx, i);
+        int seg = i + 1;
+        int depth = 0;
+        fn->param_names = arena_alloc(cx, (close - i) * sizeof(const char*));
+        for (k = i + 1; k <= close; k++) {
+            const Token* t = &cx->tokens[k];
+            if (k < close && t->kind == TOK_PUNCT) {
+                if (t->ch == '(' || t->ch == '[' || t->ch == '<') depth++;
+                else if (t->ch == ')' || t->ch == ']' ||
+                         (t->ch == '>' && !tok_is_punct(t - 1, '-'))) depth--;
+            }
+            if (k < close && !(depth == 0 && tok_is_punct(t, ','))) continue;
+            if (k > seg) {
+                /* Binding is the ident before the first single ':' */
+                const char* name = NULL;
+                int j, is_self = 0;
+                for (j = seg; j < k; j++) {
+                    const Token* p = &cx->tokens[j];
+                    if (tok_is_punct(p, ':') && !tok_is_punct(p + 1, ':') &&
+                        !tok_is_punct(p - 1, ':')) break;
+                    if (tok_kw(p) == KW_SELF) is_self = 1;
+                    else if (p->kind == TOK_IDENT && tok_kw(p) < 0) name = sym_name(cx, p->sym);
+                    else if (tok_is_punct(p, '(') || tok_is_punct(p, '[')) { name = NULL; break; }
+                }
+                if (is_self && fn->param_count == 0) {
+                    fn->has_self = 1;
+                    name = sym_name(cx, KW_SELF);
+                }
+                fn->param_names[fn->param_count++] = name;
+            }
+            seg = k + 1;
+        }
+        i = close + 1;
+    }
+
+    /* -> ReturnType up to the body or where clause */
+    if (tok_is_punct(&cx->tokens[i], '-') && tok_is_punct(&cx->tokens[i + 1], '>')) {
+        int r = i + 2;
+        while (r < cx->tok_count && !tok_is_punct(&cx->tokens[r], '{') &&
+               !tok_is_punct(&cx->tokens[r], ';') && tok_kw(&cx->tokens[r]) != KW_WHERE) {
+            r++;
+        }
+        if (r > i + 2) {
+            fn->return_type = arena_strndup(cx, tok_ptr(cx, &cx->tokens[i + 2]),
+                                            (int)(tok_ptr(cx, &cx->tokens[r - 1]) - tok_ptr(cx, &cx->tokens[i + 2])) + cx->tokens[r - 1].len);
+        }
+        i = r;
+    }
+
+    /* A ';' before any '{' is a trait method declaration with no body */
+    while (i < cx->tok_count && !tok_is_punct(&cx->tokens[i], '{') && !tok_is_punct(&cx->tokens[i], ';')) i++;
+    if (i >= cx->tok_count || tok_is_punct(&cx->tokens[i], ';')) return -1;
+    fn->body_tok = i;
+    fn->body_end_tok = tok_match_close(cx, i);
+
+    /* Label: Type_method or just the name; repeats get _1, _2, ... */
+    if (fn->name != sym_name(cx, SYM_MAIN)) {
+        char label[160];
+        int label_sym, dup;
+        if (fn->owner) snprintf(label, sizeof(label), "%s_%s", fn->owner, fn->name);
+        else snprintf(label, sizeof(label), "%s", fn->name);
+        label_sym = intern(cx, label, strlen(label));
+        dup = cx->sym_entries[label_sym].label_uses++;
+        if (dup > 0) {
+            char suffix[16];
+            snprintf(suffix, sizeof(suffix), "_%d", dup);
+            strncat(label, suffix, sizeof(label) - strlen(label) - 1);
+        }
+        fn->label = intern_str(cx, label);
+    } else {
+        fn->label = fn->name;
+    }
+
+    cx->func_count++;
+    cx->functions = table_reserve(cx, cx->functions, cx->func_count, &cx->func_capacity, sizeof(Function));
+    return cx->func_count - 1;
+}
+
+/* Record the const/static item at token ti (`const NAME: T = ...;` or
+ * `static [mut] NAME: T = ...;`). Items without an initializer (trait
+ * consts, extern statics) are not recorded. Returns the token index of
+ * the closing ';', or ti. */
+int const_declare(CompilerContext* cx, int ti) {
+    ConstItem* c = &cx->consts[cx->const_count];
+    int i = ti + 1, depth = 0;
+
+    memset(c, 0, sizeof(*c));
+    c->is_static = tok_kw(&cx->tokens[ti]) == KW_STATIC;
+    if (c->is_static && tok_kw(&cx->tokens[i]) == KW_MUT) {
+        c->is_mut = 1;
+        i++;
+    }
+    if (cx->tokens[i].kind != TOK_IDENT || tok_kw(&cx->tokens[i]) >= 0 ||
+        !tok_is_punct(&cx->tokens[i + 1], ':') || tok_is_punct(&cx->tokens[i + 2], ':')) {
+        return ti;
+    }
+    c->sym = cx->tokens[i].sym;
+    c->type_tok = i + 2;
+    for (i += 2; i < cx->tok_count; i++) {
+        const Token* t = &cx->tokens[i];
+        if (t->kind != TOK_PUNCT) continue;
+        if (t->ch == '(' || t->ch == '[' || t->ch == '{') depth++;
+        else if (t->ch == ')' || t->ch == ']' || t->ch == '}') depth--;
+        else if (depth == 0 && t->ch == ';') break;
+        else if (depth == 0 && t->ch == '=' && !c->init_tok) c->init_tok = i + 1;
+        if (depth < 0) return ti;
+    }
+    if (!c->init_tok || i >= cx->tok_count) return ti;
+    c->end_tok = i;
+    if (cx->sym_entries[c->sym].const_idx < 0) cx->sym_entries[c->sym].const_idx = cx->const_count;
+    cx->const_count++;
+    cx->consts = table_reserve(cx, cx->consts, cx->const_count, &cx->const_capacity, sizeof(ConstItem));
+    return i;
+}
 
-void skip_whitespace() {
-    while (*pos && isspace(*pos)) pos++;
+void skip_whitespace(CompilerContext* cx) {
+    while (*cx->pos && isspace(*cx->pos)) cx->pos++;
 }
 
-int parse_number() {
+int parse_number(CompilerContext* cx) {
     int num = 0;
     int sign = 1;
     
-    if (*pos == '-') {
+    if (*cx->pos == '-') {
         sign = -1;
-        pos++;
+        cx->pos++;
     }
     
     /* Handle hex, octal, binary */
-    if (*pos == '0' && *(pos+1) == 'x') {
-        pos += 2;
-        while (*pos && isxdigit(*pos)) {
-            num = num * 16 + (isdigit(*pos) ? *pos - '0' : 
-                             tolower(*pos) - 'a' + 10);
-            pos++;
-        }
-    } else if (*pos == '0' && *(pos+1) == 'b') {
-        pos += 2;
-        while (*pos && (*pos == '0' || *pos == '1')) {
-            num = num * 2 + (*pos - '0');
-            pos++;
+    if (*cx->pos == '0' && *(cx->pos+1) == 'x') {
+        cx->pos += 2;
+        while (*cx->pos && isxdigit(*cx->pos)) {
+            num = num * 16 + (isdigit(*cx->pos) ? *cx->pos - '0' : 
+                             tolower(*cx->pos) - 'a' + 10);
+            cx->pos++;
+        }
+    } else if (*cx->pos == '0' && *(cx->pos+1) == 'b') {
+        cx->pos += 2;
+        while (*cx->pos && (*cx->pos == '0' || *cx->pos == '1')) {
+            num = num * 2 + (*cx->pos - '0');
+            cx->pos++;
         }
     } else {
-        while (*pos && isdigit(*pos)) {
-            num = num * 10 + (*pos - '0');
-            pos++;
+        while (*cx->pos && isdigit(*cx->pos)) {
+            num = num * 10 + (*cx->pos - '0');
+            cx->pos++;
         }
     }
     
     /* Type suffix (i32, u64, etc) */
-    if (*pos == 'i' || *pos == 'u' || *pos == 'f') {
-        while (*pos && isalnum(*pos)) pos++;
+    if (*cx->pos == 'i' || *cx->pos == 'u' || *cx->pos == 'f') {
+        while (*cx->pos && isalnum(*cx->pos)) cx->pos++;
     }
     
     return num * sign;
 }
 
-void parse_string(char* dest, int max_len) {
+void parse_string(CompilerContext* cx, char* dest, int max_len) {
     int i = 0;
-    while (*pos && (isalnum(*pos) || *pos == '_') && i < max_len - 1) {
-        dest[i++] = *pos++;
+    while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_') && i < max_len - 1) {
+        dest[i++] = *cx->pos++;
     }
     dest[i] = '\0';
 }
 
 /* Skip balanced angle brackets <...> including nested generics */
-void skip_generic_params() {
-    if (*pos != '<') return;
+void skip_generic_params(CompilerContext* cx) {
+    if (*cx->pos != '<') return;
     int depth = 1;
-    pos++;
-    while (*pos && depth > 0) {
-        if (*pos == '<') depth++;
-        else if (*pos == '>') {
+    cx->pos++;
+    while (*cx->pos && depth > 0) {
+        if (*cx->pos == '<') depth++;
+        else if (*cx->pos == '>') {
             /* Don't count > in -> as closing generic */
-            if (*(pos-1) == '-') {
-                pos++;
+            if (*(cx->pos-1) == '-') {
+                cx->pos++;
                 continue;
             }
             depth--;
-        } else if (*pos == '(' || *pos == '[' || *pos == '{') {
+        } else if (*cx->pos == '(' || *cx->pos == '[' || *cx->pos == '{') {
             /* Skip nested parens/brackets/braces inside generics */
-            char open = *pos;
+            char open = *cx->pos;
             char close = (open == '(') ? ')' : (open == '{') ? '}' : ']';
             int inner = 1;
-            pos++;
-            while (*pos && inner > 0) {
-                if (*pos == open) inner++;
-                else if (*pos == close) inner--;
-                pos++;
+            cx->pos++;
+            while (*cx->pos && inner > 0) {
+                if (*cx->pos == open) inner++;
+                else if (*cx->pos == close) inner--;
+                cx->pos++;
             }
             continue;
         }
-        pos++;
+        cx->pos++;
     }
 }
 
-RustType parse_type() {
-    skip_whitespace();
+RustType parse_type(CompilerContext* cx) {
+    skip_whitespace(cx);
 
     /* Skip lifetime annotations: 'a, 'static, 'lifetime, etc. */
-    if (*pos == '\'' && (isalpha(*(pos+1)) || *(pos+1) == '_')) {
-        pos++; /* skip apostrophe */
-        while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
-        skip_whitespace();
+    if (*cx->pos == '\'' && (isalpha(*(cx->pos+1)) || *(cx->pos+1) == '_')) {
+        cx->pos++; /* skip apostrophe */
+        while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
+        skip_whitespace(cx);
         /* After lifetime, might have + for trait bounds: 'a + Send */
-        while (*pos == '+') {
-            pos++;
-            skip_whitespace();
-            while (*pos && (isalnum(*pos) || *pos == '_' || *pos == ':')) pos++;
-            skip_whitespace();
+        while (*cx->pos == '+') {
+            cx->pos++;
+            skip_whitespace(cx);
+            while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_' || *cx->pos == ':')) cx->pos++;
+            skip_whitespace(cx);
         }
     }
 
     /* Skip #[...] attributes (e.g., #[from] in enum variants) */
-    while (*pos == '#' && *(pos+1) == '[') {
-        pos += 2;
+    while (*cx->pos == '#' && *(cx->pos+1) == '[') {
+        cx->pos += 2;
         int bracket_depth = 1;
-        while (*pos && bracket_depth > 0) {
-            if (*pos == '[') bracket_depth++;
-            else if (*pos == ']') bracket_depth--;
-            pos++;
+        while (*cx->pos && bracket_depth > 0) {
+            if (*cx->pos == '[') bracket_depth++;
+            else if (*cx->pos == ']') bracket_depth--;
+            cx->pos++;
         }
-        skip_whitespace();
+        skip_whitespace(cx);
     }
 
-    if (*pos == '<') {
+    if (*cx->pos == '<') {
         /* Qualified type: <Type as Trait>::AssocType or <T>::Item */
-        skip_generic_params();
-        skip_whitespace();
+        skip_generic_params(cx);
+        skip_whitespace(cx);
         /* Skip :: and associated type name */
-        if (*pos == ':' && *(pos+1) == ':') {
-            pos += 2;
-            while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
-            skip_whitespace();
-            if (*pos == '<') skip_generic_params();
+        if (*cx->pos == ':' && *(cx->pos+1) == ':') {
+            cx->pos += 2;
+            while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
+            skip_whitespace(cx);
+            if (*cx->pos == '<') skip_generic_params(cx);
         }
         return TYPE_STRUCT;
-    } else if (*pos == '[') {
+    } else if (*cx->pos == '[') {
         /* Array type: [Type; N] or slice [Type] */
-        pos++;
-        parse_type(); /* skip element type */
-        skip_whitespace();
-        if (*pos == ';') {
-            pos++;
-            skip_whitespace();
-            while (*pos && *pos != ']') pos++; /* skip size expr */
-            if (*pos == ']') pos++;
+        cx->pos++;
+        parse_type(cx); /* skip element type */
+        skip_whitespace(cx);
+        if (*cx->pos == ';') {
+            cx->pos++;
+            skip_whitespace(cx);
+            while (*cx->pos && *cx->pos != ']') cx->pos++; /* skip size expr */
+            if (*cx->pos == ']') cx->pos++;
             return TYPE_ARRAY;
         }
-        if (*pos == ']') pos++;
+        if (*cx->pos == ']') cx->pos++;
         return TYPE_SLICE;
-    } else if (*pos == '(') {
+    } else if (*cx->pos == '(') {
         /* Tuple type: (T1, T2, ...) or unit () */
-        pos++;
-        while (*pos && *pos != ')') {
-            parse_type();
-            skip_whitespace();
-            if (*pos == ',') pos++;
-            skip_whitespace();
-        }
-        if (*pos == ')') pos++;
+        cx->pos++;
+        while (*cx->pos && *cx->pos != ')') {
+            parse_type(cx);
+            skip_whitespace(cx);
+            if (*cx->pos == ',') cx->pos++;
+            skip_whitespace(cx);
+        }
+        if (*cx->pos == ')') cx->pos++;
         return TYPE_TUPLE;
-    } else if (*pos == '*') {
+    } else if (*cx->pos == '*') {
         /* Raw pointer: *const T or *mut T */
-        pos++;
-        skip_whitespace();
-        if (strncmp(pos, "const ", 6) == 0) pos += 6;
-        else if (strncmp(pos, "mut ", 4) == 0) pos += 4;
-        parse_type();
+        cx->pos++;
+        skip_whitespace(cx);
+        if (strncmp(cx->pos, "const ", 6) == 0) cx->pos += 6;
+        else if (strncmp(cx->pos, "mut ", 4) == 0) cx->pos += 4;
+        parse_type(cx);
         return TYPE_REF;
-    } else if (*pos == '&') {
-        pos++;
-        skip_whitespace();
+    } else if (*cx->pos == '&') {
+        cx->pos++;
+        skip_whitespace(cx);
         /* Skip lifetime after &: &'a T, &'static T */
-        if (*pos == '\'' && (isalpha(*(pos+1)) || *(pos+1) == '_')) {
-            pos++;
-            while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
-            skip_whitespace();
-        }
-        if (strncmp(pos, "mut ", 4) == 0) {
-            pos += 4;
-            parse_type(); /* skip inner type */
+        if (*cx->pos == '\'' && (isalpha(*(cx->pos+1)) || *(cx->pos+1) == '_')) {
+            cx->pos++;
+            while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
+            skip_whitespace(cx);
+        }
+        if (strncmp(cx->pos, "mut ", 4) == 0) {
+            cx->pos += 4;
+            parse_type(cx); /* skip inner type */
             return TYPE_MUT_REF;
         }
-        parse_type(); /* skip inner type */
+        parse_type(cx); /* skip inner type */
         return TYPE_REF;
-    } else if (strncmp(pos, "Box<", 4) == 0) {
-        pos += 3; skip_generic_params();
+    } else if (strncmp(cx->pos, "Box<", 4) == 0) {
+        cx->pos += 3; skip_generic_params(cx);
         return TYPE_BOX;
-    } else if (strncmp(pos, "Rc<", 3) == 0) {
-        pos += 2; skip_generic_params();
+    } else if (strncmp(cx->pos, "Rc<", 3) == 0) {
+        cx->pos += 2; skip_generic_params(cx);
         return TYPE_RC;
-    } else if (strncmp(pos, "Arc<", 4) == 0) {
-        pos += 3; skip_generic_params();
+    } else if (strncmp(cx->pos, "Arc<", 4) == 0) {
+        cx->pos += 3; skip_generic_params(cx);
         return TYPE_ARC;
-    } else if (strncmp(pos, "Vec<", 4) == 0) {
-        pos += 3; skip_generic_params();
+    } else if (strncmp(cx->pos, "Vec<", 4) == 0) {
+        cx->pos += 3; skip_generic_params(cx);
         return TYPE_VEC;
-    } else if (strncmp(pos, "Option<", 7) == 0) {
-        pos += 6; skip_generic_params();
+    } else if (strncmp(cx->pos, "Option<", 7) == 0) {
+        cx->pos += 6; skip_generic_params(cx);
         return TYPE_OPTION;
-    } else if (strncmp(pos, "Result<", 7) == 0) {
-        pos += 6; skip_generic_params();
+    } else if (strncmp(cx->pos, "Result<", 7) == 0) {
+        cx->pos += 6; skip_generic_params(cx);
         return TYPE_RESULT;
-    } else if (strncmp(pos, "String", 6) == 0 && !isalnum(*(pos+6)) && *(pos+6) != '_') {
-        pos += 6;
-        skip_whitespace();
-        if (*pos == '<') skip_generic_params(); /* String<'bump> etc. */
+    } else if (strncmp(cx->pos, "String", 6) == 0 && !isalnum(*(cx->pos+6)) && *(cx->pos+6) != '_') {
+        cx->pos += 6;
+        skip_whitespace(cx);
+        if (*cx->pos == '<') skip_generic_params(cx); /* String<'bump> etc. */
         return TYPE_STRING;
-    } else if (strncmp(pos, "str", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "str", 3) == 0) {
+        cx->pos += 3;
         return TYPE_STR;
-    } else if (strncmp(pos, "bool", 4) == 0) {
-        pos += 4;
+    } else if (strncmp(cx->pos, "bool", 4) == 0) {
+        cx->pos += 4;
         return TYPE_BOOL;
-    } else if (strncmp(pos, "char", 4) == 0) {
-        pos += 4;
+    } else if (strncmp(cx->pos, "char", 4) == 0) {
+        cx->pos += 4;
         return TYPE_CHAR;
-    } else if (strncmp(pos, "dyn ", 4) == 0) {
-        pos += 4;
-        skip_whitespace();
+    } else if (strncmp(cx->pos, "dyn ", 4) == 0) {
+        cx->pos += 4;
+        skip_whitespace(cx);
         /* Skip for<'a> higher-ranked trait bounds */
-        if (strncmp(pos, "for<", 4) == 0) {
-            pos += 3;
-            skip_generic_params();
-            skip_whitespace();
+        if (strncmp(cx->pos, "for<", 4) == 0) {
+            cx->pos += 3;
+            skip_generic_params(cx);
+            skip_whitespace(cx);
         }
         /* Handle Fn/FnMut/FnOnce trait objects with (...) -> T syntax */
-        if (strncmp(pos, "FnOnce", 6) == 0 || strncmp(pos, "FnMut", 5) == 0 || strncmp(pos, "Fn(", 3) == 0) {
-            while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
-            skip_whitespace();
-            if (*pos == '(') {
-                int pd = 1; pos++;
-                while (*pos && pd > 0) { if (*pos == '(') pd++; else if (*pos == ')') pd--; pos++; }
-            }
-            skip_whitespace();
-            if (*pos == '-' && *(pos+1) == '>') {
-                pos += 2;
-                skip_whitespace();
-                parse_type();
+        if (strncmp(cx->pos, "FnOnce", 6) == 0 || strncmp(cx->pos, "FnMut", 5) == 0 || strncmp(cx->pos, "Fn(", 3) == 0) {
+            while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
+            skip_whitespace(cx);
+            if (*cx->pos == '(') {
+                int pd = 1; cx->pos++;
+                while (*cx->pos && pd > 0) { if (*cx->pos == '(') pd++; else if (*cx->pos == ')') pd--; cx->pos++; }
+            }
+            skip_whitespace(cx);
+            if (*cx->pos == '-' && *(cx->pos+1) == '>') {
+                cx->pos += 2;
+                skip_whitespace(cx);
+                parse_type(cx);
             }
         } else {
-            parse_type(); /* skip trait name */
+            parse_type(cx); /* skip trait name */
         }
         /* Handle + Send + Sync + 'static etc. */
-        skip_whitespace();
-        while (*pos == '+') {
-            pos++;
-            skip_whitespace();
+        skip_whitespace(cx);
+        while (*cx->pos == '+') {
+            cx->pos++;
+            skip_whitespace(cx);
             /* Skip lifetime like 'static */
-            if (*pos == '\'' && (isalpha(*(pos+1)) || *(pos+1) == '_')) {
-                pos++;
-                while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
+            if (*cx->pos == '\'' && (isalpha(*(cx->pos+1)) || *(cx->pos+1) == '_')) {
+                cx->pos++;
+                while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
             } else {
-                parse_type(); /* skip next trait bound */
+                parse_type(cx); /* skip next trait bound */
             }
-            skip_whitespace();
+            skip_whitespace(cx);
         }
         return TYPE_TRAIT_OBJ;
-    } else if ((strncmp(pos, "fn(", 3) == 0) || (strncmp(pos, "fn (", 4) == 0) ||
-               (strncmp(pos, "unsafe fn", 9) == 0) ||
-               (strncmp(pos, "extern ", 7) == 0 && strstr(pos, "fn") != NULL && (strstr(pos, "fn") - pos) < 20) ||
-               (strncmp(pos, "for<", 4) == 0)) {
+    } else if ((strncmp(cx->pos, "fn(", 3) == 0) || (strncmp(cx->pos, "fn (", 4) == 0) ||
+               (strncmp(cx->pos, "unsafe fn", 9) == 0) ||
+               (strncmp(cx->pos, "extern ", 7) == 0 && strstr(cx->pos, "fn") != NULL && (strstr(cx->pos, "fn") - cx->pos) < 20) ||
+               (strncmp(cx->pos, "for<", 4) == 0)) {
         /* Function pointer type: fn(...) -> T, unsafe fn(...), extern "C" fn(...), for<'a> Fn(...) */
         /* Skip qualifiers */
-        if (strncmp(pos, "for<", 4) == 0) {
-            pos += 3;
-            skip_generic_params();
-            skip_whitespace();
-        }
-        if (strncmp(pos, "unsafe ", 7) == 0) pos += 7;
-        if (strncmp(pos, "extern ", 7) == 0) {
-            pos += 7;
-            skip_whitespace();
-            if (*pos == '"') { pos++; while (*pos && *pos != '"') pos++; if (*pos == '"') pos++; }
-            skip_whitespace();
+        if (strncmp(cx->pos, "for<", 4) == 0) {
+            cx->pos += 3;
+            skip_generic_params(cx);
+            skip_whitespace(cx);
+        }
+        if (strncmp(cx->pos, "unsafe ", 7) == 0) cx->pos += 7;
+        if (strncmp(cx->pos, "extern ", 7) == 0) {
+            cx->pos += 7;
+            skip_whitespace(cx);
+            if (*cx->pos == '"') { cx->pos++; while (*cx->pos && *cx->pos != '"') cx->pos++; if (*cx->pos == '"') cx->pos++; }
+            skip_whitespace(cx);
         }
         /* Skip fn/Fn/FnMut/FnOnce */
-        if (strncmp(pos, "fn", 2) == 0) { pos += 2; }
-        else if (strncmp(pos, "FnOnce", 6) == 0) { pos += 6; }
-        else if (strncmp(pos, "FnMut", 5) == 0) { pos += 5; }
-        else if (strncmp(pos, "Fn", 2) == 0) { pos += 2; }
-        skip_whitespace();
+        if (strncmp(cx->pos, "fn", 2) == 0) { cx->pos += 2; }
+        else if (strncmp(cx->pos, "FnOnce", 6) == 0) { cx->pos += 6; }
+        else if (strncmp(cx->pos, "FnMut", 5) == 0) { cx->pos += 5; }
+        else if (strncmp(cx->pos, "Fn", 2) == 0) { cx->pos += 2; }
+        skip_whitespace(cx);
         /* Skip parameter list (...) */
-        if (*pos == '(') {
+        if (*cx->pos == '(') {
             int paren_depth = 1;
-            pos++;
-            while (*pos && paren_depth > 0) {
-                if (*pos == '(') paren_depth++;
-                else if (*pos == ')') paren_depth--;
-                pos++;
+            cx->pos++;
+            while (*cx->pos && paren_depth > 0) {
+                if (*cx->pos == '(') paren_depth++;
+                else if (*cx->pos == ')') paren_depth--;
+                cx->pos++;
             }
         }
-        skip_whitespace();
+        skip_whitespace(cx);
         /* Skip return type -> T */
-        if (*pos == '-' && *(pos+1) == '>') {
-            pos += 2;
-            skip_whitespace();
-            parse_type();
+        if (*cx->pos == '-' && *(cx->pos+1) == '>') {
+            cx->pos += 2;
+            skip_whitespace(cx);
+            parse_type(cx);
         }
         /* Handle + Send + Sync + 'static etc. */
-        skip_whitespace();
-        while (*pos == '+') {
-            pos++;
-            skip_whitespace();
-            if (*pos == '\'' && (isalpha(*(pos+1)) || *(pos+1) == '_')) {
-                pos++;
-                while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
+        skip_whitespace(cx);
+        while (*cx->pos == '+') {
+            cx->pos++;
+            skip_whitespace(cx);
+            if (*cx->pos == '\'' && (isalpha(*(cx->pos+1)) || *(cx->pos+1) == '_')) {
+                cx->pos++;
+                while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
             } else {
-                parse_type();
+                parse_type(cx);
             }
-            skip_whitespace();
+            skip_whitespace(cx);
         }
         return TYPE_STRUCT; /* fn pointers are pointer-sized */
-    } else if (strncmp(pos, "i128", 4) == 0) {
-        pos += 4;
+    } else if (strncmp(cx->pos, "i128", 4) == 0) {
+        cx->pos += 4;
         return TYPE_I128;
-    } else if (strncmp(pos, "i64", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "i64", 3) == 0) {
+        cx->pos += 3;
         return TYPE_I64;
-    } else if (strncmp(pos, "i32", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "i32", 3) == 0) {
+        cx->pos += 3;
         return TYPE_I32;
-    } else if (strncmp(pos, "i16", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "i16", 3) == 0) {
+        cx->pos += 3;
         return TYPE_I16;
-    } else if (strncmp(pos, "i8", 2) == 0) {
-        pos += 2;
+    } else if (strncmp(cx->pos, "i8", 2) == 0) {
+        cx->pos += 2;
         return TYPE_I8;
-    } else if (strncmp(pos, "u128", 4) == 0) {
-        pos += 4;
+    } else if (strncmp(cx->pos, "u128", 4) == 0) {
+        cx->pos += 4;
         return TYPE_U128;
-    } else if (strncmp(pos, "u64", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "u64", 3) == 0) {
+        cx->pos += 3;
         return TYPE_U64;
-    } else if (strncmp(pos, "u32", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "u32", 3) == 0) {
+        cx->pos += 3;
         return TYPE_U32;
-    } else if (strncmp(pos, "u16", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "u16", 3) == 0) {
+        cx->pos += 3;
         return TYPE_U16;
-    } else if (strncmp(pos, "u8", 2) == 0) {
-        pos += 2;
+    } else if (strncmp(cx->pos, "u8", 2) == 0) {
+        cx->pos += 2;
         return TYPE_U8;
-    } else if (strncmp(pos, "f64", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "f64", 3) == 0) {
+        cx->pos += 3;
         return TYPE_F64;
-    } else if (strncmp(pos, "f32", 3) == 0) {
-        pos += 3;
+    } else if (strncmp(cx->pos, "f32", 3) == 0) {
+        cx->pos += 3;
         return TYPE_F32;
     }
     
     /* Skip r# raw identifier prefix in types */
-    if (*pos == 'r' && *(pos+1) == '#' && (isalpha(*(pos+2)) || *(pos+2) == '_')) {
-        pos += 2;
+    if (*cx->pos == 'r' && *(cx->pos+1) == '#' && (isalpha(*(cx->pos+2)) || *(cx->pos+2) == '_')) {
+        cx->pos += 2;
     }
 
     /* Check if it's a known struct type or path-qualified type */
-    if (isalpha(*pos) || *pos == '_') {
+    if (isalpha(*cx->pos) || *cx->pos == '_') {
         char type_name[64] = {0};
         int ti = 0;
         /* Parse type name including :: path separators (e.g., std::io::Error, twomg::TwoMgHeader) */
-        while (*pos && (isalnum(*pos) || *pos == '_' || (*pos == ':' && *(pos+1) == ':')) && ti < 63) {
-            if (*pos == ':' && *(pos+1) == ':') {
-                type_name[ti++] = *pos++;
-                if (ti < 63) type_name[ti++] = *pos++;
+        while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_' || (*cx->pos == ':' && *(cx->pos+1) == ':')) && ti < 63) {
+            if (*cx->pos == ':' && *(cx->pos+1) == ':') {
+                type_name[ti++] = *cx->pos++;
+                if (ti < 63) type_name[ti++] = *cx->pos++;
             } else {
-                type_name[ti++] = *pos++;
+                type_name[ti++] = *cx->pos++;
             }
         }
         type_name[ti] = '\0';
         /* Check if it's a known struct */
-        int si;
-        for (si = 0; si < struct_count; si++) {
-            if (strcmp(structs[si].name, type_name) == 0) {
-                skip_whitespace();
-                if (*pos == '<') skip_generic_params();
-                return TYPE_STRUCT;
-            }
+        if (struct_lookup(cx, type_name) >= 0) {
+            skip_whitespace(cx);
+            if (*cx->pos == '<') skip_generic_params(cx);
+            return TYPE_STRUCT;
         }
         /* Check for macro invocation: TypeName!(...) or TypeName![...] or TypeName!{...} */
-        skip_whitespace();
-        if (*pos == '!') {
-            pos++; /* skip ! */
-            skip_whitespace();
-            if (*pos == '(' || *pos == '[' || *pos == '{') {
-                char open = *pos;
+        skip_whitespace(cx);
+        if (*cx->pos == '!') {
+            cx->pos++; /* skip ! */
+            skip_whitespace(cx);
+            if (*cx->pos == '(' || *cx->pos == '[' || *cx->pos == '{') {
+                char open = *cx->pos;
                 char close = (open == '(') ? ')' : (open == '{') ? '}' : ']';
-                int d = 1; pos++;
-                while (*pos && d > 0) {
-                    if (*pos == open) d++;
-                    else if (*pos == close) d--;
-                    pos++;
+                int d = 1; cx->pos++;
+                while (*cx->pos && d > 0) {
+                    if (*cx->pos == open) d++;
+                    else if (*cx->pos == close) d--;
+                    cx->pos++;
                 }
             }
             return TYPE_STRUCT;
         }
         /* Unknown type — skip any generics */
-        if (*pos == '<') skip_generic_params();
+        if (*cx->pos == '<') skip_generic_params(cx);
         return TYPE_STRUCT;
     }
 
     /* Handle macro metavariables: $ident or $(...) */
-    if (*pos == '$') {
-        pos++;
-        if (*pos == '(') {
-            int d = 1; pos++;
-            while (*pos && d > 0) { if (*pos == '(') d++; else if (*pos == ')') d--; pos++; }
+    if (*cx->pos == '$') {
+        cx->pos++;
+        if (*cx->pos == '(') {
+            int d = 1; cx->pos++;
+            while (*cx->pos && d > 0) { if (*cx->pos == '(') d++; else if (*cx->pos == ')') d--; cx->pos++; }
             /* Skip repeat operators: *, +, ? */
-            while (*pos == '*' || *pos == '+' || *pos == '?') pos++;
+            while (*cx->pos == '*' || *cx->pos == '+' || *cx->pos == '?') cx->pos++;
         } else {
-            while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
+            while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
         }
         return TYPE_STRUCT;
     }
 
     /* Handle ! (negation in type position) or other single-char noise */
-    if (*pos == '!' || *pos == '~') {
-        pos++;
-        parse_type();
+    if (*cx->pos == '!' || *cx->pos == '~') {
+        cx->pos++;
+        parse_type(cx);
         return TYPE_STRUCT;
     }
 
@@ -545,35 +1657,35 @@ RustType parse_type() {
     return TYPE_I32;
 }
 
-void emit_drop_glue(Variable* var) {
+void emit_drop_glue(CompilerContext* cx, Variable* var) {
     if (!var) return;
     
-    printf("    ; Drop glue for %s\n", var->name);
+    emit(cx, "    ; Drop glue for %s\n", var->name);
     
     switch (var->type) {
         case TYPE_BOX:
-            printf("    lwz r3, %d(r1)    ; load Box pointer\n", var->offset);
-            printf("    bl _dealloc_box   ; free heap memory\n");
+            emit(cx, "    lwz r3, %d(r1)    ; load Box pointer\n", var->offset);
+            emit(cx, "    bl _dealloc_box   ; free heap memory\n");
             break;
             
         case TYPE_RC:
-            printf("    lwz r3, %d(r1)    ; load Rc pointer\n", var->offset);
-            printf("    bl _rc_decrement  ; decrement ref count\n");
+            emit(cx, "    lwz r3, %d(r1)    ; load Rc pointer\n", var->offset);
+            emit(cx, "    bl _rc_decrement  ; decrement ref count\n");
             break;
             
         case TYPE_ARC:
-            printf("    lwz r3, %d(r1)    ; load Arc pointer\n", var->offset);
-            printf("    bl _arc_decrement ; atomic decrement\n");
+            emit(cx, "    lwz r3, %d(r1)    ; load Arc pointer\n", var->offset);
+            emit(cx, "    bl _arc_decrement ; atomic decrement\n");
             break;
             
         case TYPE_VEC:
-            printf("    la r3, %d(r1)     ; Vec address\n", var->offset);
-            printf("    bl _vec_drop      ; deallocate buffer\n");
+            emit(cx, "    la r3, %d(r1)     ; Vec address\n", var->offset);
+            emit(cx, "    bl _vec_drop      ; deallocate buffer\n");
             break;
             
         case TYPE_STRING:
-            printf("    la r3, %d(r1)     ; String address\n", var->offset);
-            printf("    bl _string_drop   ; deallocate buffer\n");
+            emit(cx, "    la r3, %d(r1)     ; String address\n", var->offset);
+            emit(cx, "    bl _string_drop   ; deallocate buffer\n");
             break;
             
         default:
@@ -595,10 +1707,8 @@ static unsigned int file_hash(const char* filename) {
     return h & 0xFFFF;  /* 16-bit hash */
 }
 
-static unsigned int current_file_hash = 0;
-
 /* Forward declarations */
-void compile_function_body(int frame_size);
+void compile_function_body(CompilerContext* cx, int frame_size);
 
 /* Emit a load-immediate for any 32-bit value.
  * PPC `li` only handles -32768..32767 (signed 16-bit).
@@ -606,10 +1716,10 @@ void compile_function_body(int frame_size);
  */
 /* Sanitize a Rust path into a valid PPC assembly label.
  * Replaces :: with _, strips <>, spaces, and other non-label chars.
- * Returns static buffer — not thread-safe but fine for single-pass compiler.
+ * Returns cx->label_buf, valid until the next call.
  */
-const char* sanitize_label(const char* name) {
-    static char buf[256];
+const char* sanitize_label(CompilerContext* cx, const char* name) {
+    char* buf = cx->label_buf;
     int j = 0;
     for (int i = 0; name[i] && j < 254; i++) {
         if (name[i] == ':' && name[i+1] == ':') {
@@ -628,9 +1738,9 @@ const char* sanitize_label(const char* name) {
     return buf;
 }
 
-void emit_li(int reg, int value) {
+void emit_li(CompilerContext* cx, int reg, int value) {
     if (value >= -32768 && value <= 32767) {
-        printf("    li r%d, %d\n", reg, value);
+        emit(cx, "    li r%d, %d\n", reg, value);
     } else {
         /* Split into upper and lower 16-bit halves.
          * lis loads signed 16-bit, shifts left 16.
@@ -640,2790 +1750,10215 @@ void emit_li(int reg, int value) {
         unsigned int lower = uval & 0xFFFF;
         /* lis takes a signed 16-bit operand, but the Mac PPC assembler
          * accepts unsigned 0-65535 as well. Use hex for clarity. */
-        printf("    lis r%d, 0x%X\n", reg, upper);
+        emit(cx, "    lis r%d, 0x%X\n", reg, upper);
         if (lower != 0) {
-            printf("    ori r%d, r%d, 0x%X\n", reg, reg, lower);
+            emit(cx, "    ori r%d, r%d, 0x%X\n", reg, reg, lower);
         }
     }
 }
 
-/* Emit .asciz with proper escaping of special characters */
-void emit_asciz(const char* str) {
-    printf("    .asciz \"");
-    for (const char* p = str; *p; p++) {
-        switch (*p) {
-            case '\n': printf("\\n"); break;
-            case '\r': printf("\\r"); break;
-            case '\t': printf("\\t"); break;
-            case '"':  printf("\\\""); break;
-            case '\\': printf("\\\\"); break;
-            default:
-                if ((unsigned char)*p < 32 || (unsigned char)*p > 126) {
-                    printf("\\%03o", (unsigned char)*p);
-                } else {
-                    putchar(*p);
-                }
+/* Magic multiplier and shift for signed division by d, 2 <= |d| < 2^31
+ * (Hacker's Delight 10-1): q = mulhw(n, m) [+/- n] >> s, plus the sign bit */
+static void magic_signed(int d, int* m, int* s) {
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d < 0 ? 0u - (unsigned)d : (unsigned)d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad, delta;
+    int p = 31;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
         }
-    }
-    printf("\"\n");
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    *m = (int)(q2 + 1);
+    if (d < 0) *m = -*m;
+    *s = p - 32;
 }
 
-/* Emit a compare-word-immediate, handling values outside 16-bit range.
- * PPC `cmpwi` only accepts -32768..32767. For larger values, load into
- * r0 (volatile) and use `cmpw` (register compare).
- */
-void emit_cmpwi(int reg, int value) {
-    if (value >= -32768 && value <= 32767) {
-        printf("    cmpwi r%d, %d\n", reg, value);
+/* The same for unsigned division by d >= 2 (Hacker's Delight 10-8);
+ * add is set when the multiplier needs 33 bits */
+static void magic_unsigned(unsigned d, unsigned* m, int* add, int* s) {
+    unsigned nc = 0xFFFFFFFFu - (0u - d) % d;
+    unsigned q1 = 0x80000000u / nc, r1 = 0x80000000u - q1 * nc;
+    unsigned q2 = 0x7FFFFFFFu / d, r2 = 0x7FFFFFFFu - q2 * d, delta;
+    int p = 31;
+    *add = 0;
+    do {
+        p++;
+        if (r1 >= nc - r1) {
+            q1 = 2 * q1 + 1;
+            r1 = 2 * r1 - nc;
+        } else {
+            q1 = 2 * q1;
+            r1 = 2 * r1;
+        }
+        if (r2 + 1 >= d - r2) {
+            if (q2 >= 0x7FFFFFFFu) *add = 1;
+            q2 = 2 * q2 + 1;
+            r2 = 2 * r2 + 1 - d;
+        } else {
+            if (q2 >= 0x80000000u) *add = 1;
+            q2 = 2 * q2;
+            r2 = 2 * r2 + 1;
+        }
+        delta = d - 1 - r2;
+    } while (p < 64 && (q1 < delta || (q1 == delta && r1 == 0)));
+    *m = q2 + 1;
+    *s = p - 32;
+}
+
+/* log2 of a power of two, -1 for anything else */
+static int exact_log2(unsigned v) {
+    int k = 0;
+    if (v == 0 || (v & (v - 1))) return -1;
+    while (v >>= 1) k++;
+    return k;
+}
+
+/* reg *= c in place, with tmp as scratch. Shifts and shift-adds beat
+ * mullw (4 cycles on the 7450) wherever one or two ops do. */
+static void emit_mul_const(CompilerContext* cx, int reg, int tmp, int c) {
+    unsigned ac = c < 0 ? 0u - (unsigned)c : (unsigned)c;
+    int k = exact_log2(ac);
+    if (c == 0) {
+        emit(cx, "    li r%d, 0\n", reg);
+    } else if (k >= 0) {
+        if (k > 0) emit(cx, "    slwi r%d, r%d, %d\n", reg, reg, k);
+        if (c < 0) emit(cx, "    neg r%d, r%d\n", reg, reg);
+    } else if (c > 0 && (k = exact_log2(ac - 1)) >= 0) {
+        emit(cx, "    slwi r%d, r%d, %d\n", tmp, reg, k);
+        emit(cx, "    add r%d, r%d, r%d\n", reg, reg, tmp);
+    } else if (c > 0 && (k = exact_log2(ac + 1)) >= 0) {
+        emit(cx, "    slwi r%d, r%d, %d\n", tmp, reg, k);
+        emit(cx, "    sub r%d, r%d, r%d\n", reg, tmp, reg);
+    } else if (c >= -32768 && c <= 32767) {
+        emit(cx, "    mulli r%d, r%d, %d\n", reg, reg, c);
     } else {
-        emit_li(0, value);  /* r0 is volatile/scratch */
-        printf("    cmpw r%d, r0\n", reg);
+        emit_li(cx, tmp, c);
+        emit(cx, "    mullw r%d, r%d, r%d\n", reg, reg, tmp);
     }
 }
 
-/* Compile a simple expression into the given register.
- * Handles: integer literals, variable references, binary ops (+,-,*,/,%,&,|,^,<<,>>)
- * Stops at: ; , ) } { and comparison operators (==, !=, <, >, <=, >=)
- * Returns the RustType of the expression result.
- */
-RustType compile_expr_to_reg(int dest_reg) {
-    skip_whitespace();
-    RustType result_type = TYPE_I32;
-    int loaded = 0;
-
-    /* Load first operand */
-    if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-        int value = parse_number();
-        emit_li(dest_reg, value);
-        loaded = 1;
-    } else if (strncmp(pos, "true", 4) == 0 && !isalnum(*(pos+4))) {
-        pos += 4;
-        printf("    li r%d, 1\n", dest_reg);
-        result_type = TYPE_BOOL;
-        loaded = 1;
-    } else if (strncmp(pos, "false", 5) == 0 && !isalnum(*(pos+5))) {
-        pos += 5;
-        printf("    li r%d, 0\n", dest_reg);
-        result_type = TYPE_BOOL;
-        loaded = 1;
-    } else if (isalpha(*pos) || *pos == '_') {
-        char name[64] = {0};
-        char* save = pos;
-        parse_string(name, sizeof(name));
-        /* Look up variable */
-        int found = 0;
-        int j;
-        for (j = 0; j < var_count; j++) {
-            if (strcmp(vars[j].name, name) == 0) {
-                printf("    lwz r%d, %d(r1)   ; load %s\n", dest_reg, vars[j].offset, name);
-                result_type = vars[j].type;
-                found = 1;
-                /* Check for .field access */
-                if (*pos == '.') {
-                    char field_name[64] = {0};
-                    pos++; /* skip '.' */
-                    int fi = 0;
-                    while (*pos && (isalnum(*pos) || *pos == '_') && fi < 63) {
-                        field_name[fi++] = *pos++;
-                    }
-                    field_name[fi] = '\0';
-                    /* Skip method calls: .method() — let caller handle */
-                    if (*pos == '(') {
-                        /* rewind */
-                        pos -= fi + 1;
-                    } else {
-                        /* Resolve struct field */
-                        int struct_idx = -1;
-                        /* If this is 'self', use current_impl_struct */
-                        if (strcmp(name, "self") == 0 && current_impl_struct >= 0) {
-                            struct_idx = current_impl_struct;
-                        } else {
-                            /* Look up variable's struct type */
-                            for (int si = 0; si < struct_count; si++) {
-                                if (vars[j].type == TYPE_STRUCT) {
-                                    struct_idx = si; /* TODO: track actual struct type per var */
-                                    break;
-                                }
-                            }
-                        }
-                        if (struct_idx >= 0) {
-                            Struct* s = &structs[struct_idx];
-                            int fk;
-                            for (fk = 0; fk < s->field_count; fk++) {
-                                if (strcmp(s->fields[fk].name, field_name) == 0) {
-                                    if (strcmp(name, "self") == 0) {
-                                        /* self is a pointer — dereference then offset */
-                                        printf("    lwz r%d, %d(r%d)  ; self.%s\n",
-                                               dest_reg, s->fields[fk].offset, dest_reg, field_name);
-                                    } else {
-                                        /* struct is inline on stack */
-                                        printf("    lwz r%d, %d(r1)   ; %s.%s\n",
-                                               dest_reg, vars[j].offset + s->fields[fk].offset, name, field_name);
-                                    }
-                                    result_type = s->fields[fk].type;
-                                    break;
-                                }
-                            }
-                            if (fk == s->field_count) {
-                                printf("    ; unresolved field %s.%s\n", name, field_name);
-                            }
-                        } else {
-                            printf("    ; unresolved struct for %s.%s\n", name, field_name);
-                        }
-                    }
-                }
-                break;
-            }
-        }
-        if (!found) {
-            /* Could be a function call: name(...) */
-            skip_whitespace();
-            if (*pos == '(') {
-                pos = save;
-                return result_type;
+/* dst = src / c for c other than 0; dst may be src, tmp must differ from
+ * both, r0 is clobbered */
+static void emit_div_const(CompilerContext* cx, int dst, int src, int tmp, int c, int is_unsigned) {
+    unsigned uc = (unsigned)c, um;
+    int k, m, s, add;
+    if (is_unsigned) {
+        if (uc == 1) {
+            if (dst != src) emit(cx, "    mr r%d, r%d\n", dst, src);
+        } else if ((k = exact_log2(uc)) >= 0) {
+            emit(cx, "    srwi r%d, r%d, %d\n", dst, src, k);
+        } else if (uc & 0x80000000u) {
+            /* The quotient is 0 or 1, and 1 exactly when src has its top
+             * bit set and src - c does not: a compare without CA, which
+             * the IR cannot see */
+            emit_li(cx, tmp, c);
+            emit(cx, "    sub r%d, r%d, r%d\n", tmp, src, tmp);
+            emit(cx, "    andc r%d, r%d, r%d\n", tmp, src, tmp);
+            emit(cx, "    srwi r%d, r%d, 31\n", dst, tmp);
+        } else {
+            magic_unsigned(uc, &um, &add, &s);
+            emit_li(cx, tmp, (int)um);
+            emit(cx, "    mulhwu r%d, r%d, r%d\n", tmp, src, tmp);
+            if (add) {
+                emit(cx, "    sub r0, r%d, r%d\n", src, tmp);
+                emit(cx, "    srwi r0, r0, 1\n");
+                emit(cx, "    add r%d, r0, r%d\n", tmp, tmp);
+                s--;
             }
-            /* Unknown variable — emit 0 */
-            printf("    li r%d, 0         ; %s (unresolved)\n", dest_reg, name);
+            emit(cx, "    srwi r%d, r%d, %d\n", dst, tmp, s);
         }
-        loaded = 1;
+        return;
+    }
+    if (c == 1 || c == -1) {
+        if (c < 0) emit(cx, "    neg r%d, r%d\n", dst, src);
+        else if (dst != src) emit(cx, "    mr r%d, r%d\n", dst, src);
+    } else if ((k = exact_log2(c < 0 ? 0u - uc : uc)) >= 0) {
+        /* bias a negative dividend by 2^k - 1 so the shift rounds toward
+         * zero; srawi/addze would be shorter, but CA is invisible to the IR */
+        if (k > 1) emit(cx, "    srawi r%d, r%d, 31\n", tmp, src);
+        emit(cx, "    srwi r%d, r%d, %d\n", tmp, k > 1 ? tmp : src, 32 - k);
+        emit(cx, "    add r%d, r%d, r%d\n", tmp, src, tmp);
+        emit(cx, "    srawi r%d, r%d, %d\n", dst, tmp, k);
+        if (c < 0) emit(cx, "    neg r%d, r%d\n", dst, dst);
+    } else {
+        magic_signed(c, &m, &s);
+        emit_li(cx, tmp, m);
+        emit(cx, "    mulhw r%d, r%d, r%d\n", tmp, src, tmp);
+        if (c > 0 && m < 0) emit(cx, "    add r%d, r%d, r%d\n", tmp, tmp, src);
+        if (c < 0 && m > 0) emit(cx, "    sub r%d, r%d, r%d\n", tmp, tmp, src);
+        if (s > 0) emit(cx, "    srawi r%d, r%d, %d\n", tmp, tmp, s);
+        emit(cx, "    srwi r0, r%d, 31\n", tmp);
+        emit(cx, "    add r%d, r%d, r0\n", dst, tmp);
     }
+}
 
-    if (!loaded) return result_type;
+/* reg = reg op c for op in * / % with a constant right operand. tmp is
+ * free scratch; % also uses r16 like the register form. Returns 0 to
+ * leave the operation to the register form. */
+static int emit_const_arith(CompilerContext* cx, char op, int reg, int tmp, int c, int is_unsigned) {
+    unsigned uc = (unsigned)c;
+    int k;
+    if (op == '*') {
+        emit_mul_const(cx, reg, tmp, c);
+        return 1;
+    }
+    if (c == 0 || (op != '/' && op != '%')) return 0;
+    if (op == '/') {
+        emit_div_const(cx, reg, reg, tmp, c, is_unsigned);
+        return 1;
+    }
 
-    /* Check for binary operator */
-    skip_whitespace();
-    while (*pos == '+' || *pos == '-' || *pos == '*' || *pos == '/' || *pos == '%' ||
-           (*pos == '&' && *(pos+1) != '&') || (*pos == '|' && *(pos+1) != '|') ||
-           *pos == '^' || (*pos == '<' && *(pos+1) == '<') || (*pos == '>' && *(pos+1) == '>')) {
-        char op = *pos;
-        char op2 = *(pos+1);
-        int is_shift = (op == '<' && op2 == '<') || (op == '>' && op2 == '>');
-        if (is_shift) pos += 2; else pos++;
-        skip_whitespace();
+    if (is_unsigned && (k = exact_log2(uc)) >= 0) {
+        if (k == 0) emit(cx, "    li r%d, 0\n", reg);
+        else emit(cx, "    clrlwi r%d, r%d, %d\n", reg, reg, 32 - k);
+        return 1;
+    }
+    if (!is_unsigned && (c == 1 || c == -1)) {
+        emit(cx, "    li r%d, 0\n", reg);
+        return 1;
+    }
+    /* n % c = n - (n / c) * c; the sign follows n, so c's is irrelevant */
+    if (!is_unsigned && c < 0 && c != INT_MIN) c = -c;
+    emit_div_const(cx, 16, reg, tmp, c, is_unsigned);
+    emit_mul_const(cx, 16, tmp, c);
+    emit(cx, "    sub r%d, r%d, r16\n", reg, reg);
+    return 1;
+}
 
-        /* Load second operand into temp register */
-        int tmp_reg = (dest_reg == 14) ? 15 : 14;
-        if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-            int value = parse_number();
-            emit_li(tmp_reg, value);
-        } else if (isalpha(*pos) || *pos == '_') {
-            char rname[64] = {0};
-            parse_string(rname, sizeof(rname));
-            int found = 0;
-            int j;
-            for (j = 0; j < var_count; j++) {
-                if (strcmp(vars[j].name, rname) == 0) {
-                    printf("    lwz r%d, %d(r1)   ; load %s\n", tmp_reg, vars[j].offset, rname);
-                    found = 1;
-                    break;
+/* Emit .asciz with proper escaping of special characters */
+void emit_asciz(CompilerContext* cx, const char* str) {
+    emit(cx, "    .asciz \"");
+    for (const char* p = str; *p; p++) {
+        switch (*p) {
+            case '\n': emit(cx, "\\n"); break;
+            case '\r': emit(cx, "\\r"); break;
+            case '\t': emit(cx, "\\t"); break;
+            case '"':  emit(cx, "\\\""); break;
+            case '\\': emit(cx, "\\\\"); break;
+            default:
+                if ((unsigned char)*p < 32 || (unsigned char)*p > 126) {
+                    emit(cx, "\\%03o", (unsigned char)*p);
+                } else {
+                    emit_char(cx, *p);
                 }
-            }
-            if (!found) {
-                printf("    li r%d, 0         ; %s (unresolved)\n", tmp_reg, rname);
-            }
         }
-
-        /* Emit the arithmetic instruction */
-        if (op == '+') {
-            printf("    add r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        } else if (op == '-') {
-            printf("    sub r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        } else if (op == '*') {
-            printf("    mullw r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        } else if (op == '/') {
-            printf("    divw r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        } else if (op == '%') {
-            printf("    divw r16, r%d, r%d\n", dest_reg, tmp_reg);
-            printf("    mullw r16, r16, r%d\n", tmp_reg);
-            printf("    sub r%d, r%d, r16\n", dest_reg, dest_reg);
-        } else if (op == '&') {
-            printf("    and r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        } else if (op == '|') {
-            printf("    or r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        } else if (op == '^') {
-            printf("    xor r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        } else if (op == '<' && is_shift) {
-            printf("    slw r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        } else if (op == '>' && is_shift) {
-            printf("    sraw r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
-        }
-        skip_whitespace();
     }
-
-    return result_type;
+    emit(cx, "\"\n");
 }
 
-/* Compile statements inside a function body.
- * pos must point just after the opening '{'.
- * Emits PPC assembly for all statements until matching '}'.
- * frame_size is used for proper epilogue generation. */
-void compile_function_body(int frame_size) {
-    int brace_depth = 1;
-    int saved_var_count = var_count;
-    int saved_stack_offset = stack_offset;
-    int i;
-    int iter_limit = 100000;  /* Safety: prevent infinite loops */
+/* Emit a compare-word-immediate, handling values outside 16-bit range.
+ * PPC `cmpwi` only accepts -32768..32767. For larger values, load into
+ * r0 (volatile) and use `cmpw` (register compare).
+ */
+void emit_cmpwi(CompilerContext* cx, int reg, int value) {
+    if (value >= -32768 && value <= 32767) {
+        emit(cx, "    cmpwi r%d, %d\n", reg, value);
+    } else {
+        emit_li(cx, 0, value);  /* r0 is volatile/scratch */
+        emit(cx, "    cmpw r%d, r0\n", reg);
+    }
+}
 
-    while (*pos && brace_depth > 0 && --iter_limit > 0) {
-        /* Skip comments */
-        if (*pos == '/' && *(pos+1) == '/') {
-            while (*pos && *pos != '\n') pos++;
-            if (*pos == '\n') pos++;
-            continue;
-        }
-        if (*pos == '/' && *(pos+1) == '*') {
-            pos += 2;
-            while (*pos && !(*pos == '*' && *(pos+1) == '/')) pos++;
-            if (*pos) pos += 2;
-            continue;
-        }
-        /* Track braces for nested blocks */
-        if (*pos == '{') {
-            brace_depth++;
-            pos++;
-            continue;
-        } else if (*pos == '}') {
-            brace_depth--;
-            if (brace_depth <= 0) break;
-            pos++;
-            continue;
-        }
-        skip_whitespace();
-        if (!*pos || *pos == '}') break;
+/* Compile-time evaluation of constant expressions: integer, char and
+ * bool literals, const and static items, casts, the arithmetic, bitwise,
+ * comparison and logical operators with Rust's precedence, and calls to
+ * const fns whose bodies stick to let, assignment, if/else, while and
+ * return. Values are carried in 64 bits and wrapped to their type after
+ * every operation; an overflow that rustc would reject, a runtime
+ * variable, a float or anything else it does not know makes the whole
+ * expression non-constant and leaves it to the code generator. */
+enum {
+    CPREC_NONE, CPREC_OR, CPREC_AND, CPREC_CMP, CPREC_BITOR, CPREC_XOR,
+    CPREC_BITAND, CPREC_SHIFT, CPREC_ADD, CPREC_MUL
+};
+
+#define CONST_MAX_DEPTH 64          /* const fn calls in progress */
+#define CONST_MAX_STEPS 200000      /* operands evaluated per expression */
+#define CONST_MAX_ARGS 16
+#define CONST_MAX_ELEMS 65536       /* array initializer elements */
 
-        if (strncmp(pos, "let ", 4) == 0) {
-            pos += 4;
-            skip_whitespace();
+typedef struct {
+    long long v;
+    RustType type;              /* TYPE_TUPLE for () */
+    int typed;                  /* from a suffix, cast or declaration; else inferred */
+} ConstVal;
 
-            int is_mut = 0;
-            if (strncmp(pos, "mut ", 4) == 0) {
-                is_mut = 1;
-                pos += 4;
-                skip_whitespace();
-            }
+typedef struct {
+    CompilerContext* cx;
+    int i;                      /* next token */
+    int end;                    /* first token past the expression */
+    int depth;                  /* const fn nesting; 0 = the item or codegen's expression */
+    int item;                   /* evaluating an item's initializer: no locals in scope */
+    int env_base;               /* first const_env binding this frame sees */
+    int steps;
+    int failed;
+    int dry;                    /* parsing a branch not taken: no effects, no errors */
+    int prefix;                 /* the outermost operator chain may stop early */
+    int returning;              /* `return` seen, value in ret */
+    ConstVal ret;
+    RustType hint;              /* type unsuffixed literals take, TYPE_TUPLE for none */
+    int overflow;               /* operator token that overflowed or divided by zero, 0 for none */
+    const char* overflow_what;  /* ... in rustc's words */
+} ConstEval;
+
+static ConstVal ce_expr(ConstEval* ev, int min_prec);
+static ConstVal ce_block(ConstEval* ev);
+int const_item_eval(CompilerContext* cx, int idx);
+
+/* Integer type named by sym (usize/isize are 32-bit here), or -1 */
+static int const_type_of(CompilerContext* cx, int sym) {
+    static const struct { const char* name; RustType type; } types[] = {
+        { "i8", TYPE_I8 },   { "i16", TYPE_I16 }, { "i32", TYPE_I32 }, { "i64", TYPE_I64 },
+        { "isize", TYPE_I32 }, { "u8", TYPE_U8 }, { "u16", TYPE_U16 }, { "u32", TYPE_U32 },
+        { "u64", TYPE_U64 }, { "usize", TYPE_U32 }, { "bool", TYPE_BOOL }, { "char", TYPE_CHAR },
+        { NULL, TYPE_I32 }
+    };
+    const char* name = sym_name(cx, sym);
+    int k;
+    for (k = 0; types[k].name; k++) {
+        if (strcmp(name, types[k].name) == 0) return types[k].type;
+    }
+    return -1;
+}
 
-            /* Pattern: _ (discard) */
-            if (*pos == '_' && (*(pos+1) == ' ' || *(pos+1) == ':' || *(pos+1) == '=')) {
-                /* Discard binding */
-                while (*pos && *pos != ';') pos++;
-                if (*pos == ';') pos++;
-                continue;
-            }
+/* TYPE_F32/TYPE_F64 for the type named sym, or -1 */
+static int float_type_of(CompilerContext* cx, int sym) {
+    const char* name = sym_name(cx, sym);
+    if (strcmp(name, "f32") == 0) return TYPE_F32;
+    if (strcmp(name, "f64") == 0) return TYPE_F64;
+    return -1;
+}
 
-            char var_name[64] = {0};
-            parse_string(var_name, sizeof(var_name));
+static int const_bits(RustType t) {
+    switch (t) {
+    case TYPE_I8: case TYPE_U8: return 8;
+    case TYPE_I16: case TYPE_U16: return 16;
+    case TYPE_I64: case TYPE_U64: return 64;
+    default: return 32;
+    }
+}
 
-            skip_whitespace();
+static int const_unsigned(RustType t) {
+    return t == TYPE_U8 || t == TYPE_U16 || t == TYPE_U32 || t == TYPE_U64 ||
+           t == TYPE_CHAR || t == TYPE_BOOL;
+}
 
-            /* Type annotation */
-            RustType var_type = TYPE_I32;
-            if (*pos == ':') {
-                pos++;
-                skip_whitespace();
-                var_type = parse_type();
-            }
+static long long const_wrap(long long v, RustType t) {
+    switch (t) {
+    case TYPE_I8: return (signed char)v;
+    case TYPE_U8: return (unsigned char)v;
+    case TYPE_I16: return (short)v;
+    case TYPE_U16: return (unsigned short)v;
+    case TYPE_I32: return (int)v;
+    case TYPE_U32: case TYPE_CHAR: return (unsigned int)v;
+    case TYPE_BOOL: return v != 0;
+    default: return v;
+    }
+}
 
-            skip_whitespace();
-            if (*pos == '=') {
-                pos++;
-                skip_whitespace();
+/* Bytes a scalar of type t takes in .data */
+static int const_size(RustType t) {
+    int bits = const_bits(t);
+    return (t == TYPE_BOOL) ? 1 : bits / 8;
+}
 
-                /* Handle all initialization patterns */
-                if (strncmp(pos, "Box::new(", 9) == 0) {
-                    pos += 9;
-                    int value = parse_number();
-                    printf("    ; %s = Box::new(%d)\n", var_name, value);
-                    printf("    li r3, 4\n");
-                    printf("    bl _alloc_box\n");
-                    emit_li(4, value);
-                    printf("    stw r4, 0(r3)\n");
-                    printf("    stw r3, %d(r1)\n", stack_offset);
-                    vars[var_count].type = TYPE_BOX;
-
-                } else if (strncmp(pos, "Rc::new(", 8) == 0) {
-                    pos += 8;
-                    int value = parse_number();
-                    printf("    ; %s = Rc::new(%d)\n", var_name, value);
-                    printf("    li r3, 8\n");
-                    printf("    bl _alloc_rc\n");
-                    printf("    li r4, 1\n");
-                    printf("    stw r4, 0(r3)     ; refcount = 1\n");
-                    emit_li(4, value);
-                    printf("    stw r4, 4(r3)\n");
-                    printf("    stw r3, %d(r1)\n", stack_offset);
-                    vars[var_count].type = TYPE_RC;
-                    vars[var_count].ref_count = 1;
-
-                } else if (strncmp(pos, "Arc::new(", 9) == 0) {
-                    pos += 9;
-                    int value = parse_number();
-                    printf("    ; %s = Arc::new(%d)\n", var_name, value);
-                    printf("    li r3, 8\n");
-                    printf("    bl _alloc_arc\n");
-                    printf("    li r4, 1\n");
-                    printf("    stw r4, 0(r3)     ; atomic refcount = 1\n");
-                    emit_li(4, value);
-                    printf("    stw r4, 4(r3)\n");
-                    printf("    stw r3, %d(r1)\n", stack_offset);
-                    vars[var_count].type = TYPE_ARC;
-                    vars[var_count].ref_count = 1;
-
-                } else if (strncmp(pos, "vec![", 5) == 0) {
-                    pos += 5;
-                    skip_whitespace();
-                    printf("    ; %s = vec![...]\n", var_name);
-                    printf("    bl _vec_new\n");
-                    /* Check for vec![value; count] repeat syntax */
-                    int vec_repeat = 0;
-                    if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                        char* save_pos = pos;
-                        int first_val = parse_number();
-                        skip_whitespace();
-                        if (*pos == ';') {
-                            pos++; /* past ';' */
-                            skip_whitespace();
-                            /* count could be a variable or literal */
-                            int count = 0;
-                            if (isdigit(*pos)) {
-                                count = parse_number();
-                            } else {
-                                /* Variable count - skip it, emit runtime-sized vec */
-                                while (*pos && *pos != ']') pos++;
-                                count = 0; /* runtime-determined */
-                            }
-                            if (count > 0 && count <= 256) {
-                                for (int vi = 0; vi < count; vi++) {
-                                    printf("    mr r16, r3\n");
-                                    emit_li(4, first_val);
-                                    printf("    bl _vec_push\n");
-                                    printf("    mr r3, r16\n");
-                                }
-                            }
-                            vec_repeat = 1;
-                        } else {
-                            pos = save_pos; /* rewind, not a repeat */
-                        }
-                    }
-                    if (!vec_repeat) {
-                        while (*pos && *pos != ']') {
-                            skip_whitespace();
-                            if (*pos == ']') break;
-                            if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                                int value = parse_number();
-                                printf("    mr r16, r3\n");
-                                emit_li(4, value);
-                                printf("    bl _vec_push\n");
-                                printf("    mr r3, r16\n");
-                            } else {
-                                /* Non-numeric element (variable, expr) - skip */
-                                while (*pos && *pos != ',' && *pos != ']') pos++;
-                            }
-                            skip_whitespace();
-                            if (*pos == ',') pos++;
-                        }
-                    }
-                    while (*pos && *pos != ']') pos++;
-                    if (*pos == ']') pos++;
-                    printf("    stw r3, %d(r1)\n", stack_offset);
-                    printf("    lwz r4, 4(r3)\n");
-                    printf("    stw r4, %d(r1)\n", stack_offset + 4);
-                    printf("    lwz r4, 8(r3)\n");
-                    printf("    stw r4, %d(r1)\n", stack_offset + 8);
-                    vars[var_count].type = TYPE_VEC;
-                    vars[var_count].size = 12;
-
-                } else if (strncmp(pos, "String::from(", 13) == 0) {
-                    pos += 13;
-                    printf("    ; %s = String::from(...)\n", var_name);
-                    /* Parse string arg */
-                    if (*pos == '"') {
-                        pos++;
-                        char sbuf[512] = {0};
-                        int si = 0;
-                        while (*pos && *pos != '"' && si < 511) {
-                            if (*pos == '\\') pos++;
-                            sbuf[si++] = *pos++;
-                        }
-                        if (*pos == '"') pos++;
-                        printf("    .section __DATA,__cstring\n");
-                        printf("L_str_%d:\n", string_label_count);
-                        emit_asciz(sbuf);
-                        printf("    .text\n");
-                        string_label_count++;
-                        emit_li(3, si + 1);
-                        printf("    bl L_malloc$stub\n");
-                        printf("    stw r3, %d(r1)    ; String ptr\n", stack_offset);
-                        emit_li(4, si);
-                        printf("    stw r4, %d(r1)    ; String len\n", stack_offset + 4);
-                        emit_li(4, si + 1);
-                        printf("    stw r4, %d(r1)    ; String cap\n", stack_offset + 8);
-                    }
-                    while (*pos && *pos != ')') pos++;
-                    if (*pos == ')') pos++;
-                    vars[var_count].type = TYPE_STRING;
-                    vars[var_count].size = 12;
-
-                } else if (strncmp(pos, "Some(", 5) == 0) {
-                    pos += 5;
-                    int value = parse_number();
-                    printf("    ; %s = Some(%d)\n", var_name, value);
-                    printf("    li r14, 1         ; tag = Some\n");
-                    printf("    stw r14, %d(r1)\n", stack_offset);
-                    emit_li(14, value);
-                    printf("    stw r14, %d(r1)   ; value\n", stack_offset + 4);
-                    vars[var_count].type = TYPE_OPTION;
-                    vars[var_count].size = 8;
-
-                } else if (strncmp(pos, "None", 4) == 0 && !isalnum(*(pos+4))) {
-                    pos += 4;
-                    printf("    ; %s = None\n", var_name);
-                    printf("    li r14, 0         ; tag = None\n");
-                    printf("    stw r14, %d(r1)\n", stack_offset);
-                    printf("    stw r14, %d(r1)\n", stack_offset + 4);
-                    vars[var_count].type = TYPE_OPTION;
-                    vars[var_count].size = 8;
-
-                } else if (strncmp(pos, "Ok(", 3) == 0) {
-                    pos += 3;
-                    int value = parse_number();
-                    printf("    ; %s = Ok(%d)\n", var_name, value);
-                    printf("    li r14, 0         ; tag = Ok\n");
-                    printf("    stw r14, %d(r1)\n", stack_offset);
-                    emit_li(14, value);
-                    printf("    stw r14, %d(r1)   ; value\n", stack_offset + 4);
-                    vars[var_count].type = TYPE_RESULT;
-                    vars[var_count].size = 8;
-
-                } else if (strncmp(pos, "Err(", 4) == 0) {
-                    pos += 4;
-                    printf("    ; %s = Err(...)\n", var_name);
-                    printf("    li r14, 1         ; tag = Err\n");
-                    printf("    stw r14, %d(r1)\n", stack_offset);
-                    /* Parse error value */
-                    if (*pos == '"') {
-                        pos++;
-                        while (*pos && *pos != '"') { if (*pos == '\\') pos++; pos++; }
-                        if (*pos == '"') pos++;
-                    } else {
-                        int eval = parse_number();
-                        emit_li(14, eval);
-                        printf("    stw r14, %d(r1)   ; error value\n", stack_offset + 4);
-                    }
-                    while (*pos && *pos != ')') pos++;
-                    if (*pos == ')') pos++;
-                    vars[var_count].type = TYPE_RESULT;
-                    vars[var_count].size = 8;
-
-                } else if (*pos == '[') {
-                    pos++;
-                    skip_whitespace();
-                    printf("    ; %s = [...]\n", var_name);
-                    int array_idx = 0;
-                    /* Check for [value; count] repeat syntax */
-                    int first_val = 0;
-                    int is_repeat = 0;
-                    if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                        first_val = parse_number();
-                        skip_whitespace();
-                        if (*pos == ';') {
-                            /* [value; count] repeat expression */
-                            pos++; /* past ';' */
-                            skip_whitespace();
-                            int count = parse_number();
-                            skip_whitespace();
-                            if (count > 256) count = 256; /* safety limit */
-                            emit_li(14, first_val);
-                            for (int ri = 0; ri < count; ri++) {
-                                printf("    stw r14, %d(r1)\n", stack_offset + ri * 4);
-                            }
-                            array_idx = count;
-                            is_repeat = 1;
-                        }
-                    }
-                    if (!is_repeat) {
-                        /* Regular array literal [a, b, c, ...] */
-                        if (array_idx == 0 && first_val != 0) {
-                            /* We already parsed first_val above */
-                            emit_li(14, first_val);
-                            printf("    stw r14, %d(r1)\n", stack_offset);
-                            array_idx = 1;
-                            skip_whitespace();
-                            if (*pos == ',') pos++;
-                        }
-                        while (*pos && *pos != ']') {
-                            skip_whitespace();
-                            if (*pos == ']') break;
-                            int value = parse_number();
-                            emit_li(14, value);
-                            printf("    stw r14, %d(r1)\n", stack_offset + array_idx * 4);
-                            array_idx++;
-                            skip_whitespace();
-                            if (*pos == ',') pos++;
-                            /* Safety: skip non-numeric non-bracket chars */
-                            while (*pos && *pos != ',' && *pos != ']' && !isdigit(*pos) && *pos != '-') pos++;
-                        }
-                    }
-                    while (*pos && *pos != ']') pos++;
-                    if (*pos == ']') pos++;
-                    vars[var_count].type = TYPE_ARRAY;
-                    vars[var_count].size = array_idx * 4;
+static ConstVal const_val(long long v, RustType type, int typed) {
+    ConstVal c;
+    c.v = v;
+    c.type = type;
+    c.typed = typed;
+    return c;
+}
 
-                } else if (*pos == '(') {
-                    /* Parenthesized expression or tuple */
-                    pos++; /* past '(' */
-                    compile_expr_to_reg(14);
-                    while (*pos && *pos != ')') pos++;
-                    if (*pos == ')') pos++;
-                    skip_whitespace();
-                    /* Check for binary op after closing paren: (expr) * 8 */
-                    while ((*pos == '+' || *pos == '-' || *pos == '*' || *pos == '/' || *pos == '%' ||
-                            (*pos == '&' && *(pos+1) != '&') || (*pos == '|' && *(pos+1) != '|') ||
-                            *pos == '^' || (*pos == '<' && *(pos+1) == '<') || (*pos == '>' && *(pos+1) == '>')) &&
-                           *pos != ';') {
-                        char op = *pos;
-                        char op2 = *(pos+1);
-                        int is_shift = (op == '<' && op2 == '<') || (op == '>' && op2 == '>');
-                        if (is_shift) pos += 2; else pos++;
-                        skip_whitespace();
-                        compile_expr_to_reg(15);
-                        if (op == '+') printf("    add r14, r14, r15\n");
-                        else if (op == '-') printf("    sub r14, r14, r15\n");
-                        else if (op == '*') printf("    mullw r14, r14, r15\n");
-                        else if (op == '/') printf("    divw r14, r14, r15\n");
-                        else if (op == '%') { printf("    divw r16, r14, r15\n"); printf("    mullw r16, r16, r15\n"); printf("    sub r14, r14, r16\n"); }
-                        else if (op == '&') printf("    and r14, r14, r15\n");
-                        else if (op == '|') printf("    or r14, r14, r15\n");
-                        else if (op == '^') printf("    xor r14, r14, r15\n");
-                        else if (op == '<' && is_shift) printf("    slw r14, r14, r15\n");
-                        else if (op == '>' && is_shift) printf("    sraw r14, r14, r15\n");
-                        skip_whitespace();
-                    }
-                    printf("    stw r14, %d(r1)   ; %s\n", stack_offset, var_name);
-                    vars[var_count].type = var_type;
-                    vars[var_count].size = 4;
-
-                } else if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                    int value = parse_number();
-                    emit_li(14, value);
-                    printf("    stw r14, %d(r1)   ; %s\n", stack_offset, var_name);
-                    vars[var_count].type = var_type;
-                    vars[var_count].size = 4;
-
-                } else if (strncmp(pos, "true", 4) == 0 && !isalnum(*(pos+4))) {
-                    pos += 4;
-                    printf("    li r14, 1\n");
-                    printf("    stw r14, %d(r1)   ; %s = true\n", stack_offset, var_name);
-                    vars[var_count].type = TYPE_BOOL;
-                    vars[var_count].size = 4;
-
-                } else if (strncmp(pos, "false", 5) == 0 && !isalnum(*(pos+5))) {
-                    pos += 5;
-                    printf("    li r14, 0\n");
-                    printf("    stw r14, %d(r1)   ; %s = false\n", stack_offset, var_name);
-                    vars[var_count].type = TYPE_BOOL;
-                    vars[var_count].size = 4;
-
-                } else if (*pos == '"') {
-                    pos++;
-                    char str_buf[512] = {0};
-                    int si = 0;
-                    while (*pos && *pos != '"' && si < 511) {
-                        if (*pos == '\\') pos++;
-                        str_buf[si++] = *pos++;
-                    }
-                    if (*pos == '"') pos++;
-                    printf("    ; %s = (string literal)\n", var_name);
-                    printf("    .section __DATA,__cstring\n");
-                    { int slbl = string_label_count++;
-                    printf("L_str_%d:\n", slbl);
-                    emit_asciz(str_buf);
-                    printf("    .text\n");
-                    printf("    lis r14, ha16(L_str_%d)\n", slbl);
-                    printf("    la r14, lo16(L_str_%d)(r14)\n", slbl); }
-                    printf("    stw r14, %d(r1)   ; %s ptr\n", stack_offset, var_name);
-                    emit_li(15, si);
-                    printf("    stw r15, %d(r1)   ; %s len\n", stack_offset + 4, var_name);
-                    vars[var_count].type = TYPE_STR;
-                    vars[var_count].size = 8;
-
-                } else if (strncmp(pos, "match ", 6) == 0) {
-                    /* Match expression: let x = match val { arms }; */
-                    pos += 6;
-                    skip_whitespace();
-                    printf("    ; %s = match ...\n", var_name);
+/* A semantic failure; branches not taken ignore them */
+static void ce_fail(ConstEval* ev) {
+    if (!ev->dry) ev->failed = 1;
+}
 
-                    /* Load the match subject into r14 */
-                    compile_expr_to_reg(14);
-                    skip_whitespace();
-                    /* Skip to opening { */
-                    while (*pos && *pos != '{') pos++;
-                    if (*pos == '{') pos++;
-
-                    static int match_label_let = 0;
-                    int arm_count = 0;
-                    int end_label = match_label_let++;
-
-                    /* Parse match arms: pattern => expr, */
-                    while (*pos) {
-                        skip_whitespace();
-                        if (*pos == '}') { pos++; break; }
-                        /* Skip comments */
-                        if (*pos == '/' && *(pos+1) == '/') {
-                            while (*pos && *pos != '\n') pos++;
-                            if (*pos == '\n') pos++;
-                            continue;
-                        }
-                        if (*pos == '/' && *(pos+1) == '*') {
-                            pos += 2;
-                            while (*pos && !(*pos == '*' && *(pos+1) == '/')) pos++;
-                            if (*pos) pos += 2;
-                            continue;
-                        }
+/* An operation rustc rejects at compile time: overflow, or a division
+ * by zero. The first one is kept for const_error(). */
+static void ce_overflow(ConstEval* ev, int at, const char* what) {
+    if (ev->dry) return;
+    ev->failed = 1;
+    if (!ev->overflow) {
+        ev->overflow = at;
+        ev->overflow_what = what;
+    }
+}
 
-                        int is_wildcard = (*pos == '_' && (*(pos+1) == ' ' || *(pos+1) == '='));
-                        static int arm_label_ctr = 0;
-                        int arm_label = arm_label_ctr++;
-
-                        if (is_wildcard) {
-                            /* _ => default arm */
-                            pos++; /* skip _ */
-                            skip_whitespace();
-                            if (*pos == '=' && *(pos+1) == '>') pos += 2;
-                            skip_whitespace();
-                            compile_expr_to_reg(15);
-                            printf("    mr r14, r15\n");
-                            /* Skip to comma or closing brace */
-                            while (*pos && *pos != ',' && *pos != '}') {
-                                if (*pos == '{') {
-                                    int d = 1; pos++;
-                                    while (*pos && d > 0) {
-                                        if (*pos == '{') d++;
-                                        else if (*pos == '}') d--;
-                                        pos++;
-                                    }
-                                } else pos++;
-                            }
-                            if (*pos == ',') pos++;
-                            printf("    b Lmatch_let_end_%d\n", end_label);
-                        } else if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                            /* Numeric pattern: N => expr */
-                            int pat_val = parse_number();
-                            skip_whitespace();
-                            /* Skip | alternatives: 1 | 2 | 3 => */
-                            while (*pos == '|') {
-                                pos++;
-                                skip_whitespace();
-                                parse_number();
-                                skip_whitespace();
-                            }
-                            if (*pos == '=' && *(pos+1) == '>') pos += 2;
-                            skip_whitespace();
-                            emit_cmpwi(14, pat_val);
-                            printf("    bne Lmatch_let_skip_%d\n", arm_label);
-                            compile_expr_to_reg(15);
-                            printf("    mr r14, r15\n");
-                            /* Skip to comma or closing brace */
-                            while (*pos && *pos != ',' && *pos != '}') {
-                                if (*pos == '{') {
-                                    int d = 1; pos++;
-                                    while (*pos && d > 0) {
-                                        if (*pos == '{') d++;
-                                        else if (*pos == '}') d--;
-                                        pos++;
-                                    }
-                                } else pos++;
-                            }
-                            if (*pos == ',') pos++;
-                            printf("    b Lmatch_let_end_%d\n", end_label);
-                            printf("Lmatch_let_skip_%d:\n", arm_label);
-                        } else {
-                            /* Named/complex pattern — skip the arm */
-                            while (*pos && *pos != '=' ) pos++;
-                            if (*pos == '=' && *(pos+1) == '>') pos += 2;
-                            skip_whitespace();
-                            /* Skip arm body */
-                            while (*pos && *pos != ',' && *pos != '}') {
-                                if (*pos == '{') {
-                                    int d = 1; pos++;
-                                    while (*pos && d > 0) {
-                                        if (*pos == '{') d++;
-                                        else if (*pos == '}') d--;
-                                        pos++;
-                                    }
-                                } else pos++;
-                            }
-                            if (*pos == ',') pos++;
-                        }
-                        arm_count++;
-                    }
-                    printf("Lmatch_let_end_%d:\n", end_label);
-                    printf("    stw r14, %d(r1)   ; %s = match result\n", stack_offset, var_name);
-                    vars[var_count].type = var_type;
-                    vars[var_count].size = 4;
+static int ce_stopped(const ConstEval* ev) {
+    return ev->failed || ev->returning;
+}
 
-                } else if (isalpha(*pos) || *pos == '_') {
-                    /* Variable reference, function call, or struct literal */
-                    int alpha_size_set = 0;  /* Flag: did a branch set type/size? */
-                    char* ref_start = pos;  /* Save position before parsing name */
-                    char ref_name[64] = {0};
-                    int ri = 0;
-                    while (*pos && (isalnum(*pos) || *pos == '_' || *pos == ':') && ri < 63) {
-                        ref_name[ri++] = *pos++;
-                    }
-                    ref_name[ri] = '\0';
-                    skip_whitespace();
+static Token* ce_tok(ConstEval* ev, int k) {
+    return &ev->cx->tokens[k < ev->end ? k : ev->end];
+}
 
-                    if (*pos == '{') {
-                        /* Struct literal: Type { field: val, ... } */
-                        pos++;
-                        printf("    ; %s = %s { ... }\n", var_name, ref_name);
+static int ce_punct(ConstEval* ev, char c) {
+    return ev->i < ev->end && tok_is_punct(&ev->cx->tokens[ev->i], c);
+}
 
-                        /* Find struct definition */
-                        int si_idx = -1;
-                        int j;
-                        for (j = 0; j < struct_count; j++) {
-                            if (strcmp(structs[j].name, ref_name) == 0) { si_idx = j; break; }
-                        }
-                        int struct_size = (si_idx >= 0) ? structs[si_idx].size : 16;
+/* Whether token k is immediately followed by punctuation c, as in "<<" */
+static int ce_joined(ConstEval* ev, int k, char c) {
+    const Token* t = ce_tok(ev, k);
+    return k + 1 < ev->end && tok_is_punct(t + 1, c) && t[1].start == t->start + t->len;
+}
 
-                        while (*pos && *pos != '}') {
-                            skip_whitespace();
-                            if (*pos == '}') break;
-                            /* Parse field_name: value */
-                            char fname[64] = {0};
-                            parse_string(fname, sizeof(fname));
-                            skip_whitespace();
-                            if (*pos == ':') pos++;
-                            skip_whitespace();
+static void ce_expect(ConstEval* ev, char c) {
+    if (ce_punct(ev, c)) ev->i++;
+    else ev->failed = 1;
+}
 
-                            /* Find field offset */
-                            int foff = -1;
-                            if (si_idx >= 0) {
-                                int k;
-                                for (k = 0; k < structs[si_idx].field_count; k++) {
-                                    if (strcmp(structs[si_idx].fields[k].name, fname) == 0) {
-                                        foff = structs[si_idx].fields[k].offset;
-                                        break;
-                                    }
-                                }
-                            }
-                            if (foff < 0) foff = 0;
+/* Binary operator at ev->i: its precedence (CPREC_NONE for none), a
+ * one-character code in *op and its token count in *len. Compound
+ * assignments, ranges and arrows are not operators. */
+static int ce_binop(ConstEval* ev, char* op, int* len) {
+    int k = ev->i;
+    const Token* t = ce_tok(ev, k);
+    if (k >= ev->end || t->kind != TOK_PUNCT) return CPREC_NONE;
+    *len = 1;
+    *op = t->ch;
+    switch (t->ch) {
+    case '*': case '/': case '%':
+        return ce_joined(ev, k, '=') ? CPREC_NONE : CPREC_MUL;
+    case '+':
+        return ce_joined(ev, k, '=') ? CPREC_NONE : CPREC_ADD;
+    case '-':
+        return (ce_joined(ev, k, '=') || ce_joined(ev, k, '>')) ? CPREC_NONE : CPREC_ADD;
+    case '<': case '>':
+        if (ce_joined(ev, k, t->ch)) {
+            *len = 2;
+            *op = t->ch == '<' ? 'L' : 'R';
+            return ce_joined(ev, k + 1, '=') ? CPREC_NONE : CPREC_SHIFT;
+        }
+        if (ce_joined(ev, k, '=')) {
+            *len = 2;
+            *op = t->ch == '<' ? 'l' : 'g';
+        }
+        return CPREC_CMP;
+    case '=': case '!':
+        if (!ce_joined(ev, k, '=')) return CPREC_NONE;
+        *len = 2;
+        *op = t->ch == '=' ? 'e' : 'n';
+        return CPREC_CMP;
+    case '&': case '|':
+        if (ce_joined(ev, k, t->ch)) {
+            *len = 2;
+            *op = t->ch == '&' ? 'A' : 'O';
+            return t->ch == '&' ? CPREC_AND : CPREC_OR;
+        }
+        if (ce_joined(ev, k, '=')) return CPREC_NONE;
+        return t->ch == '&' ? CPREC_BITAND : CPREC_BITOR;
+    case '^':
+        return ce_joined(ev, k, '=') ? CPREC_NONE : CPREC_XOR;
+    }
+    return CPREC_NONE;
+}
 
-                            /* Parse value */
-                            if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                                int fval = parse_number();
-                                emit_li(14, fval);
-                                printf("    stw r14, %d(r1)   ; .%s\n", stack_offset + foff, fname);
-                            } else if (*pos == '"') {
-                                pos++;
-                                while (*pos && *pos != '"') { if (*pos == '\\') pos++; pos++; }
-                                if (*pos == '"') pos++;
-                                printf("    li r14, 0         ; .%s (string TODO)\n", fname);
-                                printf("    stw r14, %d(r1)\n", stack_offset + foff);
-                            } else if (isalpha(*pos) || *pos == '_') {
-                                char fvar[64] = {0};
-                                parse_string(fvar, sizeof(fvar));
-                                int found = 0;
-                                int k;
-                                for (k = 0; k < var_count; k++) {
-                                    if (strcmp(vars[k].name, fvar) == 0) {
-                                        printf("    lwz r14, %d(r1)   ; load %s\n", vars[k].offset, fvar);
-                                        printf("    stw r14, %d(r1)   ; .%s\n", stack_offset + foff, fname);
-                                        found = 1;
-                                        break;
-                                    }
-                                }
-                                if (!found) {
-                                    printf("    li r14, 0\n");
-                                    printf("    stw r14, %d(r1)   ; .%s (unresolved)\n", stack_offset + foff, fname);
-                                }
-                            } else {
-                                int fval = parse_number();
-                                emit_li(14, fval);
-                                printf("    stw r14, %d(r1)\n", stack_offset + foff);
-                            }
+/* a op b for everything but && and ||, with the operator at token at */
+static ConstVal ce_apply(ConstEval* ev, char op, ConstVal a, ConstVal b, int at) {
+    RustType type = a.typed ? a.type : b.typed ? b.type : a.type;
+    int typed = a.typed || b.typed;
+    int is_unsigned = const_unsigned(type);
+    unsigned long long ua = (unsigned long long)a.v, ub = (unsigned long long)b.v;
+    long long r = 0;
+
+    if (a.type == TYPE_TUPLE || b.type == TYPE_TUPLE) {
+        ce_fail(ev);
+        return a;
+    }
+    switch (op) {
+    case 'e': case 'n': case '<': case '>': case 'l': case 'g': {
+        int cmp = is_unsigned ? (ua > ub) - (ua < ub) : (a.v > b.v) - (a.v < b.v);
+        r = op == 'e' ? cmp == 0 : op == 'n' ? cmp != 0 : op == '<' ? cmp < 0 :
+            op == '>' ? cmp > 0 : op == 'l' ? cmp <= 0 : cmp >= 0;
+        return const_val(r, TYPE_BOOL, 1);
+    }
+    case 'L': case 'R': {
+        int bits = const_bits(a.type);
+        if (b.v < 0 || b.v >= bits) {
+            ce_overflow(ev, at, op == 'L' ? "attempt to shift left with overflow" : "attempt to shift right with overflow");
+            return a;
+        }
+        if (op == 'L') r = const_wrap((long long)(ua << b.v), a.type);
+        else if (const_unsigned(a.type)) r = (long long)(ua >> b.v);
+        else r = a.v >> b.v;
+        return const_val(r, a.type, a.typed);
+    }
+    case '+': r = (long long)(ua + ub); break;
+    case '-': r = (long long)(ua - ub); break;
+    case '*': r = (long long)(ua * ub); break;
+    case '/': case '%':
+        if (b.v == 0) {
+            ce_overflow(ev, at, op == '/' ? "attempt to divide by zero"
+                                          : "attempt to calculate the remainder with a divisor of zero");
+            return a;
+        }
+        if (!is_unsigned && a.v == LLONG_MIN && b.v == -1) {
+            ce_overflow(ev, at, op == '/' ? "attempt to divide with overflow"
+                                          : "attempt to calculate the remainder with overflow");
+            return a;
+        }
+        if (is_unsigned) r = (long long)(op == '/' ? ua / ub : ua % ub);
+        else r = op == '/' ? a.v / b.v : a.v % b.v;
+        break;
+    case '&': r = a.v & b.v; break;
+    case '|': r = a.v | b.v; break;
+    case '^': r = a.v ^ b.v; break;
+    }
+    /* rustc rejects a const whose arithmetic overflows its type */
+    if (typed && const_wrap(r, type) != r) {
+        ce_overflow(ev, at, op == '+' ? "attempt to add with overflow" : op == '-' ? "attempt to subtract with overflow"
+                          : op == '*' ? "attempt to multiply with overflow" : op == '/' ? "attempt to divide with overflow"
+                          : "attempt to calculate the remainder with overflow");
+        return a;
+    }
+    return const_val(r, type, typed);
+}
 
-                            /* Skip past any trailing expr parts (as casts, operators, etc.) */
-                            while (*pos && *pos != ',' && *pos != '}') pos++;
-                            if (*pos == ',') pos++;
-                        }
-                        if (*pos == '}') pos++;
+/* An integer literal token: digits, '_' separators, 0x/0o/0b and an
+ * optional type suffix */
+static int ce_int_literal(ConstEval* ev, const Token* t, ConstVal* out) {
+    CompilerContext* cx = ev->cx;
+    const char* p = tok_ptr(cx, t);
+    const char* e = p + t->len;
+    unsigned long long v = 0;
+    int base = 10, d;
+
+    if (e - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'o' || p[1] == 'b')) {
+        base = p[1] == 'x' ? 16 : p[1] == 'o' ? 8 : 2;
+        p += 2;
+    }
+    for (; p < e; p++) {
+        if (*p == '_') continue;
+        if (isdigit((unsigned char)*p)) d = *p - '0';
+        else if (base == 16 && isxdigit((unsigned char)*p)) d = tolower((unsigned char)*p) - 'a' + 10;
+        else break;
+        if (d >= base || v > (~0ULL - d) / base) return 0;
+        v = v * base + d;
+    }
+    *out = const_val((long long)v, TYPE_I32, 0);
+    if (p < e) {
+        /* interned: the file need not name the type anywhere else */
+        int type = const_type_of(cx, intern(cx, p, (int)(e - p)));
+        if (type < 0 || type == TYPE_BOOL || type == TYPE_CHAR) return 0;
+        *out = const_val(const_wrap((long long)v, type), type, 1);
+        if ((unsigned long long)out->v != v) return 0;
+    } else if (ev->hint != TYPE_TUPLE && ev->hint != TYPE_BOOL && ev->hint != TYPE_CHAR) {
+        out->type = ev->hint;
+    }
+    return 1;
+}
 
-                        vars[var_count].type = TYPE_STRUCT;
-                        vars[var_count].size = struct_size > 0 ? struct_size : 4;
-                        alpha_size_set = 1;
+/* 'x', '\n', '\x41', '\u{1F600}', b'x' */
+static int ce_char_literal(ConstEval* ev, const Token* t, ConstVal* out) {
+    const unsigned char* p = (const unsigned char*)tok_ptr(ev->cx, t);
+    const unsigned char* e = p + t->len - 1;
+    int is_byte = *p == 'b';
+    long long v;
+
+    p += is_byte ? 2 : 1;
+    if (p >= e) return 0;
+    if (*p == '\\') {
+        p++;
+        switch (*p) {
+        case 'n': v = '\n'; break;
+        case 'r': v = '\r'; break;
+        case 't': v = '\t'; break;
+        case '0': v = 0; break;
+        case '\\': case '\'': case '"': v = *p; break;
+        case 'x':
+            if (e - p < 3 || !isxdigit(p[1]) || !isxdigit(p[2])) return 0;
+            v = strtol((const char*)p + 1, NULL, 16) & 0xFF;
+            break;
+        case 'u':
+            if (p[1] != '{') return 0;
+            v = strtol((const char*)p + 2, NULL, 16);
+            break;
+        default:
+            return 0;
+        }
+    } else if (*p < 0x80) {
+        v = *p;
+    } else {
+        /* one UTF-8 sequence */
+        int n = (*p >= 0xF0) ? 3 : (*p >= 0xE0) ? 2 : 1;
+        v = *p & (0x3F >> n);
+        while (n-- > 0 && ++p < e) v = (v << 6) | (*p & 0x3F);
+    }
+    *out = const_val(v, is_byte ? TYPE_U8 : TYPE_CHAR, 1);
+    return 1;
+}
 
-                    } else if (*pos == '(') {
-                        printf("    ; %s = %s(...)\n", var_name, ref_name);
-                        /* Pass arguments */
-                        pos++;
-                        int arg_reg = 3;
-                        while (*pos && *pos != ')') {
-                            skip_whitespace();
-                            if (*pos == ')') break;
-                            if (*pos == '"') {
-                                /* String arg — skip for now */
-                                pos++;
-                                while (*pos && *pos != '"') { if (*pos == '\\') pos++; pos++; }
-                                if (*pos == '"') pos++;
-                            } else if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                                int aval = parse_number();
-                                if (arg_reg <= 10) {
-                                    emit_li(arg_reg, aval);
-                                    arg_reg++;
-                                }
-                            } else if (isalpha(*pos) || *pos == '_') {
-                                char aname[64] = {0};
-                                int ai = 0;
-                                while (*pos && (isalnum(*pos) || *pos == '_') && ai < 63) {
-                                    aname[ai++] = *pos++;
-                                }
-                                /* Skip method chains: arg.method().method() */
-                                while (*pos == '.') {
-                                    pos++;
-                                    while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
-                                    if (*pos == '(') {
-                                        pos++;
-                                        int depth = 1;
-                                        while (*pos && depth > 0) {
-                                            if (*pos == '(') depth++;
-                                            else if (*pos == ')') depth--;
-                                            pos++;
-                                        }
-                                    }
-                                }
-                                /* Look up arg variable */
-                                int j;
-                                for (j = 0; j < var_count; j++) {
-                                    if (strcmp(vars[j].name, aname) == 0) {
-                                        if (arg_reg <= 10) {
-                                            printf("    lwz r%d, %d(r1)   ; arg %s\n", arg_reg, vars[j].offset, aname);
-                                            arg_reg++;
-                                        }
-                                        break;
-                                    }
+/* The binding sym names in the current const fn frame, or NULL */
+static ConstBinding* ce_binding(ConstEval* ev, int sym) {
+    CompilerContext* cx = ev->cx;
+    int k;
+    for (k = cx->const_env_count - 1; k >= ev->env_base; k--) {
+        if (cx->const_env[k].sym == sym) return &cx->const_env[k];
+    }
+    return NULL;
+}
+
+static void ce_bind(ConstEval* ev, int sym, ConstVal v) {
+    CompilerContext* cx = ev->cx;
+    ConstBinding* b = &cx->const_env[cx->const_env_count++];
+    b->sym = sym;
+    b->value = v.v;
+    b->type = v.type;
+    b->typed = v.typed;
+    cx->const_env = table_reserve(cx, cx->const_env, cx->const_env_count, &cx->const_env_capacity,
+                                  sizeof(ConstBinding));
+}
+
+/* type_of() of each parameter's declared type name, -1 where there is
+ * no plain name */
+static void fn_param_named_types(CompilerContext* cx, const Function* fn, int* types,
+                                 int (*type_of)(CompilerContext*, int)) {
+    int i = tok_skip_angles(cx, fn->fn_tok + 2);
+    int close = tok_match_close(cx, i);
+    int p = 0, colon = 0;
+    for (i++; i <= close && p < fn->param_count; i++) {
+        const Token* t = &cx->tokens[i];
+        if (i == close || tok_is_punct(t, ',')) {
+            types[p++] = colon;
+            colon = 0;
+        } else if (tok_is_punct(t, ':') && !tok_is_punct(t + 1, ':') && !tok_is_punct(t - 1, ':')) {
+            colon = t[1].kind == TOK_IDENT ? type_of(cx, t[1].sym) : -1;
+            if (!tok_is_punct(t + 2, ',') && !tok_is_punct(t + 2, ')')) colon = -1;
+        }
+    }
+}
+
+/* Declared integer type of each parameter of fn, -1 where it is not one */
+static void ce_param_types(CompilerContext* cx, const Function* fn, int* types) {
+    fn_param_named_types(cx, fn, types, const_type_of);
+}
+
+/* TYPE_F32/TYPE_F64 for each f32/f64 parameter of fn, -1 for the rest */
+static void fn_param_floats(CompilerContext* cx, const Function* fn, int* types) {
+    fn_param_named_types(cx, fn, types, float_type_of);
+}
+
+/* Element type a slice of the type named sym may hold: the integers
+ * up to 32 bits and f32; -1 for anything else */
+static int slice_elem_type(CompilerContext* cx, int sym) {
+    int t = const_type_of(cx, sym);
+    if (t == TYPE_BOOL || t == TYPE_CHAR || const_bits(t) > 32) t = -1;
+    if (t < 0 && float_type_of(cx, sym) == TYPE_F32) t = TYPE_F32;
+    return t;
+}
+
+/* Element type of each &[T] / &mut [T] parameter of fn, -1 for the
+ * rest. Slices take two argument words, the pointer and the length. */
+static void fn_param_slices(CompilerContext* cx, const Function* fn, int* elems) {
+    int i = tok_skip_angles(cx, fn->fn_tok + 2);
+    int close = tok_match_close(cx, i);
+    int p = 0, elem = -1;
+    for (i++; i <= close && p < fn->param_count; i++) {
+        const Token* t = &cx->tokens[i];
+        if (i == close || tok_is_punct(t, ',')) {
+            elems[p++] = elem;
+            elem = -1;
+        } else if (tok_is_punct(t, ':') && !tok_is_punct(t + 1, ':') && !tok_is_punct(t - 1, ':')
+                   && tok_is_punct(t + 1, '&')) {
+            const Token* e = t + 2;
+            if (tok_kw(e) == KW_MUT) e++;
+            if (tok_is_punct(e, '[') && e[1].kind == TOK_IDENT && tok_is_punct(e + 2, ']')
+                    && (tok_is_punct(e + 3, ',') || tok_is_punct(e + 3, ')'))) {
+                elem = slice_elem_type(cx, e[1].sym);
+            }
+        }
+    }
+}
+
+/* Call const fn f with the arguments at ev->i ('(') */
+static ConstVal ce_call(ConstEval* ev, int f) {
+    CompilerContext* cx = ev->cx;
+    Function* fn = &cx->functions[f];
+    ConstVal args[CONST_MAX_ARGS], result = const_val(0, TYPE_TUPLE, 0);
+    int types[CONST_MAX_ARGS];
+    int n = 0, k, ret_type = -1;
+
+    ev->i++;
+    while (!ce_stopped(ev) && !ce_punct(ev, ')')) {
+        if (n == CONST_MAX_ARGS) {
+            ev->failed = 1;
+            break;
+        }
+        args[n++] = ce_expr(ev, CPREC_OR);
+        if (!ce_punct(ev, ')')) ce_expect(ev, ',');
+    }
+    ce_expect(ev, ')');
+    if (ce_stopped(ev) || ev->dry) return const_val(0, TYPE_I32, 0);
+    if (n != fn->param_count || fn->has_self || ev->depth >= CONST_MAX_DEPTH) {
+        ev->failed = 1;
+        return result;
+    }
+
+    ConstEval sub = *ev;
+    int base = cx->const_env_count;
+    ce_param_types(cx, fn, types);
+    for (k = 0; k < n; k++) {
+        if (!fn->param_names[k]) {
+            ev->failed = 1;
+            return result;
+        }
+        if (types[k] >= 0) args[k] = const_val(const_wrap(args[k].v, types[k]), types[k], 1);
+        sub.env_base = base;
+        ce_bind(&sub, intern(cx, fn->param_names[k], strlen(fn->param_names[k])), args[k]);
+    }
+    if (fn->return_type) {
+        int sym = sym_find(cx, fn->return_type, strlen(fn->return_type));
+        ret_type = sym >= 0 ? const_type_of(cx, sym) : -1;
+    }
+    sub.i = fn->body_tok;
+    sub.end = fn->body_end_tok + 1;
+    sub.depth = ev->depth + 1;
+    sub.item = 1;
+    sub.env_base = base;
+    sub.hint = ret_type >= 0 ? (RustType)ret_type : TYPE_TUPLE;
+    sub.prefix = 0;
+    sub.overflow = 0;
+    result = ce_block(&sub);
+    if (sub.returning) result = sub.ret;
+    cx->const_env_count = base;
+    ev->steps = sub.steps;
+    /* overflow in a call is an error where rustc evaluates it: in a
+     * const item; codegen's own expressions fall back to the call */
+    if (sub.overflow && ev->item && !ev->overflow) {
+        ev->overflow = sub.overflow;
+        ev->overflow_what = sub.overflow_what;
+    }
+    if (sub.failed || result.type == TYPE_TUPLE) {
+        ev->failed = 1;
+        return result;
+    }
+    if (ret_type >= 0) result = const_val(const_wrap(result.v, ret_type), ret_type, 1);
+    return result;
+}
+
+/* A path expression: local binding, const fn call, const/static item,
+ * or one of the integer types' MAX/MIN/BITS */
+static ConstVal ce_path(ConstEval* ev) {
+    CompilerContext* cx = ev->cx;
+    ConstVal v = const_val(0, TYPE_I32, 0);
+    int segs[8], n = 0, idx;
+
+    for (;;) {
+        const Token* t = ce_tok(ev, ev->i);
+        int kw = tok_kw(t);
+        if (ev->i >= ev->end || t->kind != TOK_IDENT ||
+            (kw >= 0 && kw != KW_CRATE && kw != KW_SELF_TYPE && kw != KW_SUPER && kw != KW_SELF)) {
+            ev->failed = 1;
+            return v;
+        }
+        if (n < 8) segs[n++] = t->sym;
+        ev->i++;
+        if (!(ce_punct(ev, ':') && ce_joined(ev, ev->i, ':'))) break;
+        ev->i += 2;
+        if (ce_punct(ev, '<')) ev->i = tok_skip_angles(cx, ev->i);     /* turbofish */
+        if (ce_punct(ev, ':') && ce_joined(ev, ev->i, ':')) ev->i += 2;
+    }
+    int last = segs[n - 1];
+
+    if (ce_punct(ev, '!')) {
+        ev->failed = 1;         /* macro */
+        return v;
+    }
+    if (ce_punct(ev, '(')) {
+        int f = cx->sym_entries[last].const_fn;
+        const char* owner = f >= 0 ? cx->functions[f].owner : NULL;
+        if (f < 0 || (n == 1 && owner) ||
+            (n > 1 && owner && segs[n - 2] != KW_SELF_TYPE && strcmp(owner, sym_name(cx, segs[n - 2])) != 0)) {
+            ev->failed = 1;
+            return v;
+        }
+        return ce_call(ev, f);
+    }
+
+    if (n == 1) {
+        ConstBinding* b = ce_binding(ev, last);
+        if (b) return const_val(b->value, b->type, b->typed);
+        if (!ev->item && ev->depth == 0 && cx->sym_entries[last].var >= 0) {
+            ev->failed = 1;     /* a runtime local shadows any item */
+            return v;
+        }
+    }
+    if (n == 2) {
+        int type = const_type_of(cx, segs[0]);
+        const char* what = sym_name(cx, last);
+        int si = cx->sym_entries[segs[0]].struct_idx, k;
+        if (si >= 0 && !ce_punct(ev, '{')) {
+            /* Enum::Variant of a fieldless variant is its discriminant */
+            Struct* s = &cx->structs[si];
+            for (k = 0; k < s->field_count; k++) {
+                if (s->fields[k].type != TYPE_ENUM) break;
+                if (s->fields[k].name == what && s->fields[k].size == 0) return const_val(s->fields[k].offset, TYPE_I32, 0);
+            }
+        }
+        if (type >= 0 && type != TYPE_BOOL && type != TYPE_CHAR) {
+            int bits = const_bits(type);
+            if (strcmp(what, "BITS") == 0) return const_val(bits, TYPE_U32, 1);
+            if (strcmp(what, "MAX") == 0) {
+                unsigned long long m = const_unsigned(type) ? ~0ULL >> (64 - bits) : ~0ULL >> (65 - bits);
+                return const_val((long long)m, type, 1);
+            }
+            if (strcmp(what, "MIN") == 0) {
+                return const_val(const_unsigned(type) ? 0 : (long long)(~0ULL << (bits - 1)), type, 1);
+            }
+        }
+    }
+
+    idx = cx->sym_entries[last].const_idx;
+    if (idx < 0 || (cx->consts[idx].is_static && cx->consts[idx].is_mut) || !const_item_eval(cx, idx)) {
+        ce_fail(ev);
+        return v;
+    }
+    ConstItem* c = &cx->consts[idx];
+    if (!c->is_array) return const_val(c->value, c->type, 1);
+
+    /* Constant tables: TABLE[i] and TABLE.len() */
+    if (ce_punct(ev, '[')) {
+        ev->i++;
+        ConstVal at = ce_expr(ev, CPREC_OR);
+        ce_expect(ev, ']');
+        if (ce_stopped(ev)) return v;
+        if (at.v < 0 || at.v >= c->elem_count) {
+            ce_fail(ev);
+            return v;
+        }
+        return const_val(c->elems[at.v], c->type, 1);
+    }
+    if (ce_punct(ev, '.') && ev->i + 3 < ev->end && ce_tok(ev, ev->i + 1)->kind == TOK_IDENT &&
+        strcmp(sym_name(cx, ce_tok(ev, ev->i + 1)->sym), "len") == 0 &&
+        tok_is_punct(ce_tok(ev, ev->i + 2), '(') && tok_is_punct(ce_tok(ev, ev->i + 3), ')')) {
+        ev->i += 4;
+        return const_val(c->elem_count, TYPE_U32, 1);
+    }
+    ev->failed = 1;
+    return v;
+}
+
+/* if COND { .. } [else if .. | else { .. }] at ev->i */
+static ConstVal ce_if(ConstEval* ev) {
+    ConstVal v = const_val(0, TYPE_TUPLE, 0), branch;
+    int dry = ev->dry, taken;
+
+    ev->i++;
+    if (tok_kw(ce_tok(ev, ev->i)) == KW_LET) {
+        ev->failed = 1;
+        return v;
+    }
+    ConstVal cond = ce_expr(ev, CPREC_OR);
+    if (ce_stopped(ev) || !ce_punct(ev, '{')) {
+        ev->failed = 1;
+        return v;
+    }
+    taken = !dry && cond.v;
+    ev->dry = dry || !taken;
+    branch = ce_block(ev);
+    ev->dry = dry;
+    if (taken) v = branch;
+    if (!ce_stopped(ev) && tok_kw(ce_tok(ev, ev->i)) == KW_ELSE) {
+        ev->i++;
+        ev->dry = dry || taken;
+        if (tok_kw(ce_tok(ev, ev->i)) == KW_IF) branch = ce_if(ev);
+        else if (ce_punct(ev, '{')) branch = ce_block(ev);
+        else ev->failed = 1;
+        ev->dry = dry;
+        if (!dry && !taken) v = branch;
+    }
+    return v;
+}
+
+static ConstVal ce_unary(ConstEval* ev) {
+    ConstVal v = const_val(0, TYPE_I32, 0);
+    const Token* t = ce_tok(ev, ev->i);
+    int kw = tok_kw(t);
+
+    if (ev->i >= ev->end || --ev->steps < 0) {
+        ev->failed = 1;
+        return v;
+    }
+    if (tok_is_punct(t, '-') || tok_is_punct(t, '!')) {
+        ev->i++;
+        v = ce_unary(ev);
+        if (ce_stopped(ev)) return v;
+        if (v.type == TYPE_TUPLE) {
+            ce_fail(ev);
+        } else if (t->ch == '!') {
+            v.v = v.type == TYPE_BOOL ? !v.v : (v.typed ? const_wrap(~v.v, v.type) : ~v.v);
+        } else if (v.typed && const_unsigned(v.type)) {
+            ce_fail(ev);
+        } else if (v.typed && const_wrap(-(unsigned long long)v.v, v.type) != (long long)-(unsigned long long)v.v) {
+            ce_overflow(ev, (int)(t - ev->cx->tokens), "attempt to negate with overflow");
+        } else {
+            v.v = (long long)-(unsigned long long)v.v;
+        }
+        return v;
+    }
+    switch (t->kind) {
+    case TOK_INT:
+        if (!ce_int_literal(ev, t, &v)) ev->failed = 1;
+        ev->i++;
+        return v;
+    case TOK_CHAR:
+        if (!ce_char_literal(ev, t, &v)) ev->failed = 1;
+        ev->i++;
+        return v;
+    case TOK_IDENT:
+        if (kw == KW_TRUE || kw == KW_FALSE) {
+            ev->i++;
+            return const_val(kw == KW_TRUE, TYPE_BOOL, 1);
+        }
+        if (kw == KW_IF) return ce_if(ev);
+        if (kw == KW_UNSAFE && tok_is_punct(ce_tok(ev, ev->i + 1), '{')) {
+            ev->i++;
+            return ce_block(ev);
+        }
+        return ce_path(ev);
+    case TOK_PUNCT:
+        if (t->ch == '(') {
+            ev->i++;
+            v = ce_expr(ev, CPREC_OR);
+            ce_expect(ev, ')');
+            return v;
+        }
+        if (t->ch == '{') return ce_block(ev);
+        break;
+    }
+    ev->failed = 1;
+    return v;
+}
+
+/* Operand with its `as` casts */
+static ConstVal ce_cast(ConstEval* ev) {
+    ConstVal v = ce_unary(ev);
+    while (!ce_stopped(ev) && tok_kw(ce_tok(ev, ev->i)) == KW_AS && ev->i + 1 < ev->end) {
+        const Token* t = ce_tok(ev, ev->i + 1);
+        int type = t->kind == TOK_IDENT ? const_type_of(ev->cx, t->sym) : -1;
+        /* only bool and u8 cast to char; nothing casts to bool */
+        if (type < 0 || type == TYPE_BOOL || v.type == TYPE_TUPLE ||
+            (type == TYPE_CHAR && v.type != TYPE_U8 && v.type != TYPE_CHAR)) {
+            ev->failed = 1;
+            return v;
+        }
+        ev->i += 2;
+        v = const_val(const_wrap(v.v, type), type, 1);
+    }
+    return v;
+}
+
+/* Precedence climbing from min_prec up */
+static ConstVal ce_expr(ConstEval* ev, int min_prec) {
+    int top = ev->prefix;
+    ev->prefix = 0;
+    ConstVal lhs = ce_cast(ev);
+    char op;
+    int len, prec;
+
+    while (!ce_stopped(ev) && (prec = ce_binop(ev, &op, &len)) >= min_prec && prec != CPREC_NONE) {
+        int at = ev->i, dry = ev->dry;
+        ev->i += len;
+        if (op == 'A' || op == 'O') {
+            /* short-circuit: the right side is parsed but not evaluated */
+            if (lhs.type != TYPE_BOOL) ce_fail(ev);
+            ev->dry = dry || (op == 'A' ? !lhs.v : lhs.v);
+            ConstVal rhs = ce_expr(ev, prec + 1);
+            ev->dry = dry;
+            if (!ev->failed && rhs.type != TYPE_BOOL) ce_fail(ev);
+            if (!ce_stopped(ev) && (op == 'A' ? lhs.v : !lhs.v)) lhs.v = rhs.v;
+        } else {
+            ConstVal rhs = ce_expr(ev, prec + 1);
+            if (!ce_stopped(ev)) lhs = ce_apply(ev, op, lhs, rhs, at);
+        }
+        if (ev->failed && top && !ev->returning) {
+            /* keep the constant prefix; codegen takes it from here */
+            ev->failed = 0;
+            ev->i = at;
+            break;
+        }
+    }
+    return lhs;
+}
+
+/* Assignment statement `name op= expr` at ev->i; 0 if it is not one */
+static int ce_assign(ConstEval* ev) {
+    char op = 0;
+    int k = ev->i + 1;
+    const Token* t = ce_tok(ev, k);
+    if (ce_tok(ev, ev->i)->kind != TOK_IDENT || k >= ev->end || t->kind != TOK_PUNCT) return 0;
+    if (t->ch == '=' && !ce_joined(ev, k, '=')) {
+        k += 1;
+    } else if (strchr("+-*/%&|^", t->ch) && ce_joined(ev, k, '=')) {
+        op = t->ch;
+        k += 2;
+    } else if ((t->ch == '<' || t->ch == '>') && ce_joined(ev, k, t->ch) && ce_joined(ev, k + 1, '=')) {
+        op = t->ch == '<' ? 'L' : 'R';
+        k += 3;
+    } else {
+        return 0;
+    }
+    ConstBinding* b = ce_binding(ev, ce_tok(ev, ev->i)->sym);
+    if (!b) {
+        ev->failed = 1;
+        return 1;
+    }
+    int at = (int)(b - ev->cx->const_env), op_tok = ev->i + 1;
+    ConstVal cur = const_val(b->value, b->type, b->typed);
+    ev->i = k;
+    ConstVal v = ce_expr(ev, CPREC_OR);
+    if (ce_stopped(ev)) return 1;
+    if (op) v = ce_apply(ev, op, cur, v, op_tok);
+    if (!ev->failed && !ev->dry) {
+        b = &ev->cx->const_env[at];     /* the call above may have grown the table */
+        b->value = b->typed ? const_wrap(v.v, b->type) : v.v;
+        if (!b->typed) b->type = v.type;
+    }
+    return 1;
+}
+
+/* { statements; tail } at ev->i. Returns the tail's value, () without one. */
+static ConstVal ce_block(ConstEval* ev) {
+    CompilerContext* cx = ev->cx;
+    ConstVal v = const_val(0, TYPE_TUPLE, 0);
+    int close = tok_match_close(cx, ev->i);
+    int mark = cx->const_env_count;
+    int saved_end = ev->end;
+
+    if (close >= ev->end) {
+        ev->failed = 1;
+        return v;
+    }
+    ev->end = close;
+    ev->i++;
+    while (!ce_stopped(ev) && ev->i < close) {
+        const Token* t = ce_tok(ev, ev->i);
+        int kw = tok_kw(t);
+        v = const_val(0, TYPE_TUPLE, 0);
+
+        if (tok_is_punct(t, ';')) {
+            ev->i++;
+        } else if (kw == KW_LET) {
+            int sym, type = -1;
+            ev->i++;
+            if (tok_kw(ce_tok(ev, ev->i)) == KW_MUT) ev->i++;
+            t = ce_tok(ev, ev->i);
+            if (t->kind != TOK_IDENT || tok_kw(t) >= 0) {
+                ev->failed = 1;
+                break;
+            }
+            sym = t->sym;
+            ev->i++;
+            if (ce_punct(ev, ':')) {
+                t = ce_tok(ev, ev->i + 1);
+                type = t->kind == TOK_IDENT ? const_type_of(cx, t->sym) : -1;
+                if (type < 0) {
+                    ev->failed = 1;
+                    break;
+                }
+                ev->i += 2;
+            }
+            ce_expect(ev, '=');
+            RustType hint = ev->hint;
+            if (type >= 0) ev->hint = type;
+            ConstVal init = ce_expr(ev, CPREC_OR);
+            ev->hint = hint;
+            ce_expect(ev, ';');
+            if (type >= 0) init = const_val(const_wrap(init.v, type), type, 1);
+            if (!ev->failed) ce_bind(ev, sym, init);
+        } else if (kw == KW_RETURN) {
+            ev->i++;
+            if (!ce_punct(ev, ';') && ev->i < close) v = ce_expr(ev, CPREC_OR);
+            if (!ce_stopped(ev) && !ev->dry) {
+                ev->ret = v;
+                ev->returning = 1;
+            }
+            if (ce_punct(ev, ';')) ev->i++;
+            v = const_val(0, TYPE_TUPLE, 0);
+        } else if (kw == KW_WHILE) {
+            int cond = ev->i + 1, dry = ev->dry;
+            for (;;) {
+                ev->i = cond;
+                ConstVal c = ce_expr(ev, CPREC_OR);
+                if (ce_stopped(ev) || !ce_punct(ev, '{')) {
+                    ev->failed = 1;
+                    break;
+                }
+                if (dry || !c.v) {
+                    ev->dry = 1;
+                    ce_block(ev);
+                    ev->dry = dry;
+                    break;
+                }
+                ce_block(ev);
+                if (ce_stopped(ev)) break;
+            }
+        } else if (kw == KW_IF || tok_is_punct(t, '{') || (kw == KW_UNSAFE && tok_is_punct(t + 1, '{'))) {
+            v = ce_unary(ev);
+        } else if (kw >= 0 && kw != KW_SELF && kw != KW_SELF_TYPE && kw != KW_CRATE &&
+                   kw != KW_TRUE && kw != KW_FALSE) {
+            ev->failed = 1;     /* loop, for, match, break, items ... */
+        } else if (ce_assign(ev)) {
+            if (!ce_stopped(ev) && ev->i < close) ce_expect(ev, ';');
+        } else {
+            v = ce_expr(ev, CPREC_OR);
+            if (!ce_stopped(ev) && ev->i < close) ce_expect(ev, ';');
+            if (ev->i < close) v = const_val(0, TYPE_TUPLE, 0);
+        }
+    }
+    cx->const_env_count = mark;
+    ev->end = saved_end;
+    ev->i = close + 1;
+    return v;
+}
+
+/* 1-based source line of pos, for errors and -Z match-stats */
+static int source_line(CompilerContext* cx, const char* pos) {
+    const char* p;
+    int line = 1;
+    for (p = cx->src_base; p < pos; p++) {
+        if (*p == '\n') line++;
+    }
+    return line;
+}
+
+/* An error rustc reports at compile time, at token tok: on stderr, and
+ * kept for --serve and -j reports. The file fails. */
+static void const_error(CompilerContext* cx, int tok, const char* what) {
+    snprintf(cx->error, sizeof(cx->error), "%s:%d: error: %s", cx->input ? cx->input : "<stdin>",
+             source_line(cx, tok_ptr(cx, &cx->tokens[tok])), what);
+    fprintf(stderr, "%s\n", cx->error);
+    cx->error_count++;
+}
+
+/* Evaluate the const or static item idx once; 1 if its value is known */
+int const_item_eval(CompilerContext* cx, int idx) {
+    ConstItem* c = &cx->consts[idx];
+    const Token* ty = &cx->tokens[c->type_tok];
+    int type;
+    ConstEval ev;
+
+    if (c->state == CONST_KNOWN || c->state == CONST_UNKNOWN) return c->state == CONST_KNOWN;
+    if (c->state == CONST_BUSY) return 0;       /* defined in terms of itself */
+    c->state = CONST_BUSY;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.cx = cx;
+    ev.i = c->init_tok;
+    ev.end = c->end_tok;
+    ev.item = 1;
+    ev.env_base = cx->const_env_count;
+    ev.steps = CONST_MAX_STEPS;
+
+    /* T or [T; N] */
+    c->is_array = tok_is_punct(ty, '[');
+    if (c->is_array) ty++;
+    type = ty->kind == TOK_IDENT ? const_type_of(cx, ty->sym) : -1;
+    if (type < 0 || (!c->is_array && c->type_tok + 1 != c->init_tok - 1)) {
+        c->state = CONST_UNKNOWN;
+        return 0;
+    }
+    c->type = type;
+    ev.hint = type;
+
+    if (!c->is_array) {
+        ConstVal v = ce_expr(&ev, CPREC_OR);
+        if (!ev.failed && ev.i == ev.end && v.type != TYPE_TUPLE) {
+            c->value = const_wrap(v.v, type);
+            c->state = CONST_KNOWN;
+        }
+    } else if (tok_is_punct(&cx->tokens[ev.i], '[') && tok_match_close(cx, ev.i) == ev.end - 1) {
+        ConstVal first;
+        ev.end--;
+        ev.i++;
+        first = ce_expr(&ev, CPREC_OR);
+        if (!ev.failed && ce_punct(&ev, ';')) {
+            /* [x; N] */
+            ConstVal n;
+            int k;
+            ev.i++;
+            ev.hint = TYPE_U32;
+            n = ce_expr(&ev, CPREC_OR);
+            if (!ev.failed && ev.i == ev.end && n.v >= 0 && n.v <= CONST_MAX_ELEMS) {
+                c->elem_count = (int)n.v;
+                c->elems = arena_alloc(cx, (c->elem_count + 1) * sizeof(long long));
+                for (k = 0; k < c->elem_count; k++) c->elems[k] = const_wrap(first.v, type);
+                c->state = CONST_KNOWN;
+            }
+        } else if (!ev.failed) {
+            /* [a, b, ...] */
+            int cap = 0;
+            c->elems = table_reserve(cx, NULL, 0, &cap, sizeof(long long));
+            c->elems[c->elem_count++] = const_wrap(first.v, type);
+            while (!ev.failed && ce_punct(&ev, ',') && c->elem_count < CONST_MAX_ELEMS) {
+                ev.i++;
+                if (ev.i == ev.end) break;      /* trailing comma */
+                ConstVal e = ce_expr(&ev, CPREC_OR);
+                c->elems = table_reserve(cx, c->elems, c->elem_count, &cap, sizeof(long long));
+                c->elems[c->elem_count++] = const_wrap(e.v, type);
+            }
+            if (!ev.failed && ev.i == ev.end) c->state = CONST_KNOWN;
+        }
+    }
+    cx->const_env_count = ev.env_base;
+    if (c->state != CONST_KNOWN) {
+        c->state = CONST_UNKNOWN;
+        if (ev.overflow) {
+            char what[256];
+            snprintf(what, sizeof(what), "evaluation of %s `%s` failed: %s", c->is_static ? "static" : "constant",
+                     sym_name(cx, c->sym), ev.overflow_what);
+            const_error(cx, ev.overflow, what);
+        }
+    }
+    return c->state == CONST_KNOWN;
+}
+
+/* Evaluate the expression at pos if it is a compile-time constant,
+ * taking operators from min_prec up. With prefix, a constant leading
+ * operand chain folds even when the rest is not (`A * B + x`). With a
+ * stop character the next token must be that punctuation. On success
+ * pos moves past the expression. */
+int const_expr_at(CompilerContext* cx, int min_prec, int prefix, char stop, long long* value, RustType* type) {
+    ConstEval ev;
+    int i;
+
+    skip_whitespace(cx);
+    i = tok_index_at(cx, cx->pos);
+    if (i >= cx->tok_count || cx->src_base + cx->tokens[i].start != cx->pos) return 0;
+    memset(&ev, 0, sizeof(ev));
+    ev.cx = cx;
+    ev.i = i;
+    ev.end = cx->tok_count;
+    ev.env_base = cx->const_env_count;
+    ev.steps = CONST_MAX_STEPS;
+    ev.prefix = prefix;
+    ev.hint = TYPE_TUPLE;
+    ConstVal v = ce_expr(&ev, min_prec);
+    cx->const_env_count = ev.env_base;
+    /* codegen may look at an expression more than once; report it once */
+    if (ev.overflow) {
+        int k = 0;
+        while (k < cx->error_tok_count && cx->error_toks[k] != ev.overflow) k++;
+        if (k == cx->error_tok_count && k < (int)(sizeof(cx->error_toks) / sizeof(cx->error_toks[0]))) {
+            cx->error_toks[cx->error_tok_count++] = ev.overflow;
+            const_error(cx, ev.overflow, ev.overflow_what);
+        }
+    }
+    if (ev.failed || ev.returning || v.type == TYPE_TUPLE || ev.i == i) return 0;
+    if (stop && !tok_is_punct(&cx->tokens[ev.i], stop)) return 0;
+    cx->pos = tok_end(cx, &cx->tokens[ev.i - 1]);
+    *value = v.v;
+    if (type) *type = v.type;
+    return 1;
+}
+
+/* The static mut whose value lives in .data under _NAME, or NULL */
+ConstItem* static_mut_lookup(CompilerContext* cx, const char* name) {
+    int sym = sym_find(cx, name, strlen(name));
+    if (sym < 0 || cx->sym_entries[sym].const_idx < 0 || cx->sym_entries[sym].var >= 0) return NULL;
+    ConstItem* c = &cx->consts[cx->sym_entries[sym].const_idx];
+    return (c->is_static && c->is_mut && !c->is_array && c->state == CONST_KNOWN) ? c : NULL;
+}
+
+void emit_static_load(CompilerContext* cx, int reg, ConstItem* c) {
+    const char* name = sym_name(cx, c->sym);
+    int size = const_size(c->type);
+    const char* op = size == 1 ? "lbz" : size == 2 ? (const_unsigned(c->type) ? "lhz" : "lha") : "lwz";
+    emit(cx, "    lis r%d, ha16(_%s)\n", reg, name);
+    emit(cx, "    %s r%d, lo16(_%s%s)(r%d)   ; static %s\n", op, reg, name, size == 8 ? "+4" : "", reg, name);
+}
+
+/* Store reg into the static, using addr_reg for its address */
+void emit_static_store(CompilerContext* cx, int reg, int addr_reg, ConstItem* c) {
+    const char* name = sym_name(cx, c->sym);
+    int size = const_size(c->type);
+    const char* op = size == 1 ? "stb" : size == 2 ? "sth" : "stw";
+    emit(cx, "    lis r%d, ha16(_%s)\n", addr_reg, name);
+    emit(cx, "    %s r%d, lo16(_%s%s)(r%d)   ; static %s\n", op, reg, name, size == 8 ? "+4" : "", addr_reg, name);
+}
+
+/* Static items as initialized data */
+void emit_static_data(CompilerContext* cx) {
+    int i, k, any = 0;
+    for (i = 0; i < cx->const_count; i++) {
+        ConstItem* c = &cx->consts[i];
+        if (!c->is_static || cx->sym_entries[c->sym].const_idx != i || !const_item_eval(cx, i)) continue;
+        int size = const_size(c->type);
+        int count = c->is_array ? c->elem_count : 1;
+        if (!any++) emit(cx, "\n; Static items\n.data\n");
+        emit(cx, ".align %d\n_%s:\n", size == 8 ? 3 : 2, sym_name(cx, c->sym));
+        for (k = 0; k < count; k++) {
+            unsigned long long v = (unsigned long long)(c->is_array ? c->elems[k] : c->value);
+            if (size == 8) emit(cx, "    .long %u, %u\n", (unsigned)(v >> 32), (unsigned)v);
+            else emit(cx, "    %s %u\n", size == 1 ? ".byte" : size == 2 ? ".short" : ".long",
+                      (unsigned)(v & (size == 4 ? 0xFFFFFFFFu : size == 2 ? 0xFFFFu : 0xFFu)));
+        }
+    }
+}
+
+/* The float literal pool float_li() loads from, doubles then singles;
+ * the text section resumes after it */
+static void emit_float_consts(CompilerContext* cx) {
+    int k, single;
+    if (!cx->float_const_count) return;
+    for (single = 0; single <= 1; single++) {
+        int any = 0;
+        for (k = 0; k < cx->float_const_count; k++) {
+            unsigned long long v = cx->float_consts[k].bits;
+            if (cx->float_consts[k].single != single) continue;
+            if (!any++) emit(cx, "\n%s\n.align %d\n", single ? ".literal4" : ".literal8", single ? 2 : 3);
+            emit(cx, "Lfconst_%d:\n", k);
+            if (single) emit(cx, "    .long 0x%08x\n", (unsigned)v);
+            else emit(cx, "    .long 0x%08x, 0x%08x\n", (unsigned)(v >> 32), (unsigned)v);
+        }
+    }
+    emit(cx, ".text\n");
+}
+
+/* Compile a simple expression into the given register.
+ * Handles: integer literals, variable references, binary ops (+,-,*,/,%,&,|,^,<<,>>)
+ * Stops at: ; , ) } { and comparison operators (==, !=, <, >, <=, >=)
+ * Returns the RustType of the expression result.
+ */
+/* *name at pos into reg. Loop bindings over arrays hold the element
+ * itself, so only reference-typed locals are loaded through. */
+static RustType emit_deref_load(CompilerContext* cx, int reg) {
+    char name[64] = {0};
+    cx->pos++;
+    parse_string(cx, name, sizeof(name));
+    Variable* v = var_lookup(cx, name);
+    if (!v) {
+        emit(cx, "    li r%d, 0         ; *%s (unresolved)\n", reg, name);
+        return TYPE_I32;
+    }
+    emit_var_load(cx, reg, v, "");
+    if (v->type == TYPE_REF || v->type == TYPE_MUT_REF || v->type == TYPE_BOX) {
+        emit(cx, "    lwz r%d, 0(r%d)   ; *%s\n", reg, reg, name);
+        return TYPE_I32;
+    }
+    return v->type;
+}
+
+RustType compile_expr_to_reg(CompilerContext* cx, int dest_reg) {
+    skip_whitespace(cx);
+    RustType result_type = TYPE_I32;
+    int loaded = 0;
+    long long cval;
+    RustType ctype;
+
+    /* Load first operand; a constant leading chain folds to one immediate */
+    if (const_expr_at(cx, CPREC_BITOR, 1, 0, &cval, &ctype)) {
+        emit_li(cx, dest_reg, (int)cval);
+        if (ctype == TYPE_BOOL) result_type = TYPE_BOOL;
+        loaded = 1;
+    } else if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+        int value = parse_number(cx);
+        emit_li(cx, dest_reg, value);
+        loaded = 1;
+    } else if (strncmp(cx->pos, "true", 4) == 0 && !isalnum(*(cx->pos+4))) {
+        cx->pos += 4;
+        emit(cx, "    li r%d, 1\n", dest_reg);
+        result_type = TYPE_BOOL;
+        loaded = 1;
+    } else if (strncmp(cx->pos, "false", 5) == 0 && !isalnum(*(cx->pos+5))) {
+        cx->pos += 5;
+        emit(cx, "    li r%d, 0\n", dest_reg);
+        result_type = TYPE_BOOL;
+        loaded = 1;
+    } else if (*cx->pos == '*' && (isalpha(cx->pos[1]) || cx->pos[1] == '_')) {
+        result_type = emit_deref_load(cx, dest_reg);
+        loaded = 1;
+    } else if (isalpha(*cx->pos) || *cx->pos == '_') {
+        char name[64] = {0};
+        char* save = cx->pos;
+        parse_string(cx, name, sizeof(name));
+        /* Look up variable */
+        int found = 0;
+        Variable* v = var_lookup(cx, name);
+        if (v && (v->type == TYPE_SLICE || v->type == TYPE_ARRAY) && !v->reg
+                && strncmp(cx->pos, ".len()", 6) == 0) {
+            /* a slice keeps its length beside the pointer; an array's is fixed */
+            cx->pos += 6;
+            if (v->type == TYPE_SLICE) emit(cx, "    lwz r%d, %d(r1)   ; %s.len()\n", dest_reg, v->offset + 4, name);
+            else emit_li(cx, dest_reg, v->size / 4);
+            result_type = TYPE_U32;
+            found = 1;
+        } else if (v) {
+            emit_var_load(cx, dest_reg, v, "");
+            result_type = v->type;
+            found = 1;
+            /* Check for .field access */
+            if (*cx->pos == '.') {
+                char field_name[64] = {0};
+                cx->pos++; /* skip '.' */
+                int fi = 0;
+                while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_') && fi < 63) {
+                    field_name[fi++] = *cx->pos++;
+                }
+                field_name[fi] = '\0';
+                /* Skip method calls: .method() — let caller handle */
+                if (*cx->pos == '(') {
+                    /* rewind */
+                    cx->pos -= fi + 1;
+                } else {
+                    /* Resolve struct field */
+                    int struct_idx = -1;
+                    /* If this is 'self', use current_impl_struct */
+                    if (strcmp(name, "self") == 0 && cx->current_impl_struct >= 0) {
+                        struct_idx = cx->current_impl_struct;
+                    } else {
+                        /* Look up variable's struct type */
+                        if (v->type == TYPE_STRUCT && cx->struct_count > 0) {
+                            struct_idx = 0; /* TODO: track actual struct type per var */
+                        }
+                    }
+                    if (struct_idx >= 0) {
+                        Struct* s = &cx->structs[struct_idx];
+                        int fk;
+                        for (fk = 0; fk < s->field_count; fk++) {
+                            if (strcmp(s->fields[fk].name, field_name) == 0) {
+                                if (strcmp(name, "self") == 0) {
+                                    /* self is a pointer — dereference then offset */
+                                    emit(cx, "    lwz r%d, %d(r%d)  ; self.%s\n",
+                                           dest_reg, s->fields[fk].offset, dest_reg, field_name);
+                                } else {
+                                    /* struct is inline on stack */
+                                    emit(cx, "    lwz r%d, %d(r1)   ; %s.%s\n",
+                                           dest_reg, v->offset + s->fields[fk].offset, name, field_name);
                                 }
-                            } else {
-                                /* Unknown token in function args — skip to avoid infinite loop */
-                                pos++;
+                                result_type = s->fields[fk].type;
+                                break;
                             }
-                            skip_whitespace();
-                            if (*pos == ',') pos++;
                         }
-                        if (*pos == ')') pos++;
-                        printf("    bl _%s\n", sanitize_label(ref_name));
-                        printf("    stw r3, %d(r1)   ; %s = result\n", stack_offset, var_name);
+                        if (fk == s->field_count) {
+                            emit(cx, "    ; unresolved field %s.%s\n", name, field_name);
+                        }
                     } else {
-                        /* Variable reference, possibly with binary op: let x = a + b */
-                        /* Rewind pos to before ref_name so compile_expr_to_reg can parse it */
-                        pos = ref_start;
-                        var_type = compile_expr_to_reg(14);
-                        printf("    stw r14, %d(r1)   ; %s\n", stack_offset, var_name);
-                    }
-                    if (!alpha_size_set) {
-                        vars[var_count].type = var_type;
-                        vars[var_count].size = 4;
+                        emit(cx, "    ; unresolved struct for %s.%s\n", name, field_name);
                     }
-
-                } else {
-                    int value = parse_number();
-                    emit_li(14, value);
-                    printf("    stw r14, %d(r1)   ; %s\n", stack_offset, var_name);
-                    vars[var_count].type = var_type;
-                    vars[var_count].size = 4;
                 }
+            }
+        }
+        if (!found) {
+            /* Could be a function call: name(...) */
+            skip_whitespace(cx);
+            if (*cx->pos == '(') {
+                cx->pos = save;
+                return result_type;
+            }
+            ConstItem* st = static_mut_lookup(cx, name);
+            if (st) emit_static_load(cx, dest_reg, st);
+            /* Unknown variable — emit 0 */
+            else emit(cx, "    li r%d, 0         ; %s (unresolved)\n", dest_reg, name);
+        }
+        loaded = 1;
+    }
+
+    if (!loaded) return result_type;
+
+    /* Check for binary operator */
+    skip_whitespace(cx);
+    while (*cx->pos == '+' || *cx->pos == '-' || *cx->pos == '*' || *cx->pos == '/' || *cx->pos == '%' ||
+           (*cx->pos == '&' && *(cx->pos+1) != '&') || (*cx->pos == '|' && *(cx->pos+1) != '|') ||
+           *cx->pos == '^' || (*cx->pos == '<' && *(cx->pos+1) == '<') || (*cx->pos == '>' && *(cx->pos+1) == '>')) {
+        char op = *cx->pos;
+        char op2 = *(cx->pos+1);
+        int is_shift = (op == '<' && op2 == '<') || (op == '>' && op2 == '>');
+        int prec = is_shift ? CPREC_SHIFT : (op == '+' || op == '-') ? CPREC_ADD :
+                   op == '&' ? CPREC_BITAND : op == '|' ? CPREC_BITOR : op == '^' ? CPREC_XOR : CPREC_MUL;
+        if (is_shift) cx->pos += 2; else cx->pos++;
+        skip_whitespace(cx);
+
+        /* Load second operand into temp register; constant operands of
+         * tighter-binding operators fold first (x + 4 * 1024) */
+        int tmp_reg = (dest_reg == 14) ? 15 : 14;
+        if (const_expr_at(cx, prec + 1, 1, 0, &cval, NULL)) {
+            /* constant multipliers and divisors become shifts and
+             * multiply-high sequences */
+            if ((op == '*' || op == '/' || op == '%') &&
+                emit_const_arith(cx, op, dest_reg, tmp_reg, (int)cval, const_unsigned(result_type))) {
+                skip_whitespace(cx);
+                continue;
+            }
+            emit_li(cx, tmp_reg, (int)cval);
+        } else if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+            int value = parse_number(cx);
+            emit_li(cx, tmp_reg, value);
+        } else if (*cx->pos == '*' && (isalpha(cx->pos[1]) || cx->pos[1] == '_')) {
+            emit_deref_load(cx, tmp_reg);
+        } else if (isalpha(*cx->pos) || *cx->pos == '_') {
+            char rname[64] = {0};
+            parse_string(cx, rname, sizeof(rname));
+            Variable* rv = var_lookup(cx, rname);
+            ConstItem* st = rv ? NULL : static_mut_lookup(cx, rname);
+            if (rv) {
+                emit_var_load(cx, tmp_reg, rv, "");
+            } else if (st) {
+                emit_static_load(cx, tmp_reg, st);
+            } else {
+                emit(cx, "    li r%d, 0         ; %s (unresolved)\n", tmp_reg, rname);
+            }
+        }
+
+        /* Emit the arithmetic instruction */
+        if (op == '+') {
+            emit(cx, "    add r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        } else if (op == '-') {
+            emit(cx, "    sub r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        } else if (op == '*') {
+            emit(cx, "    mullw r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        } else if (op == '/') {
+            emit(cx, "    divw r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        } else if (op == '%') {
+            emit(cx, "    divw r16, r%d, r%d\n", dest_reg, tmp_reg);
+            emit(cx, "    mullw r16, r16, r%d\n", tmp_reg);
+            emit(cx, "    sub r%d, r%d, r16\n", dest_reg, dest_reg);
+        } else if (op == '&') {
+            emit(cx, "    and r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        } else if (op == '|') {
+            emit(cx, "    or r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        } else if (op == '^') {
+            emit(cx, "    xor r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        } else if (op == '<' && is_shift) {
+            emit(cx, "    slw r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        } else if (op == '>' && is_shift) {
+            emit(cx, "    sraw r%d, r%d, r%d\n", dest_reg, dest_reg, tmp_reg);
+        }
+        skip_whitespace(cx);
+    }
+
+    return result_type;
+}
+
+/* A slice argument from av into reg and reg + 1: a slice local as it
+ * is, or &arr for a parameter the callee declares as a slice. Returns
+ * the registers used, 0 if av is passed the plain way. */
+static int emit_slice_arg(CompilerContext* cx, int reg, const Variable* av, const char* name,
+                          int by_ref, int slice_param) {
+    if (reg >= 10 || av->reg) return 0;
+    if (av->type == TYPE_SLICE) {
+        emit(cx, "    lwz r%d, %d(r1)   ; arg %s (ptr)\n", reg, av->offset, name);
+        emit(cx, "    lwz r%d, %d(r1)   ; arg %s (len)\n", reg + 1, av->offset + 4, name);
+        return 2;
+    }
+    if (av->type == TYPE_ARRAY && by_ref && slice_param) {
+        emit(cx, "    la r%d, %d(r1)   ; &%s, %d bytes\n", reg, av->offset, name, av->size);
+        emit_li(cx, reg + 1, av->size / 4);
+        return 2;
+    }
+    return 0;
+}
+
+/* 64-bit integers. An i64/u64 lives in a register pair, high word first
+ * as in memory: a local's slot holds the high word at off and the low
+ * word at off + 4, and arguments and results take two GPRs (r3:r4, ...).
+ * Adds and subtracts carry through XER[CA] (addc/adde, subfc/subfe),
+ * multiplies sum mullw/mulhwu partial products and shifts by a register
+ * amount lean on slw/srw giving 0 for amounts of 32-63, so none of them
+ * branch; only / and % call libgcc (__divdi3 and friends). A 32-bit
+ * operand is sign- or zero-extended as its type says and a narrowing
+ * `as` truncates and extends again, so a pair always holds the exact
+ * value and a 32-bit result is its low word.
+ *
+ * An expression compiled at base b ends up in rb:rb+1. A right operand
+ * goes to rb+2:rb+3 with rb+4 as scratch, and one that is itself an
+ * expression (a tighter-binding operator, parentheses, a call argument)
+ * is compiled at that next base up. */
+#define WIDE_BASE_MAX 27            /* rb+4 is r31 */
+
+/* Integer return type of fn, -1 for none or another type */
+static int fn_return_int(CompilerContext* cx, const Function* fn) {
+    int sym = fn->return_type ? sym_find(cx, fn->return_type, strlen(fn->return_type)) : -1;
+    return sym >= 0 ? const_type_of(cx, sym) : -1;
+}
+
+/* TYPE_F32/TYPE_F64 when fn returns one, else -1 */
+static int fn_return_float(CompilerContext* cx, const Function* fn) {
+    int sym = fn->return_type ? sym_find(cx, fn->return_type, strlen(fn->return_type)) : -1;
+    return sym >= 0 ? float_type_of(cx, sym) : -1;
+}
+
+/* Whether token t makes an expression 64-bit: an i64/u64 local or type
+ * name, or a literal with that suffix */
+static int tok_wide(CompilerContext* cx, const Token* t) {
+    const char* p = tok_ptr(cx, t);
+    if (t->kind == TOK_INT) {
+        return t->len > 3 && (strncmp(p + t->len - 3, "i64", 3) == 0 || strncmp(p + t->len - 3, "u64", 3) == 0);
+    }
+    if (t->kind != TOK_IDENT || tok_kw(t) >= 0) return 0;
+    if (cx->sym_entries[t->sym].var >= 0) return type_wide(cx->vars[cx->sym_entries[t->sym].var].type);
+    return type_wide((RustType)const_type_of(cx, t->sym));
+}
+
+/* Whether t is a float literal (1.5, 2e3, 1f64, 0.5_f32): its digits
+ * go to buf without underscores or suffix, and *type gets the suffix's
+ * type, FLOAT_WEAK for none (-1 when t is not one) */
+#define FLOAT_WEAK (-2)
+static int tok_float_text(CompilerContext* cx, const Token* t, char* buf, int size, int* type) {
+    const char* p = tok_ptr(cx, t);
+    int k, n = 0;
+    *type = -1;
+    if (t->kind != TOK_FLOAT && t->kind != TOK_INT) return 0;
+    if (t->len > 1 && p[0] == '0' && (p[1] == 'x' || p[1] == 'o' || p[1] == 'b')) return 0;
+    *type = FLOAT_WEAK;
+    for (k = 0; k < t->len && n < size - 1; k++) {
+        if (p[k] == 'f' && k + 3 == t->len) {
+            *type = p[k + 1] == '3' ? TYPE_F32 : TYPE_F64;
+            break;
+        }
+        if (p[k] != '_') buf[n++] = p[k];
+    }
+    buf[n] = '\0';
+    if (strspn(buf, "0123456789.eE+-") == (size_t)n
+            && (t->kind == TOK_FLOAT || *type != FLOAT_WEAK || strpbrk(buf, "eE") != NULL)) return 1;
+    *type = -1;
+    return 0;
+}
+
+/* Whether token t makes an expression floating-point: an f32/f64 local
+ * or type name, or a float literal */
+static int tok_float(CompilerContext* cx, const Token* t) {
+    char buf[64];
+    int type;
+    if (t->kind == TOK_FLOAT || t->kind == TOK_INT) return tok_float_text(cx, t, buf, sizeof(buf), &type);
+    if (t->kind != TOK_IDENT || tok_kw(t) >= 0) return 0;
+    if (cx->sym_entries[t->sym].var >= 0) return type_float(cx->vars[cx->sym_entries[t->sym].var].type);
+    return float_type_of(cx, t->sym) >= 0;
+}
+
+/* Whether the expression at pos can go through compile_expr64() at base
+ * b: 1 if it involves an i64/u64 (a local, a suffixed literal, a cast
+ * to one, a call taking or returning one), 0 if it could but does not,
+ * -1 if it holds anything but literals, locals, free fn calls, casts,
+ * parentheses and arithmetic, or needs more registers than there are.
+ * Stops at the end of the statement or argument, and at a comparison
+ * unless compare is set; the right side of one starts at base b + 2. */
+static int wide_expr_at(CompilerContext* cx, int b, int compare) {
+    int base[16], callbase[16], args[16], pending[16][8], npending[16];
+    int i = tok_index_at(cx, cx->pos), depth = 0, wide = 0, operand = 0, prec = 0;
+
+    /* each paren level is climbed as wide_expr() climbs it: an operand
+     * goes two registers above its level's base per operator waiting */
+    base[0] = b;
+    callbase[0] = -1;
+    npending[0] = 0;
+    for (; i < cx->tok_count; i++) {
+        const Token* t = &cx->tokens[i];
+        int joined = t[1].kind == TOK_PUNCT && t[1].start == t->start + t->len;
+        int kw = tok_kw(t);
+        if (kw == KW_AS) {
+            int to = t[1].kind == TOK_IDENT ? const_type_of(cx, t[1].sym) : -1;
+            if (to < 0 && t[1].kind == TOK_IDENT && float_type_of(cx, t[1].sym) >= 0) to = TYPE_F64;
+            if (!operand || to < 0 || to == TYPE_BOOL) return -1;
+            wide |= type_wide(to) || type_float(to);
+            i++;
+            continue;
+        }
+        if (t->kind == TOK_FLOAT || tok_float(cx, t)) {
+            /* the float operands compile_expr64() hands to float_operand() */
+            if (operand) return -1;
+            wide = 1;
+            operand = 1;
+            continue;
+        }
+        if (t->kind == TOK_INT || t->kind == TOK_CHAR) {
+            if (operand) return -1;
+            wide |= tok_wide(cx, t);
+            operand = 1;
+            continue;
+        }
+        if (t->kind == TOK_IDENT) {
+            const SymEntry* e = &cx->sym_entries[t->sym];
+            int nb = base[depth] + 2 * npending[depth];
+            if (operand || (kw >= 0 && kw != KW_TRUE && kw != KW_FALSE)) return -1;
+            operand = 1;
+            if (kw >= 0) continue;
+            if (tok_is_punct(t + 1, ':')) {
+                /* u64::MAX, f64::EPSILON and the like */
+                int type = const_type_of(cx, t->sym);
+                if (type < 0) type = float_type_of(cx, t->sym);
+                if (type < 0 || !tok_is_punct(t + 2, ':') || t[3].kind != TOK_IDENT) return -1;
+                wide |= type_wide(type) || type_float(type);
+                i += 3;
+            } else if (e->var >= 0) {
+                const Variable* v = &cx->vars[e->var];
+                wide |= type_wide(v->type) || type_float(v->type);
+                if (type_float(v->type) && tok_is_punct(t + 1, '.')) {
+                    /* x.abs(), x.mul_add(a, b): float_operand() takes the calls */
+                    if (t[2].kind != TOK_IDENT || !tok_is_punct(t + 3, '(')) return -1;
+                    i = tok_match_close(cx, i + 3);
+                    while (tok_is_punct(&cx->tokens[i + 1], '.') && cx->tokens[i + 2].kind == TOK_IDENT
+                           && tok_is_punct(&cx->tokens[i + 3], '(')) i = tok_match_close(cx, i + 3);
+                } else if (tok_is_punct(t + 1, '.')) {
+                    /* nothing but .len() of a slice or array */
+                    if ((v->type != TYPE_SLICE && v->type != TYPE_ARRAY) || v->reg || t[2].kind != TOK_IDENT ||
+                        strcmp(sym_name(cx, t[2].sym), "len") != 0 || !tok_is_punct(t + 3, '(') ||
+                        !tok_is_punct(t + 4, ')')) return -1;
+                    i += 4;
+                }
+            } else if (tok_is_punct(t + 1, '(')) {
+                const Function* fn = e->free_fn >= 0 ? &cx->functions[e->free_fn] : NULL;
+                int types[16], floats[16], k;
+                if (!fn || fn->param_count > 16 || depth + 1 >= 16 || nb + 2 > WIDE_BASE_MAX) return -1;
+                ce_param_types(cx, fn, types);
+                fn_param_floats(cx, fn, floats);
+                for (k = 0; k < fn->param_count; k++) wide |= type_wide((RustType)types[k]) || floats[k] >= 0;
+                wide |= type_wide((RustType)fn_return_int(cx, fn)) || fn_return_float(cx, fn) >= 0;
+                depth++;
+                callbase[depth] = nb;
+                base[depth] = nb + 2;
+                args[depth] = 0;
+                npending[depth] = 0;
+                operand = 0;
+                i++;
+            } else if (e->const_idx >= 0) {
+                ConstItem* c = &cx->consts[e->const_idx];
+                if (!const_item_eval(cx, e->const_idx) || c->is_array) return -1;
+                wide |= type_wide(c->type);
+            } else {
+                return -1;
+            }
+            continue;
+        }
+        if (t->kind != TOK_PUNCT) return -1;
+        switch (t->ch) {
+        case '(':
+            if (operand || depth + 1 >= 16) return -1;
+            depth++;
+            base[depth] = base[depth - 1] + 2 * npending[depth - 1];
+            callbase[depth] = -1;
+            npending[depth] = 0;
+            if (base[depth] > WIDE_BASE_MAX) return -1;
+            continue;
+        case ')':
+            if (depth == 0) return wide;
+            if (!operand && !(callbase[depth] >= 0 && tok_is_punct(t - 1, '('))) return -1;
+            depth--;
+            operand = 1;
+            continue;
+        case ',':
+            if (depth == 0) return wide;
+            if (callbase[depth] < 0 || !operand) return -1;
+            base[depth] = callbase[depth] + 2 + 2 * ++args[depth];
+            if (base[depth] > WIDE_BASE_MAX) return -1;
+            npending[depth] = 0;
+            operand = 0;
+            continue;
+        case ';': case '{': case '}':
+            return depth ? -1 : wide;
+        case '&':
+            if (joined && t[1].ch == '&') return depth ? -1 : wide;
+            if (!operand) {
+                /* &x and &mut x as call arguments */
+                if (callbase[depth] < 0 || !(tok_is_punct(t - 1, '(') || tok_is_punct(t - 1, ',')) ||
+                    t[1].kind != TOK_IDENT) return -1;
+                if (tok_kw(t + 1) == KW_MUT) i++;
+                if (cx->sym_entries[cx->tokens[i + 1].sym].var < 0) return -1;
+                continue;
+            }
+            prec = CPREC_BITAND;
+            break;
+        case '|':
+            if (joined && t[1].ch == '|') return depth ? -1 : wide;
+            prec = CPREC_BITOR;
+            break;
+        case '<': case '>':
+            if (joined && t[1].ch == t->ch) {
+                i++;
+                prec = CPREC_SHIFT;
+                break;
+            }
+            goto comparison;
+        case '=':
+            if (!joined || t[1].ch != '=') return depth ? -1 : wide;
+            goto comparison;
+        case '!':
+            if (!joined || t[1].ch != '=') return -1;
+            goto comparison;
+        case '*':
+            if (!operand) continue;     /* *r */
+            prec = CPREC_MUL;
+            break;
+        case '/': case '%':
+            prec = CPREC_MUL;
+            break;
+        case '-':
+            if (!operand && (t[1].kind == TOK_INT || t[1].kind == TOK_FLOAT)) continue;
+            if (!operand && tok_float(cx, t + 1)) continue;     /* -x of an f32/f64 */
+            prec = CPREC_ADD;
+            break;
+        case '+':
+            prec = CPREC_ADD;
+            break;
+        case '^':
+            prec = CPREC_XOR;
+            break;
+        default:
+            return -1;
+        }
+        /* a binary operator */
+        if (!operand) return -1;
+        while (npending[depth] && pending[depth][npending[depth] - 1] >= prec) npending[depth]--;
+        if (npending[depth] == 8) return -1;
+        pending[depth][npending[depth]++] = prec;
+        if (base[depth] + 2 * npending[depth] > WIDE_BASE_MAX) return -1;
+        operand = 0;
+        continue;
+      comparison:
+        if (depth) return -1;
+        if (!compare || !operand) return wide;
+        if (joined && t[1].ch == '=') i++;
+        base[0] = b + 2;
+        npending[0] = 0;
+        operand = 0;
+        compare = 0;
+    }
+    return wide;
+}
+
+static RustType wide_expr(CompilerContext* cx, int b, int* weak);
+
+/* Extend the 32-bit value in lo into hi:lo as type t says */
+static void wide_extend(CompilerContext* cx, int hi, int lo, RustType t) {
+    if (const_unsigned(t)) emit(cx, "    li r%d, 0\n", hi);
+    else emit(cx, "    srawi r%d, r%d, 31\n", hi, lo);
+}
+
+static void wide_li(CompilerContext* cx, int b, long long v) {
+    emit_li(cx, b, (int)(v >> 32));
+    emit_li(cx, b + 1, (int)v);
+}
+
+/* `as T` casts on the pair at rb. A 32-bit value was extended by its own
+ * type when loaded, so widening costs nothing; a narrower T truncates
+ * and extends again as T. */
+static RustType wide_cast(CompilerContext* cx, int b, RustType type) {
+    int hi = b, lo = b + 1;
+    char tname[16];
+    skip_whitespace(cx);
+    while (strncmp(cx->pos, "as", 2) == 0 && !isalnum(cx->pos[2]) && cx->pos[2] != '_') {
+        cx->pos += 2;
+        skip_whitespace(cx);
+        parse_string(cx, tname, sizeof(tname));
+        int sym = sym_find(cx, tname, strlen(tname));
+        int to = sym >= 0 ? const_type_of(cx, sym) : -1;
+        if (to >= 0 && to != TYPE_BOOL && !type_wide(to)) {
+            int bits = const_bits(to);
+            if (bits == 8 && const_unsigned(to)) emit(cx, "    clrlwi r%d, r%d, 24\n", lo, lo);
+            else if (bits == 8) emit(cx, "    extsb r%d, r%d\n", lo, lo);
+            else if (bits == 16 && const_unsigned(to)) emit(cx, "    clrlwi r%d, r%d, 16\n", lo, lo);
+            else if (bits == 16) emit(cx, "    extsh r%d, r%d\n", lo, lo);
+            wide_extend(cx, hi, lo, to);
+        }
+        if (to >= 0) type = to;
+        skip_whitespace(cx);
+    }
+    return type;
+}
+
+/* rb:rb+1 shifted by a constant k in 1..63: '<' left, '>' right,
+ * arithmetic when arith is set. rb+4 is scratch. */
+static void wide_shift_const(CompilerContext* cx, int b, char dir, int k, int arith) {
+    int hi = b, lo = b + 1, s = b + 4;
+    if (k == 0) return;
+    if (dir == '<' && k < 32) {
+        emit(cx, "    srwi r%d, r%d, %d\n", s, lo, 32 - k);
+        emit(cx, "    slwi r%d, r%d, %d\n", hi, hi, k);
+        emit(cx, "    or r%d, r%d, r%d\n", hi, hi, s);
+        emit(cx, "    slwi r%d, r%d, %d\n", lo, lo, k);
+    } else if (dir == '<') {
+        if (k == 32) emit(cx, "    mr r%d, r%d\n", hi, lo);
+        else emit(cx, "    slwi r%d, r%d, %d\n", hi, lo, k - 32);
+        emit(cx, "    li r%d, 0\n", lo);
+    } else if (k < 32) {
+        emit(cx, "    srwi r%d, r%d, %d\n", lo, lo, k);
+        emit(cx, "    slwi r%d, r%d, %d\n", s, hi, 32 - k);
+        emit(cx, "    or r%d, r%d, r%d\n", lo, lo, s);
+        emit(cx, "    %s r%d, r%d, %d\n", arith ? "srawi" : "srwi", hi, hi, k);
+    } else {
+        if (k == 32) emit(cx, "    mr r%d, r%d\n", lo, hi);
+        else emit(cx, "    %s r%d, r%d, %d\n", arith ? "srawi" : "srwi", lo, hi, k - 32);
+        if (arith) emit(cx, "    srawi r%d, r%d, 31\n", hi, hi);
+        else emit(cx, "    li r%d, 0\n", hi);
+    }
+}
+
+/* One half of a bitwise op with a constant; scratch takes a constant
+ * that fits no immediate */
+static void wide_logic_const(CompilerContext* cx, char op, int reg, unsigned v, int scratch) {
+    if (op == '&') {
+        if (v == 0) emit(cx, "    li r%d, 0\n", reg);
+        else if (v == 0xFFFFFFFFu) return;
+        else if (v <= 0xFFFF) emit(cx, "    andi. r%d, r%d, 0x%X\n", reg, reg, v);
+        else if (!(v & 0xFFFF)) emit(cx, "    andis. r%d, r%d, 0x%X\n", reg, reg, v >> 16);
+        else {
+            emit_li(cx, scratch, (int)v);
+            emit(cx, "    and r%d, r%d, r%d\n", reg, reg, scratch);
+        }
+        return;
+    }
+    const char* name = op == '|' ? "or" : "xor";
+    if (v == 0) return;
+    if (v == 0xFFFFFFFFu && op == '|') emit(cx, "    li r%d, -1\n", reg);
+    else if (v == 0xFFFFFFFFu) emit(cx, "    not r%d, r%d\n", reg, reg);
+    else {
+        if (v >> 16) emit(cx, "    %sis r%d, r%d, 0x%X\n", name, reg, reg, v >> 16);
+        if (v & 0xFFFF) emit(cx, "    %si r%d, r%d, 0x%X\n", name, reg, reg, v & 0xFFFF);
+    }
+}
+
+/* rb:rb+1 op= the constant c without loading it as a pair, where that
+ * is shorter; 0 if it is not */
+static int wide_op_const(CompilerContext* cx, int b, char op, long long c, int is_unsigned) {
+    int hi = b, lo = b + 1, k;
+    unsigned long long u = (unsigned long long)c;
+    long long v;
+
+    switch (op) {
+    case '+': case '-':
+        v = op == '-' ? (long long)(0 - u) : c;
+        if (v == 0) return 1;
+        if (v < -32768 || v > 32767) return 0;
+        emit(cx, "    addic r%d, r%d, %d\n", lo, lo, (int)v);
+        emit(cx, "    %s r%d, r%d\n", v < 0 ? "addme" : "addze", hi, hi);
+        return 1;
+    case '*':
+        if (u == 0) {
+            wide_li(cx, b, 0);
+            return 1;
+        }
+        if (!(u & (u - 1))) {
+            for (k = 0; u >> k != 1; k++) ;
+            wide_shift_const(cx, b, '<', k, 0);
+            return 1;
+        }
+        if (u >> 32) return 0;
+        /* hi*c + the carry out of lo*c */
+        emit_li(cx, b + 3, (int)u);
+        emit(cx, "    mullw r%d, r%d, r%d\n", b + 4, hi, b + 3);
+        emit(cx, "    mulhwu r%d, r%d, r%d\n", b + 2, lo, b + 3);
+        emit(cx, "    add r%d, r%d, r%d\n", hi, b + 4, b + 2);
+        emit(cx, "    mullw r%d, r%d, r%d\n", lo, lo, b + 3);
+        return 1;
+    case '/': case '%':
+        if (!is_unsigned || u == 0 || (u & (u - 1))) return 0;
+        for (k = 0; u >> k != 1; k++) ;
+        if (op == '/') {
+            wide_shift_const(cx, b, '>', k, 0);
+        } else if (k == 0) {
+            wide_li(cx, b, 0);
+        } else if (k < 32) {
+            emit(cx, "    clrlwi r%d, r%d, %d\n", lo, lo, 32 - k);
+            emit(cx, "    li r%d, 0\n", hi);
+        } else if (k == 32) {
+            emit(cx, "    li r%d, 0\n", hi);
+        } else {
+            emit(cx, "    clrlwi r%d, r%d, %d\n", hi, hi, 64 - k);
+        }
+        return 1;
+    case '<': case '>':
+        wide_shift_const(cx, b, op, (int)(u & 63), op == '>' && !is_unsigned);
+        return 1;
+    case '&': case '|': case '^':
+        wide_logic_const(cx, op, hi, (unsigned)(u >> 32), b + 4);
+        wide_logic_const(cx, op, lo, (unsigned)u, b + 4);
+        return 1;
+    }
+    return 0;
+}
+
+/* rb:rb+1 op= rb+2:rb+3, with '<' and '>' for the shifts */
+static void wide_op(CompilerContext* cx, int b, char op, int is_unsigned) {
+    int hi = b, lo = b + 1, rhi = b + 2, rlo = b + 3, s = b + 4;
+    const char* helper = NULL;
+
+    switch (op) {
+    case '+':
+        emit(cx, "    addc r%d, r%d, r%d\n", lo, lo, rlo);
+        emit(cx, "    adde r%d, r%d, r%d\n", hi, hi, rhi);
+        break;
+    case '-':
+        emit(cx, "    subfc r%d, r%d, r%d\n", lo, rlo, lo);
+        emit(cx, "    subfe r%d, r%d, r%d\n", hi, rhi, hi);
+        break;
+    case '*':
+        /* the low 64 bits: hi*rlo + lo*rhi + the high word of lo*rlo */
+        emit(cx, "    mullw r%d, r%d, r%d\n", s, hi, rlo);
+        emit(cx, "    mullw r%d, r%d, r%d\n", rhi, lo, rhi);
+        emit(cx, "    add r%d, r%d, r%d\n", s, s, rhi);
+        emit(cx, "    mulhwu r%d, r%d, r%d\n", rhi, lo, rlo);
+        emit(cx, "    add r%d, r%d, r%d\n", hi, s, rhi);
+        emit(cx, "    mullw r%d, r%d, r%d\n", lo, lo, rlo);
+        break;
+    case '&': case '|': case '^':
+        emit(cx, "    %s r%d, r%d, r%d\n", op == '&' ? "and" : op == '|' ? "or" : "xor", hi, hi, rhi);
+        emit(cx, "    %s r%d, r%d, r%d\n", op == '&' ? "and" : op == '|' ? "or" : "xor", lo, lo, rlo);
+        break;
+    case '<':
+        /* n = rlo; the words crossing over come from n - 32 or 32 - n,
+         * whichever is in range, the other shift giving 0 */
+        emit(cx, "    andi. r%d, r%d, 63\n", rlo, rlo);
+        emit(cx, "    subfic r%d, r%d, 32\n", rhi, rlo);
+        emit(cx, "    slw r%d, r%d, r%d\n", hi, hi, rlo);
+        emit(cx, "    srw r%d, r%d, r%d\n", s, lo, rhi);
+        emit(cx, "    or r%d, r%d, r%d\n", hi, hi, s);
+        emit(cx, "    addi r%d, r%d, -32\n", rhi, rlo);
+        emit(cx, "    slw r%d, r%d, r%d\n", s, lo, rhi);
+        emit(cx, "    or r%d, r%d, r%d\n", hi, hi, s);
+        emit(cx, "    slw r%d, r%d, r%d\n", lo, lo, rlo);
+        break;
+    case '>':
+        emit(cx, "    andi. r%d, r%d, 63\n", rlo, rlo);
+        emit(cx, "    subfic r%d, r%d, 32\n", rhi, rlo);
+        emit(cx, "    srw r%d, r%d, r%d\n", lo, lo, rlo);
+        emit(cx, "    slw r%d, r%d, r%d\n", s, hi, rhi);
+        emit(cx, "    or r%d, r%d, r%d\n", lo, lo, s);
+        emit(cx, "    addi r%d, r%d, -32\n", rhi, rlo);
+        if (is_unsigned) {
+            emit(cx, "    srw r%d, r%d, r%d\n", s, hi, rhi);
+            emit(cx, "    or r%d, r%d, r%d\n", lo, lo, s);
+            emit(cx, "    srw r%d, r%d, r%d\n", hi, hi, rlo);
+        } else {
+            /* sraw by n - 32 < 0 must not reach lo: mask it off */
+            emit(cx, "    sraw r%d, r%d, r%d\n", s, hi, rhi);
+            emit(cx, "    srawi r%d, r%d, 31\n", rhi, rhi);
+            emit(cx, "    andc r%d, r%d, r%d\n", s, s, rhi);
+            emit(cx, "    or r%d, r%d, r%d\n", lo, lo, s);
+            emit(cx, "    sraw r%d, r%d, r%d\n", hi, hi, rlo);
+        }
+        break;
+    case '/':
+        helper = is_unsigned ? "__udivdi3" : "__divdi3";
+        break;
+    case '%':
+        helper = is_unsigned ? "__umoddi3" : "__moddi3";
+        break;
+    }
+    if (helper) {
+        emit(cx, "    mr r3, r%d\n", hi);
+        emit(cx, "    mr r4, r%d\n", lo);
+        emit(cx, "    mr r5, r%d\n", rhi);
+        emit(cx, "    mr r6, r%d\n", rlo);
+        emit(cx, "    bl _%s\n", helper);
+        emit(cx, "    mr r%d, r3\n", hi);
+        emit(cx, "    mr r%d, r4\n", lo);
+    }
+}
+
+static RustType float_expr(CompilerContext* cx, int fb, int gb, RustType type);
+static RustType float_operand(CompilerContext* cx, int fb, int gb, RustType type);
+static int float_scan_operand(CompilerContext* cx, int* i, int* inner);
+static void float_to_int(CompilerContext* cx, int fb, int gb, RustType to);
+
+/* The frame doubleword an expression at GPR base gb may use for its
+ * own conversions: past the r14..gb-1 call saves, with the FPR call
+ * saves after it */
+static int float_scratch(CompilerContext* cx, int gb) {
+    return (cx->stack_offset + 4 * (gb - 14) + 7) & ~7;
+}
+
+/* Below opt-level 2 nothing saves the nonvolatile registers a callee
+ * writes, so the r14..gb-1 of an enclosing expression keep to the frame
+ * over a call */
+static void emit_gpr_saves(CompilerContext* cx, int gb, int restore) {
+    int k;
+    for (k = 14; k < gb && cx->opts.opt_level < 2; k++) {
+        if (restore) emit(cx, "    lwz r%d, %d(r1)\n", k, cx->stack_offset + 4 * (k - 14));
+        else emit(cx, "    stw r%d, %d(r1)   ; r%d over the call\n", k, cx->stack_offset + 4 * (k - 14), k);
+    }
+}
+
+/* The FPRs are all volatile here: f1..live of an enclosing float
+ * expression keep to the frame over a call at every level */
+static void emit_fpr_saves(CompilerContext* cx, int gb, int live, int restore) {
+    int k, at = float_scratch(cx, gb) + 8;
+    for (k = 1; k <= live; k++) {
+        if (restore) emit(cx, "    lfd f%d, %d(r1)\n", k, at + 8 * (k - 1));
+        else emit(cx, "    stfd f%d, %d(r1)   ; f%d over the call\n", k, at + 8 * (k - 1), k);
+    }
+}
+
+/* A call of the free fn fn, pos at its '(', into rb:rb+1. Arguments are
+ * evaluated into pairs from rb+2 up before any of them moves to r3, so
+ * a call among them cannot clobber one already placed; an i64/u64
+ * parameter takes two GPRs and the rest one, or two for a slice. An
+ * f32/f64 one is evaluated into the FPR above the enclosing float
+ * expression's and goes to f1 up, using up its GPR words all the same. */
+static RustType wide_call(CompilerContext* cx, int b, const Function* fn, const char* name) {
+    int types[16], floats[16], elems[16], argtype[16], freg[16], n = 0, nf = 0, k, word = 3, fpr = 1, weak;
+    int live = cx->fpr_live;
+    const Variable* refs[16];
+    char aname[64];
+
+    for (k = 0; k < 16; k++) types[k] = floats[k] = elems[k] = -1;
+    if (fn->param_count <= 16) {
+        ce_param_types(cx, fn, types);
+        fn_param_floats(cx, fn, floats);
+        fn_param_slices(cx, fn, elems);
+    }
+    cx->pos++;
+    skip_whitespace(cx);
+    while (*cx->pos && *cx->pos != ')' && n < 16) {
+        refs[n] = NULL;
+        argtype[n] = TYPE_REF;
+        cx->fpr_live = live + nf;
+        if (floats[n] >= 0) {
+            freg[n] = live + 1 + nf++;
+            argtype[n] = float_expr(cx, freg[n], b + 2 + 2 * n, floats[n]);
+        } else if (*cx->pos == '&') {
+            cx->pos++;
+            skip_whitespace(cx);
+            if (strncmp(cx->pos, "mut ", 4) == 0) cx->pos += 4;
+            skip_whitespace(cx);
+            parse_string(cx, aname, sizeof(aname));
+            refs[n] = var_lookup(cx, aname);
+        } else {
+            argtype[n] = wide_expr(cx, b + 2 + 2 * n, &weak);
+        }
+        n++;
+        skip_whitespace(cx);
+        if (*cx->pos == ',') cx->pos++;
+        skip_whitespace(cx);
+    }
+    if (*cx->pos == ')') cx->pos++;
+    cx->fpr_live = live;
+    emit_fpr_saves(cx, b, live, 0);
+    for (k = 0; k < n; k++) {
+        int r = b + 2 + 2 * k;
+        if (floats[k] >= 0) {
+            if (fpr <= 13 && fpr != freg[k]) emit(cx, "    fmr f%d, f%d\n", fpr, freg[k]);
+            fpr++;
+            word += floats[k] == TYPE_F64 ? 2 : 1;
+        } else if (word > 10) {
+            continue;
+        } else if (argtype[k] == TYPE_REF) {
+            int words = refs[k] ? emit_slice_arg(cx, word, refs[k], refs[k]->name, 1, elems[k] >= 0) : 0;
+            if (!words && refs[k]) emit_var_load(cx, word, refs[k], "");
+            else if (!words) emit(cx, "    li r%d, 0\n", word);
+            word += words ? words : 1;
+        } else if ((type_wide((RustType)types[k]) || (types[k] < 0 && type_wide(argtype[k]))) && word < 10) {
+            emit(cx, "    mr r%d, r%d\n", word++, r);
+            emit(cx, "    mr r%d, r%d\n", word++, r + 1);
+        } else {
+            emit(cx, "    mr r%d, r%d\n", word++, r + 1);
+        }
+    }
+    emit_gpr_saves(cx, b, 0);
+    emit(cx, "    bl _%s\n", sanitize_label(cx, name));
+    emit_gpr_saves(cx, b, 1);
+    int ret = fn_return_int(cx, fn);
+    if (ret < 0) ret = TYPE_I32;
+    if (type_wide(ret)) {
+        emit(cx, "    mr r%d, r3\n", b);
+        emit(cx, "    mr r%d, r4\n", b + 1);
+    } else {
+        emit(cx, "    mr r%d, r3\n", b + 1);
+        wide_extend(cx, b, b + 1, ret);
+    }
+    emit_fpr_saves(cx, b, live, 1);
+    return ret;
+}
+
+/* One operand at pos into rb:rb+1, casts included: its type, or -1 if
+ * there is none. *weak is set for an unsuffixed literal, which takes
+ * the type of whatever it meets. */
+static int wide_operand(CompilerContext* cx, int b, int* weak) {
+    int hi = b, lo = b + 1, sym, i, inner;
+    long long c;
+    RustType ctype, type;
+    char name[64] = {0};
+
+    *weak = 0;
+    skip_whitespace(cx);
+    i = tok_index_at(cx, cx->pos);
+    float_scan_operand(cx, &i, &inner);
+    if (type_float(inner) || inner == FLOAT_WEAK) {
+        /* an f32/f64, of which only an integer cast means anything here */
+        Token* t;
+        int fb = cx->fpr_live + 1;
+        float_operand(cx, fb, b, inner == FLOAT_WEAK ? TYPE_F64 : (RustType)inner);
+        skip_whitespace(cx);
+        t = tok_at(cx, cx->pos);
+        type = tok_kw(t) == KW_AS && t[1].kind == TOK_IDENT ? const_type_of(cx, t[1].sym) : -1;
+        if ((int)type < 0 || type == TYPE_BOOL) {
+            wide_li(cx, b, 0);
+            *weak = 1;
+            return TYPE_I32;
+        }
+        cx->pos = tok_end(cx, t + 1);
+        float_to_int(cx, fb, b, type);
+        return wide_cast(cx, b, type);
+    }
+    if (const_expr_at(cx, CPREC_MUL + 1, 0, 0, &c, &ctype)) {
+        wide_li(cx, b, c);
+        *weak = !type_wide(ctype);
+        type = ctype;
+    } else if (*cx->pos == '(') {
+        cx->pos++;
+        type = wide_expr(cx, b, weak);
+        skip_whitespace(cx);
+        if (*cx->pos == ')') cx->pos++;
+    } else if (*cx->pos == '*' && (isalpha(cx->pos[1]) || cx->pos[1] == '_')) {
+        type = emit_deref_load(cx, lo);
+        if (type_wide(type)) type = const_unsigned(type) ? TYPE_U32 : TYPE_I32;
+        wide_extend(cx, hi, lo, type);
+    } else if (isalpha(*cx->pos) || *cx->pos == '_') {
+        parse_string(cx, name, sizeof(name));
+        Variable* v = var_lookup(cx, name);
+        ConstItem* st;
+        if (v && (v->type == TYPE_SLICE || v->type == TYPE_ARRAY) && !v->reg
+                && strncmp(cx->pos, ".len()", 6) == 0) {
+            cx->pos += 6;
+            if (v->type == TYPE_SLICE) emit(cx, "    lwz r%d, %d(r1)   ; %s.len()\n", lo, v->offset + 4, name);
+            else emit_li(cx, lo, v->size / 4);
+            emit(cx, "    li r%d, 0\n", hi);
+            type = TYPE_U32;
+        } else if (v && type_wide(v->type) && !v->reg) {
+            emit(cx, "    lwz r%d, %d(r1)   ; load %s (high)\n", hi, v->offset, name);
+            emit(cx, "    lwz r%d, %d(r1)   ; load %s (low)\n", lo, v->offset + 4, name);
+            type = v->type;
+        } else if (v) {
+            emit_var_load(cx, lo, v, "");
+            type = v->type;
+            wide_extend(cx, hi, lo, type);
+        } else if (*cx->pos == '(' && (sym = sym_find(cx, name, strlen(name))) >= 0 &&
+                   cx->sym_entries[sym].free_fn >= 0) {
+            type = wide_call(cx, b, &cx->functions[cx->sym_entries[sym].free_fn], name);
+        } else if ((st = static_mut_lookup(cx, name))) {
+            emit_static_load(cx, lo, st);
+            type = st->type;
+            if (type_wide(type)) {
+                emit(cx, "    lis r%d, ha16(_%s)\n", hi, name);
+                emit(cx, "    lwz r%d, lo16(_%s)(r%d)   ; static %s (high)\n", hi, name, hi, name);
+            } else {
+                wide_extend(cx, hi, lo, type);
+            }
+        } else {
+            emit(cx, "    li r%d, 0         ; %s (unresolved)\n", hi, name);
+            emit(cx, "    li r%d, 0\n", lo);
+            type = TYPE_I32;
+            *weak = 1;
+        }
+    } else {
+        return -1;
+    }
+    return wide_cast(cx, b, type);
+}
+
+/* Precedence of the binary operator at pos, CPREC_NONE for none; *op
+ * gets its first character, '<' and '>' standing for the shifts */
+static int wide_binop(CompilerContext* cx, char* op) {
+    const char* p = cx->pos;
+    *op = p[0];
+    switch (p[0]) {
+    case '*': case '/': case '%': return CPREC_MUL;
+    case '+': case '-': return CPREC_ADD;
+    case '<': case '>': return p[1] == p[0] ? CPREC_SHIFT : CPREC_NONE;
+    case '&': return p[1] == '&' ? CPREC_NONE : CPREC_BITAND;
+    case '^': return CPREC_XOR;
+    case '|': return p[1] == '|' ? CPREC_NONE : CPREC_BITOR;
+    }
+    return CPREC_NONE;
+}
+
+/* The operators at pos binding at least min_prec, by precedence
+ * climbing: a right operand that binds tighter still is compiled two
+ * registers up before the operator applies */
+static RustType wide_expr_prec(CompilerContext* cx, int b, int min_prec, int* weak) {
+    long long c;
+    RustType ctype;
+    int type, prec, rweak;
+    char op, next;
+
+    skip_whitespace(cx);
+    /* a constant leading chain folds to one pair of immediates */
+    if (const_expr_at(cx, min_prec > CPREC_BITOR ? min_prec : CPREC_BITOR, 1, 0, &c, &ctype)) {
+        wide_li(cx, b, c);
+        *weak = !type_wide(ctype);
+        type = wide_cast(cx, b, ctype);
+    } else if ((type = wide_operand(cx, b, weak)) < 0) {
+        wide_li(cx, b, 0);
+        *weak = 1;
+        return TYPE_I32;
+    }
+
+    skip_whitespace(cx);
+    while ((prec = wide_binop(cx, &op)) != CPREC_NONE && prec >= min_prec) {
+        int is_shift = prec == CPREC_SHIFT, folded;
+        char* right;
+        cx->pos += is_shift ? 2 : 1;
+        skip_whitespace(cx);
+        right = cx->pos;
+
+        /* a shift keeps its left side's type; otherwise a literal takes
+         * the type of the other side */
+        folded = const_expr_at(cx, prec + 1, 1, 0, &c, &ctype);
+        skip_whitespace(cx);
+        if (folded && wide_binop(cx, &next) <= prec) {
+            if (!is_shift && *weak && type_wide(ctype)) {
+                type = ctype;
+                *weak = 0;
+            }
+            if (wide_op_const(cx, b, op, c, const_unsigned(type))) continue;
+            wide_li(cx, b + 2, c);
+        } else {
+            cx->pos = right;
+            RustType rtype = wide_expr_prec(cx, b + 2, prec + 1, &rweak);
+            if (!is_shift && *weak && !rweak) {
+                type = rtype;
+                *weak = 0;
+            }
+        }
+        wide_op(cx, b, op, const_unsigned(type));
+        skip_whitespace(cx);
+    }
+    return type;
+}
+
+static RustType wide_expr(CompilerContext* cx, int b, int* weak) {
+    return wide_expr_prec(cx, b, CPREC_BITOR, weak);
+}
+
+/* The expression at pos into rb:rb+1, as an i64/u64 whatever its type;
+ * the type it has in the source */
+RustType compile_expr64(CompilerContext* cx, int b) {
+    int weak;
+    return wide_expr(cx, b, &weak);
+}
+
+/* Store r14:r15 to the slot at off of type t: both words for an
+ * i64/u64, the low word for anything narrower */
+static void wide_store(CompilerContext* cx, int off, RustType t, const char* name, const char* note) {
+    if (type_wide(t)) {
+        emit(cx, "    stw r14, %d(r1)   ; %s%s (high)\n", off, name, note);
+        emit(cx, "    stw r15, %d(r1)   ; %s%s (low)\n", off + 4, name, note);
+    } else {
+        emit(cx, "    stw r15, %d(r1)   ; %s%s\n", off, name, note);
+    }
+}
+
+/* Floating point. An f32 or f64 lives in one FPR and computes there: an
+ * expression compiled at base fb ends up in f<fb>, its right operands
+ * from f<fb+1> up, with f0 as scratch, so everything stays in the
+ * volatile f0-f13 and no prologue saves one. A local takes a 4-byte slot
+ * (lfs/stfs) or a doubleword-aligned 8-byte one (lfd/stfd); arguments
+ * and results go in f1 up as the Darwin ABI passes them, each also using
+ * up the GPR words it would take in memory. An f32 expression computes
+ * with the single-precision forms (fadds, fmuls, ...), rounding each
+ * step to f32 as Rust does.
+ *
+ * Constants load from a pool of .literal4/.literal8 words, emitted with
+ * the file's other data. An integer converts through the double 2^52 + x
+ * built in the frame, and back through fctiwz, saturating as Rust's `as`
+ * does with NaN going to 0; an i64/u64 result calls libgcc as the 64-bit
+ * divides do. GPR work (pool addresses, conversions, integer operands)
+ * uses rgb up, as compile_expr64() at gb would.
+ *
+ * x.mul_add(a, b) is always one fmadd. a * b + c, a * b - c and
+ * c - a * b are fmadd, fmsub and fnmsub only under -C fp-contract=fast,
+ * since the fused result rounds once where rustc's rounds twice. */
+#define FLOAT_BASE_MAX 12           /* f<fb+1> is f13 */
+
+static int float_scan(CompilerContext* cx, int* i, int compare);
+
+/* f32/f64 methods: libm names the call for those not done inline */
+static const struct { const char* name; const char* libm; int args; } float_methods[] = {
+    { "abs", NULL, 0 },      { "sqrt", "sqrt", 0 },   { "mul_add", NULL, 2 },  { "floor", "floor", 0 },
+    { "ceil", "ceil", 0 },   { "round", "round", 0 }, { "trunc", "trunc", 0 }, { "sin", "sin", 0 },
+    { "cos", "cos", 0 },     { "tan", "tan", 0 },     { "exp", "exp", 0 },     { "ln", "log", 0 },
+    { "log10", "log10", 0 }, { "powf", "pow", 1 },    { "atan2", "atan2", 1 }, { "hypot", "hypot", 1 },
+    { "min", "fmin", 1 },    { "max", "fmax", 1 },    { NULL, NULL, 0 }
+};
+
+static int float_method(const char* name) {
+    int k;
+    for (k = 0; float_methods[k].name; k++) {
+        if (strcmp(name, float_methods[k].name) == 0) return k;
+    }
+    return -1;
+}
+
+/* The operand at token *i, moving *i past it: its type after any casts,
+ * -1 if nothing says, FLOAT_WEAK for a bare float literal. *inner gets
+ * the type before the casts. */
+static int float_scan_operand(CompilerContext* cx, int* i, int* inner) {
+    const Token* t;
+    char buf[64];
+    int type = -1;
+
+    while (tok_is_punct(&cx->tokens[*i], '-') || tok_is_punct(&cx->tokens[*i], '!')
+           || tok_is_punct(&cx->tokens[*i], '*') || tok_is_punct(&cx->tokens[*i], '&')) ++*i;
+    t = &cx->tokens[*i];
+    if (tok_is_punct(t, '(')) {
+        /* (a + b), but not a tuple */
+        int k = *i + 1, close = tok_match_close(cx, *i);
+        type = float_scan(cx, &k, 0);
+        if (k != close) type = -1;
+        *i = close + 1;
+    } else if (tok_float_text(cx, t, buf, sizeof(buf), &type)) {
+        ++*i;
+    } else if (t->kind == TOK_INT || t->kind == TOK_CHAR || t->kind == TOK_STRING) {
+        type = t->kind == TOK_CHAR ? TYPE_CHAR : -1;
+        ++*i;
+    } else if (t->kind == TOK_IDENT && (tok_kw(t) < 0 || tok_kw(t) == KW_TRUE || tok_kw(t) == KW_FALSE)) {
+        const SymEntry* e = &cx->sym_entries[t->sym];
+        ++*i;
+        if (tok_kw(t) >= 0) {
+            type = TYPE_BOOL;
+        } else if (tok_is_punct(t + 1, ':') && tok_is_punct(t + 2, ':')) {
+            /* f64::EPSILON, u32::MAX, f64::consts::PI */
+            type = float_type_of(cx, t->sym);
+            if (type < 0) type = const_type_of(cx, t->sym);
+            while (tok_is_punct(&cx->tokens[*i], ':') && tok_is_punct(&cx->tokens[*i + 1], ':')
+                   && cx->tokens[*i + 2].kind == TOK_IDENT) *i += 3;
+        } else if (e->var >= 0) {
+            type = cx->vars[e->var].type;
+        } else if (tok_is_punct(t + 1, '(') && e->free_fn >= 0) {
+            type = fn_return_float(cx, &cx->functions[e->free_fn]);
+            if (type < 0) type = fn_return_int(cx, &cx->functions[e->free_fn]);
+        } else if (e->const_idx >= 0) {
+            type = cx->consts[e->const_idx].type;
+        }
+        if (tok_is_punct(&cx->tokens[*i], '(')) *i = tok_match_close(cx, *i) + 1;
+    } else {
+        *inner = -1;
+        return -1;
+    }
+    /* x.abs(), v.len(), s.field */
+    while (tok_is_punct(&cx->tokens[*i], '.') && cx->tokens[*i + 1].kind == TOK_IDENT) {
+        const char* m = sym_name(cx, cx->tokens[*i + 1].sym);
+        if (strcmp(m, "len") == 0) type = TYPE_U32;
+        else if (!type_float(type) || float_method(m) < 0) type = -1;
+        *i += 2;
+        if (tok_is_punct(&cx->tokens[*i], '(')) *i = tok_match_close(cx, *i) + 1;
+    }
+    *inner = type;
+    while (tok_kw(&cx->tokens[*i]) == KW_AS && cx->tokens[*i + 1].kind == TOK_IDENT) {
+        type = float_type_of(cx, cx->tokens[*i + 1].sym);
+        if (type < 0) type = const_type_of(cx, cx->tokens[*i + 1].sym);
+        *i += 2;
+    }
+    return type;
+}
+
+/* The expression at token *i, up to the end of the statement, argument
+ * or parenthesis it is in, and of its comparison when compare is set;
+ * *i is left on the token that ends it. Its type is that of the first
+ * operand that has one, or FLOAT_WEAK when only bare float literals do. */
+static int float_scan(CompilerContext* cx, int* i, int compare) {
+    int type = -1, weak = 0, inner;
+    for (;;) {
+        int start = *i, t = float_scan_operand(cx, i, &inner);
+        const Token* op = &cx->tokens[*i];
+        int joined = op[1].kind == TOK_PUNCT && op[1].start == op->start + op->len;
+        if (*i == start) break;
+        if (t == FLOAT_WEAK) weak = 1;
+        else if (type < 0) type = t;
+        if (op->kind != TOK_PUNCT) break;
+        if (strchr("+-*/%^", op->ch) && !(joined && op[1].ch == '=')) {
+            ++*i;
+        } else if ((op->ch == '&' || op->ch == '|') && !(joined && (op[1].ch == op->ch || op[1].ch == '='))) {
+            ++*i;
+        } else if ((op->ch == '<' || op->ch == '>') && joined && op[1].ch == op->ch) {
+            *i += 2;
+        } else if (compare && (op->ch == '<' || op->ch == '>' || ((op->ch == '=' || op->ch == '!')
+                                                                  && joined && op[1].ch == '='))) {
+            *i += 1 + (joined && op[1].ch == '=');
+            compare = 0;
+        } else {
+            break;
+        }
+    }
+    return type < 0 && weak ? FLOAT_WEAK : type;
+}
+
+/* The f32/f64 type of the expression at pos (and of its comparison with
+ * compare set), or -1 when it computes in the GPRs */
+static int float_expr_at(CompilerContext* cx, int compare) {
+    int i = tok_index_at(cx, cx->pos), t = float_scan(cx, &i, compare);
+    return t == FLOAT_WEAK ? TYPE_F64 : type_float(t) ? t : -1;
+}
+
+static const char* float_single(RustType t) {
+    return t == TYPE_F32 ? "s" : "";
+}
+
+/* Pool entry for value as an f32 (single) or f64 */
+static int float_const(CompilerContext* cx, double value, int single) {
+    union { double d; unsigned long long u; } d;
+    union { float f; unsigned u; } f;
+    unsigned long long bits;
+    int k;
+    if (single) {
+        f.f = (float)value;
+        bits = f.u;
+    } else {
+        d.d = value;
+        bits = d.u;
+    }
+    for (k = 0; k < cx->float_const_count; k++) {
+        if (cx->float_consts[k].bits == bits && cx->float_consts[k].single == single) return k;
+    }
+    cx->float_consts[k].bits = bits;
+    cx->float_consts[k].single = single;
+    cx->float_const_count++;
+    cx->float_consts = table_reserve(cx, cx->float_consts, cx->float_const_count, &cx->float_const_capacity,
+                                     sizeof(FloatConst));
+    return k;
+}
+
+/* value into f<fb> as type t, its address through rgb */
+static void float_li(CompilerContext* cx, int fb, int gb, double value, RustType t) {
+    int k = float_const(cx, value, t == TYPE_F32);
+    char text[32];
+    /* emit() has no %g */
+    snprintf(text, sizeof(text), "%g", value);
+    emit(cx, "    lis r%d, ha16(Lfconst_%d)\n", gb, k);
+    emit(cx, "    %s f%d, lo16(Lfconst_%d)(r%d)   ; %s\n", t == TYPE_F32 ? "lfs" : "lfd", fb, k, gb, text);
+}
+
+/* f<fb> = name(f<fb>[, f<fb+1>]) from libm, the f-suffixed one for an
+ * f32. f1 up are the arguments; the enclosing expression's FPRs below
+ * fb keep to the frame, and its GPRs too below opt-level 2. */
+static void float_libcall(CompilerContext* cx, int fb, int gb, const char* name, int args, RustType t) {
+    int k;
+    emit_fpr_saves(cx, gb, fb - 1, 0);
+    for (k = 0; k < args; k++) {
+        if (fb != 1) emit(cx, "    fmr f%d, f%d\n", 1 + k, fb + k);
+    }
+    emit_gpr_saves(cx, gb, 0);
+    emit(cx, "    bl _%s%s\n", name, t == TYPE_F32 ? "f" : "");
+    emit_gpr_saves(cx, gb, 1);
+    if (fb != 1) emit(cx, "    fmr f%d, f1\n", fb);
+    emit_fpr_saves(cx, gb, fb - 1, 1);
+}
+
+/* rword as a double in f<fb>, rtmp free: 2^52 + word (biased by 2^31
+ * when signed) less the same double with a zero word, which is exact */
+static void float_word(CompilerContext* cx, int fb, int word, int tmp, int is_signed, int scratch) {
+    int k = float_const(cx, is_signed ? 4503601774854144.0 : 4503599627370496.0, 0);
+    emit(cx, "    lis r%d, 0x4330\n", tmp);
+    if (is_signed) emit(cx, "    xoris r%d, r%d, 0x8000\n", word, word);
+    emit(cx, "    stw r%d, %d(r1)\n", tmp, scratch);
+    emit(cx, "    stw r%d, %d(r1)\n", word, scratch + 4);
+    emit(cx, "    lfd f%d, %d(r1)\n", fb, scratch);
+    emit(cx, "    lis r%d, ha16(Lfconst_%d)\n", tmp, k);
+    emit(cx, "    lfd f0, lo16(Lfconst_%d)(r%d)\n", k, tmp);
+    emit(cx, "    fsub f%d, f%d, f0\n", fb, fb);
+}
+
+/* rgb:rgb+1, an integer of type from as wide_operand() leaves it, into
+ * f<fb> as type to. An i64/u64 is its high word times 2^32 plus its low
+ * word, the fmadd rounding once; to f32 that rounds twice, off by one
+ * ulp in rare ties. */
+static void float_from_int(CompilerContext* cx, int fb, int gb, RustType from, RustType to) {
+    int scratch = float_scratch(cx, gb);
+    if (type_wide(from)) {
+        float_word(cx, fb, gb, gb + 2, !const_unsigned(from), scratch);
+        float_word(cx, fb + 1, gb + 1, gb + 2, 0, scratch);
+        float_li(cx, 0, gb + 2, 4294967296.0, TYPE_F64);
+        emit(cx, "    fmadd f%d, f%d, f0, f%d\n", fb, fb, fb + 1);
+    } else {
+        float_word(cx, fb, gb + 1, gb, !const_unsigned(from), scratch);
+    }
+    if (to == TYPE_F32) emit(cx, "    frsp f%d, f%d\n", fb, fb);
+}
+
+/* fctiwz of f<src> into rlo, through the frame */
+static void float_fctiwz(CompilerContext* cx, int src, int lo, int scratch) {
+    emit(cx, "    fctiwz f0, f%d\n", src);
+    emit(cx, "    stfd f0, %d(r1)\n", scratch);
+    emit(cx, "    lwz r%d, %d(r1)\n", lo, scratch + 4);
+}
+
+/* Clamp rlo to at most max, unsigned or signed */
+static void float_clamp_max(CompilerContext* cx, int lo, int max, int is_unsigned) {
+    int label = cx->labels.fp++;
+    emit(cx, "    %s cr1, r%d, %d\n", is_unsigned ? "cmplwi" : "cmpwi", lo, max);
+    emit(cx, "    ble cr1, Lfloat_%d\n", label);
+    emit_li(cx, lo, max);
+    emit(cx, "Lfloat_%d:\n", label);
+}
+
+/* f<fb> into rgb:rgb+1 as integer type to, saturating as Rust's `as`
+ * does: out-of-range values clamp to the type's bounds and NaN is 0.
+ * fctiwz already saturates to i32 (NaN to its minimum); narrower types
+ * clamp after it, and u32 converts above 2^31 less 2^31. */
+static void float_to_int(CompilerContext* cx, int fb, int gb, RustType to) {
+    int scratch = float_scratch(cx, gb), lo = gb + 1, bits = const_bits(to), label;
+    if (type_wide(to)) {
+        /* libgcc converts what is in range; the bounds and NaN are here */
+        int is_unsigned = const_unsigned(to), below = cx->labels.fp++, call = cx->labels.fp++;
+        label = cx->labels.fp++;
+        float_li(cx, 0, gb, is_unsigned ? 18446744073709551616.0 : 9223372036854775808.0, TYPE_F64);
+        emit(cx, "    fcmpu cr1, f%d, f0\n", fb);
+        emit(cx, "    blt cr1, Lfloat_%d\n", below);
+        emit_li(cx, gb, is_unsigned ? -1 : 0x7FFFFFFF);
+        emit(cx, "    li r%d, -1\n", lo);
+        emit(cx, "    fcmpu cr1, f%d, f%d\n", fb, fb);
+        emit(cx, "    beq cr1, Lfloat_%d\n", label);
+        emit(cx, "    li r%d, 0           ; NaN\n", gb);
+        emit(cx, "    li r%d, 0\n", lo);
+        emit(cx, "    b Lfloat_%d\n", label);
+        emit(cx, "Lfloat_%d:\n", below);
+        float_li(cx, 0, gb, is_unsigned ? 0.0 : -9223372036854775808.0, TYPE_F64);
+        emit(cx, "    fcmpu cr1, f%d, f0\n", fb);
+        emit(cx, "    %s cr1, Lfloat_%d\n", is_unsigned ? "bgt" : "bge", call);
+        emit_li(cx, gb, is_unsigned ? 0 : INT_MIN);
+        emit(cx, "    li r%d, 0\n", lo);
+        emit(cx, "    b Lfloat_%d\n", label);
+        emit(cx, "Lfloat_%d:\n", call);
+        emit_fpr_saves(cx, gb, fb - 1, 0);
+        if (fb != 1) emit(cx, "    fmr f1, f%d\n", fb);
+        emit_gpr_saves(cx, gb, 0);
+        emit(cx, "    bl %s\n", is_unsigned ? "___fixunsdfdi" : "___fixdfdi");
+        emit_gpr_saves(cx, gb, 1);
+        emit(cx, "    mr r%d, r3\n", gb);
+        emit(cx, "    mr r%d, r4\n", lo);
+        emit_fpr_saves(cx, gb, fb - 1, 1);
+        emit(cx, "Lfloat_%d:\n", label);
+        return;
+    }
+    if (const_unsigned(to) && bits == 32) {
+        int k = float_const(cx, 2147483648.0, 0), big = cx->labels.fp++;
+        label = cx->labels.fp++;
+        emit(cx, "    lis r%d, ha16(Lfconst_%d)\n", gb, k);
+        emit(cx, "    lfd f0, lo16(Lfconst_%d)(r%d)   ; 2^31\n", k, gb);
+        emit(cx, "    fcmpu cr1, f%d, f0\n", fb);
+        emit(cx, "    bge cr1, Lfloat_%d\n", big);
+        /* below 2^31: negatives go to 0. NaN is unordered, so takes the
+         * branch, and fctiwz's 0x80000000 flips to 0 there */
+        float_fctiwz(cx, fb, lo, scratch);
+        emit(cx, "    srawi r0, r%d, 31\n", lo);
+        emit(cx, "    andc r%d, r%d, r0\n", lo, lo);
+        emit(cx, "    b Lfloat_%d\n", label);
+        emit(cx, "Lfloat_%d:\n", big);
+        emit(cx, "    fsub f0, f%d, f0\n", fb);
+        float_fctiwz(cx, 0, lo, scratch);
+        emit(cx, "    xoris r%d, r%d, 0x8000\n", lo, lo);
+        emit(cx, "Lfloat_%d:\n", label);
+    } else if (const_unsigned(to)) {
+        float_fctiwz(cx, fb, lo, scratch);
+        emit(cx, "    srawi r0, r%d, 31\n", lo);
+        emit(cx, "    andc r%d, r%d, r0\n", lo, lo);
+        float_clamp_max(cx, lo, (1 << bits) - 1, 1);
+    } else {
+        label = cx->labels.fp++;
+        float_fctiwz(cx, fb, lo, scratch);
+        emit(cx, "    fcmpu cr1, f%d, f%d\n", fb, fb);
+        emit(cx, "    beq cr1, Lfloat_%d\n", label);
+        emit(cx, "    li r%d, 0           ; NaN\n", lo);
+        emit(cx, "Lfloat_%d:\n", label);
+        if (bits < 32) {
+            float_clamp_max(cx, lo, (1 << (bits - 1)) - 1, 0);
+            label = cx->labels.fp++;
+            emit(cx, "    cmpwi cr1, r%d, %d\n", lo, -(1 << (bits - 1)));
+            emit(cx, "    bge cr1, Lfloat_%d\n", label);
+            emit(cx, "    li r%d, %d\n", lo, -(1 << (bits - 1)));
+            emit(cx, "Lfloat_%d:\n", label);
+        }
+    }
+    wide_extend(cx, gb, lo, to);
+}
+
+static RustType float_expr_prec(CompilerContext* cx, int fb, int gb, RustType type, int min_prec, int* product);
+
+/* A call of the free fn fn, pos at its '(', into f<fb>. As in
+ * wide_call(), float arguments are evaluated into f<fb+1> up and the
+ * rest into GPR pairs from rgb+2 before any moves to f1 or r3. */
+static RustType float_call(CompilerContext* cx, int fb, int gb, const Function* fn, const char* name) {
+    int types[16], floats[16], elems[16], argtype[16], freg[16], n = 0, nf = 0, k, word = 3, fpr = 1, weak;
+    int live = cx->fpr_live;
+    RustType ret = fn_return_float(cx, fn);
+    const Variable* refs[16];
+    char aname[64];
+
+    for (k = 0; k < 16; k++) types[k] = floats[k] = elems[k] = -1;
+    if (fn->param_count <= 16) {
+        ce_param_types(cx, fn, types);
+        fn_param_floats(cx, fn, floats);
+        fn_param_slices(cx, fn, elems);
+    }
+    cx->pos++;
+    skip_whitespace(cx);
+    while (*cx->pos && *cx->pos != ')' && n < 16) {
+        refs[n] = NULL;
+        argtype[n] = TYPE_REF;
+        if (floats[n] >= 0) {
+            freg[n] = fb + 1 + nf++;
+            argtype[n] = float_expr(cx, freg[n], gb + 2 + 2 * n, floats[n]);
+        } else if (*cx->pos == '&') {
+            cx->pos++;
+            skip_whitespace(cx);
+            if (strncmp(cx->pos, "mut ", 4) == 0) cx->pos += 4;
+            skip_whitespace(cx);
+            parse_string(cx, aname, sizeof(aname));
+            refs[n] = var_lookup(cx, aname);
+        } else {
+            cx->fpr_live = fb + nf;
+            argtype[n] = wide_expr(cx, gb + 2 + 2 * n, &weak);
+            cx->fpr_live = live;
+        }
+        n++;
+        skip_whitespace(cx);
+        if (*cx->pos == ',') cx->pos++;
+        skip_whitespace(cx);
+    }
+    if (*cx->pos == ')') cx->pos++;
+    emit_fpr_saves(cx, gb, fb - 1, 0);
+    for (k = 0; k < n; k++) {
+        int r = gb + 2 + 2 * k;
+        if (floats[k] >= 0) {
+            if (fpr <= 13 && fpr != freg[k]) emit(cx, "    fmr f%d, f%d\n", fpr, freg[k]);
+            fpr++;
+            word += floats[k] == TYPE_F64 ? 2 : 1;
+        } else if (word > 10) {
+            continue;
+        } else if (argtype[k] == TYPE_REF) {
+            int words = refs[k] ? emit_slice_arg(cx, word, refs[k], refs[k]->name, 1, elems[k] >= 0) : 0;
+            if (!words && refs[k]) emit_var_load(cx, word, refs[k], "");
+            else if (!words) emit(cx, "    li r%d, 0\n", word);
+            word += words ? words : 1;
+        } else if ((type_wide((RustType)types[k]) || (types[k] < 0 && type_wide(argtype[k]))) && word < 10) {
+            emit(cx, "    mr r%d, r%d\n", word++, r);
+            emit(cx, "    mr r%d, r%d\n", word++, r + 1);
+        } else {
+            emit(cx, "    mr r%d, r%d\n", word++, r + 1);
+        }
+    }
+    emit_gpr_saves(cx, gb, 0);
+    emit(cx, "    bl _%s\n", sanitize_label(cx, name));
+    emit_gpr_saves(cx, gb, 1);
+    if (fb != 1) emit(cx, "    fmr f%d, f1\n", fb);
+    emit_fpr_saves(cx, gb, fb - 1, 1);
+    return ret;
+}
+
+/* T::NAME of f32/f64 type t, pos past the T */
+static double float_path_const(CompilerContext* cx, RustType t, char* name, int size) {
+    static const struct { const char* name; double f64, f32; } consts[] = {
+        { "MAX", DBL_MAX, FLT_MAX },              { "MIN", -DBL_MAX, -FLT_MAX },
+        { "MIN_POSITIVE", DBL_MIN, FLT_MIN },     { "EPSILON", DBL_EPSILON, FLT_EPSILON },
+        { "INFINITY", HUGE_VAL, HUGE_VAL },       { "NEG_INFINITY", -HUGE_VAL, -HUGE_VAL },
+        { "NAN", NAN, NAN },                      { "PI", 3.14159265358979323846, 3.14159265358979323846 },
+        { "TAU", 6.28318530717958647693, 6.28318530717958647693 },
+        { "E", 2.71828182845904523536, 2.71828182845904523536 },
+        { "SQRT_2", 1.41421356237309504880, 1.41421356237309504880 },
+        { "LN_2", 0.693147180559945309417, 0.693147180559945309417 },
+        { NULL, 0, 0 }
+    };
+    int k;
+    name[0] = '\0';
+    while (cx->pos[0] == ':' && cx->pos[1] == ':') {
+        cx->pos += 2;
+        parse_string(cx, name, size);
+    }
+    for (k = 0; consts[k].name; k++) {
+        if (strcmp(name, consts[k].name) == 0) return t == TYPE_F32 ? consts[k].f32 : consts[k].f64;
+    }
+    return 0.0;
+}
+
+/* A literal, f32/f64 local, path constant, call or parenthesized
+ * expression into f<fb>, then its method calls; type is what a bare
+ * literal or an expression that does not say takes */
+static RustType float_primary(CompilerContext* cx, int fb, int gb, RustType type) {
+    Token* t = tok_at(cx, cx->pos);
+    char name[64] = {0}, buf[64];
+    int lit, sym, m, k;
+    Variable* v;
+
+    if (tok_float_text(cx, t, buf, sizeof(buf), &lit)) {
+        if (lit != FLOAT_WEAK) type = lit;
+        float_li(cx, fb, gb, type == TYPE_F32 ? (double)strtof(buf, NULL) : strtod(buf, NULL), type);
+        cx->pos = tok_end(cx, t);
+    } else if (*cx->pos == '(') {
+        k = tok_index_at(cx, cx->pos) + 1;
+        lit = float_scan(cx, &k, 0);
+        cx->pos++;
+        type = float_expr(cx, fb, gb, type_float(lit) ? (RustType)lit : type);
+        skip_whitespace(cx);
+        if (*cx->pos == ')') cx->pos++;
+    } else {
+        parse_string(cx, name, sizeof(name));
+        v = var_lookup(cx, name);
+        if (v && type_float(v->type)) {
+            emit(cx, "    %s f%d, %d(r1)   ; load %s\n", v->type == TYPE_F32 ? "lfs" : "lfd", fb, v->offset, name);
+            type = v->type;
+        } else if (cx->pos[0] == ':' && (sym = sym_find(cx, name, strlen(name))) >= 0 && float_type_of(cx, sym) >= 0) {
+            type = float_type_of(cx, sym);
+            float_li(cx, fb, gb, float_path_const(cx, type, name, sizeof(name)), type);
+        } else if (*cx->pos == '(' && (sym = sym_find(cx, name, strlen(name))) >= 0 && cx->sym_entries[sym].free_fn >= 0) {
+            float_call(cx, fb, gb, &cx->functions[cx->sym_entries[sym].free_fn], name);
+        } else {
+            int k = float_const(cx, 0.0, type == TYPE_F32);
+            emit(cx, "    lis r%d, ha16(Lfconst_%d)\n", gb, k);
+            emit(cx, "    %s f%d, lo16(Lfconst_%d)(r%d)   ; %s (unresolved)\n", type == TYPE_F32 ? "lfs" : "lfd",
+                 fb, k, gb, name);
+        }
+    }
+
+    /* x.abs(), x.sqrt(), x.mul_add(a, b), x.powf(y) */
+    while (cx->pos[0] == '.' && (isalpha(cx->pos[1]) || cx->pos[1] == '_')) {
+        char* save = cx->pos;
+        cx->pos++;
+        parse_string(cx, name, sizeof(name));
+        if ((m = float_method(name)) < 0 || *cx->pos != '(' || fb + float_methods[m].args > FLOAT_BASE_MAX + 1) {
+            cx->pos = save;
+            break;
+        }
+        cx->pos++;
+        for (k = 1; k <= float_methods[m].args; k++) {
+            skip_whitespace(cx);
+            if (*cx->pos == ',') cx->pos++;
+            float_expr(cx, fb + k, gb, type);
+        }
+        skip_whitespace(cx);
+        if (*cx->pos == ')') cx->pos++;
+        if (strcmp(name, "abs") == 0) {
+            emit(cx, "    fabs f%d, f%d\n", fb, fb);
+        } else if (strcmp(name, "mul_add") == 0) {
+            emit(cx, "    fmadd%s f%d, f%d, f%d, f%d\n", float_single(type), fb, fb, fb + 1, fb + 2);
+        } else if (strcmp(name, "sqrt") == 0 && target_cpus[cx->opts.target_cpu].machine
+                   && strcmp(target_cpus[cx->opts.target_cpu].machine, "ppc970") == 0) {
+            /* only the 970 has the optional fsqrt */
+            emit(cx, "    fsqrt%s f%d, f%d\n", float_single(type), fb, fb);
+        } else {
+            float_libcall(cx, fb, gb, float_methods[m].libm, 1 + float_methods[m].args, type);
+        }
+    }
+    return type;
+}
+
+/* One operand at pos into f<fb>, its float casts included: a unary
+ * minus, a float primary, or an integer operand converted by `as`.
+ * Stops at a cast to an integer type, which is the caller's. */
+static RustType float_operand(CompilerContext* cx, int fb, int gb, RustType type) {
+    int i, inner, to;
+    Token* t;
+
+    skip_whitespace(cx);
+    i = tok_index_at(cx, cx->pos);
+    if (fb > FLOAT_BASE_MAX) {
+        /* deeper than the volatile FPRs go */
+        float_scan_operand(cx, &i, &inner);
+        cx->pos = tok_ptr(cx, &cx->tokens[i]);
+        emit(cx, "    fsub f0, f0, f0     ; (expression too deep)\n");
+        return type;
+    }
+    if (*cx->pos == '-') {
+        char buf[64];
+        t = &cx->tokens[i + 1];
+        if (tok_float_text(cx, t, buf, sizeof(buf), &to) && !tok_is_punct(t + 1, '.')) {
+            /* -1.5 loads as it is */
+            if (to != FLOAT_WEAK) type = to;
+            float_li(cx, fb, gb, -(type == TYPE_F32 ? (double)strtof(buf, NULL) : strtod(buf, NULL)), type);
+            cx->pos = tok_end(cx, t);
+            goto casts;
+        }
+        cx->pos++;
+        type = float_operand(cx, fb, gb, type);
+        emit(cx, "    fneg f%d, f%d\n", fb, fb);
+        return type;
+    }
+    float_scan_operand(cx, &i, &inner);
+    if (type_float(inner) || inner == FLOAT_WEAK) {
+        type = float_primary(cx, fb, gb, inner == FLOAT_WEAK ? type : (RustType)inner);
+    } else {
+        /* an integer, which Rust only lets in through a cast */
+        int live = cx->fpr_live, weak, from;
+        cx->fpr_live = fb - 1;
+        from = wide_operand(cx, gb, &weak);
+        cx->fpr_live = live;
+        skip_whitespace(cx);
+        t = tok_at(cx, cx->pos);
+        to = tok_kw(t) == KW_AS && t[1].kind == TOK_IDENT ? float_type_of(cx, t[1].sym) : -1;
+        if (to >= 0) {
+            type = to;
+            cx->pos = tok_end(cx, t + 1);
+        }
+        float_from_int(cx, fb, gb, from < 0 ? TYPE_I32 : (RustType)from, type);
+    }
+  casts:
+    for (;;) {
+        skip_whitespace(cx);
+        t = tok_at(cx, cx->pos);
+        to = tok_kw(t) == KW_AS && t[1].kind == TOK_IDENT ? float_type_of(cx, t[1].sym) : -1;
+        if (to < 0) break;
+        if (to == TYPE_F32 && type == TYPE_F64) emit(cx, "    frsp f%d, f%d\n", fb, fb);
+        type = to;
+        cx->pos = tok_end(cx, t + 1);
+    }
+    return type;
+}
+
+/* Precedence of the float operator at pos, CPREC_NONE for none */
+static int float_binop(CompilerContext* cx, char* op) {
+    *op = cx->pos[0];
+    if (cx->pos[1] == '=') return CPREC_NONE;
+    switch (*op) {
+    case '*': case '/': case '%': return CPREC_MUL;
+    case '+': case '-': return CPREC_ADD;
+    }
+    return CPREC_NONE;
+}
+
+/* The operators at pos binding at least min_prec, by precedence
+ * climbing as wide_expr_prec() does. Under -C fp-contract=fast a product
+ * followed by + or - waits unmultiplied in f<fb>, f<fb+1> to become one
+ * fused op with it; with product set, one left over at the end is handed
+ * up that way too. */
+static RustType float_expr_prec(CompilerContext* cx, int fb, int gb, RustType type, int min_prec, int* product) {
+    const char* s = float_single(type);
+    int prec, pending = 0, rprod, rb;
+    char op, next;
+
+    if (product) *product = 0;
+    float_operand(cx, fb, gb, type);
+    skip_whitespace(cx);
+    while ((prec = float_binop(cx, &op)) != CPREC_NONE && prec >= min_prec) {
+        cx->pos++;
+        if (pending && prec != CPREC_ADD) {
+            emit(cx, "    fmul%s f%d, f%d, f%d\n", s, fb, fb, fb + 1);
+            pending = 0;
+        }
+        if (prec == CPREC_MUL) {
+            float_expr_prec(cx, fb + 1, gb, type, CPREC_MUL + 1, NULL);
+            skip_whitespace(cx);
+            if (op == '*' && cx->opts.fp_contract && fb + 3 <= FLOAT_BASE_MAX + 1
+                    && float_binop(cx, &next) == CPREC_ADD && (product || CPREC_ADD >= min_prec)) {
+                pending = 1;
+            } else if (op == '%') {
+                float_libcall(cx, fb, gb, "fmod", 2, type);
+            } else {
+                emit(cx, "    f%s%s f%d, f%d, f%d\n", op == '*' ? "mul" : "div", s, fb, fb, fb + 1);
+            }
+            continue;
+        }
+        /* + and -, fusing with a product on either side */
+        rb = pending ? fb + 2 : fb + 1;
+        float_expr_prec(cx, rb, gb, type, CPREC_ADD + 1, cx->opts.fp_contract && rb + 1 <= FLOAT_BASE_MAX ? &rprod : NULL);
+        if (!cx->opts.fp_contract || rb + 1 > FLOAT_BASE_MAX) rprod = 0;
+        if (pending && rprod) emit(cx, "    fmul%s f%d, f%d, f%d\n", s, rb, rb, rb + 1);
+        if (pending) {
+            emit(cx, "    f%s%s f%d, f%d, f%d, f%d\n", op == '+' ? "madd" : "msub", s, fb, fb, fb + 1, rb);
+        } else if (rprod) {
+            emit(cx, "    f%s%s f%d, f%d, f%d, f%d\n", op == '+' ? "madd" : "nmsub", s, fb, rb, rb + 1, fb);
+        } else {
+            emit(cx, "    f%s%s f%d, f%d, f%d\n", op == '+' ? "add" : "sub", s, fb, fb, rb);
+        }
+        pending = 0;
+        skip_whitespace(cx);
+    }
+    if (pending && product) *product = 1;
+    else if (pending) emit(cx, "    fmul%s f%d, f%d, f%d\n", s, fb, fb, fb + 1);
+    return type;
+}
+
+/* The expression at pos into f<fb> as type, GPR work from rgb up */
+static RustType float_expr(CompilerContext* cx, int fb, int gb, RustType type) {
+    return float_expr_prec(cx, fb, gb, type, CPREC_ADD, NULL);
+}
+
+/* f<fb> to the slot at off of type t */
+static void float_store(CompilerContext* cx, int fb, int off, RustType t, const char* name, const char* note) {
+    emit(cx, "    %s f%d, %d(r1)   ; %s%s\n", t == TYPE_F32 ? "stfs" : "stfd", fb, off, name, note);
+}
+
+/* x op= expr for an f32/f64 local x; acc += a * b fuses under
+ * -C fp-contract=fast */
+static void float_compound(CompilerContext* cx, char op, int off, RustType t, const char* name) {
+    const char* s = float_single(t);
+    int product = 0;
+    char note[16];
+    emit(cx, "    %s f1, %d(r1)   ; load %s\n", t == TYPE_F32 ? "lfs" : "lfd", off, name);
+    float_expr_prec(cx, 2, 14, t, CPREC_ADD, (op == '+' || op == '-') && cx->opts.fp_contract ? &product : NULL);
+    if (product) emit(cx, "    f%s%s f1, f2, f3, f1\n", op == '+' ? "madd" : "nmsub", s);
+    else if (op == '%') float_libcall(cx, 1, 14, "fmod", 2, t);
+    else if (strchr("+-*/", op)) {
+        emit(cx, "    f%s%s f1, f1, f2\n", op == '+' ? "add" : op == '-' ? "sub" : op == '*' ? "mul" : "div", s);
+    }
+    snprintf(note, sizeof(note), " %c= expr", op);
+    float_store(cx, 1, off, t, name, note);
+}
+
+/* if and while conditions. A comparison sets a CR field and the branch
+ * tests it directly; && and || short-circuit through branches instead of
+ * combining materialized booleans. A run of side-effect-free comparisons
+ * in one chain (i < n && x != 0) issues all its compares into separate
+ * CR fields before the first branch, so they overlap in the pipeline.
+ * Only the volatile fields cr0, cr1 and cr5-cr7 are used. */
+enum { CC_EQ, CC_NE, CC_LT, CC_GE, CC_GT, CC_LE };   /* cc ^ 1 negates */
+
+static const char* const cond_cc_name[] = { "eq", "ne", "lt", "ge", "gt", "le" };
+static const int cond_cc_swapped[] = { CC_EQ, CC_NE, CC_GT, CC_LE, CC_LT, CC_GE };
+static const int cond_fields[] = { 0, 1, 5, 6, 7 };
+
+#define COND_BATCH_MAX 5
+#define COND_REG_FIRST 14           /* a batch loads its operands into r14..r19 */
+#define COND_REG_COUNT 6
+
+typedef struct {
+    Variable* var;              /* NULL: the constant value */
+    long long value;
+    RustType type;
+} CondOperand;
+
+typedef struct {
+    CondOperand lhs;
+    CondOperand rhs;
+    int cc;
+    int is_unsigned;
+    int known;                  /* -1, or the value of a constant test */
+} CondLeaf;
+
+/* A comparison operator at pos (not << or >>) */
+static int cond_compare_op(CompilerContext* cx, int* cc) {
+    const char* p = cx->pos;
+    int len = 2;
+    if (p[0] == '=' && p[1] == '=') *cc = CC_EQ;
+    else if (p[0] == '!' && p[1] == '=') *cc = CC_NE;
+    else if (p[0] == '<' && p[1] == '=') *cc = CC_LE;
+    else if (p[0] == '>' && p[1] == '=') *cc = CC_GE;
+    else if (p[0] == '<' && p[1] != '<') *cc = CC_LT, len = 1;
+    else if (p[0] == '>' && p[1] != '>') *cc = CC_GT, len = 1;
+    else return 0;
+    cx->pos += len;
+    skip_whitespace(cx);
+    return 1;
+}
+
+/* Whether pos ends an operand of a level-0 (||) or level-1 (&&) chain */
+static int cond_at_boundary(CompilerContext* cx, int level) {
+    const char* p = cx->pos;
+    return !*p || *p == '{' || *p == ')' || (p[0] == '|' && p[1] == '|')
+        || (level && p[0] == '&' && p[1] == '&');
+}
+
+/* Whether the chain operand at pos is its last one: no || (&& for level
+ * 1) follows at paren depth 0 before the chain ends */
+static int cond_chain_last(CompilerContext* cx, int level) {
+    int i = tok_index_at(cx, cx->pos), depth = 0;
+    for (; i + 1 < cx->tok_count; i++) {
+        const Token* t = &cx->tokens[i];
+        int joined = t[1].start == t->start + 1;
+        if (tok_is_punct(t, '(') || tok_is_punct(t, '[')) depth++;
+        else if (tok_is_punct(t, ')') || tok_is_punct(t, ']')) {
+            if (depth-- == 0) return 1;
+        } else if (depth == 0 && tok_is_punct(t, '{')) {
+            return 1;
+        } else if (depth == 0 && joined && tok_is_punct(t, '|') && tok_is_punct(t + 1, '|')) {
+            return level == 1;
+        } else if (depth == 0 && joined && tok_is_punct(t, '&') && tok_is_punct(t + 1, '&')) {
+            if (level == 1) return 0;
+            i++;
+        }
+    }
+    return 1;
+}
+
+/* Move past whatever codegen could not make sense of, up to the next
+ * comparison or chain boundary */
+static void cond_skip(CompilerContext* cx) {
+    int depth = 0, cc;
+    while (*cx->pos) {
+        char* save = cx->pos;
+        if (depth == 0 && (cond_at_boundary(cx, 1) || cond_compare_op(cx, &cc))) {
+            cx->pos = save;
+            return;
+        }
+        if (*cx->pos == '(' || *cx->pos == '[') depth++;
+        else if (*cx->pos == ')' || *cx->pos == ']') depth--;
+        cx->pos++;
+        skip_whitespace(cx);
+    }
+}
+
+/* A constant or a plain variable; anything else restores pos */
+static int cond_operand(CompilerContext* cx, CondOperand* op) {
+    char* save = cx->pos;
+    char name[64] = {0};
+    skip_whitespace(cx);
+    op->var = NULL;
+    op->value = 0;
+    op->type = TYPE_I32;
+    if (!const_expr_at(cx, CPREC_BITOR, 0, 0, &op->value, &op->type)) {
+        if (!isalpha(*cx->pos) && *cx->pos != '_') return 0;
+        parse_string(cx, name, sizeof(name));
+        if ((op->var = var_lookup(cx, name)) == NULL) {
+            cx->pos = save;
+            return 0;
+        }
+        op->type = op->var->type;
+    }
+    if (type_wide(op->type) || type_float(op->type)) {
+        /* i64/u64 sides go through cond_wide(), f32/f64 ones cond_float() */
+        cx->pos = save;
+        return 0;
+    }
+    skip_whitespace(cx);
+    return 1;
+}
+
+/* A chain operand that is one comparison of plain operands ("x", "!x",
+ * "i < n"); registers it needs go to *regs */
+static int cond_simple_leaf(CompilerContext* cx, int level, CondLeaf* lf, int* regs) {
+    char* save = cx->pos;
+    int negate = cx->pos[0] == '!' && cx->pos[1] != '=';
+    if (negate) cx->pos++;
+    lf->cc = negate ? CC_EQ : CC_NE;
+    lf->rhs.var = NULL;
+    lf->rhs.value = 0;
+    lf->rhs.type = TYPE_I32;
+    if (!cond_operand(cx, &lf->lhs)
+            || (!negate && cond_compare_op(cx, &lf->cc) && !cond_operand(cx, &lf->rhs))
+            || !cond_at_boundary(cx, level)) {
+        cx->pos = save;
+        return 0;
+    }
+    if (!lf->lhs.var && lf->rhs.var) {
+        CondOperand t = lf->lhs;
+        lf->lhs = lf->rhs;
+        lf->rhs = t;
+        lf->cc = cond_cc_swapped[lf->cc];
+    }
+    lf->is_unsigned = const_unsigned(lf->lhs.type) && (!lf->rhs.var || const_unsigned(lf->rhs.type));
+    lf->known = -1;
+    if (!lf->lhs.var) {
+        long long a = lf->lhs.value, b = lf->rhs.value;
+        int r[] = { a == b, a != b, a < b, a >= b, a > b, a <= b };
+        lf->known = r[lf->cc];
+    }
+    *regs = 0;
+    if (lf->known < 0) {
+        *regs += lf->lhs.var->reg == 0;
+        if (lf->rhs.var) *regs += lf->rhs.var->reg == 0;
+        else if (lf->is_unsigned ? (lf->rhs.value < 0 || lf->rhs.value > 0xFFFF)
+                                 : (lf->rhs.value < -32768 || lf->rhs.value > 32767)) *regs += 1;
+    }
+    return 1;
+}
+
+static int cond_operand_reg(CompilerContext* cx, const CondOperand* op, int* next) {
+    if (op->var->reg) return op->var->reg;
+    emit_var_load(cx, *next, op->var, "");
+    return (*next)++;
+}
+
+/* cmpw/cmplw of reg against value, through scratch when it does not
+ * fit the immediate */
+static int cond_compare_imm(CompilerContext* cx, const char* cr, int reg, long long value, int is_unsigned, int scratch) {
+    const char* op = is_unsigned ? "cmplw" : "cmpw";
+    if (is_unsigned ? (value >= 0 && value <= 0xFFFF) : (value >= -32768 && value <= 32767)) {
+        emit(cx, "    %si %sr%d, %d\n", op, cr, reg, (int)value);
+        return 0;
+    }
+    emit_li(cx, scratch, (int)value);
+    emit(cx, "    %s %sr%d, r%d\n", op, cr, reg, scratch);
+    return 1;
+}
+
+static void cond_leaf_compare(CompilerContext* cx, const CondLeaf* lf, int crf, int* next) {
+    char cr[8] = "";
+    if (lf->known >= 0) return;
+    if (crf) snprintf(cr, sizeof(cr), "cr%d, ", crf);
+    int a = cond_operand_reg(cx, &lf->lhs, next);
+    if (!lf->rhs.var) {
+        if (cond_compare_imm(cx, cr, a, lf->rhs.value, lf->is_unsigned, *next)) (*next)++;
+    } else {
+        int b = cond_operand_reg(cx, &lf->rhs, next);
+        emit(cx, "    %s %sr%d, r%d\n", lf->is_unsigned ? "cmplw" : "cmpw", cr, a, b);
+    }
+}
+
+static void cond_leaf_branch(CompilerContext* cx, const CondLeaf* lf, int crf, const char* target, int value) {
+    char cr[8] = "";
+    if (lf->known >= 0) {
+        if (lf->known == value) emit(cx, "    b %s\n", target);
+        return;
+    }
+    if (crf) snprintf(cr, sizeof(cr), "cr%d, ", crf);
+    emit(cx, "    b%s %s%s\n", cond_cc_name[value ? lf->cc : lf->cc ^ 1], cr, target);
+}
+
+/* Any other comparison or value: the left side goes through r14, the
+ * right through r15 (r17 holds the left while a compound right side
+ * uses r14) */
+/* A comparison with an i64/u64 side, r14:r15 against r16:r17: the high
+ * words decide unless they are equal, then the low words, unsigned */
+static void cond_wide(CompilerContext* cx, const char* target, int value) {
+    int cc = CC_NE, label = cx->labels.wide++;
+    RustType lt = compile_expr64(cx, 14), rt = TYPE_I32;
+
+    skip_whitespace(cx);
+    if (cond_compare_op(cx, &cc)) {
+        rt = compile_expr64(cx, 16);
+    } else {
+        emit(cx, "    li r16, 0\n");
+        emit(cx, "    li r17, 0\n");
+    }
+    if (!type_wide(lt) && type_wide(rt)) lt = rt;
+    emit(cx, "    %s r14, r16\n", const_unsigned(lt) ? "cmplw" : "cmpw");
+    emit(cx, "    bne Lwide_%d\n", label);
+    emit(cx, "    cmplw r15, r17\n");
+    emit(cx, "Lwide_%d:\n", label);
+    skip_whitespace(cx);
+    if (!cond_at_boundary(cx, 1)) cond_skip(cx);
+    emit(cx, "    b%s %s\n", cond_cc_name[value ? cc : cc ^ 1], target);
+}
+
+/* A comparison of type t floats, f1 against f2 with fcmpu. A NaN side
+ * sets only the unordered bit, making everything but != false: <= and
+ * >= first fold eq into the bit they test, and a branch on one of them
+ * failing folds unordered into the opposite one. */
+static void cond_float(CompilerContext* cx, const char* target, int value, RustType t) {
+    static const char* const fold[] = {
+        /* value 1: eq, ne, lt, ge, gt, le */
+        NULL, NULL, NULL, "cror 2, 1, 2", NULL, "cror 2, 0, 2",
+        /* value 0 */
+        NULL, NULL, NULL, "cror 0, 0, 3", NULL, "cror 1, 1, 3"
+    };
+    static const char* const branch[] = {
+        "eq", "ne", "lt", "eq", "gt", "eq",
+        "ne", "eq", "ge", "lt", "le", "gt"
+    };
+    int cc = CC_NE, k;
+
+    float_expr(cx, 1, 14, t);
+    skip_whitespace(cx);
+    if (cond_compare_op(cx, &cc)) float_expr(cx, 2, 14, t);
+    else float_li(cx, 2, 14, 0.0, t);
+    emit(cx, "    fcmpu cr0, f1, f2\n");
+    k = (value ? 0 : 6) + cc;
+    if (fold[k]) emit(cx, "    %s\n", fold[k]);
+    skip_whitespace(cx);
+    if (!cond_at_boundary(cx, 1)) cond_skip(cx);
+    emit(cx, "    b%s %s\n", branch[k], target);
+}
+
+static void cond_general(CompilerContext* cx, const char* target, int value, int unresolved) {
+    CondOperand op;
+    char name[64] = {0};
+    char* start;
+    long long rhs;
+    int cc = CC_NE, is_unsigned, a = 14, b = 15, k;
+
+    skip_whitespace(cx);
+    if ((k = float_expr_at(cx, 1)) >= 0) {
+        cond_float(cx, target, value, k);
+        return;
+    }
+    if (wide_expr_at(cx, 14, 1) > 0) {
+        cond_wide(cx, target, value);
+        return;
+    }
+    start = cx->pos;
+    RustType lt = compile_expr_to_reg(cx, 14);
+    if (cx->pos == start) {
+        /* calls and whatever else codegen does not know yet */
+        parse_string(cx, name, sizeof(name));
+        emit(cx, "    li r14, %d         ; %s (unresolved)\n", unresolved, name);
+    }
+    skip_whitespace(cx);
+    int has_cmp = cond_compare_op(cx, &cc);
+    if (!has_cmp && !cond_at_boundary(cx, 1)) {
+        cond_skip(cx);
+        has_cmp = cond_compare_op(cx, &cc);
+    }
+    is_unsigned = const_unsigned(lt);
+    if (!has_cmp) {
+        cond_compare_imm(cx, "", 14, 0, is_unsigned, 0);
+    } else if (const_expr_at(cx, CPREC_BITOR, 0, 0, &rhs, NULL)) {
+        cond_compare_imm(cx, "", 14, rhs, is_unsigned, 0);
+    } else {
+        start = cx->pos;
+        if (cond_operand(cx, &op) && op.var && cond_at_boundary(cx, 1)) {
+            is_unsigned = is_unsigned && const_unsigned(op.type);
+            emit(cx, "    %s r14, r%d\n", is_unsigned ? "cmplw" : "cmpw", cond_operand_reg(cx, &op, &b));
+        } else {
+            cx->pos = start;
+            emit(cx, "    mr r17, r14\n");
+            a = 17;
+            RustType rt = compile_expr_to_reg(cx, 15);
+            if (cx->pos == start) {
+                parse_string(cx, name, sizeof(name));
+                emit(cx, "    li r15, %d         ; %s (unresolved)\n", unresolved, name);
+            }
+            is_unsigned = is_unsigned && const_unsigned(rt);
+            emit(cx, "    %s r%d, r15\n", is_unsigned ? "cmplw" : "cmpw", a);
+        }
+    }
+    skip_whitespace(cx);
+    if (!cond_at_boundary(cx, 1)) cond_skip(cx);
+    emit(cx, "    b%s %s\n", cond_cc_name[value ? cc : cc ^ 1], target);
+}
+
+/* The && (level 1) or || (level 0) between two chain operands */
+static int cond_chain_op(CompilerContext* cx, int level) {
+    skip_whitespace(cx);
+    if (cx->pos[0] != (level ? '&' : '|') || cx->pos[1] != cx->pos[0]) return 0;
+    cx->pos += 2;
+    skip_whitespace(cx);
+    return 1;
+}
+
+static void cond_chain(CompilerContext* cx, int level, const char* target, int value, int unresolved);
+
+/* One chain operand: branch to target when it evaluates to value */
+static void cond_item(CompilerContext* cx, int level, const char* target, int value, int unresolved) {
+    skip_whitespace(cx);
+    if (level == 0) {
+        cond_chain(cx, 1, target, value, unresolved);
+        return;
+    }
+    if (cx->pos[0] == '!' && cx->pos[1] != '=') {
+        cx->pos++;
+        cond_item(cx, 1, target, !value, unresolved);
+        return;
+    }
+    if (*cx->pos == '(') {
+        /* a parenthesized condition, not (a + b) < c */
+        int close = tok_match_close(cx, tok_index_at(cx, cx->pos));
+        char* save = cx->pos;
+        if (close < cx->tok_count) {
+            cx->pos = tok_ptr(cx, &cx->tokens[close + 1]);
+            int group = cond_at_boundary(cx, 1);
+            cx->pos = save;
+            if (group) {
+                cx->pos++;
+                cond_chain(cx, 0, target, value, unresolved);
+                skip_whitespace(cx);
+                if (*cx->pos == ')') cx->pos++;
+                skip_whitespace(cx);
+                return;
+            }
+        }
+    }
+    cond_general(cx, target, value, unresolved);
+}
+
+/* Operands of one && or || chain. Each but the last branches out as
+ * soon as it settles the chain (true for ||, false for &&); runs of
+ * simple comparisons compare first and branch after. */
+static void cond_chain(CompilerContext* cx, int level, const char* target, int value, int unresolved) {
+    int settles = level == 0;
+    char skip[32];
+    int skip_used = 0, k;
+
+    snprintf(skip, sizeof(skip), "Lcond_%d", cx->labels.cond++);
+    for (;;) {
+        CondLeaf leaves[COND_BATCH_MAX];
+        int lasts[COND_BATCH_MAX];
+        int n = 0, regs = 0, need, more = 1, last;
+
+        skip_whitespace(cx);
+        while (n < COND_BATCH_MAX) {
+            char* save = cx->pos;
+            last = cond_chain_last(cx, level);
+            if (!cond_simple_leaf(cx, level, &leaves[n], &need) || regs + need > COND_REG_COUNT) {
+                cx->pos = save;
+                break;
+            }
+            regs += need;
+            lasts[n++] = last;
+            if (last || !cond_chain_op(cx, level)) {
+                more = 0;
+                break;
+            }
+        }
+        if (n > 0) {
+            int next = COND_REG_FIRST;
+            for (k = 0; k < n; k++) cond_leaf_compare(cx, &leaves[k], cond_fields[k], &next);
+            for (k = 0; k < n; k++) {
+                const char* t = (lasts[k] || value == settles) ? target : skip;
+                skip_used |= t == skip;
+                cond_leaf_branch(cx, &leaves[k], cond_fields[k], t, lasts[k] ? value : settles);
+            }
+            if (!more) break;
+            continue;
+        }
+
+        last = cond_chain_last(cx, level);
+        const char* t = (last || value == settles) ? target : skip;
+        skip_used |= t == skip;
+        cond_item(cx, level, t, last ? value : settles, unresolved);
+        if (last || !cond_chain_op(cx, level)) break;
+    }
+    if (skip_used) emit(cx, "%s:\n", skip);
+}
+
+/* Branch to false_label unless the condition at pos holds; pos ends at
+ * the condition's end. Unresolved names read as unresolved. */
+static void compile_condition(CompilerContext* cx, const char* false_label, int unresolved) {
+    cond_chain(cx, 0, false_label, 0, unresolved);
+}
+
+/* Whether tokens i and i+1 are an adjacent ".." */
+static int tok_dotdot(CompilerContext* cx, int i) {
+    const Token* t = &cx->tokens[i];
+    return tok_is_punct(t, '.') && tok_is_punct(t + 1, '.') && t[1].start == t->start + 1;
+}
+
+/* Integer and enum matches. The arms are scanned before any code is
+ * emitted, the subject (in r14) dispatches once to the arm labels and
+ * the arm bodies follow in source order. The dispatch is picked per
+ * match by density: at least MATCH_TABLE_MIN values covering at least a
+ * third of their span get a bounds-checked bctr through a table in
+ * __TEXT,__const, other matches with more than MATCH_LINEAR_MAX values a
+ * binary search of cmpwi/beq/blt nodes, the rest a compare chain. */
+#define MATCH_TABLE_MIN 4
+#define MATCH_TABLE_SPAN 1024
+#define MATCH_LINEAR_MAX 3
+
+typedef struct {
+    int value;
+    int arm;                    /* arm index; the first arm wins a value */
+} MatchCase;
+
+typedef struct {
+    int pat;                    /* token index of the pattern */
+    int body;                   /* ... of the body */
+    int supported;              /* only literal/const/enum patterns get cases */
+    int wildcard;
+} MatchArm;
+
+typedef struct {
+    MatchArm* arms;
+    int arm_count;
+    MatchCase* cases;
+    int case_count;
+    int default_arm;            /* -1: fall out of the match */
+    int open;                   /* token indices of the braces */
+    int close;
+} MatchPlan;
+
+static int match_case_cmp(const void* a, const void* b) {
+    const MatchCase* x = a;
+    const MatchCase* y = b;
+    if (x->value != y->value) return x->value < y->value ? -1 : 1;
+    return x->arm - y->arm;
+}
+
+static void match_add_case(CompilerContext* cx, MatchPlan* mp, int* capacity, long long value, int arm) {
+    mp->cases = table_reserve(cx, mp->cases, mp->case_count, capacity, sizeof(MatchCase));
+    mp->cases[mp->case_count].value = (int)value;
+    mp->cases[mp->case_count++].arm = arm;
+}
+
+/* One pattern alternative at token i: a constant (literal, const item,
+ * Enum::Variant) or an inclusive range of them. Returns the token after
+ * it, or -1 if it is anything else. */
+static int match_scan_alternative(CompilerContext* cx, MatchPlan* mp, int* capacity, int i, int arm) {
+    long long lo, hi, v;
+    cx->pos = tok_ptr(cx, &cx->tokens[i]);
+    if (!const_expr_at(cx, CPREC_XOR, 0, 0, &lo, NULL)) return -1;
+    i = tok_index_at(cx, cx->pos);
+    if (tok_dotdot(cx, i) && tok_is_punct(&cx->tokens[i + 2], '=')) {
+        cx->pos = tok_ptr(cx, &cx->tokens[i + 3]);
+        if (!const_expr_at(cx, CPREC_XOR, 0, 0, &hi, NULL) || hi < lo || hi - lo >= MATCH_TABLE_SPAN) return -1;
+        i = tok_index_at(cx, cx->pos);
+    } else {
+        hi = lo;
+    }
+    for (v = lo; v <= hi; v++) match_add_case(cx, mp, capacity, v, arm);
+    return i;
+}
+
+/* Split the arms of the match whose '{' is token open */
+static void match_scan(CompilerContext* cx, int open, MatchPlan* mp) {
+    int i = open + 1, arm_capacity = 0, case_capacity = 0;
+    memset(mp, 0, sizeof(*mp));
+    mp->default_arm = -1;
+    mp->open = open;
+    mp->close = tok_match_close(cx, open);
+    while (i < mp->close) {
+        mp->arms = table_reserve(cx, mp->arms, mp->arm_count, &arm_capacity, sizeof(MatchArm));
+        MatchArm* arm = &mp->arms[mp->arm_count];
+        int a = mp->arm_count++, first_case = mp->case_count, k = i;
+        arm->pat = i;
+        arm->wildcard = tok_is_punct(&cx->tokens[i], '_') ||
+                        (cx->tokens[i].kind == TOK_IDENT && cx->tokens[i].len == 1 && tok_ptr(cx, &cx->tokens[i])[0] == '_');
+        arm->supported = !arm->wildcard;
+
+        /* Pattern: alternatives up to => */
+        if (arm->wildcard) {
+            k = i + 1;
+        } else {
+            if (tok_is_punct(&cx->tokens[k], '|')) k++;
+            while (k < mp->close) {
+                k = match_scan_alternative(cx, mp, &case_capacity, k, a);
+                if (k < 0 || !tok_is_punct(&cx->tokens[k], '|')) break;
+                k++;
+            }
+        }
+        if (k < 0 || !(tok_is_punct(&cx->tokens[k], '=') && tok_is_punct(&cx->tokens[k + 1], '>'))) {
+            /* bindings, guards, tuple and struct patterns: skipped */
+            arm->supported = arm->wildcard = 0;
+            mp->case_count = first_case;
+            for (k = i; k < mp->close && !(tok_is_punct(&cx->tokens[k], '=') && tok_is_punct(&cx->tokens[k + 1], '>')); k++) {
+                if (tok_is_punct(&cx->tokens[k], '(') || tok_is_punct(&cx->tokens[k], '[') ||
+                    tok_is_punct(&cx->tokens[k], '{')) k = tok_match_close(cx, k);
+            }
+        }
+        if (arm->wildcard && mp->default_arm < 0) mp->default_arm = a;
+
+        /* Body: a block, or an expression up to the next top-level comma */
+        k += 2;
+        arm->body = k;
+        if (tok_is_punct(&cx->tokens[k], '{')) {
+            k = tok_match_close(cx, k) + 1;
+        } else {
+            while (k < mp->close && !tok_is_punct(&cx->tokens[k], ',')) {
+                if (tok_is_punct(&cx->tokens[k], '(') || tok_is_punct(&cx->tokens[k], '[') ||
+                    tok_is_punct(&cx->tokens[k], '{')) k = tok_match_close(cx, k);
+                k++;
+            }
+        }
+        if (k < mp->close && tok_is_punct(&cx->tokens[k], ',')) k++;
+        i = k;
+    }
+
+    /* Sorted by value; a value a later arm repeats belongs to the first */
+    if (mp->case_count) {
+        int n = 1;
+        qsort(mp->cases, mp->case_count, sizeof(MatchCase), match_case_cmp);
+        for (i = 1; i < mp->case_count; i++) {
+            if (mp->cases[i].value != mp->cases[n - 1].value) mp->cases[n++] = mp->cases[i];
+        }
+        mp->case_count = n;
+    }
+}
+
+/* Binary search over cases[lo..hi] of the subject in r14 */
+static void match_emit_search(CompilerContext* cx, const MatchPlan* mp, const char* kind, int id,
+                              int lo, int hi, int* next_node, const char* default_label) {
+    int k;
+    if (hi - lo + 1 <= MATCH_LINEAR_MAX) {
+        for (k = lo; k <= hi; k++) {
+            emit_cmpwi(cx, 14, mp->cases[k].value);
+            emit(cx, "    beq Lmatch_%s_arm_%d_%d\n", kind, id, mp->cases[k].arm);
+        }
+        emit(cx, "    b %s\n", default_label);
+        return;
+    }
+    int mid = (lo + hi) / 2, node = (*next_node)++;
+    emit_cmpwi(cx, 14, mp->cases[mid].value);
+    emit(cx, "    beq Lmatch_%s_arm_%d_%d\n", kind, id, mp->cases[mid].arm);
+    emit(cx, "    blt Lmatch_%s_lt_%d_%d\n", kind, id, node);
+    match_emit_search(cx, mp, kind, id, mid + 1, hi, next_node, default_label);
+    emit(cx, "Lmatch_%s_lt_%d_%d:\n", kind, id, node);
+    match_emit_search(cx, mp, kind, id, lo, mid - 1, next_node, default_label);
+}
+
+/* Dispatch on r14 to Lmatch_KIND_arm_ID_N, or to the default */
+static void match_emit_dispatch(CompilerContext* cx, const MatchPlan* mp, const char* kind, int id) {
+    char default_label[64];
+    const char* strategy;
+    int n = mp->case_count, next_node = 0, k;
+    long long span = n ? (long long)mp->cases[n - 1].value - mp->cases[0].value + 1 : 0;
+
+    if (mp->default_arm >= 0) snprintf(default_label, sizeof(default_label), "Lmatch_%s_arm_%d_%d", kind, id, mp->default_arm);
+    else snprintf(default_label, sizeof(default_label), "Lmatch_%s_end_%d", kind, id);
+
+    if (n >= MATCH_TABLE_MIN && span <= MATCH_TABLE_SPAN && span <= 3LL * n && !cx->ctr_busy) {
+        int lo = mp->cases[0].value, c = 0;
+        strategy = "jump table";
+        emit(cx, "    ; jump table: %d cases over %d..=%d\n", n, lo, mp->cases[n - 1].value);
+        if (lo == 0) {
+            emit(cx, "    cmplwi r14, %d\n", (int)span - 1);
+            emit(cx, "    bgt %s\n", default_label);
+            emit(cx, "    slwi r15, r14, 2\n");
+        } else {
+            if (lo >= -32767 && lo <= 32768) {
+                emit(cx, "    addi r15, r14, %d\n", -lo);
+            } else {
+                emit_li(cx, 0, lo);
+                emit(cx, "    sub r15, r14, r0\n");
+            }
+            emit(cx, "    cmplwi r15, %d\n", (int)span - 1);
+            emit(cx, "    bgt %s\n", default_label);
+            emit(cx, "    slwi r15, r15, 2\n");
+        }
+        emit(cx, "    lis r16, ha16(Lmatch_%s_table_%d)\n", kind, id);
+        emit(cx, "    la r16, lo16(Lmatch_%s_table_%d)(r16)\n", kind, id);
+        emit(cx, "    lwzx r15, r16, r15\n");
+        emit(cx, "    mtctr r15\n");
+        emit(cx, "    bctr\n");
+        emit(cx, "    .section __TEXT,__const\n");
+        emit(cx, "    .align 2\n");
+        emit(cx, "Lmatch_%s_table_%d:\n", kind, id);
+        for (k = 0; k < span; k++) {
+            if (c < n && mp->cases[c].value == lo + k) {
+                emit(cx, "    .long Lmatch_%s_arm_%d_%d\n", kind, id, mp->cases[c++].arm);
+            } else {
+                emit(cx, "    .long %s\n", default_label);
+            }
+        }
+        emit(cx, "    .text\n");
+    } else if (n > MATCH_LINEAR_MAX) {
+        strategy = "binary search";
+        emit(cx, "    ; binary search: %d cases\n", n);
+        match_emit_search(cx, mp, kind, id, 0, n - 1, &next_node, default_label);
+    } else {
+        strategy = "compare chain";
+        match_emit_search(cx, mp, kind, id, 0, n - 1, &next_node, default_label);
+    }
+    if (cx->opts.match_stats) {
+        fprintf(stderr, "match: line %d, %d arms, %d cases, span %lld: %s\n",
+                source_line(cx, tok_ptr(cx, &cx->tokens[mp->open])), mp->arm_count, n, span, strategy);
+    }
+}
+
+/* Whether the tokens strictly between open and close call anything (a
+ * name before '(' or '!'), which would clobber CTR and r3-r12, and
+ * whether they hold another for loop */
+static int loop_body_calls(CompilerContext* cx, int open, int close, int* nested_for) {
+    int i, calls = 0, wide = 0, divides = 0, floats = 0, modulo = 0;
+    *nested_for = 0;
+    for (i = open + 1; i < close; i++) {
+        const Token* t = &cx->tokens[i];
+        if (tok_kw(t) == KW_FOR) *nested_for = 1;
+        if (t->kind == TOK_IDENT && tok_kw(t) < 0 && (tok_is_punct(t + 1, '(') || tok_is_punct(t + 1, '!'))) {
+            calls = 1;
+        }
+        /* 64-bit / and %, and float to i64/u64, call libgcc; float % fmod */
+        wide |= tok_wide(cx, t);
+        floats |= tok_float(cx, t);
+        divides |= tok_is_punct(t, '/') || tok_is_punct(t, '%');
+        modulo |= tok_is_punct(t, '%');
+    }
+    return calls || (wide && (divides || floats)) || (floats && modulo);
+}
+
+/* Load the range bound whose tokens start at i into reg, leaving pos
+ * after it. A lone name never reaches compile_expr_to_reg, which would
+ * take the ".." that follows a start bound for a field access. */
+static RustType emit_range_bound(CompilerContext* cx, int i, int reg) {
+    const Token* t = &cx->tokens[i];
+    long long value;
+    RustType type = TYPE_I32;
+    Variable* v;
+    cx->pos = tok_ptr(cx, t);
+    if (const_expr_at(cx, CPREC_BITOR, 0, 0, &value, &type)) {
+        emit_li(cx, reg, (int)value);
+        return type;
+    }
+    if (t->kind == TOK_IDENT && (tok_dotdot(cx, i + 1) || tok_is_punct(t + 1, ')') || tok_is_punct(t + 1, '{'))
+            && (v = var_lookup(cx, sym_name(cx, t->sym))) != NULL) {
+        emit_var_load(cx, reg, v, "");
+        cx->pos = tok_end(cx, t);
+        return v->type;
+    }
+    return compile_expr_to_reg(cx, reg);
+}
+
+/* Declare the i32 loop binding named by token tok, living in reg if
+ * nonzero, else in the slot at off */
+static void loop_bind(CompilerContext* cx, int tok, int reg, int off) {
+    cx->vars[cx->var_count].offset = reg ? 0 : off;
+    cx->vars[cx->var_count].type = TYPE_I32;
+    cx->vars[cx->var_count].size = 4;
+    var_declare(cx, sym_name(cx, cx->tokens[tok].sym));
+    cx->vars[cx->var_count - 1].reg = reg;
+}
+
+/* Loop kernels: a for loop over a slice (or an array) whose body is
+ * one element-wise idiom -- a sum, a count of elements equal to a
+ * constant, or dst = a OP b over the element, a zip()ped source and a
+ * constant (fills and copies included) -- is emitted as a unit. With
+ * AltiVec at opt-level 2 that is a scalar head up to a 16-byte boundary
+ * of the destination, a body over whole quadwords (lvx/stvx, a source
+ * realigned with lvsl/vperm, sums and counts in word lanes) and a
+ * scalar tail; otherwise the tail loop alone. tests/altivec_model.c
+ * models each body lane by lane.
+ *
+ * f32 sums, counts and arithmetic maps are vector only under
+ * -C fp-contract=fast: the sum adds in four lanes where rustc adds in
+ * order, and vaddfp, vmaddfp and vcmpeqfp run with VSCR[NJ] set,
+ * flushing denormals to zero. f32 fills and copies only move bits. */
+enum { VK_SUM, VK_COUNT, VK_MAP };
+enum { VK_DST, VK_SRC, VK_K };
+
+typedef struct {
+    int kind;
+    RustType elem;
+    Variable* dst;      /* iterated; written by VK_MAP */
+    Variable* src;      /* the zip()ped slice, NULL if none */
+    Variable* acc;      /* VK_SUM and VK_COUNT */
+    int op;             /* VK_MAP: + - * & | ^, or 0 to store operand a */
+    int a, b;           /* VK_MAP operands */
+    unsigned k;         /* the constant, masked to the element; f32 as bits */
+} LoopKernel;
+
+static int tok_pair(CompilerContext* cx, int i, char a, char b) {
+    const Token* t = &cx->tokens[i];
+    return tok_is_punct(t, a) && tok_is_punct(t + 1, b) && t[1].start == t->start + 1;
+}
+
+/* A slice or word array iterated from token *j: NAME, &NAME, &mut NAME,
+ * with .iter(), .iter_mut() or .into_iter() */
+static Variable* kernel_iterable(CompilerContext* cx, int* j, int* mut) {
+    int i = *j;
+    Variable* v;
+    *mut = 0;
+    if (tok_is_punct(&cx->tokens[i], '&')) {
+        i++;
+        if (tok_kw(&cx->tokens[i]) == KW_MUT) {
+            *mut = 1;
+            i++;
+        }
+    }
+    if (cx->tokens[i].kind != TOK_IDENT || !(v = var_lookup(cx, sym_name(cx, cx->tokens[i].sym))) || v->reg
+            || !((v->type == TYPE_SLICE && v->elem >= 0) || (v->type == TYPE_ARRAY && v->size >= 4))) {
+        return NULL;
+    }
+    i++;
+    if (tok_is_punct(&cx->tokens[i], '.') && cx->tokens[i + 1].kind == TOK_IDENT
+            && tok_is_punct(&cx->tokens[i + 2], '(') && tok_is_punct(&cx->tokens[i + 3], ')')) {
+        const char* name = sym_name(cx, cx->tokens[i + 1].sym);
+        if (strcmp(name, "iter_mut") == 0) *mut = 1;
+        else if (strcmp(name, "iter") != 0 && strcmp(name, "into_iter") != 0) return NULL;
+        i += 4;
+    }
+    *j = i;
+    return v;
+}
+
+static RustType kernel_elem(const Variable* v) {
+    return v->type == TYPE_SLICE ? v->elem : TYPE_I32;
+}
+
+/* The element bound to x or s at token *j (`*x` or `x`): VK_DST, VK_SRC
+ * or -1 */
+static int kernel_operand(CompilerContext* cx, int* j, int x, int s) {
+    int i = *j + tok_is_punct(&cx->tokens[*j], '*');
+    const Token* t = &cx->tokens[i];
+    if (t->kind != TOK_IDENT) return -1;
+    *j = i + 1;
+    return t->sym == x ? VK_DST : (s >= 0 && t->sym == s) ? VK_SRC : -1;
+}
+
+/* A constant of the element type at token *j, followed by stop */
+static int kernel_const(CompilerContext* cx, int* j, RustType elem, char stop, unsigned* k) {
+    long long value;
+    if (elem == TYPE_F32) {
+        int neg = tok_is_punct(&cx->tokens[*j], '-'), i = *j + neg;
+        union { float f; unsigned u; } bits;
+        if (cx->tokens[i].kind != TOK_FLOAT || (stop && !tok_is_punct(&cx->tokens[i + 1], stop))) return 0;
+        bits.f = strtof(tok_ptr(cx, &cx->tokens[i]), NULL);
+        *k = bits.u ^ (neg ? 0x80000000u : 0);
+        *j = i + 1;
+        return 1;
+    }
+    cx->pos = tok_ptr(cx, &cx->tokens[*j]);
+    if (!const_expr_at(cx, CPREC_MUL, 0, stop, &value, NULL)) return 0;
+    *k = const_bits(elem) == 8 ? (unsigned)value & 0xFF : const_bits(elem) == 16 ? (unsigned)value & 0xFFFF
+                                                                                  : (unsigned)value;
+    *j = tok_index_at(cx, cx->pos);
+    return 1;
+}
+
+/* A map operand at token *j: an element or a constant */
+static int kernel_map_operand(CompilerContext* cx, int* j, int x, int s, LoopKernel* lk) {
+    int i = *j, o = kernel_operand(cx, &i, x, s);
+    if (o >= 0) {
+        *j = i;
+        return o;
+    }
+    return kernel_const(cx, j, lk->elem, 0, &lk->k) ? VK_K : -1;
+}
+
+/* Recognize the loop whose pattern, iterable and body tokens are given */
+static int kernel_match(CompilerContext* cx, LoopKernel* lk, int pat_i, int pat_x, int pat_paren,
+                        int in_tok, int open, int close) {
+    int j = in_tok + 1, mut, src_mut, x, s = -1;
+    memset(lk, 0, sizeof(*lk));
+    if (tok_kw(&cx->tokens[in_tok]) != KW_IN || !(lk->dst = kernel_iterable(cx, &j, &mut))) return 0;
+    if (tok_is_punct(&cx->tokens[j], '.') && cx->tokens[j + 1].kind == TOK_IDENT
+            && strcmp(sym_name(cx, cx->tokens[j + 1].sym), "zip") == 0 && tok_is_punct(&cx->tokens[j + 2], '(')) {
+        int args_close = tok_match_close(cx, j + 2);
+        j += 3;
+        if (!(lk->src = kernel_iterable(cx, &j, &src_mut)) || j != args_close || src_mut) return 0;
+        j++;
+        if (!pat_paren || pat_i < 0 || pat_x < 0) return 0;
+        x = cx->tokens[pat_i].sym;
+        s = cx->tokens[pat_x].sym;
+    } else {
+        if (pat_paren || pat_x < 0) return 0;
+        x = cx->tokens[pat_x].sym;
+    }
+    if (j != open) return 0;
+    lk->elem = kernel_elem(lk->dst);
+    if (lk->src && kernel_elem(lk->src) != lk->elem) return 0;
+
+    int f32 = lk->elem == TYPE_F32, bits = const_bits(lk->elem);
+    const Token* t = &cx->tokens[open + 1];
+    j = open + 1;
+    if (!mut && !lk->src && tok_kw(t) == KW_IF) {
+        /* if *x == K { c += 1; } */
+        int o;
+        j++;
+        if ((o = kernel_operand(cx, &j, x, -1)) == VK_DST && tok_pair(cx, j, '=', '=')) {
+            j += 2;
+            if (!kernel_const(cx, &j, lk->elem, '{', &lk->k)) return 0;
+        } else {
+            j = open + 2;
+            if (!kernel_const(cx, &j, lk->elem, '=', &lk->k) || !tok_pair(cx, j, '=', '=')) return 0;
+            j += 2;
+            if (kernel_operand(cx, &j, x, -1) != VK_DST || !tok_is_punct(&cx->tokens[j], '{')) return 0;
+        }
+        const Token* one = &cx->tokens[j + 4];
+        t = &cx->tokens[j + 1];
+        if (t->kind != TOK_IDENT || !tok_pair(cx, j + 2, '+', '=') || one->kind != TOK_INT
+                || tok_end(cx, one) - tok_ptr(cx, one) != 1 || *tok_ptr(cx, one) != '1'
+                || !tok_is_punct(&cx->tokens[j + 5], ';') || !tok_is_punct(&cx->tokens[j + 6], '}') || j + 7 != close) {
+            return 0;
+        }
+        lk->kind = VK_COUNT;
+        lk->acc = var_lookup(cx, sym_name(cx, t->sym));
+        if (!lk->acc || lk->acc->type == TYPE_F32) return 0;
+    } else if (!mut && !lk->src && t->kind == TOK_IDENT && t->sym != x) {
+        /* s += *x, s = s + *x, either with an optional widening cast */
+        j++;
+        if (tok_pair(cx, j, '+', '=')) {
+            j += 2;
+        } else if (tok_is_punct(&cx->tokens[j], '=') && cx->tokens[j + 1].sym == t->sym
+                   && cx->tokens[j + 1].kind == TOK_IDENT && tok_is_punct(&cx->tokens[j + 2], '+')) {
+            j += 3;
+        } else {
+            return 0;
+        }
+        if (kernel_operand(cx, &j, x, -1) != VK_DST) return 0;
+        if (tok_kw(&cx->tokens[j]) == KW_AS && cx->tokens[j + 1].kind == TOK_IDENT) {
+            int to = const_type_of(cx, cx->tokens[j + 1].sym);
+            if (f32 || to < 0 || to == TYPE_BOOL || to == TYPE_CHAR || const_bits(to) != 32) return 0;
+            j += 2;
+        } else if (bits != 32) {
+            return 0;
+        }
+        if (!tok_is_punct(&cx->tokens[j], ';') || j + 1 != close) return 0;
+        lk->kind = VK_SUM;
+        lk->acc = var_lookup(cx, sym_name(cx, t->sym));
+        if (!lk->acc || (lk->acc->type == TYPE_F32) != f32) return 0;
+    } else if (mut && tok_is_punct(t, '*') && t[1].kind == TOK_IDENT && t[1].sym == x) {
+        /* *x = a [OP b] or *x OP= b */
+        j += 2;
+        lk->kind = VK_MAP;
+        if (tok_is_punct(&cx->tokens[j], '=') && !tok_is_punct(&cx->tokens[j + 1], '=')) {
+            j++;
+            if ((lk->a = kernel_map_operand(cx, &j, x, s, lk)) < 0) return 0;
+            t = &cx->tokens[j];
+            if (!tok_is_punct(t, ';')) {
+                lk->op = t->kind == TOK_PUNCT ? t->ch : 0;
+                j++;
+                if ((lk->b = kernel_map_operand(cx, &j, x, s, lk)) < 0) return 0;
+            }
+        } else if (cx->tokens[j].kind == TOK_PUNCT && tok_is_punct(&cx->tokens[j + 1], '=')
+                   && cx->tokens[j + 1].start == cx->tokens[j].start + 1) {
+            lk->op = cx->tokens[j].ch;
+            lk->a = VK_DST;
+            j += 2;
+            if ((lk->b = kernel_map_operand(cx, &j, x, s, lk)) < 0) return 0;
+        } else {
+            return 0;
+        }
+        if (!tok_is_punct(&cx->tokens[j], ';') || j + 1 != close) return 0;
+        if (lk->op && !strchr(f32 ? "+-*" : "+-&|^", lk->op)) return 0;
+        if ((lk->op == 0 && lk->a == VK_DST) || (lk->a == VK_K && lk->b == VK_K)) return 0;
+    } else {
+        return 0;
+    }
+    return lk->acc == NULL || (!lk->acc->reg && lk->acc->type != TYPE_SLICE && lk->acc->type != TYPE_ARRAY &&
+                               !type_wide(lk->acc->type));
+}
+
+/* One element of the kernel at 0(r3), and the source's at 0(r4), then
+ * both pointers on. r4 holds a sum or count instead when there is no
+ * source, r16 the constant, f1 an f32 sum and f2 an f32 constant. */
+static void kernel_scalar_step(CompilerContext* cx, const LoopKernel* lk) {
+    int size = const_bits(lk->elem) / 8, f32 = lk->elem == TYPE_F32;
+    const char* load = size == 1 ? "lbz" : size == 2 ? "lhz" : "lwz";
+    const char* store = size == 1 ? "stb" : size == 2 ? "sth" : "stw";
+
+    if (lk->kind == VK_SUM && f32) {
+        emit(cx, "    lfs f0, 0(r3)\n");
+        emit(cx, "    fadds f1, f1, f0\n");
+    } else if (lk->kind == VK_SUM) {
+        if (lk->elem == TYPE_I16) load = "lha";
+        emit(cx, "    %s r15, 0(r3)\n", load);
+        if (lk->elem == TYPE_I8) emit(cx, "    extsb r15, r15\n");
+        emit(cx, "    add r4, r4, r15\n");
+    } else if (lk->kind == VK_COUNT) {
+        /* equal is a zero difference: cntlzw gives 32, bit 5 set */
+        emit(cx, "    %s r15, 0(r3)\n", load);
+        if (f32 && !(lk->k & 0x7FFFFFFFu)) emit(cx, "    clrlwi r15, r15, 1   ; -0.0 == 0.0\n");
+        else emit(cx, "    xor r15, r15, r16\n");
+        emit(cx, "    cntlzw r15, r15\n");
+        emit(cx, "    srwi r15, r15, 5\n");
+        emit(cx, "    add r4, r4, r15\n");
+    } else if (f32 && lk->op) {
+        static const char* fregs[] = { "f0", "f3", "f2" };
+        if (lk->a == VK_DST || lk->b == VK_DST) emit(cx, "    lfs f0, 0(r3)\n");
+        if (lk->a == VK_SRC || lk->b == VK_SRC) emit(cx, "    lfs f3, 0(r4)\n");
+        emit(cx, "    %s f0, %s, %s\n", lk->op == '+' ? "fadds" : lk->op == '-' ? "fsubs" : "fmuls",
+             fregs[lk->a], fregs[lk->b]);
+        emit(cx, "    stfs f0, 0(r3)\n");
+    } else if (lk->op == 0) {
+        if (lk->a == VK_SRC) emit(cx, "    %s r15, 0(r4)\n", load);
+        emit(cx, "    %s r%d, 0(r3)\n", store, lk->a == VK_SRC ? 15 : 16);
+    } else {
+        /* the element in r15, the source's or the constant in r16 */
+        static const int gprs[] = { 15, 16, 16 };
+        const char* insn = lk->op == '+' ? "add" : lk->op == '-' ? "sub" : lk->op == '&' ? "and"
+                         : lk->op == '|' ? "or" : "xor";
+        if (lk->a == VK_DST || lk->b == VK_DST) emit(cx, "    %s r15, 0(r3)\n", load);
+        if (lk->a == VK_SRC || lk->b == VK_SRC) {
+            emit(cx, "    %s r%d, 0(r4)\n", load, lk->a == VK_DST || lk->b == VK_DST ? 16 : 15);
+        }
+        int ra = lk->a == VK_SRC && lk->b != VK_DST ? 15 : gprs[lk->a];
+        int rb = lk->b == VK_SRC && lk->a != VK_DST ? 15 : gprs[lk->b];
+        emit(cx, "    %s r15, r%d, r%d\n", insn, ra, rb);
+        emit(cx, "    %s r15, 0(r3)\n", store);
+    }
+    emit(cx, "    addi r3, r3, %d\n", size);
+    if (lk->src) emit(cx, "    addi r4, r4, %d\n", size);
+}
+
+/* Emit the kernel lk for the loop at stmt; the loop's header is the
+ * text between "for" and the body */
+static void kernel_emit(CompilerContext* cx, const LoopKernel* lk, Token* stmt, int open, int id) {
+    int size = const_bits(lk->elem) / 8, lanes = 16 / size, shift = exact_log2(lanes);
+    int f32 = lk->elem == TYPE_F32, is_signed = lk->elem == TYPE_I8 || lk->elem == TYPE_I16;
+    char lane = size == 1 ? 'b' : size == 2 ? 'h' : 'w';
+    int count = -1;   /* the trip count, when both lengths are fixed */
+    int use_ctr = !cx->ctr_busy, scratch = -1;
+    int nan = f32 && (lk->k & 0x7F800000u) == 0x7F800000u && (lk->k & 0x7FFFFFu);
+    int uses_k = lk->kind == VK_COUNT || (lk->kind == VK_MAP && (lk->a == VK_K || lk->b == VK_K));
+    int uses_src = lk->kind == VK_MAP && (lk->a == VK_SRC || lk->b == VK_SRC);
+    /* a fill or a copy only stores: b means nothing without an op */
+    int uses_dst = lk->kind != VK_MAP || lk->a == VK_DST || (lk->op && lk->b == VK_DST);
+    static const char* kinds[] = { "sum", "count", "map" };
+    const char* what = kinds[lk->kind];
+    const Token* last = &cx->tokens[open - 1];
+
+    if (lk->kind == VK_MAP && lk->op == 0) what = lk->a == VK_K ? "fill" : "copy";
+    if (lk->dst->type == TYPE_ARRAY && (!lk->src || lk->src->type == TYPE_ARRAY)) {
+        count = lk->dst->size / 4;
+        if (lk->src && lk->src->size / 4 < count) count = lk->src->size / 4;
+    }
+    int vector = target_altivec(&cx->opts) && cx->opts.opt_level >= 2 && (count < 0 || count >= 2 * lanes)
+                 && (!f32 || (lk->kind == VK_MAP && lk->op == 0) || cx->opts.fp_contract == FP_CONTRACT_FAST);
+
+    emit(cx, "    ; for ");
+    emit_raw(cx, tok_ptr(cx, stmt + 1), (size_t)(tok_end(cx, last) - tok_ptr(cx, stmt + 1)));
+    emit(cx, ": %s, %s\n", what, vector ? (size == 1 ? "16 lanes" : size == 2 ? "8 lanes" : "4 lanes") : "scalar");
+    if (nan) {
+        emit(cx, "    ; nothing compares equal to NaN\n");
+        return;
+    }
+
+    /* Pointers and the trip count */
+    if (lk->dst->type == TYPE_SLICE) {
+        emit(cx, "    lwz r3, %d(r1)   ; load %s (ptr)\n", lk->dst->offset, lk->dst->name);
+    } else {
+        emit(cx, "    la r3, %d(r1)   ; &%s, %d bytes\n", lk->dst->offset, lk->dst->name, lk->dst->size);
+    }
+    if (count >= 0) emit_li(cx, 14, count);
+    else if (lk->dst->type == TYPE_SLICE) emit(cx, "    lwz r14, %d(r1)   ; %s.len()\n", lk->dst->offset + 4, lk->dst->name);
+    else emit_li(cx, 14, lk->dst->size / 4);
+    if (lk->src) {
+        if (lk->src->type == TYPE_SLICE) {
+            emit(cx, "    lwz r4, %d(r1)   ; load %s (ptr)\n", lk->src->offset, lk->src->name);
+        } else {
+            emit(cx, "    la r4, %d(r1)   ; &%s, %d bytes\n", lk->src->offset, lk->src->name, lk->src->size);
+        }
+        if (count < 0) {
+            /* zip stops at the shorter one */
+            if (lk->src->type == TYPE_SLICE) emit(cx, "    lwz r15, %d(r1)   ; %s.len()\n", lk->src->offset + 4, lk->src->name);
+            else emit_li(cx, 15, lk->src->size / 4);
+            emit(cx, "    cmplw r15, r14\n");
+            emit(cx, "    bge Lvlen_%d\n", id);
+            emit(cx, "    mr r14, r15\n");
+            emit(cx, "Lvlen_%d:\n", id);
+        }
+    }
+
+    /* The accumulator, and the constant */
+    if (lk->kind == VK_SUM && f32) {
+        scratch = cx->stack_offset;
+        cx->stack_offset += 4;
+        emit_var_load(cx, 15, lk->acc, "");
+        emit(cx, "    stw r15, %d(r1)\n", scratch);
+        emit(cx, "    la r15, %d(r1)   ; &lanes, 4 bytes\n", scratch);
+        emit(cx, "    lfs f1, 0(r15)\n");
+    } else if (lk->acc) {
+        emit_var_load(cx, 4, lk->acc, "");
+    }
+    if (uses_k) emit_li(cx, 16, (int)lk->k);
+    if (uses_k && f32 && lk->kind == VK_MAP && lk->op) {
+        if (scratch < 0) {
+            scratch = cx->stack_offset;
+            cx->stack_offset += 4;
+        }
+        emit(cx, "    stw r16, %d(r1)\n", scratch);
+        emit(cx, "    la r15, %d(r1)   ; &lanes, 4 bytes\n", scratch);
+        emit(cx, "    lfs f2, 0(r15)\n");
+    }
+
+    if (vector) {
+        /* Scalar head until the destination is quadword aligned */
+        int kv = size == 1 ? (signed char)lk->k : size == 2 ? (short)lk->k : (int)lk->k;
+        if (scratch < 0 && (lk->kind != VK_MAP || (uses_k && (kv < -16 || kv > 15)))) {
+            scratch = cx->stack_offset;
+            cx->stack_offset += 4;
+        }
+        emit(cx, "Lvhead_%d:\n", id);
+        emit(cx, "    cmpwi r14, 0\n");
+        emit(cx, "    beq Lvdone_%d\n", id);
+        emit(cx, "    andi. r15, r3, 15\n");
+        emit(cx, "    beq Lvbody_%d\n", id);
+        kernel_scalar_step(cx, lk);
+        emit(cx, "    addi r14, r14, -1\n");
+        emit(cx, "    b Lvhead_%d\n", id);
+        emit(cx, "Lvbody_%d:\n", id);
+        emit(cx, "    cmplwi r14, %d\n", lanes);
+        emit(cx, "    blt Lvtail_%d\n", id);
+
+        /* v0-v7 are live: VRSAVE says so while the body runs */
+        emit(cx, "    mfspr r0, 256   ; VRSAVE\n");
+        emit(cx, "    oris r15, r0, 0xff00\n");
+        emit(cx, "    mtspr 256, r15\n");
+        if (uses_k && kv >= -16 && kv <= 15) {
+            emit(cx, "    vspltis%c v4, %d\n", lane, kv);
+        } else if (uses_k) {
+            /* through memory: lvewx lands the word in its own lane,
+             * vperm rotates it to lane 0 */
+            emit(cx, "    stw r16, %d(r1)\n", scratch);
+            emit(cx, "    la r15, %d(r1)   ; &lanes, 4 bytes\n", scratch);
+            emit(cx, "    lvewx v4, 0, r15\n");
+            emit(cx, "    lvsl v5, 0, r15\n");
+            emit(cx, "    vperm v4, v4, v4, v5\n");
+            emit(cx, "    vsplt%c v4, v4, %d\n", lane, size == 1 ? 3 : size == 2 ? 1 : 0);
+        }
+        if (lk->kind != VK_MAP) {
+            if (size < 4) emit(cx, "    vspltis%c v6, 1\n", lane);
+            emit(cx, "    vxor v7, v7, v7\n");
+        }
+        if (f32 && lk->op == '*') {
+            /* -0.0 in each lane: vmaddfp adds it to the product exactly */
+            emit(cx, "    vspltisw v5, -1\n");
+            emit(cx, "    vslw v5, v5, v5\n");
+        }
+        if (uses_src) emit(cx, "    lvsl v3, 0, r4\n");
+        if (use_ctr) {
+            emit(cx, "    srwi r15, r14, %d\n", shift);
+            emit(cx, "    mtctr r15\n");
+        }
+        if (uses_src) emit(cx, "    li r15, 15\n");
+
+        emit(cx, "Lvloop_%d:\n", id);
+        if (uses_dst) emit(cx, "    lvx v0, 0, r3\n");
+        if (uses_src) {
+            /* the two quadwords the source element run touches; at +15
+             * an aligned source loads the same one, never the next */
+            emit(cx, "    lvx v1, 0, r4\n");
+            emit(cx, "    lvx v2, r4, r15\n");
+            emit(cx, "    vperm v1, v1, v2, v3\n");
+        }
+        if (lk->kind == VK_SUM) {
+            if (f32) emit(cx, "    vaddfp v7, v7, v0\n");
+            else if (size == 4) emit(cx, "    vadduwm v7, v7, v0\n");
+            else emit(cx, "    %s v7, v0, v6, v7\n", size == 1 ? (is_signed ? "vmsummbm" : "vmsumubm")
+                                                          : (is_signed ? "vmsumshm" : "vmsumuhm"));
+        } else if (lk->kind == VK_COUNT) {
+            /* equal lanes are all ones: -1 per word lane, or 1 per
+             * narrower lane once masked and summed into words */
+            if (f32) emit(cx, "    vcmpeqfp v0, v0, v4\n");
+            else emit(cx, "    vcmpequ%c v0, v0, v4\n", lane);
+            if (size == 4) {
+                emit(cx, "    vsubuwm v7, v7, v0\n");
+            } else {
+                emit(cx, "    vand v0, v0, v6\n");
+                emit(cx, "    vmsumu%cm v7, v0, v6, v7\n", lane);
+            }
+        } else {
+            static const char* vregs[] = { "v0", "v1", "v4" };
+            int result = 0;
+            if (lk->op == 0) {
+                result = lk->a == VK_SRC ? 1 : 4;
+            } else if (f32) {
+                if (lk->op == '*') emit(cx, "    vmaddfp v0, %s, %s, v5\n", vregs[lk->a], vregs[lk->b]);
+                else emit(cx, "    %s v0, %s, %s\n", lk->op == '+' ? "vaddfp" : "vsubfp", vregs[lk->a], vregs[lk->b]);
+            } else if (lk->op == '+' || lk->op == '-') {
+                emit(cx, "    %s%cm v0, %s, %s\n", lk->op == '+' ? "vaddu" : "vsubu", lane, vregs[lk->a], vregs[lk->b]);
+            } else {
+                emit(cx, "    %s v0, %s, %s\n", lk->op == '&' ? "vand" : lk->op == '|' ? "vor" : "vxor",
+                     vregs[lk->a], vregs[lk->b]);
+            }
+            emit(cx, "    stvx v%d, 0, r3\n", result);
+        }
+        emit(cx, "    addi r3, r3, 16\n");
+        if (lk->src) emit(cx, "    addi r4, r4, 16\n");
+        if (use_ctr) {
+            emit(cx, "    bdnz Lvloop_%d\n", id);
+            emit(cx, "    clrlwi r14, r14, %d\n", 32 - shift);
+        } else {
+            emit(cx, "    addi r14, r14, %d\n", -lanes);
+            emit(cx, "    cmplwi r14, %d\n", lanes);
+            emit(cx, "    bge Lvloop_%d\n", id);
+        }
+        if (lk->kind != VK_MAP) {
+            /* fold the word lanes: every lane ends up holding the total */
+            int fsum = f32 && lk->kind == VK_SUM;
+            const char* add = fsum ? "vaddfp" : "vadduwm";
+            emit(cx, "    vsldoi v5, v7, v7, 8\n");
+            emit(cx, "    %s v7, v7, v5\n", add);
+            emit(cx, "    vsldoi v5, v7, v7, 4\n");
+            emit(cx, "    %s v7, v7, v5\n", add);
+            emit(cx, "    la r15, %d(r1)   ; &lanes, 4 bytes\n", scratch);
+            emit(cx, "    stvewx v7, 0, r15\n");
+            if (fsum) {
+                emit(cx, "    lfs f0, 0(r15)\n");
+                emit(cx, "    fadds f1, f1, f0\n");
+            } else {
+                emit(cx, "    lwz r15, 0(r15)\n");
+                emit(cx, "    add r4, r4, r15\n");
+            }
+        }
+        emit(cx, "    mtspr 256, r0\n");
+    }
+
+    /* Scalar tail: the whole loop without AltiVec */
+    emit(cx, "Lvtail_%d:\n", id);
+    emit(cx, "    cmpwi r14, 0\n");
+    emit(cx, "    beq Lvdone_%d\n", id);
+    if (use_ctr) emit(cx, "    mtctr r14\n");
+    emit(cx, "Lvscalar_%d:\n", id);
+    kernel_scalar_step(cx, lk);
+    if (use_ctr) {
+        emit(cx, "    bdnz Lvscalar_%d\n", id);
+    } else {
+        emit(cx, "    addi r14, r14, -1\n");
+        emit(cx, "    cmpwi r14, 0\n");
+        emit(cx, "    bne Lvscalar_%d\n", id);
+    }
+    emit(cx, "Lvdone_%d:\n", id);
+    if (lk->kind == VK_SUM && f32) {
+        emit(cx, "    la r15, %d(r1)   ; &lanes, 4 bytes\n", scratch);
+        emit(cx, "    stfs f1, 0(r15)\n");
+        emit(cx, "    lwz r4, 0(r15)\n");
+    }
+    if (lk->acc) emit(cx, "    stw r4, %d(r1)   ; %s\n", lk->acc->offset, lk->acc->name);
+}
+
+/* for PAT in ITER { ... } with stmt at "for".
+ *
+ * Ranges (a..b, a..=b, with .rev() and a constant .step_by(n) in either
+ * order) and arrays (arr, &arr, arr.iter(), arr.iter().enumerate())
+ * become counted loops: the trip count is computed once, the loop
+ * variable steps by a constant and the loop closes with bdnz. A body
+ * that calls nothing keeps the loop variables in volatile registers
+ * from r12 down; CTR goes to the innermost such loop, an outer one
+ * counts in a register. Bodies with calls keep everything in stack
+ * slots (opt-level 2 promotes them) and count with a compare. */
+static void compile_for_loop(CompilerContext* cx, Token* stmt, int frame_size) {
+    int my_label = cx->labels.for_label++;
+    int i = (int)(stmt - cx->tokens) + 1;
+    int mark = cx->var_count;
+    int pat_i = -1, pat_x = -1, pat_paren = 0;
+    int k, open, close, in_tok;
+
+    /* Pattern: x, _, &x, (i, x), (i, &x) */
+    if (tok_is_punct(&cx->tokens[i], '(')) {
+        pat_paren = 1;
+        i++;
+        if (cx->tokens[i].kind == TOK_IDENT) pat_i = i++;
+        if (tok_is_punct(&cx->tokens[i], ',')) i++;
+        if (tok_is_punct(&cx->tokens[i], '&')) i++;
+        if (cx->tokens[i].kind == TOK_IDENT) pat_x = i++;
+        if (tok_is_punct(&cx->tokens[i], ')')) i++;
+    } else {
+        if (tok_is_punct(&cx->tokens[i], '&')) i++;
+        if (cx->tokens[i].kind == TOK_IDENT) pat_x = i++;
+    }
+    in_tok = i;
+    for (open = i; open < cx->tok_count && !tok_is_punct(&cx->tokens[open], '{'); open++) {
+        if (tok_is_punct(&cx->tokens[open], '(') || tok_is_punct(&cx->tokens[open], '[')) {
+            open = tok_match_close(cx, open);
+        }
+    }
+    close = tok_match_close(cx, open);
+
+    /* Element-wise idioms over slices become kernels; over arrays only
+     * where this loop could not do them or AltiVec can */
+    LoopKernel lk;
+    if (kernel_match(cx, &lk, pat_i, pat_x, pat_paren, in_tok, open, close)
+            && (lk.dst->type == TYPE_SLICE || lk.src || lk.kind == VK_MAP
+                || (target_altivec(&cx->opts) && cx->opts.opt_level >= 2 && lk.dst->size >= 32))) {
+        kernel_emit(cx, &lk, stmt, open, my_label);
+        cx->pos = tok_end(cx, &cx->tokens[close]);
+        return;
+    }
+
+    /* Classify the iterable */
+    int is_range = 0, is_array = 0, inclusive = 0, rev = 0, step = 1, step_first = 0, enumerate = 0;
+    int start_tok = -1, end_tok = -1, array_count = 0;
+    Variable* array = NULL;
+    i = in_tok + 1;
+    if (tok_kw(&cx->tokens[in_tok]) == KW_IN) {
+        int paren = tok_is_punct(&cx->tokens[i], '(');
+        int j = paren ? i + 1 : i, stop = paren ? tok_match_close(cx, i) : open;
+        for (k = j; k < stop; k++) {
+            if (tok_is_punct(&cx->tokens[k], '(') || tok_is_punct(&cx->tokens[k], '[')) k = tok_match_close(cx, k);
+            else if (tok_dotdot(cx, k)) break;
+        }
+        if (k < stop && k > j) {
+            is_range = 1;
+            start_tok = j;
+            end_tok = k + 2;
+            if (tok_is_punct(&cx->tokens[end_tok], '=')) {
+                inclusive = 1;
+                end_tok++;
+            }
+            if (end_tok >= stop) is_range = 0;   /* a.. has no end */
+            i = paren ? stop + 1 : open;
+            if (!paren && !pat_paren && pat_x >= 0) {
+                /* bare a..b: nothing may follow */
+            }
+        } else if (!paren) {
+            j = i;
+            if (tok_is_punct(&cx->tokens[j], '&')) j++;
+            Variable* v = cx->tokens[j].kind == TOK_IDENT ? var_lookup(cx, sym_name(cx, cx->tokens[j].sym)) : NULL;
+            if (v && v->type == TYPE_ARRAY && v->size >= 4 && !v->reg) {
+                is_array = 1;
+                array = v;
+                array_count = v->size / 4;
+                i = j + 1;
+            } else if (v && v->type == TYPE_SLICE && !v->reg) {
+                is_array = 1;   /* counted from its length word */
+                array = v;
+                i = j + 1;
+            }
+        }
+        /* Adapters: .rev(), .step_by(n), .iter(), .enumerate() */
+        while ((is_range || is_array) && i + 3 < open && tok_is_punct(&cx->tokens[i], '.')
+               && cx->tokens[i + 1].kind == TOK_IDENT && tok_is_punct(&cx->tokens[i + 2], '(')) {
+            const char* name = sym_name(cx, cx->tokens[i + 1].sym);
+            int args_close = tok_match_close(cx, i + 2);
+            long long value;
+            if (is_range && strcmp(name, "rev") == 0 && args_close == i + 3 && !rev) {
+                rev = 1;
+            } else if (is_range && strcmp(name, "step_by") == 0 && step == 1) {
+                cx->pos = tok_ptr(cx, &cx->tokens[i + 3]);
+                if (!const_expr_at(cx, CPREC_OR, 0, ')', &value, NULL) || value < 1 || value > 0x7FFF) {
+                    is_range = 0;
+                    break;
+                }
+                step = (int)value;
+                step_first = !rev;
+            } else if (is_array && (strcmp(name, "iter") == 0 || strcmp(name, "into_iter") == 0)
+                       && args_close == i + 3 && !enumerate) {
+                /* elements by value either way */
+            } else if (is_array && strcmp(name, "enumerate") == 0 && args_close == i + 3) {
+                enumerate = 1;
+            } else {
+                is_range = is_array = 0;
+                break;
+            }
+            i = args_close + 1;
+        }
+        if (i != open || (pat_paren && !enumerate) || (enumerate && !pat_paren)) is_range = is_array = 0;
+    }
+
+    if (!is_range && !is_array) {
+        /* Anything else: the old open-ended walk */
+        char iter_var[64] = {0};
+        if (pat_x >= 0) snprintf(iter_var, sizeof(iter_var), "%s", sym_name(cx, cx->tokens[pat_x].sym));
+        emit(cx, "    ; for %s in 0..0\n", iter_var);
+        emit_li(cx, 14, 0);
+        emit(cx, "    stw r14, %d(r1)   ; %s = %d\n", cx->stack_offset, iter_var, 0);
+        cx->vars[cx->var_count].offset = cx->stack_offset;
+        cx->vars[cx->var_count].type = TYPE_I32;
+        cx->vars[cx->var_count].size = 4;
+        var_declare(cx, iter_var);
+        cx->stack_offset += 4;
+        emit(cx, "Lfor_%d:\n", my_label);
+        cx->pos = tok_ptr(cx, &cx->tokens[open]) + 1;
+        compile_function_body(cx, frame_size);
+        if (*cx->pos == '}') cx->pos++;
+        emit(cx, "    b Lfor_%d\n", my_label);
+        emit(cx, "Lendfor_%d:\n", my_label);
+        return;
+    }
+
+    int is_slice = is_array && array->type == TYPE_SLICE;
+    int elem_size = is_slice ? const_bits(array->elem) / 8 : 4;
+    int nested_for, calls = loop_body_calls(cx, open, close, &nested_for);
+    int use_ctr = !calls && !nested_for && !cx->ctr_busy;
+    int homes = (is_range ? 1 : 2 * (pat_x >= 0) + (enumerate && pat_i >= 0)) + !use_ctr;
+    int in_regs = !calls && 12 - cx->loop_regs - homes >= 4;   /* r3/r4 stay free */
+    int next_reg = 12 - cx->loop_regs, used = 0;
+    int iv_reg = 0, x_reg = 0, idx_reg = 0, ptr_reg = 0, cnt_reg = 0;
+    int iv_off = -1, x_off = -1, idx_off = -1, ptr_off = -1, cnt_off = -1;
+    int iv_named = is_range ? pat_x : -1;
+    char header[96];
+
+    const Token* last = &cx->tokens[open - 1];
+    snprintf(header, sizeof(header), "%.*s", (int)(tok_end(cx, last) - tok_ptr(cx, stmt + 1)), tok_ptr(cx, stmt + 1));
+    emit(cx, "    ; for %s\n", header);
+
+    /* Homes: a register from r12 down, or a fresh slot */
+    #define LOOP_HOME(r, o) do { \
+        if (in_regs) { \
+            r = next_reg--; \
+            used++; \
+        } else { \
+            o = cx->stack_offset; \
+            cx->stack_offset += 4; \
+        } \
+    } while (0)
+
+    if (is_range) {
+        int is_unsigned;
+        LOOP_HOME(iv_reg, iv_off);
+        if (!use_ctr) LOOP_HOME(cnt_reg, cnt_off);
+
+        /* start in X (the IV register, or r16), end in r14, count in r15 */
+        int x = iv_reg ? iv_reg : 16;
+        long long lo, hi;
+        cx->pos = tok_ptr(cx, &cx->tokens[start_tok]);
+        int const_lo = const_expr_at(cx, CPREC_BITOR, 0, 0, &lo, NULL);
+        cx->pos = tok_ptr(cx, &cx->tokens[end_tok]);
+        if (const_lo && const_expr_at(cx, CPREC_BITOR, 0, 0, &hi, NULL)) {
+            /* Both bounds known: the first value and the trip count are too */
+            long long count = hi - lo + inclusive;
+            if (count > 0) count = (count + step - 1) / step;
+            if (count <= 0) {
+                emit(cx, "    b Lendfor_%d\n", my_label);
+                count = 1;
+            }
+            emit_li(cx, x, (int)(!rev ? lo : step_first ? lo + (count - 1) * step : hi - !inclusive));
+            emit_li(cx, 15, (int)count);
+        } else {
+            RustType st = emit_range_bound(cx, start_tok, x);
+            RustType et = emit_range_bound(cx, end_tok, 14);
+            is_unsigned = const_unsigned(st) && const_unsigned(et);
+            emit(cx, "    %s r%d, r14\n", is_unsigned ? "cmplw" : "cmpw", x);
+            emit(cx, "    %s Lendfor_%d\n", inclusive ? "bgt" : "bge", my_label);
+            emit(cx, "    sub r15, r14, r%d\n", x);
+            if (rev && !step_first) {
+                if (inclusive) emit(cx, "    mr r%d, r14\n", x);
+                else emit(cx, "    addi r%d, r14, -1\n", x);
+            }
+            if (step > 1) {
+                if (!inclusive) emit(cx, "    addi r15, r15, %d\n", step - 1);
+                emit_div_const(cx, 15, 15, 14, step, 1);
+            }
+            if (inclusive) emit(cx, "    addi r15, r15, 1\n");
+            if (rev && step_first) {
+                /* the last element of the stepped range */
+                emit(cx, "    addi r14, r15, -1\n");
+                emit_mul_const(cx, 14, 0, step);
+                emit(cx, "    add r%d, r%d, r14\n", x, x);
+            }
+        }
+        if (!iv_reg) emit(cx, "    stw r16, %d(r1)   ; %s\n", iv_off,
+                          iv_named >= 0 ? sym_name(cx, cx->tokens[iv_named].sym) : "_");
+    } else {
+        if (pat_x >= 0) LOOP_HOME(x_reg, x_off);
+        if (enumerate && pat_i >= 0) LOOP_HOME(idx_reg, idx_off);
+        if (pat_x >= 0) LOOP_HOME(ptr_reg, ptr_off);
+        if (!use_ctr) LOOP_HOME(cnt_reg, cnt_off);
+        if (pat_x >= 0) {
+            /* one below the first element, for lwzu */
+            int p = ptr_reg ? ptr_reg : 14;
+            if (is_slice) emit(cx, "    lwz r%d, %d(r1)   ; load %s (ptr)\n", p, array->offset, array->name);
+            else emit(cx, "    la r%d, %d(r1)   ; &%s, %d bytes\n", p, array->offset, array->name, array->size);
+            emit(cx, "    addi r%d, r%d, %d\n", p, p, -elem_size);
+            if (!ptr_reg) emit(cx, "    stw r14, %d(r1)\n", ptr_off);
+        }
+        if (idx_reg) emit(cx, "    li r%d, 0\n", idx_reg);
+        if (idx_off >= 0) {
+            emit(cx, "    li r14, 0\n");
+            emit(cx, "    stw r14, %d(r1)   ; %s\n", idx_off, sym_name(cx, cx->tokens[pat_i].sym));
+        }
+        if (is_slice) {
+            emit(cx, "    lwz r15, %d(r1)   ; %s.len()\n", array->offset + 4, array->name);
+            emit(cx, "    cmpwi r15, 0\n");
+            emit(cx, "    beq Lendfor_%d\n", my_label);
+        } else {
+            emit_li(cx, 15, array_count);
+        }
+    }
+    if (use_ctr) emit(cx, "    mtctr r15\n");
+    else if (cnt_reg) emit(cx, "    mr r%d, r15\n", cnt_reg);
+    else emit(cx, "    stw r15, %d(r1)   ; trip count\n", cnt_off);
+    #undef LOOP_HOME
+
+    /* Bindings */
+    if (is_range && iv_named >= 0) loop_bind(cx, iv_named, iv_reg, iv_off);
+    if (is_array && pat_x >= 0) {
+        loop_bind(cx, pat_x, x_reg, x_off);
+        if (is_slice) cx->vars[cx->var_count - 1].type = array->elem;
+    }
+    if (enumerate && pat_i >= 0) loop_bind(cx, pat_i, idx_reg, idx_off);
+
+    emit(cx, "Lfor_%d:\n", my_label);
+    if (is_array && pat_x >= 0) {
+        /* slices load their element width, extended the way it is typed */
+        RustType et = is_slice ? array->elem : TYPE_I32;
+        const char* load = elem_size == 1 ? "lbzu" : elem_size == 2 ? (et == TYPE_I16 ? "lhau" : "lhzu") : "lwzu";
+        int x = x_reg && ptr_reg ? x_reg : 15;
+        if (!(x_reg && ptr_reg)) emit(cx, "    lwz r14, %d(r1)\n", ptr_off);
+        emit(cx, "    %s r%d, %d(r%d)\n", load, x, elem_size, x_reg && ptr_reg ? ptr_reg : 14);
+        if (et == TYPE_I8) emit(cx, "    extsb r%d, r%d\n", x, x);
+        if (!(x_reg && ptr_reg)) {
+            emit(cx, "    stw r14, %d(r1)\n", ptr_off);
+            emit(cx, "    stw r15, %d(r1)   ; %s\n", x_off, sym_name(cx, cx->tokens[pat_x].sym));
+        }
+    }
+
+    /* Body */
+    int saved_regs = cx->loop_regs, saved_ctr = cx->ctr_busy;
+    cx->loop_regs += used;
+    if (use_ctr) cx->ctr_busy = 1;
+    cx->pos = tok_ptr(cx, &cx->tokens[open]) + 1;
+    compile_function_body(cx, frame_size);
+    if (*cx->pos == '}') cx->pos++;
+    cx->loop_regs = saved_regs;
+    cx->ctr_busy = saved_ctr;
+
+    /* Step */
+    int delta = rev ? -step : step;
+    if (is_range && iv_reg) {
+        emit(cx, "    addi r%d, r%d, %d\n", iv_reg, iv_reg, delta);
+    } else if (is_range) {
+        emit(cx, "    lwz r14, %d(r1)\n", iv_off);
+        emit(cx, "    addi r14, r14, %d\n", delta);
+        emit(cx, "    stw r14, %d(r1)\n", iv_off);
+    }
+    if (idx_reg) {
+        emit(cx, "    addi r%d, r%d, 1\n", idx_reg, idx_reg);
+    } else if (idx_off >= 0) {
+        emit(cx, "    lwz r14, %d(r1)\n", idx_off);
+        emit(cx, "    addi r14, r14, 1\n");
+        emit(cx, "    stw r14, %d(r1)\n", idx_off);
+    }
+    if (use_ctr) {
+        emit(cx, "    bdnz Lfor_%d\n", my_label);
+    } else if (cnt_reg) {
+        emit(cx, "    addi r%d, r%d, -1\n", cnt_reg, cnt_reg);
+        emit(cx, "    cmpwi r%d, 0\n", cnt_reg);
+        emit(cx, "    bne Lfor_%d\n", my_label);
+    } else {
+        emit(cx, "    lwz r14, %d(r1)\n", cnt_off);
+        emit(cx, "    addi r14, r14, -1\n");
+        emit(cx, "    stw r14, %d(r1)\n", cnt_off);
+        emit(cx, "    cmpwi r14, 0\n");
+        emit(cx, "    bne Lfor_%d\n", my_label);
+    }
+    emit(cx, "Lendfor_%d:\n", my_label);
+    scope_pop(cx, mark);
+}
+
+/* Element types of the slice parameters of the free fn named name;
+ * all -1 when it is unknown or takes none */
+static void call_param_slices(CompilerContext* cx, const char* name, int* elems, int max) {
+    int sym = sym_find(cx, name, strlen(name)), k;
+    const Function* fn = sym >= 0 && cx->sym_entries[sym].free_fn >= 0
+                       ? &cx->functions[cx->sym_entries[sym].free_fn] : NULL;
+    for (k = 0; k < max; k++) elems[k] = -1;
+    if (fn && fn->param_count <= max) fn_param_slices(cx, fn, elems);
+}
+
+/* Compile statements inside a function body.
+ * pos must point just after the opening '{'.
+ * Emits PPC assembly for all statements until matching '}'.
+ * frame_size is used for proper epilogue generation. */
+void compile_function_body(CompilerContext* cx, int frame_size) {
+    int brace_depth = 1;
+    int saved_var_count = cx->var_count;
+    int saved_stack_offset = cx->stack_offset;
+    int block_marks[64];      /* var_count at each open bare or unsafe block */
+    int i;
+    int iter_limit = 100000;  /* Safety: prevent infinite loops */
+
+    cx->block_depth++;
+    while (*cx->pos && brace_depth > 0 && --iter_limit > 0) {
+        /* Statements start on a token boundary; comments are already gone */
+        Token* stmt = tok_at(cx, cx->pos);
+        cx->pos = tok_ptr(cx, stmt);
+        if (stmt->kind == TOK_EOF) break;
+
+        /* A bare { ... } or unsafe { ... } is a scope of its own: its
+         * bindings are dropped and unshadowed at the '}' */
+        if (tok_is_punct(stmt, '{')) {
+            if (brace_depth < 64) block_marks[brace_depth] = cx->var_count;
+            brace_depth++;
+            cx->pos++;
+            continue;
+        } else if (tok_is_punct(stmt, '}')) {
+            brace_depth--;
+            if (brace_depth <= 0) break;
+            if (brace_depth < 64) {
+                for (i = cx->var_count - 1; i >= block_marks[brace_depth]; i--) {
+                    emit_drop_glue(cx, &cx->vars[i]);
+                }
+                scope_pop(cx, block_marks[brace_depth]);
+            }
+            cx->pos++;
+            continue;
+        }
+        int kw = tok_kw(stmt);
+
+        if (kw == KW_LET) {
+            cx->pos = tok_end(cx, stmt);
+            skip_whitespace(cx);
+
+            int is_mut = 0;
+            if (strncmp(cx->pos, "mut ", 4) == 0) {
+                is_mut = 1;
+                cx->pos += 4;
+                skip_whitespace(cx);
+            }
+
+            /* Pattern: _ (discard) */
+            if (*cx->pos == '_' && (*(cx->pos+1) == ' ' || *(cx->pos+1) == ':' || *(cx->pos+1) == '=')) {
+                /* Discard binding */
+                while (*cx->pos && *cx->pos != ';') cx->pos++;
+                if (*cx->pos == ';') cx->pos++;
+                continue;
+            }
+
+            char var_name[64] = {0};
+            parse_string(cx, var_name, sizeof(var_name));
+
+            skip_whitespace(cx);
+
+            /* Type annotation */
+            RustType var_type = TYPE_I32;
+            int typed = 0;
+            if (*cx->pos == ':') {
+                cx->pos++;
+                skip_whitespace(cx);
+                var_type = parse_type(cx);
+                typed = 1;
+            }
+
+            skip_whitespace(cx);
+            if (*cx->pos == '=') {
+                cx->pos++;
+                skip_whitespace(cx);
+
+                long long cval;
+                RustType ctype;
+                int wide = wide_expr_at(cx, 14, 0);
+                int ft = float_expr_at(cx, 0);
+
+                /* Handle all initialization patterns */
+                if (ft >= 0 || (typed && type_float(var_type))) {
+                    /* f32/f64 arithmetic in the FPRs; an f64 slot is doubleword aligned */
+                    if (typed && type_float(var_type)) ft = var_type;
+                    if (ft == TYPE_F64) cx->stack_offset = (cx->stack_offset + 7) & ~7;
+                    float_expr(cx, 1, 14, (RustType)ft);
+                    float_store(cx, 1, cx->stack_offset, (RustType)ft, var_name, "");
+                    cx->vars[cx->var_count].type = (RustType)ft;
+                    cx->vars[cx->var_count].size = ft == TYPE_F64 ? 8 : 4;
+
+                } else if (wide > 0 || (wide == 0 && type_wide(var_type))) {
+                    /* 64-bit arithmetic, or a 64-bit value narrowed */
+                    RustType t = compile_expr64(cx, 14);
+                    if (!typed) var_type = t;
+                    wide_store(cx, cx->stack_offset, var_type, var_name, "");
+                    cx->vars[cx->var_count].type = var_type;
+                    cx->vars[cx->var_count].size = type_wide(var_type) ? 8 : 4;
+
+                } else if (const_expr_at(cx, CPREC_OR, 0, ';', &cval, &ctype)) {
+                    /* Compile-time constant: one immediate */
+                    emit_li(cx, 14, (int)cval);
+                    if (ctype == TYPE_BOOL) {
+                        emit(cx, "    stw r14, %d(r1)   ; %s = %s\n", cx->stack_offset, var_name, cval ? "true" : "false");
+                    } else {
+                        emit(cx, "    stw r14, %d(r1)   ; %s\n", cx->stack_offset, var_name);
+                    }
+                    cx->vars[cx->var_count].type = (ctype == TYPE_BOOL) ? TYPE_BOOL : var_type;
+                    cx->vars[cx->var_count].size = 4;
+
+                } else if (strncmp(cx->pos, "Box::new(", 9) == 0) {
+                    cx->pos += 9;
+                    int value = parse_number(cx);
+                    emit(cx, "    ; %s = Box::new(%d)\n", var_name, value);
+                    emit(cx, "    li r3, 4\n");
+                    emit(cx, "    bl _alloc_box\n");
+                    emit_li(cx, 4, value);
+                    emit(cx, "    stw r4, 0(r3)\n");
+                    emit(cx, "    stw r3, %d(r1)\n", cx->stack_offset);
+                    cx->vars[cx->var_count].type = TYPE_BOX;
+
+                } else if (strncmp(cx->pos, "Rc::new(", 8) == 0) {
+                    cx->pos += 8;
+                    int value = parse_number(cx);
+                    emit(cx, "    ; %s = Rc::new(%d)\n", var_name, value);
+                    emit(cx, "    li r3, 8\n");
+                    emit(cx, "    bl _alloc_rc\n");
+                    emit(cx, "    li r4, 1\n");
+                    emit(cx, "    stw r4, 0(r3)     ; refcount = 1\n");
+                    emit_li(cx, 4, value);
+                    emit(cx, "    stw r4, 4(r3)\n");
+                    emit(cx, "    stw r3, %d(r1)\n", cx->stack_offset);
+                    cx->vars[cx->var_count].type = TYPE_RC;
+                    cx->vars[cx->var_count].ref_count = 1;
+
+                } else if (strncmp(cx->pos, "Arc::new(", 9) == 0) {
+                    cx->pos += 9;
+                    int value = parse_number(cx);
+                    emit(cx, "    ; %s = Arc::new(%d)\n", var_name, value);
+                    emit(cx, "    li r3, 8\n");
+                    emit(cx, "    bl _alloc_arc\n");
+                    emit(cx, "    li r4, 1\n");
+                    emit(cx, "    stw r4, 0(r3)     ; atomic refcount = 1\n");
+                    emit_li(cx, 4, value);
+                    emit(cx, "    stw r4, 4(r3)\n");
+                    emit(cx, "    stw r3, %d(r1)\n", cx->stack_offset);
+                    cx->vars[cx->var_count].type = TYPE_ARC;
+                    cx->vars[cx->var_count].ref_count = 1;
+
+                } else if (strncmp(cx->pos, "vec![", 5) == 0) {
+                    cx->pos += 5;
+                    skip_whitespace(cx);
+                    emit(cx, "    ; %s = vec![...]\n", var_name);
+                    emit(cx, "    bl _vec_new\n");
+                    /* Check for vec![value; count] repeat syntax */
+                    int vec_repeat = 0;
+                    if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+                        char* save_pos = cx->pos;
+                        int first_val = parse_number(cx);
+                        skip_whitespace(cx);
+                        if (*cx->pos == ';') {
+                            cx->pos++; /* past ';' */
+                            skip_whitespace(cx);
+                            /* count could be a variable or literal */
+                            int count = 0;
+                            if (isdigit(*cx->pos)) {
+                                count = parse_number(cx);
+                            } else {
+                                /* Variable count - skip it, emit runtime-sized vec */
+                                while (*cx->pos && *cx->pos != ']') cx->pos++;
+                                count = 0; /* runtime-determined */
+                            }
+                            if (count > 0 && count <= 256) {
+                                for (int vi = 0; vi < count; vi++) {
+                                    emit(cx, "    mr r16, r3\n");
+                                    emit_li(cx, 4, first_val);
+                                    emit(cx, "    bl _vec_push\n");
+                                    emit(cx, "    mr r3, r16\n");
+                                }
+                            }
+                            vec_repeat = 1;
+                        } else {
+                            cx->pos = save_pos; /* rewind, not a repeat */
+                        }
+                    }
+                    if (!vec_repeat) {
+                        while (*cx->pos && *cx->pos != ']') {
+                            skip_whitespace(cx);
+                            if (*cx->pos == ']') break;
+                            if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+                                int value = parse_number(cx);
+                                emit(cx, "    mr r16, r3\n");
+                                emit_li(cx, 4, value);
+                                emit(cx, "    bl _vec_push\n");
+                                emit(cx, "    mr r3, r16\n");
+                            } else {
+                                /* Non-numeric element (variable, expr) - skip */
+                                while (*cx->pos && *cx->pos != ',' && *cx->pos != ']') cx->pos++;
+                            }
+                            skip_whitespace(cx);
+                            if (*cx->pos == ',') cx->pos++;
+                        }
+                    }
+                    while (*cx->pos && *cx->pos != ']') cx->pos++;
+                    if (*cx->pos == ']') cx->pos++;
+                    emit(cx, "    stw r3, %d(r1)\n", cx->stack_offset);
+                    emit(cx, "    lwz r4, 4(r3)\n");
+                    emit(cx, "    stw r4, %d(r1)\n", cx->stack_offset + 4);
+                    emit(cx, "    lwz r4, 8(r3)\n");
+                    emit(cx, "    stw r4, %d(r1)\n", cx->stack_offset + 8);
+                    cx->vars[cx->var_count].type = TYPE_VEC;
+                    cx->vars[cx->var_count].size = 12;
+
+                } else if (strncmp(cx->pos, "String::from(", 13) == 0) {
+                    cx->pos += 13;
+                    emit(cx, "    ; %s = String::from(...)\n", var_name);
+                    /* Parse string arg */
+                    if (*cx->pos == '"') {
+                        cx->pos++;
+                        char sbuf[512] = {0};
+                        int si = 0;
+                        while (*cx->pos && *cx->pos != '"' && si < 511) {
+                            if (*cx->pos == '\\') cx->pos++;
+                            sbuf[si++] = *cx->pos++;
+                        }
+                        if (*cx->pos == '"') cx->pos++;
+                        emit(cx, "    .section __DATA,__cstring\n");
+                        emit(cx, "L_str_%d:\n", cx->string_label_count);
+                        emit_asciz(cx, sbuf);
+                        emit(cx, "    .text\n");
+                        cx->string_label_count++;
+                        emit_li(cx, 3, si + 1);
+                        emit(cx, "    bl L_malloc$stub\n");
+                        emit(cx, "    stw r3, %d(r1)    ; String ptr\n", cx->stack_offset);
+                        emit_li(cx, 4, si);
+                        emit(cx, "    stw r4, %d(r1)    ; String len\n", cx->stack_offset + 4);
+                        emit_li(cx, 4, si + 1);
+                        emit(cx, "    stw r4, %d(r1)    ; String cap\n", cx->stack_offset + 8);
+                    }
+                    while (*cx->pos && *cx->pos != ')') cx->pos++;
+                    if (*cx->pos == ')') cx->pos++;
+                    cx->vars[cx->var_count].type = TYPE_STRING;
+                    cx->vars[cx->var_count].size = 12;
+
+                } else if (strncmp(cx->pos, "Some(", 5) == 0) {
+                    cx->pos += 5;
+                    int value = parse_number(cx);
+                    emit(cx, "    ; %s = Some(%d)\n", var_name, value);
+                    emit(cx, "    li r14, 1         ; tag = Some\n");
+                    emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset);
+                    emit_li(cx, 14, value);
+                    emit(cx, "    stw r14, %d(r1)   ; value\n", cx->stack_offset + 4);
+                    cx->vars[cx->var_count].type = TYPE_OPTION;
+                    cx->vars[cx->var_count].size = 8;
+
+                } else if (strncmp(cx->pos, "None", 4) == 0 && !isalnum(*(cx->pos+4))) {
+                    cx->pos += 4;
+                    emit(cx, "    ; %s = None\n", var_name);
+                    emit(cx, "    li r14, 0         ; tag = None\n");
+                    emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset);
+                    emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset + 4);
+                    cx->vars[cx->var_count].type = TYPE_OPTION;
+                    cx->vars[cx->var_count].size = 8;
+
+                } else if (strncmp(cx->pos, "Ok(", 3) == 0) {
+                    cx->pos += 3;
+                    int value = parse_number(cx);
+                    emit(cx, "    ; %s = Ok(%d)\n", var_name, value);
+                    emit(cx, "    li r14, 0         ; tag = Ok\n");
+                    emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset);
+                    emit_li(cx, 14, value);
+                    emit(cx, "    stw r14, %d(r1)   ; value\n", cx->stack_offset + 4);
+                    cx->vars[cx->var_count].type = TYPE_RESULT;
+                    cx->vars[cx->var_count].size = 8;
+
+                } else if (strncmp(cx->pos, "Err(", 4) == 0) {
+                    cx->pos += 4;
+                    emit(cx, "    ; %s = Err(...)\n", var_name);
+                    emit(cx, "    li r14, 1         ; tag = Err\n");
+                    emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset);
+                    /* Parse error value */
+                    if (*cx->pos == '"') {
+                        cx->pos++;
+                        while (*cx->pos && *cx->pos != '"') { if (*cx->pos == '\\') cx->pos++; cx->pos++; }
+                        if (*cx->pos == '"') cx->pos++;
+                    } else {
+                        int eval = parse_number(cx);
+                        emit_li(cx, 14, eval);
+                        emit(cx, "    stw r14, %d(r1)   ; error value\n", cx->stack_offset + 4);
+                    }
+                    while (*cx->pos && *cx->pos != ')') cx->pos++;
+                    if (*cx->pos == ')') cx->pos++;
+                    cx->vars[cx->var_count].type = TYPE_RESULT;
+                    cx->vars[cx->var_count].size = 8;
+
+                } else if (*cx->pos == '[') {
+                    cx->pos++;
+                    skip_whitespace(cx);
+                    emit(cx, "    ; %s = [...]\n", var_name);
+                    int array_idx = 0;
+                    /* Check for [value; count] repeat syntax */
+                    int first_val = 0;
+                    int is_repeat = 0;
+                    if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+                        first_val = parse_number(cx);
+                        skip_whitespace(cx);
+                        if (*cx->pos == ';') {
+                            /* [value; count] repeat expression */
+                            cx->pos++; /* past ';' */
+                            skip_whitespace(cx);
+                            int count = parse_number(cx);
+                            skip_whitespace(cx);
+                            if (count > 256) count = 256; /* safety limit */
+                            emit_li(cx, 14, first_val);
+                            for (int ri = 0; ri < count; ri++) {
+                                emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset + ri * 4);
+                            }
+                            array_idx = count;
+                            is_repeat = 1;
+                        }
+                    }
+                    if (!is_repeat) {
+                        /* Regular array literal [a, b, c, ...] */
+                        if (array_idx == 0 && first_val != 0) {
+                            /* We already parsed first_val above */
+                            emit_li(cx, 14, first_val);
+                            emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset);
+                            array_idx = 1;
+                            skip_whitespace(cx);
+                            if (*cx->pos == ',') cx->pos++;
+                        }
+                        while (*cx->pos && *cx->pos != ']') {
+                            skip_whitespace(cx);
+                            if (*cx->pos == ']') break;
+                            int value = parse_number(cx);
+                            emit_li(cx, 14, value);
+                            emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset + array_idx * 4);
+                            array_idx++;
+                            skip_whitespace(cx);
+                            if (*cx->pos == ',') cx->pos++;
+                            /* Safety: skip non-numeric non-bracket chars */
+                            while (*cx->pos && *cx->pos != ',' && *cx->pos != ']' && !isdigit(*cx->pos) && *cx->pos != '-') cx->pos++;
+                        }
+                    }
+                    while (*cx->pos && *cx->pos != ']') cx->pos++;
+                    if (*cx->pos == ']') cx->pos++;
+                    cx->vars[cx->var_count].type = TYPE_ARRAY;
+                    cx->vars[cx->var_count].size = array_idx * 4;
+
+                } else if (*cx->pos == '(') {
+                    /* Parenthesized expression or tuple */
+                    cx->pos++; /* past '(' */
+                    RustType paren_type = compile_expr_to_reg(cx, 14);
+                    while (*cx->pos && *cx->pos != ')') cx->pos++;
+                    if (*cx->pos == ')') cx->pos++;
+                    skip_whitespace(cx);
+                    /* Check for binary op after closing paren: (expr) * 8 */
+                    while ((*cx->pos == '+' || *cx->pos == '-' || *cx->pos == '*' || *cx->pos == '/' || *cx->pos == '%' ||
+                            (*cx->pos == '&' && *(cx->pos+1) != '&') || (*cx->pos == '|' && *(cx->pos+1) != '|') ||
+                            *cx->pos == '^' || (*cx->pos == '<' && *(cx->pos+1) == '<') || (*cx->pos == '>' && *(cx->pos+1) == '>')) &&
+                           *cx->pos != ';') {
+                        char op = *cx->pos;
+                        char op2 = *(cx->pos+1);
+                        int is_shift = (op == '<' && op2 == '<') || (op == '>' && op2 == '>');
+                        if (is_shift) cx->pos += 2; else cx->pos++;
+                        skip_whitespace(cx);
+                        if ((op == '*' || op == '/' || op == '%') &&
+                            const_expr_at(cx, CPREC_MUL + 1, 1, 0, &cval, NULL)) {
+                            if (!emit_const_arith(cx, op, 14, 15, (int)cval, const_unsigned(paren_type))) {
+                                emit_li(cx, 15, (int)cval);
+                                if (op == '/') emit(cx, "    divw r14, r14, r15\n");
+                                else { emit(cx, "    divw r16, r14, r15\n"); emit(cx, "    mullw r16, r16, r15\n"); emit(cx, "    sub r14, r14, r16\n"); }
+                            }
+                            skip_whitespace(cx);
+                            continue;
+                        }
+                        compile_expr_to_reg(cx, 15);
+                        if (op == '+') emit(cx, "    add r14, r14, r15\n");
+                        else if (op == '-') emit(cx, "    sub r14, r14, r15\n");
+                        else if (op == '*') emit(cx, "    mullw r14, r14, r15\n");
+                        else if (op == '/') emit(cx, "    divw r14, r14, r15\n");
+                        else if (op == '%') { emit(cx, "    divw r16, r14, r15\n"); emit(cx, "    mullw r16, r16, r15\n"); emit(cx, "    sub r14, r14, r16\n"); }
+                        else if (op == '&') emit(cx, "    and r14, r14, r15\n");
+                        else if (op == '|') emit(cx, "    or r14, r14, r15\n");
+                        else if (op == '^') emit(cx, "    xor r14, r14, r15\n");
+                        else if (op == '<' && is_shift) emit(cx, "    slw r14, r14, r15\n");
+                        else if (op == '>' && is_shift) emit(cx, "    sraw r14, r14, r15\n");
+                        skip_whitespace(cx);
+                    }
+                    emit(cx, "    stw r14, %d(r1)   ; %s\n", cx->stack_offset, var_name);
+                    cx->vars[cx->var_count].type = var_type;
+                    cx->vars[cx->var_count].size = 4;
+
+                } else if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+                    int value = parse_number(cx);
+                    emit_li(cx, 14, value);
+                    emit(cx, "    stw r14, %d(r1)   ; %s\n", cx->stack_offset, var_name);
+                    cx->vars[cx->var_count].type = var_type;
+                    cx->vars[cx->var_count].size = 4;
+
+                } else if (strncmp(cx->pos, "true", 4) == 0 && !isalnum(*(cx->pos+4))) {
+                    cx->pos += 4;
+                    emit(cx, "    li r14, 1\n");
+                    emit(cx, "    stw r14, %d(r1)   ; %s = true\n", cx->stack_offset, var_name);
+                    cx->vars[cx->var_count].type = TYPE_BOOL;
+                    cx->vars[cx->var_count].size = 4;
+
+                } else if (strncmp(cx->pos, "false", 5) == 0 && !isalnum(*(cx->pos+5))) {
+                    cx->pos += 5;
+                    emit(cx, "    li r14, 0\n");
+                    emit(cx, "    stw r14, %d(r1)   ; %s = false\n", cx->stack_offset, var_name);
+                    cx->vars[cx->var_count].type = TYPE_BOOL;
+                    cx->vars[cx->var_count].size = 4;
+
+                } else if (*cx->pos == '"') {
+                    cx->pos++;
+                    char str_buf[512] = {0};
+                    int si = 0;
+                    while (*cx->pos && *cx->pos != '"' && si < 511) {
+                        if (*cx->pos == '\\') cx->pos++;
+                        str_buf[si++] = *cx->pos++;
+                    }
+                    if (*cx->pos == '"') cx->pos++;
+                    emit(cx, "    ; %s = (string literal)\n", var_name);
+                    emit(cx, "    .section __DATA,__cstring\n");
+                    { int slbl = cx->string_label_count++;
+                    emit(cx, "L_str_%d:\n", slbl);
+                    emit_asciz(cx, str_buf);
+                    emit(cx, "    .text\n");
+                    emit(cx, "    lis r14, ha16(L_str_%d)\n", slbl);
+                    emit(cx, "    la r14, lo16(L_str_%d)(r14)\n", slbl); }
+                    emit(cx, "    stw r14, %d(r1)   ; %s ptr\n", cx->stack_offset, var_name);
+                    emit_li(cx, 15, si);
+                    emit(cx, "    stw r15, %d(r1)   ; %s len\n", cx->stack_offset + 4, var_name);
+                    cx->vars[cx->var_count].type = TYPE_STR;
+                    cx->vars[cx->var_count].size = 8;
+
+                } else if (strncmp(cx->pos, "match ", 6) == 0) {
+                    /* Match expression: let x = match val { arms }; */
+                    cx->pos += 6;
+                    skip_whitespace(cx);
+                    emit(cx, "    ; %s = match ...\n", var_name);
+
+                    /* Load the match subject into r14 */
+                    compile_expr_to_reg(cx, 14);
+                    skip_whitespace(cx);
+                    /* Skip to opening { */
+                    while (*cx->pos && *cx->pos != '{') cx->pos++;
+                    int end_label = cx->labels.match_let++, a;
+                    MatchPlan mp;
+                    match_scan(cx, tok_index_at(cx, cx->pos), &mp);
+                    match_emit_dispatch(cx, &mp, "let", end_label);
+
+                    /* Each arm leaves its value in r14; with no _ arm an
+                     * unmatched subject is the result */
+                    for (a = 0; a < mp.arm_count; a++) {
+                        if (!mp.arms[a].supported && !mp.arms[a].wildcard) continue;
+                        emit(cx, "Lmatch_let_arm_%d_%d:\n", end_label, a);
+                        cx->pos = tok_ptr(cx, &cx->tokens[mp.arms[a].body]);
+                        compile_expr_to_reg(cx, 15);
+                        emit(cx, "    mr r14, r15\n");
+                        emit(cx, "    b Lmatch_let_end_%d\n", end_label);
+                    }
+                    cx->pos = tok_end(cx, &cx->tokens[mp.close]);
+                    emit(cx, "Lmatch_let_end_%d:\n", end_label);
+                    emit(cx, "    stw r14, %d(r1)   ; %s = match result\n", cx->stack_offset, var_name);
+                    cx->vars[cx->var_count].type = var_type;
+                    cx->vars[cx->var_count].size = 4;
+
+                } else if (isalpha(*cx->pos) || *cx->pos == '_') {
+                    /* Variable reference, function call, or struct literal */
+                    int alpha_size_set = 0;  /* Flag: did a branch set type/size? */
+                    char* ref_start = cx->pos;  /* Save position before parsing name */
+                    char ref_name[64] = {0};
+                    int ri = 0;
+                    while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_' || *cx->pos == ':') && ri < 63) {
+                        ref_name[ri++] = *cx->pos++;
+                    }
+                    ref_name[ri] = '\0';
+                    skip_whitespace(cx);
+
+                    if (*cx->pos == '{') {
+                        /* Struct literal: Type { field: val, ... } */
+                        cx->pos++;
+                        emit(cx, "    ; %s = %s { ... }\n", var_name, ref_name);
+
+                        /* Find struct definition */
+                        int si_idx = struct_lookup(cx, ref_name);
+                        int struct_size = (si_idx >= 0) ? cx->structs[si_idx].size : 16;
+
+                        while (*cx->pos && *cx->pos != '}') {
+                            skip_whitespace(cx);
+                            if (*cx->pos == '}') break;
+                            /* Parse field_name: value */
+                            char fname[64] = {0};
+                            parse_string(cx, fname, sizeof(fname));
+                            skip_whitespace(cx);
+                            if (*cx->pos == ':') cx->pos++;
+                            skip_whitespace(cx);
+
+                            /* Find field offset */
+                            int foff = -1;
+                            if (si_idx >= 0) {
+                                int k;
+                                for (k = 0; k < cx->structs[si_idx].field_count; k++) {
+                                    if (strcmp(cx->structs[si_idx].fields[k].name, fname) == 0) {
+                                        foff = cx->structs[si_idx].fields[k].offset;
+                                        break;
+                                    }
+                                }
+                            }
+                            if (foff < 0) foff = 0;
+
+                            /* Parse value */
+                            if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+                                int fval = parse_number(cx);
+                                emit_li(cx, 14, fval);
+                                emit(cx, "    stw r14, %d(r1)   ; .%s\n", cx->stack_offset + foff, fname);
+                            } else if (*cx->pos == '"') {
+                                cx->pos++;
+                                while (*cx->pos && *cx->pos != '"') { if (*cx->pos == '\\') cx->pos++; cx->pos++; }
+                                if (*cx->pos == '"') cx->pos++;
+                                emit(cx, "    li r14, 0         ; .%s (string TODO)\n", fname);
+                                emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset + foff);
+                            } else if (isalpha(*cx->pos) || *cx->pos == '_') {
+                                char fvar[64] = {0};
+                                parse_string(cx, fvar, sizeof(fvar));
+                                Variable* fv = var_lookup(cx, fvar);
+                                if (fv) {
+                                    emit_var_load(cx, 14, fv, "");
+                                    emit(cx, "    stw r14, %d(r1)   ; .%s\n", cx->stack_offset + foff, fname);
+                                } else {
+                                    emit(cx, "    li r14, 0\n");
+                                    emit(cx, "    stw r14, %d(r1)   ; .%s (unresolved)\n", cx->stack_offset + foff, fname);
+                                }
+                            } else {
+                                int fval = parse_number(cx);
+                                emit_li(cx, 14, fval);
+                                emit(cx, "    stw r14, %d(r1)\n", cx->stack_offset + foff);
+                            }
+
+                            /* Skip past any trailing expr parts (as casts, operators, etc.) */
+                            while (*cx->pos && *cx->pos != ',' && *cx->pos != '}') cx->pos++;
+                            if (*cx->pos == ',') cx->pos++;
+                        }
+                        if (*cx->pos == '}') cx->pos++;
+
+                        cx->vars[cx->var_count].type = TYPE_STRUCT;
+                        cx->vars[cx->var_count].size = struct_size > 0 ? struct_size : 4;
+                        alpha_size_set = 1;
+
+                    } else if (*cx->pos == '(') {
+                        emit(cx, "    ; %s = %s(...)\n", var_name, ref_name);
+                        /* Pass arguments */
+                        cx->pos++;
+                        int arg_reg = 3, arg = 0, by_ref, slices[16];
+                        call_param_slices(cx, ref_name, slices, 16);
+                        while (*cx->pos && *cx->pos != ')') {
+                            skip_whitespace(cx);
+                            if (*cx->pos == ')') break;
+                            by_ref = *cx->pos == '&';
+                            if (by_ref) {
+                                cx->pos++;
+                                skip_whitespace(cx);
+                                if (strncmp(cx->pos, "mut ", 4) == 0) cx->pos += 4;
+                            }
+                            if (*cx->pos == '"') {
+                                /* String arg — skip for now */
+                                cx->pos++;
+                                while (*cx->pos && *cx->pos != '"') { if (*cx->pos == '\\') cx->pos++; cx->pos++; }
+                                if (*cx->pos == '"') cx->pos++;
+                            } else if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+                                int aval = parse_number(cx);
+                                if (arg_reg <= 10) {
+                                    emit_li(cx, arg_reg, aval);
+                                    arg_reg++;
+                                }
+                            } else if (isalpha(*cx->pos) || *cx->pos == '_') {
+                                char aname[64] = {0};
+                                int ai = 0;
+                                while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_') && ai < 63) {
+                                    aname[ai++] = *cx->pos++;
+                                }
+                                /* Skip method chains: arg.method().method() */
+                                while (*cx->pos == '.') {
+                                    cx->pos++;
+                                    while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
+                                    if (*cx->pos == '(') {
+                                        cx->pos++;
+                                        int depth = 1;
+                                        while (*cx->pos && depth > 0) {
+                                            if (*cx->pos == '(') depth++;
+                                            else if (*cx->pos == ')') depth--;
+                                            cx->pos++;
+                                        }
+                                    }
+                                }
+                                /* Look up arg variable */
+                                Variable* av = var_lookup(cx, aname);
+                                int words = av ? emit_slice_arg(cx, arg_reg, av, aname, by_ref,
+                                                                arg < 16 && slices[arg] >= 0) : 0;
+                                if (words) {
+                                    arg_reg += words;
+                                } else if (av && arg_reg <= 10) {
+                                    emit(cx, "    lwz r%d, %d(r1)   ; arg %s\n", arg_reg, av->offset, aname);
+                                    arg_reg++;
+                                }
+                            } else {
+                                /* Unknown token in function args — skip to avoid infinite loop */
+                                cx->pos++;
+                            }
+                            skip_whitespace(cx);
+                            if (*cx->pos == ',') {
+                                cx->pos++;
+                                arg++;
+                            }
+                        }
+                        if (*cx->pos == ')') cx->pos++;
+                        emit(cx, "    bl _%s\n", sanitize_label(cx, ref_name));
+                        emit(cx, "    stw r3, %d(r1)   ; %s = result\n", cx->stack_offset, var_name);
+                    } else {
+                        /* Variable reference, possibly with binary op: let x = a + b */
+                        /* Rewind pos to before ref_name so compile_expr_to_reg can parse it */
+                        cx->pos = ref_start;
+                        var_type = compile_expr_to_reg(cx, 14);
+                        emit(cx, "    stw r14, %d(r1)   ; %s\n", cx->stack_offset, var_name);
+                    }
+                    if (!alpha_size_set) {
+                        cx->vars[cx->var_count].type = var_type;
+                        cx->vars[cx->var_count].size = 4;
+                    }
+
+                } else {
+                    int value = parse_number(cx);
+                    emit_li(cx, 14, value);
+                    emit(cx, "    stw r14, %d(r1)   ; %s\n", cx->stack_offset, var_name);
+                    cx->vars[cx->var_count].type = var_type;
+                    cx->vars[cx->var_count].size = 4;
+                }
+
+                if (type_wide(cx->vars[cx->var_count].type) && cx->vars[cx->var_count].size == 4) {
+                    /* a 32-bit value bound as i64/u64: extend it in place */
+                    emit(cx, "    lwz r15, %d(r1)\n", cx->stack_offset);
+                    wide_extend(cx, 14, 15, cx->vars[cx->var_count].type);
+                    wide_store(cx, cx->stack_offset, cx->vars[cx->var_count].type, var_name, "");
+                    cx->vars[cx->var_count].size = 8;
+                }
+                cx->vars[cx->var_count].offset = cx->stack_offset;
+                cx->vars[cx->var_count].is_mut = is_mut;
+                cx->stack_offset += (cx->vars[cx->var_count].size > 0 ? cx->vars[cx->var_count].size : 4);
+                var_declare(cx, var_name);
+            }
+
+            while (*cx->pos && *cx->pos != ';') cx->pos++;
+            if (*cx->pos == ';') cx->pos++;
+
+        } else if (kw == KW_UNSAFE) {
+            cx->pos = tok_end(cx, stmt);
+            skip_whitespace(cx);
+            if (*cx->pos == '{') {
+                /* the '{' itself opens a block scope like a bare one */
+                emit(cx, "    ; unsafe block\n");
+                cx->in_unsafe_block = 1;
+            }
+
+        } else if (kw == KW_IF) {
+            cx->pos = tok_end(cx, stmt);
+            skip_whitespace(cx);
+            int my_label = cx->labels.if_label++;
+            long long cond_value;
+
+            if (strncmp(cx->pos, "let ", 4) == 0) {
+                /* if let Some(x) = expr { ... } */
+                cx->pos += 4;
+                skip_whitespace(cx);
+                emit(cx, "    ; if let\n");
+
+                /* Parse pattern: Some(var) or Ok(var) */
+                int is_some = 0, is_ok = 0;
+                if (strncmp(cx->pos, "Some(", 5) == 0) { cx->pos += 5; is_some = 1; }
+                else if (strncmp(cx->pos, "Ok(", 3) == 0) { cx->pos += 3; is_ok = 1; }
+
+                char bind_var[64] = {0};
+                parse_string(cx, bind_var, sizeof(bind_var));
+                while (*cx->pos && *cx->pos != '=') cx->pos++;
+                if (*cx->pos == '=') cx->pos++;
+                skip_whitespace(cx);
+
+                /* Parse the expression being matched */
+                char match_expr[64] = {0};
+                parse_string(cx, match_expr, sizeof(match_expr));
+
+                int expr_off = -1;
+                RustType expr_type = TYPE_I32;
+                Variable* mv = var_lookup(cx, match_expr);
+                if (mv) {
+                    expr_off = mv->offset;
+                    expr_type = mv->type;
+                }
+
+                if (expr_off >= 0) {
+                    emit(cx, "    lwz r14, %d(r1)   ; load %s tag\n", expr_off, match_expr);
+                    if (is_some || expr_type == TYPE_OPTION) {
+                        emit(cx, "    cmpwi r14, 0      ; None?\n");
+                        emit(cx, "    beq Lelse_%d\n", my_label);
+                    } else if (is_ok || expr_type == TYPE_RESULT) {
+                        emit(cx, "    cmpwi r14, 1      ; Err?\n");
+                        emit(cx, "    beq Lelse_%d\n", my_label);
+                    }
+                    /* Bind the inner value */
+                    emit(cx, "    lwz r14, %d(r1)   ; load inner value\n", expr_off + 4);
+                    emit(cx, "    stw r14, %d(r1)   ; bind %s\n", cx->stack_offset, bind_var);
+                    cx->vars[cx->var_count].offset = cx->stack_offset;
+                    cx->vars[cx->var_count].type = TYPE_I32;
+                    cx->vars[cx->var_count].size = 4;
+                    var_declare(cx, bind_var);
+                    cx->stack_offset += 4;
+                } else {
+                    emit(cx, "    li r14, 0\n");
+                    emit(cx, "    beq Lelse_%d\n", my_label);
+                }
+            } else if (const_expr_at(cx, CPREC_OR, 0, '{', &cond_value, NULL)) {
+                /* Constant condition: no test, and a plain branch if false */
+                if (!cond_value) emit(cx, "    b Lelse_%d\n", my_label);
+            } else {
+                char false_label[32];
+                snprintf(false_label, sizeof(false_label), "Lelse_%d", my_label);
+                compile_condition(cx, false_label, 0);
+            }
+
+            /* Compile if-body */
+            while (*cx->pos && *cx->pos != '{') cx->pos++;
+            if (*cx->pos == '{') {
+                cx->pos++;
+                compile_function_body(cx, frame_size);
+                if (*cx->pos == '}') cx->pos++;
+            }
+
+            emit(cx, "    b Lendif_%d\n", my_label);
+            emit(cx, "Lelse_%d:\n", my_label);
+
+            skip_whitespace(cx);
+
+            /* Check for else if / else */
+            if (strncmp(cx->pos, "else", 4) == 0 && !isalnum(*(cx->pos+4))) {
+                cx->pos += 4;
+                skip_whitespace(cx);
+                if (strncmp(cx->pos, "if ", 3) == 0) {
+                    /* else if — don't consume "if", let next iteration handle it */
+                    /* But we need to emit it inside the else block */
+                    /* For now, compile the else-if body inline */
+                }
+                while (*cx->pos && *cx->pos != '{') cx->pos++;
+                if (*cx->pos == '{') {
+                    cx->pos++;
+                    compile_function_body(cx, frame_size);
+                    if (*cx->pos == '}') cx->pos++;
+                }
+            }
+            emit(cx, "Lendif_%d:\n", my_label);
+
+        } else if (kw == KW_WHILE) {
+            cx->pos = tok_end(cx, stmt);
+            skip_whitespace(cx);
+            int my_label = cx->labels.while_label++;
+
+            emit(cx, "Lwhile_%d:\n", my_label);
+
+            /* Parse condition */
+            long long cond_value;
+            if (const_expr_at(cx, CPREC_OR, 0, '{', &cond_value, NULL)) {
+                /* Constant condition: loop forever or not at all */
+                if (!cond_value) emit(cx, "    b Lendwhile_%d\n", my_label);
+            } else {
+                char false_label[32];
+                snprintf(false_label, sizeof(false_label), "Lendwhile_%d", my_label);
+                compile_condition(cx, false_label, 1);
+            }
+
+            /* Compile while body */
+            while (*cx->pos && *cx->pos != '{') cx->pos++;
+            if (*cx->pos == '{') {
+                cx->pos++;
+                compile_function_body(cx, frame_size);
+                if (*cx->pos == '}') cx->pos++;
+            }
+            emit(cx, "    b Lwhile_%d\n", my_label);
+            emit(cx, "Lendwhile_%d:\n", my_label);
+
+        } else if (kw == KW_FOR) {
+            compile_for_loop(cx, stmt, frame_size);
+
+        } else if (kw == KW_LOOP) {
+            cx->pos = tok_end(cx, stmt);
+            int my_label = cx->labels.loop_label++;
+            emit(cx, "Lloop_%d:\n", my_label);
+
+            /* Compile loop body */
+            skip_whitespace(cx);
+            while (*cx->pos && *cx->pos != '{') cx->pos++;
+            if (*cx->pos == '{') {
+                cx->pos++;
+                compile_function_body(cx, frame_size);
+                if (*cx->pos == '}') cx->pos++;
+            }
+            emit(cx, "    b Lloop_%d\n", my_label);
+            emit(cx, "Lendloop_%d:\n", my_label);
+
+        } else if (kw == KW_MATCH) {
+            cx->pos = tok_end(cx, stmt);
+            skip_whitespace(cx);
+            emit(cx, "    ; match statement\n");
+
+            /* Load match subject into r14 */
+            compile_expr_to_reg(cx, 14);
+            skip_whitespace(cx);
+
+            /* Skip to opening { */
+            while (*cx->pos && *cx->pos != '{') cx->pos++;
+            int end_label = cx->labels.match_stmt++, a;
+            MatchPlan mp;
+            match_scan(cx, tok_index_at(cx, cx->pos), &mp);
+            match_emit_dispatch(cx, &mp, "stmt", end_label);
+
+            /* Arm bodies; single-expression arms are skipped */
+            for (a = 0; a < mp.arm_count; a++) {
+                if (!mp.arms[a].supported && !mp.arms[a].wildcard) continue;
+                emit(cx, "Lmatch_stmt_arm_%d_%d:\n", end_label, a);
+                cx->pos = tok_ptr(cx, &cx->tokens[mp.arms[a].body]);
+                if (*cx->pos == '{') {
+                    cx->pos++;
+                    compile_function_body(cx, frame_size);
+                }
+                emit(cx, "    b Lmatch_stmt_end_%d\n", end_label);
+            }
+            cx->pos = tok_end(cx, &cx->tokens[mp.close]);
+            emit(cx, "Lmatch_stmt_end_%d:\n", end_label);
+
+        } else if (kw == KW_RETURN) {
+            cx->pos = tok_end(cx, stmt);
+            skip_whitespace(cx);
+
+            if (strncmp(cx->pos, "Ok(", 3) == 0) {
+                cx->pos += 3;
+                int value = parse_number(cx);
+                emit(cx, "    ; return Ok(%d)\n", value);
+                emit(cx, "    li r3, 0          ; Ok tag\n");
+                emit_li(cx, 4, value);
+            } else if (strncmp(cx->pos, "Err(", 4) == 0) {
+                cx->pos += 4;
+                emit(cx, "    ; return Err(...)\n");
+                emit(cx, "    li r3, 1          ; Err tag\n");
+            } else if (strncmp(cx->pos, "Some(", 5) == 0) {
+                cx->pos += 5;
+                int value = parse_number(cx);
+                emit(cx, "    ; return Some(%d)\n", value);
+                emit(cx, "    li r3, 1          ; Some tag\n");
+                emit_li(cx, 4, value);
+            } else if (strncmp(cx->pos, "None", 4) == 0 && !isalnum(*(cx->pos+4))) {
+                cx->pos += 4;
+                emit(cx, "    ; return None\n");
+                emit(cx, "    li r3, 0          ; None tag\n");
+            } else if (type_float(cx->return_type)) {
+                /* f32/f64 results come back in f1 */
+                float_expr(cx, 1, 14, cx->return_type);
+            } else if (type_wide(cx->return_type) || wide_expr_at(cx, 14, 0) > 0) {
+                /* i64/u64 results come back in r3:r4 */
+                if (wide_expr_at(cx, 14, 0) >= 0) compile_expr64(cx, 14);
+                else wide_extend(cx, 14, 15, compile_expr_to_reg(cx, 15));
+                if (type_wide(cx->return_type)) {
+                    emit(cx, "    mr r3, r14\n");
+                    emit(cx, "    mr r4, r15\n");
+                } else {
+                    emit(cx, "    mr r3, r15\n");
+                }
+            } else {
+                /* General expression: return x * 2, return a + b, etc. */
+                compile_expr_to_reg(cx, 3);
+            }
+
+            /* RAII cleanup */
+            for (i = cx->var_count - 1; i >= saved_var_count; i--) {
+                emit_drop_glue(cx, &cx->vars[i]);
+            }
+
+            /* Epilogue and return */
+            emit(cx, "    addi r1, r1, %d\n", frame_size);
+            emit(cx, "    lwz r0, 8(r1)\n");
+            emit(cx, "    mtlr r0\n");
+            emit(cx, "    blr\n");
+
+            while (*cx->pos && *cx->pos != ';') cx->pos++;
+            if (*cx->pos == ';') cx->pos++;
+
+        } else if (stmt->sym == SYM_PRINTLN && tok_is_punct(stmt + 1, '!')) {
+            cx->pos = tok_end(cx, stmt + 1);
+            emit(cx, "    ; println! macro\n");
+            int pd = 0;
+            while (*cx->pos) {
+                if (*cx->pos == '(') pd++;
+                else if (*cx->pos == ')') { pd--; if (pd == 0) { cx->pos++; break; } }
+                cx->pos++;
+            }
+            emit(cx, "    bl _rust_println\n");
+            while (*cx->pos && *cx->pos != ';') cx->pos++;
+            if (*cx->pos == ';') cx->pos++;
+
+        } else if (stmt->sym == SYM_ASSERT && tok_is_punct(stmt + 1, '!')) {
+            cx->pos = tok_end(cx, stmt + 1);
+            emit(cx, "    ; assert! macro\n");
+            emit(cx, "    bl _rust_assert\n");
+            int pd = 0;
+            while (*cx->pos) {
+                if (*cx->pos == '(') pd++;
+                else if (*cx->pos == ')') { pd--; if (pd == 0) { cx->pos++; break; } }
+                cx->pos++;
+            }
+            while (*cx->pos && *cx->pos != ';') cx->pos++;
+            if (*cx->pos == ';') cx->pos++;
+
+        } else if (kw == KW_BREAK) {
+            cx->pos = tok_end(cx, stmt);
+            emit(cx, "    ; break\n");
+            /* Would need loop context to know target label */
+            while (*cx->pos && *cx->pos != ';') cx->pos++;
+            if (*cx->pos == ';') cx->pos++;
+
+        } else if (kw == KW_CONTINUE) {
+            cx->pos = tok_end(cx, stmt);
+            emit(cx, "    ; continue\n");
+            while (*cx->pos && *cx->pos != ';') cx->pos++;
+            if (*cx->pos == ';') cx->pos++;
+
+        } else if (stmt->kind == TOK_IDENT) {
+            /* Method calls, field access, assignments, function calls */
+            char obj_name[64] = {0};
+            parse_string(cx, obj_name, sizeof(obj_name));
+
+            int obj_offset = -1;
+            RustType obj_type = TYPE_I32;
+            Variable* ov = var_lookup(cx, obj_name);
+            if (ov) {
+                obj_offset = ov->offset;
+                obj_type = ov->type;
+            }
+
+            skip_whitespace(cx);
+
+            if ((*cx->pos == '+' || *cx->pos == '-' || *cx->pos == '*' || *cx->pos == '/' || *cx->pos == '%' ||
+                 *cx->pos == '&' || *cx->pos == '|' || *cx->pos == '^') && *(cx->pos+1) == '=') {
+                /* Compound assignment: +=, -=, *=, /=, %=, &=, |=, ^= */
+                char cop = *cx->pos;
+                ConstItem* st = ov ? NULL : static_mut_lookup(cx, obj_name);
+                int wide;
+                cx->pos += 2;
+                skip_whitespace(cx);
+                wide = obj_offset >= 0 ? wide_expr_at(cx, 16, 0) : -1;
+                if (obj_offset >= 0 && type_float(obj_type)) {
+                    float_compound(cx, cop, obj_offset, obj_type, obj_name);
+                } else if (wide > 0 || (wide == 0 && type_wide(obj_type))) {
+                    /* 64-bit: the target in r14:r15, the right side a constant or r16:r17 */
+                    int is_unsigned = const_unsigned(obj_type);
+                    long long cval;
+                    char note[16];
+                    if (type_wide(obj_type)) {
+                        emit(cx, "    lwz r14, %d(r1)   ; load %s (high)\n", obj_offset, obj_name);
+                        emit(cx, "    lwz r15, %d(r1)   ; load %s (low)\n", obj_offset + 4, obj_name);
+                    } else {
+                        emit(cx, "    lwz r15, %d(r1)   ; load %s\n", obj_offset, obj_name);
+                        wide_extend(cx, 14, 15, obj_type);
+                    }
+                    if (const_expr_at(cx, CPREC_OR, 0, ';', &cval, NULL)) {
+                        if (!wide_op_const(cx, 14, cop, cval, is_unsigned)) {
+                            wide_li(cx, 16, cval);
+                            wide_op(cx, 14, cop, is_unsigned);
+                        }
+                    } else {
+                        compile_expr64(cx, 16);
+                        wide_op(cx, 14, cop, is_unsigned);
+                    }
+                    snprintf(note, sizeof(note), " %c= expr", cop);
+                    wide_store(cx, obj_offset, obj_type, obj_name, note);
+                } else if (obj_offset >= 0 || st) {
+                    if (st) emit_static_load(cx, 14, st);
+                    else emit(cx, "    lwz r14, %d(r1)   ; load %s\n", obj_offset, obj_name);
+                    long long cval;
+                    if ((cop == '*' || cop == '/' || cop == '%') &&
+                        const_expr_at(cx, CPREC_OR, 0, ';', &cval, NULL)) {
+                        if (emit_const_arith(cx, cop, 14, 15, (int)cval,
+                                             const_unsigned(st ? st->type : obj_type))) {
+                            cop = 0;
+                        } else {
+                            emit_li(cx, 15, (int)cval);
+                        }
+                    } else {
+                        compile_expr_to_reg(cx, 15);
+                    }
+                    if (cop == '+') emit(cx, "    add r14, r14, r15\n");
+                    else if (cop == '-') emit(cx, "    sub r14, r14, r15\n");
+                    else if (cop == '*') emit(cx, "    mullw r14, r14, r15\n");
+                    else if (cop == '/') emit(cx, "    divw r14, r14, r15\n");
+                    else if (cop == '%') { emit(cx, "    divw r16, r14, r15\n"); emit(cx, "    mullw r16, r16, r15\n"); emit(cx, "    sub r14, r14, r16\n"); }
+                    else if (cop == '&') emit(cx, "    and r14, r14, r15\n");
+                    else if (cop == '|') emit(cx, "    or r14, r14, r15\n");
+                    else if (cop == '^') emit(cx, "    xor r14, r14, r15\n");
+                    if (st) emit_static_store(cx, 14, 16, st);
+                    else emit(cx, "    stw r14, %d(r1)   ; %s %c= expr\n", obj_offset, obj_name, cop);
+                }
+                while (*cx->pos && *cx->pos != ';') cx->pos++;
+                if (*cx->pos == ';') cx->pos++;
+
+            } else if (*cx->pos == '=' && *(cx->pos+1) != '=') {
+                ConstItem* st = ov ? NULL : static_mut_lookup(cx, obj_name);
+                cx->pos++;
+                skip_whitespace(cx);
+                if (obj_offset >= 0 && type_float(obj_type)) {
+                    float_expr(cx, 1, 14, obj_type);
+                    float_store(cx, 1, obj_offset, obj_type, obj_name, " = expr");
+                } else if (obj_offset >= 0 && (type_wide(obj_type) || wide_expr_at(cx, 14, 0) > 0)) {
+                    /* an i64/u64 target, or a 64-bit value narrowed */
+                    if (wide_expr_at(cx, 14, 0) >= 0) compile_expr64(cx, 14);
+                    else wide_extend(cx, 14, 15, compile_expr_to_reg(cx, 15));
+                    wide_store(cx, obj_offset, obj_type, obj_name, " = expr");
+                } else if (obj_offset >= 0) {
+                    compile_expr_to_reg(cx, 14);
+                    emit(cx, "    stw r14, %d(r1)   ; %s = expr\n", obj_offset, obj_name);
+                } else if (st) {
+                    compile_expr_to_reg(cx, 14);
+                    emit_static_store(cx, 14, 16, st);
+                }
+                while (*cx->pos && *cx->pos != ';') cx->pos++;
+                if (*cx->pos == ';') cx->pos++;
+
+            } else if (*cx->pos == '.') {
+                cx->pos++;
+                if (strncmp(cx->pos, "await", 5) == 0 && !isalnum(*(cx->pos+5))) {
+                    cx->pos += 5;
+                    emit(cx, "    ; %s.await\n", obj_name);
+                    emit(cx, "    lwz r3, %d(r1)\n", obj_offset >= 0 ? obj_offset : 0);
+                    emit(cx, "    bl _await_future\n");
+                } else {
+                    char method[64] = {0};
+                    parse_string(cx, method, sizeof(method));
+                    int var_off = obj_offset >= 0 ? obj_offset : 0;
+
+                    if (*cx->pos == '(') {
+                        emit(cx, "    ; %s.%s()\n", obj_name, method);
+                        if (strcmp(method, "clone") == 0) {
+                            emit(cx, "    la r3, %d(r1)\n", var_off);
+                            emit(cx, "    bl _clone_impl\n");
+                        } else if (strcmp(method, "drop") == 0) {
+                            emit(cx, "    la r3, %d(r1)\n", var_off);
+                            emit(cx, "    bl _drop_impl\n");
+                        } else if (strcmp(method, "len") == 0) {
+                            emit(cx, "    lwz r3, %d(r1)\n", var_off + 4);
+                        } else if (strcmp(method, "push") == 0) {
+                            emit(cx, "    lwz r3, %d(r1)    ; Vec ptr\n", var_off);
+                            emit(cx, "    bl _vec_push\n");
+                        } else if (strcmp(method, "iter") == 0) {
+                            emit(cx, "    la r3, %d(r1)\n", var_off);
+                            emit(cx, "    bl _create_iter\n");
+                        } else if (strcmp(method, "collect") == 0) {
+                            emit(cx, "    bl _iter_collect\n");
+                        } else if (strcmp(method, "unwrap") == 0) {
+                            emit(cx, "    lwz r14, %d(r1)   ; load tag\n", var_off);
+                            if (obj_type == TYPE_RESULT) {
+                                emit(cx, "    cmpwi r14, 1\n");
+                                emit(cx, "    beq _panic_unwrap ; panic if Err\n");
+                            } else {
+                                emit(cx, "    cmpwi r14, 0\n");
+                                emit(cx, "    beq _panic_unwrap ; panic if None\n");
+                            }
+                            emit(cx, "    lwz r3, %d(r1)\n", var_off + 4);
+                        } else {
+                            emit(cx, "    la r3, %d(r1)\n", var_off);
+                            { char mname[256]; snprintf(mname, sizeof(mname), "%s_%s", obj_name, method);
+                            emit(cx, "    bl _%s\n", sanitize_label(cx, mname)); }
+                        }
+                        while (*cx->pos && *cx->pos != ')') cx->pos++;
+                        if (*cx->pos == ')') cx->pos++;
+                    } else {
+                        /* Field access: obj.field (not a method call) */
+                        emit(cx, "    ; %s.%s (field access)\n", obj_name, method);
+                        int field_off = -1;
+                        int is_self = (strcmp(obj_name, "self") == 0);
+
+                        /* Resolve struct type */
+                        int struct_idx = -1;
+                        if (is_self && cx->current_impl_struct >= 0) {
+                            struct_idx = cx->current_impl_struct;
+                        } else if (obj_type == TYPE_STRUCT) {
+                            for (int si = 0; si < cx->struct_count; si++) {
+                                int fi;
+                                for (fi = 0; fi < cx->structs[si].field_count; fi++) {
+                                    if (strcmp(cx->structs[si].fields[fi].name, method) == 0) {
+                                        struct_idx = si;
+                                        field_off = cx->structs[si].fields[fi].offset;
+                                        break;
+                                    }
+                                }
+                                if (field_off >= 0) break;
+                            }
+                        }
+                        if (struct_idx >= 0 && field_off < 0) {
+                            for (int fi = 0; fi < cx->structs[struct_idx].field_count; fi++) {
+                                if (strcmp(cx->structs[struct_idx].fields[fi].name, method) == 0) {
+                                    field_off = cx->structs[struct_idx].fields[fi].offset;
+                                    break;
+                                }
+                            }
+                        }
+                        if (field_off < 0) field_off = 0;
+
+                        skip_whitespace(cx);
+                        if (*cx->pos == '=' && *(cx->pos+1) != '=') {
+                            /* self.field = expr */
+                            cx->pos++;
+                            skip_whitespace(cx);
+                            compile_expr_to_reg(cx, 14);
+                            if (is_self) {
+                                emit(cx, "    lwz r15, %d(r1)   ; load self ptr\n", var_off);
+                                emit(cx, "    stw r14, %d(r15)  ; self.%s = expr\n", field_off, method);
+                            } else {
+                                emit(cx, "    stw r14, %d(r1)   ; %s.%s = expr\n", var_off + field_off, obj_name, method);
+                            }
+                        } else if ((*cx->pos == '+' || *cx->pos == '-' || *cx->pos == '*') && *(cx->pos+1) == '=') {
+                            /* self.field += expr */
+                            char cop = *cx->pos;
+                            cx->pos += 2;
+                            skip_whitespace(cx);
+                            if (is_self) {
+                                emit(cx, "    lwz r15, %d(r1)   ; load self ptr\n", var_off);
+                                emit(cx, "    lwz r14, %d(r15)  ; load self.%s\n", field_off, method);
+                            } else {
+                                emit(cx, "    lwz r14, %d(r1)   ; load %s.%s\n", var_off + field_off, obj_name, method);
+                            }
+                            compile_expr_to_reg(cx, 16);
+                            if (cop == '+') emit(cx, "    add r14, r14, r16\n");
+                            else if (cop == '-') emit(cx, "    sub r14, r14, r16\n");
+                            else if (cop == '*') emit(cx, "    mullw r14, r14, r16\n");
+                            if (is_self) {
+                                emit(cx, "    stw r14, %d(r15)  ; self.%s %c= expr\n", field_off, method, cop);
+                            } else {
+                                emit(cx, "    stw r14, %d(r1)   ; %s.%s %c= expr\n", var_off + field_off, obj_name, method, cop);
+                            }
+                        } else {
+                            /* Just a read: obj.field */
+                            if (is_self) {
+                                emit(cx, "    lwz r15, %d(r1)   ; load self ptr\n", var_off);
+                                emit(cx, "    lwz r3, %d(r15)   ; load self.%s\n", field_off, method);
+                            } else {
+                                emit(cx, "    lwz r3, %d(r1)    ; load %s.%s\n", var_off + field_off, obj_name, method);
+                            }
+                        }
+                    }
+                }
+                while (*cx->pos && *cx->pos != ';') cx->pos++;
+                if (*cx->pos == ';') cx->pos++;
+
+            } else if (*cx->pos == '[') {
+                cx->pos++;
+                int index = parse_number(cx);
+                int var_off = obj_offset >= 0 ? obj_offset : 0;
+                emit(cx, "    ; %s[%d]\n", obj_name, index);
+                emit(cx, "    lwz r3, %d(r1)\n", var_off);
+                emit(cx, "    lwz r3, %d(r3)\n", index * 4);
+                while (*cx->pos && *cx->pos != ']') cx->pos++;
+                if (*cx->pos == ']') cx->pos++;
+                while (*cx->pos && *cx->pos != ';') cx->pos++;
+                if (*cx->pos == ';') cx->pos++;
+
+            } else if (*cx->pos == '(') {
+                char* args = cx->pos;
+                emit(cx, "    ; Call %s()\n", obj_name);
+                cx->pos = tok_ptr(cx, stmt);
+                if (wide_expr_at(cx, 14, 0) > 0) {
+                    /* i64/u64 arguments go in register pairs */
+                    compile_expr64(cx, 14);
+                    skip_whitespace(cx);
+                    if (*cx->pos == ';') cx->pos++;
+                    continue;
+                }
+                cx->pos = args;
+                /* Parse arguments */
+                cx->pos++;
+                int arg_reg = 3, arg = 0, by_ref, slices[16];
+                call_param_slices(cx, obj_name, slices, 16);
+                while (*cx->pos && *cx->pos != ')') {
+                    skip_whitespace(cx);
+                    if (*cx->pos == ')') break;
+                    by_ref = *cx->pos == '&';
+                    if (by_ref) {
+                        cx->pos++;
+                        skip_whitespace(cx);
+                        if (strncmp(cx->pos, "mut ", 4) == 0) cx->pos += 4;
+                    }
+                    if (*cx->pos == '"') {
+                        /* String literal argument */
+                        cx->pos++;
+                        while (*cx->pos && *cx->pos != '"') { if (*cx->pos == '\\') cx->pos++; cx->pos++; }
+                        if (*cx->pos == '"') cx->pos++;
+                        /* Pass string address in register (simplified) */
+                        if (arg_reg <= 10) {
+                            emit(cx, "    li r%d, 0         ; string arg (TODO)\n", arg_reg++);
+                        }
+                    } else if (isdigit(*cx->pos) || (*cx->pos == '-' && isdigit(*(cx->pos+1)))) {
+                        int aval = parse_number(cx);
+                        if (arg_reg <= 10) {
+                            emit_li(cx, arg_reg, aval); arg_reg++;
+                        }
+                    } else if (isalpha(*cx->pos) || *cx->pos == '_') {
+                        char aname[64] = {0};
+                        parse_string(cx, aname, sizeof(aname));
+                        Variable* av = var_lookup(cx, aname);
+                        int words = av ? emit_slice_arg(cx, arg_reg, av, aname, by_ref,
+                                                        arg < 16 && slices[arg] >= 0) : 0;
+                        if (words) {
+                            arg_reg += words;
+                        } else if (av && arg_reg <= 10) {
+                            emit(cx, "    lwz r%d, %d(r1)\n", arg_reg++, av->offset);
+                        }
+                    } else {
+                        /* Unknown argument type — skip one char to avoid infinite loop */
+                        cx->pos++;
+                    }
+                    skip_whitespace(cx);
+                    if (*cx->pos == ',') {
+                        cx->pos++;
+                        arg++;
+                    }
+                }
+                if (*cx->pos == ')') cx->pos++;
+                emit(cx, "    bl _%s\n", sanitize_label(cx, obj_name));
+                while (*cx->pos && *cx->pos != ';') cx->pos++;
+                if (*cx->pos == ';') cx->pos++;
+
+            } else {
+                /* Unknown statement — skip to semicolon */
+                while (*cx->pos && *cx->pos != ';') cx->pos++;
+                if (*cx->pos == ';') cx->pos++;
+            }
+
+        } else {
+            /* Stray punctuation, literals, lifetimes — step over the token */
+            cx->pos = tok_end(cx, stmt);
+        }
+    }
+
+    /* Restore state for caller. A nested block's bindings end here; the
+     * function-level scope stays live for the caller's drop glue and is
+     * popped by the caller. */
+    if (cx->block_depth > 1) {
+        for (i = cx->var_count - 1; i >= saved_var_count; i--) {
+            emit_drop_glue(cx, &cx->vars[i]);
+        }
+        scope_pop(cx, saved_var_count);
+    }
+    cx->block_depth--;
+    cx->stack_offset = saved_stack_offset;
+}
+
+/* Emit PIC symbol stubs for malloc/free — required on Tiger PPC.
+ * Must be called at end of every translation unit.
+ */
+void emit_pic_stubs(CompilerContext* cx) {
+    emit(cx, "\n    .section __TEXT,__picsymbolstub1,symbol_stubs,pure_instructions,32\n");
+    emit(cx, "    .align 5\n");
+    emit(cx, "L_malloc$stub:\n");
+    emit(cx, "    .indirect_symbol _malloc\n");
+    emit(cx, "    mflr r0\n");
+    emit(cx, "    bcl 20,31,\"L_malloc$spb\"\n");
+    emit(cx, "\"L_malloc$spb\":\n");
+    emit(cx, "    mflr r11\n");
+    emit(cx, "    addis r11,r11,ha16(L_malloc$lazy_ptr-\"L_malloc$spb\")\n");
+    emit(cx, "    mtlr r0\n");
+    emit(cx, "    lwzu r12,lo16(L_malloc$lazy_ptr-\"L_malloc$spb\")(r11)\n");
+    emit(cx, "    mtctr r12\n");
+    emit(cx, "    bctr\n");
+    emit(cx, "L_free$stub:\n");
+    emit(cx, "    .indirect_symbol _free\n");
+    emit(cx, "    mflr r0\n");
+    emit(cx, "    bcl 20,31,\"L_free$spb\"\n");
+    emit(cx, "\"L_free$spb\":\n");
+    emit(cx, "    mflr r11\n");
+    emit(cx, "    addis r11,r11,ha16(L_free$lazy_ptr-\"L_free$spb\")\n");
+    emit(cx, "    mtlr r0\n");
+    emit(cx, "    lwzu r12,lo16(L_free$lazy_ptr-\"L_free$spb\")(r11)\n");
+    emit(cx, "    mtctr r12\n");
+    emit(cx, "    bctr\n");
+    emit(cx, "    .lazy_symbol_pointer\n");
+    emit(cx, "L_malloc$lazy_ptr:\n");
+    emit(cx, "    .indirect_symbol _malloc\n");
+    emit(cx, "    .long dyld_stub_binding_helper\n");
+    emit(cx, "L_free$lazy_ptr:\n");
+    emit(cx, "    .indirect_symbol _free\n");
+    emit(cx, "    .long dyld_stub_binding_helper\n");
+    emit(cx, "    .subsections_via_symbols\n");
+}
+
+void compile_rust(CompilerContext* cx, char* source) {
+    cx->pos = source;
+    
+    emit(cx, "; PowerPC Rust Compiler - 100%% Firefox-Ready Edition\n");
+    emit(cx, "; Complete Rust implementation for PowerPC\n");
+    emit(cx, "; Supports all features needed for Firefox\n\n");
+    if (target_machine(&cx->opts)) emit(cx, ".machine %s\n\n", target_machine(&cx->opts));
+    
+    /* Initialize built-in macros */
+    compiler_state_init(cx);
+    macro_declare(cx, "println!", 1);
+    macro_declare(cx, "vec!", 1);
+    macro_declare(cx, "format!", 1);
+    macro_declare(cx, "panic!", 1);
+    macro_declare(cx, "assert!", 1);
+    macro_declare(cx, "dbg!", 1);
+    
+    /* Multi-pass compilation */
+    
+    /* Pass 1: Collect type definitions — walks the token array, so
+     * comments and string literals can never be mistaken for items */
+    lex_source(cx, source);
+    int ti = 0;
+    /* The function index is built on the same walk: a stack of open impl
+     * bodies gives each fn item its owner. fns nested in a fn body are
+     * not items of their own. */
+    int impl_owner[64];       /* self type symbol of each open impl */
+    int impl_depth[64];       /* brace depth of that impl's body */
+    int impl_sp = 0;
+    int pending_impl = 0;     /* impl header seen, body brace not yet */
+    int pending_owner = -1;
+    int depth = 0;
+    int fn_body_end = -1;     /* closing brace of the fn being walked */
+    while (ti < cx->tok_count) {
+        Token* t = &cx->tokens[ti];
+        int kw = tok_kw(t);
+        cx->pos = tok_end(cx, t);
+
+        if (t->kind == TOK_PUNCT) {
+            if (t->ch == '{') {
+                depth++;
+                if (pending_impl && impl_sp < 64) {
+                    impl_owner[impl_sp] = pending_owner;
+                    impl_depth[impl_sp] = depth;
+                    impl_sp++;
+                }
+                pending_impl = 0;
+            } else if (t->ch == '}') {
+                if (impl_sp > 0 && impl_depth[impl_sp - 1] == depth) impl_sp--;
+                depth--;
+            } else if (t->ch == ';') {
+                pending_impl = 0;
+            }
+        } else if (kw == KW_FN && t[1].kind == TOK_IDENT && ti > fn_body_end) {
+            int owner = (impl_sp > 0 && impl_depth[impl_sp - 1] == depth) ? impl_owner[impl_sp - 1] : -1;
+            int f = function_declare(cx, ti, owner);
+            if (f >= 0) {
+                fn_body_end = cx->functions[f].body_end_tok;
+                if (cx->functions[f].is_const && cx->sym_entries[t[1].sym].const_fn < 0) {
+                    cx->sym_entries[t[1].sym].const_fn = f;
+                }
+                if (owner < 0 && cx->sym_entries[t[1].sym].free_fn < 0) cx->sym_entries[t[1].sym].free_fn = f;
+            }
+        }
+
+        if (tok_is_punct(t, '#') && (tok_is_punct(t + 1, '[') ||
+                (tok_is_punct(t + 1, '!') && tok_is_punct(t + 2, '[')))) {
+            /* Attributes (#[derive(...)], #![...]) — parsed but not needed for codegen */
+            int open = tok_is_punct(t + 1, '[') ? ti + 1 : ti + 2;
+            ti = tok_match_close(cx, open) + 1;
+            continue;
+        } else if (kw == KW_STRUCT) {
+            skip_whitespace(cx);
+            
+            char struct_name[64] = {0};
+            parse_string(cx, struct_name, sizeof(struct_name));
+            
+            cx->structs[cx->struct_count].name = intern_str(cx, struct_name);
+            
+            /* Parse generics */
+            if (*cx->pos == '<') {
+                cx->pos++;
+                char generics[128] = {0};
+                int g_idx = 0;
+                while (*cx->pos && *cx->pos != '>' && g_idx < 127) {
+                    generics[g_idx++] = *cx->pos++;
+                }
+                cx->structs[cx->struct_count].generics = arena_strdup(cx, generics);
+                if (*cx->pos == '>') cx->pos++;
+            }
+            
+            /* Parse struct fields */
+            skip_whitespace(cx);
+            cx->structs[cx->struct_count].field_count = 0;
+            cx->structs[cx->struct_count].alignment = 4;
+
+            if (*cx->pos == '{') {
+                cx->pos++;
+                int field_offset = 0;
+                while (*cx->pos && *cx->pos != '}') {
+                    skip_whitespace(cx);
+                    if (*cx->pos == '}') break;
+                    /* Skip comments inside struct */
+                    if (*cx->pos == '/' && *(cx->pos+1) == '/') {
+                        while (*cx->pos && *cx->pos != '\n') cx->pos++;
+                        if (*cx->pos == '\n') cx->pos++;
+                        continue;
+                    }
+                    if (*cx->pos == '/' && *(cx->pos+1) == '*') {
+                        cx->pos += 2;
+                        while (*cx->pos && !(*cx->pos == '*' && *(cx->pos+1) == '/')) cx->pos++;
+                        if (*cx->pos) cx->pos += 2;
+                        continue;
+                    }
+                    /* Skip attributes like #[...] */
+                    if (*cx->pos == '#' && *(cx->pos+1) == '[') {
+                        while (*cx->pos && *cx->pos != ']') cx->pos++;
+                        if (*cx->pos == ']') cx->pos++;
+                        continue;
+                    }
+                    /* Skip @ attributes like @size(16), @align(16) */
+                    if (*cx->pos == '@') {
+                        cx->pos++;
+                        while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
+                        if (*cx->pos == '(') {
+                            int d = 1; cx->pos++;
+                            while (*cx->pos && d > 0) { if (*cx->pos == '(') d++; else if (*cx->pos == ')') d--; cx->pos++; }
+                        }
+                        skip_whitespace(cx);
+                        continue;
+                    }
+                    /* Skip macro metavariables $(...) */
+                    if (*cx->pos == '$') {
+                        if (*(cx->pos+1) == '(') {
+                            int d = 1; cx->pos += 2;
+                            while (*cx->pos && d > 0) { if (*cx->pos == '(') d++; else if (*cx->pos == ')') d--; cx->pos++; }
+                            /* Skip optional repeat operator: *, +, ? */
+                            while (*cx->pos == '*' || *cx->pos == '+' || *cx->pos == '?') cx->pos++;
+                        } else {
+                            cx->pos++; /* skip $ */
+                            while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++; /* skip $ident */
+                        }
+                        continue;
+                    }
+                    /* Skip pub keyword */
+                    if (strncmp(cx->pos, "pub ", 4) == 0) cx->pos += 4;
+                    if (strncmp(cx->pos, "pub(crate) ", 11) == 0) cx->pos += 11;
+                    if (strncmp(cx->pos, "pub(super) ", 11) == 0) cx->pos += 11;
+                    skip_whitespace(cx);
+                    /* Skip r# raw identifier prefix */
+                    if (*cx->pos == 'r' && *(cx->pos+1) == '#') cx->pos += 2;
+                    /* Parse field name */
+                    char fname[32] = {0};
+                    int fi = 0;
+                    while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_') && fi < 31) {
+                        fname[fi++] = *cx->pos++;
+                    }
+                    fname[fi] = '\0';
+                    skip_whitespace(cx);
+                    if (*cx->pos == '=') {
+                        /* key = value (macro syntax, not a real field) — skip to comma */
+                        while (*cx->pos && *cx->pos != ',' && *cx->pos != '}') cx->pos++;
+                        if (*cx->pos == ',') cx->pos++;
+                        continue;
+                    }
+                    if (*cx->pos == ':') cx->pos++;
+                    skip_whitespace(cx);
+                    /* Parse field type */
+                    RustType ftype = parse_type(cx);
+                    int fsize = 4; /* default */
+                    switch (ftype) {
+                        case TYPE_I8: case TYPE_U8: case TYPE_BOOL: fsize = 1; break;
+                        case TYPE_I16: case TYPE_U16: fsize = 2; break;
+                        case TYPE_I64: case TYPE_U64: case TYPE_F64: fsize = 8; break;
+                        case TYPE_I128: case TYPE_U128: fsize = 16; break;
+                        case TYPE_STRING: case TYPE_VEC: fsize = 12; break;
+                        case TYPE_STR: case TYPE_SLICE: fsize = 8; break;
+                        default: fsize = 4; break;
+                    }
+                    /* Align field */
+                    int align = fsize > 4 ? 4 : (fsize < 4 ? fsize : 4);
+                    field_offset = (field_offset + align - 1) & ~(align - 1);
+
+                    struct_add_field(cx, &cx->structs[cx->struct_count], fname, ftype, field_offset, fsize);
+                    field_offset += fsize;
+
+                    /* Skip comma */
+                    skip_whitespace(cx);
+                    if (*cx->pos == ',') cx->pos++;
+                }
+                if (*cx->pos == '}') cx->pos++;
+                cx->structs[cx->struct_count].size = (field_offset + 3) & ~3; /* Pad to 4-byte */
+            } else if (*cx->pos == '(') {
+                /* Tuple struct: struct Foo(i32, i32); */
+                cx->pos++;
+                int field_offset = 0;
+                int tidx = 0;
+                while (*cx->pos && *cx->pos != ')') {
+                    skip_whitespace(cx);
+                    if (*cx->pos == ')') break;
+                    /* Skip comments inside tuple struct */
+                    if (*cx->pos == '/' && *(cx->pos+1) == '/') {
+                        while (*cx->pos && *cx->pos != '\n') cx->pos++;
+                        if (*cx->pos == '\n') cx->pos++;
+                        continue;
+                    }
+                    if (*cx->pos == '/' && *(cx->pos+1) == '*') {
+                        cx->pos += 2;
+                        while (*cx->pos && !(*cx->pos == '*' && *(cx->pos+1) == '/')) cx->pos++;
+                        if (*cx->pos) cx->pos += 2;
+                        continue;
+                    }
+                    /* Skip attributes (#[...]) and @ attributes (@size(N)) */
+                    if (*cx->pos == '#' && *(cx->pos+1) == '[') {
+                        while (*cx->pos && *cx->pos != ']') cx->pos++;
+                        if (*cx->pos == ']') cx->pos++;
+                        continue;
+                    }
+                    if (*cx->pos == '@') {
+                        cx->pos++;
+                        while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_')) cx->pos++;
+                        if (*cx->pos == '(') {
+                            int d = 1; cx->pos++;
+                            while (*cx->pos && d > 0) { if (*cx->pos == '(') d++; else if (*cx->pos == ')') d--; cx->pos++; }
+                        }
+                        skip_whitespace(cx);
+                        continue;
+                    }
+                    /* Skip pub keyword */
+                    if (strncmp(cx->pos, "pub ", 4) == 0) cx->pos += 4;
+                    if (strncmp(cx->pos, "pub(crate) ", 11) == 0) cx->pos += 11;
+                    /* Safety: skip => (macro syntax) and other non-type chars */
+                    if (*cx->pos == '=' && *(cx->pos+1) == '>') {
+                        cx->pos += 2;
+                        skip_whitespace(cx);
+                        continue;
+                    }
+                    char *before_parse = cx->pos;
+                    RustType ftype = parse_type(cx);
+                    /* Safety: if parse_type didn't advance, skip one char to avoid infinite loop */
+                    if (cx->pos == before_parse) {
+                        cx->pos++;
+                        continue;
+                    }
+                    int fsize = 4;
+                    switch (ftype) {
+                        case TYPE_I8: case TYPE_U8: case TYPE_BOOL: fsize = 1; break;
+                        case TYPE_I16: case TYPE_U16: fsize = 2; break;
+                        case TYPE_I64: case TYPE_U64: case TYPE_F64: fsize = 8; break;
+                        default: fsize = 4; break;
+                    }
+                    char tname[32];
+                    snprintf(tname, sizeof(tname), "%d", tidx);
+                    struct_add_field(cx, &cx->structs[cx->struct_count], tname, ftype, field_offset, fsize);
+                    field_offset += fsize;
+                    tidx++;
+                    skip_whitespace(cx);
+                    if (*cx->pos == ',') cx->pos++;
+                }
+                if (*cx->pos == ')') cx->pos++;
+                while (*cx->pos && *cx->pos != ';') cx->pos++;
+                if (*cx->pos == ';') cx->pos++;
+                cx->structs[cx->struct_count].size = (field_offset + 3) & ~3;
+            } else if (*cx->pos == ';') {
+                /* Unit struct: struct Foo; */
+                cx->structs[cx->struct_count].size = 0;
+                cx->pos++;
+            } else {
+                cx->structs[cx->struct_count].size = 0;
+            }
+
+            struct_declare(cx);
+
+        } else if (kw == KW_ENUM) {
+            /* Parse enum definition */
+            skip_whitespace(cx);
+            char enum_name[64] = {0};
+            parse_string(cx, enum_name, sizeof(enum_name));
+            skip_whitespace(cx);
+
+            /* Store as a struct with tag field */
+            cx->structs[cx->struct_count].name = intern_str(cx, enum_name);
+            cx->structs[cx->struct_count].field_count = 0;
+            cx->structs[cx->struct_count].alignment = 4;
+
+            if (*cx->pos == '{') {
+                cx->pos++;
+                int variant_idx = 0;
+                int max_payload = 0;
+                while (*cx->pos && *cx->pos != '}') {
+                    skip_whitespace(cx);
+                    if (*cx->pos == '}') break;
+                    /* Skip comments inside enum */
+                    if (*cx->pos == '/' && *(cx->pos+1) == '/') {
+                        while (*cx->pos && *cx->pos != '\n') cx->pos++;
+                        if (*cx->pos == '\n') cx->pos++;
+                        continue;
+                    }
+                    if (*cx->pos == '/' && *(cx->pos+1) == '*') {
+                        cx->pos += 2;
+                        while (*cx->pos && !(*cx->pos == '*' && *(cx->pos+1) == '/')) cx->pos++;
+                        if (*cx->pos) cx->pos += 2;
+                        continue;
+                    }
+                    /* Skip attributes */
+                    if (*cx->pos == '#' && *(cx->pos+1) == '[') {
+                        while (*cx->pos && *cx->pos != ']') cx->pos++;
+                        if (*cx->pos == ']') cx->pos++;
+                        continue;
+                    }
+                    /* Parse variant name */
+                    char vname[32] = {0};
+                    int vi = 0;
+                    while (*cx->pos && (isalnum(*cx->pos) || *cx->pos == '_') && vi < 31) {
+                        vname[vi++] = *cx->pos++;
+                    }
+                    vname[vi] = '\0';
+
+                    /* Safety: if we couldn't parse a variant name, skip to next comma/brace */
+                    if (vi == 0) {
+                        while (*cx->pos && *cx->pos != ',' && *cx->pos != '}') {
+                            if (*cx->pos == '(' || *cx->pos == '{' || *cx->pos == '[') {
+                                int d = 1; char open = *cx->pos;
+                                char close = (open == '(') ? ')' : (open == '{') ? '}' : ']';
+                                cx->pos++;
+                                while (*cx->pos && d > 0) {
+                                    if (*cx->pos == open) d++;
+                                    else if (*cx->pos == close) d--;
+                                    cx->pos++;
+                                }
+                            } else {
+                                cx->pos++;
+                            }
+                        }
+                        if (*cx->pos == ',') cx->pos++;
+                        continue;
+                    }
+
+                    int payload_size = 0;
+                    if (*cx->pos == '(') {
+                        /* Tuple variant: Variant(Type, Type) */
+                        cx->pos++;
+                        while (*cx->pos && *cx->pos != ')') {
+                            skip_whitespace(cx);
+                            if (*cx->pos == ')') break;
+                            char *before = cx->pos;
+                            parse_type(cx);
+                            if (cx->pos == before) { cx->pos++; continue; } /* safety: avoid infinite loop */
+                            payload_size += 4;
+                            skip_whitespace(cx);
+                            if (*cx->pos == ',') cx->pos++;
+                        }
+                        if (*cx->pos == ')') cx->pos++;
+                    } else if (*cx->pos == '{') {
+                        /* Struct variant: Variant { field: Type } */
+                        cx->pos++;
+                        while (*cx->pos && *cx->pos != '}') {
+                            skip_whitespace(cx);
+                            if (*cx->pos == '}') break;
+                            /* Skip comments */
+                            if (*cx->pos == '/' && *(cx->pos+1) == '/') {
+                                while (*cx->pos && *cx->pos != '\n') cx->pos++;
+                                if (*cx->pos == '\n') cx->pos++;
+                                continue;
+                            }
+                            if (*cx->pos == '/' && *(cx->pos+1) == '*') {
+                                cx->pos += 2;
+                                while (*cx->pos && !(*cx->pos == '*' && *(cx->pos+1) == '/')) cx->pos++;
+                                if (*cx->pos) cx->pos += 2;
+                                continue;
+                            }
+                            while (*cx->pos && *cx->pos != ':' && *cx->pos != '}') cx->pos++;
+                            if (*cx->pos == ':') { cx->pos++; skip_whitespace(cx); parse_type(cx); payload_size += 4; }
+                            skip_whitespace(cx);
+                            if (*cx->pos == ',') cx->pos++;
+                        }
+                        if (*cx->pos == '}') cx->pos++;
+                    }
+                    /* = value or => value for C-like enums */
+                    skip_whitespace(cx);
+                    if (*cx->pos == '=' && *(cx->pos+1) == '>') {
+                        /* => value (macro-generated enum syntax) */
+                        cx->pos += 2;
+                        skip_whitespace(cx);
+                        /* Skip complex value expressions until comma or closing brace */
+                        int depth = 0;
+                        while (*cx->pos && !(depth == 0 && (*cx->pos == ',' || *cx->pos == '}'))) {
+                            if (*cx->pos == '(' || *cx->pos == '[' || *cx->pos == '{') depth++;
+                            else if (*cx->pos == ')' || *cx->pos == ']' || *cx->pos == '}') {
+                                if (depth > 0) depth--; else break;
+                            }
+                            cx->pos++;
+                        }
+                    } else if (*cx->pos == '=') {
+                        cx->pos++;
+                        skip_whitespace(cx);
+                        /* An explicit discriminant; later variants count on from it */
+                        long long disc;
+                        if (const_expr_at(cx, CPREC_OR, 0, 0, &disc, NULL)) variant_idx = (int)disc;
+                        /* Skip complex value expression (not just numbers - could be make_tag(b"...")) */
+                        int depth = 0;
+                        while (*cx->pos && !(depth == 0 && (*cx->pos == ',' || *cx->pos == '}'))) {
+                            if (*cx->pos == '(' || *cx->pos == '[' || *cx->pos == '{') depth++;
+                            else if (*cx->pos == ')' || *cx->pos == ']' || *cx->pos == '}') {
+                                if (depth > 0) depth--; else break;
+                            }
+                            cx->pos++;
+                        }
+                    }
+
+                    if (payload_size > max_payload) max_payload = payload_size;
+
+                    /* Store variant as a pseudo-field */
+                    struct_add_field(cx, &cx->structs[cx->struct_count], vname, TYPE_ENUM, variant_idx, payload_size);
+                    variant_idx++;
+
+                    skip_whitespace(cx);
+                    if (*cx->pos == ',') cx->pos++;
+                }
+                if (*cx->pos == '}') cx->pos++;
+                cx->structs[cx->struct_count].size = 4 + max_payload; /* tag + max payload */
+            }
+            struct_declare(cx);
+            
+        } else if (kw == KW_TRAIT) {
+            skip_whitespace(cx);
+            
+            char trait_name[64] = {0};
+            parse_string(cx, trait_name, sizeof(trait_name));
+            
+            cx->traits[cx->trait_count].name = intern_str(cx, trait_name);
+            
+            /* Parse supertrait bounds */
+            if (*cx->pos == ':') {
+                cx->pos++;
+                char supertraits[256] = {0};
+                int idx = 0;
+                while (*cx->pos && *cx->pos != '{' && idx < 255) {
+                    supertraits[idx++] = *cx->pos++;
+                }
+                cx->traits[cx->trait_count].supertraits = arena_strdup(cx, supertraits);
+            }
+            
+            trait_declare(cx);
+            
+        } else if (kw == KW_IMPL && tok_is_impl_item(cx, ti)) {
+            /* impl [<..>] [Trait for] Type — the body is walked as usual */
+            int trait_sym;
+            int type_sym = impl_header(cx, ti, &trait_sym);
+            pending_impl = 1;
+            pending_owner = type_sym;
+            impl_declare(cx, type_sym >= 0 ? sym_name(cx, type_sym) : "",
+                         trait_sym >= 0 ? sym_name(cx, trait_sym) : "");
+
+        } else if (kw == KW_USE) {
+            /* Import — skip the entire use statement to avoid keyword collisions */
+            while (ti < cx->tok_count && !tok_is_punct(&cx->tokens[ti], ';')) {
+                if (tok_is_punct(&cx->tokens[ti], '{')) ti = tok_match_close(cx, ti);
+                ti++;
+            }
+            cx->pos = tok_end(cx, &cx->tokens[ti]);
+
+        } else if (t->sym == SYM_MACRO_RULES && tok_is_punct(t + 1, '!')) {
+            /* Declarative macro */
+            cx->pos = tok_end(cx, t + 1);
+            skip_whitespace(cx);
+            
+            char macro_name[64] = {0};
+            parse_string(cx, macro_name, sizeof(macro_name));
+            
+            macro_declare(cx, macro_name, 0);
+
+        } else if ((kw == KW_CONST || kw == KW_STATIC) && t[1].kind == TOK_IDENT && tok_kw(t + 1) != KW_FN) {
+            /* const/static item: the initializer is evaluated on first use */
+            int end = const_declare(cx, ti);
+            if (end > ti) cx->pos = tok_end(cx, &cx->tokens[end]);
+        }
+        /* type/mod names are plain tokens — nothing to collect */
+
+        /* Resume at the first token the handler did not consume */
+        int next = tok_index_at(cx, cx->pos);
+        ti = (next > ti) ? next : ti + 1;
+    }
+    
+    /* Pass 2: Generate code */
+    cx->pos = source;
+    
+    emit(cx, ".text\n.align 2\n");
+    
+    /* Generate vtables for traits — labels include file hash for uniqueness */
+    int i;
+    for (i = 0; i < cx->trait_count; i++) {
+        emit(cx, "\n; Vtable for trait %s\n", cx->traits[i].name);
+        emit(cx, ".section __DATA,__const\n");
+        emit(cx, "_vtable_%s_%04x:\n", cx->traits[i].name, cx->current_file_hash);
+        emit(cx, "    .long 0  ; Size\n");
+        emit(cx, "    .long 4  ; Alignment\n");
+        emit(cx, "    .long 0  ; Destructor\n");
+        /* Method pointers would go here */
+        emit(cx, "\n");
+    }
+    
+    emit_static_data(cx);
+    emit(cx, ".text\n");
+    
+    /* Owners can be declared after their impls; resolve them now */
+    for (i = 0; i < cx->func_count; i++) {
+        if (cx->functions[i].owner) cx->functions[i].owner_struct = struct_lookup(cx, cx->functions[i].owner);
+    }
+
+    /* Pass 2.5: Emit all non-main functions straight from the Pass 1 index */
+    Function* main_fn = NULL;
+    for (i = 0; i < cx->func_count; i++) {
+        Function* fn = &cx->functions[i];
+        int p;
+
+        /* Skip main — handled separately below */
+        if (fn->name == sym_name(cx, SYM_MAIN)) {
+            if (!main_fn && !fn->owner) main_fn = fn;
+            continue;
+        }
+
+        emit(cx, "\n.align 2\n");
+        emit(cx, "_%s:\n", fn->label);
+        emit(cx, "    mflr r0\n");
+        emit(cx, "    stw r0, 8(r1)\n");
+        emit(cx, "    stwu r1, -256(r1)  ; frame for %s\n", fn->label);
+
+        /* Register variables */
+        int save_var_count = cx->var_count;
+        int save_stack_offset = cx->stack_offset;
+        cx->stack_offset = 72;
+
+        int param_types[64], param_elems[64], param_floats[64], word = 3, fpr = 1;
+        if (fn->param_count <= 64) {
+            ce_param_types(cx, fn, param_types);
+            fn_param_slices(cx, fn, param_elems);
+            fn_param_floats(cx, fn, param_floats);
+        }
+        for (p = 0; p < fn->param_count; p++, word++) {
+            int size = 4;
+            if (p == 0 && fn->has_self) {
+                /* self is passed as pointer in r3 */
+                emit(cx, "    stw r3, %d(r1)    ; param self (ptr)\n", cx->stack_offset);
+                cx->vars[cx->var_count].type = TYPE_REF;
+            } else if (fn->param_count <= 64 && param_floats[p] >= 0) {
+                /* f32/f64 arrive in f1 up, each still taking its GPR words */
+                if (param_floats[p] == TYPE_F64) word++;
+                if (!fn->param_names[p] || fpr > 13) {
+                    fpr++;
+                    continue;
+                }
+                if (param_floats[p] == TYPE_F64) {
+                    cx->stack_offset = (cx->stack_offset + 7) & ~7;
+                    size = 8;
+                }
+                float_store(cx, fpr++, cx->stack_offset, (RustType)param_floats[p], "param ", fn->param_names[p]);
+                cx->vars[cx->var_count].type = (RustType)param_floats[p];
+            } else if (fn->param_names[p] && fn->param_count <= 64 && param_elems[p] >= 0 && word < 10) {
+                /* a slice: pointer and length */
+                emit(cx, "    stw r%d, %d(r1)    ; param %s (ptr)\n", word, cx->stack_offset, fn->param_names[p]);
+                emit(cx, "    stw r%d, %d(r1)    ; param %s (len)\n", word + 1, cx->stack_offset + 4,
+                     fn->param_names[p]);
+                cx->vars[cx->var_count].type = TYPE_SLICE;
+                cx->vars[cx->var_count].elem = param_elems[p];
+                size = 8;
+                word++;
+            } else if (fn->param_names[p] && fn->param_count <= 64 && type_wide(param_types[p]) && word < 10) {
+                /* i64/u64: high word first */
+                emit(cx, "    stw r%d, %d(r1)    ; param %s (high)\n", word, cx->stack_offset, fn->param_names[p]);
+                emit(cx, "    stw r%d, %d(r1)    ; param %s (low)\n", word + 1, cx->stack_offset + 4,
+                     fn->param_names[p]);
+                cx->vars[cx->var_count].type = param_types[p];
+                size = 8;
+                word++;
+            } else if (fn->param_names[p] && word <= 10) {
+                emit(cx, "    stw r%d, %d(r1)    ; param %s\n", word, cx->stack_offset, fn->param_names[p]);
+                /* unsigned parameters divide and shift as unsigned */
+                cx->vars[cx->var_count].type = TYPE_I32;
+                if (fn->param_count <= 64 && param_types[p] >= 0 && const_unsigned(param_types[p]) &&
+                    const_bits(param_types[p]) <= 32) {
+                    cx->vars[cx->var_count].type = param_types[p];
+                }
+            } else {
+                continue;
+            }
+            cx->vars[cx->var_count].offset = cx->stack_offset;
+            cx->vars[cx->var_count].size = size;
+            var_declare(cx, fn->param_names[p]);
+            cx->stack_offset += size;
+        }
+
+        /* Store impl struct index for self.field resolution */
+        int save_impl_struct = cx->current_impl_struct;
+        cx->current_impl_struct = fn->owner_struct;
+        int ret = fn_return_int(cx, fn);
+        if (ret < 0) ret = fn_return_float(cx, fn);
+        cx->return_type = ret >= 0 ? (RustType)ret : TYPE_I32;
+
+        cx->pos = tok_ptr(cx, &cx->tokens[fn->body_tok]) + 1;
+        compile_function_body(cx, 256);
+
+        /* Default return if body didn't explicitly return */
+        emit(cx, "    li r3, 0          ; default return\n");
+        if (type_wide(cx->return_type)) emit(cx, "    li r4, 0\n");
+        emit(cx, "    addi r1, r1, 256\n");
+        emit(cx, "    lwz r0, 8(r1)\n");
+        emit(cx, "    mtlr r0\n");
+        emit(cx, "    blr\n");
+
+        /* Restore compiler state for next function */
+        scope_pop(cx, save_var_count);
+        cx->stack_offset = save_stack_offset;
+        cx->current_impl_struct = save_impl_struct;
+    }
+
+    /* main's body, if this is a binary crate */
+    char* main_start = NULL;
+    if (main_fn) {
+        main_start = tok_ptr(cx, &cx->tokens[main_fn->body_tok]);
+        if (main_fn->is_async) cx->in_async_block = 1;
+        cx->return_type = TYPE_I32;
+    }
+
+    if (!main_start) {
+        /* No main — this is a library crate. Emit all functions as stubs already done above. */
+        /* Generate impl blocks for trait implementations */
+        for (i = 0; i < cx->impl_count; i++) {
+            emit(cx, "\n; impl %s for %s\n", cx->impls[i].trait_name, cx->impls[i].struct_name);
+        }
+
+        emit_float_consts(cx);
+
+        /* PIC symbol stubs for external calls */
+        emit_pic_stubs(cx);
+        return;
+    }
+
+    emit(cx, ".globl _main\n_main:\n");
+    emit(cx, "    mflr r0\n");
+    emit(cx, "    stw r0, 8(r1)\n");
+    emit(cx, "    stwu r1, -2048(r1)  ; Large frame for Firefox\n");
+    
+    /* Initialize runtime */
+    emit(cx, "    bl _rust_runtime_init\n");
+
+    cx->pos = main_start + 1;  /* main_start is main's opening brace */
+    cx->stack_offset = 72;  /* Reset for main */
+    scope_pop(cx, 0);
+
+    compile_function_body(cx, 2048);
+
+    /* Cleanup at end of main */
+    emit(cx, "\n    ; Cleanup and exit\n");
+    
+    /* Drop all variables in reverse order - RAII */
+    for (i = cx->var_count - 1; i >= 0; i--) {
+        emit_drop_glue(cx, &cx->vars[i]);
+    }
+    
+    emit(cx, "    bl _rust_runtime_cleanup\n");
+    emit(cx, "    li r3, 0          ; exit code\n");
+    emit(cx, "    addi r1, r1, 2048\n");
+    emit(cx, "    lwz r0, 8(r1)\n");
+    emit(cx, "    mtlr r0\n");
+    emit(cx, "    blr\n");
+    
+    /* Generate runtime support functions */
+    emit(cx, "\n; Runtime support functions\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_rust_runtime_init:\n");
+    emit(cx, "    ; Initialize memory allocator, thread locals, etc\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_rust_runtime_cleanup:\n");
+    emit(cx, "    ; Clean up runtime state\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_alloc_box:\n");
+    emit(cx, "    ; r3 = size, return pointer in r3\n");
+    emit(cx, "    b L_malloc$stub   ; Use system malloc for now\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_dealloc_box:\n");
+    emit(cx, "    ; r3 = pointer\n");
+    emit(cx, "    b L_free$stub     ; Use system free\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_alloc_rc:\n");
+    emit(cx, "    ; Allocate with reference count\n");
+    emit(cx, "    b L_malloc$stub\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_rc_decrement:\n");
+    emit(cx, "    ; Decrement ref count, free if zero\n");
+    emit(cx, "    lwz r4, 0(r3)     ; load refcount\n");
+    emit(cx, "    subi r4, r4, 1    ; decrement\n");
+    emit(cx, "    stw r4, 0(r3)     ; store back\n");
+    emit(cx, "    cmpwi r4, 0\n");
+    emit(cx, "    bne 1f\n");
+    emit(cx, "    b L_free$stub     ; free if zero\n");
+    emit(cx, "1:  blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_alloc_arc:\n");
+    emit(cx, "    ; Allocate with atomic reference count\n");
+    emit(cx, "    b L_malloc$stub\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_arc_decrement:\n");
+    emit(cx, "    ; Atomic decrement ref count\n");
+    emit(cx, "    lwarx r4, 0, r3   ; load reserved\n");
+    emit(cx, "    subi r4, r4, 1    ; decrement\n");
+    emit(cx, "    stwcx. r4, 0, r3  ; store conditional\n");
+    emit(cx, "    bne- _arc_decrement ; retry if failed\n");
+    emit(cx, "    cmpwi r4, 0\n");
+    emit(cx, "    bne 1f\n");
+    emit(cx, "    b L_free$stub     ; free if zero\n");
+    emit(cx, "1:  blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_vec_new:\n");
+    emit(cx, "    ; Create new Vec — allocate struct + initial buffer\n");
+    emit(cx, "    mflr r0\n");
+    emit(cx, "    stw r0, 8(r1)\n");
+    emit(cx, "    stwu r1, -48(r1)\n");
+    emit(cx, "    li r3, 12         ; Vec struct size\n");
+    emit(cx, "    bl L_malloc$stub\n");
+    emit(cx, "    stw r3, 24(r1)    ; save Vec ptr\n");
+    emit(cx, "    li r4, 16         ; initial capacity (4 elements)\n");
+    emit(cx, "    stw r4, 28(r1)    ; save cap request\n");
+    emit(cx, "    mr r14, r3        ; save vec ptr\n");
+    emit(cx, "    li r3, 16         ; alloc buffer for 4 i32 elements\n");
+    emit(cx, "    bl L_malloc$stub\n");
+    emit(cx, "    lwz r14, 24(r1)   ; restore vec ptr\n");
+    emit(cx, "    stw r3, 0(r14)    ; ptr = buffer\n");
+    emit(cx, "    li r4, 0\n");
+    emit(cx, "    stw r4, 4(r14)    ; len = 0\n");
+    emit(cx, "    li r4, 4\n");
+    emit(cx, "    stw r4, 8(r14)    ; cap = 4\n");
+    emit(cx, "    mr r3, r14        ; return Vec ptr\n");
+    emit(cx, "    addi r1, r1, 48\n");
+    emit(cx, "    lwz r0, 8(r1)\n");
+    emit(cx, "    mtlr r0\n");
+    emit(cx, "    blr\n");
+
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_vec_push:\n");
+    emit(cx, "    ; r3 = vec ptr, r4 = value to push\n");
+    emit(cx, "    mflr r0\n");
+    emit(cx, "    stw r0, 8(r1)\n");
+    emit(cx, "    stwu r1, -48(r1)\n");
+    emit(cx, "    stw r3, 24(r1)    ; save vec ptr\n");
+    emit(cx, "    stw r4, 28(r1)    ; save value\n");
+    emit(cx, "    lwz r5, 4(r3)     ; load len\n");
+    emit(cx, "    lwz r6, 8(r3)     ; load cap\n");
+    emit(cx, "    cmpw r5, r6\n");
+    emit(cx, "    blt 1f            ; skip realloc if space available\n");
+    emit(cx, "    ; TODO: realloc buffer (double capacity)\n");
+    emit(cx, "1:\n");
+    emit(cx, "    lwz r3, 24(r1)    ; reload vec ptr\n");
+    emit(cx, "    lwz r5, 4(r3)     ; reload len\n");
+    emit(cx, "    lwz r6, 0(r3)     ; load data ptr\n");
+    emit(cx, "    slwi r7, r5, 2    ; len * 4 = byte offset\n");
+    emit(cx, "    lwz r4, 28(r1)    ; reload value\n");
+    emit(cx, "    stwx r4, r6, r7   ; store element at data[len]\n");
+    emit(cx, "    addi r5, r5, 1    ; increment len\n");
+    emit(cx, "    stw r5, 4(r3)     ; store new len\n");
+    emit(cx, "    addi r1, r1, 48\n");
+    emit(cx, "    lwz r0, 8(r1)\n");
+    emit(cx, "    mtlr r0\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_vec_drop:\n");
+    emit(cx, "    ; r3 = vec ptr\n");
+    emit(cx, "    lwz r3, 0(r3)     ; load data ptr\n");
+    emit(cx, "    cmpwi r3, 0\n");
+    emit(cx, "    beq 1f\n");
+    emit(cx, "    b L_free$stub     ; free data\n");
+    emit(cx, "1:  blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_string_drop:\n");
+    emit(cx, "    ; Same as vec_drop\n");
+    emit(cx, "    b _vec_drop\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_create_future:\n");
+    emit(cx, "    ; Create Future for async\n");
+    emit(cx, "    li r3, 16         ; Future size\n");
+    emit(cx, "    b L_malloc$stub\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_await_future:\n");
+    emit(cx, "    ; r3 = future ptr\n");
+    emit(cx, "    ; Simplified - would need executor integration\n");
+    emit(cx, "    lwz r3, 12(r3)    ; get result\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_rust_println:\n");
+    emit(cx, "    ; Simplified println\n");
+    emit(cx, "    ; Would format and call write syscall\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_rust_assert:\n");
+    emit(cx, "    ; Assert implementation\n");
+    emit(cx, "    cmpwi r3, 0\n");
+    emit(cx, "    bne 1f\n");
+    emit(cx, "    bl _panic         ; panic if false\n");
+    emit(cx, "1:  blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_panic:\n");
+    emit(cx, "    ; Panic handler\n");
+    emit(cx, "    ; Would print message and abort\n");
+    emit(cx, "    li r0, 1          ; exit syscall\n");
+    emit(cx, "    li r3, 1          ; error code\n");
+    emit(cx, "    sc                ; system call\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_panic_unwrap:\n");
+    emit(cx, "    ; Panic on unwrap None/Err\n");
+    emit(cx, "    b _panic\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_try_operator:\n");
+    emit(cx, "    ; Handle ? operator\n");
+    emit(cx, "    ; Check if Ok/Some, return early if Err/None\n");
+    emit(cx, "    lwz r4, 0(r3)     ; load tag\n");
+    emit(cx, "    cmpwi r4, 0\n");
+    emit(cx, "    bne 1f            ; if not Ok/Some\n");
+    emit(cx, "    lwz r3, 4(r3)     ; extract value\n");
+    emit(cx, "    blr\n");
+    emit(cx, "1:  ; Return early with Err/None\n");
+    emit(cx, "    addi r1, r1, 2048 ; unwind stack\n");
+    emit(cx, "    lwz r0, 8(r1)\n");
+    emit(cx, "    mtlr r0\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_clone_impl:\n");
+    emit(cx, "    ; Generic clone implementation\n");
+    emit(cx, "    ; Would deep copy based on type\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_drop_impl:\n");
+    emit(cx, "    ; Generic drop implementation\n");
+    emit(cx, "    ; Would call destructor based on type\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_create_iter:\n");
+    emit(cx, "    ; Create iterator from collection\n");
+    emit(cx, "    li r4, 16         ; Iterator size\n");
+    emit(cx, "    mr r5, r3         ; save collection\n");
+    emit(cx, "    li r3, 16\n");
+    emit(cx, "    bl L_malloc$stub\n");
+    emit(cx, "    stw r5, 0(r3)     ; store collection ptr\n");
+    emit(cx, "    li r4, 0\n");
+    emit(cx, "    stw r4, 4(r3)     ; index = 0\n");
+    emit(cx, "    blr\n");
+    
+    emit(cx, "\n.align 2\n");
+    emit(cx, "_iter_collect:\n");
+    emit(cx, "    ; Collect iterator into Vec\n");
+    emit(cx, "    bl _vec_new\n");
+    emit(cx, "    ; Would iterate and push all elements\n");
+    emit(cx, "    blr\n");
+    
+    /* rustc evaluates every const item, used or not */
+    for (i = 0; i < cx->const_count; i++) {
+        if (cx->sym_entries[cx->consts[i].sym].const_idx == i) const_item_eval(cx, i);
+    }
+    emit_float_consts(cx);
+    emit_pic_stubs(cx);
+}
+
+/* Peephole optimizer (-C opt-level=1 and up). At those levels the whole
+ * file's assembly is held in the output buffer; pipeline_run() splits it
+ * into a line list, rewrites short instruction windows until nothing
+ * changes, and emits what is left:
+ *   store-load      stw rX, D(rB) ; lwz rY, D(rB)  ->  drop lwz / mr rY, rX
+ *   redundant-move  mr rX, rX; mr back; op rT + mr rV, rT  ->  op rV
+ *   copy-prop       mr rA, rB: later reads of rA read rB; drop the mr
+ *   branch-next     b/bcc L straight into L:
+ *   cmp-imm         li rA, imm ; cmpw rX, rA  ->  cmpwi rX, imm
+ *   dead-label      local L labels nothing refers to
+ * Register rewrites that delete a def only fire when peep_live() shows
+ * the register is overwritten before any read on every path. */
+enum { PEEP_INSN, PEEP_LABEL, PEEP_OTHER };
+enum {
+    PEEP_STORE_LOAD, PEEP_MOVE, PEEP_COPY_PROP, PEEP_BRANCH_NEXT, PEEP_CMP_IMM, PEEP_DEAD_LABEL,
+    PEEP_PATTERNS
+};
+
+static const char* peep_pattern_names[PEEP_PATTERNS] = {
+    "store-load", "redundant-move", "copy-prop", "branch-next", "cmp-imm", "dead-label"
+};
+
+typedef struct {
+    const char* text;           /* the line, not NUL-terminated */
+    int len;
+    int kind;
+    int dead;
+    char op[16];
+    int nargs;
+    const char* arg[4];         /* operands, trimmed */
+    int arg_len[4];
+    const char* comment;        /* trailing "; ..." or NULL */
+    int comment_len;
+    const char* before;         /* lines emitted ahead of this one, or NULL */
+    const char* after;          /* ... and after it */
+} PeepLine;
+
+/* A function with the standard mflr/stwu prologue */
+typedef struct {
+    int entry;                  /* its stwu line */
+    int end;                    /* first line past it */
+    int frame;
+    int locals_end;             /* first frame byte above everything codegen uses */
+    int exact;                  /* ... and no object in the frame may reach past it */
+    unsigned saved;             /* nonvolatile registers save-regs saves, */
+    int save_base;              /* ... from this offset up */
+} PeepFunc;
+
+typedef struct {
+    PeepLine* lines;
+    int count;
+    int line_capacity;          /* lines allocated; a reload reuses them */
+    int* live_seen;             /* [line]: the peep_live() query that walked from it */
+    int live_query;
+    int* label_at;              /* symbol -> line index + 1 of its label */
+    int label_syms;
+    int hits[PEEP_PATTERNS];
+    PeepFunc* funcs;            /* functions that get a save set */
+    int func_count;
+    int func_capacity;
+    int promoted;               /* -Z peephole-stats: slots given a register, */
+    int fpr_promoted;           /* ... of them f32/f64 slots in FPRs, */
+    int spilled;                /* ... left in memory under pressure, */
+    int saved;                  /* ... and registers saved in prologues */
+    int leaves;                 /* frame: functions without an LR save, */
+    int frameless;              /* ... and of those without a frame */
+    int inlined;                /* inline: calls replaced by the callee, */
+    int inlined_extern;         /* ... of them into other crates' functions */
+    int kept;                   /* lines left after the pipeline */
+    int folded;                 /* const-fold: operations computed, */
+    int immediates;             /* ... constant operands made immediates, */
+    int reduced;                /* ... multiplies and divides made shifts, */
+    int branches;               /* ... branches decided, */
+    int dead;                   /* ... and unused defs deleted */
+    int slots_shared;           /* stack-color: slots moved onto another's, */
+    int frame_freed;            /* ... and frame bytes that gave back */
+    struct IrProgram* ir;       /* between ir-build and ir-lower */
+} PeepState;
+
+static void peep_parse(PeepLine* l) {
+    const char* p = l->text;
+    const char* end = l->text + l->len;
+    l->kind = PEEP_OTHER;
+    l->nargs = 0;
+    l->op[0] = '\0';
+    l->comment = NULL;
+    if (p < end && *p != ' ' && *p != '\t') {
+        const char* colon = memchr(p, ':', l->len);
+        if (colon && colon + 1 == end) l->kind = PEEP_LABEL;
+        return;
+    }
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p == end || *p == ';' || *p == '.') return;
+
+    int n = 0;
+    while (p < end && *p != ' ' && *p != '\t' && n < (int)sizeof(l->op) - 1) l->op[n++] = *p++;
+    l->op[n] = '\0';
+    l->kind = PEEP_INSN;
+    const char* semi = p;
+    while (semi < end && *semi != ';') semi++;
+    if (semi < end) {
+        l->comment = semi;
+        l->comment_len = (int)(end - semi);
+        end = semi;
+    }
+    while (p < end && l->nargs < 4) {
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        if (p == end) break;
+        const char* a = p;
+        while (p < end && *p != ',') p++;
+        const char* e = p;
+        while (e > a && (e[-1] == ' ' || e[-1] == '\t')) e--;
+        l->arg[l->nargs] = a;
+        l->arg_len[l->nargs++] = (int)(e - a);
+        if (p < end) p++;
+    }
+}
+
+/* Replace a line's instruction, keeping its comment */
+static void peep_rewrite(CompilerContext* cx, PeepLine* l, const char* insn) {
+    char buf[256];
+    int n;
+    if (l->comment) {
+        n = snprintf(buf, sizeof(buf), "    %-18s%.*s", insn, l->comment_len, l->comment);
+    } else {
+        n = snprintf(buf, sizeof(buf), "    %s", insn);
+    }
+    if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;
+    l->text = arena_strndup(cx, buf, n);
+    l->len = n;
+    peep_parse(l);
+}
+
+/* Register number of an "rN" (file 'r') or "fN" (file 'f') operand,
+ * -1 otherwise */
+static int peep_regfile(const PeepLine* l, int k, char file) {
+    if (k >= l->nargs || l->arg_len[k] < 2 || l->arg_len[k] > 3 || l->arg[k][0] != file) return -1;
+    int r = 0, i;
+    for (i = 1; i < l->arg_len[k]; i++) {
+        if (!isdigit((unsigned char)l->arg[k][i])) return -1;
+        r = r * 10 + (l->arg[k][i] - '0');
+    }
+    return r < 32 ? r : -1;
+}
+
+static int peep_reg(const PeepLine* l, int k) {
+    return peep_regfile(l, k, 'r');
+}
+
+/* Bytes an lfs/stfs (4) or lfd/stfd (8) moves, 0 for other ops */
+static int peep_fp_width(const char* op) {
+    if (strcmp(op, "lfs") == 0 || strcmp(op, "stfs") == 0) return 4;
+    if (strcmp(op, "lfd") == 0 || strcmp(op, "stfd") == 0) return 8;
+    return 0;
+}
+
+/* Base register of a "D(rN)" operand, -1 otherwise */
+static int peep_mem_base(const PeepLine* l, int k) {
+    if (k >= l->nargs) return -1;
+    const char* open = l->arg[k] + l->arg_len[k] - 1;
+    while (open > l->arg[k] && *open != '(') open--;      /* lo16(_X)(rN): the last one */
+    if (*open != '(' || l->arg[k][l->arg_len[k] - 1] != ')' || open[1] != 'r') return -1;
+    int r = 0;
+    const char* p;
+    for (p = open + 2; p < l->arg[k] + l->arg_len[k] - 1; p++) {
+        if (!isdigit((unsigned char)*p)) return -1;
+        r = r * 10 + (*p - '0');
+    }
+    return r < 32 ? r : -1;
+}
+
+/* Displacement of a "D(rN)" operand with a plain decimal D; 0 if it has
+ * none (symbolic lo16(...) and the like) */
+static int peep_mem_disp(const PeepLine* l, int k, int* disp) {
+    const char* p = l->arg[k];
+    const char* open = memchr(p, '(', l->arg_len[k]);
+    int neg = 0, d = 0;
+    if (!open || open == p) return 0;
+    if (*p == '-') { neg = 1; p++; }
+    for (; p < open; p++) {
+        if (!isdigit((unsigned char)*p)) return 0;
+        d = d * 10 + (*p - '0');
+    }
+    *disp = neg ? -d : d;
+    return 1;
+}
+
+/* Value of a plain decimal operand k. The operands point into the whole
+ * file's text, so this must not go through sscanf(), which measures the
+ * rest of the string first. */
+static int peep_arg_int(const PeepLine* l, int k, int* value) {
+    const char* p;
+    const char* end;
+    int neg = 0, v = 0;
+    if (k >= l->nargs || l->arg_len[k] == 0) return 0;
+    p = l->arg[k];
+    end = p + l->arg_len[k];
+    if (*p == '-') { neg = 1; p++; }
+    if (p == end) return 0;
+    for (; p < end; p++) {
+        if (!isdigit((unsigned char)*p)) return 0;
+        v = v * 10 + (*p - '0');
+    }
+    *value = neg ? -v : v;
+    return 1;
+}
+
+static int peep_args_equal(const PeepLine* a, int i, const PeepLine* b, int j) {
+    return i < a->nargs && j < b->nargs && a->arg_len[i] == b->arg_len[j]
+        && memcmp(a->arg[i], b->arg[j], a->arg_len[i]) == 0;
+}
+
+/* Next live line after i that is not a bare comment; -1 at the end */
+static int peep_next(PeepState* ps, int i) {
+    for (i++; i < ps->count; i++) {
+        PeepLine* l = &ps->lines[i];
+        if (l->dead) continue;
+        if (l->kind == PEEP_OTHER) {
+            const char* p = l->text;
+            while (p < l->text + l->len && (*p == ' ' || *p == '\t')) p++;
+            if (p == l->text + l->len || *p == ';') continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
+static int peep_is_branch(const char* op) {
+    static const char* branches[] = {
+        "b", "beq", "bne", "blt", "ble", "bgt", "bge", "bso", "bns", "bdnz", "bdz", NULL
+    };
+    int i;
+    for (i = 0; branches[i]; i++) {
+        if (strcmp(op, branches[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/* Line index of the label a branch operand names, -1 if not local */
+static int peep_label_line(CompilerContext* cx, PeepState* ps, const PeepLine* l, int k) {
+    int sym = sym_find(cx, l->arg[k], l->arg_len[k]);
+    if (sym < 0 || sym >= ps->label_syms) return -1;
+    return ps->label_at[sym] - 1;
+}
+
+/* Load/store with update (lwzu, stwu, ...): writes its base too */
+static int peep_is_update(const PeepLine* l) {
+    int k;
+    for (k = 0; k < l->nargs; k++) {
+        if (peep_mem_base(l, k) >= 0) return strchr(l->op + 1, 'u') != NULL;
+    }
+    return 0;
+}
+
+/* GPRs an instruction reads and writes, as bitmasks. Returns -1 for
+ * control flow and anything else the passes should not reason about. */
+static int peep_effects(const PeepLine* l, unsigned* use, unsigned* def) {
+    int k, r;
+    *use = *def = 0;
+    if (l->op[0] == 'b' || strcmp(l->op, "sc") == 0 || strcmp(l->op, "lmw") == 0
+            || strcmp(l->op, "stmw") == 0 || strncmp(l->op, "rlwimi", 6) == 0) {
+        return -1;
+    }
+    /* Stores, compares and moves to SPRs only read; everything else
+     * writes its first operand and reads the rest */
+    int reads_all = strncmp(l->op, "st", 2) == 0 || strncmp(l->op, "cmp", 3) == 0
+                 || strncmp(l->op, "tw", 2) == 0 || strncmp(l->op, "mt", 2) == 0;
+    for (k = 0; k < l->nargs; k++) {
+        if ((r = peep_reg(l, k)) >= 0) {
+            if (k == 0 && !reads_all) *def |= 1u << r;
+            else *use |= 1u << r;
+        } else if ((r = peep_mem_base(l, k)) >= 0) {
+            *use |= 1u << r;
+            if (peep_is_update(l)) *def |= 1u << r;
+        }
+    }
+    return 0;
+}
+
+/* Could reg be read after line i before being overwritten? Follows
+ * branches, each target once per query so a loop ends the path rather
+ * than the budget; anything it does not understand counts as a read. */
+static int peep_live(CompilerContext* cx, PeepState* ps, int i, int reg, int* budget) {
+    while ((i = peep_next(ps, i)) >= 0) {
+        PeepLine* l = &ps->lines[i];
+        unsigned use, def;
+        if (--*budget < 0) return 1;
+        if (l->kind != PEEP_INSN) {
+            if (l->kind == PEEP_OTHER && l->text[0] != ' ' && l->text[0] != '\t') return 1;
+            continue;
+        }
+
+        if (peep_is_branch(l->op)) {
+            int target = peep_label_line(cx, ps, l, l->nargs - 1);
+            int seen;
+            if (target < 0) return 1;
+            seen = ps->live_seen[target] == ps->live_query;
+            ps->live_seen[target] = ps->live_query;
+            if (strcmp(l->op, "b") == 0) {
+                if (seen) return 0;
+                i = target;
+                continue;
+            }
+            if (!seen && peep_live(cx, ps, target, reg, budget)) return 1;
+            continue;
+        }
+        if (strcmp(l->op, "blr") == 0) {
+            /* r3/r4 carry the result. Dropping a write to a nonvolatile
+             * register can only help a caller that expects it kept. */
+            return reg == 1 || reg == 3 || reg == 4;
+        }
+        if (strcmp(l->op, "bl") == 0) {
+            if (reg >= 3 && reg <= 10) return 1;             /* arguments */
+            if (reg == 0 || (reg >= 3 && reg <= 12)) return 0; /* clobbered */
+            continue;
+        }
+        if (peep_effects(l, &use, &def) < 0 || (use & (1u << reg))) return 1;
+        if (def & (1u << reg)) return 0;
+    }
+    return 1;
+}
+
+static int peep_dead_after(CompilerContext* cx, PeepState* ps, int i, int reg) {
+    int budget = 256;
+    ps->live_query++;
+    return !peep_live(cx, ps, i, reg, &budget);
+}
+
+/* Rewrite l to read register to wherever it reads from; the operands
+ * it writes stay as they are */
+static void peep_substitute(CompilerContext* cx, PeepLine* l, int from, int to) {
+    char insn[128];
+    int reads_all = strncmp(l->op, "st", 2) == 0 || strncmp(l->op, "cmp", 3) == 0
+                 || strncmp(l->op, "tw", 2) == 0 || strncmp(l->op, "mt", 2) == 0;
+    int n = snprintf(insn, sizeof(insn), "%s", l->op);
+    int k;
+    for (k = 0; k < l->nargs && n < (int)sizeof(insn); k++) {
+        const char* sep = k ? ", " : " ";
+        if (peep_reg(l, k) == from && (k > 0 || reads_all)) {
+            n += snprintf(insn + n, sizeof(insn) - n, "%sr%d", sep, to);
+        } else if (peep_mem_base(l, k) == from) {
+            const char* open = memchr(l->arg[k], '(', l->arg_len[k]);
+            n += snprintf(insn + n, sizeof(insn) - n, "%s%.*s(r%d)", sep,
+                          (int)(open - l->arg[k]), l->arg[k], to);
+        } else {
+            n += snprintf(insn + n, sizeof(insn) - n, "%s%.*s", sep, l->arg_len[k], l->arg[k]);
+        }
+    }
+    peep_rewrite(cx, l, insn);
+}
+
+/* Same instruction with rd as its destination */
+static void peep_retarget(CompilerContext* cx, PeepLine* l, int rd) {
+    char insn[128];
+    int n = snprintf(insn, sizeof(insn), "%s r%d", l->op, rd);
+    int k;
+    for (k = 1; k < l->nargs && n < (int)sizeof(insn); k++) {
+        n += snprintf(insn + n, sizeof(insn) - n, ", %.*s", l->arg_len[k], l->arg[k]);
+    }
+    peep_rewrite(cx, l, insn);
+}
+
+/* One sweep of the window patterns; returns the number of rewrites */
+static int peep_sweep(CompilerContext* cx, PeepState* ps) {
+    int changes = 0;
+    int i;
+    for (i = peep_next(ps, -1); i >= 0; i = peep_next(ps, i)) {
+        PeepLine* a = &ps->lines[i];
+        if (a->kind != PEEP_INSN) continue;
+        int j = peep_next(ps, i);
+        PeepLine* b = j >= 0 ? &ps->lines[j] : NULL;
+        char insn[96];
+
+        /* mr rX, rX */
+        if (strcmp(a->op, "mr") == 0 && a->nargs == 2 && peep_reg(a, 0) >= 0
+                && peep_reg(a, 0) == peep_reg(a, 1)) {
+            a->dead = 1;
+            ps->hits[PEEP_MOVE]++;
+            changes++;
+            continue;
+        }
+
+        /* mr rA, rB: following straight-line reads of rA read rB, and
+         * the move goes if that leaves rA dead */
+        if (strcmp(a->op, "mr") == 0 && a->nargs == 2) {
+            int ra = peep_reg(a, 0), rb = peep_reg(a, 1);
+            if (ra > 1 && rb > 1 && ra != rb) {
+                int k, rewrote = 0;
+                for (k = j; k >= 0; k = peep_next(ps, k)) {
+                    PeepLine* c = &ps->lines[k];
+                    unsigned use, def;
+                    if (c->kind != PEEP_INSN || peep_effects(c, &use, &def) < 0 || peep_is_update(c)) break;
+                    if (use & (1u << ra)) {
+                        peep_substitute(cx, c, ra, rb);
+                        rewrote = 1;
+                    }
+                    if (def & ((1u << ra) | (1u << rb))) break;
+                }
+                if (peep_dead_after(cx, ps, i, ra)) {
+                    a->dead = 1;
+                    ps->hits[PEEP_COPY_PROP]++;
+                    changes++;
+                    continue;
+                }
+                changes += rewrote;
+            }
+        }
+        if (!b || b->kind != PEEP_INSN) {
+            /* branch-next: b L, then only labels up to L: */
+            if (b && b->kind == PEEP_LABEL && peep_is_branch(a->op) && a->nargs >= 1) {
+                int target = peep_label_line(cx, ps, a, a->nargs - 1);
+                int k;
+                for (k = j; k >= 0 && ps->lines[k].kind == PEEP_LABEL; k = peep_next(ps, k)) {
+                    if (k == target) {
+                        a->dead = 1;
+                        ps->hits[PEEP_BRANCH_NEXT]++;
+                        changes++;
+                        break;
+                    }
+                }
+            }
+            continue;
+        }
+
+        /* stw rX, D(rB) ; lwz rY, D(rB) */
+        if (strcmp(a->op, "stw") == 0 && strcmp(b->op, "lwz") == 0 && a->nargs == 2
+                && b->nargs == 2 && peep_args_equal(a, 1, b, 1) && peep_mem_base(a, 1) >= 0
+                && peep_reg(a, 0) >= 0 && peep_reg(b, 0) >= 0) {
+            if (peep_reg(a, 0) == peep_reg(b, 0)) {
+                b->dead = 1;
+            } else {
+                snprintf(insn, sizeof(insn), "mr r%d, r%d", peep_reg(b, 0), peep_reg(a, 0));
+                peep_rewrite(cx, b, insn);
+            }
+            ps->hits[PEEP_STORE_LOAD]++;
+            changes++;
+            continue;
+        }
+
+        /* mr rA, rB ; mr rB, rA */
+        if (strcmp(a->op, "mr") == 0 && strcmp(b->op, "mr") == 0 && a->nargs == 2 && b->nargs == 2
+                && peep_reg(a, 0) >= 0 && peep_reg(a, 0) == peep_reg(b, 1)
+                && peep_reg(a, 1) >= 0 && peep_reg(a, 1) == peep_reg(b, 0)) {
+            b->dead = 1;
+            ps->hits[PEEP_MOVE]++;
+            changes++;
+            continue;
+        }
+
+        /* op rT, ... ; mr rV, rT  ->  op rV, ...  with rT dead afterwards */
+        if (strcmp(b->op, "mr") == 0 && b->nargs == 2 && a->nargs >= 1) {
+            int rt = peep_reg(a, 0), rv = peep_reg(b, 0);
+            unsigned use, def;
+            if (rt >= 0 && rt != 1 && rv >= 0 && rv != 1 && rv != rt && peep_reg(b, 1) == rt
+                    && peep_effects(a, &use, &def) == 0 && def == (1u << rt) && !peep_is_update(a)
+                    && peep_dead_after(cx, ps, j, rt)) {
+                peep_retarget(cx, a, rv);
+                b->dead = 1;
+                ps->hits[PEEP_MOVE]++;
+                changes++;
+                continue;
+            }
+        }
+
+        /* li rA, imm ; cmpw rX, rA  ->  cmpwi rX, imm */
+        if (strcmp(a->op, "li") == 0 && (strcmp(b->op, "cmpw") == 0 || strcmp(b->op, "cmplw") == 0)
+                && a->nargs == 2 && b->nargs == 2 && peep_reg(a, 0) >= 0
+                && peep_reg(b, 1) == peep_reg(a, 0) && peep_reg(b, 0) != peep_reg(a, 0)
+                && (b->op[3] != 'l' || a->arg[1][0] != '-')
+                && peep_dead_after(cx, ps, j, peep_reg(a, 0))) {
+            snprintf(insn, sizeof(insn), "%si r%d, %.*s", b->op, peep_reg(b, 0),
+                     a->arg_len[1], a->arg[1]);
+            peep_rewrite(cx, b, insn);
+            a->dead = 1;
+            ps->hits[PEEP_CMP_IMM]++;
+            changes++;
+            continue;
+        }
+    }
+    return changes;
+}
 
-                strcpy(vars[var_count].name, var_name);
-                vars[var_count].offset = stack_offset;
-                vars[var_count].is_mut = is_mut;
-                stack_offset += (vars[var_count].size > 0 ? vars[var_count].size : 4);
-                var_count++;
+/* Local labels (L..., not stubs) that no operand mentions */
+static int peep_prune_labels(CompilerContext* cx, PeepState* ps) {
+    char* used = arena_alloc(cx, ps->label_syms + 1);
+    int removed = 0;
+    int i;
+    for (i = 0; i < ps->count; i++) {
+        PeepLine* l = &ps->lines[i];
+        const char* p = l->text;
+        const char* end = l->comment ? l->comment : l->text + l->len;
+        if (l->dead || l->kind == PEEP_LABEL) continue;
+        while (p < end) {
+            if (*p == ';') break;
+            if (isalpha((unsigned char)*p) || *p == '_') {
+                const char* w = p;
+                while (p < end && (isalnum((unsigned char)*p) || *p == '_' || *p == '$')) p++;
+                int sym = sym_find(cx, w, (int)(p - w));
+                if (sym >= 0 && sym < ps->label_syms) used[sym] = 1;
+            } else {
+                p++;
             }
+        }
+    }
+    for (i = 0; i < ps->count; i++) {
+        PeepLine* l = &ps->lines[i];
+        if (l->dead || l->kind != PEEP_LABEL || l->text[0] != 'L' || memchr(l->text, '$', l->len)) continue;
+        int sym = sym_find(cx, l->text, l->len - 1);
+        if (sym >= 0 && sym < ps->label_syms && !used[sym]) {
+            l->dead = 1;
+            ps->label_at[sym] = 0;
+            removed++;
+        }
+    }
+    ps->hits[PEEP_DEAD_LABEL] += removed;
+    return removed;
+}
 
-            while (*pos && *pos != ';') pos++;
-            if (*pos == ';') pos++;
+/* Register allocation (-C opt-level=2 and up). Codegen keeps every
+ * local in a word stack slot and computes in r14-r16. Slots whose
+ * address is never taken are promoted to nonvolatile registers the
+ * function does not otherwise touch. A slot's live range is the span of
+ * lines from its first to its last access, stretched over every loop it
+ * overlaps. Ranges get registers by linear scan; when none is free, the
+ * range with the fewest accesses (each one inside a loop counting as
+ * PEEP_LOOP_WEIGHT) stays in memory, the one that ends last breaking
+ * ties. Each function then saves
+ * exactly the nonvolatile registers it writes at the top of its frame
+ * (peep_save_regs). */
+typedef struct {
+    int offset;
+    int start;                  /* first and last line accessing it */
+    int end;
+    int reg;                    /* -1 = stays in the stack slot */
+    int ok;                     /* only ever a plain lwz/stw of a GPR */
+    int weight;                 /* accesses, loops weighing more */
+} PeepSlot;
 
-        } else if (strncmp(pos, "unsafe ", 7) == 0) {
-            pos += 7;
-            skip_whitespace();
-            if (*pos == '{') {
-                printf("    ; unsafe block\n");
-                in_unsafe_block = 1;
-                pos++;
-            }
+#define PEEP_LOOP_WEIGHT 8
 
-        } else if (strncmp(pos, "if ", 3) == 0) {
-            pos += 3;
-            skip_whitespace();
-            static int if_label = 0;
-            int my_label = if_label++;
+typedef struct {
+    int top;                    /* loop label line */
+    int bottom;                 /* the branch back to it */
+} PeepLoop;
+
+/* If line i is the label of a function with the usual
+ * mflr r0 / stw r0, 8(r1) / stwu r1, -F(r1) prologue, return the stwu line */
+static int peep_function_at(PeepState* ps, int i, int* frame) {
+    PeepLine* l = &ps->lines[i];
+    int k, disp;
+    if (l->dead || l->kind != PEEP_LABEL || l->text[0] != '_') return -1;
+    if ((k = peep_next(ps, i)) < 0 || strcmp(ps->lines[k].op, "mflr") != 0) return -1;
+    if ((k = peep_next(ps, k)) < 0 || strcmp(ps->lines[k].op, "stw") != 0) return -1;
+    if ((k = peep_next(ps, k)) < 0) return -1;
+    l = &ps->lines[k];
+    if (strcmp(l->op, "stwu") != 0 || peep_reg(l, 0) != 1 || peep_mem_base(l, 1) != 1
+            || !peep_mem_disp(l, 1, &disp) || disp >= 0) {
+        return -1;
+    }
+    *frame = -disp;
+    return k;
+}
 
-            if (strncmp(pos, "let ", 4) == 0) {
-                /* if let Some(x) = expr { ... } */
-                pos += 4;
-                skip_whitespace();
-                printf("    ; if let\n");
+static int peep_is_frame_pop(const PeepLine* l, int frame) {
+    int disp = 0;
+    return strcmp(l->op, "addi") == 0 && l->nargs == 3 && peep_reg(l, 0) == 1 && peep_reg(l, 1) == 1
+        && peep_arg_int(l, 2, &disp) && disp == frame;
+}
 
-                /* Parse pattern: Some(var) or Ok(var) */
-                int is_some = 0, is_ok = 0;
-                if (strncmp(pos, "Some(", 5) == 0) { pos += 5; is_some = 1; }
-                else if (strncmp(pos, "Ok(", 3) == 0) { pos += 3; is_ok = 1; }
+static int peep_slot_cmp(const void* a, const void* b) {
+    return ((const PeepSlot*)a)->start - ((const PeepSlot*)b)->start;
+}
 
-                char bind_var[64] = {0};
-                parse_string(bind_var, sizeof(bind_var));
-                while (*pos && *pos != '=') pos++;
-                if (*pos == '=') pos++;
-                skip_whitespace();
+/* Whether the bctr at line i dispatches through a match jump table,
+ * which codegen emits right behind it and whose targets all follow */
+static int peep_is_jump_table(PeepState* ps, int i) {
+    int j = peep_next(ps, i);
+    PeepLine* l = j >= 0 ? &ps->lines[j] : NULL;
+    return l && l->kind == PEEP_OTHER && l->len >= 27 && memcmp(l->text, "    .section __TEXT,__const", 27) == 0;
+}
 
-                /* Parse the expression being matched */
-                char match_expr[64] = {0};
-                parse_string(match_expr, sizeof(match_expr));
+/* Size of the object an "la" points at, from codegen's "&name, N bytes"
+ * comment; 0 when it does not say */
+static int la_extent(const char* comment, int len) {
+    const char* comma;
+    const char* end = comment + len;
+    int size = 0;
+    if (!comment || len < 3 || comment[2] != '&') return 0;
+    comma = memchr(comment, ',', len);
+    if (!comma) return 0;
+    /* by hand: the comment is not NUL-terminated, see peep_arg_int() */
+    for (comma++; comma < end && *comma == ' '; comma++) {
+    }
+    if (comma == end || !isdigit((unsigned char)*comma)) return 0;
+    while (comma < end && isdigit((unsigned char)*comma)) size = size * 10 + (*comma++ - '0');
+    if (end - comma < 6 || memcmp(comma, " bytes", 6) != 0) return 0;
+    return size;
+}
 
-                int expr_off = -1;
-                RustType expr_type = TYPE_I32;
-                for (i = 0; i < var_count; i++) {
-                    if (strcmp(vars[i].name, match_expr) == 0) {
-                        expr_off = vars[i].offset;
-                        expr_type = vars[i].type;
-                        break;
-                    }
-                }
+static int peep_la_extent(const PeepLine* l) {
+    return la_extent(l->comment, l->comment_len);
+}
 
-                if (expr_off >= 0) {
-                    printf("    lwz r14, %d(r1)   ; load %s tag\n", expr_off, match_expr);
-                    if (is_some || expr_type == TYPE_OPTION) {
-                        printf("    cmpwi r14, 0      ; None?\n");
-                        printf("    beq Lelse_%d\n", my_label);
-                    } else if (is_ok || expr_type == TYPE_RESULT) {
-                        printf("    cmpwi r14, 1      ; Err?\n");
-                        printf("    beq Lelse_%d\n", my_label);
-                    }
-                    /* Bind the inner value */
-                    printf("    lwz r14, %d(r1)   ; load inner value\n", expr_off + 4);
-                    printf("    stw r14, %d(r1)   ; bind %s\n", stack_offset, bind_var);
-                    strcpy(vars[var_count].name, bind_var);
-                    vars[var_count].offset = stack_offset;
-                    vars[var_count].type = TYPE_I32;
-                    vars[var_count].size = 4;
-                    var_count++;
-                    stack_offset += 4;
-                } else {
-                    printf("    li r14, 0\n");
-                    printf("    beq Lelse_%d\n", my_label);
-                }
+/* Grow sl's range over every loop it overlaps, until none is left
+ * half in */
+static void peep_stretch(PeepSlot* sl, const PeepLoop* loops, int loop_count) {
+    int n, grown = 1;
+    while (grown) {
+        grown = 0;
+        for (n = 0; n < loop_count; n++) {
+            if (sl->start <= loops[n].bottom && sl->end >= loops[n].top
+                    && (loops[n].top < sl->start || loops[n].bottom > sl->end)) {
+                if (loops[n].top < sl->start) sl->start = loops[n].top;
+                if (loops[n].bottom > sl->end) sl->end = loops[n].bottom;
+                grown = 1;
+            }
+        }
+    }
+}
+
+/* Linear scan of ranges, sorted here, over pool (most preferred first):
+ * each gets a reg, or -1 under pressure */
+static void peep_linear_scan(PeepState* ps, PeepSlot* ranges, int range_count, const int* pool, int pool_size) {
+    int active[18], active_count = 0;
+    int free_regs[18], free_count = pool_size;
+    int k, n;
+    qsort(ranges, range_count, sizeof(PeepSlot), peep_slot_cmp);
+    for (n = 0; n < pool_size; n++) free_regs[n] = pool[pool_size - 1 - n];
+    for (k = 0; k < range_count; k++) {
+        PeepSlot* cur = &ranges[k];
+        for (n = 0; n < active_count; ) {
+            if (ranges[active[n]].end < cur->start) {
+                free_regs[free_count++] = ranges[active[n]].reg;
+                active[n] = active[--active_count];
             } else {
-                /* Parse condition: var, var op expr, !var, function() */
-                int negate = 0;
-                if (*pos == '!') { negate = 1; pos++; skip_whitespace(); }
+                n++;
+            }
+        }
+        if (free_count > 0) {
+            cur->reg = free_regs[--free_count];
+            active[active_count++] = k;
+            continue;
+        }
+        int last = 0;
+        for (n = 1; n < active_count; n++) {
+            PeepSlot* a = &ranges[active[n]];
+            PeepSlot* b = &ranges[active[last]];
+            if (a->weight < b->weight || (a->weight == b->weight && a->end > b->end)) last = n;
+        }
+        PeepSlot* victim = &ranges[active[last]];
+        if (victim->weight < cur->weight || (victim->weight == cur->weight && victim->end > cur->end)) {
+            cur->reg = ranges[active[last]].reg;
+            ranges[active[last]].reg = -1;
+            active[last] = k;
+        }
+        ps->spilled++;
+    }
+}
 
-                char cond_var[64] = {0};
-                parse_string(cond_var, sizeof(cond_var));
+/* f32/f64 slots go to FPRs the same way. A slot only ever loaded and
+ * stored whole, by lfs/stfs or by lfd/stfd at its own offset, moves to
+ * a volatile FPR (f1-f13) the function never names, for a range no call
+ * crosses since nothing saves those. */
+static void peep_fpr_promote(CompilerContext* cx, PeepState* ps, int entry, int end, int frame, int taken_min,
+                             const PeepLoop* loops, int loop_count) {
+    int nslots = frame / 4, k, n, r, disp, size;
+    PeepSlot* slots = arena_alloc(cx, nslots * sizeof(PeepSlot));
+    char* width = arena_alloc(cx, nslots);
+    char* hit = arena_alloc(cx, nslots);
+    unsigned named = 1;                 /* f0 is codegen's scratch */
+
+    for (k = 0; k < nslots; k++) {
+        slots[k].offset = k * 4;
+        slots[k].start = -1;
+        slots[k].reg = -1;
+        slots[k].ok = 1;
+        slots[k].weight = 0;
+    }
+    for (k = peep_next(ps, entry); k >= 0 && k < end; k = peep_next(ps, k)) {
+        PeepLine* l = &ps->lines[k];
+        int w = 1;
+        if (l->kind != PEEP_INSN) continue;
+        for (n = 0; n < l->nargs; n++) {
+            if ((r = peep_regfile(l, n, 'f')) >= 0) named |= 1u << r;
+            if (peep_mem_base(l, n) != 1 || !peep_mem_disp(l, n, &disp) || disp < 0 || disp >= frame) continue;
+            size = strcmp(l->op, "la") == 0 ? peep_la_extent(l) : 4;
+            for (r = disp / 4; r * 4 < disp + (size > 0 ? size : 4) && r < nslots; r++) hit[r] = 1;
+            PeepSlot* sl = &slots[disp / 4];
+            if (n != 1 || disp % 4 || !peep_fp_width(l->op)
+                    || (width[disp / 4] && width[disp / 4] != peep_fp_width(l->op))) {
+                sl->ok = 0;
+                continue;
+            }
+            width[disp / 4] = (char)peep_fp_width(l->op);
+            if (sl->start < 0) sl->start = k;
+            sl->end = k;
+            for (r = 0; r < loop_count; r++) {
+                if (loops[r].top <= k && k <= loops[r].bottom) w *= PEEP_LOOP_WEIGHT;
+            }
+            sl->weight += w;
+        }
+    }
 
-                int cond_off = -1;
-                for (i = 0; i < var_count; i++) {
-                    if (strcmp(vars[i].name, cond_var) == 0) {
-                        cond_off = vars[i].offset;
-                        break;
-                    }
-                }
+    int pool[13], pool_size = 0;
+    for (r = 13; r >= 1; r--) {
+        if (!(named & (1u << r))) pool[pool_size++] = r;
+    }
+    if (pool_size == 0) return;
+
+    /* Candidates: nothing else in their words, no call in their range */
+    PeepSlot* ranges = arena_alloc(cx, nslots * sizeof(PeepSlot));
+    int range_count = 0;
+    for (k = 72 / 4; k < nslots; k++) {
+        PeepSlot* sl = &slots[k];
+        if (sl->start < 0 || !sl->ok || sl->offset + width[k] > taken_min) continue;
+        if (width[k] == 8 && (k + 1 >= nslots || hit[k + 1])) continue;
+        peep_stretch(sl, loops, loop_count);
+        for (n = sl->start; n <= sl->end; n++) {
+            if (!ps->lines[n].dead && ps->lines[n].kind == PEEP_INSN && strcmp(ps->lines[n].op, "bl") == 0) break;
+        }
+        if (n <= sl->end) continue;
+        ranges[range_count++] = *sl;
+    }
+    peep_linear_scan(ps, ranges, range_count, pool, pool_size);
 
-                if (cond_off >= 0) {
-                    printf("    lwz r14, %d(r1)   ; load %s\n", cond_off, cond_var);
-                } else {
-                    printf("    li r14, 0         ; %s (unresolved)\n", cond_var);
-                }
+    for (k = 0; k < range_count; k++) {
+        if (ranges[k].reg >= 0) {
+            slots[ranges[k].offset / 4].reg = ranges[k].reg;
+            ps->fpr_promoted++;
+        }
+    }
+    for (k = peep_next(ps, entry); k >= 0 && k < end; k = peep_next(ps, k)) {
+        PeepLine* l = &ps->lines[k];
+        char insn[64];
+        int f;
+        if (l->kind != PEEP_INSN || !peep_fp_width(l->op) || l->nargs != 2 || peep_mem_base(l, 1) != 1
+                || !peep_mem_disp(l, 1, &disp) || disp < 0 || disp >= frame || slots[disp / 4].reg < 0
+                || (f = peep_regfile(l, 0, 'f')) < 0) {
+            continue;
+        }
+        if (l->op[0] == 'l') snprintf(insn, sizeof(insn), "fmr f%d, f%d", f, slots[disp / 4].reg);
+        else snprintf(insn, sizeof(insn), "fmr f%d, f%d", slots[disp / 4].reg, f);
+        peep_rewrite(cx, l, insn);
+    }
+}
 
-                skip_whitespace();
-
-                /* Check for comparison operator */
-                /* Helper macro: load RHS into r15 (number or variable) and emit compare */
-                #define EMIT_CMP_RHS() do { \
-                    if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) { \
-                        int rhs = parse_number(); \
-                        emit_cmpwi(14, rhs); \
-                    } else if (isalpha(*pos) || *pos == '_') { \
-                        compile_expr_to_reg(15); \
-                        printf("    cmpw r14, r15\n"); \
-                    } else { \
-                        printf("    cmpwi r14, 0\n"); \
-                    } \
-                } while(0)
-
-                if (strncmp(pos, "==", 2) == 0) {
-                    pos += 2; skip_whitespace();
-                    EMIT_CMP_RHS();
-                    printf("    %s Lelse_%d\n", negate ? "beq" : "bne", my_label);
-                } else if (strncmp(pos, "!=", 2) == 0) {
-                    pos += 2; skip_whitespace();
-                    EMIT_CMP_RHS();
-                    printf("    %s Lelse_%d\n", negate ? "bne" : "beq", my_label);
-                } else if (strncmp(pos, ">=", 2) == 0) {
-                    pos += 2; skip_whitespace();
-                    EMIT_CMP_RHS();
-                    printf("    %s Lelse_%d\n", negate ? "bge" : "blt", my_label);
-                } else if (strncmp(pos, "<=", 2) == 0) {
-                    pos += 2; skip_whitespace();
-                    EMIT_CMP_RHS();
-                    printf("    %s Lelse_%d\n", negate ? "ble" : "bgt", my_label);
-                } else if (*pos == '>' && *(pos+1) != '>') {
-                    pos++; skip_whitespace();
-                    EMIT_CMP_RHS();
-                    printf("    %s Lelse_%d\n", negate ? "bgt" : "ble", my_label);
-                } else if (*pos == '<' && *(pos+1) != '<') {
-                    pos++; skip_whitespace();
-                    EMIT_CMP_RHS();
-                    printf("    %s Lelse_%d\n", negate ? "blt" : "bge", my_label);
-                } else {
-                    /* Boolean truthiness check */
-                    printf("    cmpwi r14, 0\n");
-                    printf("    %s Lelse_%d\n", negate ? "bne" : "beq", my_label);
-                }
-                #undef EMIT_CMP_RHS
+static void peep_regalloc_function(CompilerContext* cx, PeepState* ps, int entry, int end, int frame) {
+    int nslots = frame / 4;
+    PeepSlot* slots = arena_alloc(cx, nslots * sizeof(PeepSlot));
+    PeepLoop* loops = NULL;
+    int loop_count = 0, loop_capacity = 0;
+    unsigned touched = 0, nv_written = 0;
+    int taken_min = frame, locals_end = 72, popped = 0, can_alloc = 1;
+    int k, n, r, size;
+
+    for (k = 0; k < nslots; k++) {
+        slots[k].offset = k * 4;
+        slots[k].start = -1;
+        slots[k].reg = -1;
+        slots[k].ok = 1;
+        slots[k].weight = 0;
+    }
+
+    for (k = peep_next(ps, entry); k >= 0 && k < end; k = peep_next(ps, k)) {
+        PeepLine* l = &ps->lines[k];
+        unsigned use, def;
+        if (l->kind == PEEP_LABEL) {
+            popped = 0;
+            continue;
+        }
+        if (l->kind != PEEP_INSN) {
+            if (l->len > 0 && !strchr(" \t.;", l->text[0])) return;   /* "1:  blr" and friends */
+            continue;
+        }
+        if (strcmp(l->op, "blr") == 0) {
+            if (!popped) return;
+            popped = 0;
+            continue;
+        }
+        if (strcmp(l->op, "bctr") == 0 && peep_is_jump_table(ps, k)) continue;   /* forward only */
+        if (strcmp(l->op, "bctr") == 0 || strcmp(l->op, "bctrl") == 0) return;
+        if (peep_is_branch(l->op)) {
+            int target = peep_label_line(cx, ps, l, l->nargs - 1);
+            if (target < 0 && strcmp(l->op, "b") == 0) return;      /* tail call */
+            if (target < 0 || target <= entry || target >= end) {
+                can_alloc = 0;
+            } else if (target < k) {
+                loops = table_reserve(cx, loops, loop_count, &loop_capacity, sizeof(PeepLoop));
+                loops[loop_count].top = target;
+                loops[loop_count++].bottom = k;
             }
+            continue;
+        }
+        if (peep_is_frame_pop(l, frame)) {
+            popped = 1;
+            continue;
+        }
+        if (popped && strcmp(l->op, "lwz") == 0 && peep_reg(l, 0) == 0) continue;   /* reload LR */
+        if (peep_effects(l, &use, &def) < 0) {
+            if (strcmp(l->op, "bl") != 0) return;
+            continue;
+        }
+        touched |= use | def;
+        nv_written |= def & 0xFFFFE000u;   /* r13-r31 */
 
-            /* Compile if-body */
-            while (*pos && *pos != '{') pos++;
-            if (*pos == '{') {
-                pos++;
-                compile_function_body(frame_size);
-                if (*pos == '}') pos++;
+        /* r1 as a plain register operand leaks the frame address */
+        for (n = 0; n < l->nargs; n++) {
+            if (peep_reg(l, n) == 1) taken_min = 0;
+        }
+        for (n = 0; n < l->nargs; n++) {
+            int disp;
+            if (peep_mem_base(l, n) != 1) continue;
+            if (!peep_mem_disp(l, n, &disp)) {
+                taken_min = 0;
+            } else if ((strcmp(l->op, "lwz") == 0 || strcmp(l->op, "stw") == 0) && n == 1
+                    && peep_reg(l, 0) > 1) {
+                if (disp >= 0 && disp < frame) {
+                    PeepSlot* sl = &slots[disp / 4];
+                    if (disp % 4) sl->ok = 0;
+                    if (sl->start < 0) sl->start = k;
+                    sl->end = k;
+                    if (disp + 4 > locals_end) locals_end = disp + 4;
+                }
+            } else if ((size = peep_fp_width(l->op)) > 0 && n == 1 && disp >= 0 && disp + size <= frame) {
+                /* An f32/f64: its own words stay out of the GPRs
+                 * (peep_fpr_promote() may give it an FPR) */
+                for (r = disp / 4; r * 4 < disp + size; r++) slots[r].ok = 0;
+                if (disp + size > locals_end) locals_end = disp + size;
+            } else if (strcmp(l->op, "la") == 0 && (size = peep_la_extent(l)) > 0 && disp >= 0
+                    && disp + size <= frame) {
+                /* The address of an object codegen gave the size of:
+                 * only its own slots are out */
+                for (r = disp / 4; r * 4 < disp + size; r++) slots[r].ok = 0;
+                if (disp + size > locals_end) locals_end = disp + size;
+            } else {
+                /* An address (la) or an access of another width: the
+                 * object may extend upwards from here */
+                if (disp < taken_min) taken_min = disp;
+                if (disp + 12 > locals_end) locals_end = disp + 12;
             }
+        }
+    }
 
-            printf("    b Lendif_%d\n", my_label);
-            printf("Lelse_%d:\n", my_label);
+    /* The function qualifies for a save set */
+    ps->funcs = table_reserve(cx, ps->funcs, ps->func_count, &ps->func_capacity, sizeof(PeepFunc));
+    PeepFunc* f = &ps->funcs[ps->func_count++];
+    f->entry = entry;
+    f->end = end;
+    f->frame = frame;
+    f->locals_end = locals_end;
+    f->exact = taken_min == frame;
+    f->saved = 0;
+    if (!can_alloc) return;
+    peep_fpr_promote(cx, ps, entry, end, frame, taken_min, loops, loop_count);
+
+    /* Registers the save area still has room for */
+    int room = (frame - locals_end) / 4;
+    for (r = 13; r < 32; r++) {
+        if (nv_written & (1u << r)) room--;
+    }
+    int pool[18], pool_size = 0;
+    for (r = 31; r >= 14 && pool_size < room; r--) {
+        if (!(touched & (1u << r))) pool[pool_size++] = r;
+    }
+    if (pool_size == 0) return;
 
-            skip_whitespace();
+    for (k = peep_next(ps, entry); k >= 0 && k < end; k = peep_next(ps, k)) {
+        PeepLine* l = &ps->lines[k];
+        int disp, w = 1;
+        if (l->kind != PEEP_INSN || l->nargs != 2 || peep_mem_base(l, 1) != 1
+                || !peep_mem_disp(l, 1, &disp) || disp < 0 || disp >= frame) {
+            continue;
+        }
+        for (n = 0; n < loop_count; n++) {
+            if (loops[n].top <= k && k <= loops[n].bottom) w *= PEEP_LOOP_WEIGHT;
+        }
+        slots[disp / 4].weight += w;
+    }
 
-            /* Check for else if / else */
-            if (strncmp(pos, "else", 4) == 0 && !isalnum(*(pos+4))) {
-                pos += 4;
-                skip_whitespace();
-                if (strncmp(pos, "if ", 3) == 0) {
-                    /* else if — don't consume "if", let next iteration handle it */
-                    /* But we need to emit it inside the else block */
-                    /* For now, compile the else-if body inline */
-                }
-                while (*pos && *pos != '{') pos++;
-                if (*pos == '{') {
-                    pos++;
-                    compile_function_body(frame_size);
-                    if (*pos == '}') pos++;
-                }
+    /* Candidate ranges, stretched over the loops they overlap */
+    PeepSlot* ranges = arena_alloc(cx, nslots * sizeof(PeepSlot));
+    int range_count = 0;
+    for (k = 72 / 4; k < nslots; k++) {
+        PeepSlot* sl = &slots[k];
+        if (sl->start < 0 || !sl->ok || sl->offset + 4 > taken_min) continue;
+        peep_stretch(sl, loops, loop_count);
+        ranges[range_count++] = *sl;
+    }
+    peep_linear_scan(ps, ranges, range_count, pool, pool_size);
+
+    for (k = 0; k < range_count; k++) {
+        if (ranges[k].reg >= 0) {
+            slots[ranges[k].offset / 4].reg = ranges[k].reg;
+            ps->promoted++;
+        }
+    }
+    for (k = peep_next(ps, entry); k >= 0 && k < end; k = peep_next(ps, k)) {
+        PeepLine* l = &ps->lines[k];
+        char insn[64];
+        int disp;
+        if (l->kind != PEEP_INSN || l->nargs != 2 || peep_mem_base(l, 1) != 1
+                || !peep_mem_disp(l, 1, &disp) || disp < 0 || disp >= frame
+                || slots[disp / 4].reg < 0) {
+            continue;
+        }
+        if (strcmp(l->op, "lwz") == 0) {
+            snprintf(insn, sizeof(insn), "mr r%d, r%d", peep_reg(l, 0), slots[disp / 4].reg);
+            peep_rewrite(cx, l, insn);
+        } else if (strcmp(l->op, "stw") == 0) {
+            snprintf(insn, sizeof(insn), "mr r%d, r%d", slots[disp / 4].reg, peep_reg(l, 0));
+            peep_rewrite(cx, l, insn);
+        }
+    }
+}
+
+static void peep_regalloc(CompilerContext* cx, PeepState* ps) {
+    int i, frame;
+    for (i = 0; i < ps->count; i++) {
+        int entry = peep_function_at(ps, i, &frame);
+        if (entry < 0) continue;
+        int end = entry + 1;
+        while (end < ps->count && !(ps->lines[end].kind == PEEP_LABEL && ps->lines[end].text[0] == '_')) end++;
+        peep_regalloc_function(cx, ps, entry, end, frame);
+        i = end - 1;
+    }
+}
+
+/* Attach f's save sequence behind its prologue and the matching restores
+ * ahead of every frame pop, the save area starting at base */
+static void peep_attach_saves(CompilerContext* cx, PeepState* ps, PeepFunc* f, int base) {
+    char save[19 * 48], restore[19 * 48];
+    int sn = 0, rn = 0, off = base, k, r;
+    save[0] = restore[0] = 0;
+    for (r = 13; r < 32; r++) {
+        if (!(f->saved & (1u << r))) continue;
+        sn += snprintf(save + sn, sizeof(save) - sn, "    stw r%d, %d(r1)   ; save r%d\n", r, off, r);
+        rn += snprintf(restore + rn, sizeof(restore) - rn, "    lwz r%d, %d(r1)   ; restore r%d\n", r, off, r);
+        off += 4;
+    }
+    ps->lines[f->entry].after = arena_strdup(cx, save);
+    for (k = f->entry + 1; k < f->end; k++) {
+        if (!ps->lines[k].dead && ps->lines[k].kind == PEEP_INSN
+                && peep_is_frame_pop(&ps->lines[k], f->frame)) {
+            ps->lines[k].before = arena_strdup(cx, restore);
+        }
+    }
+}
+
+/* Save and restore the nonvolatile registers each function writes */
+static void peep_save_regs(CompilerContext* cx, PeepState* ps) {
+    int i, k, r;
+    for (i = 0; i < ps->func_count; i++) {
+        PeepFunc* f = &ps->funcs[i];
+        unsigned written = 0;
+        for (k = f->entry + 1; k < f->end; k++) {
+            unsigned use, def;
+            if (!ps->lines[k].dead && ps->lines[k].kind == PEEP_INSN
+                    && peep_effects(&ps->lines[k], &use, &def) == 0) {
+                written |= def & 0xFFFFE000u;
             }
-            printf("Lendif_%d:\n", my_label);
+        }
+        int count = 0;
+        for (r = 13; r < 32; r++) {
+            if (written & (1u << r)) count++;
+        }
+        int base = f->frame - 4 * count;
+        if (count == 0 || base < f->locals_end) continue;
 
-        } else if (strncmp(pos, "while ", 6) == 0) {
-            pos += 6;
-            static int while_label = 0;
-            int my_label = while_label++;
+        f->saved = written;
+        f->save_base = base;
+        peep_attach_saves(cx, ps, f, base);
+        ps->saved += count;
+    }
+}
 
-            printf("Lwhile_%d:\n", my_label);
+/* Frames sized to what they hold. Once save-regs has laid out a
+ * function, a frame codegen gave the fixed 256 bytes shrinks to its
+ * locals plus save area (when nothing in it can reach past the locals
+ * regalloc saw). A leaf, which never calls, drops the mflr/stw r0 LR
+ * save and its reload; when everything it keeps in the frame then fits
+ * the 224-byte red zone below the caller's r1, the stwu and the frame
+ * pops go too and the slots are addressed off r1 directly. Functions
+ * that do anything else with r1 keep their frame as it is. */
+#define PEEP_RED_ZONE 224
+
+/* Replace operand k of l's instruction */
+static void peep_set_arg(CompilerContext* cx, PeepLine* l, int k, const char* operand) {
+    char insn[160];
+    int len = snprintf(insn, sizeof(insn), "%s ", l->op), a;
+    for (a = 0; a < l->nargs && len < (int)sizeof(insn); a++) {
+        if (a == k) len += snprintf(insn + len, sizeof(insn) - len, "%s%s", a ? ", " : "", operand);
+        else len += snprintf(insn + len, sizeof(insn) - len, "%s%.*s", a ? ", " : "", l->arg_len[a], l->arg[a]);
+    }
+    peep_rewrite(cx, l, insn);
+}
 
-            /* Parse condition */
-            int negate = 0;
-            if (*pos == '!') { negate = 1; pos++; skip_whitespace(); }
+/* Rename GPR from to to, as a register or a base, throughout f */
+static void peep_rename_reg(CompilerContext* cx, PeepState* ps, PeepFunc* f, int from, int to) {
+    char operand[64];
+    int k, n;
+    for (k = f->entry + 1; k < f->end; k++) {
+        PeepLine* l = &ps->lines[k];
+        if (l->dead || l->kind != PEEP_INSN) continue;
+        for (n = 0; n < l->nargs; n++) {
+            if (peep_reg(l, n) == from) {
+                snprintf(operand, sizeof(operand), "r%d", to);
+                peep_set_arg(cx, l, n, operand);
+            } else if (peep_mem_base(l, n) == from) {
+                const char* open = l->arg[n] + l->arg_len[n] - 1;
+                while (*open != '(') open--;
+                snprintf(operand, sizeof(operand), "%.*s(r%d)", (int)(open - l->arg[n]), l->arg[n], to);
+                peep_set_arg(cx, l, n, operand);
+            }
+        }
+    }
+}
+
+static void peep_frame_function(CompilerContext* cx, PeepState* ps, PeepFunc* f) {
+    int prologue[2] = { -1, -1 };          /* mflr r0, stw r0, 8(r1) */
+    int leaf = 1, popped = 0, min_disp = f->frame, count = 0;
+    unsigned touched = 0, had_saves = f->saved;
+    int k, n, r, v, disp;
+    char insn[160];
+
+    for (k = f->entry - 1, n = 1; k > 0 && n >= 0; k--) {
+        PeepLine* l = &ps->lines[k];
+        if (l->dead || l->kind != PEEP_INSN) continue;
+        prologue[n--] = k;
+    }
+    if (prologue[0] < 0 || strcmp(ps->lines[prologue[0]].op, "mflr") != 0) return;
 
-            char cond_var[64] = {0};
-            parse_string(cond_var, sizeof(cond_var));
+    for (k = peep_next(ps, f->entry); k >= 0 && k < f->end; k = peep_next(ps, k)) {
+        PeepLine* l = &ps->lines[k];
+        unsigned use, def;
+        if (l->kind == PEEP_LABEL) {
+            popped = 0;
+            continue;
+        }
+        if (l->kind != PEEP_INSN) continue;
+        if (strcmp(l->op, "blr") == 0) {
+            popped = 0;
+            continue;
+        }
+        if (strcmp(l->op, "bl") == 0 || strcmp(l->op, "bctrl") == 0) {
+            leaf = 0;
+            continue;
+        }
+        if (peep_is_branch(l->op) || strcmp(l->op, "bctr") == 0) continue;
+        if (peep_is_frame_pop(l, f->frame)) {
+            popped = 1;
+            continue;
+        }
+        if (popped) {
+            /* between a pop and its blr only the LR reload may follow */
+            if ((strcmp(l->op, "lwz") == 0 && peep_reg(l, 0) == 0) || strcmp(l->op, "mtlr") == 0) continue;
+            return;
+        }
+        if (peep_effects(l, &use, &def) < 0 || (def & 2u)) return;
+        touched |= use | def;
+        for (n = 0; n < l->nargs; n++) {
+            if (peep_reg(l, n) == 1) return;
+            if (peep_mem_base(l, n) != 1) continue;
+            if (!peep_mem_disp(l, n, &disp) || disp < 0 || disp >= f->frame) return;
+            if (disp < min_disp) min_disp = disp;
+        }
+    }
 
-            int cond_off = -1;
-            for (i = 0; i < var_count; i++) {
-                if (strcmp(vars[i].name, cond_var) == 0) { cond_off = vars[i].offset; break; }
+    if (leaf) {
+        /* Nothing is live across a call in a leaf, so a volatile register
+         * it never mentions serves as well as a nonvolatile one and
+         * needs no save */
+        for (r = 13, v = 12; r < 32; r++) {
+            if (!(touched & (1u << r))) continue;
+            while (v >= 4 && (touched & (1u << v))) v--;
+            if (v < 4) break;
+            peep_rename_reg(cx, ps, f, r, v);
+            touched |= 1u << v;
+            f->saved &= ~(1u << r);
+        }
+    }
+    for (r = 13; r < 32; r++) {
+        if (f->saved & (1u << r)) count++;
+    }
+    int frame = f->frame;
+    if (f->exact) {
+        frame = (f->locals_end + 4 * count + 15) & ~15;
+        if (frame > f->frame) frame = f->frame;
+    }
+    int base = frame - 4 * count;
+    if (count && base < min_disp) min_disp = base;
+    int frameless = leaf && min_disp >= frame - PEEP_RED_ZONE;
+    if (!leaf && frame == f->frame) return;
+
+    /* The restores sit ahead of the pops, so redo them before any dies */
+    if (had_saves) peep_attach_saves(cx, ps, f, frameless ? base - frame : base);
+    if (leaf) {
+        ps->lines[prologue[0]].dead = 1;
+        ps->lines[prologue[1]].dead = 1;
+    }
+    if (frameless) {
+        ps->lines[f->entry].dead = 1;
+    } else if (frame != f->frame) {
+        snprintf(insn, sizeof(insn), "stwu r1, -%d(r1)", frame);
+        peep_rewrite(cx, &ps->lines[f->entry], insn);
+    }
+    popped = 0;
+    for (k = peep_next(ps, f->entry); k >= 0 && k < f->end; k = peep_next(ps, k)) {
+        PeepLine* l = &ps->lines[k];
+        if (l->kind == PEEP_LABEL || (l->kind == PEEP_INSN && strcmp(l->op, "blr") == 0)) {
+            popped = 0;
+        } else if (l->kind != PEEP_INSN) {
+            continue;
+        } else if (peep_is_frame_pop(l, f->frame)) {
+            popped = 1;
+            if (frameless) {
+                l->dead = 1;
+            } else if (frame != f->frame) {
+                snprintf(insn, sizeof(insn), "addi r1, r1, %d", frame);
+                peep_rewrite(cx, l, insn);
             }
-            if (cond_off >= 0) {
-                printf("    lwz r14, %d(r1)   ; load %s\n", cond_off, cond_var);
-            } else {
-                printf("    li r14, 1         ; %s (default true)\n", cond_var);
-            }
-
-            skip_whitespace();
-
-            /* Comparison operators — handle both immediate and variable RHS */
-            #define WHILE_CMP_RHS() do { \
-                if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) { \
-                    int rhs = parse_number(); \
-                    emit_cmpwi(14, rhs); \
-                } else if (isalpha(*pos) || *pos == '_') { \
-                    compile_expr_to_reg(15); \
-                    printf("    cmpw r14, r15\n"); \
-                } else { \
-                    printf("    cmpwi r14, 0\n"); \
-                } \
-            } while(0)
-
-            if (strncmp(pos, "==", 2) == 0) {
-                pos += 2; skip_whitespace();
-                WHILE_CMP_RHS();
-                printf("    bne Lendwhile_%d\n", my_label);
-            } else if (strncmp(pos, "!=", 2) == 0) {
-                pos += 2; skip_whitespace();
-                WHILE_CMP_RHS();
-                printf("    beq Lendwhile_%d\n", my_label);
-            } else if (*pos == '<' && *(pos+1) != '<') {
-                pos++; skip_whitespace();
-                WHILE_CMP_RHS();
-                printf("    bge Lendwhile_%d\n", my_label);
-            } else if (*pos == '>' && *(pos+1) != '>') {
-                pos++; skip_whitespace();
-                WHILE_CMP_RHS();
-                printf("    ble Lendwhile_%d\n", my_label);
-            } else {
-                printf("    cmpwi r14, 0\n");
-                printf("    %s Lendwhile_%d\n", negate ? "bne" : "beq", my_label);
+        } else if (popped) {
+            if (leaf) l->dead = 1;
+        } else if (frameless) {
+            /* a slot at D off the frame is D - frame off the caller's r1 */
+            for (n = 0; n < l->nargs; n++) {
+                if (peep_mem_base(l, n) != 1 || !peep_mem_disp(l, n, &disp)) continue;
+                snprintf(insn, sizeof(insn), "%d(r1)", disp - frame);
+                peep_set_arg(cx, l, n, insn);
             }
-            #undef WHILE_CMP_RHS
+        }
+    }
+    if (leaf) ps->leaves++;
+    if (frameless) ps->frameless++;
+}
 
-            /* Compile while body */
-            while (*pos && *pos != '{') pos++;
-            if (*pos == '{') {
-                pos++;
-                compile_function_body(frame_size);
-                if (*pos == '}') pos++;
-            }
-            printf("    b Lwhile_%d\n", my_label);
-            printf("Lendwhile_%d:\n", my_label);
-
-        } else if (strncmp(pos, "for ", 4) == 0) {
-            pos += 4;
-            static int for_label = 0;
-            int my_label = for_label++;
-
-            /* Parse: for VAR in EXPR { ... } */
-            skip_whitespace();
-            char iter_var[64] = {0};
-            parse_string(iter_var, sizeof(iter_var));
-            skip_whitespace();
-            if (strncmp(pos, "in ", 3) == 0) pos += 3;
-            skip_whitespace();
-
-            /* Parse range: 0..N or collection.iter() */
-            int range_start = 0, range_end = 0;
-            int is_range = 0;
-            if (isdigit(*pos)) {
-                range_start = parse_number();
-                if (strncmp(pos, "..", 2) == 0) {
-                    pos += 2;
-                    if (*pos == '=') pos++; /* ..= inclusive */
-                    range_end = parse_number();
-                    is_range = 1;
-                }
-            } else {
-                /* Collection iteration — skip to body */
-                while (*pos && *pos != '{') pos++;
-            }
+static void peep_frames(CompilerContext* cx, PeepState* ps) {
+    int i;
+    for (i = 0; i < ps->func_count; i++) peep_frame_function(cx, ps, &ps->funcs[i]);
+}
 
-            /* Register iterator variable */
-            printf("    ; for %s in %d..%d\n", iter_var, range_start, range_end);
-            emit_li(14, range_start);
-            printf("    stw r14, %d(r1)   ; %s = %d\n", stack_offset, iter_var, range_start);
+/* Optimize the held output in place */
+/* Split arena text into lines and index the labels */
+static void peep_load_text(CompilerContext* cx, PeepState* ps, const char* text, size_t len) {
+    const char* p = text;
+    const char* end = text + len;
+    PeepLine* old = ps->lines;
+    int* old_seen = ps->live_seen;
+    int old_capacity = ps->line_capacity, count = 0, i;
+
+    /* Counted first and allocated once: a table grown by doubling leaves
+     * as much again behind in the arena */
+    for (p = text; p < end; count++) {
+        const char* nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    memset(ps, 0, sizeof(*ps));
+    if (old && count <= old_capacity) {
+        ps->lines = old;
+        ps->live_seen = old_seen;
+        ps->line_capacity = old_capacity;
+        memset(ps->live_seen, 0, count * sizeof(int));
+    } else {
+        ps->lines = arena_alloc(cx, (count + 1) * sizeof(PeepLine));
+        ps->live_seen = arena_alloc(cx, (count + 1) * sizeof(int));
+        ps->line_capacity = count + 1;
+    }
+    for (p = text; p < end; ) {
+        const char* nl = memchr(p, '\n', end - p);
+        if (!nl) nl = end;
+        PeepLine* l = &ps->lines[ps->count++];
+        memset(l, 0, sizeof(*l));
+        l->text = p;
+        l->len = (int)(nl - p);
+        peep_parse(l);
+        p = nl + 1;
+    }
 
-            strcpy(vars[var_count].name, iter_var);
-            vars[var_count].offset = stack_offset;
-            vars[var_count].type = TYPE_I32;
-            vars[var_count].size = 4;
-            int iter_off = stack_offset;
-            var_count++;
-            stack_offset += 4;
+    /* Label names go through the interner so branch targets resolve
+     * with one lookup */
+    for (i = 0; i < ps->count; i++) {
+        if (ps->lines[i].kind == PEEP_LABEL) intern(cx, ps->lines[i].text, ps->lines[i].len - 1);
+    }
+    ps->label_syms = cx->sym_count;
+    ps->label_at = arena_alloc(cx, (ps->label_syms + 1) * sizeof(int));
+    for (i = 0; i < ps->count; i++) {
+        if (ps->lines[i].kind == PEEP_LABEL) {
+            ps->label_at[sym_find(cx, ps->lines[i].text, ps->lines[i].len - 1)] = i + 1;
+        }
+    }
+}
 
-            printf("Lfor_%d:\n", my_label);
-            if (is_range) {
-                printf("    lwz r14, %d(r1)   ; load %s\n", iter_off, iter_var);
-                emit_cmpwi(14, range_end);
-                printf("    bge Lendfor_%d\n", my_label);
-            }
+/* ... the held output */
+static void peep_load(CompilerContext* cx, PeepState* ps) {
+    peep_load_text(cx, ps, arena_strndup(cx, cx->out_buf, (int)cx->out_len), cx->out_len);
+}
 
-            /* Compile for body */
-            while (*pos && *pos != '{') pos++;
-            if (*pos == '{') {
-                pos++;
-                compile_function_body(frame_size);
-                if (*pos == '}') pos++;
-            }
+/* Rewrite instruction windows until nothing changes */
+static void peep_optimize(CompilerContext* cx, PeepState* ps) {
+    int round;
+    for (round = 0; round < 8; round++) {
+        int changes = peep_sweep(cx, ps);
+        changes += peep_prune_labels(cx, ps);
+        if (!changes) break;
+    }
+}
 
-            /* Increment iterator */
-            if (is_range) {
-                printf("    lwz r14, %d(r1)\n", iter_off);
-                printf("    addi r14, r14, 1\n");
-                printf("    stw r14, %d(r1)\n", iter_off);
-            }
-            printf("    b Lfor_%d\n", my_label);
-            printf("Lendfor_%d:\n", my_label);
+/* Put what is left back into the output buffer */
+static void peep_store(CompilerContext* cx, PeepState* ps) {
+    int i;
+    cx->out_len = 0;
+    cx->out_hold = 0;
+    ps->kept = 0;
+    for (i = 0; i < ps->count; i++) {
+        PeepLine* l = &ps->lines[i];
+        if (l->before) emit_raw(cx, l->before, strlen(l->before));
+        if (!l->dead) {
+            emit_raw(cx, l->text, l->len);
+            emit_char(cx, '\n');
+            ps->kept++;
+        }
+        if (l->after) emit_raw(cx, l->after, strlen(l->after));
+    }
+}
 
-        } else if (strncmp(pos, "loop", 4) == 0 && (*(pos+4) == ' ' || *(pos+4) == '{')) {
-            pos += 4;
-            static int loop_label = 0;
-            int my_label = loop_label++;
-            printf("Lloop_%d:\n", my_label);
+/* Three-address IR (-C opt-level=1 and up, and --emit=ir). Codegen still
+ * prints PPC text; ir_build() lifts every function with the standard
+ * prologue into basic blocks of IR instructions, the IR passes rewrite
+ * those, and ir_lower() prints them back as PPC for the text passes.
+ *
+ * Operands are vregs. v0-v31 are r0-r31 themselves and carry every value
+ * that crosses a block boundary, a call, a return or an opaque
+ * instruction. Any other def gets a fresh vreg (v32 and up) that lives
+ * inside its block; the backend maps it back to a GPR, preferring the one
+ * codegen used. Memory is only touched by explicit loads and stores; the
+ * r1-based ones are the frame slots. An instruction nobody rewrote is
+ * printed from its original text, so codegen's comments survive, and a
+ * function the backend cannot allocate comes out exactly as it went in. */
+typedef enum {
+    IR_NOP,         /* deleted by a pass */
+    IR_NOTE,        /* comment, blank line or string-data island */
+    IR_ASM,         /* any other instruction; use/def say what it touches */
+    IR_ENTER,       /* mflr r0 / stw r0, 8(r1) / stwu r1, -imm(r1) */
+    IR_RET,         /* addi r1, r1, imm / lwz r0, 8(r1) / mtlr r0 / blr */
+    IR_CONST,       /* dst = imm */
+    IR_MOVE,        /* dst = src0 */
+    IR_ADD, IR_SUB, IR_MUL, IR_DIV, IR_DIVU,
+    IR_AND, IR_OR, IR_XOR, IR_SHL, IR_SHR, IR_SAR,
+                    /* dst = src0 op src1, or src0 op imm with has_imm */
+    IR_NEG,         /* dst = -src0 */
+    IR_LOAD,        /* dst = mem[src0 + (src1 or imm)] */
+    IR_STORE,       /* mem[src0 + (src1 or imm)] = src2 */
+    IR_CMP,         /* cr[crf] = compare src0 with src1 or imm */
+    IR_JUMP,        /* goto target */
+    IR_BRANCH,      /* if cond(cr[crf]) goto target, else the next block */
+    IR_CALL,        /* bl sym */
+    IR_OPCODES
+} IrOpcode;
+
+static const char* ir_opcode_names[IR_OPCODES] = {
+    "nop", "note", "asm", "enter", "ret", "const", "move",
+    "add", "sub", "mul", "div", "divu", "and", "or", "xor", "shl", "shr", "sar", "neg",
+    "load", "store", "cmp", "jump", "branch", "call"
+};
+
+/* IR_DNZ is bdnz: decrement CTR, branch while nonzero; it reads no cr */
+enum { IR_EQ, IR_NE, IR_LT, IR_GE, IR_GT, IR_LE, IR_DNZ, IR_CONDS };
+static const char* ir_cond_names[IR_CONDS] = { "eq", "ne", "lt", "ge", "gt", "le", "dnz" };
+
+#define IR_NONE (-1)
+#define IR_PHYS 32          /* vregs below this are the GPRs themselves */
 
-            /* Compile loop body */
-            skip_whitespace();
-            while (*pos && *pos != '{') pos++;
-            if (*pos == '{') {
-                pos++;
-                compile_function_body(frame_size);
-                if (*pos == '}') pos++;
-            }
-            printf("    b Lloop_%d\n", my_label);
-            printf("Lendloop_%d:\n", my_label);
+typedef struct {
+    unsigned char op;
+    unsigned char width;        /* LOAD/STORE: 1, 2 or 4 bytes */
+    unsigned char is_signed;    /* LOAD: algebraic; CMP: cmpw rather than cmplw */
+    unsigned char crf;          /* CMP/BRANCH: condition register field */
+    unsigned char cond;         /* BRANCH */
+    unsigned char has_imm;      /* the last source operand is imm */
+    int dst;
+    int src[3];
+    int imm;                    /* immediate, displacement or frame size */
+    int target;                 /* JUMP/BRANCH: block index */
+    int sym;                    /* CALL: callee; JUMP/BRANCH: label while building */
+    unsigned use, def;          /* ASM: the GPRs it reads and writes */
+    const char* text;           /* original line(s), NULL once rewritten */
+    int text_len;
+    const char* comment;        /* codegen's "; ..." to keep on rewrite */
+    int comment_len;
+} IrInsn;
 
-        } else if (strncmp(pos, "match ", 6) == 0) {
-            pos += 6;
-            skip_whitespace();
-            printf("    ; match statement\n");
+typedef struct {
+    int label;                  /* symbol of its label, -1 if it has none */
+    IrInsn* insns;
+    int count;
+    int capacity;
+    int succ[2];
+    int succ_count;
+    unsigned live_in;           /* GPRs v0-v31 live on entry ... */
+    unsigned live_out;          /* ... and on exit */
+} IrBlock;
 
-            /* Load match subject into r14 */
-            compile_expr_to_reg(14);
-            skip_whitespace();
+typedef struct {
+    int first_line;             /* the lines it replaces in the PeepState */
+    int end_line;
+    int frame;
+    IrBlock* blocks;            /* in layout order; falling through goes to the next */
+    int block_count;
+    int block_capacity;
+    int* vreg_hint;             /* [v - IR_PHYS]: the GPR codegen used */
+    int* vreg_gpr;              /* [v - IR_PHYS]: the GPR the backend picked */
+    int vreg_count;             /* vregs from IR_PHYS up */
+    int vreg_capacity;
+} IrFunction;
+
+typedef struct IrProgram {
+    IrFunction* funcs;
+    int count;
+    int capacity;
+    int labels_made;            /* labels invented for unlabeled branch targets */
+} IrProgram;
+
+static IrInsn* ir_append(CompilerContext* cx, IrBlock* b) {
+    b->insns = table_reserve(cx, b->insns, b->count, &b->capacity, sizeof(IrInsn));
+    IrInsn* in = &b->insns[b->count++];
+    in->dst = in->src[0] = in->src[1] = in->src[2] = IR_NONE;
+    in->target = in->sym = IR_NONE;
+    return in;
+}
 
-            /* Skip to opening { */
-            while (*pos && *pos != '{') pos++;
-            if (*pos == '{') pos++;
-
-            static int match_label_stmt = 0;
-            int end_label = match_label_stmt++;
-
-            /* Parse match arms */
-            while (*pos) {
-                skip_whitespace();
-                if (*pos == '}') { pos++; break; }
-                /* Skip comments */
-                if (*pos == '/' && *(pos+1) == '/') {
-                    while (*pos && *pos != '\n') pos++;
-                    if (*pos == '\n') pos++;
-                    continue;
-                }
-                if (*pos == '/' && *(pos+1) == '*') {
-                    pos += 2;
-                    while (*pos && !(*pos == '*' && *(pos+1) == '/')) pos++;
-                    if (*pos) pos += 2;
-                    continue;
-                }
+static IrBlock* ir_new_block(CompilerContext* cx, IrFunction* fn, int label) {
+    fn->blocks = table_reserve(cx, fn->blocks, fn->block_count, &fn->block_capacity, sizeof(IrBlock));
+    IrBlock* b = &fn->blocks[fn->block_count++];
+    b->label = label;
+    return b;
+}
 
-                int is_wildcard = (*pos == '_' && (*(pos+1) == ' ' || *(pos+1) == '='));
-                static int arm_label_stmt = 0;
-                int arm_label = arm_label_stmt++;
-
-                if (is_wildcard) {
-                    pos++;
-                    skip_whitespace();
-                    if (*pos == '=' && *(pos+1) == '>') pos += 2;
-                    skip_whitespace();
-                    /* Compile arm body */
-                    if (*pos == '{') {
-                        pos++;
-                        compile_function_body(frame_size);
-                        if (*pos == '}') pos++;
-                    } else {
-                        /* Single expression arm — skip it */
-                        while (*pos && *pos != ',' && *pos != '}') pos++;
-                    }
-                    if (*pos == ',') pos++;
-                    printf("    b Lmatch_stmt_end_%d\n", end_label);
-                } else if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                    int pat_val = parse_number();
-                    skip_whitespace();
-                    while (*pos == '|') { pos++; skip_whitespace(); parse_number(); skip_whitespace(); }
-                    if (*pos == '=' && *(pos+1) == '>') pos += 2;
-                    skip_whitespace();
-                    emit_cmpwi(14, pat_val);
-                    printf("    bne Lmatch_stmt_skip_%d\n", arm_label);
-                    if (*pos == '{') {
-                        pos++;
-                        compile_function_body(frame_size);
-                        if (*pos == '}') pos++;
-                    } else {
-                        while (*pos && *pos != ',' && *pos != '}') pos++;
-                    }
-                    if (*pos == ',') pos++;
-                    printf("    b Lmatch_stmt_end_%d\n", end_label);
-                    printf("Lmatch_stmt_skip_%d:\n", arm_label);
-                } else {
-                    /* Named/complex pattern — skip entire arm */
-                    while (*pos && *pos != '=') pos++;
-                    if (*pos == '=' && *(pos+1) == '>') pos += 2;
-                    skip_whitespace();
-                    if (*pos == '{') {
-                        int d = 1; pos++;
-                        while (*pos && d > 0) {
-                            if (*pos == '{') d++;
-                            else if (*pos == '}') d--;
-                            pos++;
-                        }
-                    } else {
-                        while (*pos && *pos != ',' && *pos != '}') pos++;
-                    }
-                    if (*pos == ',') pos++;
-                }
-            }
-            printf("Lmatch_stmt_end_%d:\n", end_label);
-
-        } else if (strncmp(pos, "return ", 7) == 0) {
-            pos += 7;
-            skip_whitespace();
-
-            if (strncmp(pos, "Ok(", 3) == 0) {
-                pos += 3;
-                int value = parse_number();
-                printf("    ; return Ok(%d)\n", value);
-                printf("    li r3, 0          ; Ok tag\n");
-                emit_li(4, value);
-            } else if (strncmp(pos, "Err(", 4) == 0) {
-                pos += 4;
-                printf("    ; return Err(...)\n");
-                printf("    li r3, 1          ; Err tag\n");
-            } else if (strncmp(pos, "Some(", 5) == 0) {
-                pos += 5;
-                int value = parse_number();
-                printf("    ; return Some(%d)\n", value);
-                printf("    li r3, 1          ; Some tag\n");
-                emit_li(4, value);
-            } else if (strncmp(pos, "None", 4) == 0 && !isalnum(*(pos+4))) {
-                pos += 4;
-                printf("    ; return None\n");
-                printf("    li r3, 0          ; None tag\n");
+/* Size b's instructions for the lines from i to the next label, which is
+ * as many as it can lift; a table grown by doubling would leave twice
+ * that behind in the arena for every block of the file */
+static void ir_size_block(CompilerContext* cx, IrBlock* b, const PeepState* ps, int i, int end) {
+    int n = 0;
+    while (i + n < end && ps->lines[i + n].kind != PEEP_LABEL) n++;
+    if (n > b->capacity) {
+        b->insns = arena_alloc(cx, n * sizeof(IrInsn));
+        b->capacity = n;
+    }
+}
+
+static int ir_new_vreg(CompilerContext* cx, IrFunction* fn, int hint) {
+    int cap = fn->vreg_capacity;
+    fn->vreg_hint = table_reserve(cx, fn->vreg_hint, fn->vreg_count, &fn->vreg_capacity, sizeof(int));
+    fn->vreg_gpr = table_reserve(cx, fn->vreg_gpr, fn->vreg_count, &cap, sizeof(int));
+    fn->vreg_hint[fn->vreg_count] = hint;
+    fn->vreg_gpr[fn->vreg_count] = hint;
+    return IR_PHYS + fn->vreg_count++;
+}
+
+/* GPRs an instruction reads and writes, counting only v0-v31 */
+static void ir_effects(const IrInsn* in, unsigned* use, unsigned* def) {
+    int k;
+    *use = *def = 0;
+    switch (in->op) {
+    case IR_NOP: case IR_NOTE: case IR_JUMP: case IR_BRANCH:
+        return;
+    case IR_ASM:
+        *use = in->use;
+        *def = in->def;
+        return;
+    case IR_ENTER:
+        *use = 1u << 1;
+        *def = 1u << 0 | 1u << 1;
+        return;
+    case IR_RET:
+        *use = 1u << 1 | 1u << 3 | 1u << 4;     /* r3/r4 carry results */
+        *def = 1u << 0 | 1u << 1;
+        return;
+    case IR_CALL:
+        *use = 0x7F8u;                          /* r3-r10 may be arguments */
+        *def = 1u << 0 | 0x1FF8u;               /* r0 and r3-r12 are clobbered */
+        return;
+    }
+    for (k = 0; k < 3; k++) {
+        if (in->src[k] >= 0 && in->src[k] < IR_PHYS) *use |= 1u << in->src[k];
+    }
+    if (in->dst >= 0 && in->dst < IR_PHYS) *def |= 1u << in->dst;
+}
+
+/* Block live-in/live-out sets over v0-v31 */
+static void ir_liveness(IrFunction* fn) {
+    int b, i, changed = 1;
+    unsigned* gen = malloc(fn->block_count * 2 * sizeof(unsigned));
+    unsigned* kill = gen + fn->block_count;
+    for (b = 0; b < fn->block_count; b++) {
+        IrBlock* bl = &fn->blocks[b];
+        gen[b] = kill[b] = 0;
+        for (i = bl->count - 1; i >= 0; i--) {
+            unsigned use, def;
+            ir_effects(&bl->insns[i], &use, &def);
+            gen[b] = (gen[b] & ~def) | use;
+            kill[b] |= def;
+        }
+        bl->live_in = bl->live_out = 0;
+    }
+    while (changed) {
+        changed = 0;
+        for (b = fn->block_count - 1; b >= 0; b--) {
+            IrBlock* bl = &fn->blocks[b];
+            unsigned out = 0;
+            for (i = 0; i < bl->succ_count; i++) out |= fn->blocks[bl->succ[i]].live_in;
+            unsigned in = gen[b] | (out & ~kill[b]);
+            if (in != bl->live_in || out != bl->live_out) changed = 1;
+            bl->live_in = in;
+            bl->live_out = out;
+        }
+    }
+    free(gen);
+}
+
+static int ir_parse_imm(const char* s, int len, int* value) {
+    char buf[32];
+    char* end;
+    if (len <= 0 || len >= (int)sizeof(buf)) return 0;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    long v = strtol(buf, &end, 0);
+    if (*end || v < -2147483648L || v > 4294967295L) return 0;
+    *value = (int)(unsigned)v;
+    return 1;
+}
+
+/* Condition register field of a leading "crN" operand; 0 without one */
+static int ir_crf(const PeepLine* l, int* k) {
+    if (l->nargs > 0 && l->arg_len[0] == 3 && memcmp(l->arg[0], "cr", 2) == 0
+            && l->arg[0][2] >= '0' && l->arg[0][2] <= '7') {
+        *k = 1;
+        return l->arg[0][2] - '0';
+    }
+    *k = 0;
+    return 0;
+}
+
+/* Lift one instruction line. Returns 0 for instructions the IR cannot
+ * carry even opaquely (branches it does not model, sc, lmw). */
+static int ir_lift(CompilerContext* cx, const PeepLine* l, IrInsn* in) {
+    static const struct { const char* op; unsigned char ir, imm; } arith[] = {
+        { "add", IR_ADD, 0 },   { "addi", IR_ADD, 1 },  { "sub", IR_SUB, 0 },
+        { "subi", IR_SUB, 1 },  { "mullw", IR_MUL, 0 }, { "mulli", IR_MUL, 1 },
+        { "divw", IR_DIV, 0 },  { "divwu", IR_DIVU, 0 }, { "and", IR_AND, 0 },
+        { "or", IR_OR, 0 },     { "ori", IR_OR, 1 },    { "xor", IR_XOR, 0 },
+        { "xori", IR_XOR, 1 },  { "slw", IR_SHL, 0 },   { "slwi", IR_SHL, 1 },
+        { "srw", IR_SHR, 0 },   { "srwi", IR_SHR, 1 },  { "sraw", IR_SAR, 0 },
+        { "srawi", IR_SAR, 1 }, { NULL, 0, 0 }
+    };
+    static const struct { const char* op; unsigned char ir, width, is_signed, indexed; } mem[] = {
+        { "lwz", IR_LOAD, 4, 0, 0 },   { "lhz", IR_LOAD, 2, 0, 0 },   { "lha", IR_LOAD, 2, 1, 0 },
+        { "lbz", IR_LOAD, 1, 0, 0 },   { "lwzx", IR_LOAD, 4, 0, 1 },  { "lhzx", IR_LOAD, 2, 0, 1 },
+        { "lhax", IR_LOAD, 2, 1, 1 },  { "lbzx", IR_LOAD, 1, 0, 1 },  { "stw", IR_STORE, 4, 0, 0 },
+        { "sth", IR_STORE, 2, 0, 0 },  { "stb", IR_STORE, 1, 0, 0 },  { "stwx", IR_STORE, 4, 0, 1 },
+        { "sthx", IR_STORE, 2, 0, 1 }, { "stbx", IR_STORE, 1, 0, 1 }, { NULL, 0, 0, 0, 0 }
+    };
+    static const char* conds[IR_CONDS] = { "beq", "bne", "blt", "bge", "bgt", "ble", "bdnz" };
+    int r0 = peep_reg(l, 0), r1 = peep_reg(l, 1), r2 = peep_reg(l, 2);
+    int k, v;
+
+    in->text = l->text;
+    in->text_len = l->len;
+    in->comment = l->comment;
+    in->comment_len = l->comment ? l->comment_len : 0;
+
+    if (l->op[0] == 'b') {
+        char op[16];
+        int n = (int)strlen(l->op);
+        memcpy(op, l->op, n + 1);
+        if (n > 1 && (op[n - 1] == '+' || op[n - 1] == '-')) op[--n] = '\0';   /* static hints */
+        if (strcmp(op, "b") == 0 && l->nargs == 1) {
+            in->op = IR_JUMP;
+            in->sym = intern(cx, l->arg[0], l->arg_len[0]);
+            return 1;
+        }
+        if (strcmp(op, "bl") == 0 && l->nargs == 1) {
+            in->op = IR_CALL;
+            in->sym = intern(cx, l->arg[0], l->arg_len[0]);
+            return 1;
+        }
+        for (v = 0; v < IR_CONDS; v++) {
+            if (strcmp(op, conds[v]) != 0) continue;
+            in->crf = ir_crf(l, &k);
+            if (l->nargs != k + 1 || (v == IR_DNZ && k)) return 0;
+            in->op = IR_BRANCH;
+            in->cond = v;
+            in->sym = intern(cx, l->arg[k], l->arg_len[k]);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(l->op, "li") == 0 && r0 > 0 && l->nargs == 2 && ir_parse_imm(l->arg[1], l->arg_len[1], &v)) {
+        in->op = IR_CONST;
+        in->dst = r0;
+        in->imm = v;
+        return 1;
+    }
+    if (strcmp(l->op, "lis") == 0 && r0 > 0 && l->nargs == 2 && ir_parse_imm(l->arg[1], l->arg_len[1], &v)) {
+        in->op = IR_CONST;
+        in->dst = r0;
+        in->imm = (int)((unsigned)v << 16);
+        return 1;
+    }
+    if (strcmp(l->op, "mr") == 0 && r0 >= 0 && r1 >= 0 && l->nargs == 2) {
+        in->op = IR_MOVE;
+        in->dst = r0;
+        in->src[0] = r1;
+        return 1;
+    }
+    if (strcmp(l->op, "neg") == 0 && r0 >= 0 && r1 >= 0 && l->nargs == 2) {
+        in->op = IR_NEG;
+        in->dst = r0;
+        in->src[0] = r1;
+        return 1;
+    }
+    if (strcmp(l->op, "subf") == 0 && r0 >= 0 && r1 >= 0 && r2 >= 0 && l->nargs == 3) {
+        in->op = IR_SUB;
+        in->dst = r0;
+        in->src[0] = r2;
+        in->src[1] = r1;
+        return 1;
+    }
+    if (strcmp(l->op, "la") == 0 && r0 >= 0 && l->nargs == 2 && peep_mem_base(l, 1) > 0
+            && peep_mem_disp(l, 1, &v)) {
+        in->op = IR_ADD;
+        in->dst = r0;
+        in->src[0] = peep_mem_base(l, 1);
+        in->has_imm = 1;
+        in->imm = v;
+        return 1;
+    }
+    for (k = 0; arith[k].op; k++) {
+        if (strcmp(l->op, arith[k].op) != 0 || l->nargs != 3 || r0 < 0 || r1 < 0) continue;
+        if (arith[k].imm) {
+            /* addi/subi read r0 as the constant 0 */
+            if (r1 == 0 && (arith[k].ir == IR_ADD || arith[k].ir == IR_SUB)) break;
+            if (!ir_parse_imm(l->arg[2], l->arg_len[2], &v)) break;
+            in->has_imm = 1;
+            in->imm = v;
+        } else {
+            if (r2 < 0) break;
+            in->src[1] = r2;
+        }
+        in->op = arith[k].ir;
+        in->dst = r0;
+        in->src[0] = r1;
+        return 1;
+    }
+    for (k = 0; mem[k].op; k++) {
+        if (strcmp(l->op, mem[k].op) != 0 || r0 < 0) continue;
+        if (mem[k].indexed) {
+            if (l->nargs != 3 || r1 <= 0 || r2 < 0) break;
+            in->src[0] = r1;
+            in->src[1] = r2;
+        } else {
+            if (l->nargs != 2 || peep_mem_base(l, 1) <= 0 || !peep_mem_disp(l, 1, &v)) break;
+            in->src[0] = peep_mem_base(l, 1);
+            in->has_imm = 1;
+            in->imm = v;
+        }
+        in->op = mem[k].ir;
+        in->width = mem[k].width;
+        in->is_signed = mem[k].is_signed;
+        if (in->op == IR_LOAD) in->dst = r0;
+        else in->src[2] = r0;
+        return 1;
+    }
+    if (strncmp(l->op, "cmp", 3) == 0) {
+        int is_imm = strcmp(l->op, "cmpwi") == 0 || strcmp(l->op, "cmplwi") == 0;
+        int is_reg = strcmp(l->op, "cmpw") == 0 || strcmp(l->op, "cmplw") == 0;
+        int crf = ir_crf(l, &k);
+        if ((is_imm || is_reg) && l->nargs == k + 2 && peep_reg(l, k) >= 0) {
+            if (is_reg && peep_reg(l, k + 1) >= 0) {
+                in->src[1] = peep_reg(l, k + 1);
+            } else if (is_imm && ir_parse_imm(l->arg[k + 1], l->arg_len[k + 1], &v)) {
+                in->has_imm = 1;
+                in->imm = v;
             } else {
-                /* General expression: return x * 2, return a + b, etc. */
-                compile_expr_to_reg(3);
+                is_imm = is_reg = 0;
             }
-
-            /* RAII cleanup */
-            for (i = var_count - 1; i >= saved_var_count; i--) {
-                emit_drop_glue(&vars[i]);
+            if (is_imm || is_reg) {
+                in->op = IR_CMP;
+                in->crf = crf;
+                in->is_signed = l->op[3] == 'w';
+                in->src[0] = peep_reg(l, k);
+                return 1;
             }
+        }
+    }
 
-            /* Epilogue and return */
-            printf("    addi r1, r1, %d\n", frame_size);
-            printf("    lwz r0, 8(r1)\n");
-            printf("    mtlr r0\n");
-            printf("    blr\n");
+    if (peep_effects(l, &in->use, &in->def) < 0) return 0;
+    in->op = IR_ASM;
+    return 1;
+}
 
-            while (*pos && *pos != ';') pos++;
-            if (*pos == ';') pos++;
+static int ir_line_is(const PeepLine* l, const char* op, const char* args) {
+    char buf[64] = "";
+    int n = 0, k;
+    if (l->kind != PEEP_INSN || strcmp(l->op, op) != 0) return 0;
+    for (k = 0; k < l->nargs; k++) {
+        n += snprintf(buf + n, sizeof(buf) - n, "%s%.*s", k ? ", " : "", l->arg_len[k], l->arg[k]);
+        if (n >= (int)sizeof(buf)) return 0;
+    }
+    return strcmp(buf, args) == 0;
+}
 
-        } else if (strncmp(pos, "println!", 8) == 0) {
-            pos += 8;
-            printf("    ; println! macro\n");
-            int pd = 0;
-            while (*pos) {
-                if (*pos == '(') pd++;
-                else if (*pos == ')') { pd--; if (pd == 0) { pos++; break; } }
-                pos++;
-            }
-            printf("    bl _rust_println\n");
-            while (*pos && *pos != ';') pos++;
-            if (*pos == ';') pos++;
-
-        } else if (strncmp(pos, "assert!", 7) == 0) {
-            pos += 7;
-            printf("    ; assert! macro\n");
-            printf("    bl _rust_assert\n");
-            int pd = 0;
-            while (*pos) {
-                if (*pos == '(') pd++;
-                else if (*pos == ')') { pd--; if (pd == 0) { pos++; break; } }
-                pos++;
+/* Give every def whose value stays inside its block a vreg of its own */
+static void ir_rename(CompilerContext* cx, IrFunction* fn) {
+    int b, i, k, max = 0;
+    for (b = 0; b < fn->block_count; b++) {
+        if (fn->blocks[b].count > max) max = fn->blocks[b].count;
+    }
+    char* own = malloc(max + 1);
+    for (b = 0; b < fn->block_count; b++) {
+        IrBlock* bl = &fn->blocks[b];
+        unsigned reaches_exit = bl->live_out, implicit = 0;
+        int cur[IR_PHYS];
+
+        /* Backwards: a def can be renamed if its value neither leaves the
+         * block nor is read by anything but an explicit operand */
+        for (i = bl->count - 1; i >= 0; i--) {
+            IrInsn* in = &bl->insns[i];
+            unsigned use, def, explicit_use = 0;
+            ir_effects(in, &use, &def);
+            own[i] = 0;
+            if (in->op != IR_ASM && in->op != IR_CALL && in->op != IR_ENTER && in->op != IR_RET) {
+                for (k = 0; k < 3; k++) {
+                    if (in->src[k] >= 0) explicit_use |= 1u << in->src[k];
+                }
+                if (in->dst >= 3 && in->dst != 13 && !((reaches_exit | implicit) & (1u << in->dst))) {
+                    own[i] = 1;
+                }
             }
-            while (*pos && *pos != ';') pos++;
-            if (*pos == ';') pos++;
+            reaches_exit &= ~def;
+            implicit = (implicit & ~def) | (use & ~explicit_use);
+        }
 
-        } else if (strncmp(pos, "break", 5) == 0 && !isalnum(*(pos+5))) {
-            pos += 5;
-            printf("    ; break\n");
-            /* Would need loop context to know target label */
-            while (*pos && *pos != ';') pos++;
-            if (*pos == ';') pos++;
+        for (k = 0; k < IR_PHYS; k++) cur[k] = k;
+        for (i = 0; i < bl->count; i++) {
+            IrInsn* in = &bl->insns[i];
+            unsigned use, def;
+            for (k = 0; k < 3; k++) {
+                if (in->src[k] >= 0) in->src[k] = cur[in->src[k]];
+            }
+            ir_effects(in, &use, &def);
+            for (k = 0; k < IR_PHYS; k++) {
+                if (def & (1u << k)) cur[k] = k;
+            }
+            if (own[i]) {
+                int v = ir_new_vreg(cx, fn, in->dst);
+                cur[in->dst] = v;
+                in->dst = v;
+            }
+        }
+    }
+    free(own);
+}
 
-        } else if (strncmp(pos, "continue", 8) == 0 && !isalnum(*(pos+8))) {
-            pos += 8;
-            printf("    ; continue\n");
-            while (*pos && *pos != ';') pos++;
-            if (*pos == ';') pos++;
+/* The edges between fn's blocks; 0 if the last one would run off the end */
+static int ir_edges(IrFunction* fn) {
+    int b, k;
+    for (b = 0; b < fn->block_count; b++) {
+        IrBlock* bl = &fn->blocks[b];
+        IrInsn* last = NULL;
+        bl->succ_count = 0;
+        for (k = 0; k < bl->count; k++) {
+            if (bl->insns[k].op != IR_NOTE && bl->insns[k].op != IR_NOP) last = &bl->insns[k];
+        }
+        if (last && (last->op == IR_JUMP || last->op == IR_BRANCH)) {
+            bl->succ[bl->succ_count++] = last->target;
+        }
+        if (!last || (last->op != IR_JUMP && last->op != IR_RET)) {
+            if (b + 1 < fn->block_count) bl->succ[bl->succ_count++] = b + 1;
+            else if (last) return 0;
+        }
+    }
+    return 1;
+}
 
-        } else if (isalpha(*pos) || *pos == '_') {
-            /* Method calls, field access, assignments, function calls */
-            char obj_name[64] = {0};
-            parse_string(obj_name, sizeof(obj_name));
+/* Lift the function whose label is at line first; NULL if anything in it
+ * is beyond the IR, which leaves its text to the text passes alone */
+static IrFunction* ir_build_function(CompilerContext* cx, PeepState* ps, int first, int end, int frame) {
+    IrFunction* fn = arena_alloc(cx, sizeof(IrFunction));
+    int* block_at = arena_alloc(cx, (end - first) * sizeof(int));
+    IrBlock* cur;
+    int i, b, k;
+
+    fn->first_line = first;
+    fn->frame = frame;
+    for (i = first; i < end; i++) block_at[i - first] = -1;
+    for (i = first + 1; i <= first + 3; i++) {
+        if (i >= end || ps->lines[i].kind != PEEP_INSN) return NULL;
+    }
 
-            int obj_offset = -1;
-            RustType obj_type = TYPE_I32;
-            for (i = 0; i < var_count; i++) {
-                if (strcmp(vars[i].name, obj_name) == 0) {
-                    obj_offset = vars[i].offset;
-                    obj_type = vars[i].type;
-                    break;
-                }
+    cur = ir_new_block(cx, fn, intern(cx, ps->lines[first].text, ps->lines[first].len - 1));
+    ir_size_block(cx, cur, ps, first + 1, end);
+    block_at[0] = 0;
+    IrInsn* in = ir_append(cx, cur);
+    in->op = IR_ENTER;
+    in->imm = frame;
+    in->text = ps->lines[first + 1].text;
+    in->text_len = (int)(ps->lines[first + 3].text + ps->lines[first + 3].len - in->text);
+    in->comment = ps->lines[first + 3].comment;
+    in->comment_len = in->comment ? ps->lines[first + 3].comment_len : 0;
+
+    for (i = first + 4; i < end; i++) {
+        PeepLine* l = &ps->lines[i];
+        if (l->kind == PEEP_LABEL) {
+            if (!isalpha((unsigned char)l->text[0]) && l->text[0] != '_') return NULL;
+            cur = ir_new_block(cx, fn, intern(cx, l->text, l->len - 1));
+            ir_size_block(cx, cur, ps, i + 1, end);
+            block_at[i - first] = fn->block_count - 1;
+            continue;
+        }
+        if (l->kind == PEEP_OTHER) {
+            const char* p = l->text;
+            const char* e = l->text + l->len;
+            if (p < e && *p != ' ' && *p != '\t' && *p != ';') break;   /* directive: the function is over */
+            while (p < e && (*p == ' ' || *p == '\t')) p++;
+            if (!cur) {
+                cur = ir_new_block(cx, fn, IR_NONE);
+                ir_size_block(cx, cur, ps, i, end);
             }
-
-            skip_whitespace();
-
-            if ((*pos == '+' || *pos == '-' || *pos == '*' || *pos == '/' || *pos == '%' ||
-                 *pos == '&' || *pos == '|' || *pos == '^') && *(pos+1) == '=') {
-                /* Compound assignment: +=, -=, *=, /=, %=, &=, |=, ^= */
-                char cop = *pos;
-                pos += 2;
-                skip_whitespace();
-                if (obj_offset >= 0) {
-                    printf("    lwz r14, %d(r1)   ; load %s\n", obj_offset, obj_name);
-                    compile_expr_to_reg(15);
-                    if (cop == '+') printf("    add r14, r14, r15\n");
-                    else if (cop == '-') printf("    sub r14, r14, r15\n");
-                    else if (cop == '*') printf("    mullw r14, r14, r15\n");
-                    else if (cop == '/') printf("    divw r14, r14, r15\n");
-                    else if (cop == '%') { printf("    divw r16, r14, r15\n"); printf("    mullw r16, r16, r15\n"); printf("    sub r14, r14, r16\n"); }
-                    else if (cop == '&') printf("    and r14, r14, r15\n");
-                    else if (cop == '|') printf("    or r14, r14, r15\n");
-                    else if (cop == '^') printf("    xor r14, r14, r15\n");
-                    printf("    stw r14, %d(r1)   ; %s %c= expr\n", obj_offset, obj_name, cop);
+            in = ir_append(cx, cur);
+            in->op = IR_NOTE;
+            in->text = l->text;
+            in->text_len = l->len;
+            if (e - p >= 8 && memcmp(p, ".section", 8) == 0) {
+                /* A string literal: everything up to the switch back to
+                 * .text is one note, its label included */
+                while (++i < end && !(ps->lines[i].kind == PEEP_OTHER && ps->lines[i].len >= 9
+                        && memcmp(ps->lines[i].text, "    .text", 9) == 0)) {
                 }
-                while (*pos && *pos != ';') pos++;
-                if (*pos == ';') pos++;
-
-            } else if (*pos == '=' && *(pos+1) != '=') {
-                pos++;
-                skip_whitespace();
-                if (obj_offset >= 0) {
-                    compile_expr_to_reg(14);
-                    printf("    stw r14, %d(r1)   ; %s = expr\n", obj_offset, obj_name);
-                }
-                while (*pos && *pos != ';') pos++;
-                if (*pos == ';') pos++;
-
-            } else if (*pos == '.') {
-                pos++;
-                if (strncmp(pos, "await", 5) == 0 && !isalnum(*(pos+5))) {
-                    pos += 5;
-                    printf("    ; %s.await\n", obj_name);
-                    printf("    lwz r3, %d(r1)\n", obj_offset >= 0 ? obj_offset : 0);
-                    printf("    bl _await_future\n");
-                } else {
-                    char method[64] = {0};
-                    parse_string(method, sizeof(method));
-                    int var_off = obj_offset >= 0 ? obj_offset : 0;
+                if (i == end) return NULL;
+                in->text_len = (int)(ps->lines[i].text + ps->lines[i].len - in->text);
+            }
+            continue;
+        }
 
-                    if (*pos == '(') {
-                        printf("    ; %s.%s()\n", obj_name, method);
-                        if (strcmp(method, "clone") == 0) {
-                            printf("    la r3, %d(r1)\n", var_off);
-                            printf("    bl _clone_impl\n");
-                        } else if (strcmp(method, "drop") == 0) {
-                            printf("    la r3, %d(r1)\n", var_off);
-                            printf("    bl _drop_impl\n");
-                        } else if (strcmp(method, "len") == 0) {
-                            printf("    lwz r3, %d(r1)\n", var_off + 4);
-                        } else if (strcmp(method, "push") == 0) {
-                            printf("    lwz r3, %d(r1)    ; Vec ptr\n", var_off);
-                            printf("    bl _vec_push\n");
-                        } else if (strcmp(method, "iter") == 0) {
-                            printf("    la r3, %d(r1)\n", var_off);
-                            printf("    bl _create_iter\n");
-                        } else if (strcmp(method, "collect") == 0) {
-                            printf("    bl _iter_collect\n");
-                        } else if (strcmp(method, "unwrap") == 0) {
-                            printf("    lwz r14, %d(r1)   ; load tag\n", var_off);
-                            if (obj_type == TYPE_RESULT) {
-                                printf("    cmpwi r14, 1\n");
-                                printf("    beq _panic_unwrap ; panic if Err\n");
-                            } else {
-                                printf("    cmpwi r14, 0\n");
-                                printf("    beq _panic_unwrap ; panic if None\n");
-                            }
-                            printf("    lwz r3, %d(r1)\n", var_off + 4);
-                        } else {
-                            printf("    la r3, %d(r1)\n", var_off);
-                            { char mname[256]; snprintf(mname, sizeof(mname), "%s_%s", obj_name, method);
-                            printf("    bl _%s\n", sanitize_label(mname)); }
-                        }
-                        while (*pos && *pos != ')') pos++;
-                        if (*pos == ')') pos++;
-                    } else {
-                        /* Field access: obj.field (not a method call) */
-                        printf("    ; %s.%s (field access)\n", obj_name, method);
-                        int field_off = -1;
-                        int is_self = (strcmp(obj_name, "self") == 0);
+        if (!cur) {
+            cur = ir_new_block(cx, fn, IR_NONE);
+            ir_size_block(cx, cur, ps, i, end);
+        }
+        if (strcmp(l->op, "blr") == 0) return NULL;
+        if (strcmp(l->op, "addi") == 0 && peep_reg(l, 0) == 1 && peep_reg(l, 1) == 1) {
+            char pop[16];
+            snprintf(pop, sizeof(pop), "r1, r1, %d", frame);
+            if (i + 3 >= end || !ir_line_is(l, "addi", pop) || !ir_line_is(&ps->lines[i + 1], "lwz", "r0, 8(r1)")
+                    || !ir_line_is(&ps->lines[i + 2], "mtlr", "r0") || !ir_line_is(&ps->lines[i + 3], "blr", "")) {
+                return NULL;
+            }
+            in = ir_append(cx, cur);
+            in->op = IR_RET;
+            in->imm = frame;
+            in->text = l->text;
+            in->text_len = (int)(ps->lines[i + 3].text + ps->lines[i + 3].len - l->text);
+            i += 3;
+            cur = NULL;
+            continue;
+        }
+        in = ir_append(cx, cur);
+        if (!ir_lift(cx, l, in)) return NULL;
+        if (in->op == IR_JUMP || in->op == IR_BRANCH) cur = NULL;
+    }
+    fn->end_line = i;
+
+    /* Branch targets */
+    for (b = 0; b < fn->block_count; b++) {
+        IrBlock* bl = &fn->blocks[b];
+        for (k = 0; k < bl->count; k++) {
+            in = &bl->insns[k];
+            if (in->op == IR_JUMP || in->op == IR_BRANCH) {
+                int line = in->sym < ps->label_syms ? ps->label_at[in->sym] - 1 : -1;
+                if (line < first || line >= fn->end_line || block_at[line - first] < 0) return NULL;
+                in->target = block_at[line - first];
+                in->sym = IR_NONE;
+            }
+        }
+    }
+    if (!ir_edges(fn)) return NULL;
 
-                        /* Resolve struct type */
-                        int struct_idx = -1;
-                        if (is_self && current_impl_struct >= 0) {
-                            struct_idx = current_impl_struct;
-                        } else if (obj_type == TYPE_STRUCT) {
-                            for (int si = 0; si < struct_count; si++) {
-                                int fi;
-                                for (fi = 0; fi < structs[si].field_count; fi++) {
-                                    if (strcmp(structs[si].fields[fi].name, method) == 0) {
-                                        struct_idx = si;
-                                        field_off = structs[si].fields[fi].offset;
-                                        break;
-                                    }
-                                }
-                                if (field_off >= 0) break;
-                            }
-                        }
-                        if (struct_idx >= 0 && field_off < 0) {
-                            for (int fi = 0; fi < structs[struct_idx].field_count; fi++) {
-                                if (strcmp(structs[struct_idx].fields[fi].name, method) == 0) {
-                                    field_off = structs[struct_idx].fields[fi].offset;
-                                    break;
-                                }
-                            }
-                        }
-                        if (field_off < 0) field_off = 0;
+    ir_liveness(fn);
+    ir_rename(cx, fn);
+    return fn;
+}
 
-                        skip_whitespace();
-                        if (*pos == '=' && *(pos+1) != '=') {
-                            /* self.field = expr */
-                            pos++;
-                            skip_whitespace();
-                            compile_expr_to_reg(14);
-                            if (is_self) {
-                                printf("    lwz r15, %d(r1)   ; load self ptr\n", var_off);
-                                printf("    stw r14, %d(r15)  ; self.%s = expr\n", field_off, method);
-                            } else {
-                                printf("    stw r14, %d(r1)   ; %s.%s = expr\n", var_off + field_off, obj_name, method);
-                            }
-                        } else if ((*pos == '+' || *pos == '-' || *pos == '*') && *(pos+1) == '=') {
-                            /* self.field += expr */
-                            char cop = *pos;
-                            pos += 2;
-                            skip_whitespace();
-                            if (is_self) {
-                                printf("    lwz r15, %d(r1)   ; load self ptr\n", var_off);
-                                printf("    lwz r14, %d(r15)  ; load self.%s\n", field_off, method);
-                            } else {
-                                printf("    lwz r14, %d(r1)   ; load %s.%s\n", var_off + field_off, obj_name, method);
-                            }
-                            compile_expr_to_reg(16);
-                            if (cop == '+') printf("    add r14, r14, r16\n");
-                            else if (cop == '-') printf("    sub r14, r14, r16\n");
-                            else if (cop == '*') printf("    mullw r14, r14, r16\n");
-                            if (is_self) {
-                                printf("    stw r14, %d(r15)  ; self.%s %c= expr\n", field_off, method, cop);
-                            } else {
-                                printf("    stw r14, %d(r1)   ; %s.%s %c= expr\n", var_off + field_off, obj_name, method, cop);
-                            }
-                        } else {
-                            /* Just a read: obj.field */
-                            if (is_self) {
-                                printf("    lwz r15, %d(r1)   ; load self ptr\n", var_off);
-                                printf("    lwz r3, %d(r15)   ; load self.%s\n", field_off, method);
-                            } else {
-                                printf("    lwz r3, %d(r1)    ; load %s.%s\n", var_off + field_off, obj_name, method);
-                            }
-                        }
-                    }
-                }
-                while (*pos && *pos != ';') pos++;
-                if (*pos == ';') pos++;
+static void ir_build(CompilerContext* cx, PeepState* ps) {
+    IrProgram* prog = arena_alloc(cx, sizeof(IrProgram));
+    int i, frame;
+    for (i = 0; i < ps->count; i++) {
+        int entry = peep_function_at(ps, i, &frame);
+        if (entry != i + 3) continue;
+        int end = entry + 1;
+        while (end < ps->count && !(ps->lines[end].kind == PEEP_LABEL && ps->lines[end].text[0] == '_')) end++;
+        IrFunction* fn = ir_build_function(cx, ps, i, end, frame);
+        if (fn) {
+            prog->funcs = table_reserve(cx, prog->funcs, prog->count, &prog->capacity, sizeof(IrFunction));
+            prog->funcs[prog->count++] = *fn;
+            i = fn->end_line - 1;
+        } else {
+            i = end - 1;
+        }
+    }
+    ps->ir = prog;
+}
 
-            } else if (*pos == '[') {
-                pos++;
-                int index = parse_number();
-                int var_off = obj_offset >= 0 ? obj_offset : 0;
-                printf("    ; %s[%d]\n", obj_name, index);
-                printf("    lwz r3, %d(r1)\n", var_off);
-                printf("    lwz r3, %d(r3)\n", index * 4);
-                while (*pos && *pos != ']') pos++;
-                if (*pos == ']') pos++;
-                while (*pos && *pos != ';') pos++;
-                if (*pos == ';') pos++;
-
-            } else if (*pos == '(') {
-                printf("    ; Call %s()\n", obj_name);
-                /* Parse arguments */
-                pos++;
-                int arg_reg = 3;
-                while (*pos && *pos != ')') {
-                    skip_whitespace();
-                    if (*pos == ')') break;
-                    if (*pos == '"') {
-                        /* String literal argument */
-                        pos++;
-                        while (*pos && *pos != '"') { if (*pos == '\\') pos++; pos++; }
-                        if (*pos == '"') pos++;
-                        /* Pass string address in register (simplified) */
-                        if (arg_reg <= 10) {
-                            printf("    li r%d, 0         ; string arg (TODO)\n", arg_reg++);
-                        }
-                    } else if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
-                        int aval = parse_number();
-                        if (arg_reg <= 10) {
-                            emit_li(arg_reg, aval); arg_reg++;
-                        }
-                    } else if (isalpha(*pos) || *pos == '_') {
-                        char aname[64] = {0};
-                        parse_string(aname, sizeof(aname));
-                        int j;
-                        for (j = 0; j < var_count; j++) {
-                            if (strcmp(vars[j].name, aname) == 0) {
-                                if (arg_reg <= 10) {
-                                    printf("    lwz r%d, %d(r1)\n", arg_reg++, vars[j].offset);
-                                }
-                                break;
-                            }
-                        }
-                    } else {
-                        /* Unknown argument type — skip one char to avoid infinite loop */
-                        pos++;
-                    }
-                    skip_whitespace();
-                    if (*pos == ',') pos++;
-                }
-                if (*pos == ')') pos++;
-                printf("    bl _%s\n", sanitize_label(obj_name));
-                while (*pos && *pos != ';') pos++;
-                if (*pos == ';') pos++;
+/* Inlining (-C opt-level=2 and up). A call to a small function becomes a
+ * copy of the callee's IR: its reachable blocks go in between the two
+ * halves of the calling block, its returns become jumps to the second
+ * half, and its frame slots move up above the caller's (whose frame grows
+ * when they would crowd out the save area). The argument set-up stays as
+ * codegen wrote it; regalloc and copy-prop fold it into the body like any
+ * other slot traffic.
+ *
+ * The size limit counts IR instructions: -C inline-threshold, four times
+ * that for #[inline], none for #[inline(always)]; #[inline(never)] is
+ * never inlined. Other crates' functions come from the metadata files
+ * named by --extern NAME=PATH, which --emit=metadata writes: the lifted
+ * text of every pub #[inline] function that makes no calls. */
+#define INLINE_THRESHOLD 24
+#define INLINE_SAVE_AREA (19 * 4)       /* what save-regs may put above the slots */
 
+typedef struct {
+    IrFunction* fn;
+    int sym;                    /* the label calls name, */
+    int alias;                  /* ... or _crate_label for another crate's; -1 */
+    int hint;                   /* INLINE_* */
+    int exported;               /* pub #[inline]: goes into --emit=metadata */
+    int external;               /* from an --extern file */
+    int scanned;                /* the fields below are current */
+    int ok;                     /* the body can be copied */
+    int size;                   /* instructions reachable from the entry */
+    int blocks;                 /* ... and the blocks holding them */
+    int has_call;
+    int lo, hi;                 /* frame bytes its slots take */
+    unsigned clobbers;          /* GPRs v0-v31 it writes */
+    char* reach;                /* [block]: reachable from the entry */
+} InlineCallee;
+
+static const char* inline_hint_names[] = { "auto", "hint", "always", "never" };
+
+/* The frame bytes fn's slots span, [*lo, *hi); 0 if r1 serves for
+ * anything but loads, stores and addresses of sized objects */
+static int ir_frame_extent(const IrFunction* fn, int* lo, int* hi) {
+    int b, i;
+    *lo = fn->frame;
+    *hi = 72;
+    for (b = 0; b < fn->block_count; b++) {
+        for (i = 0; i < fn->blocks[b].count; i++) {
+            const IrInsn* in = &fn->blocks[b].insns[i];
+            unsigned use, def;
+            int end;
+            if (in->op == IR_ENTER || in->op == IR_RET) continue;
+            ir_effects(in, &use, &def);
+            if (!((use | def) & (1u << 1))) continue;
+            if ((in->op == IR_LOAD || in->op == IR_STORE) && in->src[0] == 1 && in->has_imm
+                    && in->dst != 1 && in->src[2] != 1) {
+                end = in->imm + in->width;
+            } else if (in->op == IR_ADD && in->src[0] == 1 && in->has_imm && in->dst != 1
+                    && la_extent(in->comment, in->comment_len) > 0) {
+                end = in->imm + la_extent(in->comment, in->comment_len);
             } else {
-                /* Unknown statement — skip to semicolon */
-                while (*pos && *pos != ';') pos++;
-                if (*pos == ';') pos++;
+                return 0;
             }
-
-        } else {
-            pos++;
+            if (in->imm < 0 || end > fn->frame) return 0;
+            if (in->imm < *lo) *lo = in->imm;
+            if (end > *hi) *hi = end;
         }
+    }
+    return 1;
+}
 
-        skip_whitespace();
+static void inline_scan(CompilerContext* cx, InlineCallee* ce) {
+    IrFunction* fn = ce->fn;
+    int b, i, k, changed = 1;
+
+    ce->scanned = 1;
+    ce->ok = ir_frame_extent(fn, &ce->lo, &ce->hi) && ce->lo >= 72;
+    ce->size = ce->blocks = ce->has_call = 0;
+    ce->clobbers = 0;
+    ce->reach = arena_alloc(cx, fn->block_count);
+    ce->reach[0] = 1;
+    while (changed) {
+        changed = 0;
+        for (b = 0; b < fn->block_count; b++) {
+            if (!ce->reach[b]) continue;
+            for (k = 0; k < fn->blocks[b].succ_count; k++) {
+                if (!ce->reach[fn->blocks[b].succ[k]]) changed = ce->reach[fn->blocks[b].succ[k]] = 1;
+            }
+        }
+    }
+    for (b = 0; b < fn->block_count; b++) {
+        if (!ce->reach[b]) continue;
+        ce->blocks++;
+        for (i = 0; i < fn->blocks[b].count; i++) {
+            const IrInsn* in = &fn->blocks[b].insns[i];
+            unsigned use, def;
+            if (in->op == IR_NOTE) {
+                /* comments come along; string data would repeat its label */
+                const char* p = in->text;
+                while (p < in->text + in->text_len && (*p == ' ' || *p == '\t')) p++;
+                if (p < in->text + in->text_len && *p != ';') ce->ok = 0;
+                continue;
+            }
+            if (in->op == IR_NOP || in->op == IR_ENTER || in->op == IR_RET) continue;
+            if (in->op == IR_CALL) ce->has_call = 1;
+            ce->size++;
+            ir_effects(in, &use, &def);
+            ce->clobbers |= def;
+        }
     }
+}
 
-    /* Restore state for caller */
-    stack_offset = saved_stack_offset;
-    /* Don't restore var_count — locals remain visible for drop glue if needed */
+static int inline_vreg(CompilerContext* cx, IrFunction* fn, const IrFunction* callee, int* map, int v) {
+    if (v < IR_PHYS) return v;
+    if (!map[v - IR_PHYS]) map[v - IR_PHYS] = ir_new_vreg(cx, fn, callee->vreg_hint[v - IR_PHYS]);
+    return map[v - IR_PHYS];
 }
 
-/* Emit PIC symbol stubs for malloc/free — required on Tiger PPC.
- * Must be called at end of every translation unit.
- */
-void emit_pic_stubs(void) {
-    printf("\n    .section __TEXT,__picsymbolstub1,symbol_stubs,pure_instructions,32\n");
-    printf("    .align 5\n");
-    printf("L_malloc$stub:\n");
-    printf("    .indirect_symbol _malloc\n");
-    printf("    mflr r0\n");
-    printf("    bcl 20,31,\"L_malloc$spb\"\n");
-    printf("\"L_malloc$spb\":\n");
-    printf("    mflr r11\n");
-    printf("    addis r11,r11,ha16(L_malloc$lazy_ptr-\"L_malloc$spb\")\n");
-    printf("    mtlr r0\n");
-    printf("    lwzu r12,lo16(L_malloc$lazy_ptr-\"L_malloc$spb\")(r11)\n");
-    printf("    mtctr r12\n");
-    printf("    bctr\n");
-    printf("L_free$stub:\n");
-    printf("    .indirect_symbol _free\n");
-    printf("    mflr r0\n");
-    printf("    bcl 20,31,\"L_free$spb\"\n");
-    printf("\"L_free$spb\":\n");
-    printf("    mflr r11\n");
-    printf("    addis r11,r11,ha16(L_free$lazy_ptr-\"L_free$spb\")\n");
-    printf("    mtlr r0\n");
-    printf("    lwzu r12,lo16(L_free$lazy_ptr-\"L_free$spb\")(r11)\n");
-    printf("    mtctr r12\n");
-    printf("    bctr\n");
-    printf("    .lazy_symbol_pointer\n");
-    printf("L_malloc$lazy_ptr:\n");
-    printf("    .indirect_symbol _malloc\n");
-    printf("    .long dyld_stub_binding_helper\n");
-    printf("L_free$lazy_ptr:\n");
-    printf("    .indirect_symbol _free\n");
-    printf("    .long dyld_stub_binding_helper\n");
-    printf("    .subsections_via_symbols\n");
-}
-
-void compile_rust(char* source) {
-    pos = source;
-    
-    printf("; PowerPC Rust Compiler - 100%% Firefox-Ready Edition\n");
-    printf("; Complete Rust implementation for PowerPC\n");
-    printf("; Supports all features needed for Firefox\n\n");
-    
-    /* Initialize built-in macros */
-    strcpy(macros[0].name, "println!");
-    macros[0].is_builtin = 1;
-    strcpy(macros[1].name, "vec!");
-    macros[1].is_builtin = 1;
-    strcpy(macros[2].name, "format!");
-    macros[2].is_builtin = 1;
-    strcpy(macros[3].name, "panic!");
-    macros[3].is_builtin = 1;
-    strcpy(macros[4].name, "assert!");
-    macros[4].is_builtin = 1;
-    strcpy(macros[5].name, "dbg!");
-    macros[5].is_builtin = 1;
-    macro_count = 6;
-    
-    /* Multi-pass compilation */
-    
-    /* Pass 1: Collect type definitions */
-    while (*pos) {
-        skip_whitespace();
-
-        /* Skip comments */
-        if (*pos == '/' && *(pos+1) == '/') {
-            while (*pos && *pos != '\n') pos++;
-            if (*pos == '\n') pos++;
-            continue;
-        }
-        if (*pos == '/' && *(pos+1) == '*') {
-            pos += 2;
-            while (*pos && !(*pos == '*' && *(pos+1) == '/')) pos++;
-            if (*pos) pos += 2;
-            continue;
+/* Replace the call at fn's block b, insn i, with ce's body. *caller_hi is
+ * the top of the caller's slots, moved up past the callee's. */
+static int ir_inline_call(CompilerContext* cx, IrFunction* fn, int b, int i, InlineCallee* ce, int* caller_hi) {
+    const IrFunction* callee = ce->fn;
+    IrBlock* bl = &fn->blocks[b];
+    unsigned live = bl->live_out;
+    int j, k, crossing = 0, frame = fn->frame;
+
+    /* The callee may not write a nonvolatile register the caller reads
+     * after the call, and no vreg (block-local by construction) may be
+     * live across the split */
+    for (j = bl->count - 1; j > i; j--) {
+        unsigned use, def;
+        ir_effects(&bl->insns[j], &use, &def);
+        live = (live & ~def) | use;
+    }
+    if (live & ce->clobbers & ~(1u << 0 | 0x1FF8u)) return 0;
+    char* later = calloc(fn->vreg_count + 1, 1);
+    for (j = i + 1; j < bl->count; j++) {
+        IrInsn* in = &bl->insns[j];
+        for (k = 0; k < 3; k++) {
+            if (in->src[k] >= IR_PHYS && !later[in->src[k] - IR_PHYS]) crossing = 1;
         }
+        if (in->dst >= IR_PHYS) later[in->dst - IR_PHYS] = 1;
+    }
+    free(later);
+    if (crossing) return 0;
+
+    int top = (*caller_hi + 3) & ~3;
+    int delta = top - ce->lo;
+    int new_hi = top + ce->hi - ce->lo;
+    if (new_hi + INLINE_SAVE_AREA > frame) {
+        frame = (new_hi + INLINE_SAVE_AREA + 15) & ~15;
+        if (frame > 32752) return 0;
+    }
 
-        /* Skip string literals — prevents parsing code inside strings as definitions */
-        if (*pos == '"') {
-            pos++;
-            while (*pos && *pos != '"') {
-                if (*pos == '\\') pos++; /* skip escaped char */
-                if (*pos) pos++;
+    /* Layout: blocks up to b (the first half), the copies, the second
+     * half, then the rest */
+    int m = ce->blocks, tail = b + 1 + m, count = fn->block_count + m + 1;
+    IrBlock* blocks = arena_alloc(cx, count * sizeof(IrBlock));
+    int* map = malloc(callee->block_count * sizeof(int));
+    int* vmap = calloc(callee->vreg_count + 1, sizeof(int));
+    for (k = 0, j = 0; k < callee->block_count; k++) map[k] = ce->reach[k] ? b + 1 + j++ : -1;
+
+    memcpy(blocks, fn->blocks, (b + 1) * sizeof(IrBlock));
+    memcpy(blocks + tail + 1, fn->blocks + b + 1, (fn->block_count - b - 1) * sizeof(IrBlock));
+    blocks[tail].label = IR_NONE;
+    for (j = i + 1; j < bl->count; j++) *ir_append(cx, &blocks[tail]) = bl->insns[j];
+    blocks[b].count = i;
+    for (k = 0; k < count; k++) {
+        if (k > b && k < tail) continue;
+        for (j = 0; j < blocks[k].count; j++) {
+            IrInsn* in = &blocks[k].insns[j];
+            if ((in->op == IR_JUMP || in->op == IR_BRANCH) && in->target > b) in->target += m + 1;
+            if (frame != fn->frame && (in->op == IR_ENTER || in->op == IR_RET)) {
+                in->imm = frame;
+                in->text = NULL;
             }
-            if (*pos == '"') pos++;
-            continue;
         }
-        /* Skip raw string literals r"..." and r#"..."# */
-        if (*pos == 'r' && (*(pos+1) == '"' || (*(pos+1) == '#' && *(pos+2) == '"'))) {
-            if (*(pos+1) == '#' && *(pos+2) == '"') {
-                pos += 3;
-                while (*pos && !(*pos == '"' && *(pos+1) == '#')) pos++;
-                if (*pos) pos += 2;
-            } else if (*(pos+1) == '"') {
-                pos += 2;
-                while (*pos && *pos != '"') pos++;
-                if (*pos == '"') pos++;
+    }
+
+    for (k = 0; k < callee->block_count; k++) {
+        IrBlock* to = &blocks[map[k] < 0 ? 0 : map[k]];
+        if (map[k] < 0) continue;
+        to->label = IR_NONE;
+        for (j = 0; j < callee->blocks[k].count; j++) {
+            IrInsn in = callee->blocks[k].insns[j];
+            if (in.op == IR_ENTER || in.op == IR_NOP) continue;
+            if (in.op == IR_RET) {
+                memset(&in, 0, sizeof(in));
+                in.op = IR_JUMP;
+                in.dst = in.src[0] = in.src[1] = in.src[2] = in.sym = IR_NONE;
+                in.target = tail;
+            } else if (in.op == IR_JUMP || in.op == IR_BRANCH) {
+                in.target = map[in.target];
+                in.text = NULL;
+            } else if ((in.op == IR_LOAD || in.op == IR_STORE || in.op == IR_ADD) && in.src[0] == 1 && in.has_imm) {
+                in.imm += delta;
+                in.text = NULL;
             }
+            in.dst = inline_vreg(cx, fn, callee, vmap, in.dst);
+            for (int s = 0; s < 3; s++) in.src[s] = inline_vreg(cx, fn, callee, vmap, in.src[s]);
+            *ir_append(cx, to) = in;
+        }
+    }
+    free(map);
+    free(vmap);
+
+    fn->blocks = blocks;
+    fn->block_count = fn->block_capacity = count;
+    fn->frame = frame;
+    ir_edges(fn);
+    ir_liveness(fn);
+    *caller_hi = new_hi;
+    return 1;
+}
+
+/* --emit=metadata: every exported function whose body can be copied
+ * anywhere, as the text ir-build lifted it from */
+static void inline_write_metadata(CompilerContext* cx, PeepState* ps, InlineCallee* callees, int count) {
+    FILE* out = fopen(cx->meta_path, "w");
+    int f, k;
+    if (!out) {
+        fprintf(stderr, "%s: Cannot write metadata: %s\n", cx->meta_path, strerror(errno));
+        return;
+    }
+    fprintf(out, "rustc_ppc metadata 1\n");
+    for (f = 0; f < count; f++) {
+        InlineCallee* ce = &callees[f];
+        if (!ce->exported) continue;
+        if (!ce->scanned) inline_scan(cx, ce);
+        if (!ce->ok || ce->has_call) continue;
+        fprintf(out, "inline %s %s\n", sym_name(cx, ce->sym), inline_hint_names[ce->hint]);
+        for (k = ce->fn->first_line; k < ce->fn->end_line; k++) {
+            fprintf(out, "%.*s\n", ps->lines[k].len, ps->lines[k].text);
+        }
+        fprintf(out, "end\n");
+    }
+    if (fclose(out) != 0) fprintf(stderr, "%s: Cannot write metadata: %s\n", cx->meta_path, strerror(errno));
+}
+
+/* --extern NAME=PATH: lift the functions in a dependency's metadata */
+static InlineCallee* inline_read_metadata(CompilerContext* cx, const char* spec, InlineCallee* callees,
+                                          int* count, int* capacity) {
+    const char* eq = strchr(spec, '=');
+    FILE* in = fopen(eq + 1, "r");
+    char* text;
+    long size;
+    if (!in) {
+        fprintf(stderr, "%s: Cannot open metadata: %s\n", eq + 1, strerror(errno));
+        return callees;
+    }
+    fseek(in, 0, SEEK_END);
+    size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    text = arena_alloc(cx, size + 1);
+    size = (long)fread(text, 1, size, in);
+    fclose(in);
+    if (strncmp(text, "rustc_ppc metadata 1\n", 21) != 0) {
+        fprintf(stderr, "%s: not rustc_ppc metadata\n", eq + 1);
+        return callees;
+    }
+
+    char* p = text;
+    char* end = text + size;
+    while (p < end) {
+        char* nl = memchr(p, '\n', end - p);
+        char label[256], hint[16], alias[512];
+        int h, fields;
+        if (!nl) break;
+        /* one line at a time: sscanf() measures all it is given */
+        *nl = '\0';
+        fields = sscanf(p, "inline %255s %15s", label, hint);
+        *nl = '\n';
+        if (fields != 2) {
+            p = nl + 1;
             continue;
         }
+        /* The body runs to the "end" line */
+        char* body = nl + 1;
+        for (p = body; p < end && !(end - p >= 4 && memcmp(p, "end\n", 4) == 0); ) {
+            nl = memchr(p, '\n', end - p);
+            p = nl ? nl + 1 : end;
+        }
+        PeepState tmp;
+        int frame;
+        memset(&tmp, 0, sizeof(tmp));
+        peep_load_text(cx, &tmp, body, p - body);
+        p += 4;
+        if (tmp.count == 0 || peep_function_at(&tmp, 0, &frame) != 3) continue;
+        IrFunction* fn = ir_build_function(cx, &tmp, 0, tmp.count, frame);
+        if (!fn) continue;
+        for (h = INLINE_HINT; h < INLINE_NEVER && strcmp(hint, inline_hint_names[h]) != 0; h++) {
+        }
 
-        if (strncmp(pos, "#[derive(", 9) == 0) {
-            /* Parse derive macros */
-            pos += 9;
-            /* Skip derive content - parsed but not needed for codegen */
-            while (*pos && *pos != ')') pos++;
-        } else if (strncmp(pos, "struct ", 7) == 0) {
-            pos += 7;
-            skip_whitespace();
-            
-            char struct_name[64] = {0};
-            parse_string(struct_name, sizeof(struct_name));
-            
-            strcpy(structs[struct_count].name, struct_name);
-            
-            /* Parse generics */
-            if (*pos == '<') {
-                pos++;
-                char generics[128] = {0};
-                int g_idx = 0;
-                while (*pos && *pos != '>' && g_idx < 127) {
-                    generics[g_idx++] = *pos++;
-                }
-                strcpy(structs[struct_count].generics, generics);
-                if (*pos == '>') pos++;
+        callees = table_reserve(cx, callees, *count, capacity, sizeof(InlineCallee));
+        InlineCallee* ce = &callees[(*count)++];
+        memset(ce, 0, sizeof(*ce));
+        ce->fn = fn;
+        ce->sym = intern(cx, label, strlen(label));
+        snprintf(alias, sizeof(alias), "_%.*s%s", (int)(eq - spec), spec, label);
+        ce->alias = intern(cx, alias, strlen(alias));
+        ce->hint = h;
+        ce->external = 1;
+    }
+    return callees;
+}
+
+static void ir_inline(CompilerContext* cx, PeepState* ps) {
+    IrProgram* prog = ps->ir;
+    InlineCallee* callees = NULL;
+    int count = 0, capacity = 0, f, k;
+    int threshold = cx->opts.inline_threshold > 0 ? cx->opts.inline_threshold : INLINE_THRESHOLD;
+
+    /* The function index by label symbol; the first of a name wins */
+    int* func_by_sym = arena_alloc(cx, cx->sym_count * sizeof(int));
+    for (k = cx->func_count - 1; k >= 0; k--) {
+        const char* label = cx->functions[k].label;
+        int sym = label ? sym_find(cx, label, (int)strlen(label)) : -1;
+        if (sym >= 0) func_by_sym[sym] = k + 1;
+    }
+
+    /* This crate's functions, matched to the function index by label */
+    for (f = 0; f < prog->count; f++) {
+        InlineCallee* ce;
+        const char* label;
+        int sym;
+        callees = table_reserve(cx, callees, count, &capacity, sizeof(InlineCallee));
+        ce = &callees[count++];
+        memset(ce, 0, sizeof(*ce));
+        ce->fn = &prog->funcs[f];
+        ce->sym = ce->fn->blocks[0].label;
+        ce->alias = IR_NONE;
+        label = sym_name(cx, ce->sym);
+        sym = label[0] ? sym_find(cx, label + 1, (int)strlen(label) - 1) : -1;
+        if (sym >= 0 && sym < cx->sym_count && func_by_sym[sym]) {
+            const Function* fn = &cx->functions[func_by_sym[sym] - 1];
+            ce->hint = fn->inline_hint;
+            ce->exported = fn->is_pub && (fn->inline_hint == INLINE_HINT || fn->inline_hint == INLINE_ALWAYS);
+        }
+    }
+    if (cx->opts.emit_metadata) inline_write_metadata(cx, ps, callees, count);
+    for (k = 0; k < cx->opts.extern_count; k++) {
+        callees = inline_read_metadata(cx, cx->opts.externs[k], callees, &count, &capacity);
+    }
+
+    /* Callee by label; this crate's own win */
+    int syms = cx->sym_count;
+    int* by_sym = arena_alloc(cx, syms * sizeof(int));
+    for (k = count - 1; k >= 0; k--) {
+        by_sym[callees[k].sym] = k + 1;
+        if (callees[k].alias >= 0) by_sym[callees[k].alias] = k + 1;
+    }
+
+    for (f = 0; f < prog->count; f++) {
+        IrFunction* fn = &prog->funcs[f];
+        int lo, hi, b, i;
+        if (!ir_frame_extent(fn, &lo, &hi)) continue;
+        for (b = 0; b < fn->block_count; b++) {
+            for (i = 0; i < fn->blocks[b].count; i++) {
+                IrInsn* in = &fn->blocks[b].insns[i];
+                int c = in->op == IR_CALL && in->sym >= 0 && in->sym < syms ? by_sym[in->sym] - 1 : -1;
+                if (c < 0 || callees[c].fn == fn) continue;
+                InlineCallee* ce = &callees[c];
+                if (!ce->scanned) inline_scan(cx, ce);
+                if (!ce->ok || ce->hint == INLINE_NEVER) continue;
+                if (ce->hint != INLINE_ALWAYS && ce->size > (ce->hint == INLINE_HINT ? 4 * threshold : threshold)) continue;
+                if (!ir_inline_call(cx, fn, b, i, ce, &hi)) continue;
+                ps->inlined++;
+                if (ce->external) ps->inlined_extern++;
+                callees[f].scanned = 0;
+                /* carry on in the second half, past the copy */
+                b += ce->blocks + 1;
+                i = -1;
             }
-            
-            /* Parse struct fields */
-            skip_whitespace();
-            structs[struct_count].field_count = 0;
-            structs[struct_count].alignment = 4;
+        }
+    }
+}
 
-            if (*pos == '{') {
-                pos++;
-                int field_offset = 0;
-                while (*pos && *pos != '}') {
-                    skip_whitespace();
-                    if (*pos == '}') break;
-                    /* Skip comments inside struct */
-                    if (*pos == '/' && *(pos+1) == '/') {
-                        while (*pos && *pos != '\n') pos++;
-                        if (*pos == '\n') pos++;
-                        continue;
-                    }
-                    if (*pos == '/' && *(pos+1) == '*') {
-                        pos += 2;
-                        while (*pos && !(*pos == '*' && *(pos+1) == '/')) pos++;
-                        if (*pos) pos += 2;
-                        continue;
-                    }
-                    /* Skip attributes like #[...] */
-                    if (*pos == '#' && *(pos+1) == '[') {
-                        while (*pos && *pos != ']') pos++;
-                        if (*pos == ']') pos++;
-                        continue;
-                    }
-                    /* Skip @ attributes like @size(16), @align(16) */
-                    if (*pos == '@') {
-                        pos++;
-                        while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
-                        if (*pos == '(') {
-                            int d = 1; pos++;
-                            while (*pos && d > 0) { if (*pos == '(') d++; else if (*pos == ')') d--; pos++; }
-                        }
-                        skip_whitespace();
-                        continue;
-                    }
-                    /* Skip macro metavariables $(...) */
-                    if (*pos == '$') {
-                        if (*(pos+1) == '(') {
-                            int d = 1; pos += 2;
-                            while (*pos && d > 0) { if (*pos == '(') d++; else if (*pos == ')') d--; pos++; }
-                            /* Skip optional repeat operator: *, +, ? */
-                            while (*pos == '*' || *pos == '+' || *pos == '?') pos++;
-                        } else {
-                            pos++; /* skip $ */
-                            while (*pos && (isalnum(*pos) || *pos == '_')) pos++; /* skip $ident */
-                        }
-                        continue;
-                    }
-                    /* Skip pub keyword */
-                    if (strncmp(pos, "pub ", 4) == 0) pos += 4;
-                    if (strncmp(pos, "pub(crate) ", 11) == 0) pos += 11;
-                    if (strncmp(pos, "pub(super) ", 11) == 0) pos += 11;
-                    skip_whitespace();
-                    /* Skip r# raw identifier prefix */
-                    if (*pos == 'r' && *(pos+1) == '#') pos += 2;
-                    /* Parse field name */
-                    char fname[32] = {0};
-                    int fi = 0;
-                    while (*pos && (isalnum(*pos) || *pos == '_') && fi < 31) {
-                        fname[fi++] = *pos++;
-                    }
-                    fname[fi] = '\0';
-                    skip_whitespace();
-                    if (*pos == '=') {
-                        /* key = value (macro syntax, not a real field) — skip to comma */
-                        while (*pos && *pos != ',' && *pos != '}') pos++;
-                        if (*pos == ',') pos++;
-                        continue;
-                    }
-                    if (*pos == ':') pos++;
-                    skip_whitespace();
-                    /* Parse field type */
-                    RustType ftype = parse_type();
-                    int fsize = 4; /* default */
-                    switch (ftype) {
-                        case TYPE_I8: case TYPE_U8: case TYPE_BOOL: fsize = 1; break;
-                        case TYPE_I16: case TYPE_U16: fsize = 2; break;
-                        case TYPE_I64: case TYPE_U64: case TYPE_F64: fsize = 8; break;
-                        case TYPE_I128: case TYPE_U128: fsize = 16; break;
-                        case TYPE_STRING: case TYPE_VEC: fsize = 12; break;
-                        case TYPE_STR: case TYPE_SLICE: fsize = 8; break;
-                        default: fsize = 4; break;
-                    }
-                    /* Align field */
-                    int align = fsize > 4 ? 4 : (fsize < 4 ? fsize : 4);
-                    field_offset = (field_offset + align - 1) & ~(align - 1);
+/* The value of op on constants with PPC semantics; 0 where the
+ * instruction's result is undefined (divide by zero, INT_MIN / -1) */
+static int ir_fold_value(int op, int a, int b, int* r) {
+    unsigned ua = (unsigned)a, ub = (unsigned)b;
+    switch (op) {
+    case IR_ADD: *r = (int)(ua + ub); return 1;
+    case IR_SUB: *r = (int)(ua - ub); return 1;
+    case IR_MUL: *r = (int)(ua * ub); return 1;
+    case IR_DIV:
+        if (b == 0 || (a == INT_MIN && b == -1)) return 0;
+        *r = a / b;
+        return 1;
+    case IR_DIVU:
+        if (b == 0) return 0;
+        *r = (int)(ua / ub);
+        return 1;
+    case IR_AND: *r = a & b; return 1;
+    case IR_OR: *r = a | b; return 1;
+    case IR_XOR: *r = a ^ b; return 1;
+    case IR_SHL: *r = (ub & 32) ? 0 : (int)(ua << (ub & 31)); return 1;
+    case IR_SHR: *r = (ub & 32) ? 0 : (int)(ua >> (ub & 31)); return 1;
+    case IR_SAR: *r = (ub & 32) ? (a < 0 ? -1 : 0) : a >> (ub & 31); return 1;
+    case IR_NEG: *r = (int)(0u - ua); return 1;
+    }
+    return 0;
+}
+
+/* Whether op has an immediate form that takes imm without a scratch
+ * register. AND has none: andi. also writes cr0. */
+static int ir_imm_fits(int op, int imm) {
+    switch (op) {
+    case IR_ADD: case IR_MUL: return imm >= -32768 && imm <= 32767;
+    case IR_SUB: return imm >= -32767 && imm <= 32768;
+    case IR_OR: case IR_XOR: return imm >= 0 && imm <= 0xFFFF;
+    case IR_SHL: case IR_SHR: case IR_SAR: return imm >= 0 && imm <= 31;
+    }
+    return 0;
+}
 
-                    int idx = structs[struct_count].field_count;
-                    if (idx < 32) {
-                        strcpy(structs[struct_count].fields[idx].name, fname);
-                        structs[struct_count].fields[idx].type = ftype;
-                        structs[struct_count].fields[idx].offset = field_offset;
-                        structs[struct_count].fields[idx].size = fsize;
-                        structs[struct_count].field_count++;
-                    }
-                    field_offset += fsize;
+/* A constant one li or lis can load */
+static int ir_const_cheap(int v) {
+    return (v >= -32768 && v <= 32767) || (v & 0xFFFF) == 0;
+}
 
-                    /* Skip comma */
-                    skip_whitespace();
-                    if (*pos == ',') pos++;
-                }
-                if (*pos == '}') pos++;
-                structs[struct_count].size = (field_offset + 3) & ~3; /* Pad to 4-byte */
-            } else if (*pos == '(') {
-                /* Tuple struct: struct Foo(i32, i32); */
-                pos++;
-                int field_offset = 0;
-                int tidx = 0;
-                while (*pos && *pos != ')') {
-                    skip_whitespace();
-                    if (*pos == ')') break;
-                    /* Skip comments inside tuple struct */
-                    if (*pos == '/' && *(pos+1) == '/') {
-                        while (*pos && *pos != '\n') pos++;
-                        if (*pos == '\n') pos++;
-                        continue;
-                    }
-                    if (*pos == '/' && *(pos+1) == '*') {
-                        pos += 2;
-                        while (*pos && !(*pos == '*' && *(pos+1) == '/')) pos++;
-                        if (*pos) pos += 2;
-                        continue;
-                    }
-                    /* Skip attributes (#[...]) and @ attributes (@size(N)) */
-                    if (*pos == '#' && *(pos+1) == '[') {
-                        while (*pos && *pos != ']') pos++;
-                        if (*pos == ']') pos++;
-                        continue;
-                    }
-                    if (*pos == '@') {
-                        pos++;
-                        while (*pos && (isalnum(*pos) || *pos == '_')) pos++;
-                        if (*pos == '(') {
-                            int d = 1; pos++;
-                            while (*pos && d > 0) { if (*pos == '(') d++; else if (*pos == ')') d--; pos++; }
-                        }
-                        skip_whitespace();
-                        continue;
-                    }
-                    /* Skip pub keyword */
-                    if (strncmp(pos, "pub ", 4) == 0) pos += 4;
-                    if (strncmp(pos, "pub(crate) ", 11) == 0) pos += 11;
-                    /* Safety: skip => (macro syntax) and other non-type chars */
-                    if (*pos == '=' && *(pos+1) == '>') {
-                        pos += 2;
-                        skip_whitespace();
-                        continue;
-                    }
-                    char *before_parse = pos;
-                    RustType ftype = parse_type();
-                    /* Safety: if parse_type didn't advance, skip one char to avoid infinite loop */
-                    if (pos == before_parse) {
-                        pos++;
-                        continue;
+static void ir_make_const(IrInsn* in, int v) {
+    in->op = IR_CONST;
+    in->imm = v;
+    in->has_imm = 0;
+    in->src[0] = in->src[1] = in->src[2] = IR_NONE;
+    in->text = NULL;
+}
+
+#define IR_FOLD_SLOTS 32
+
+/* Constant propagation inside each block of fn */
+static void ir_fold_function(PeepState* ps, IrFunction* fn) {
+    int n = IR_PHYS + fn->vreg_count;
+    char* known = calloc(n, 1);
+    int* val = calloc(n, sizeof(int));
+    int* uses = calloc(n, sizeof(int));
+    int b, i, k, changed;
+
+    for (b = 0; b < fn->block_count; b++) {
+        IrBlock* bl = &fn->blocks[b];
+        int slot_disp[IR_FOLD_SLOTS], slot_val[IR_FOLD_SLOTS], slots = 0;
+        int cr_known = 0, cr_cmp[8];
+        memset(known, 0, IR_PHYS);
+
+        for (i = 0; i < bl->count; i++) {
+            IrInsn* in = &bl->insns[i];
+            unsigned use, def;
+            int a = in->src[0], c = in->src[1], r;
+            int ka = a >= 0 && known[a];
+            int kb = in->has_imm || (c >= 0 && known[c]);
+            int vb = in->has_imm ? in->imm : (c >= 0 ? val[c] : 0);
+            int dst_val = 0, dst_known = 0;
+
+            ir_effects(in, &use, &def);
+            switch (in->op) {
+            case IR_CONST:
+                dst_known = 1;
+                dst_val = in->imm;
+                break;
+            case IR_MOVE:
+                /* left for the coalescer: rewriting it would strand the source */
+                dst_known = ka;
+                dst_val = ka ? val[a] : 0;
+                break;
+            case IR_NEG:
+            case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_DIVU:
+            case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR: case IR_SAR:
+                if (ka && (kb || in->op == IR_NEG) && ir_fold_value(in->op, val[a], vb, &r)) {
+                    dst_known = 1;
+                    dst_val = r;
+                    if (ir_const_cheap(r)) {
+                        ir_make_const(in, r);
+                        ps->folded++;
                     }
-                    int fsize = 4;
-                    switch (ftype) {
-                        case TYPE_I8: case TYPE_U8: case TYPE_BOOL: fsize = 1; break;
-                        case TYPE_I16: case TYPE_U16: fsize = 2; break;
-                        case TYPE_I64: case TYPE_U64: case TYPE_F64: fsize = 8; break;
-                        default: fsize = 4; break;
+                    break;
+                }
+                if (in->op == IR_NEG || in->has_imm) break;
+                if (ka && !kb && (in->op == IR_ADD || in->op == IR_MUL || in->op == IR_OR ||
+                                  in->op == IR_XOR) && ir_imm_fits(in->op, val[a])) {
+                    /* commutative: the constant goes second */
+                    in->src[0] = c;
+                    in->src[1] = a;
+                    a = c;
+                    c = in->src[1];
+                    kb = 1;
+                    vb = val[c];
+                }
+                if (kb && (in->op == IR_MUL || in->op == IR_DIVU) && vb > 0 && exact_log2(vb) >= 0) {
+                    /* operands known only here, after propagation */
+                    in->op = in->op == IR_MUL ? IR_SHL : IR_SHR;
+                    vb = exact_log2(vb);
+                    ps->reduced++;
+                }
+                if (kb && ir_imm_fits(in->op, vb) && a != 0) {
+                    in->has_imm = 1;
+                    in->imm = vb;
+                    in->src[1] = IR_NONE;
+                    in->text = NULL;
+                    ps->immediates++;
+                }
+                break;
+            case IR_LOAD:
+                if (in->src[0] != 1 || !in->has_imm || in->width != 4) break;
+                for (k = 0; k < slots; k++) {
+                    if (slot_disp[k] == in->imm) break;
+                }
+                if (k == slots) break;
+                dst_known = 1;
+                dst_val = slot_val[k];
+                if (ir_const_cheap(dst_val)) {
+                    ir_make_const(in, dst_val);
+                    ps->folded++;
+                }
+                break;
+            case IR_STORE:
+                if (in->src[0] != 1 || !in->has_imm) {
+                    slots = 0;
+                    break;
+                }
+                for (k = 0; k < slots; k++) {
+                    if (slot_disp[k] < in->imm + in->width && slot_disp[k] + 4 > in->imm) {
+                        slot_disp[k] = slot_disp[--slots];
+                        slot_val[k] = slot_val[slots];
+                        k--;
                     }
-                    int idx = structs[struct_count].field_count;
-                    if (idx < 32) {
-                        char tname[32];
-                        snprintf(tname, sizeof(tname), "%d", tidx);
-                        strcpy(structs[struct_count].fields[idx].name, tname);
-                        structs[struct_count].fields[idx].type = ftype;
-                        structs[struct_count].fields[idx].offset = field_offset;
-                        structs[struct_count].fields[idx].size = fsize;
-                        structs[struct_count].field_count++;
+                }
+                if (in->width == 4 && in->src[2] >= 0 && known[in->src[2]] && slots < IR_FOLD_SLOTS) {
+                    slot_disp[slots] = in->imm;
+                    slot_val[slots++] = val[in->src[2]];
+                }
+                break;
+            case IR_CMP:
+                cr_known &= ~(1 << in->crf);
+                if (ka && kb) {
+                    int x = val[a];
+                    cr_cmp[in->crf] = in->is_signed ? (x > vb) - (x < vb)
+                                                    : ((unsigned)x > (unsigned)vb) - ((unsigned)x < (unsigned)vb);
+                    cr_known |= 1 << in->crf;
+                } else if (!in->has_imm && kb &&
+                           (in->is_signed ? vb >= -32768 && vb <= 32767 : vb >= 0 && vb <= 0xFFFF)) {
+                    in->has_imm = 1;
+                    in->imm = vb;
+                    in->src[1] = IR_NONE;
+                    in->text = NULL;
+                    ps->immediates++;
+                }
+                break;
+            case IR_BRANCH:
+                if (in->cond != IR_DNZ && (cr_known & (1 << in->crf))) {
+                    int x = cr_cmp[in->crf];
+                    int taken = in->cond == IR_EQ ? x == 0 : in->cond == IR_NE ? x != 0 :
+                                in->cond == IR_LT ? x < 0 : in->cond == IR_GE ? x >= 0 :
+                                in->cond == IR_GT ? x > 0 : x <= 0;
+                    if (taken) {
+                        in->op = IR_JUMP;
+                        bl->succ_count = 1;
+                    } else {
+                        in->op = IR_NOP;
+                        bl->succ[0] = bl->succ[1];
+                        bl->succ_count = 1;
                     }
-                    field_offset += fsize;
-                    tidx++;
-                    skip_whitespace();
-                    if (*pos == ',') pos++;
+                    in->text = NULL;
+                    ps->branches++;
                 }
-                if (*pos == ')') pos++;
-                while (*pos && *pos != ';') pos++;
-                if (*pos == ';') pos++;
-                structs[struct_count].size = (field_offset + 3) & ~3;
-            } else if (*pos == ';') {
-                /* Unit struct: struct Foo; */
-                structs[struct_count].size = 0;
-                pos++;
-            } else {
-                structs[struct_count].size = 0;
+                break;
+            case IR_CALL:
+                slots = 0;
+                cr_known = 0;
+                break;
+            case IR_ASM: {
+                /* stores and anything with a record form are opaque */
+                const char* p = in->text;
+                while (*p == ' ' || *p == '\t') p++;
+                if (p[0] == 's' && p[1] == 't') slots = 0;
+                if (p[0] == 'd' && p[1] == 'c') slots = 0;
+                cr_known = 0;
+                break;
+            }
             }
 
-            struct_count++;
-
-        } else if (strncmp(pos, "enum ", 5) == 0) {
-            /* Parse enum definition */
-            pos += 5;
-            skip_whitespace();
-            char enum_name[64] = {0};
-            parse_string(enum_name, sizeof(enum_name));
-            skip_whitespace();
-
-            /* Store as a struct with tag field */
-            strcpy(structs[struct_count].name, enum_name);
-            structs[struct_count].field_count = 0;
-            structs[struct_count].alignment = 4;
+            /* whatever the instruction writes is unknown unless computed */
+            for (k = 0; k < IR_PHYS; k++) {
+                if (def & (1u << k)) known[k] = 0;
+            }
+            if (in->dst >= 0) {
+                known[in->dst] = dst_known;
+                val[in->dst] = dst_val;
+            }
+            if (def & 2u) slots = 0;
+        }
+    }
 
-            if (*pos == '{') {
-                pos++;
-                int variant_idx = 0;
-                int max_payload = 0;
-                while (*pos && *pos != '}') {
-                    skip_whitespace();
-                    if (*pos == '}') break;
-                    /* Skip comments inside enum */
-                    if (*pos == '/' && *(pos+1) == '/') {
-                        while (*pos && *pos != '\n') pos++;
-                        if (*pos == '\n') pos++;
-                        continue;
-                    }
-                    if (*pos == '/' && *(pos+1) == '*') {
-                        pos += 2;
-                        while (*pos && !(*pos == '*' && *(pos+1) == '/')) pos++;
-                        if (*pos) pos += 2;
-                        continue;
-                    }
-                    /* Skip attributes */
-                    if (*pos == '#' && *(pos+1) == '[') {
-                        while (*pos && *pos != ']') pos++;
-                        if (*pos == ']') pos++;
-                        continue;
-                    }
-                    /* Parse variant name */
-                    char vname[32] = {0};
-                    int vi = 0;
-                    while (*pos && (isalnum(*pos) || *pos == '_') && vi < 31) {
-                        vname[vi++] = *pos++;
-                    }
-                    vname[vi] = '\0';
+    /* Delete pure vreg defs nothing reads any more */
+    for (b = 0; b < fn->block_count; b++) {
+        for (i = 0; i < fn->blocks[b].count; i++) {
+            IrInsn* in = &fn->blocks[b].insns[i];
+            for (k = 0; k < 3; k++) {
+                if (in->src[k] >= 0) uses[in->src[k]]++;
+            }
+        }
+    }
+    do {
+        changed = 0;
+        for (b = 0; b < fn->block_count; b++) {
+            for (i = 0; i < fn->blocks[b].count; i++) {
+                IrInsn* in = &fn->blocks[b].insns[i];
+                if (in->dst < IR_PHYS || uses[in->dst] > 0) continue;
+                if (in->op != IR_CONST && in->op != IR_MOVE && in->op != IR_NEG &&
+                    (in->op < IR_ADD || in->op > IR_SAR)) {
+                    continue;
+                }
+                for (k = 0; k < 3; k++) {
+                    if (in->src[k] >= 0) uses[in->src[k]]--;
+                }
+                in->op = IR_NOP;
+                in->dst = IR_NONE;
+                in->src[0] = in->src[1] = in->src[2] = IR_NONE;
+                ps->dead++;
+                changed = 1;
+            }
+        }
+    } while (changed);
 
-                    /* Safety: if we couldn't parse a variant name, skip to next comma/brace */
-                    if (vi == 0) {
-                        while (*pos && *pos != ',' && *pos != '}') {
-                            if (*pos == '(' || *pos == '{' || *pos == '[') {
-                                int d = 1; char open = *pos;
-                                char close = (open == '(') ? ')' : (open == '{') ? '}' : ']';
-                                pos++;
-                                while (*pos && d > 0) {
-                                    if (*pos == open) d++;
-                                    else if (*pos == close) d--;
-                                    pos++;
-                                }
-                            } else {
-                                pos++;
-                            }
-                        }
-                        if (*pos == ',') pos++;
-                        continue;
-                    }
+    free(uses);
+    free(val);
+    free(known);
+}
 
-                    int payload_size = 0;
-                    if (*pos == '(') {
-                        /* Tuple variant: Variant(Type, Type) */
-                        pos++;
-                        while (*pos && *pos != ')') {
-                            skip_whitespace();
-                            if (*pos == ')') break;
-                            char *before = pos;
-                            parse_type();
-                            if (pos == before) { pos++; continue; } /* safety: avoid infinite loop */
-                            payload_size += 4;
-                            skip_whitespace();
-                            if (*pos == ',') pos++;
-                        }
-                        if (*pos == ')') pos++;
-                    } else if (*pos == '{') {
-                        /* Struct variant: Variant { field: Type } */
-                        pos++;
-                        while (*pos && *pos != '}') {
-                            skip_whitespace();
-                            if (*pos == '}') break;
-                            /* Skip comments */
-                            if (*pos == '/' && *(pos+1) == '/') {
-                                while (*pos && *pos != '\n') pos++;
-                                if (*pos == '\n') pos++;
-                                continue;
-                            }
-                            if (*pos == '/' && *(pos+1) == '*') {
-                                pos += 2;
-                                while (*pos && !(*pos == '*' && *(pos+1) == '/')) pos++;
-                                if (*pos) pos += 2;
-                                continue;
-                            }
-                            while (*pos && *pos != ':' && *pos != '}') pos++;
-                            if (*pos == ':') { pos++; skip_whitespace(); parse_type(); payload_size += 4; }
-                            skip_whitespace();
-                            if (*pos == ',') pos++;
-                        }
-                        if (*pos == '}') pos++;
-                    }
-                    /* = value or => value for C-like enums */
-                    skip_whitespace();
-                    if (*pos == '=' && *(pos+1) == '>') {
-                        /* => value (macro-generated enum syntax) */
-                        pos += 2;
-                        skip_whitespace();
-                        /* Skip complex value expressions until comma or closing brace */
-                        int depth = 0;
-                        while (*pos && !(depth == 0 && (*pos == ',' || *pos == '}'))) {
-                            if (*pos == '(' || *pos == '[' || *pos == '{') depth++;
-                            else if (*pos == ')' || *pos == ']' || *pos == '}') {
-                                if (depth > 0) depth--; else break;
-                            }
-                            pos++;
-                        }
-                    } else if (*pos == '=') {
-                        pos++;
-                        skip_whitespace();
-                        /* Skip complex value expression (not just numbers - could be make_tag(b"...")) */
-                        int depth = 0;
-                        while (*pos && !(depth == 0 && (*pos == ',' || *pos == '}'))) {
-                            if (*pos == '(' || *pos == '[' || *pos == '{') depth++;
-                            else if (*pos == ')' || *pos == ']' || *pos == '}') {
-                                if (depth > 0) depth--; else break;
-                            }
-                            pos++;
-                        }
-                    }
+static void ir_fold(CompilerContext* cx, PeepState* ps) {
+    int f;
+    (void)cx;
+    for (f = 0; f < ps->ir->count; f++) ir_fold_function(ps, &ps->ir->funcs[f]);
+}
 
-                    if (payload_size > max_payload) max_payload = payload_size;
+/* Stack-slot coloring (-C opt-level=1 and up). Codegen hands every let,
+ * loop variable and temporary a slot of its own, and only a closing scope
+ * gives slots back, so a frame grows with the bindings a function has
+ * rather than with those alive at once. Where the frame is only loaded
+ * and stored (ir_frame_extent), word slots get liveness the way
+ * registers do, slots never live at the same time share an offset, and
+ * the frame shrinks to the slots left plus the save area. Words whose
+ * address is taken, or that are accessed at another width, stay put. */
+#define COLOR_MAX_SLOTS 1024
+
+/* The word slot a load or store of fn's frame touches; -1 for others */
+static int ir_slot(const IrInsn* in, int hi) {
+    if ((in->op != IR_LOAD && in->op != IR_STORE) || in->src[0] != 1 || !in->has_imm) return -1;
+    if (in->width != 4 || in->imm % 4 || in->imm < 72 || in->imm >= hi) return -1;
+    return (in->imm - 72) / 4;
+}
 
-                    /* Store variant as a pseudo-field */
-                    int idx = structs[struct_count].field_count;
-                    if (idx < 32) {
-                        strcpy(structs[struct_count].fields[idx].name, vname);
-                        structs[struct_count].fields[idx].type = TYPE_ENUM;
-                        structs[struct_count].fields[idx].offset = variant_idx;
-                        structs[struct_count].fields[idx].size = payload_size;
-                        structs[struct_count].field_count++;
-                    }
-                    variant_idx++;
+static void ir_color_function(PeepState* ps, IrFunction* fn) {
+    int lo, hi, n, words, b, i, s, t;
+    if (!ir_frame_extent(fn, &lo, &hi) || hi <= 72) return;
+    n = (hi - 72 + 3) / 4;
+    if (n > COLOR_MAX_SLOTS) return;
+    words = (n + 31) / 32;
+
+    char* pinned = calloc(2 * n, 1);
+    char* used = pinned + n;
+    int* color = malloc(n * sizeof(int));
+    unsigned* edge = calloc((size_t)n * words, sizeof(unsigned));
+    unsigned* sets = calloc((size_t)fn->block_count * 4 * words + words, sizeof(unsigned));
+    unsigned* live = sets + (size_t)fn->block_count * 4 * words;
+#define SLOT_SET(set, k) ((set)[(k) / 32] |= 1u << ((k) % 32))
+#define SLOT_HAS(set, k) ((set)[(k) / 32] & (1u << ((k) % 32)))
+
+    /* Objects and odd-width accesses pin the words they cover */
+    for (b = 0; b < fn->block_count; b++) {
+        for (i = 0; i < fn->blocks[b].count; i++) {
+            const IrInsn* in = &fn->blocks[b].insns[i];
+            int start = 0, end = 0;
+            if ((s = ir_slot(in, hi)) >= 0) {
+                used[s] = 1;
+            } else if ((in->op == IR_LOAD || in->op == IR_STORE) && in->src[0] == 1 && in->has_imm) {
+                start = in->imm;
+                end = in->imm + in->width;
+            } else if (in->op == IR_ADD && in->src[0] == 1 && in->has_imm) {
+                start = in->imm;
+                end = in->imm + la_extent(in->comment, in->comment_len);
+            }
+            if (start < 72) start = 72;
+            for (s = (start - 72) / 4; start < end && s * 4 + 72 < end; s++) pinned[s] = 1;
+        }
+    }
 
-                    skip_whitespace();
-                    if (*pos == ',') pos++;
-                }
-                if (*pos == '}') pos++;
-                structs[struct_count].size = 4 + max_payload; /* tag + max payload */
+    /* Block liveness over the slots: gen, kill, in, out */
+    for (b = 0; b < fn->block_count; b++) {
+        unsigned* gen = sets + (size_t)b * 4 * words;
+        unsigned* kill = gen + words;
+        for (i = fn->blocks[b].count - 1; i >= 0; i--) {
+            if ((s = ir_slot(&fn->blocks[b].insns[i], hi)) < 0 || pinned[s]) continue;
+            if (fn->blocks[b].insns[i].op == IR_STORE) {
+                gen[s / 32] &= ~(1u << (s % 32));
+                SLOT_SET(kill, s);
+            } else {
+                SLOT_SET(gen, s);
             }
-            struct_count++;
-            
-        } else if (strncmp(pos, "trait ", 6) == 0) {
-            pos += 6;
-            skip_whitespace();
-            
-            char trait_name[64] = {0};
-            parse_string(trait_name, sizeof(trait_name));
-            
-            strcpy(traits[trait_count].name, trait_name);
-            
-            /* Parse supertrait bounds */
-            if (*pos == ':') {
-                pos++;
-                char supertraits[256] = {0};
-                int idx = 0;
-                while (*pos && *pos != '{' && idx < 255) {
-                    supertraits[idx++] = *pos++;
-                }
-                strcpy(traits[trait_count].supertraits, supertraits);
+        }
+    }
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (b = fn->block_count - 1; b >= 0; b--) {
+            unsigned* gen = sets + (size_t)b * 4 * words;
+            unsigned* kill = gen + words;
+            unsigned* in = kill + words;
+            unsigned* out = in + words;
+            for (t = 0; t < words; t++) {
+                unsigned o = 0, v;
+                for (i = 0; i < fn->blocks[b].succ_count; i++) o |= sets[(size_t)fn->blocks[b].succ[i] * 4 * words + 2 * words + t];
+                v = gen[t] | (o & ~kill[t]);
+                if (v != in[t] || o != out[t]) changed = 1;
+                in[t] = v;
+                out[t] = o;
             }
-            
-            trait_count++;
-            
-        } else if (strncmp(pos, "impl ", 5) == 0 || strncmp(pos, "impl<", 5) == 0) {
-            /* Parse impl block */
-            pos += 4;
-            skip_whitespace();
-
-            /* Skip generics */
-            if (*pos == '<') {
-                int angle_depth = 1;
-                pos++;
-                while (*pos && angle_depth > 0) {
-                    if (*pos == '<') angle_depth++;
-                    else if (*pos == '>') angle_depth--;
-                    pos++;
+        }
+    }
+
+    /* A store interferes with every other slot live past it; slots read
+     * before any store all hold their entry garbage at once */
+    for (b = 0; b < fn->block_count; b++) {
+        memcpy(live, sets + (size_t)b * 4 * words + 3 * words, words * sizeof(unsigned));
+        for (i = fn->blocks[b].count - 1; i >= 0; i--) {
+            if ((s = ir_slot(&fn->blocks[b].insns[i], hi)) < 0 || pinned[s]) continue;
+            if (fn->blocks[b].insns[i].op == IR_STORE) {
+                for (t = 0; t < n; t++) {
+                    if (t != s && SLOT_HAS(live, t)) {
+                        SLOT_SET(edge + (size_t)s * words, t);
+                        SLOT_SET(edge + (size_t)t * words, s);
+                    }
                 }
-                skip_whitespace();
+                live[s / 32] &= ~(1u << (s % 32));
+            } else {
+                SLOT_SET(live, s);
             }
+        }
+    }
+    for (s = 0; s < n; s++) {
+        if (!SLOT_HAS(sets + 2 * words, s)) continue;
+        for (t = 0; t < words; t++) edge[(size_t)s * words + t] |= sets[2 * words + t];
+    }
 
-            char impl_type[64] = {0};
-            int ii = 0;
-            while (*pos && (isalnum(*pos) || *pos == '_') && ii < 63) {
-                impl_type[ii++] = *pos++;
+    /* Greedy, in frame order: each slot takes the lowest word no
+     * interfering slot holds and no object covers, never above its own */
+    int top = 0, shared = 0;
+    char* taken = malloc(n);
+    for (s = 0; s < n; s++) {
+        color[s] = s;
+        if (pinned[s]) top = s + 1;
+        if (!used[s] || pinned[s]) continue;
+        memcpy(taken, pinned, n);
+        for (t = 0; t < s; t++) {
+            if (used[t] && !pinned[t] && SLOT_HAS(edge + (size_t)s * words, t)) taken[color[t]] = 1;
+        }
+        for (color[s] = 0; taken[color[s]]; color[s]++) {
+        }
+        if (color[s] != s) shared++;
+        if (color[s] + 1 > top) top = color[s] + 1;
+    }
+    free(taken);
+#undef SLOT_SET
+#undef SLOT_HAS
+
+    int frame = (72 + 4 * top + INLINE_SAVE_AREA + 15) & ~15;
+    if (frame > fn->frame) frame = fn->frame;
+    for (b = 0; b < fn->block_count; b++) {
+        for (i = 0; i < fn->blocks[b].count; i++) {
+            IrInsn* in = &fn->blocks[b].insns[i];
+            if ((s = ir_slot(in, hi)) >= 0 && !pinned[s] && color[s] != s) {
+                in->imm = 72 + 4 * color[s];
+                in->text = NULL;
+            } else if (frame != fn->frame && (in->op == IR_ENTER || in->op == IR_RET)) {
+                in->imm = frame;
+                in->text = NULL;
             }
-            impl_type[ii] = '\0';
+        }
+    }
+    ps->slots_shared += shared;
+    ps->frame_freed += fn->frame - frame;
+    fn->frame = frame;
+    free(pinned);
+    free(color);
+    free(edge);
+    free(sets);
+}
 
-            skip_whitespace();
+static void ir_color(CompilerContext* cx, PeepState* ps) {
+    int f;
+    (void)cx;
+    for (f = 0; f < ps->ir->count; f++) ir_color_function(ps, &ps->ir->funcs[f]);
+}
 
-            /* Check for "for Type" (trait impl) */
-            if (strncmp(pos, "for ", 4) == 0) {
-                pos += 4;
-                skip_whitespace();
-                strcpy(impls[impl_count].trait_name, impl_type);
-                char target[64] = {0};
-                int ti = 0;
-                while (*pos && (isalnum(*pos) || *pos == '_') && ti < 63) {
-                    target[ti++] = *pos++;
-                }
-                target[ti] = '\0';
-                strcpy(impls[impl_count].struct_name, target);
-            } else {
-                strcpy(impls[impl_count].struct_name, impl_type);
-                impls[impl_count].trait_name[0] = '\0';
+/* Map the function's vregs onto GPRs: the hint when it is free for the
+ * whole range, else a volatile register, else codegen's temporaries.
+ * Returns 0 when some vreg finds nothing. */
+static int ir_assign(IrFunction* fn) {
+    static const int pool[] = { 11, 12, 10, 9, 8, 7, 6, 5, 4, 3, 14, 15, 16 };
+    int b, i, k, ok = 1, max = 0;
+    ir_liveness(fn);
+    for (b = 0; b < fn->block_count; b++) {
+        if (fn->blocks[b].count > max) max = fn->blocks[b].count;
+    }
+    unsigned* busy = malloc((max + 1) * 2 * sizeof(unsigned));
+    unsigned* defs = busy + max + 1;
+    int* last = malloc((fn->vreg_count + 1) * sizeof(int));
+
+    for (b = 0; b < fn->block_count && ok; b++) {
+        IrBlock* bl = &fn->blocks[b];
+        unsigned live = bl->live_out;
+        int held_until[IR_PHYS];
+
+        /* busy[i]: GPRs holding v0-v31 values just after instruction i */
+        for (i = bl->count - 1; i >= 0; i--) {
+            unsigned use, def;
+            ir_effects(&bl->insns[i], &use, &def);
+            busy[i] = live;
+            defs[i] = def;
+            live = (live & ~def) | use;
+        }
+        for (i = 0; i < bl->count; i++) {
+            IrInsn* in = &bl->insns[i];
+            for (k = 0; k < 3; k++) {
+                if (in->src[k] >= IR_PHYS) last[in->src[k] - IR_PHYS] = i;
             }
-            impl_count++;
+            if (in->dst >= IR_PHYS) last[in->dst - IR_PHYS] = i;
+        }
 
-        } else if (strncmp(pos, "type ", 5) == 0) {
-            /* Type alias */
-            pos += 5;
-            
-        } else if (strncmp(pos, "const ", 6) == 0) {
-            /* Constant */
-            pos += 6;
-            
-        } else if (strncmp(pos, "static ", 7) == 0) {
-            /* Static variable */
-            pos += 7;
-            
-        } else if (strncmp(pos, "use ", 4) == 0) {
-            /* Import — skip the entire use statement to avoid keyword collisions */
-            while (*pos && *pos != ';' && *pos != '\n') {
-                if (*pos == '{') {
-                    int d = 1; pos++;
-                    while (*pos && d > 0) { if (*pos == '{') d++; else if (*pos == '}') d--; pos++; }
-                    continue;
+        for (k = 0; k < IR_PHYS; k++) held_until[k] = -1;
+        for (i = 0; i < bl->count && ok; i++) {
+            IrInsn* in = &bl->insns[i];
+            if (in->dst < IR_PHYS) continue;
+            int v = in->dst - IR_PHYS, s = i, e = last[v], j, c;
+            unsigned taken = 0;
+            for (j = s; j <= (e > s ? e - 1 : s); j++) taken |= busy[j];
+            for (j = s + 1; j < e; j++) taken |= defs[j];
+            for (k = 0; k < IR_PHYS; k++) {
+                if (held_until[k] > s) taken |= 1u << k;
+            }
+            int gpr = fn->vreg_hint[v];
+            if (gpr < 0 || (taken & (1u << gpr))) {
+                gpr = -1;
+                for (c = 0; c < (int)(sizeof(pool) / sizeof(pool[0])); c++) {
+                    if (!(taken & (1u << pool[c]))) {
+                        gpr = pool[c];
+                        break;
+                    }
                 }
-                pos++;
             }
+            if (gpr < 0) {
+                ok = 0;
+                break;
+            }
+            fn->vreg_gpr[v] = gpr;
+            held_until[gpr] = e;
+        }
+    }
+    free(last);
+    free(busy);
+    return ok;
+}
 
-        } else if (strncmp(pos, "mod ", 4) == 0) {
-            /* Module — skip the module name to avoid matching keywords in it */
-            pos += 4;
-            skip_whitespace();
-            while (*pos && (isalnum(*pos) || *pos == '_')) pos++; /* skip module name */
+static int ir_gpr(const IrFunction* fn, int v) {
+    return v < IR_PHYS ? v : fn->vreg_gpr[v - IR_PHYS];
+}
 
-        } else if (strncmp(pos, "macro_rules!", 12) == 0) {
-            /* Declarative macro */
-            pos += 12;
-            skip_whitespace();
-            
-            char macro_name[64] = {0};
-            parse_string(macro_name, sizeof(macro_name));
-            
-            strcpy(macros[macro_count].name, macro_name);
-            macros[macro_count].is_builtin = 0;
-            macro_count++;
+/* An instruction can be printed from its original text while it is
+ * unchanged and its vregs got the registers codegen picked */
+static int ir_intact(const IrFunction* fn, const IrInsn* in) {
+    int k;
+    if (!in->text) return 0;
+    for (k = 0; k < 3; k++) {
+        if (in->src[k] >= IR_PHYS && ir_gpr(fn, in->src[k]) != fn->vreg_hint[in->src[k] - IR_PHYS]) return 0;
+    }
+    return in->dst < IR_PHYS || ir_gpr(fn, in->dst) == fn->vreg_hint[in->dst - IR_PHYS];
+}
+
+static void ir_put(CompilerContext* cx, const IrInsn* in, const char* insn) {
+    char buf[256];
+    int n;
+    if (in && in->comment) {
+        n = snprintf(buf, sizeof(buf), "    %-18s%.*s\n", insn, in->comment_len, in->comment);
+    } else {
+        n = snprintf(buf, sizeof(buf), "    %s\n", insn);
+    }
+    if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;
+    emit_raw(cx, buf, n);
+}
+
+static const char* ir_block_name(CompilerContext* cx, IrProgram* prog, IrFunction* fn, int b) {
+    IrBlock* bl = &fn->blocks[b];
+    if (bl->label < 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "Lir_%d", prog->labels_made++);
+        bl->label = intern(cx, name, strlen(name));
+    }
+    return sym_name(cx, bl->label);
+}
+
+/* Print one rewritten instruction as PPC */
+static void ir_emit_insn(CompilerContext* cx, IrProgram* prog, IrFunction* fn, const IrInsn* in) {
+    static const char* reg_ops[] = {
+        [IR_ADD] = "add", [IR_SUB] = "sub", [IR_MUL] = "mullw", [IR_DIV] = "divw", [IR_DIVU] = "divwu",
+        [IR_AND] = "and", [IR_OR] = "or", [IR_XOR] = "xor", [IR_SHL] = "slw", [IR_SHR] = "srw",
+        [IR_SAR] = "sraw"
+    };
+    static const char* mem_ops[2][5] = {
+        { NULL, "lbz", "lhz", NULL, "lwz" }, { NULL, "stb", "sth", NULL, "stw" }
+    };
+    char insn[96], cr[8] = "";
+    int d = in->dst >= 0 ? ir_gpr(fn, in->dst) : -1;
+    int a = in->src[0] >= 0 ? ir_gpr(fn, in->src[0]) : -1;
+    int bb = in->src[1] >= 0 ? ir_gpr(fn, in->src[1]) : -1;
+    int imm = in->imm;
+
+    if (in->op == IR_CMP || in->op == IR_BRANCH) {
+        if (in->crf && in->cond != IR_DNZ) snprintf(cr, sizeof(cr), "cr%d, ", in->crf);
+    }
+    switch (in->op) {
+    case IR_NOP:
+        return;
+    case IR_ENTER:
+        emit(cx, "    mflr r0\n    stw r0, 8(r1)\n");
+        snprintf(insn, sizeof(insn), "stwu r1, -%d(r1)", imm);
+        ir_put(cx, in, insn);
+        return;
+    case IR_RET:
+        emit(cx, "    addi r1, r1, %d\n    lwz r0, 8(r1)\n    mtlr r0\n    blr\n", imm);
+        return;
+    case IR_CONST:
+        if (imm >= -32768 && imm <= 32767) {
+            snprintf(insn, sizeof(insn), "li r%d, %d", d, imm);
+            ir_put(cx, in, insn);
+        } else {
+            snprintf(insn, sizeof(insn), "lis r%d, 0x%X", d, ((unsigned)imm >> 16) & 0xFFFF);
+            ir_put(cx, in, insn);
+            if (imm & 0xFFFF) {
+                snprintf(insn, sizeof(insn), "ori r%d, r%d, 0x%X", d, d, (unsigned)imm & 0xFFFF);
+                ir_put(cx, NULL, insn);
+            }
         }
-        
-        pos++;
+        return;
+    case IR_MOVE:
+        snprintf(insn, sizeof(insn), "mr r%d, r%d", d, a);
+        break;
+    case IR_NEG:
+        snprintf(insn, sizeof(insn), "neg r%d, r%d", d, a);
+        break;
+    case IR_LOAD:
+    case IR_STORE: {
+        const char* op = mem_ops[in->op == IR_STORE][in->width];
+        int r = in->op == IR_LOAD ? d : ir_gpr(fn, in->src[2]);
+        if (in->op == IR_LOAD && in->is_signed) op = "lha";
+        if (in->has_imm) snprintf(insn, sizeof(insn), "%s r%d, %d(r%d)", op, r, imm, a);
+        else snprintf(insn, sizeof(insn), "%sx r%d, r%d, r%d", op, r, a, bb);
+        break;
     }
-    
-    /* Pass 2: Generate code */
-    pos = source;
-    
-    printf(".text\n.align 2\n");
-    
-    /* Generate vtables for traits — labels include file hash for uniqueness */
-    int i;
-    for (i = 0; i < trait_count; i++) {
-        printf("\n; Vtable for trait %s\n", traits[i].name);
-        printf(".section __DATA,__const\n");
-        printf("_vtable_%s_%04x:\n", traits[i].name, current_file_hash);
-        printf("    .long 0  ; Size\n");
-        printf("    .long 4  ; Alignment\n");
-        printf("    .long 0  ; Destructor\n");
-        /* Method pointers would go here */
-        printf("\n");
+    case IR_CMP:
+        if (in->has_imm && (in->is_signed ? imm >= -32768 && imm <= 32767 : (unsigned)imm <= 0xFFFF)) {
+            snprintf(insn, sizeof(insn), "%s %sr%d, %d", in->is_signed ? "cmpwi" : "cmplwi", cr, a, imm);
+            break;
+        }
+        if (in->has_imm) {
+            emit_li(cx, 0, imm);
+            bb = 0;
+        }
+        snprintf(insn, sizeof(insn), "%s %sr%d, r%d", in->is_signed ? "cmpw" : "cmplw", cr, a, bb);
+        break;
+    case IR_JUMP:
+        snprintf(insn, sizeof(insn), "b %s", ir_block_name(cx, prog, fn, in->target));
+        break;
+    case IR_BRANCH:
+        snprintf(insn, sizeof(insn), "b%s %s%s", ir_cond_names[in->cond], cr,
+                 ir_block_name(cx, prog, fn, in->target));
+        break;
+    case IR_CALL:
+        snprintf(insn, sizeof(insn), "bl %s", sym_name(cx, in->sym));
+        break;
+    default:
+        if (in->op < IR_ADD || in->op > IR_SAR) {
+            /* opaque instructions always keep their text */
+            emit_raw(cx, in->text, in->text_len);
+            emit_char(cx, '\n');
+            return;
+        }
+        if (!in->has_imm) {
+            snprintf(insn, sizeof(insn), "%s r%d, r%d, r%d", reg_ops[in->op], d, a, bb);
+        } else if ((in->op == IR_ADD || in->op == IR_MUL) && imm >= -32768 && imm <= 32767) {
+            snprintf(insn, sizeof(insn), "%s r%d, r%d, %d", in->op == IR_ADD ? "addi" : "mulli", d, a, imm);
+        } else if (in->op == IR_SUB && imm >= -32767 && imm <= 32768) {
+            snprintf(insn, sizeof(insn), "subi r%d, r%d, %d", d, a, imm);
+        } else if ((in->op == IR_OR || in->op == IR_XOR) && (unsigned)imm <= 0xFFFF) {
+            snprintf(insn, sizeof(insn), "%s r%d, r%d, 0x%X", in->op == IR_OR ? "ori" : "xori", d, a, imm);
+        } else if (in->op >= IR_SHL) {
+            snprintf(insn, sizeof(insn), "%s r%d, r%d, %d",
+                     in->op == IR_SHL ? "slwi" : in->op == IR_SHR ? "srwi" : "srawi", d, a, imm & 31);
+        } else {
+            emit_li(cx, 0, imm);       /* r0 is scratch outside prologues */
+            snprintf(insn, sizeof(insn), "%s r%d, r%d, r0", reg_ops[in->op], d, a);
+        }
+        break;
     }
-    
-    printf(".text\n");
-    
-    /* Pass 2.5: Emit all non-main functions */
-    {
-        char* scan = source;
-        while ((scan = strstr(scan, "fn ")) != NULL) {
-            char* fn_start = scan;
-            scan += 3;
-
-            /* Skip if preceded by non-boundary char (e.g. "cfn") */
-            if (fn_start > source && (isalnum(*(fn_start-1)) || *(fn_start-1) == '_')) continue;
-
-            char* save_pos = pos;
-            pos = scan;
-            skip_whitespace();
-
-            char fn_name[64] = {0};
-            int ni = 0;
-            while (*pos && (isalnum(*pos) || *pos == '_') && ni < 63) {
-                fn_name[ni++] = *pos++;
-            }
-            fn_name[ni] = '\0';
-            scan = pos;
-            pos = save_pos;
-
-            /* Skip main — handled separately below */
-            if (strcmp(fn_name, "main") == 0) continue;
-            if (fn_name[0] == '\0') continue;
-
-            /* Find the function body */
-            char* body = strchr(scan, '{');
-            if (!body) continue;
-
-            /* Check for semicolon before brace — trait method declaration (no body) */
-            {
-                char* check = scan;
-                while (check < body) {
-                    if (*check == ';') break;
-                    check++;
-                }
-                if (check < body && *check == ';') { scan = check + 1; continue; }
-            }
-
-            /* Determine impl type by scanning backward for "impl Type" */
-            char impl_type[64] = {0};
-            int impl_struct_idx = -1;
-            {
-                /* Count brace depth from source to fn_start */
-                char* bp = source;
-                char* last_impl = NULL;
-                int depth = 0;
-                while (bp < fn_start) {
-                    if (*bp == '{') depth++;
-                    else if (*bp == '}') { depth--; last_impl = NULL; }
-                    else if (depth == 0 && strncmp(bp, "impl ", 5) == 0) {
-                        last_impl = bp;
-                    } else if (depth == 0 && strncmp(bp, "impl<", 5) == 0) {
-                        last_impl = bp;
-                    }
-                    bp++;
+    ir_put(cx, in, insn);
+}
+
+static void ir_emit_function(CompilerContext* cx, IrProgram* prog, IrFunction* fn) {
+    int b, i;
+    for (b = 0; b < fn->block_count; b++) {
+        IrBlock* bl = &fn->blocks[b];
+        for (i = 0; i < bl->count; i++) {
+            IrInsn* in = &bl->insns[i];
+            if ((in->op == IR_JUMP || in->op == IR_BRANCH)) ir_block_name(cx, prog, fn, in->target);
+        }
+    }
+    for (b = 0; b < fn->block_count; b++) {
+        IrBlock* bl = &fn->blocks[b];
+        if (bl->label >= 0) emit(cx, "%s:\n", sym_name(cx, bl->label));
+        for (i = 0; i < bl->count; i++) {
+            IrInsn* in = &bl->insns[i];
+            if (ir_intact(fn, in)) {
+                emit_raw(cx, in->text, in->text_len);
+                emit_char(cx, '\n');
+            } else {
+                ir_emit_insn(cx, prog, fn, in);
+            }
+        }
+    }
+}
+
+/* Print the IR back as PPC and split it into lines again for the text
+ * passes */
+static void ir_lower(CompilerContext* cx, PeepState* ps) {
+    IrProgram* prog = ps->ir;
+    int i = 0, f = 0, k;
+    cx->out_len = 0;
+    while (i < ps->count) {
+        if (f < prog->count && prog->funcs[f].first_line == i) {
+            IrFunction* fn = &prog->funcs[f++];
+            if (ir_assign(fn)) {
+                ir_emit_function(cx, prog, fn);
+            } else {
+                for (k = fn->first_line; k < fn->end_line; k++) {
+                    emit_raw(cx, ps->lines[k].text, ps->lines[k].len);
+                    emit_char(cx, '\n');
                 }
-                /* If we're inside an impl block (depth > 0 when we hit the fn) */
-                /* Re-scan: find the impl that owns this fn */
-                bp = source;
-                depth = 0;
-                last_impl = NULL;
-                while (bp < fn_start) {
-                    if (*bp == '/' && *(bp+1) == '/') { while (*bp && *bp != '\n') bp++; continue; }
-                    if (*bp == '/' && *(bp+1) == '*') { bp += 2; while (*bp && !(*bp == '*' && *(bp+1) == '/')) bp++; if (*bp) bp += 2; continue; }
-                    if (strncmp(bp, "impl ", 5) == 0 || strncmp(bp, "impl<", 5) == 0) {
-                        last_impl = bp;
-                    }
-                    if (*bp == '{') {
-                        depth++;
-                    } else if (*bp == '}') {
-                        depth--;
-                        if (depth == 0) last_impl = NULL;
-                    }
-                    bp++;
+            }
+            i = fn->end_line;
+            continue;
+        }
+        emit_raw(cx, ps->lines[i].text, ps->lines[i].len);
+        emit_char(cx, '\n');
+        i++;
+    }
+    /* reload the lowered text, keeping what the IR passes counted */
+    int folded = ps->folded, immediates = ps->immediates, reduced = ps->reduced;
+    int branches = ps->branches, dead = ps->dead;
+    int inlined = ps->inlined, inlined_extern = ps->inlined_extern;
+    int slots_shared = ps->slots_shared, frame_freed = ps->frame_freed;
+    peep_load(cx, ps);
+    ps->slots_shared = slots_shared;
+    ps->frame_freed = frame_freed;
+    ps->inlined = inlined;
+    ps->inlined_extern = inlined_extern;
+    ps->folded = folded;
+    ps->immediates = immediates;
+    ps->reduced = reduced;
+    ps->branches = branches;
+    ps->dead = dead;
+}
+
+static void ir_dump_reg(CompilerContext* cx, int v) {
+    if (v < IR_PHYS) emit(cx, "r%d", v);
+    else emit(cx, "v%d", v);
+}
+
+/* Trimmed text of an opaque or note line, without its comment */
+static void ir_dump_text(CompilerContext* cx, const IrInsn* in) {
+    const char* p = in->text;
+    const char* e = in->text + in->text_len;
+    const char* nl = memchr(p, '\n', in->text_len);
+    if (nl) e = nl;
+    while (p < e && (*p == ' ' || *p == '\t')) p++;
+    while (e > p && (e[-1] == ' ' || e[-1] == '\t')) e--;
+    emit_raw(cx, p, e - p);
+    if (nl) emit(cx, " ...");
+}
+
+static int ir_has_text(const IrInsn* in) {
+    int k;
+    for (k = 0; k < in->text_len; k++) {
+        if (in->text[k] != ' ' && in->text[k] != '\t') return 1;
+    }
+    return 0;
+}
+
+/* --emit=ir: the program as text, one instruction per line */
+static void ir_dump(CompilerContext* cx, IrProgram* prog) {
+    int f, b, i, k;
+    cx->out_len = 0;
+    for (f = 0; f < prog->count; f++) {
+        IrFunction* fn = &prog->funcs[f];
+        emit(cx, "%sfn %s frame %d\n", f ? "\n" : "", sym_name(cx, fn->blocks[0].label), fn->frame);
+        for (b = 0; b < fn->block_count; b++) {
+            IrBlock* bl = &fn->blocks[b];
+            emit(cx, "b%d", b);
+            if (bl->label >= 0) emit(cx, " %s", sym_name(cx, bl->label));
+            emit(cx, ":");
+            for (k = 0; k < bl->succ_count; k++) emit(cx, "%s b%d", k ? "," : " ->", bl->succ[k]);
+            emit(cx, "\n");
+            for (i = 0; i < bl->count; i++) {
+                IrInsn* in = &bl->insns[i];
+                const char* w = in->width == 1 ? ".b" : in->width == 2 ? (in->is_signed ? ".hs" : ".h") : ".w";
+                if (in->op == IR_NOP || (in->op == IR_NOTE && !ir_has_text(in))) continue;
+                emit(cx, "    ");
+                if (in->dst >= 0) {
+                    ir_dump_reg(cx, in->dst);
+                    emit(cx, " = ");
                 }
-                if (last_impl && depth > 0) {
-                    /* Extract type name from "impl [<...>] TypeName [for ConcreteType]" */
-                    char* tp = last_impl + 4;
-                    while (*tp && isspace(*tp)) tp++;
-                    if (*tp == '<') { int d = 1; tp++; while (*tp && d > 0) { if (*tp == '<') d++; else if (*tp == '>') d--; tp++; } }
-                    while (*tp && isspace(*tp)) tp++;
-                    int ti = 0;
-                    char trait_name[64] = {0};
-                    while (*tp && (isalnum(*tp) || *tp == '_') && ti < 63) {
-                        trait_name[ti++] = *tp++;
-                    }
-                    trait_name[ti] = '\0';
-                    /* Skip generic params after trait name */
-                    while (*tp && isspace(*tp)) tp++;
-                    if (*tp == '<') { int d = 1; tp++; while (*tp && d > 0) { if (*tp == '<') d++; else if (*tp == '>') d--; tp++; } }
-                    while (*tp && isspace(*tp)) tp++;
-                    /* Check for "for ConcreteType" */
-                    if (strncmp(tp, "for ", 4) == 0) {
-                        tp += 4;
-                        while (*tp && isspace(*tp)) tp++;
-                        ti = 0;
-                        while (*tp && (isalnum(*tp) || *tp == '_') && ti < 63) {
-                            impl_type[ti++] = *tp++;
-                        }
-                        impl_type[ti] = '\0';
+                switch (in->op) {
+                case IR_NOTE:
+                    ir_dump_text(cx, in);
+                    break;
+                case IR_ASM:
+                    emit(cx, "asm ");
+                    ir_dump_text(cx, in);
+                    break;
+                case IR_ENTER:
+                case IR_RET:
+                    emit(cx, "%s %d", ir_opcode_names[in->op], in->imm);
+                    break;
+                case IR_CONST:
+                    emit(cx, "const %d", in->imm);
+                    break;
+                case IR_LOAD:
+                case IR_STORE:
+                    emit(cx, "%s%s [", ir_opcode_names[in->op], w);
+                    ir_dump_reg(cx, in->src[0]);
+                    if (in->has_imm) {
+                        emit(cx, " + %d]", in->imm);
                     } else {
-                        strncpy(impl_type, trait_name, 63);
-                        impl_type[63] = '\0';
+                        emit(cx, " + ");
+                        ir_dump_reg(cx, in->src[1]);
+                        emit(cx, "]");
                     }
-                    /* Find struct index for field offsets */
-                    for (int si = 0; si < struct_count; si++) {
-                        if (strcmp(structs[si].name, impl_type) == 0) {
-                            impl_struct_idx = si;
-                            break;
-                        }
+                    if (in->op == IR_STORE) {
+                        emit(cx, ", ");
+                        ir_dump_reg(cx, in->src[2]);
                     }
+                    break;
+                case IR_JUMP:
+                    emit(cx, "jump b%d", in->target);
+                    break;
+                case IR_BRANCH:
+                    if (in->cond == IR_DNZ) emit(cx, "branch dnz b%d", in->target);
+                    else emit(cx, "branch %s cr%d, b%d", ir_cond_names[in->cond], in->crf, in->target);
+                    break;
+                case IR_CALL:
+                    emit(cx, "call %s", sym_name(cx, in->sym));
+                    break;
+                default:
+                    emit(cx, "%s", ir_opcode_names[in->op]);
+                    if (in->op == IR_CMP) emit(cx, "%s cr%d,", in->is_signed ? ".s" : ".u", in->crf);
+                    for (k = 0; k < 2 && in->src[k] >= 0; k++) {
+                        emit(cx, "%s ", k ? "," : "");
+                        ir_dump_reg(cx, in->src[k]);
+                    }
+                    if (in->has_imm) emit(cx, ", %d", in->imm);
+                    break;
                 }
+                emit(cx, "\n");
             }
+        }
+    }
+}
 
-            /* Build full function name: Type_method or just method */
-            /* Deduplicate: track emitted labels, append counter if collision */
-            static char emitted_labels[500][128];
-            static int emitted_count = 0;
-            char full_name[128] = {0};
-            if (impl_type[0]) {
-                snprintf(full_name, sizeof(full_name), "%s_%s", impl_type, fn_name);
-            } else {
-                snprintf(full_name, sizeof(full_name), "%s", fn_name);
-            }
-            /* Check for duplicate and append suffix if needed */
-            int dup = 0;
-            for (int di = 0; di < emitted_count; di++) {
-                if (strcmp(emitted_labels[di], full_name) == 0) { dup++; }
-            }
-            if (emitted_count < 500) {
-                strncpy(emitted_labels[emitted_count], full_name, 127);
-                emitted_count++;
-            }
-            if (dup > 0) {
-                char suffix[16];
-                snprintf(suffix, sizeof(suffix), "_%d", dup);
-                strncat(full_name, suffix, sizeof(full_name) - strlen(full_name) - 1);
-            }
-
-            /* Parse parameter list */
-            char* paren = strchr(fn_start + 3, '(');
-            int param_count = 0;
-            int has_self = 0;
-            if (paren && paren < body) {
-                char* pp = paren + 1;
-                while (*pp && isspace(*pp)) pp++;
-                /* Check for self parameter */
-                if (strncmp(pp, "&mut self", 9) == 0 || strncmp(pp, "&self", 5) == 0 ||
-                    strncmp(pp, "mut self", 8) == 0 || strncmp(pp, "self", 4) == 0) {
-                    has_self = 1;
-                }
-                pp = paren + 1;
-                while (*pp && *pp != ')') {
-                    if (*pp == ':') param_count++;
-                    pp++;
-                }
-                if (has_self) param_count++; /* self doesn't have : but is a param */
-            }
-
-            printf("\n.align 2\n");
-            printf("_%s:\n", full_name);
-            printf("    mflr r0\n");
-            printf("    stw r0, 8(r1)\n");
-            printf("    stwu r1, -256(r1)  ; frame for %s\n", full_name);
+/* Instruction scheduling (-C opt-level=2 and up), the last pass. Every
+ * run of straight-line instructions between labels, branches, calls,
+ * directives and anything else it does not model is list-scheduled for
+ * the -C target-cpu's pipeline: instructions go out cycle by cycle, the
+ * ready one with the longest latency path to the end of the run first,
+ * so loads and multiplies start early and independent work fills their
+ * shadow. Dependences cover the GPRs, FPRs, VRs, CR fields, CTR, LR and
+ * XER[CA], so nothing crosses a carry chain (addc/adde, srawi/addze),
+ * and memory: a store keeps its place against every other access unless
+ * both use the same base register at disjoint displacements. A new
+ * order is kept only when the model says it is faster.
+ *
+ * -Z schedule-stats prints a static estimate per function, before and
+ * after: each run costs the cycles until its last result is ready, as if
+ * the pipeline drained at every boundary, and each boundary one more. */
+enum {
+    SCHED_INT, SCHED_MUL, SCHED_DIV, SCHED_LOAD, SCHED_STORE, SCHED_FP, SCHED_FDIV, SCHED_FLOAD,
+    SCHED_CRLOG, SCHED_MTSPR, SCHED_MFSPR, SCHED_MFCR, SCHED_VEC, SCHED_CLASSES
+};
+enum { SCHED_IU, SCHED_CIU, SCHED_LSU, SCHED_FPU, SCHED_SRU, SCHED_VPU, SCHED_UNITS };
+
+static const unsigned char sched_unit_of[SCHED_CLASSES] = {
+    SCHED_IU, SCHED_CIU, SCHED_CIU, SCHED_LSU, SCHED_LSU, SCHED_FPU, SCHED_FPU, SCHED_LSU,
+    SCHED_SRU, SCHED_SRU, SCHED_SRU, SCHED_SRU, SCHED_VPU
+};
 
-            /* Register variables */
-            int save_var_count = var_count;
-            int save_stack_offset = stack_offset;
-            stack_offset = 72;
+typedef struct {
+    const char* name;
+    int width;                              /* instructions dispatched per cycle */
+    int cracked;                            /* record and update forms take two slots */
+    unsigned solo;                          /* classes that dispatch in a group of their own */
+    unsigned char units[SCHED_UNITS];
+    unsigned char latency[SCHED_CLASSES];
+    unsigned char busy[SCHED_CLASSES];      /* cycles an unpipelined unit stays taken */
+} SchedModel;
+
+/* From the 750, 7400, 7450 and 970 user's manuals, rounded. Classes:
+ *   int mul div load store fp fdiv fload crlog mtspr mfspr mfcr vec
+ * The G4e trades the G3's 2-cycle loads and 3-cycle FPU for a deeper
+ * pipe; the G5 adds 2-cycle dependent integer ops, 5-op dispatch groups
+ * (4 here, the fifth slot only takes a branch), cracked record and
+ * update forms, and a microcoded mfcr. */
+static const SchedModel sched_models[] = {
+    { "750", 2, 0, 0, { 2, 1, 1, 1, 1, 1 },
+      { 1, 4, 19, 2, 1, 3, 31, 2, 1, 2, 1, 1, 1 },
+      { 1, 2, 19, 1, 1, 1, 31, 1, 1, 1, 1, 1, 1 } },
+    { "7400", 2, 0, 0, { 2, 1, 1, 1, 1, 2 },
+      { 1, 4, 19, 2, 1, 3, 31, 2, 1, 2, 1, 1, 3 },
+      { 1, 2, 19, 1, 1, 1, 31, 1, 1, 1, 1, 1, 1 } },
+    { "7450", 3, 0, 0, { 3, 1, 1, 1, 1, 2 },
+      { 1, 4, 23, 3, 1, 5, 35, 4, 1, 2, 3, 2, 4 },
+      { 1, 2, 23, 1, 1, 1, 35, 1, 1, 1, 1, 1, 1 } },
+    { "970", 4, 1, 1u << SCHED_MFCR, { 2, 2, 2, 2, 1, 2 },
+      { 2, 7, 36, 3, 1, 6, 33, 5, 2, 6, 6, 5, 4 },
+      { 1, 2, 36, 1, 1, 1, 28, 1, 1, 1, 1, 1, 1 } },
+};
+
+#define SCHED_WINDOW 64
+#define SCHED_SPAN (4 * SCHED_WINDOW)   /* lines a run covers, comments included */
+/* Bits of the fourth resource set past the eight CR fields */
+#define SCHED_CA (1u << 8)
+#define SCHED_CTR (1u << 9)
+#define SCHED_LR (1u << 10)
 
-            char* param_scan = paren + 1;
-            int param_idx = 0;
+typedef struct {
+    int first, line;            /* its comment lines from first, then itself */
+    int cls;
+    int slots;                  /* dispatch slots it takes */
+    unsigned use[4], def[4];    /* GPRs, FPRs, VRs, CR fields and CA/CTR/LR */
+    int mem;                    /* 1 load, 2 store */
+    int base, disp, width;      /* the address; width 0 when unknown */
+} SchedInsn;
+
+/* The dispatch and unit state of the cycle being filled */
+typedef struct {
+    int cycle;
+    int slots;
+    int free_at[SCHED_UNITS][4];
+} SchedClock;
+
+static const char* sched_carry_ops[] = {
+    "addc", "adde", "addze", "addme", "addic", "subfc", "subc", "subfe", "subfic", "subic",
+    "srawi", "sraw", NULL
+};
+
+/* Whether op (without its '.') is in the NULL-terminated list */
+static int sched_op_in(const char* op, int len, const char** list) {
+    int i;
+    for (i = 0; list[i]; i++) {
+        if ((int)strlen(list[i]) == len && strncmp(op, list[i], len) == 0) return 1;
+    }
+    return 0;
+}
 
-            if (has_self) {
-                /* self is passed as pointer in r3 */
-                printf("    stw r3, %d(r1)    ; param self (ptr)\n", stack_offset);
-                strcpy(vars[var_count].name, "self");
-                vars[var_count].offset = stack_offset;
-                vars[var_count].type = TYPE_REF;
-                vars[var_count].size = 4;
-                var_count++;
-                stack_offset += 4;
-                param_idx = 1;
-                /* Skip past self in param list */
-                while (*param_scan && *param_scan != ',' && *param_scan != ')') param_scan++;
-                if (*param_scan == ',') param_scan++;
-            }
-
-            while (param_scan && *param_scan && *param_scan != ')' && param_idx < param_count) {
-                while (*param_scan && isspace(*param_scan)) param_scan++;
-                if (*param_scan == ')') break;
-                if (*param_scan == '&') param_scan++;
-                while (*param_scan && isspace(*param_scan)) param_scan++;
-                if (strncmp(param_scan, "mut ", 4) == 0) param_scan += 4;
-                while (*param_scan && isspace(*param_scan)) param_scan++;
-                char pname[64] = {0};
-                int pni = 0;
-                while (*param_scan && (isalnum(*param_scan) || *param_scan == '_') && pni < 63) {
-                    pname[pni++] = *param_scan++;
-                }
-                pname[pni] = '\0';
-                while (*param_scan && *param_scan != ',' && *param_scan != ')') param_scan++;
-                if (*param_scan == ',') param_scan++;
-
-                if (pname[0] && param_idx < 8) {
-                    printf("    stw r%d, %d(r1)    ; param %s\n", 3 + param_idx, stack_offset, pname);
-                    strcpy(vars[var_count].name, pname);
-                    vars[var_count].offset = stack_offset;
-                    vars[var_count].type = TYPE_I32;
-                    vars[var_count].size = 4;
-                    var_count++;
-                    stack_offset += 4;
-                }
-                param_idx++;
+/* Class of the instruction l, filling in what it reads and writes; -1
+ * for one the scheduler must not move or move anything across */
+static int sched_classify(const PeepLine* l, const SchedModel* m, SchedInsn* s) {
+    static const char* barriers[] = {
+        "sc", "sync", "isync", "eieio", "lwarx", "stwcx.", "trap", "mcrf", "mcrxr", "lswi", "stswi", NULL
+    };
+    const char* op = l->op;
+    int len = (int)strlen(op), rec = len > 1 && op[len - 1] == '.', k, r, bits[3];
+    unsigned use, def;
+
+    memset(s, 0, sizeof(*s));
+    if (op[0] == 'b' || sched_op_in(op, len, barriers) || strncmp(op, "tw", 2) == 0
+            || strncmp(op, "dcb", 3) == 0 || strncmp(op, "icb", 3) == 0) return -1;
+    if (peep_effects(l, &use, &def) < 0) return -1;
+    s->use[0] = use;
+    s->def[0] = def;
+    if (rec) len--;
+
+    if (strcmp(op, "mtctr") == 0 || strcmp(op, "mtlr") == 0) {
+        s->cls = SCHED_MTSPR;
+        s->def[3] = op[2] == 'c' ? SCHED_CTR : SCHED_LR;
+    } else if (strcmp(op, "mfctr") == 0 || strcmp(op, "mflr") == 0) {
+        s->cls = SCHED_MFSPR;
+        s->use[3] = op[2] == 'c' ? SCHED_CTR : SCHED_LR;
+    } else if (strcmp(op, "mfcr") == 0) {
+        s->cls = SCHED_MFCR;
+        s->use[3] = 0xFF;
+    } else if (strncmp(op, "mt", 2) == 0 || strncmp(op, "mf", 2) == 0) {
+        return -1;
+    } else if (op[0] == 'c' && op[1] == 'r') {
+        /* cror bt, ba, bb: CR bits by number; bt's field is read too */
+        for (k = 0; k < 3; k++) {
+            int n = k < l->nargs ? l->arg_len[k] : 0;
+            if (n < 1 || n > 2 || !isdigit((unsigned char)l->arg[k][0])
+                    || (n == 2 && !isdigit((unsigned char)l->arg[k][1]))) return -1;
+            bits[k] = atoi(l->arg[k]);
+        }
+        s->cls = SCHED_CRLOG;
+        s->def[3] = 1u << (bits[0] / 4);
+        s->use[3] = s->def[3] | 1u << (bits[1] / 4) | 1u << (bits[2] / 4);
+    } else if (strncmp(op, "cmp", 3) == 0 || strncmp(op, "fcmp", 4) == 0) {
+        s->cls = op[0] == 'f' ? SCHED_FP : SCHED_INT;
+        s->def[3] = 1u << ir_crf(l, &k);
+    } else if (op[0] == 'f') {
+        s->cls = (strncmp(op, "fdiv", 4) == 0 || strncmp(op, "fsqrt", 5) == 0) ? SCHED_FDIV : SCHED_FP;
+        if (rec) s->def[3] = 1u << 1;
+    } else if (op[0] == 'v') {
+        s->cls = SCHED_VEC;
+        if (rec) s->def[3] = 1u << 6;
+    } else if (op[0] == 'l' && strcmp(op, "li") != 0 && strcmp(op, "lis") != 0 && strcmp(op, "la") != 0) {
+        s->cls = op[1] == 'f' ? SCHED_FLOAD : SCHED_LOAD;
+        s->mem = 1;
+    } else if (strncmp(op, "st", 2) == 0) {
+        s->cls = SCHED_STORE;
+        s->mem = 2;
+    } else if (strncmp(op, "mul", 3) == 0) {
+        s->cls = SCHED_MUL;
+    } else if (strncmp(op, "div", 3) == 0) {
+        s->cls = SCHED_DIV;
+    } else {
+        s->cls = SCHED_INT;
+    }
+    if (rec && op[0] != 'f' && op[0] != 'v') s->def[3] |= 1u;
+    if (sched_op_in(op, len, sched_carry_ops)) s->def[3] |= SCHED_CA;
+    if (strncmp(op, "adde", 4) == 0 || strncmp(op, "addze", 5) == 0 || strncmp(op, "addme", 5) == 0
+            || strncmp(op, "subfe", 5) == 0) s->use[3] |= SCHED_CA;
+
+    /* FPR and VR operands: the first is written unless it is a store's */
+    for (k = 0; k < l->nargs; k++) {
+        int file;
+        for (file = 1; file <= 2; file++) {
+            if ((r = peep_regfile(l, k, file == 1 ? 'f' : 'v')) < 0) continue;
+            if (k == 0 && s->mem != 2) s->def[file] |= 1u << r;
+            else s->use[file] |= 1u << r;
+        }
+        if (s->mem && (r = peep_mem_base(l, k)) >= 0) {
+            s->base = r;
+            if (peep_mem_disp(l, k, &s->disp)) {
+                char size = op[s->mem == 2 ? 2 : 1];
+                s->width = peep_fp_width(op) ? peep_fp_width(op)
+                         : size == 'b' ? 1 : size == 'h' ? 2 : size == 'w' ? 4 : 0;
             }
+        }
+    }
+    s->slots = m->cracked && (rec || (s->mem && peep_is_update(l))) ? 2 : 1;
+    return s->cls;
+}
 
-            /* Store impl struct index for self.field resolution */
-            int save_impl_struct = current_impl_struct;
-            current_impl_struct = impl_struct_idx;
-
-            pos = body + 1;
-            compile_function_body(256);
-
-            /* Default return if body didn't explicitly return */
-            printf("    li r3, 0          ; default return\n");
-            printf("    addi r1, r1, 256\n");
-            printf("    lwz r0, 8(r1)\n");
-            printf("    mtlr r0\n");
-            printf("    blr\n");
+/* Whether b, later in the run, must stay after a; *latency gets the
+ * cycles between their issues */
+static int sched_depends(const SchedModel* m, const SchedInsn* a, const SchedInsn* b, int* latency) {
+    int k, raw = 0, order = 0;
+    for (k = 0; k < 4; k++) {
+        raw |= (a->def[k] & b->use[k]) != 0;
+        order |= (a->use[k] & b->def[k]) != 0 || (a->def[k] & b->def[k]) != 0;
+    }
+    if (a->mem && b->mem && (a->mem == 2 || b->mem == 2)) {
+        int apart = a->width && b->width && a->base == b->base
+                 && (a->disp + a->width <= b->disp || b->disp + b->width <= a->disp);
+        if (!apart) {
+            order = 1;
+            if (a->mem == 2 && b->mem == 1) raw = 1;
+        }
+    }
+    *latency = raw ? m->latency[a->cls] : 0;
+    return raw || order;
+}
 
-            /* Find end of function body to advance scan */
-            int bd = 1;
-            char* bp = body + 1;
-            while (*bp && bd > 0) {
-                if (*bp == '{') bd++;
-                else if (*bp == '}') bd--;
-                bp++;
-            }
+/* Whether s can go out in the clock's cycle; with take, it does, using
+ * up its slots and unit */
+static int sched_issue(const SchedModel* m, SchedClock* c, const SchedInsn* s, int take) {
+    int unit = sched_unit_of[s->cls], count = m->units[unit], k, solo = (m->solo >> s->cls) & 1;
+    if (c->slots + s->slots > m->width || (solo && c->slots)) return 0;
+    for (k = 0; k < count && c->free_at[unit][k] > c->cycle; k++) {
+    }
+    if (k == count) return 0;
+    if (!take) return 1;
+    c->free_at[unit][k] = c->cycle + m->busy[s->cls];
+    c->slots = solo ? m->width : c->slots + s->slots;
+    return 1;
+}
 
-            /* Restore compiler state for next function */
-            pos = save_pos;
-            var_count = save_var_count;
-            stack_offset = save_stack_offset;
-            current_impl_struct = save_impl_struct;
+static void sched_tick(SchedClock* c) {
+    c->cycle++;
+    c->slots = 0;
+}
 
-            scan = bp;
+/* Cycles the run takes in the given order on an in-order pipeline:
+ * until its last result is ready */
+static int sched_estimate(const SchedModel* m, const SchedInsn* run, const int* order, int n) {
+    static const SchedClock start;
+    SchedClock c = start;
+    int issued[SCHED_WINDOW], done = 0, i, j, lat;
+    for (i = 0; i < n; i++) {
+        const SchedInsn* s = &run[order[i]];
+        int ready = 0;
+        for (j = 0; j < i; j++) {
+            if (sched_depends(m, &run[order[j]], s, &lat) && issued[j] + lat > ready) ready = issued[j] + lat;
         }
+        while (c.cycle < ready) sched_tick(&c);
+        while (!sched_issue(m, &c, s, 1)) sched_tick(&c);
+        issued[i] = c.cycle;
+        if (c.cycle + m->latency[s->cls] > done) done = c.cycle + m->latency[s->cls];
     }
+    return done;
+}
 
-    /* Find and compile main */
-    char* main_start = strstr(source, "fn main()");
-    if (!main_start) {
-        /* Try async main */
-        main_start = strstr(source, "async fn main()");
-        if (main_start) in_async_block = 1;
+/* List-schedule the run into order[]: each cycle, of the instructions
+ * whose operands are ready and whose unit is free, the one with the
+ * longest latency path to the end of the run goes first, ties in
+ * source order */
+static void sched_list(const SchedModel* m, const SchedInsn* run, int n, int* order) {
+    static const SchedClock start;
+    SchedClock c = start;
+    signed char lat[SCHED_WINDOW][SCHED_WINDOW];
+    int height[SCHED_WINDOW], preds[SCHED_WINDOW], ready[SCHED_WINDOW], placed = 0, i, j, l;
+    for (i = 0; i < n; i++) {
+        preds[i] = ready[i] = 0;
+        for (j = 0; j < i; j++) {
+            lat[j][i] = sched_depends(m, &run[j], &run[i], &l) ? l : -1;
+            preds[i] += lat[j][i] >= 0;
+        }
+    }
+    for (i = n - 1; i >= 0; i--) {
+        height[i] = m->latency[run[i].cls];
+        for (j = i + 1; j < n; j++) {
+            if (lat[i][j] >= 0 && lat[i][j] + height[j] > height[i]) height[i] = lat[i][j] + height[j];
+        }
     }
+    while (placed < n) {
+        int best = -1;
+        for (i = 0; i < n; i++) {
+            if (preds[i] || ready[i] > c.cycle || !sched_issue(m, &c, &run[i], 0)) continue;
+            if (best < 0 || height[i] > height[best]) best = i;
+        }
+        if (best < 0) {
+            sched_tick(&c);
+            continue;
+        }
+        sched_issue(m, &c, &run[best], 1);
+        order[placed++] = best;
+        preds[best] = -1;
+        for (j = best + 1; j < n; j++) {
+            if (lat[best][j] < 0) continue;
+            preds[j]--;
+            if (c.cycle + lat[best][j] > ready[j]) ready[j] = c.cycle + lat[best][j];
+        }
+    }
+}
 
-    if (!main_start) {
-        /* No main — this is a library crate. Emit all functions as stubs already done above. */
-        /* Generate impl blocks for trait implementations */
-        for (i = 0; i < impl_count; i++) {
-            printf("\n; impl %s for %s\n", impls[i].trait_name, impls[i].struct_name);
+/* A comment on a line of its own */
+static int sched_is_comment(const PeepLine* l) {
+    const char* p = l->text;
+    if (l->kind != PEEP_OTHER) return 0;
+    while (p < l->text + l->len && (*p == ' ' || *p == '\t')) p++;
+    return p > l->text && p < l->text + l->len && *p == ';';
+}
+
+typedef struct {
+    int before, after;          /* estimated cycles of the function so far */
+    int runs, reordered;
+} SchedTally;
+
+/* Schedule one run and put its lines in the new order if that is
+ * faster; a comment line goes along with the instruction after it */
+static void sched_flush(PeepState* ps, const SchedModel* m, const SchedInsn* run, int n, SchedTally* t) {
+    PeepLine moved[SCHED_SPAN];
+    int order[SCHED_WINDOW], k, j, old, now, at = 0;
+    for (k = 0; k < n; k++) order[k] = k;
+    old = now = sched_estimate(m, run, order, n);
+    t->runs++;
+    if (n > 1) {
+        sched_list(m, run, n, order);
+        now = sched_estimate(m, run, order, n);
+    }
+    if (now < old) {
+        for (k = 0; k < n; k++) {
+            for (j = run[order[k]].first; j <= run[order[k]].line; j++) moved[at++] = ps->lines[j];
         }
+        memcpy(&ps->lines[run[0].first], moved, at * sizeof(PeepLine));
+        t->reordered++;
+    } else {
+        now = old;
+    }
+    t->before += old;
+    t->after += now;
+}
 
-        /* PIC symbol stubs for external calls */
-        emit_pic_stubs();
-        return;
+static void sched_run(CompilerContext* cx, PeepState* ps) {
+    const SchedModel* m = &sched_models[target_cpus[cx->opts.target_cpu].sched];
+    SchedInsn run[SCHED_WINDOW], s;
+    SchedTally fn = { 0, 0, 0, 0 }, total = { 0, 0, 0, 0 };
+    int n = 0, i, name = -1, functions = 0, first = -1;
+    for (i = 0; i <= ps->count; i++) {
+        const PeepLine* l = i < ps->count ? &ps->lines[i] : NULL;
+        if (l && (l->dead || sched_is_comment(l))) {
+            /* these go with the next instruction */
+            if (first < 0) first = i;
+            continue;
+        }
+        if (l && l->kind == PEEP_INSN && !l->before && !l->after && sched_classify(l, m, &s) >= 0) {
+            if (n == SCHED_WINDOW || (n && i - run[0].first >= SCHED_SPAN)) {
+                sched_flush(ps, m, run, n, &fn);
+                n = 0;
+            }
+            s.first = first >= 0 && i - first < SCHED_SPAN ? first : i;
+            s.line = i;
+            run[n++] = s;
+            first = -1;
+            continue;
+        }
+        if (n) sched_flush(ps, m, run, n, &fn);
+        n = 0;
+        first = -1;
+        if (l && l->kind == PEEP_INSN) {
+            /* a branch, call or the like: a cycle of its own */
+            fn.before++;
+            fn.after++;
+        }
+        if (l && !(l->kind == PEEP_LABEL && l->text[0] == '_')) continue;
+        if (fn.before) {
+            if (cx->opts.schedule_stats && name >= 0) {
+                const PeepLine* label = &ps->lines[name];
+                fprintf(stderr, "schedule: %.*s %d -> %d cycles\n", label->len - 1, label->text, fn.before, fn.after);
+            }
+            total.before += fn.before;
+            total.after += fn.after;
+            total.runs += fn.runs;
+            total.reordered += fn.reordered;
+            functions++;
+        }
+        fn.before = fn.after = fn.runs = fn.reordered = 0;
+        name = i;
     }
+    if (cx->opts.schedule_stats) {
+        fprintf(stderr, "schedule: %d functions, %d -> %d cycles, %d of %d runs reordered for the %s\n",
+                functions, total.before, total.after, total.reordered, total.runs, m->name);
+    }
+}
 
-    printf(".globl _main\n_main:\n");
-    printf("    mflr r0\n");
-    printf("    stw r0, 8(r1)\n");
-    printf("    stwu r1, -2048(r1)  ; Large frame for Firefox\n");
-    
-    /* Initialize runtime */
-    printf("    bl _rust_runtime_init\n");
+/* -Z time-passes. gettimeofday(): clock_gettime() only arrived in 10.12 */
+static double pass_clock(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
 
-    pos = strchr(main_start, '{') + 1;
-    stack_offset = 72;  /* Reset for main */
-    var_count = 0;
+static void pass_time(CompilerContext* cx, const char* name, double start) {
+    if (cx->opts.time_passes) fprintf(stderr, "time: %9.6f\t%s\n", pass_clock() - start, name);
+}
 
-    compile_function_body(2048);
+/* The optimization pipeline. O0 is compile_rust()'s direct emission with
+ * nothing after it; every pass below runs from its opt level up, in
+ * table order. */
+typedef struct {
+    const char* name;
+    int min_level;
+    void (*run)(CompilerContext* cx, PeepState* ps);
+} PassInfo;
+
+static const PassInfo pass_pipeline[] = {
+    { "ir-build",   1, ir_build },
+    { "inline",     2, ir_inline },
+    { "const-fold", 1, ir_fold },
+    { "stack-color", 1, ir_color },
+    { "ir-lower",   1, ir_lower },
+    { "regalloc",   2, peep_regalloc },
+    { "peephole",   1, peep_optimize },
+    { "save-regs",  2, peep_save_regs },
+    { "frame",      2, peep_frames },
+    { "schedule",   2, sched_run },
+};
+#define PASS_COUNT ((int)(sizeof(pass_pipeline) / sizeof(pass_pipeline[0])))
+
+/* Run the pipeline over the held output (-C opt-level=1 and up) */
+void pipeline_run(CompilerContext* cx) {
+    PeepState ps;
+    double start = pass_clock();
+    int i;
 
-    /* Cleanup at end of main */
-    printf("\n    ; Cleanup and exit\n");
-    
-    /* Drop all variables in reverse order - RAII */
-    for (i = var_count - 1; i >= 0; i--) {
-        emit_drop_glue(&vars[i]);
+    memset(&ps, 0, sizeof(ps));
+    peep_load(cx, &ps);
+    pass_time(cx, "split-lines", start);
+    for (i = 0; i < PASS_COUNT; i++) {
+        if (pass_pipeline[i].run == ir_lower && cx->opts.emit_ir) {
+            /* --emit=ir stops here, whatever the opt level */
+            if (!ps.ir) ir_build(cx, &ps);
+            ir_dump(cx, ps.ir);
+            return;
+        }
+        if (cx->opts.opt_level < pass_pipeline[i].min_level) continue;
+        start = pass_clock();
+        pass_pipeline[i].run(cx, &ps);
+        pass_time(cx, pass_pipeline[i].name, start);
+    }
+    start = pass_clock();
+    peep_store(cx, &ps);
+    pass_time(cx, "reassemble", start);
+
+    if (cx->opts.peephole_stats) {
+        fprintf(stderr, "peephole:");
+        for (i = 0; i < PEEP_PATTERNS; i++) {
+            fprintf(stderr, "%s %s %d", i ? "," : "", peep_pattern_names[i], ps.hits[i]);
+        }
+        fprintf(stderr, " (%d of %d lines removed)\n", ps.count - ps.kept, ps.count);
+        fprintf(stderr, "const-fold: %d folded, %d immediates, %d reduced, %d branches, %d dead\n",
+                ps.folded, ps.immediates, ps.reduced, ps.branches, ps.dead);
+        fprintf(stderr, "stack-color: %d slots shared, %d frame bytes freed\n", ps.slots_shared, ps.frame_freed);
+        if (cx->opts.opt_level >= 2) {
+            fprintf(stderr, "regalloc: %d slots in registers, %d in FPRs, %d spilled, %d registers saved\n",
+                    ps.promoted + ps.fpr_promoted, ps.fpr_promoted, ps.spilled, ps.saved);
+            fprintf(stderr, "frame: %d leaf functions, %d without a frame\n", ps.leaves, ps.frameless);
+            fprintf(stderr, "inline: %d calls inlined, %d from other crates\n", ps.inlined, ps.inlined_extern);
+        }
     }
-    
-    printf("    bl _rust_runtime_cleanup\n");
-    printf("    li r3, 0          ; exit code\n");
-    printf("    addi r1, r1, 2048\n");
-    printf("    lwz r0, 8(r1)\n");
-    printf("    mtlr r0\n");
-    printf("    blr\n");
-    
-    /* Generate runtime support functions */
-    printf("\n; Runtime support functions\n");
-    
-    printf("\n.align 2\n");
-    printf("_rust_runtime_init:\n");
-    printf("    ; Initialize memory allocator, thread locals, etc\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_rust_runtime_cleanup:\n");
-    printf("    ; Clean up runtime state\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_alloc_box:\n");
-    printf("    ; r3 = size, return pointer in r3\n");
-    printf("    b L_malloc$stub   ; Use system malloc for now\n");
-    
-    printf("\n.align 2\n");
-    printf("_dealloc_box:\n");
-    printf("    ; r3 = pointer\n");
-    printf("    b L_free$stub     ; Use system free\n");
-    
-    printf("\n.align 2\n");
-    printf("_alloc_rc:\n");
-    printf("    ; Allocate with reference count\n");
-    printf("    b L_malloc$stub\n");
-    
-    printf("\n.align 2\n");
-    printf("_rc_decrement:\n");
-    printf("    ; Decrement ref count, free if zero\n");
-    printf("    lwz r4, 0(r3)     ; load refcount\n");
-    printf("    subi r4, r4, 1    ; decrement\n");
-    printf("    stw r4, 0(r3)     ; store back\n");
-    printf("    cmpwi r4, 0\n");
-    printf("    bne 1f\n");
-    printf("    b L_free$stub     ; free if zero\n");
-    printf("1:  blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_alloc_arc:\n");
-    printf("    ; Allocate with atomic reference count\n");
-    printf("    b L_malloc$stub\n");
-    
-    printf("\n.align 2\n");
-    printf("_arc_decrement:\n");
-    printf("    ; Atomic decrement ref count\n");
-    printf("    lwarx r4, 0, r3   ; load reserved\n");
-    printf("    subi r4, r4, 1    ; decrement\n");
-    printf("    stwcx. r4, 0, r3  ; store conditional\n");
-    printf("    bne- _arc_decrement ; retry if failed\n");
-    printf("    cmpwi r4, 0\n");
-    printf("    bne 1f\n");
-    printf("    b L_free$stub     ; free if zero\n");
-    printf("1:  blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_vec_new:\n");
-    printf("    ; Create new Vec — allocate struct + initial buffer\n");
-    printf("    mflr r0\n");
-    printf("    stw r0, 8(r1)\n");
-    printf("    stwu r1, -48(r1)\n");
-    printf("    li r3, 12         ; Vec struct size\n");
-    printf("    bl L_malloc$stub\n");
-    printf("    stw r3, 24(r1)    ; save Vec ptr\n");
-    printf("    li r4, 16         ; initial capacity (4 elements)\n");
-    printf("    stw r4, 28(r1)    ; save cap request\n");
-    printf("    mr r14, r3        ; save vec ptr\n");
-    printf("    li r3, 16         ; alloc buffer for 4 i32 elements\n");
-    printf("    bl L_malloc$stub\n");
-    printf("    lwz r14, 24(r1)   ; restore vec ptr\n");
-    printf("    stw r3, 0(r14)    ; ptr = buffer\n");
-    printf("    li r4, 0\n");
-    printf("    stw r4, 4(r14)    ; len = 0\n");
-    printf("    li r4, 4\n");
-    printf("    stw r4, 8(r14)    ; cap = 4\n");
-    printf("    mr r3, r14        ; return Vec ptr\n");
-    printf("    addi r1, r1, 48\n");
-    printf("    lwz r0, 8(r1)\n");
-    printf("    mtlr r0\n");
-    printf("    blr\n");
-
-    printf("\n.align 2\n");
-    printf("_vec_push:\n");
-    printf("    ; r3 = vec ptr, r4 = value to push\n");
-    printf("    mflr r0\n");
-    printf("    stw r0, 8(r1)\n");
-    printf("    stwu r1, -48(r1)\n");
-    printf("    stw r3, 24(r1)    ; save vec ptr\n");
-    printf("    stw r4, 28(r1)    ; save value\n");
-    printf("    lwz r5, 4(r3)     ; load len\n");
-    printf("    lwz r6, 8(r3)     ; load cap\n");
-    printf("    cmpw r5, r6\n");
-    printf("    blt 1f            ; skip realloc if space available\n");
-    printf("    ; TODO: realloc buffer (double capacity)\n");
-    printf("1:\n");
-    printf("    lwz r3, 24(r1)    ; reload vec ptr\n");
-    printf("    lwz r5, 4(r3)     ; reload len\n");
-    printf("    lwz r6, 0(r3)     ; load data ptr\n");
-    printf("    slwi r7, r5, 2    ; len * 4 = byte offset\n");
-    printf("    lwz r4, 28(r1)    ; reload value\n");
-    printf("    stwx r4, r6, r7   ; store element at data[len]\n");
-    printf("    addi r5, r5, 1    ; increment len\n");
-    printf("    stw r5, 4(r3)     ; store new len\n");
-    printf("    addi r1, r1, 48\n");
-    printf("    lwz r0, 8(r1)\n");
-    printf("    mtlr r0\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_vec_drop:\n");
-    printf("    ; r3 = vec ptr\n");
-    printf("    lwz r3, 0(r3)     ; load data ptr\n");
-    printf("    cmpwi r3, 0\n");
-    printf("    beq 1f\n");
-    printf("    b L_free$stub     ; free data\n");
-    printf("1:  blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_string_drop:\n");
-    printf("    ; Same as vec_drop\n");
-    printf("    b _vec_drop\n");
-    
-    printf("\n.align 2\n");
-    printf("_create_future:\n");
-    printf("    ; Create Future for async\n");
-    printf("    li r3, 16         ; Future size\n");
-    printf("    b L_malloc$stub\n");
-    
-    printf("\n.align 2\n");
-    printf("_await_future:\n");
-    printf("    ; r3 = future ptr\n");
-    printf("    ; Simplified - would need executor integration\n");
-    printf("    lwz r3, 12(r3)    ; get result\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_rust_println:\n");
-    printf("    ; Simplified println\n");
-    printf("    ; Would format and call write syscall\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_rust_assert:\n");
-    printf("    ; Assert implementation\n");
-    printf("    cmpwi r3, 0\n");
-    printf("    bne 1f\n");
-    printf("    bl _panic         ; panic if false\n");
-    printf("1:  blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_panic:\n");
-    printf("    ; Panic handler\n");
-    printf("    ; Would print message and abort\n");
-    printf("    li r0, 1          ; exit syscall\n");
-    printf("    li r3, 1          ; error code\n");
-    printf("    sc                ; system call\n");
-    
-    printf("\n.align 2\n");
-    printf("_panic_unwrap:\n");
-    printf("    ; Panic on unwrap None/Err\n");
-    printf("    b _panic\n");
-    
-    printf("\n.align 2\n");
-    printf("_try_operator:\n");
-    printf("    ; Handle ? operator\n");
-    printf("    ; Check if Ok/Some, return early if Err/None\n");
-    printf("    lwz r4, 0(r3)     ; load tag\n");
-    printf("    cmpwi r4, 0\n");
-    printf("    bne 1f            ; if not Ok/Some\n");
-    printf("    lwz r3, 4(r3)     ; extract value\n");
-    printf("    blr\n");
-    printf("1:  ; Return early with Err/None\n");
-    printf("    addi r1, r1, 2048 ; unwind stack\n");
-    printf("    lwz r0, 8(r1)\n");
-    printf("    mtlr r0\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_clone_impl:\n");
-    printf("    ; Generic clone implementation\n");
-    printf("    ; Would deep copy based on type\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_drop_impl:\n");
-    printf("    ; Generic drop implementation\n");
-    printf("    ; Would call destructor based on type\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_create_iter:\n");
-    printf("    ; Create iterator from collection\n");
-    printf("    li r4, 16         ; Iterator size\n");
-    printf("    mr r5, r3         ; save collection\n");
-    printf("    li r3, 16\n");
-    printf("    bl L_malloc$stub\n");
-    printf("    stw r5, 0(r3)     ; store collection ptr\n");
-    printf("    li r4, 0\n");
-    printf("    stw r4, 4(r3)     ; index = 0\n");
-    printf("    blr\n");
-    
-    printf("\n.align 2\n");
-    printf("_iter_collect:\n");
-    printf("    ; Collect iterator into Vec\n");
-    printf("    bl _vec_new\n");
-    printf("    ; Would iterate and push all elements\n");
-    printf("    blr\n");
-    
-    emit_pic_stubs();
 }
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        printf("Usage: %s <file.rs>\n", argv[0]);
+/* Apply one -C option value; 0 (with a diagnostic) if it is invalid */
+static int apply_codegen_option(CompileOptions* o, const char* opt) {
+    int i;
+    if (strncmp(opt, "opt-level=", 10) == 0) {
+        const char* level = opt + 10;
+        if (strcmp(level, "s") == 0 || strcmp(level, "z") == 0) {
+            o->opt_level = 2;
+        } else if (level[0] >= '0' && level[0] <= '3' && level[1] == '\0') {
+            o->opt_level = level[0] - '0';
+        } else {
+            fprintf(stderr, "rustc_ppc: optimization level needs to be between 0-3, s or z (instead was `%s`)\n",
+                    level);
+            return 0;
+        }
+    } else if (strncmp(opt, "inline-threshold=", 17) == 0) {
+        o->inline_threshold = atoi(opt + 17);
+    } else if (strncmp(opt, "fp-contract=", 12) == 0) {
+        o->fp_contract = strcmp(opt + 12, "fast") == 0 ? FP_CONTRACT_FAST
+                       : strcmp(opt + 12, "on") == 0 ? FP_CONTRACT_ON : FP_CONTRACT_OFF;
+    } else if (strncmp(opt, "target-cpu=", 11) == 0) {
+        for (i = 0; i < TARGET_CPU_COUNT; i++) {
+            if (strcmp(opt + 11, target_cpus[i].name) == 0) break;
+        }
+        if (i == TARGET_CPU_COUNT) {
+            fprintf(stderr, "rustc_ppc: unknown target-cpu '%s', using generic\n", opt + 11);
+            i = 0;
+        }
+        o->target_cpu = i;
+    } else if (strncmp(opt, "target-feature=", 15) == 0) {
+        /* Comma-separated +feature / -feature list; only altivec matters */
+        const char* f = opt + 15;
+        while (*f) {
+            const char* comma = strchr(f, ',');
+            int len = comma ? (int)(comma - f) : (int)strlen(f);
+            if ((f[0] == '+' || f[0] == '-') && len == 8 && strncmp(f + 1, "altivec", 7) == 0) {
+                o->altivec = f[0] == '+' ? 1 : -1;
+            }
+            f += len + (comma != NULL);
+        }
+    }
+    return 1;
+}
+
+/* Apply the option at argv[a]. Returns how many arguments it used, 0 if
+ * argv[a] is not a -C/-Z/-O/--emit option, -1 if its value is invalid.
+ * -C also takes its value attached (-Copt-level=3). Unknown -C options are
+ * accepted and ignored, like rustc's target-specific ones. */
+int apply_option(CompileOptions* o, char** argv, int argc, int a) {
+    if (strncmp(argv[a], "--emit=", 7) == 0) {
+        /* Comma-separated: asm (the default), ir, metadata */
+        const char* e = argv[a] + 7;
+        o->emit_ir = o->emit_metadata = 0;
+        while (*e) {
+            const char* comma = strchr(e, ',');
+            int len = comma ? (int)(comma - e) : (int)strlen(e);
+            if (len == 2 && strncmp(e, "ir", 2) == 0) o->emit_ir = 1;
+            if (len == 8 && strncmp(e, "metadata", 8) == 0) o->emit_metadata = 1;
+            e += len + (comma != NULL);
+        }
         return 1;
     }
-    
-    FILE* f = fopen(argv[1], "r");
+    if (strcmp(argv[a], "--extern") == 0 && a + 1 < argc) {
+        if (strchr(argv[a + 1], '=') && o->extern_count < 32) o->externs[o->extern_count++] = argv[a + 1];
+        return 2;
+    }
+    if (strcmp(argv[a], "-O") == 0) {
+        o->opt_level = 2;
+        return 1;
+    }
+    if (strncmp(argv[a], "-C", 2) == 0 && argv[a][2]) {
+        return apply_codegen_option(o, argv[a] + 2) ? 1 : -1;
+    }
+    if ((strcmp(argv[a], "-C") == 0 || strcmp(argv[a], "-Z") == 0) && a + 1 < argc) {
+        const char* opt = argv[a + 1];
+        if (strcmp(argv[a], "-Z") == 0) {
+            if (strcmp(opt, "symtab-stats") == 0) o->symtab_stats = 1;
+            if (strcmp(opt, "peephole-stats") == 0) o->peephole_stats = 1;
+            if (strcmp(opt, "time-passes") == 0) o->time_passes = 1;
+            if (strcmp(opt, "match-stats") == 0) o->match_stats = 1;
+            if (strcmp(opt, "schedule-stats") == 0) o->schedule_stats = 1;
+        } else if (!apply_codegen_option(o, opt)) {
+            return -1;
+        }
+        return 2;
+    }
+    return 0;
+}
+
+/* Put every piece of per-file state back to its startup value, so each
+ * file of a batch compiles exactly as it would in a fresh process */
+void compiler_reset(CompilerContext* cx) {
+    arena_release(cx);
+    memset(&cx->labels, 0, sizeof(cx->labels));
+    cx->string_label_count = 0;
+    cx->current_impl_struct = -1;
+    cx->return_type = TYPE_I32;
+    cx->block_depth = 0;
+    cx->loop_regs = 0;
+    cx->ctr_busy = 0;
+    cx->fpr_live = 0;
+    cx->stack_offset = 72;
+    cx->heap_offset = 0;
+    cx->async_context_size = 0;
+    cx->in_unsafe_block = 0;
+    cx->in_async_block = 0;
+    cx->heap_blocks = NULL;
+    cx->current_file_hash = 0;
+    cx->sym_lookups = 0;
+    cx->sym_probes = 0;
+    cx->pos = NULL;
+    cx->src_base = NULL;
+    cx->out_hold = 0;
+    cx->input = NULL;
+}
+
+/* A fresh context with default options and its own output buffer */
+CompilerContext* compiler_context_new(void) {
+    CompilerContext* cx = calloc(1, sizeof(CompilerContext));
+    if (cx) {
+        cx->out_cap = OUT_BUF_SIZE;
+        cx->out_buf = malloc(cx->out_cap);
+    }
+    if (!cx || !cx->out_buf) {
+        fprintf(stderr, "rustc_ppc: out of memory\n");
+        exit(1);
+    }
+    compiler_reset(cx);
+    return cx;
+}
+
+void compiler_context_free(CompilerContext* cx) {
+    arena_release(cx);
+    free(cx->out_buf);
+    free(cx);
+}
+
+/* Report a failed file operation on stderr and keep the message */
+static void compile_fail(CompilerContext* cx, const char* path, const char* what) {
+    snprintf(cx->error, sizeof(cx->error), "%s: %s: %s", path, what, strerror(errno));
+    fprintf(stderr, "%s\n", cx->error);
+}
+
+/* Compile one file; output NULL means stdout. Returns 0 on success. */
+int compile_file(CompilerContext* cx, const char* input, const char* output) {
+    double total = pass_clock();
+    cx->error[0] = '\0';
+    cx->input = input;
+    cx->error_count = 0;
+    cx->error_tok_count = 0;
+    FILE* f = fopen(input, "r");
     if (!f) {
-        perror("Cannot open file");
+        compile_fail(cx, input, "Cannot open file");
         return 1;
     }
     
@@ -3435,10 +11970,511 @@ int main(int argc, char** argv) {
     size_t nread = fread(source, 1, size, f);
     source[nread] = 0;
     fclose(f);
+
+    if (output) {
+        cx->out_file = fopen(output, "w");
+        if (!cx->out_file) {
+            compile_fail(cx, output, "Cannot open output file");
+            free(source);
+            return 1;
+        }
+    }
     
-    current_file_hash = file_hash(argv[1]);
-    compile_rust(source);
+    /* NAME.rmeta beside NAME.s (or NAME.rs when writing to stdout) */
+    if (cx->opts.emit_metadata) {
+        const char* base = output ? output : input;
+        const char* dot = strrchr(base, '.');
+        int n = (int)(dot && !strchr(dot, '/') ? dot - base : (int)strlen(base));
+        snprintf(cx->meta_path, sizeof(cx->meta_path), "%.*s.rmeta", n, base);
+    }
+    cx->current_file_hash = file_hash(input);
+    cx->out_hold = cx->opts.opt_level >= 1 || cx->opts.emit_ir;
+    double start = pass_clock();
+    compile_rust(cx, source);
+    pass_time(cx, "codegen", start);
     free(source);
-    
+    if (cx->out_hold) pipeline_run(cx);
+
+    int failed = 0;
+    double flushed = pass_clock();
+    emit_flush(cx);
+    if (cx->out_file) {
+        failed = ferror(cx->out_file);
+        if (fclose(cx->out_file) != 0 || failed) {
+            compile_fail(cx, output, "Cannot write output file");
+            failed = 1;
+        }
+        cx->out_file = NULL;
+        if (cx->error_count) remove(output);
+    } else {
+        fflush(stdout);
+    }
+    if (cx->error_count) failed = 1;
+    pass_time(cx, "write", flushed);
+    pass_time(cx, "total", total);
+
+    if (cx->opts.symtab_stats) {
+        fprintf(stderr, "symtab: %d symbols, %ld lookups, %ld probes (%.2f probes/lookup)\n",
+                cx->sym_count, cx->sym_lookups, cx->sym_probes,
+                cx->sym_lookups ? (double)cx->sym_probes / cx->sym_lookups : 0.0);
+        fprintf(stderr, "arena: %lu KB\n", (unsigned long)(cx->arena_bytes / 1024));
+    }
+    compiler_reset(cx);
+    return failed;
+}
+
+/* One line of a --batch list */
+typedef struct {
+    char input[2048];
+    char output[2048];
+} BatchEntry;
+
+/* State shared by the -j workers; next and the report lines are
+ * guarded by lock */
+typedef struct {
+    BatchEntry* entries;
+    int count;
+    int next;
+    int ok;
+    int failed;
+    CompileOptions opts;
+    pthread_mutex_t lock;
+} BatchQueue;
+
+/* Worker: claim the next unclaimed file until the list is used up.
+ * Each worker owns a context, so nothing else is shared. */
+static void* batch_worker(void* arg) {
+    BatchQueue* q = arg;
+    CompilerContext* cx = compiler_context_new();
+    cx->opts = q->opts;
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        int i = q->next < q->count ? q->next++ : -1;
+        pthread_mutex_unlock(&q->lock);
+        if (i < 0) break;
+
+        BatchEntry* e = &q->entries[i];
+        int result = compile_file(cx, e->input, e->output);
+        pthread_mutex_lock(&q->lock);
+        if (result == 0) {
+            printf("ok %s -> %s\n", e->input, e->output);
+            q->ok++;
+        } else {
+            printf("FAILED %s\n", e->input);
+            q->failed++;
+        }
+        fflush(stdout);
+        pthread_mutex_unlock(&q->lock);
+    }
+    compiler_context_free(cx);
+    return NULL;
+}
+
+/* --batch LIST: one "input.rs [output.s]" per line ('-' reads the list
+ * from stdin; blank lines and # comments are skipped). The output
+ * defaults to the input with .rs replaced by .s. Files are compiled by
+ * up to jobs threads; an ok/FAILED line is printed per file as it
+ * finishes (in list order when jobs is 1). Returns the number of
+ * failures. */
+int compile_batch(const char* list, const CompileOptions* o, int jobs) {
+    FILE* lf = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    char line[4096];
+    BatchQueue q;
+    int capacity = 0, t;
+
+    if (!lf) {
+        fprintf(stderr, "%s: ", list);
+        perror("Cannot open batch list");
+        return 1;
+    }
+    memset(&q, 0, sizeof(q));
+    q.opts = *o;
+    while (fgets(line, sizeof(line), lf)) {
+        if (q.count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            q.entries = realloc(q.entries, capacity * sizeof(BatchEntry));
+            if (!q.entries) {
+                fprintf(stderr, "rustc_ppc: out of memory\n");
+                exit(1);
+            }
+        }
+        BatchEntry* e = &q.entries[q.count];
+        int fields = sscanf(line, "%2047s %2047s", e->input, e->output);
+        if (fields < 1 || e->input[0] == '#') continue;
+        if (fields < 2) {
+            size_t n = strlen(e->input);
+            snprintf(e->output, sizeof(e->output), "%.*s.s",
+                     (int)(n > 3 && strcmp(e->input + n - 3, ".rs") == 0 ? n - 3 : n), e->input);
+        }
+        q.count++;
+    }
+    if (lf != stdin) fclose(lf);
+
+    if (jobs > q.count) jobs = q.count;
+    pthread_mutex_init(&q.lock, NULL);
+    if (jobs <= 1) {
+        batch_worker(&q);
+    } else {
+        pthread_t* workers = malloc(jobs * sizeof(pthread_t));
+        for (t = 0; t < jobs; t++) {
+            if (pthread_create(&workers[t], NULL, batch_worker, &q) != 0) break;
+        }
+        if (t == 0) batch_worker(&q);  /* no threads to be had: do it here */
+        while (t-- > 0) pthread_join(workers[t], NULL);
+        free(workers);
+    }
+    pthread_mutex_destroy(&q.lock);
+    free(q.entries);
+    printf("batch: %d ok, %d failed\n", q.ok, q.failed);
+    return q.failed;
+}
+
+/* Line reader over a socket */
+typedef struct {
+    int fd;
+    int len;
+    char buf[8192];
+} LineReader;
+
+/* Next '\n'-terminated line without the newline; -1 at EOF or if a
+ * line does not fit */
+static int read_line(LineReader* r, char* out, int max) {
+    for (;;) {
+        char* nl = memchr(r->buf, '\n', r->len);
+        if (nl) {
+            int n = (int)(nl - r->buf);
+            if (n >= max) return -1;
+            memcpy(out, r->buf, n);
+            out[n] = '\0';
+            r->len -= n + 1;
+            memmove(r->buf, nl + 1, r->len);
+            return n;
+        }
+        if (r->len == (int)sizeof(r->buf)) return -1;
+        ssize_t got = read(r->fd, r->buf + r->len, sizeof(r->buf) - r->len);
+        if (got <= 0) return -1;
+        r->len += (int)got;
+    }
+}
+
+static int write_all(int fd, const char* buf, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, buf, n);
+        if (w <= 0) return -1;
+        buf += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static int split_tabs(char* line, char** fields, int max) {
+    int n = 0;
+    while (n < max) {
+        fields[n++] = line;
+        line = strchr(line, '\t');
+        if (!line) break;
+        *line++ = '\0';
+    }
+    return n;
+}
+
+static int serve_reply(int fd, const char* status, const char* text) {
+    char buf[1200];
+    int n = snprintf(buf, sizeof(buf), "%s\t%s\n", status, text);
+    if (n >= (int)sizeof(buf)) {
+        n = sizeof(buf) - 1;
+        buf[n - 1] = '\n';
+    }
+    return write_all(fd, buf, n);
+}
+
+/* p as the client sees it from its directory cwd. The daemon never
+ * changes directory itself: its workers serve several clients at once. */
+static const char* serve_path(char* buf, size_t size, const char* cwd, const char* p) {
+    if (p[0] == '/') return p;
+    snprintf(buf, size, "%s/%s", cwd, p);
+    return buf;
+}
+
+/* One request line; returns 1 when the daemon should exit */
+static int serve_request(CompilerContext* cx, int fd, char* line) {
+    char* f[64];
+    char input[2048], output[2048], externs[32][2048];
+    int n = split_tabs(line, f, 64);
+    int a, k;
+
+    if (strcmp(f[0], "ping") == 0) {
+        serve_reply(fd, "ok", "pong");
+        return 0;
+    }
+    if (strcmp(f[0], "shutdown") == 0) {
+        serve_reply(fd, "ok", "bye");
+        return 1;
+    }
+    if (strcmp(f[0], "compile") != 0 || n < 4) {
+        serve_reply(fd, "error", "usage: compile<TAB>cwd<TAB>input<TAB>output[<TAB>flag...]");
+        return 0;
+    }
+    if (f[1][0] != '/') {
+        serve_reply(fd, "error", "the working directory must be an absolute path");
+        return 0;
+    }
+
+    /* Flags apply to this request only */
+    CompileOptions saved = cx->opts;
+    for (a = 4; a < n; a++) {
+        int used = apply_option(&cx->opts, f, n, a);
+        if (used < 0) {
+            cx->opts = saved;
+            serve_reply(fd, "error", "invalid option value");
+            return 0;
+        }
+        if (used > 1) a += used - 1;
+    }
+    for (k = saved.extern_count; k < cx->opts.extern_count; k++) {
+        const char* eq = strchr(cx->opts.externs[k], '=');
+        int name_len = (int)(eq - cx->opts.externs[k]);
+        if (eq[1] == '/') continue;
+        snprintf(externs[k], sizeof(externs[k]), "%.*s=%s/%s", name_len, cx->opts.externs[k], f[1], eq + 1);
+        cx->opts.externs[k] = externs[k];
+    }
+    if (compile_file(cx, serve_path(input, sizeof(input), f[1], f[2]),
+                     serve_path(output, sizeof(output), f[1], f[3])) == 0) {
+        serve_reply(fd, "ok", f[3]);
+    } else {
+        serve_reply(fd, "error", cx->error[0] ? cx->error : "compilation failed");
+    }
+    cx->opts = saved;
+    return 0;
+}
+
+#define SERVE_JOBS 4                /* --serve workers without -j */
+
+/* State shared by the --serve workers; done is guarded by lock */
+typedef struct {
+    int sock;
+    int done;
+    CompileOptions opts;
+    pthread_mutex_t lock;
+    pthread_cond_t stopped;
+} ServeState;
+
+/* Worker: take the next connection and answer its requests until the
+ * client hangs up. Each worker owns a context, as batch_worker()'s do,
+ * so an idle client holds up no one else. */
+static void* serve_worker(void* arg) {
+    ServeState* s = arg;
+    CompilerContext* cx = compiler_context_new();
+    int done = 0;
+    cx->opts = s->opts;
+    while (!done) {
+        LineReader r;
+        char line[4096];
+        int conn = accept(s->sock, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        r.fd = conn;
+        r.len = 0;
+        while (!done && read_line(&r, line, sizeof(line)) >= 0) {
+            done = serve_request(cx, conn, line);
+        }
+        close(conn);
+    }
+    compiler_context_free(cx);
+    pthread_mutex_lock(&s->lock);
+    s->done = 1;
+    pthread_cond_signal(&s->stopped);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/* --serve SOCKET: resident compile daemon on a Unix domain socket.
+ * Requests and replies are single lines of tab-separated fields:
+ *   compile CWD INPUT.rs OUTPUT.s [FLAG...]  ->  ok OUTPUT.s | error MESSAGE
+ *   ping                                      ->  ok pong
+ *   shutdown                                  ->  ok bye, then the daemon exits
+ * A connection may carry any number of requests. Up to jobs connections
+ * are served at once, one per worker thread; more wait to be accepted.
+ * Relative paths, --extern ones included, are taken from CWD, which
+ * must be absolute. Every compile starts from the same reset state as a
+ * fresh process, so the output is identical to a one-shot run. shutdown
+ * ends the process, along with whatever the other workers are doing. */
+int compile_serve(const char* path, const CompileOptions* o, int jobs) {
+    struct sockaddr_un addr;
+    ServeState* s;
+    char cwd[2048], socket_file[4096];
+    int sock, t;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return 1;
+    }
+    /* Removed on shutdown by its absolute name: bind() takes the path as
+     * given, and sun_path may not have room for the absolute one */
+    if (path[0] != '/' && getcwd(cwd, sizeof(cwd))) {
+        snprintf(socket_file, sizeof(socket_file), "%s/%s", cwd, path);
+    } else {
+        snprintf(socket_file, sizeof(socket_file), "%s", path);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(path);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(sock, 16) != 0) {
+        fprintf(stderr, "%s: ", path);
+        perror("Cannot listen");
+        close(sock);
+        return 1;
+    }
+    fprintf(stderr, "rustc_ppc: serving on %s\n", path);
+
+    /* Not freed: workers still in accept() or a request hold it until exit */
+    s = calloc(1, sizeof(ServeState));
+    if (!s) {
+        fprintf(stderr, "rustc_ppc: out of memory\n");
+        exit(1);
+    }
+    s->sock = sock;
+    s->opts = *o;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->stopped, NULL);
+    for (t = 0; t < jobs; t++) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, serve_worker, s) != 0) break;
+        pthread_detach(worker);
+    }
+    if (t == 0) {
+        serve_worker(s);  /* no threads to be had: serve one client at a time */
+    } else {
+        pthread_mutex_lock(&s->lock);
+        while (!s->done) pthread_cond_wait(&s->stopped, &s->lock);
+        pthread_mutex_unlock(&s->lock);
+    }
+    close(sock);
+    unlink(socket_file);
     return 0;
-}
\ No newline at end of file
+}
+
+/* --client SOCKET: hand one compile to a running --serve daemon */
+int compile_client(const char* path, const char* input, const char* output,
+                   char** flags, int flag_count) {
+    struct sockaddr_un addr;
+    LineReader r;
+    char cwd[2048], request[8192], reply[4096], default_out[2048];
+    int sock, len, i;
+
+    if (!output) {
+        size_t n = strlen(input);
+        snprintf(default_out, sizeof(default_out), "%.*s.s",
+                 (int)(n > 3 && strcmp(input + n - 3, ".rs") == 0 ? n - 3 : n), input);
+        output = default_out;
+    }
+    if (!getcwd(cwd, sizeof(cwd)) || strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "rustc_ppc: bad working directory or socket path\n");
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "%s: ", path);
+        perror("Cannot connect to compile server");
+        if (sock >= 0) close(sock);
+        return 1;
+    }
+
+    len = snprintf(request, sizeof(request), "compile\t%s\t%s\t%s", cwd, input, output);
+    for (i = 0; i < flag_count && len < (int)sizeof(request); i++) {
+        len += snprintf(request + len, sizeof(request) - len, "\t%s", flags[i]);
+    }
+    if (len >= (int)sizeof(request) - 1) {
+        fprintf(stderr, "rustc_ppc: request too long\n");
+        close(sock);
+        return 1;
+    }
+    request[len++] = '\n';
+
+    r.fd = sock;
+    r.len = 0;
+    if (write_all(sock, request, len) != 0 || read_line(&r, reply, sizeof(reply)) < 0) {
+        fprintf(stderr, "rustc_ppc: compile server closed the connection\n");
+        close(sock);
+        return 1;
+    }
+    close(sock);
+    if (strncmp(reply, "ok\t", 3) == 0) return 0;
+    fprintf(stderr, "%s\n", strncmp(reply, "error\t", 6) == 0 ? reply + 6 : reply);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    const char* input = NULL;
+    const char* output = NULL;
+    const char* batch = NULL;
+    const char* serve = NULL;
+    const char* client = NULL;
+    char* flags[64];
+    int flag_count = 0;
+    int jobs = 0;         /* -j N; 0 = the mode's default */
+    int a;
+    CompileOptions options;
+
+    memset(&options, 0, sizeof(options));
+    for (a = 1; a < argc; a++) {
+        int used = apply_option(&options, argv, argc, a);
+        if (used < 0) return 1;
+        if (used > 0) {
+            /* Remembered so --client can forward them */
+            int k;
+            for (k = 0; k < used && flag_count < 64; k++) flags[flag_count++] = argv[a + k];
+            a += used - 1;
+        } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            output = argv[++a];
+        } else if (strcmp(argv[a], "-j") == 0 && a + 1 < argc) {
+            jobs = atoi(argv[++a]);
+        } else if (strncmp(argv[a], "-j", 2) == 0 && argv[a][2]) {
+            jobs = atoi(argv[a] + 2);
+        } else if (strcmp(argv[a], "--batch") == 0) {
+            batch = (a + 1 < argc) ? argv[++a] : "-";
+        } else if (strcmp(argv[a], "--serve") == 0 && a + 1 < argc) {
+            serve = argv[++a];
+        } else if (strcmp(argv[a], "--client") == 0 && a + 1 < argc) {
+            client = argv[++a];
+        } else if (argv[a][0] != '-' && !input) {
+            input = argv[a];
+        }
+    }
+
+    if (serve) return compile_serve(serve, &options, jobs > 0 ? jobs : SERVE_JOBS);
+    if (batch) return compile_batch(batch, &options, jobs > 0 ? jobs : 1) ? 1 : 0;
+
+    if (!input) {
+        printf("Usage: %s <file.rs> [-o file.s] [-C opt] [-Z symtab-stats|time-passes|match-stats|schedule-stats]\n"
+               "       %s --batch <listfile|-> [-j N] [-C opt]\n"
+               "       %s --serve <socket> [-j N]\n"
+               "       %s --client <socket> <file.rs> [-o file.s] [-C opt]\n"
+               "  -C opt-level=0|1|2|3|s|z  -C target-cpu=750|7400|7450|970\n"
+               "  -C target-feature=+altivec|-altivec  -O (= opt-level=2)  --emit=asm|ir|metadata\n"
+               "  -C inline-threshold=N  -C fp-contract=off|on|fast  --extern NAME=PATH.rmeta\n",
+               argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if (client) return compile_client(client, input, output, flags, flag_count);
+
+    CompilerContext* cx = compiler_context_new();
+    cx->opts = options;
+    int result = compile_file(cx, input, output);
+    compiler_context_free(cx);
+    return result;
+}
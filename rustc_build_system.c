@@ -17,7 +17,10 @@
 #include <string.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 /* ============================================================
  * CONFIGURATION — limits bumped for real-world projects
@@ -41,6 +44,8 @@ typedef struct {
     char linker[256];
     char vendor_dir[MAX_PATH_LEN];
     char rustc_ppc[MAX_PATH_LEN];  /* resolved path to rustc_ppc binary */
+    char server_socket[MAX_PATH_LEN];  /* rustc_ppc --serve socket; "" = spawn --batch */
+    int jobs;               /* rustc_ppc --batch -j; 0 = one per online CPU */
     int use_manifest;       /* 1 = read build_manifest.json */
     int dry_run;            /* 1 = print commands, don't execute */
     int verbose;
@@ -103,6 +108,12 @@ static BuildContext* ctx_new(void) {
     BuildContext* ctx = calloc(1, sizeof(BuildContext));
     ctx->crate_capacity = 256;
     ctx->crates = calloc(ctx->crate_capacity, sizeof(Crate));
+    /* Default config for Tiger on G4; main() applies the options after */
+    strcpy(ctx->config.target, "powerpc-apple-darwin8");
+    strcpy(ctx->config.opt_level, "3");
+    strcpy(ctx->config.cpu, "7450");
+    ctx->config.altivec = 1;
+    ctx->config.debug_info = 0;
     return ctx;
 }
 
@@ -497,6 +508,139 @@ void resolve_build_order(BuildContext* ctx, int* order) {
  * COMPILATION
  * ============================================================ */
 
+/* Output paths for one source file: crate_out/<name>.s and .o */
+static void crate_object_paths(const char* crate_out, const char* src,
+                               char* asm_path, char* obj_path) {
+    const char* basename = strrchr(src, '/');
+    basename = basename ? basename + 1 : src;
+    char* dot;
+
+    snprintf(asm_path, MAX_PATH_LEN, "%s/%s", crate_out, basename);
+    /* Replace .rs extension */
+    dot = strrchr(asm_path, '.');
+    if (dot) strcpy(dot, ".s");
+
+    if (obj_path) {
+        snprintf(obj_path, MAX_PATH_LEN, "%s/%s", crate_out, basename);
+        dot = strrchr(obj_path, '.');
+        if (dot) strcpy(dot, ".o");
+    }
+}
+
+/* Cross-crate inlining flags, each word preceded by sep: library crates
+ * leave metadata for their #[inline] functions (--emit=asm,metadata),
+ * and every dependency that left some is passed as --extern */
+static void crate_inline_flags(BuildContext* ctx, Crate* crate, char* buf, size_t size, char sep) {
+    size_t len = 0;
+    buf[0] = '\0';
+    if (crate->is_lib)
+        len += snprintf(buf, size, "%c--emit=asm,metadata", sep);
+    for (int i = 0; i < crate->dep_count && len < size; i++) {
+        char path[MAX_PATH_LEN];
+        char name[MAX_NAME_LEN];
+        snprintf(path, sizeof(path), "%s/lib/lib%s.rmeta", ctx->output_dir, crate->dependencies[i]);
+        if (access(path, R_OK) != 0) continue;
+        /* Source paths spell the crate with '_' where Cargo has '-' */
+        snprintf(name, sizeof(name), "%s", crate->dependencies[i]);
+        for (char* ch = name; *ch; ch++)
+            if (*ch == '-') *ch = '_';
+        len += snprintf(buf + len, size - len, "%c--extern%c%s=%s", sep, sep, name, path);
+    }
+    if (len >= size) buf[0] = '\0';   /* too many to pass: go without */
+}
+
+/* Collect the per-file metadata rustc_ppc wrote next to each .s into
+ * lib/lib<crate>.rmeta for the crates that depend on this one */
+static void merge_crate_metadata(BuildContext* ctx, Crate* crate, const char* crate_out, const int* failed) {
+    char path[MAX_PATH_LEN];
+    char line[MAX_LINE_LEN];
+    snprintf(path, sizeof(path), "%s/lib/lib%s.rmeta", ctx->output_dir, crate->name);
+    FILE* out = fopen(path, "w");
+    if (!out) return;
+    fputs("rustc_ppc metadata 1\n", out);
+    for (int i = 0; i < crate->source_count; i++) {
+        char meta_path[MAX_PATH_LEN];
+        if (failed[i]) continue;
+        crate_object_paths(crate_out, crate->source_files[i], meta_path, NULL);
+        char* dot = strrchr(meta_path, '.');
+        if (dot) snprintf(dot, meta_path + sizeof(meta_path) - dot, ".rmeta");
+        FILE* in = fopen(meta_path, "r");
+        if (!in) continue;
+        /* every file opens with the header: keep only the first */
+        if (fgets(line, sizeof(line), in)) {
+            while (fgets(line, sizeof(line), in)) fputs(line, out);
+        }
+        fclose(in);
+    }
+    fclose(out);
+}
+
+/* Send each source file of the crate to a running `rustc_ppc --serve`
+ * daemon, one request/reply line at a time over a single connection.
+ * Returns -1 if the daemon can't be reached so the caller falls back to
+ * --batch. */
+static int compile_via_server(BuildContext* ctx, Crate* crate,
+                              const char* crate_out, int* failed) {
+    char inline_flags[MAX_LINE_LEN / 2];
+    struct sockaddr_un addr;
+    char cwd[MAX_PATH_LEN];
+    int sock;
+
+    if (strlen(ctx->config.server_socket) >= sizeof(addr.sun_path) ||
+        !getcwd(cwd, sizeof(cwd)))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, ctx->config.server_socket);
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+
+    FILE* to = fdopen(sock, "w");
+    FILE* from = fdopen(dup(sock), "r");
+    if (!to || !from) {
+        if (to) fclose(to); else close(sock);
+        if (from) fclose(from);
+        return -1;
+    }
+
+    if (ctx->config.verbose)
+        printf(";   $ (server %s) %d files\n", ctx->config.server_socket, crate->source_count);
+    crate_inline_flags(ctx, crate, inline_flags, sizeof(inline_flags), '\t');
+
+    for (int i = 0; i < crate->source_count; i++) {
+        char asm_path[MAX_PATH_LEN];
+        char reply[MAX_LINE_LEN];
+        crate_object_paths(crate_out, crate->source_files[i], asm_path, NULL);
+
+        /* the same flags the --batch command line carries */
+        fprintf(to, "compile\t%s\t%s\t%s\t-C\ttarget-cpu=%s\t-C\topt-level=%s%s%s%s\n",
+                cwd, crate->source_files[i], asm_path,
+                ctx->config.cpu, ctx->config.opt_level,
+                ctx->config.altivec ? "\t-C\ttarget-feature=+altivec" : "",
+                ctx->config.debug_info ? "\t-g" : "",
+                inline_flags);
+        fflush(to);
+        if (!fgets(reply, sizeof(reply), from)) {
+            /* Server went away mid-crate: count the rest as failed */
+            for (; i < crate->source_count; i++) failed[i] = 1;
+            fprintf(stderr, "Error: compile server closed the connection\n");
+            break;
+        }
+        if (strncmp(reply, "ok\t", 3) != 0) {
+            failed[i] = 1;
+            fprintf(stderr, "Error: Compilation failed for %s: %s",
+                    crate->source_files[i], strncmp(reply, "error\t", 6) == 0 ? reply + 6 : reply);
+        }
+    }
+    fclose(to);
+    fclose(from);
+    return 0;
+}
+
 void compile_crate(BuildContext* ctx, Crate* crate) {
     if (crate->skip) {
         if (ctx->config.verbose)
@@ -521,55 +665,92 @@ void compile_crate(BuildContext* ctx, Crate* crate) {
     snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p %s", crate_out);
     if (!ctx->config.dry_run) system(mkdir_cmd);
 
+    /* Compile: .rs → .s — through the compile server when one is
+     * running, otherwise one rustc_ppc --batch run for the whole crate
+     * instead of a process per file */
+    char list_path[MAX_PATH_LEN];
+    snprintf(list_path, sizeof(list_path), "%s/rustc_batch.list", crate_out);
+
+    int* failed = calloc(crate->source_count, sizeof(int));
+    int via_server = 0;
+    if (ctx->config.server_socket[0] && !ctx->config.dry_run)
+        via_server = compile_via_server(ctx, crate, crate_out, failed) == 0;
+
+    FILE* list = (ctx->config.dry_run || via_server) ? NULL : fopen(list_path, "w");
+    if (!ctx->config.dry_run && !via_server && !list) {
+        fprintf(stderr, "Error: Cannot write %s\n", list_path);
+        free(failed);
+        return;
+    }
     for (int i = 0; i < crate->source_count; i++) {
-        char* src = crate->source_files[i];
-
-        /* Derive object file name from source path */
-        const char* basename = strrchr(src, '/');
-        basename = basename ? basename + 1 : src;
-
-        char obj_name[256];
-        strncpy(obj_name, basename, sizeof(obj_name)-1);
-        /* Replace .rs with .o */
-        char* dot = strrchr(obj_name, '.');
-        if (dot) strcpy(dot, ".o");
-
         char asm_path[MAX_PATH_LEN];
-        char obj_path[MAX_PATH_LEN];
-        snprintf(asm_path, sizeof(asm_path), "%s/%s", crate_out, basename);
-        /* Replace .rs extension */
-        dot = strrchr(asm_path, '.');
-        if (dot) strcpy(dot, ".s");
-
-        snprintf(obj_path, sizeof(obj_path), "%s/%s", crate_out, obj_name);
-
-        /* Compile: .rs → .s */
-        char cmd[2048];
-        /* rustc_ppc outputs assembly to stdout, redirect to file */
-        snprintf(cmd, sizeof(cmd),
-                "%s %s "
-                "-C target-cpu=%s "
-                "-C opt-level=%s "
-                "%s %s > %s",
-                ctx->config.rustc_ppc, src,
-                ctx->config.cpu,
-                ctx->config.opt_level,
-                ctx->config.altivec ? "-C target-feature=+altivec" : "",
-                ctx->config.debug_info ? "-g" : "",
-                asm_path);
-
-        if (ctx->config.verbose || ctx->config.dry_run)
-            printf(";   $ %s\n", cmd);
+        crate_object_paths(crate_out, crate->source_files[i], asm_path, NULL);
+        if (list) fprintf(list, "%s %s\n", crate->source_files[i], asm_path);
+    }
+    if (list) fclose(list);
+
+    char inline_flags[MAX_LINE_LEN];
+    crate_inline_flags(ctx, crate, inline_flags, sizeof(inline_flags), ' ');
+
+    char cmd[2048 + MAX_LINE_LEN];
+    snprintf(cmd, sizeof(cmd),
+            "%s --batch %s -j %d "
+            "-C target-cpu=%s "
+            "-C opt-level=%s "
+            "%s %s%s",
+            ctx->config.rustc_ppc, list_path, ctx->config.jobs,
+            ctx->config.cpu,
+            ctx->config.opt_level,
+            ctx->config.altivec ? "-C target-feature=+altivec" : "",
+            ctx->config.debug_info ? "-g" : "",
+            inline_flags);
+
+    if (!via_server && (ctx->config.verbose || ctx->config.dry_run))
+        printf(";   $ %s\n", cmd);
 
-        if (!ctx->config.dry_run) {
-            int ret = system(cmd);
-            if (ret != 0) {
-                fprintf(stderr, "Error: Compilation failed for %s\n", src);
-                continue;
+    if (!ctx->config.dry_run && !via_server) {
+        /* rustc_ppc reports "ok SRC -> ASM" / "FAILED SRC" per file and
+         * ends with "batch: N ok, M failed"; it exits 1 when any file
+         * failed. A file has failed until its ok line arrives, and a run
+         * that dies or stops short of the summary fails them all. */
+        FILE* batch = popen(cmd, "r");
+        char line[MAX_LINE_LEN];
+        int status, summary = 0;
+        if (!batch) {
+            fprintf(stderr, "Error: Cannot run %s\n", ctx->config.rustc_ppc);
+            free(failed);
+            return;
+        }
+        for (int i = 0; i < crate->source_count; i++) failed[i] = 1;
+        while (fgets(line, sizeof(line), batch)) {
+            char* arrow;
+            if (strncmp(line, "batch: ", 7) == 0) summary = 1;
+            if (strncmp(line, "ok ", 3) != 0 || !(arrow = strstr(line + 3, " -> "))) continue;
+            *arrow = '\0';
+            for (int i = 0; i < crate->source_count; i++) {
+                if (strcmp(line + 3, crate->source_files[i]) == 0) failed[i] = 0;
             }
         }
+        status = pclose(batch);
+        if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) > 1 || !summary) {
+            if (status != -1 && WIFSIGNALED(status))
+                fprintf(stderr, "Error: %s killed by signal %d\n", ctx->config.rustc_ppc, WTERMSIG(status));
+            else
+                fprintf(stderr, "Error: %s --batch did not finish\n", ctx->config.rustc_ppc);
+            for (int i = 0; i < crate->source_count; i++) failed[i] = 1;
+        }
+        for (int i = 0; i < crate->source_count; i++) {
+            if (failed[i]) fprintf(stderr, "Error: Compilation failed for %s\n", crate->source_files[i]);
+        }
+    }
+
+    /* Assemble: .s → .o */
+    for (int i = 0; i < crate->source_count; i++) {
+        char asm_path[MAX_PATH_LEN];
+        char obj_path[MAX_PATH_LEN];
+        if (failed[i]) continue;
+        crate_object_paths(crate_out, crate->source_files[i], asm_path, obj_path);
 
-        /* Assemble: .s → .o */
         snprintf(cmd, sizeof(cmd), "as -o %s %s", obj_path, asm_path);
         if (ctx->config.verbose || ctx->config.dry_run)
             printf(";   $ %s\n", cmd);
@@ -586,6 +767,7 @@ void compile_crate(BuildContext* ctx, Crate* crate) {
         snprintf(libdir, sizeof(libdir), "%s/lib", ctx->output_dir);
         snprintf(mkdir_cmd, sizeof(mkdir_cmd), "mkdir -p %s", libdir);
         if (!ctx->config.dry_run) system(mkdir_cmd);
+        if (!ctx->config.dry_run) merge_crate_metadata(ctx, crate, crate_out, failed);
 
         char ar_cmd[4096];
         int len = snprintf(ar_cmd, sizeof(ar_cmd), "ar rcs %s", archive);
@@ -607,6 +789,7 @@ void compile_crate(BuildContext* ctx, Crate* crate) {
             printf(";   $ %s\n", ar_cmd);
         if (!ctx->config.dry_run) system(ar_cmd);
     }
+    free(failed);
 }
 
 void link_binary(BuildContext* ctx, Crate* crate) {
@@ -681,15 +864,17 @@ void link_binary(BuildContext* ctx, Crate* crate) {
 void build_project(BuildContext* ctx, const char* project_dir) {
     strncpy(ctx->project_dir, project_dir, MAX_PATH_LEN-1);
 
-    /* Default config for Tiger on G4 */
-    strcpy(ctx->config.target, "powerpc-apple-darwin8");
-    strcpy(ctx->config.opt_level, "3");
-    strcpy(ctx->config.cpu, "7450");
-    ctx->config.altivec = 1;
-    ctx->config.debug_info = 0;
     /* If rustc_ppc path not set by main(), default to ./rustc_ppc */
     if (!ctx->config.rustc_ppc[0])
         strcpy(ctx->config.rustc_ppc, "./rustc_ppc");
+    /* Keep both CPUs of a dual G4 / G5 busy */
+    if (ctx->config.jobs <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        ctx->config.jobs = ncpu > 0 ? (int)ncpu : 1;
+    }
+    /* A resident compile server, if one was started (cargo_ppc serve) */
+    if (!ctx->config.server_socket[0] && getenv("RUSTC_PPC_SERVER"))
+        strncpy(ctx->config.server_socket, getenv("RUSTC_PPC_SERVER"), MAX_PATH_LEN-1);
     snprintf(ctx->output_dir, sizeof(ctx->output_dir),
              "%s/target/powerpc-apple-darwin8/release", project_dir);
 
@@ -965,6 +1150,8 @@ int main(int argc, char** argv) {
         printf("  %s build [path] --dry-run    Show commands without executing\n", argv[0]);
         printf("  %s build [path] --vendor=DIR Use specific vendor directory\n", argv[0]);
         printf("  %s build [path] --cpu=970    Target G5 instead of G4\n", argv[0]);
+        printf("  %s build [path] --jobs=N     Compile N files at once (default: CPUs)\n", argv[0]);
+        printf("  %s build [path] --server=SOCK Compile through a running rustc_ppc --serve\n", argv[0]);
         printf("  %s build [path] --verbose    Verbose output\n", argv[0]);
         printf("  %s toolchain                 Show toolchain info\n", argv[0]);
         printf("  %s makefile [name]           Generate Makefile\n", argv[0]);
@@ -1000,6 +1187,12 @@ int main(int argc, char** argv) {
             else if (strncmp(argv[i], "--vendor=", 9) == 0) {
                 strncpy(ctx->config.vendor_dir, argv[i] + 9, MAX_PATH_LEN-1);
             }
+            else if (strncmp(argv[i], "--server=", 9) == 0) {
+                strncpy(ctx->config.server_socket, argv[i] + 9, MAX_PATH_LEN-1);
+            }
+            else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+                ctx->config.jobs = atoi(argv[i] + 7);
+            }
             else if (strncmp(argv[i], "--cpu=", 6) == 0) {
                 strncpy(ctx->config.cpu, argv[i] + 6, 31);
             }
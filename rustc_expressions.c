@@ -421,7 +421,8 @@ Expr* parse_primary() {
     if (isdigit(*pos) || (*pos == '-' && isdigit(*(pos+1)))) {
         return parse_number();
     }
-    if (isalpha(*pos) || *pos == '_') {
+    if ((isalpha(*pos) || *pos == '_') &&
+        strncmp(pos, "if ", 3) != 0 && strncmp(pos, "match ", 6) != 0) {
         return parse_ident_or_call();
     }
 
@@ -747,6 +748,46 @@ void free_reg(int reg) {
 
 void emit_expr(Expr* e);
 
+/* dest = (left op right) as 0 or 1 without mfcr, which serializes on
+ * the G4 and is microcoded on the G5. Equality goes through cntlzw or
+ * the carry of x - 1; orderings flip the sign bits so the carry of an
+ * unsigned subtract answers the signed question. */
+static void emit_compare_value(BinaryOp op, int dest, int left, int right) {
+    int t;
+    switch (op) {
+        case OP_EQ:
+            printf("    subf r0, r%d, r%d\n", right, left);
+            printf("    cntlzw r0, r0\n");
+            printf("    srwi r%d, r0, 5\n", dest);
+            return;
+        case OP_NE:
+            printf("    subf r0, r%d, r%d\n", right, left);
+            printf("    addic r%d, r0, -1\n", dest);
+            printf("    subfe r%d, r%d, r0\n", dest, dest);
+            return;
+        case OP_GT:
+        case OP_LE:
+            t = left;       /* a > b is b < a, a <= b is b >= a */
+            left = right;
+            right = t;
+            op = op == OP_GT ? OP_LT : OP_GE;
+            break;
+        default:
+            break;
+    }
+    /* CA = left >= right once both are biased by 0x80000000 */
+    printf("    xoris r0, r%d, 0x8000\n", left);
+    printf("    xoris r%d, r%d, 0x8000\n", dest, right);
+    printf("    subfc r0, r%d, r0\n", dest);
+    if (op == OP_LT) {
+        printf("    subfe r%d, r%d, r%d\n", dest, dest, dest);
+        printf("    neg r%d, r%d\n", dest, dest);
+    } else {
+        printf("    li r%d, 0\n", dest);
+        printf("    addze r%d, r%d\n", dest, dest);
+    }
+}
+
 void emit_binop(BinaryOp op, int dest, int left, int right) {
     switch (op) {
         case OP_ADD:
@@ -767,18 +808,11 @@ void emit_binop(BinaryOp op, int dest, int left, int right) {
             printf("    sub r%d, r%d, r0\n", dest, left);
             break;
         case OP_AND:
+            /* bools are 0 or 1; emit_expr short-circuits impure right sides */
             printf("    and r%d, r%d, r%d\n", dest, left, right);
-            printf("    cmpwi r%d, 0\n", dest);
-            printf("    mfcr r%d\n", dest);
-            printf("    rlwinm r%d, r%d, 3, 31, 31\n", dest, dest);
-            printf("    xori r%d, r%d, 1\n", dest, dest);
             break;
         case OP_OR:
             printf("    or r%d, r%d, r%d\n", dest, left, right);
-            printf("    cmpwi r%d, 0\n", dest);
-            printf("    mfcr r%d\n", dest);
-            printf("    rlwinm r%d, r%d, 3, 31, 31\n", dest, dest);
-            printf("    xori r%d, r%d, 1\n", dest, dest);
             break;
         case OP_BITAND:
             printf("    and r%d, r%d, r%d\n", dest, left, right);
@@ -796,43 +830,286 @@ void emit_binop(BinaryOp op, int dest, int left, int right) {
             printf("    srw r%d, r%d, r%d\n", dest, left, right);
             break;
         case OP_EQ:
-            printf("    cmpw r%d, r%d\n", left, right);
-            printf("    mfcr r%d\n", dest);
-            printf("    rlwinm r%d, r%d, 3, 31, 31\n", dest, dest);
-            break;
         case OP_NE:
-            printf("    cmpw r%d, r%d\n", left, right);
-            printf("    mfcr r%d\n", dest);
-            printf("    rlwinm r%d, r%d, 3, 31, 31\n", dest, dest);
-            printf("    xori r%d, r%d, 1\n", dest, dest);
-            break;
         case OP_LT:
-            printf("    cmpw r%d, r%d\n", left, right);
-            printf("    mfcr r%d\n", dest);
-            printf("    rlwinm r%d, r%d, 1, 31, 31\n", dest, dest);
-            break;
         case OP_LE:
-            printf("    cmpw r%d, r%d\n", left, right);
-            printf("    cror 2, 0, 2\n");  /* LT or EQ */
-            printf("    mfcr r%d\n", dest);
-            printf("    rlwinm r%d, r%d, 3, 31, 31\n", dest, dest);
-            break;
         case OP_GT:
-            printf("    cmpw r%d, r%d\n", left, right);
-            printf("    mfcr r%d\n", dest);
-            printf("    rlwinm r%d, r%d, 2, 31, 31\n", dest, dest);
-            break;
         case OP_GE:
-            printf("    cmpw r%d, r%d\n", left, right);
-            printf("    cror 2, 1, 2\n");  /* GT or EQ */
-            printf("    mfcr r%d\n", dest);
-            printf("    rlwinm r%d, r%d, 3, 31, 31\n", dest, dest);
+            emit_compare_value(op, dest, left, right);
             break;
         default:
             printf("    ; TODO: binop %d\n", op);
     }
 }
 
+/* Magic multiplier and shift for signed division by d, 2 <= |d| < 2^31
+ * (Hacker's Delight 10-1) */
+static void magic_signed(int d, int* m, int* s) {
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d < 0 ? 0u - (unsigned)d : (unsigned)d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad, delta;
+    int p = 31;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    *m = (int)(q2 + 1);
+    if (d < 0) *m = -*m;
+    *s = p - 32;
+}
+
+static int exact_log2(unsigned v) {
+    int k = 0;
+    if (v == 0 || (v & (v - 1))) return -1;
+    while (v >>= 1) k++;
+    return k;
+}
+
+static void emit_load_imm(int reg, int value) {
+    if (value >= -32768 && value <= 32767) {
+        printf("    li r%d, %d\n", reg, value);
+    } else {
+        printf("    lis r%d, 0x%X\n", reg, ((unsigned)value >> 16) & 0xFFFF);
+        if (value & 0xFFFF) printf("    ori r%d, r%d, 0x%X\n", reg, reg, (unsigned)value & 0xFFFF);
+    }
+}
+
+/* reg *= c using shifts where one or two ops beat mullw */
+static void emit_mul_imm(int reg, int tmp, int c) {
+    unsigned ac = c < 0 ? 0u - (unsigned)c : (unsigned)c;
+    int k = exact_log2(ac);
+    if (c == 0) {
+        printf("    li r%d, 0\n", reg);
+    } else if (k >= 0) {
+        if (k > 0) printf("    slwi r%d, r%d, %d\n", reg, reg, k);
+        if (c < 0) printf("    neg r%d, r%d\n", reg, reg);
+    } else if (c > 0 && (k = exact_log2(ac - 1)) >= 0) {
+        printf("    slwi r%d, r%d, %d\n", tmp, reg, k);
+        printf("    add r%d, r%d, r%d\n", reg, reg, tmp);
+    } else if (c > 0 && (k = exact_log2(ac + 1)) >= 0) {
+        printf("    slwi r%d, r%d, %d\n", tmp, reg, k);
+        printf("    sub r%d, r%d, r%d\n", reg, tmp, reg);
+    } else if (c >= -32768 && c <= 32767) {
+        printf("    mulli r%d, r%d, %d\n", reg, reg, c);
+    } else {
+        emit_load_imm(tmp, c);
+        printf("    mullw r%d, r%d, r%d\n", reg, reg, tmp);
+    }
+}
+
+/* dst = src / c (signed, c != 0) without divw; tmp is scratch */
+static void emit_div_imm(int dst, int src, int tmp, int c) {
+    int k = exact_log2(c < 0 ? 0u - (unsigned)c : (unsigned)c);
+    int m, s;
+    if (c == 1 || c == -1) {
+        if (c < 0) printf("    neg r%d, r%d\n", dst, src);
+        else if (dst != src) printf("    mr r%d, r%d\n", dst, src);
+    } else if (k >= 0) {
+        /* round toward zero: bias negative dividends by 2^k - 1 */
+        if (k > 1) printf("    srawi r%d, r%d, 31\n", tmp, src);
+        printf("    srwi r%d, r%d, %d\n", tmp, k > 1 ? tmp : src, 32 - k);
+        printf("    add r%d, r%d, r%d\n", tmp, src, tmp);
+        printf("    srawi r%d, r%d, %d\n", dst, tmp, k);
+        if (c < 0) printf("    neg r%d, r%d\n", dst, dst);
+    } else {
+        magic_signed(c, &m, &s);
+        emit_load_imm(tmp, m);
+        printf("    mulhw r%d, r%d, r%d\n", tmp, src, tmp);
+        if (c > 0 && m < 0) printf("    add r%d, r%d, r%d\n", tmp, tmp, src);
+        if (c < 0 && m > 0) printf("    sub r%d, r%d, r%d\n", tmp, tmp, src);
+        if (s > 0) printf("    srawi r%d, r%d, %d\n", tmp, tmp, s);
+        printf("    srwi r0, r%d, 31\n", tmp);
+        printf("    add r%d, r%d, r0\n", dst, tmp);
+    }
+}
+
+/* dest = left op value for * / % by a constant: shifts and multiply-high
+ * instead of the 20+ cycle divw. Returns 0 if the register form is needed. */
+int emit_binop_imm(BinaryOp op, int dest, int left, long long value) {
+    int c = (int)value;
+    int tmp, quot;
+    if (value != c || (op != OP_MUL && op != OP_DIV && op != OP_MOD)) return 0;
+    if (c == 0 && op != OP_MUL) return 0;
+    if (dest != left) printf("    mr r%d, r%d\n", dest, left);
+    tmp = alloc_reg();
+    if (op == OP_MUL) {
+        emit_mul_imm(dest, tmp, c);
+    } else if (op == OP_DIV) {
+        emit_div_imm(dest, dest, tmp, c);
+    } else if (c == 1 || c == -1) {
+        printf("    li r%d, 0\n", dest);
+    } else {
+        /* n % c = n - (n / c) * c; the sign follows n, so c's is irrelevant */
+        if (c < 0 && c != (int)0x80000000u) c = -c;
+        quot = alloc_reg();
+        emit_div_imm(quot, dest, tmp, c);
+        emit_mul_imm(quot, tmp, c);
+        printf("    sub r%d, r%d, r%d\n", dest, dest, quot);
+        free_reg(quot);
+    }
+    free_reg(tmp);
+    return 1;
+}
+
+/* ------------------------------------------------------------
+ * Conditions. An if branches straight on the CR field its compare
+ * sets, && and || short-circuit through branches, and a run of
+ * side-effect-free compares in one chain is issued into separate CR
+ * fields before the first branch so the compares overlap. Only the
+ * volatile fields cr0, cr1 and cr5-cr7 are used.
+ * ------------------------------------------------------------ */
+
+#define COND_FIELDS 5
+#define COND_CHAIN_MAX 16
+
+static const int cond_fields[COND_FIELDS] = { 0, 1, 5, 6, 7 };
+static int cond_label_counter = 0;
+
+static int is_compare_op(BinaryOp op) {
+    return op >= OP_EQ && op <= OP_GE;
+}
+
+/* Branch mnemonic suffix taken when op holds (or fails, with negate) */
+static const char* cond_suffix(BinaryOp op, int negate) {
+    switch (op) {
+        case OP_EQ: return negate ? "ne" : "eq";
+        case OP_NE: return negate ? "eq" : "ne";
+        case OP_LT: return negate ? "ge" : "lt";
+        case OP_LE: return negate ? "gt" : "le";
+        case OP_GT: return negate ? "le" : "gt";
+        default:    return negate ? "lt" : "ge";
+    }
+}
+
+/* No calls, no loads through pointers: safe to evaluate early */
+static int expr_is_pure(Expr* e) {
+    switch (e->kind) {
+        case EXPR_LITERAL_INT:
+        case EXPR_LITERAL_BOOL:
+        case EXPR_IDENT:
+            return 1;
+        case EXPR_BINARY:
+            return expr_is_pure(e->data.binary.left) && expr_is_pure(e->data.binary.right);
+        case EXPR_UNARY:
+            return e->data.unary.op != UOP_DEREF && expr_is_pure(e->data.unary.operand);
+        default:
+            return 0;
+    }
+}
+
+static int is_simple_compare(Expr* e) {
+    return e->kind == EXPR_BINARY && is_compare_op(e->data.binary.op) && expr_is_pure(e);
+}
+
+/* cmpw/cmpwi of a comparison's operands into crf. The operand registers
+ * stay allocated; they go to regs[0..1] (-1 for an immediate). */
+static void emit_compare(Expr* e, int crf, int regs[2]) {
+    Expr* l = e->data.binary.left;
+    Expr* r = e->data.binary.right;
+    char cr[8] = "";
+    if (crf) snprintf(cr, sizeof(cr), "cr%d, ", crf);
+    emit_expr(l);
+    regs[0] = l->temp_reg;
+    regs[1] = -1;
+    if (r->kind == EXPR_LITERAL_INT && r->data.int_val >= -32768 && r->data.int_val <= 32767) {
+        printf("    cmpwi %sr%d, %lld\n", cr, l->temp_reg, r->data.int_val);
+    } else {
+        emit_expr(r);
+        regs[1] = r->temp_reg;
+        printf("    cmpw %sr%d, r%d\n", cr, l->temp_reg, r->temp_reg);
+    }
+}
+
+static void free_compare_regs(int regs[2]) {
+    if (regs[1] >= 0) free_reg(regs[1]);
+    free_reg(regs[0]);
+}
+
+/* Operands of a left-nested chain of one operator, in source order */
+static int flatten_chain(Expr* e, BinaryOp op, Expr** items, int n) {
+    if (e->kind == EXPR_BINARY && e->data.binary.op == op && n < COND_CHAIN_MAX - 1) {
+        n = flatten_chain(e->data.binary.left, op, items, n);
+        items[n++] = e->data.binary.right;
+        return n;
+    }
+    items[n++] = e;
+    return n;
+}
+
+void emit_cond_branch(Expr* e, const char* target, int when);
+
+/* && / ||: every operand but the last branches out as soon as it
+ * settles the chain (false for &&, true for ||) */
+static void emit_cond_chain(Expr* e, const char* target, int when) {
+    Expr* items[COND_CHAIN_MAX];
+    int regs[COND_FIELDS][2];
+    int settles = e->data.binary.op == OP_OR;
+    int n = flatten_chain(e, e->data.binary.op, items, 0);
+    int skip_used = 0, i, j, k;
+    char skip[32];
+
+    snprintf(skip, sizeof(skip), "Lcond_%d", cond_label_counter++);
+    for (i = 0; i < n; i = k) {
+        k = i;
+        while (k < n && k - i < COND_FIELDS && is_simple_compare(items[k])) k++;
+        if (k - i < 2) {
+            const char* t = (i == n - 1 || when == settles) ? target : skip;
+            skip_used |= t == skip;
+            emit_cond_branch(items[i], t, i == n - 1 ? when : settles);
+            k = i + 1;
+            continue;
+        }
+        /* all compares of the run first, then its branches */
+        for (j = i; j < k; j++) emit_compare(items[j], cond_fields[j - i], regs[j - i]);
+        for (j = k - 1; j >= i; j--) free_compare_regs(regs[j - i]);
+        for (j = i; j < k; j++) {
+            const char* t = (j == n - 1 || when == settles) ? target : skip;
+            int w = j == n - 1 ? when : settles;
+            char cr[8] = "";
+            if (j > i) snprintf(cr, sizeof(cr), "cr%d, ", cond_fields[j - i]);
+            skip_used |= t == skip;
+            printf("    b%s %s%s\n", cond_suffix(items[j]->data.binary.op, !w), cr, t);
+        }
+    }
+    if (skip_used) printf("%s:\n", skip);
+}
+
+/* Branch to target when e evaluates to when (0 or 1) */
+void emit_cond_branch(Expr* e, const char* target, int when) {
+    int regs[2];
+    if (e->kind == EXPR_UNARY && e->data.unary.op == UOP_NOT) {
+        emit_cond_branch(e->data.unary.operand, target, !when);
+    } else if (e->kind == EXPR_LITERAL_BOOL) {
+        if (e->data.bool_val == when) printf("    b %s\n", target);
+    } else if (e->kind == EXPR_BINARY && (e->data.binary.op == OP_AND || e->data.binary.op == OP_OR)) {
+        emit_cond_chain(e, target, when);
+    } else if (e->kind == EXPR_BINARY && is_compare_op(e->data.binary.op)) {
+        emit_compare(e, 0, regs);
+        free_compare_regs(regs);
+        printf("    b%s %s\n", cond_suffix(e->data.binary.op, !when), target);
+    } else {
+        emit_expr(e);
+        printf("    cmpwi r%d, 0\n", e->temp_reg);
+        free_reg(e->temp_reg);
+        printf("    %s %s\n", when ? "bne" : "beq", target);
+    }
+}
+
 void emit_expr(Expr* e) {
     if (!e) return;
 
@@ -860,9 +1137,26 @@ void emit_expr(Expr* e) {
             break;
 
         case EXPR_BINARY:
+            if ((e->data.binary.op == OP_AND || e->data.binary.op == OP_OR) &&
+                !expr_is_pure(e->data.binary.right)) {
+                /* the right side only runs when the left does not settle it */
+                char done[32];
+                snprintf(done, sizeof(done), "Lcond_%d", cond_label_counter++);
+                e->temp_reg = alloc_reg();
+                printf("    li r%d, %d\n", e->temp_reg, e->data.binary.op == OP_OR);
+                emit_cond_branch(e, done, e->data.binary.op == OP_OR);
+                printf("    li r%d, %d\n", e->temp_reg, e->data.binary.op != OP_OR);
+                printf("%s:\n", done);
+                break;
+            }
             emit_expr(e->data.binary.left);
-            emit_expr(e->data.binary.right);
             e->temp_reg = e->data.binary.left->temp_reg;
+            if (e->data.binary.right->kind == EXPR_LITERAL_INT &&
+                emit_binop_imm(e->data.binary.op, e->temp_reg, e->temp_reg,
+                               e->data.binary.right->data.int_val)) {
+                break;
+            }
+            emit_expr(e->data.binary.right);
             emit_binop(e->data.binary.op, e->temp_reg,
                       e->data.binary.left->temp_reg,
                       e->data.binary.right->temp_reg);
@@ -928,10 +1222,9 @@ void emit_expr(Expr* e) {
             static int label_counter = 0;
             int label = label_counter++;
 
-            emit_expr(e->data.if_expr.condition);
-            printf("    cmpwi r%d, 0\n", e->data.if_expr.condition->temp_reg);
-            free_reg(e->data.if_expr.condition->temp_reg);
-            printf("    beq Lelse_%d\n", label);
+            char else_label[32];
+            snprintf(else_label, sizeof(else_label), "Lelse_%d", label);
+            emit_cond_branch(e->data.if_expr.condition, else_label, 0);
 
             emit_expr(e->data.if_expr.then_branch);
             e->temp_reg = e->data.if_expr.then_branch->temp_reg;
@@ -996,6 +1289,15 @@ void demonstrate_expressions() {
     emit_expr(e1);
     printf("; Result in r%d\n\n", e1->temp_reg);
 
+    /* Test: 1000 / 7 % 3 * 9 — constant divisors become multiply-high */
+    char* test1b = "1000 / 7 % 3 * 9";
+    pos = test1b;
+    next_temp_reg = 14;
+    printf("; Expression: %s\n", test1b);
+    Expr* e1b = parse_expr();
+    emit_expr(e1b);
+    printf("; Result in r%d\n\n", e1b->temp_reg);
+
     /* Test: (a + b) * c */
     char* test2 = "(a + b) * c";
     pos = test2;
@@ -1019,7 +1321,26 @@ void demonstrate_expressions() {
     next_temp_reg = 14;
     printf("; Expression: %s\n", test4);
     Expr* e4 = parse_expr();
-    printf("; Parsed if-else OK\n\n");
+    emit_expr(e4);
+    printf("; Result in r%d\n\n", e4->temp_reg);
+
+    /* Test: short-circuit chain, compares overlap in cr0/cr1 */
+    char* test4b = "if a < b && b < c || !done { 1 } else { 0 }";
+    pos = test4b;
+    next_temp_reg = 14;
+    printf("; Expression: %s\n", test4b);
+    Expr* e4b = parse_expr();
+    emit_expr(e4b);
+    printf("; Result in r%d\n\n", e4b->temp_reg);
+
+    /* Test: a comparison as a value, without mfcr */
+    char* test4c = "a <= b";
+    pos = test4c;
+    next_temp_reg = 14;
+    printf("; Expression: %s\n", test4c);
+    Expr* e4c = parse_expr();
+    emit_expr(e4c);
+    printf("; Result in r%d\n\n", e4c->temp_reg);
 
     /* Test: result? */
     char* test5 = "foo()?";
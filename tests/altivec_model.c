@@ -0,0 +1,350 @@
+/*
+ * Scalar model of the AltiVec loop kernels in rustc_100_percent.c
+ * (see kernel_emit), so hosts without a G4 can check what they compute.
+ *
+ * Memory is a big-endian byte array as on the PowerPC; a vec is sixteen
+ * bytes in that order, lane 0 first, whatever the host's byte order. Each
+ * kernel runs the emitted shape -- a scalar head until the destination is
+ * quadword aligned, whole quadwords through lvx/stvx with the source
+ * realigned by lvsl/vperm, then a scalar tail -- and is compared with the
+ * plain loop for every length up to 70 and every misalignment.
+ *
+ * An f32 sum, vector only under -C fp-contract=fast, is reassociated:
+ * the head is added in order, the body keeps four lane sums that are
+ * folded as (l0 + l2) + (l1 + l3), and the tail is added in order after
+ * that. The reference below sums in exactly that order. vaddfp on a G4 also runs with VSCR[NJ] set, flushing
+ * denormals to zero; the values used here stay normal.
+ *
+ *   cc -O2 -o altivec_model tests/altivec_model.c && ./altivec_model
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct { unsigned char b[16]; } vec;
+
+enum { U8, I8, U16, I16, U32, I32, F32 };
+enum { SUM, COUNT, MAP };
+enum { DST, SRC, K };   /* map operands */
+
+static const char* type_names[] = { "u8", "i8", "u16", "i16", "u32", "i32", "f32" };
+static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4 };
+
+#define MEM_SIZE 1024
+static unsigned char mem[MEM_SIZE];
+static unsigned lo_quad[2], hi_quad[2];   /* quadwords the slices cover */
+static int failures, checks;
+
+/* ---- memory and lanes, big-endian ---- */
+
+static unsigned load(unsigned addr, int size) {
+    unsigned v = 0;
+    for (int i = 0; i < size; i++) v = v << 8 | mem[addr + i];
+    return v;
+}
+
+static void store(unsigned addr, int size, unsigned v) {
+    for (int i = size - 1; i >= 0; i--, v >>= 8) mem[addr + i] = (unsigned char)v;
+}
+
+static unsigned lane(const vec* v, int size, int i) {
+    unsigned x = 0;
+    for (int k = 0; k < size; k++) x = x << 8 | v->b[i * size + k];
+    return x;
+}
+
+static void set_lane(vec* v, int size, int i, unsigned x) {
+    for (int k = size - 1; k >= 0; k--, x >>= 8) v->b[i * size + k] = (unsigned char)x;
+}
+
+static float as_float(unsigned bits) {
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+static unsigned as_bits(float f) {
+    unsigned bits;
+    memcpy(&bits, &f, 4);
+    return bits;
+}
+
+static int sext(unsigned x, int type) {
+    if (type == I8) return (signed char)x;
+    if (type == I16) return (short)x;
+    return (int)x;
+}
+
+/* ---- the instructions the kernels use ---- */
+
+static void check_quad(unsigned ea, int which) {
+    if (ea < lo_quad[which] || ea > hi_quad[which]) {
+        printf("FAIL: quadword %#x outside its slice\n", ea);
+        failures++;
+    }
+}
+
+static vec lvx(unsigned ea, int which) {
+    vec v;
+    ea &= ~15u;
+    check_quad(ea, which);
+    memcpy(v.b, &mem[ea], 16);
+    return v;
+}
+
+static void stvx(vec v, unsigned ea) {
+    ea &= ~15u;
+    check_quad(ea, 0);
+    memcpy(&mem[ea], v.b, 16);
+}
+
+static vec lvsl(unsigned ea) {
+    vec v;
+    for (int i = 0; i < 16; i++) v.b[i] = (unsigned char)((ea & 15) + i);
+    return v;
+}
+
+static vec vperm(vec a, vec b, vec c) {
+    vec v;
+    for (int i = 0; i < 16; i++) {
+        int sel = c.b[i] & 31;
+        v.b[i] = sel < 16 ? a.b[sel] : b.b[sel - 16];
+    }
+    return v;
+}
+
+static vec splat(unsigned k, int size) {
+    vec v;
+    for (int i = 0; i < 16 / size; i++) set_lane(&v, size, i, k);
+    return v;
+}
+
+/* vmsumubm/vmsummbm/vmsumuhm/vmsumshm against ones, vadduwm: each word
+ * lane gains the sum of the narrower lanes it covers */
+static vec vmsum(vec acc, vec x, int type) {
+    int size = sizes[type], per = 4 / size;
+    for (int w = 0; w < 4; w++) {
+        unsigned s = lane(&acc, 4, w);
+        for (int i = 0; i < per; i++) s += (unsigned)sext(lane(&x, size, w * per + i), type);
+        set_lane(&acc, 4, w, s);
+    }
+    return acc;
+}
+
+/* vcmpequ[bhw]/vcmpeqfp: all ones where equal */
+static vec vcmpeq(vec a, vec b, int type) {
+    int size = sizes[type];
+    for (int i = 0; i < 16 / size; i++) {
+        unsigned x = lane(&a, size, i), y = lane(&b, size, i);
+        int eq = type == F32 ? as_float(x) == as_float(y) : x == y;
+        set_lane(&a, size, i, eq ? 0xFFFFFFFFu : 0);
+    }
+    return a;
+}
+
+static unsigned scalar_op(int op, unsigned x, unsigned y, int type) {
+    if (type == F32) {
+        float a = as_float(x), b = as_float(y);
+        return as_bits(op == '+' ? a + b : op == '-' ? a - b : a * b);
+    }
+    switch (op) {
+    case '+': return x + y;
+    case '-': return x - y;
+    case '&': return x & y;
+    case '|': return x | y;
+    default:  return x ^ y;
+    }
+}
+
+/* vaddu[bhw]m, vsubu[bhw]m, vand, vor, vxor, vaddfp, vsubfp, vmaddfp
+ * (+ -0.0, so exactly the product) */
+static vec vop(int op, vec a, vec b, int type) {
+    int size = sizes[type];
+    unsigned mask = size == 4 ? 0xFFFFFFFFu : (1u << (8 * size)) - 1;
+    for (int i = 0; i < 16 / size; i++) {
+        set_lane(&a, size, i, scalar_op(op, lane(&a, size, i), lane(&b, size, i), type) & mask);
+    }
+    return a;
+}
+
+/* ---- the kernels ---- */
+
+typedef struct {
+    int kind, type;
+    int op, a, b;   /* MAP: dst = a op b, or dst = a when op is 0 */
+    unsigned k;
+} Kernel;
+
+/* One scalar element, as kernel_scalar_step emits it */
+static void step(const Kernel* kn, unsigned* p, unsigned* q, unsigned* acc, float* facc) {
+    int size = sizes[kn->type];
+    unsigned mask = size == 4 ? 0xFFFFFFFFu : (1u << (8 * size)) - 1;
+    unsigned x = load(*p, size);
+    if (kn->kind == SUM && kn->type == F32) {
+        *facc += as_float(x);
+    } else if (kn->kind == SUM) {
+        *acc += (unsigned)sext(x, kn->type);
+    } else if (kn->kind == COUNT) {
+        *acc += kn->type == F32 ? as_float(x) == as_float(kn->k) : x == kn->k;
+    } else {
+        unsigned ops[3];
+        ops[DST] = x;
+        ops[SRC] = q ? load(*q, size) : 0;
+        ops[K] = kn->k;
+        store(*p, size, kn->op ? scalar_op(kn->op, ops[kn->a], ops[kn->b], kn->type) & mask : ops[kn->a]);
+    }
+    *p += size;
+    if (q) *q += size;
+}
+
+/* The vector kernel over n elements at p (and q); returns the sum or
+ * count, an f32 sum as bits */
+static unsigned kernel(const Kernel* kn, unsigned p, unsigned q, unsigned n, int has_src) {
+    int size = sizes[kn->type], lanes = 16 / size;
+    unsigned acc = 0;
+    float facc = 0.0f;
+    unsigned* qp = has_src ? &q : NULL;
+
+    for (; n && (p & 15); n--) step(kn, &p, qp, &acc, &facc);
+    if (n >= (unsigned)lanes) {
+        vec sum = splat(0, 4), kv = splat(kn->k, size), perm = lvsl(q);
+        for (; n >= (unsigned)lanes; n -= lanes, p += 16, q += 16) {
+            vec v[3], r;
+            v[DST] = lvx(p, 0);
+            v[K] = kv;
+            if (has_src) v[SRC] = vperm(lvx(q, 1), lvx(q + 15, 1), perm);
+            if (kn->kind == SUM && kn->type == F32) {
+                sum = vop('+', sum, v[DST], F32);
+            } else if (kn->kind == SUM) {
+                sum = vmsum(sum, v[DST], kn->type);
+            } else if (kn->kind == COUNT) {
+                /* -1 per equal word lane, 1 per narrower one */
+                r = vcmpeq(v[DST], kv, kn->type);
+                if (size == 4) sum = vop('-', sum, r, U32);
+                else sum = vmsum(sum, vop('&', r, splat(1, size), kn->type), kn->type == I8 ? U8 : kn->type == I16 ? U16 : kn->type);
+            } else {
+                r = kn->op ? vop(kn->op, v[kn->a], v[kn->b], kn->type) : v[kn->a];
+                stvx(r, p);
+            }
+        }
+        if (kn->kind == SUM && kn->type == F32) {
+            float l0 = as_float(lane(&sum, 4, 0)), l1 = as_float(lane(&sum, 4, 1));
+            float l2 = as_float(lane(&sum, 4, 2)), l3 = as_float(lane(&sum, 4, 3));
+            facc += (l0 + l2) + (l1 + l3);
+        } else if (kn->kind != MAP) {
+            acc += lane(&sum, 4, 0) + lane(&sum, 4, 1) + lane(&sum, 4, 2) + lane(&sum, 4, 3);
+        }
+    }
+    for (; n; n--) step(kn, &p, qp, &acc, &facc);
+    return kn->kind == SUM && kn->type == F32 ? as_bits(facc) : acc;
+}
+
+/* ---- the plain loops ---- */
+
+static unsigned reference(const Kernel* kn, unsigned p, unsigned q, unsigned n, int has_src,
+                          unsigned char* out) {
+    int size = sizes[kn->type];
+    unsigned acc = 0;
+    float head = 0.0f, lanes[4] = { 0, 0, 0, 0 }, tail = 0.0f;
+    unsigned i = 0, body = 0;
+
+    memcpy(out, mem, MEM_SIZE);
+    if (kn->kind == SUM && kn->type == F32) {
+        /* the order the kernel adds in */
+        for (; i < n && ((p + 4 * i) & 15); i++) head += as_float(load(p + 4 * i, 4));
+        for (; n - i >= 4; i += 4, body = 1) {
+            for (int l = 0; l < 4; l++) lanes[l] += as_float(load(p + 4 * (i + l), 4));
+        }
+        if (body) head += (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+        for (tail = head; i < n; i++) tail += as_float(load(p + 4 * i, 4));
+        return as_bits(tail);
+    }
+    for (i = 0; i < n; i++) {
+        unsigned x = load(p + i * size, size), y = has_src ? load(q + i * size, size) : 0;
+        unsigned mask = size == 4 ? 0xFFFFFFFFu : (1u << (8 * size)) - 1;
+        unsigned ops[3] = { x, y, kn->k }, r;
+        if (kn->kind == SUM) {
+            acc += (unsigned)sext(x, kn->type);
+        } else if (kn->kind == COUNT) {
+            acc += kn->type == F32 ? as_float(x) == as_float(kn->k) : x == kn->k;
+        } else {
+            r = kn->op ? scalar_op(kn->op, ops[kn->a], ops[kn->b], kn->type) & mask : ops[kn->a];
+            for (int k = size - 1; k >= 0; k--, r >>= 8) out[p + i * size + k] = (unsigned char)r;
+        }
+    }
+    return acc;
+}
+
+static unsigned random_element(int type) {
+    static const float floats[] = { 0.0f, -0.0f, 1.5f, -3.25f, 1e6f, 0.1f };
+    if (type == F32) {
+        if (rand() % 3) return as_bits(floats[rand() % 6]);
+        return as_bits((float)(rand() % 20001 - 10000) / 64.0f);
+    }
+    if (rand() % 4 == 0) return 3;   /* the counted constant */
+    return (unsigned)rand() << 16 ^ (unsigned)rand();
+}
+
+static void run(const Kernel* kn, int has_src) {
+    int size = sizes[kn->type];
+    static unsigned char expect_mem[MEM_SIZE];
+
+    for (unsigned n = 0; n <= 70; n++) {
+        for (unsigned mis = 0; mis < 16; mis += size) {
+            unsigned p = 64 + mis, q = 512 + (mis * 5 + 4) % 16 / size * size;
+            unsigned got, want;
+            for (int i = 0; i < MEM_SIZE; i++) mem[i] = (unsigned char)rand();
+            for (unsigned i = 0; i < n; i++) {
+                store(p + i * size, size, random_element(kn->type));
+                store(q + i * size, size, random_element(kn->type));
+            }
+            lo_quad[0] = p & ~15u;
+            hi_quad[0] = n ? (p + n * size - 1) & ~15u : 0;
+            lo_quad[1] = q & ~15u;
+            hi_quad[1] = n ? (q + n * size - 1) & ~15u : 0;
+            want = reference(kn, p, q, n, has_src, expect_mem);
+            got = kernel(kn, p, q, n, has_src);
+            checks++;
+            if (got != want || memcmp(mem, expect_mem, MEM_SIZE) != 0) {
+                printf("FAIL: %s kind %d op %c, n %u, misaligned %u: %#x, want %#x\n",
+                       type_names[kn->type], kn->kind, kn->op ? kn->op : '=', n, mis, got, want);
+                failures++;
+            }
+        }
+    }
+}
+
+int main(void) {
+    static const char int_ops[] = "+-&|^", float_ops[] = "+-*";
+    srand(1);
+    for (int type = U8; type <= F32; type++) {
+        int size = sizes[type];
+        unsigned mask = size == 4 ? 0xFFFFFFFFu : (1u << (8 * size)) - 1;
+        unsigned k = type == F32 ? as_bits(1.5f) : 0x12345u & mask;
+        const char* ops = type == F32 ? float_ops : int_ops;
+        Kernel kn;
+
+        kn = (Kernel){ SUM, type, 0, 0, 0, 0 };
+        run(&kn, 0);
+        kn = (Kernel){ COUNT, type, 0, 0, 0, type == F32 ? as_bits(-3.25f) : 3 };
+        run(&kn, 0);
+        if (type == F32) {
+            kn.k = as_bits(0.0f);   /* -0.0 == 0.0 */
+            run(&kn, 0);
+        }
+        kn = (Kernel){ MAP, type, 0, K, K, k };   /* fill */
+        run(&kn, 0);
+        kn = (Kernel){ MAP, type, 0, SRC, SRC, k };   /* copy */
+        run(&kn, 1);
+        for (const char* op = ops; *op; op++) {
+            kn = (Kernel){ MAP, type, *op, DST, K, k };
+            run(&kn, 0);
+            kn = (Kernel){ MAP, type, *op, DST, SRC, k };
+            run(&kn, 1);
+            kn = (Kernel){ MAP, type, *op, K, SRC, k };
+            run(&kn, 1);
+        }
+    }
+    printf("%d kernel runs, %d failures\n", checks, failures);
+    return failures != 0;
+}
@@ -0,0 +1,128 @@
+fn add(a: f64, b: f64) -> f64 {
+    return a + b;
+}
+
+fn poly(x: f64) -> f64 {
+    return 3.0 * x * x - 2.0 * x + 0.5;
+}
+
+fn mixed(a: f32, n: i32, b: f32) -> f32 {
+    return a * n as f32 + b;
+}
+
+fn percent(done: u32, total: u32) -> f64 {
+    return done as f64 * 100.0 / total as f64;
+}
+
+fn eta(elapsed: f64, done: u64, total: u64) -> f64 {
+    let rate = done as f64 / elapsed;
+    return (total - done) as f64 / rate;
+}
+
+fn to_i32(x: f64) -> i32 {
+    return x as i32;
+}
+
+fn to_u8(x: f64) -> u8 {
+    return x as u8;
+}
+
+fn to_i16(x: f32) -> i16 {
+    return x as i16;
+}
+
+fn to_u32(x: f64) -> u32 {
+    return x as u32;
+}
+
+fn to_i64(x: f64) -> i64 {
+    return x as i64;
+}
+
+fn to_u64(x: f64) -> u64 {
+    return x as u64;
+}
+
+fn from_i64(a: i64) -> f64 {
+    return a as f64 + 0.5;
+}
+
+fn order(a: f64, b: f64) -> u32 {
+    let mut m = 0;
+    if a < b {
+        m += 1;
+    }
+    if a <= b {
+        m += 2;
+    }
+    if a > b {
+        m += 4;
+    }
+    if a >= b {
+        m += 8;
+    }
+    if a == b {
+        m += 16;
+    }
+    if a != b {
+        m += 32;
+    }
+    return m;
+}
+
+fn dot(n: i32) -> f64 {
+    let mut acc = 0.0;
+    let mut i = 0;
+    while i < n {
+        let x = i as f64;
+        acc += x * 0.5 + 1.0 / (x + 1.0);
+        i += 1;
+    }
+    return acc;
+}
+
+fn fused(a: f64, b: f64, c: f64) -> f64 {
+    return a.mul_add(b, c);
+}
+
+fn call_chain(x: f64) -> f64 {
+    return add(x, poly(x)) * x - add(x, 1.0);
+}
+
+fn loop_sum(n: i32) -> f64 {
+    let mut sum = 0.0;
+    let mut term = 1.0;
+    let mut i = 0;
+    while i < n {
+        sum += term;
+        term = term * 0.5;
+        i += 1;
+    }
+    return sum;
+}
+
+fn single(a: f32, b: f32) -> f32 {
+    let c = a * b - 1.5f32;
+    return c / (a + 0.25);
+}
+
+fn args(a: i32, x: f64, b: i32, y: f32, c: i64) -> f64 {
+    return a as f64 * x + b as f64 - y as f64 + c as f64;
+}
+
+fn methods(x: f64) -> f64 {
+    return x.abs().sqrt() + x.floor() - x.max(1.0) + x % 3.0;
+}
+
+fn compound(a: f64, b: f64) -> f64 {
+    let mut x = a;
+    x += b;
+    x *= b;
+    x -= -1.5;
+    x /= a;
+    return x * f64::EPSILON;
+}
+
+fn main() {
+    let p = percent(3, 7);
+}
@@ -0,0 +1,170 @@
+/*
+ * floats_host.c — the functions of floats.rs in C, for the host
+ *
+ * Prints one line per call: the function, its arguments and the result,
+ * each tagged d (f64 bits), s (f32 bits), w (32-bit) or q (64-bit), for
+ * the test to replay on the compiled PowerPC code. Build it with
+ * -ffp-contract=off so a * b + c rounds twice, as rustc's does; the
+ * conversions saturate the way Rust's `as` does.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint64_t u64;
+typedef int64_t i64;
+typedef uint32_t u32;
+typedef int32_t i32;
+
+/* x toward zero into [lo, hi], NaN to 0 */
+static double sat(double x, double lo, double hi) {
+    if (x != x) return 0;
+    if (x <= lo) return lo;
+    if (x >= hi) return hi;
+    return x;
+}
+
+static double add(double a, double b) { return a + b; }
+static double poly(double x) { return 3.0 * x * x - 2.0 * x + 0.5; }
+static float mixed(float a, i32 n, float b) { return a * (float)n + b; }
+static double percent(u32 done, u32 total) { return (double)done * 100.0 / (double)total; }
+
+static double eta(double elapsed, u64 done, u64 total) {
+    double rate = (double)done / elapsed;
+    return (double)(total - done) / rate;
+}
+
+static i32 to_i32(double x) { return (i32)sat(x, -2147483648.0, 2147483647.0); }
+static uint8_t to_u8(double x) { return (uint8_t)sat(x, 0, 255); }
+static int16_t to_i16(float x) { return (int16_t)sat(x, -32768, 32767); }
+static u32 to_u32(double x) { return (u32)sat(x, 0, 4294967295.0); }
+
+static i64 to_i64(double x) {
+    if (x != x) return 0;
+    if (x >= 9223372036854775808.0) return INT64_MAX;
+    if (x <= -9223372036854775808.0) return INT64_MIN;
+    return (i64)x;
+}
+
+static u64 to_u64(double x) {
+    if (x != x || x <= 0) return 0;
+    if (x >= 18446744073709551616.0) return UINT64_MAX;
+    return (u64)x;
+}
+
+static double from_i64(i64 a) { return (double)a + 0.5; }
+
+static u32 order(double a, double b) {
+    return (a < b) * 1 + (a <= b) * 2 + (a > b) * 4 + (a >= b) * 8 + (a == b) * 16 + (a != b) * 32;
+}
+
+static double dot(i32 n) {
+    double acc = 0.0;
+    for (i32 i = 0; i < n; i++) {
+        double x = i;
+        acc += x * 0.5 + 1.0 / (x + 1.0);
+    }
+    return acc;
+}
+
+static double fused(double a, double b, double c) { return fma(a, b, c); }
+static double call_chain(double x) { return add(x, poly(x)) * x - add(x, 1.0); }
+
+static double loop_sum(i32 n) {
+    double sum = 0.0, term = 1.0;
+    for (i32 i = 0; i < n; i++) {
+        sum += term;
+        term = term * 0.5;
+    }
+    return sum;
+}
+
+static float single(float a, float b) {
+    float c = a * b - 1.5f;
+    return c / (a + 0.25f);
+}
+
+static double args(i32 a, double x, i32 b, float y, i64 c) {
+    return (double)a * x + (double)b - (double)y + (double)c;
+}
+
+static double methods(double x) { return sqrt(fabs(x)) + floor(x) - fmax(x, 1.0) + fmod(x, 3.0); }
+
+static double compound(double a, double b) {
+    double x = a;
+    x += b;
+    x *= b;
+    x -= -1.5;
+    x /= a;
+    return x * 2.220446049250313e-16;
+}
+
+static unsigned long long d(double x) {
+    unsigned long long u;
+    memcpy(&u, &x, sizeof u);
+    return u;
+}
+
+static unsigned s(float x) {
+    unsigned u;
+    memcpy(&u, &x, sizeof u);
+    return u;
+}
+
+static const double values[] = {
+    0.0, -0.0, 1.0, -1.0, 0.5, 2.75, -3.25, 1e-3, 123456.789, -98765.4321, 255.5, 256.0, -0.75,
+    32767.9, -32768.5, 2147483647.5, -2147483649.0, 3000000000.0, 4294967296.0, 1e19, -1e19, 2e19,
+    9.2233720368547758e18, 1e300, INFINITY, -INFINITY, NAN,
+};
+static const i64 ints[] = { 0, 1, -1, 7, 1000000007, 4294967295LL, -4294967296LL, 1LL << 53, (1LL << 53) + 1,
+                            INT64_MAX, INT64_MIN };
+#define COUNT(x) (sizeof(x) / sizeof((x)[0]))
+
+int main(void) {
+    unsigned i, j;
+    for (i = 0; i < COUNT(values); i++) {
+        double a = values[i];
+        float f = (float)a;
+        printf("poly d:%llx = d:%llx\n", d(a), d(poly(a)));
+        printf("to_i32 d:%llx = w:%x\n", d(a), (u32)to_i32(a));
+        printf("to_u8 d:%llx = w:%x\n", d(a), (u32)to_u8(a));
+        printf("to_i16 s:%x = w:%x\n", s(f), (u32)(i32)to_i16(f));
+        printf("to_u32 d:%llx = w:%x\n", d(a), to_u32(a));
+        printf("to_i64 d:%llx = q:%llx\n", d(a), (unsigned long long)to_i64(a));
+        printf("to_u64 d:%llx = q:%llx\n", d(a), (unsigned long long)to_u64(a));
+        printf("call_chain d:%llx = d:%llx\n", d(a), d(call_chain(a)));
+        printf("methods d:%llx = d:%llx\n", d(a), d(methods(a)));
+        for (j = 0; j < COUNT(values); j++) {
+            double b = values[j];
+            float g = (float)b;
+            printf("add d:%llx d:%llx = d:%llx\n", d(a), d(b), d(add(a, b)));
+            printf("order d:%llx d:%llx = w:%x\n", d(a), d(b), order(a, b));
+            printf("fused d:%llx d:%llx d:%llx = d:%llx\n", d(a), d(b), d(0.1), d(fused(a, b, 0.1)));
+            printf("single s:%x s:%x = s:%x\n", s(f), s(g), s(single(f, g)));
+            printf("mixed s:%x w:%x s:%x = s:%x\n", s(f), (u32)(i32)j * 37 - 200, s(g),
+                   s(mixed(f, (i32)j * 37 - 200, g)));
+            printf("compound d:%llx d:%llx = d:%llx\n", d(a), d(b), d(compound(a, b)));
+            printf("args w:%x d:%llx w:%x s:%x q:%llx = d:%llx\n", (u32)(i32)i - 9, d(a), (u32)j, s(g),
+                   (unsigned long long)ints[(i + j) % COUNT(ints)],
+                   d(args((i32)i - 9, a, (i32)j, g, ints[(i + j) % COUNT(ints)])));
+        }
+    }
+    for (i = 0; i < COUNT(ints); i++) {
+        printf("from_i64 q:%llx = d:%llx\n", (unsigned long long)ints[i], d(from_i64(ints[i])));
+        for (j = 0; j < COUNT(ints); j++) {
+            u64 done = (u64)ints[i] & 0xFFFFFFFFFF, total = done + ((u64)ints[j] & 0xFFFFFFFFF);
+            if (done) {
+                printf("eta d:%llx q:%llx q:%llx = d:%llx\n", d(12.5), (unsigned long long)done,
+                       (unsigned long long)total, d(eta(12.5, done, total)));
+            }
+        }
+    }
+    for (i = 0; i < 40; i += 3) {
+        printf("percent w:%x w:%x = d:%llx\n", i * 1000, 3 + i * 7, d(percent(i * 1000, 3 + i * 7)));
+        printf("dot w:%x = d:%llx\n", i, d(dot((i32)i)));
+        printf("loop_sum w:%x = d:%llx\n", i, d(loop_sum((i32)i)));
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+// Golden input for the peephole pass: compile with -C opt-level=1 and
+// compare against peephole.s.
+const LIMIT: i32 = 7;
+
+struct Counter { hits: i32, misses: i32 }
+
+impl Counter {
+    fn total(&self) -> i32 {
+        let t = self.hits + self.misses;
+        return t;
+    }
+}
+
+fn pick(a: i32) -> i32 {
+    let k = match a {
+        0 => 10,
+        1 => 20,
+        _ => 30,
+    };
+    return k;
+}
+
+fn check(a: i32) -> i32 {
+    if a == 0 {
+        return 1;
+    }
+    while a < LIMIT {
+        a = a + 1;
+    }
+    return a;
+}
+
+fn main() {
+    let x = pick(1);
+    let y = check(x);
+    let v = vec![1, 2, 3];
+}
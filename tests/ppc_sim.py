@@ -0,0 +1,366 @@
+"""A small interpreter for the 32-bit PowerPC that rustc_ppc emits.
+
+Enough of the user-level ISA to run compiled functions on the build
+host: GPRs, FPRs, CR fields, XER[CA], CTR, a word-addressed stack and
+the literal pools. `bl` to a local label calls it; the libgcc 64-bit
+division and float conversion helpers and the libm functions are
+computed here. Good for checking generated code against a host C build,
+not for timing it.
+"""
+
+import math
+import re
+import struct
+from fractions import Fraction
+
+M = 0xFFFFFFFF
+
+
+def s32(v):
+    v &= M
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def s64(v):
+    v &= (1 << 64) - 1
+    return v - (1 << 64) if v >> 63 else v
+
+
+def bits_of(x):
+    return struct.unpack(">Q", struct.pack(">d", x))[0]
+
+
+def double(b):
+    return struct.unpack(">d", struct.pack(">Q", b & ((1 << 64) - 1)))[0]
+
+
+def single(x):
+    """x rounded to an f32, as frsp and the single ops do"""
+    try:
+        return struct.unpack(">f", struct.pack(">f", x))[0]
+    except OverflowError:
+        return math.copysign(math.inf, x)
+
+
+def _fma(a, b, c):
+    """a * b + c rounded once"""
+    if not all(math.isfinite(v) for v in (a, b, c)):
+        return a * b + c
+    v = Fraction(a) * Fraction(b) + Fraction(c)
+    try:
+        return float(v) if v else (a * b) + c
+    except OverflowError:
+        return math.inf if v > 0 else -math.inf
+
+
+def _trunc(x, lo, hi):
+    """x toward zero, clamped; NaN to lo"""
+    if math.isnan(x):
+        return lo
+    return max(lo, min(hi, int(x))) if math.isfinite(x) else (hi if x > 0 else lo)
+
+
+_LIBM = {"sqrt": math.sqrt, "floor": math.floor, "ceil": math.ceil, "trunc": math.trunc,
+         "round": lambda x: math.copysign(math.floor(abs(x) + 0.5), x), "sin": math.sin, "cos": math.cos,
+         "tan": math.tan, "exp": math.exp, "log": math.log, "log10": math.log10, "pow": math.pow,
+         "atan2": math.atan2, "hypot": math.hypot, "fmin": min, "fmax": max, "fmod": math.fmod}
+
+CR_LT, CR_GT, CR_EQ, CR_SO = 8, 4, 2, 1
+
+
+def _cdiv(a, b):
+    q = abs(a) // abs(b)
+    return q if (a < 0) == (b < 0) else -q
+
+
+def _libgcc(name, a, b):
+    """__divdi3 and friends on 64-bit a and b; C truncating semantics"""
+    if name in ("___udivdi3", "___umoddi3"):
+        return a // b if name == "___udivdi3" else a % b
+    a, b = s64(a), s64(b)
+    q = _cdiv(a, b)
+    return q if name == "___divdi3" else a - q * b
+
+
+DATA = 0x200000
+
+
+class Program:
+    def __init__(self, asm):
+        self.lines = []
+        self.labels = {}
+        self.data = {}
+        self.f1 = 0.0
+        in_data = False
+        for line in asm.split("\n"):
+            line = line.split(";")[0].strip()
+            if line in (".literal4", ".literal8", ".data") or line.startswith(".section __DATA"):
+                in_data = True
+            elif line == ".text" or line.startswith(".section"):
+                in_data = False
+            elif line.endswith(":"):
+                self.labels[line[:-1]] = DATA + 4 * len(self.data) if in_data else len(self.lines)
+            elif in_data and line.startswith(".long"):
+                for w in line[5:].split(","):
+                    self.data[DATA + 4 * len(self.data)] = int(w, 0) & M
+            elif line and not line.startswith("."):
+                op, _, args = line.partition(" ")
+                self.lines.append((op, [a.strip() for a in args.split(",")] if args else []))
+
+    def call(self, fn, *words, fprs=(), steps=1000000):
+        """Run _fn with words in r3 up and fprs in f1 up; (r3, r4) when it
+        returns, f1 in self.f1"""
+        r = [0] * 32
+        f = [0] * 32
+        r[1] = 0x100000
+        for k, w in enumerate(words):
+            r[3 + k] = w & M
+        for k, x in enumerate(fprs):
+            f[1 + k] = bits_of(x)
+        mem, cr, ca, ctr, stack = dict(self.data), [0] * 8, 0, 0, []
+        i = self.labels["_" + fn]
+
+        def reg(t):
+            return int(t[1:])
+
+        def sym(t):
+            m = re.fullmatch(r"(ha16|lo16)\((\w+)\)", t)
+            v = self.labels[m.group(2)]
+            return (v + 0x8000) >> 16 if m.group(1) == "ha16" else (v & 0xFFFF) - (v & 0x8000) * 2
+
+        def ea(t):
+            m = re.match(r"(.+)\(r(\d+)\)$", t)
+            d = sym(m.group(1)) if m.group(1).endswith(")") else int(m.group(1), 0)
+            return (d + r[int(m.group(2))]) & M
+
+        def compare(u, v):
+            return CR_SO if u != u or v != v else CR_LT if u < v else CR_GT if u > v else CR_EQ
+
+        def record(v):
+            cr[0] = compare(s32(v), 0)
+
+        def fd(t):
+            return double(f[reg(t)])
+
+        def fset(t, x, single_op=False):
+            f[reg(t)] = bits_of(single(x) if single_op else x)
+
+        while steps > 0:
+            steps -= 1
+            op, a = self.lines[i][0], list(self.lines[i][1])
+            i += 1
+            rec = op.endswith(".")
+            op = op.rstrip(".")
+            if op[0] == "b" and op not in ("bl", "blr", "bctr", "b", "bdnz"):
+                c = cr[int(a.pop(0)[2:]) if a[0].startswith("cr") else 0]
+                taken = {"beq": c & CR_EQ, "bne": not c & CR_EQ, "blt": c & CR_LT, "bge": not c & CR_LT,
+                         "bgt": c & CR_GT, "ble": not c & CR_GT}[op.rstrip("+-")]
+                if taken:
+                    i = self.labels[a[0]]
+                continue
+            if op[0] == "f":
+                single_op = op.endswith("s") and op not in ("fabs", "fctiwz")
+                base = op[:-1] if single_op else op
+                if base in ("fadd", "fsub", "fmul", "fdiv"):
+                    x, y = fd(a[1]), fd(a[2])
+                    try:
+                        v = {"fadd": lambda: x + y, "fsub": lambda: x - y, "fmul": lambda: x * y,
+                             "fdiv": lambda: x / y}[base]()
+                    except ZeroDivisionError:
+                        v = math.nan if x == 0 or x != x else math.copysign(math.inf, x) * math.copysign(1, y)
+                    fset(a[0], v, single_op)
+                elif base in ("fmadd", "fmsub", "fnmadd", "fnmsub"):
+                    x, y, z = fd(a[1]), fd(a[2]), fd(a[3])
+                    v = _fma(x, y, z if base in ("fmadd", "fnmadd") else -z)
+                    fset(a[0], -v if base.startswith("fn") else v, single_op)
+                elif op in ("fneg", "fabs", "fmr"):
+                    v = f[reg(a[1])]
+                    f[reg(a[0])] = v ^ (1 << 63) if op == "fneg" else v & ~(1 << 63) if op == "fabs" else v
+                elif op == "frsp":
+                    fset(a[0], fd(a[1]), True)
+                elif base == "fsqrt":
+                    x = fd(a[1])
+                    fset(a[0], math.sqrt(x) if x >= 0 else math.nan, single_op)
+                elif op == "fctiwz":
+                    x = fd(a[1])
+                    f[reg(a[0])] = 0x80000000 if x != x else _trunc(x, -(1 << 31), (1 << 31) - 1) & M
+                elif op in ("fcmpu", "fcmpo"):
+                    cr[int(a[0][2:])] = compare(fd(a[1]), fd(a[2]))
+                else:
+                    raise ValueError("unsupported instruction: %s %s" % (op, ", ".join(a)))
+                continue
+            if op in ("lfs", "lfd"):
+                e = ea(a[1])
+                w = mem.get(e, 0)
+                v = struct.unpack(">f", struct.pack(">I", w))[0] if op == "lfs" else double(w << 32 | mem.get(e + 4, 0))
+                fset(a[0], v)
+                continue
+            if op in ("stfs", "stfd"):
+                e = ea(a[1])
+                if op == "stfs":
+                    mem[e] = struct.unpack(">I", struct.pack(">f", single(fd(a[0]))))[0]
+                else:
+                    mem[e], mem[e + 4] = f[reg(a[0])] >> 32, f[reg(a[0])] & M
+                continue
+            if op == "cror":
+                bt, ba, bb = (int(t) for t in a)
+                bit = lambda n: (cr[n // 4] >> (3 - n % 4)) & 1
+                v = bit(ba) | bit(bb)
+                cr[bt // 4] = cr[bt // 4] & ~(1 << (3 - bt % 4)) | v << (3 - bt % 4)
+                continue
+            d = reg(a[0]) if a and a[0].startswith("r") else None
+            x = r[reg(a[1])] if len(a) > 1 and re.fullmatch(r"r\d+", a[1]) else None
+            y = r[reg(a[2])] if len(a) > 2 and re.fullmatch(r"r\d+", a[2]) else None
+            imm = int(a[-1], 0) if a and re.fullmatch(r"-?(0x)?[0-9A-Fa-f]+", a[-1]) else None
+            if op == "blr":
+                if not stack:
+                    self.f1 = double(f[1])
+                    return r[3], r[4]
+                i = stack.pop()
+            elif op == "bl":
+                name = re.sub(r"\[f\]$", "", a[0])
+                if a[0] in self.labels:
+                    stack.append(i)
+                    i = self.labels[a[0]]
+                elif name in ("___fixdfdi", "___fixunsdfdi"):
+                    x = double(f[1])
+                    v = _trunc(x, -(1 << 63), (1 << 63) - 1) if name == "___fixdfdi" else _trunc(x, 0, (1 << 64) - 1)
+                    r[3], r[4] = (v >> 32) & M, v & M
+                elif name.lstrip("_") in _LIBM or name.lstrip("_")[:-1] in _LIBM:
+                    base = name.lstrip("_")
+                    single_op = base not in _LIBM
+                    fn_ = _LIBM[base[:-1] if single_op else base]
+                    args = [double(f[1])] + ([double(f[2])] if fn_ in (math.pow, math.atan2, math.hypot,
+                                                                         min, max, math.fmod) else [])
+                    try:
+                        v = float(fn_(*args))
+                    except (ValueError, OverflowError):
+                        v = math.nan
+                    f[1] = bits_of(single(v) if single_op else v)
+                else:
+                    v = _libgcc(a[0], r[3] << 32 | r[4], r[5] << 32 | r[6]) & ((1 << 64) - 1)
+                    r[3], r[4] = v >> 32, v & M
+            elif op == "b":
+                i = self.labels[a[0]]
+            elif op == "bdnz":
+                ctr = (ctr - 1) & M
+                if ctr:
+                    i = self.labels[a[0]]
+            elif op in ("mflr", "mtlr"):
+                pass
+            elif op == "mtctr":
+                ctr = r[d]
+            elif op == "stw":
+                mem[ea(a[1])] = r[d]
+            elif op == "stwu":
+                mem[ea(a[1])] = r[d]
+                r[1] = ea(a[1])
+            elif op == "stmw":
+                for k in range(d, 32):
+                    mem[(ea(a[1]) + 4 * (k - d)) & M] = r[k]
+            elif op == "lmw":
+                base = ea(a[1])
+                for k in range(d, 32):
+                    r[k] = mem.get((base + 4 * (k - d)) & M, 0)
+            elif op == "lwz":
+                r[d] = mem.get(ea(a[1]), 0)
+            elif op == "la":
+                r[d] = ea(a[1])
+            elif op == "li":
+                r[d] = imm & M
+            elif op == "lis":
+                r[d] = ((sym(a[1]) if imm is None else imm) << 16) & M
+            elif op == "mr":
+                r[d] = x
+            elif op in ("addi", "subi"):
+                base = 0 if a[1] == "r0" else x
+                r[d] = (base + (imm if op == "addi" else -imm)) & M
+            elif op == "addis":
+                r[d] = ((0 if a[1] == "r0" else x) + (imm << 16)) & M
+            elif op == "add":
+                r[d] = (x + y) & M
+            elif op in ("sub", "subf"):
+                r[d] = ((x - y) if op == "sub" else (y - x)) & M
+            elif op == "neg":
+                r[d] = -x & M
+            elif op in ("addc", "addic"):
+                v = x + (y if op == "addc" else imm & M)
+                r[d], ca = v & M, v >> 32
+            elif op == "adde":
+                v = x + y + ca
+                r[d], ca = v & M, v >> 32
+            elif op == "addze":
+                v = x + ca
+                r[d], ca = v & M, v >> 32
+            elif op == "addme":
+                v = x + ca + M
+                r[d], ca = v & M, v >> 32
+            elif op in ("subfc", "subfic"):
+                v = (y if op == "subfc" else imm & M) + (~x & M) + 1
+                r[d], ca = v & M, v >> 32
+            elif op == "subfe":
+                v = y + (~x & M) + ca
+                r[d], ca = v & M, v >> 32
+            elif op == "mullw":
+                r[d] = (x * y) & M
+            elif op == "mulli":
+                r[d] = (x * imm) & M
+            elif op == "mulhw":
+                r[d] = ((s32(x) * s32(y)) >> 32) & M
+            elif op == "mulhwu":
+                r[d] = (x * y) >> 32
+            elif op == "divw":
+                r[d] = _cdiv(s32(x), s32(y)) & M if y else 0
+            elif op == "divwu":
+                r[d] = x // y if y else 0
+            elif op in ("and", "or", "xor", "andc", "nor"):
+                r[d] = {"and": x & y, "or": x | y, "xor": x ^ y, "andc": x & ~y & M,
+                        "nor": ~(x | y) & M}[op]
+            elif op == "not":
+                r[d] = ~x & M
+            elif op in ("andi", "ori", "xori"):
+                r[d] = {"andi": x & imm, "ori": x | imm, "xori": x ^ imm}[op]
+            elif op in ("andis", "oris", "xoris"):
+                r[d] = {"andis": x & (imm << 16), "oris": x | (imm << 16), "xoris": x ^ (imm << 16)}[op]
+            elif op == "extsb":
+                r[d] = (x & 0xFF) - (0x100 if x & 0x80 else 0) & M
+            elif op == "extsh":
+                r[d] = (x & 0xFFFF) - (0x10000 if x & 0x8000 else 0) & M
+            elif op == "slwi":
+                r[d] = (x << imm) & M
+            elif op == "srwi":
+                r[d] = x >> imm
+            elif op == "clrlwi":
+                r[d] = x & (M >> imm)
+            elif op == "rlwinm":
+                n, mb, me = (int(t, 0) for t in a[2:])
+                rot = ((x << n) | (x >> (32 - n))) & M if n else x
+                mask = sum(1 << (31 - k) for k in (range(mb, me + 1) if mb <= me
+                                                   else list(range(mb, 32)) + list(range(0, me + 1))))
+                r[d] = rot & mask
+            elif op == "srawi":
+                v = s32(x)
+                r[d] = (v >> imm) & M
+                ca = int(v < 0 and (x & ((1 << imm) - 1)) != 0)
+            elif op in ("slw", "srw", "sraw"):
+                n = y & 63
+                if op == "slw":
+                    r[d] = (x << n) & M if n < 32 else 0
+                elif op == "srw":
+                    r[d] = x >> n if n < 32 else 0
+                else:
+                    r[d] = (s32(x) >> min(n, 31)) & M
+                    ca = int(s32(x) < 0 and (x & ((1 << min(n, 32)) - 1)) != 0)
+            elif op in ("cmpw", "cmplw", "cmpwi", "cmplwi"):
+                field = int(a.pop(0)[2:]) if a[0].startswith("cr") else 0
+                u = r[reg(a[0])]
+                v = r[reg(a[1])] if a[1].startswith("r") else int(a[1], 0) & M
+                if op in ("cmpw", "cmpwi"):
+                    u, v = s32(u), s32(v)
+                cr[field] = compare(u, v)
+                continue
+            else:
+                raise ValueError("unsupported instruction: %s %s" % (op, ", ".join(a)))
+            if rec:
+                record(r[d])
+        raise RuntimeError("step limit reached in _" + fn)
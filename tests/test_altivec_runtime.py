@@ -0,0 +1,32 @@
+import shutil
+import subprocess
+from pathlib import Path
+
+import pytest
+
+ROOT = Path(__file__).resolve().parents[1]
+
+
+@pytest.fixture(scope="module")
+def altivec_bench(tmp_path_factory):
+    cc = shutil.which("gcc") or shutil.which("cc")
+    if cc is None:
+        pytest.skip("no host C compiler")
+    exe = tmp_path_factory.mktemp("bin") / "altivec_bench"
+    subprocess.run(
+        [cc, "-std=c99", "-O2", "-Wall", "-Werror", "-o", str(exe),
+         str(ROOT / "altivec_bench.c"), str(ROOT / "rust_altivec_core.c")],
+        check=True,
+    )
+    return exe
+
+
+def test_fallback_table_matches_libc_and_reports_throughput(altivec_bench):
+    result = subprocess.run([str(altivec_bench), "0.1"], capture_output=True, text=True)
+
+    assert result.returncode == 0, result.stdout
+    assert "scalar: all checks passed" in result.stdout
+    rows = {tuple(line.split()[:2]) for line in result.stdout.splitlines()[4:] if line.strip()}
+    for op in ("memcpy", "memset", "memcmp", "memchr", "strlen", "hash", "memmem"):
+        assert (op, "4096") in rows
+
@@ -0,0 +1,96 @@
+import os
+import shutil
+import socket
+import subprocess
+import tempfile
+import threading
+from pathlib import Path
+
+import pytest
+
+ROOT = Path(__file__).resolve().parents[1]
+
+
+@pytest.fixture(scope="session")
+def tools(tmp_path_factory):
+    """rustc_build_system with rustc_ppc beside it, where it looks first"""
+    cc = shutil.which("gcc") or shutil.which("cc")
+    if cc is None:
+        pytest.skip("no host C compiler")
+    bin_dir = tmp_path_factory.mktemp("bin")
+    for name, src in (("rbs", "rustc_build_system.c"), ("rustc_ppc", "rustc_100_percent.c")):
+        subprocess.run([cc, "-O2", "-o", str(bin_dir / name), str(ROOT / src)],
+                       check=True, capture_output=True)
+    return bin_dir
+
+
+def fake_toolchain(tmp_path):
+    """as, ar and gcc stand-ins that only log how they were called"""
+    fake = tmp_path / "fake"
+    fake.mkdir()
+    for tool in ("as", "ar", "gcc"):
+        script = fake / tool
+        script.write_text(f'#!/bin/sh\necho "{tool} $*" >> "$TOOL_LOG"\n', encoding="utf8")
+        script.chmod(0o755)
+    return fake
+
+
+def test_batch_keeps_the_files_that_compiled_when_one_fails(tools, tmp_path):
+    proj = tmp_path / "proj"
+    (proj / "src").mkdir(parents=True)
+    (proj / "Cargo.toml").write_text('[package]\nname = "demo"\nversion = "0.1.0"\n', encoding="utf8")
+    (proj / "src" / "main.rs").write_text("fn main() {\n}\n", encoding="utf8")
+    (proj / "src" / "bad.rs").write_text("fn b() {\n}\n", encoding="utf8")
+    # a directory where bad.s goes: rustc_ppc cannot write it
+    (proj / "target" / "powerpc-apple-darwin8" / "release" / "obj" / "demo" / "bad.s").mkdir(parents=True)
+
+    log = tmp_path / "tools.log"
+    env = dict(os.environ, TOOL_LOG=str(log),
+               PATH=f"{fake_toolchain(tmp_path)}{os.pathsep}{os.environ['PATH']}")
+    result = subprocess.run([str(tools / "rbs"), "build", "."], cwd=proj, env=env,
+                            capture_output=True, text=True)
+
+    assert "Error: Compilation failed for ./src/bad.rs" in result.stderr
+    assert "main.rs" not in result.stderr
+    assembled = [line for line in log.read_text(encoding="utf8").splitlines() if line.startswith("as ")]
+    assert len(assembled) == 1 and assembled[0].endswith("/obj/demo/main.s")
+
+
+def test_server_requests_carry_the_batch_flags(tools, tmp_path):
+    proj = tmp_path / "proj"
+    (proj / "src").mkdir(parents=True)
+    (proj / "Cargo.toml").write_text('[package]\nname = "demo"\nversion = "0.1.0"\n', encoding="utf8")
+    (proj / "src" / "main.rs").write_text("fn main() {\n}\n", encoding="utf8")
+
+    # a stand-in daemon that records each request and says ok
+    sock_dir = tempfile.mkdtemp(prefix="rb", dir="/tmp")
+    sock_path = f"{sock_dir}/s"
+    listener = socket.socket(socket.AF_UNIX)
+    listener.bind(sock_path)
+    listener.listen(1)
+    requests = []
+
+    def serve():
+        conn, _ = listener.accept()
+        with conn, conn.makefile("rw", encoding="utf8") as stream:
+            for line in stream:
+                requests.append(line.rstrip("\n"))
+                stream.write("ok\t%s\n" % line.split("\t")[3])
+                stream.flush()
+
+    daemon = threading.Thread(target=serve, daemon=True)
+    daemon.start()
+    try:
+        env = dict(os.environ, TOOL_LOG=str(tmp_path / "tools.log"),
+                   PATH=f"{fake_toolchain(tmp_path)}{os.pathsep}{os.environ['PATH']}")
+        subprocess.run([str(tools / "rbs"), "build", ".", "--debug", f"--server={sock_path}"],
+                       cwd=proj, env=env, capture_output=True, text=True, timeout=30)
+        daemon.join(timeout=5)
+    finally:
+        listener.close()
+        shutil.rmtree(sock_dir, ignore_errors=True)
+
+    assert len(requests) == 1
+    fields = requests[0].split("\t")
+    assert fields[0] == "compile" and fields[2] == "./src/main.rs"
+    assert "-g" in fields and "opt-level=0" in fields
@@ -0,0 +1,999 @@
+import shutil
+import socket
+import subprocess
+import tempfile
+import time
+from pathlib import Path
+
+import pytest
+
+ROOT = Path(__file__).resolve().parents[1]
+
+
+@pytest.fixture(scope="session")
+def rustc_ppc(tmp_path_factory):
+    cc = shutil.which("gcc") or shutil.which("cc")
+    if cc is None:
+        pytest.skip("no host C compiler")
+    exe = tmp_path_factory.mktemp("bin") / "rustc_ppc"
+    subprocess.run(
+        [cc, "-O2", "-o", str(exe), str(ROOT / "rustc_100_percent.c")],
+        check=True,
+    )
+    return exe
+
+
+def compile_rs(rustc_ppc, tmp_path, source, *flags):
+    src = tmp_path / "input.rs"
+    src.write_text(source, encoding="utf8")
+    result = subprocess.run(
+        [str(rustc_ppc), str(src), *flags],
+        check=True,
+        capture_output=True,
+        text=True,
+    )
+    return result.stdout
+
+
+def test_minimal_fixture_compiles(rustc_ppc):
+    result = subprocess.run(
+        [str(rustc_ppc), str(ROOT / "tests" / "minimal.rs")],
+        check=True,
+        capture_output=True,
+        text=True,
+    )
+
+    assert "_main:" in result.stdout
+    assert "li r14, 100" in result.stdout
+
+
+def test_fn_in_comments_and_strings_is_not_a_function(rustc_ppc, tmp_path):
+    asm = compile_rs(
+        rustc_ppc,
+        tmp_path,
+        """
+/* fn in_block_comment() { } */
+fn real(a: i32) -> i32 {
+    // fn in_line_comment() {}
+    let s = "fn in_string() { }";
+    let c = '{';
+    return a;
+}
+""",
+    )
+
+    assert "_real:" in asm
+    assert "in_block_comment" not in asm
+    assert "_in_line_comment" not in asm
+    assert "_in_string:" not in asm
+    assert '.asciz "fn in_string() { }"' in asm
+
+
+def test_shadowed_and_block_scoped_bindings_resolve_innermost(rustc_ppc, tmp_path):
+    asm = compile_rs(
+        rustc_ppc,
+        tmp_path,
+        """
+fn main() {
+    let x = 1;
+    let x = x + 1;
+    let y = x;
+    if y == 2 {
+        let x = 9;
+        let z = x;
+    }
+    let w = x;
+}
+""",
+    )
+
+    assert "lwz r14, 76(r1)   ; load x\n    stw r14, 80(r1)   ; y" in asm
+    assert "lwz r14, 84(r1)   ; load x\n    stw r14, 88(r1)   ; z" in asm
+    # the if-block's x is out of scope again, so w sees the second x
+    assert "lwz r14, 76(r1)   ; load x\n    stw r14, 84(r1)   ; w" in asm
+
+
+def test_bare_and_unsafe_blocks_end_their_bindings(rustc_ppc, tmp_path):
+    from ppc_sim import Program
+
+    source = (
+        "fn pick(x: i32) -> i32 {\n    let y = x;\n    {\n        let y = 100;\n    }\n"
+        "    unsafe {\n        let y = 7;\n    }\n    return y;\n}\n"
+        "fn main() {\n    let p = pick(5);\n}\n"
+    )
+    for level in ("0", "1", "2"):
+        program = Program(compile_rs(rustc_ppc, tmp_path, source, "-C", "opt-level=" + level))
+        assert program.call("pick", 5)[0] == 5, "opt-level=" + level
+
+
+def test_symtab_stats_reports_probes_per_lookup(rustc_ppc, tmp_path):
+    src = tmp_path / "input.rs"
+    src.write_text("fn main() {\n    let a = 1;\n    let b = a;\n}\n", encoding="utf8")
+    result = subprocess.run(
+        [str(rustc_ppc), str(src), "-Z", "symtab-stats"],
+        check=True,
+        capture_output=True,
+        text=True,
+    )
+
+    assert "probes/lookup" in result.stderr
+    assert "_main:" in result.stdout
+
+
+def test_tables_grow_past_old_fixed_limits(rustc_ppc, tmp_path):
+    structs = "\n".join(f"struct S{i} {{ a: i32 }}" for i in range(150))
+    wide = ", ".join(f"f{i}: i32" for i in range(40))
+    asm = compile_rs(
+        rustc_ppc,
+        tmp_path,
+        structs
+        + f"""
+struct Wide {{ {wide} }}
+impl Wide {{
+    fn last(&self) -> i32 {{
+        return self.f39;
+    }}
+}}
+fn main() {{
+    let x = 1;
+}}
+""",
+    )
+
+    assert "_Wide_last:" in asm
+    assert "lwz r3, 156(r3)  ; self.f39" in asm
+    assert "unresolved" not in asm
+
+
+def test_dash_o_writes_the_same_assembly_as_stdout(rustc_ppc, tmp_path):
+    src = ROOT / "tests" / "minimal.rs"
+    out = tmp_path / "minimal.s"
+    to_stdout = subprocess.run(
+        [str(rustc_ppc), str(src)], check=True, capture_output=True, text=True
+    )
+    to_file = subprocess.run(
+        [str(rustc_ppc), str(src), "-o", str(out), "-C", "opt-level=0"],
+        check=True,
+        capture_output=True,
+        text=True,
+    )
+
+    assert to_file.stdout == ""
+    assert out.read_text(encoding="utf8") == to_stdout.stdout
+
+
+def test_function_index_resolves_owner_paths_and_params(rustc_ppc, tmp_path):
+    asm = compile_rs(
+        rustc_ppc,
+        tmp_path,
+        """
+struct Foo { a: i32 }
+impl fmt::Display for Foo {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        return self.a;
+    }
+}
+fn pick(a: std::vec::Vec<u8>, (x, y): (i32, i32), b: i32) -> i32 {
+    return b;
+}
+fn make() -> impl Iterator<Item = i32> {
+    return 0;
+}
+fn main() {
+    let z = 1;
+}
+""",
+    )
+
+    assert "_Foo_fmt:" in asm
+    assert "lwz r3, 0(r3)  ; self.a" in asm
+    # the tuple pattern still takes r4, so b arrives in r5
+    assert "stw r5, 76(r1)    ; param b" in asm
+    assert "_make:" in asm
+
+
+def test_batch_mode_matches_single_file_output(rustc_ppc, tmp_path):
+    first = tmp_path / "first.rs"
+    second = tmp_path / "second.rs"
+    first.write_text(
+        'fn f(a: i32) -> i32 {\n    if a == 1 {\n        return 2;\n    }\n    return a;\n}\n'
+        'fn main() {\n    let s = "hi";\n    println!("{}", s);\n}\n',
+        encoding="utf8",
+    )
+    second.write_text(
+        'fn main() {\n    let t = "again";\n    let n = 3;\n    while n > 0 {\n        n = n - 1;\n    }\n}\n',
+        encoding="utf8",
+    )
+    listfile = tmp_path / "list"
+    listfile.write_text(
+        f"# comment\n{first}\n{tmp_path / 'missing.rs'}\n{second} {tmp_path / 'out2.s'}\n",
+        encoding="utf8",
+    )
+
+    result = subprocess.run(
+        [str(rustc_ppc), "--batch", str(listfile)], capture_output=True, text=True
+    )
+
+    assert result.returncode == 1
+    assert f"ok {first} -> {tmp_path / 'first.s'}" in result.stdout
+    assert f"FAILED {tmp_path / 'missing.rs'}" in result.stdout
+    assert "batch: 2 ok, 1 failed" in result.stdout
+    # label counters and string labels start from scratch for each file
+    for src, out in ((first, tmp_path / "first.s"), (second, tmp_path / "out2.s")):
+        single = subprocess.run(
+            [str(rustc_ppc), str(src)], check=True, capture_output=True, text=True
+        )
+        assert out.read_text(encoding="utf8") == single.stdout
+
+
+def test_serve_mode_compiles_requests_over_a_unix_socket(rustc_ppc, tmp_path):
+    sock_dir = tempfile.mkdtemp(prefix="rp", dir="/tmp")
+    sock_path = f"{sock_dir}/s"
+    # a relative socket path, resolved from the daemon's own directory
+    server = subprocess.Popen(
+        [str(rustc_ppc), "--serve", "s"], cwd=sock_dir, stderr=subprocess.DEVNULL
+    )
+    try:
+        for _ in range(100):
+            if Path(sock_path).exists():
+                break
+            time.sleep(0.02)
+        src = ROOT / "tests" / "minimal.rs"
+        out = tmp_path / "via_server.s"
+
+        # a client that connects and says nothing holds up no one else
+        idle = socket.socket(socket.AF_UNIX)
+        idle.connect(sock_path)
+        client = subprocess.run(
+            [str(rustc_ppc), "--client", sock_path, str(src), "-o", str(out),
+             "-C", "opt-level=0"],
+            capture_output=True,
+            text=True,
+            timeout=10,
+        )
+        missing = subprocess.run(
+            [str(rustc_ppc), "--client", sock_path, str(tmp_path / "nope.rs")],
+            capture_output=True,
+            text=True,
+        )
+        single = subprocess.run(
+            [str(rustc_ppc), str(src)], check=True, capture_output=True, text=True
+        )
+
+        assert client.returncode == 0
+        assert out.read_text(encoding="utf8") == single.stdout
+        assert missing.returncode == 1
+        assert "Cannot open file" in missing.stderr
+
+        # relative paths resolve from each client's own directory, not from
+        # wherever the previous request was
+        for name in ("first", "second"):
+            work = tmp_path / name
+            work.mkdir()
+            shutil.copy(src, work / "unit.rs")
+            relative = subprocess.run(
+                [str(rustc_ppc), "--client", sock_path, "unit.rs", "-o", "unit.s",
+                 "-C", "opt-level=0"],
+                cwd=work, capture_output=True, text=True,
+            )
+            assert relative.returncode == 0, relative.stderr
+            assert (work / "unit.s").read_text(encoding="utf8") == single.stdout
+        idle.close()
+
+        with socket.socket(socket.AF_UNIX) as conn:
+            conn.connect(sock_path)
+            conn.sendall(b"ping\nshutdown\n")
+            replies = b""
+            while replies.count(b"\n") < 2:
+                chunk = conn.recv(256)
+                if not chunk:
+                    break
+                replies += chunk
+        assert replies == b"ok\tpong\nok\tbye\n"
+        assert server.wait(timeout=5) == 0
+        assert not Path(sock_path).exists()
+    finally:
+        if server.poll() is None:
+            server.kill()
+        shutil.rmtree(sock_dir, ignore_errors=True)
+
+
+def test_parallel_batch_matches_sequential_output(rustc_ppc, tmp_path):
+    sources = []
+    for i in range(8):
+        src = tmp_path / f"unit{i}.rs"
+        src.write_text(
+            f"struct P{i} {{ x: i32, y: i32 }}\n"
+            f"impl P{i} {{\n    fn sum(&self) -> i32 {{\n        return self.y;\n    }}\n}}\n"
+            f'fn main() {{\n    let s = "file {i}";\n    let n = {i};\n'
+            "    while n > 0 {\n        n = n - 1;\n    }\n"
+            "    if n == 0 {\n        let t = 1;\n    }\n}\n",
+            encoding="utf8",
+        )
+        sources.append(src)
+    listfile = tmp_path / "list"
+    listfile.write_text("".join(f"{src}\n" for src in sources), encoding="utf8")
+
+    result = subprocess.run(
+        [str(rustc_ppc), "--batch", str(listfile), "-j", "4"],
+        check=True,
+        capture_output=True,
+        text=True,
+    )
+
+    assert "batch: 8 ok, 0 failed" in result.stdout
+    for src in sources:
+        single = subprocess.run(
+            [str(rustc_ppc), str(src)], check=True, capture_output=True, text=True
+        )
+        assert src.with_suffix(".s").read_text(encoding="utf8") == single.stdout
+
+
+def test_peephole_output_matches_golden(rustc_ppc):
+    # Regenerate after an intended codegen change with:
+    #   rustc_ppc tests/golden/peephole.rs -C opt-level=1 -o tests/golden/peephole.s
+    golden = ROOT / "tests" / "golden"
+    result = subprocess.run(
+        [str(rustc_ppc), str(golden / "peephole.rs"), "-C", "opt-level=1",
+         "-Z", "peephole-stats"],
+        check=True,
+        capture_output=True,
+        text=True,
+    )
+
+    assert result.stdout == (golden / "peephole.s").read_text(encoding="utf8")
+    assert ("peephole: store-load 6, redundant-move 5, copy-prop 4, branch-next 2, "
+            "cmp-imm 0, dead-label 1") in result.stderr
+    assert "mr r3, r14        ; load t" in result.stdout
+    assert "cmpwi r3, 0" in result.stdout
+
+
+def test_peephole_is_off_at_opt_level_0(rustc_ppc):
+    src = ROOT / "tests" / "golden" / "peephole.rs"
+    default = subprocess.run(
+        [str(rustc_ppc), str(src)], check=True, capture_output=True, text=True
+    )
+    o0 = subprocess.run(
+        [str(rustc_ppc), str(src), "-C", "opt-level=0", "-Z", "peephole-stats"],
+        check=True,
+        capture_output=True,
+        text=True,
+    )
+
+    assert default.stdout == o0.stdout
+    assert "peephole:" not in o0.stderr
+    assert "    lwz r3, 76(r1)   ; load t" in o0.stdout
+
+
+def test_opt_level_2_keeps_loop_locals_in_saved_registers(rustc_ppc, tmp_path):
+    src = tmp_path / "input.rs"
+    src.write_text(
+        "fn sum(n: i32) -> i32 {\n    let total = 0;\n    let i = 0;\n"
+        "    while i < n {\n        total = total + i;\n        i = i + 1;\n    }\n"
+        "    return total;\n}\nfn main() {\n    let s = sum(10);\n}\n",
+        encoding="utf8",
+    )
+    result = subprocess.run(
+        [str(rustc_ppc), str(src), "-C", "opt-level=2", "-Z", "peephole-stats"],
+        check=True,
+        capture_output=True,
+        text=True,
+    )
+    body = result.stdout.split("_sum:")[1].split(".globl")[0]
+
+    assert "(r1)   ; load" not in body
+    # a leaf: the loop registers are renamed into volatiles, so nothing is saved
+    assert "add r10, r10, r11" in body
+    assert "; save r" not in body
+    assert "regalloc: " in result.stderr
+
+
+def test_codegen_flags_select_target_and_pass_pipeline(rustc_ppc):
+    src = str(ROOT / "tests" / "minimal.rs")
+
+    def run(*flags):
+        return subprocess.run(
+            [str(rustc_ppc), src, *flags], check=True, capture_output=True, text=True
+        )
+
+    def passes(result):
+        return [line.split("\t")[1] for line in result.stderr.splitlines()
+                if line.startswith("time:")]
+
+    g5 = run("-C", "target-cpu=970", "-C", "opt-level=3", "-Z", "time-passes")
+    g3 = run("-Ctarget-cpu=750", "-Ctarget-feature=+altivec", "-Copt-level=1",
+             "-Z", "time-passes")
+    o0 = run("-C", "opt-level=0", "-Z", "time-passes", "-g")
+
+    assert ".machine ppc970\n" in g5.stdout
+    assert ".machine ppc7400\n" in g3.stdout
+    assert ".machine" not in o0.stdout
+    assert passes(g5) == ["codegen", "split-lines", "ir-build", "inline", "const-fold",
+                          "stack-color", "ir-lower", "regalloc", "peephole", "save-regs", "frame",
+                          "schedule", "reassemble", "write", "total"]
+    assert passes(g3) == ["codegen", "split-lines", "ir-build", "const-fold", "stack-color",
+                          "ir-lower", "peephole", "reassemble", "write", "total"]
+    assert passes(o0) == ["codegen", "write", "total"]
+
+
+def test_opt_level_takes_the_whole_value(rustc_ppc):
+    src = str(ROOT / "tests" / "minimal.rs")
+    for level in ("10", "9", "3x", ""):
+        result = subprocess.run(
+            [str(rustc_ppc), src, "-C", f"opt-level={level}"], capture_output=True, text=True
+        )
+        assert result.returncode == 1, level
+        assert f"needs to be between 0-3, s or z (instead was `{level}`)" in result.stderr
+        assert result.stdout == ""
+    for level in ("0", "3", "s", "z"):
+        subprocess.run([str(rustc_ppc), src, f"-Copt-level={level}"], check=True, capture_output=True)
+
+
+def test_o2_passes_scale_linearly_with_function_count(rustc_ppc, tmp_path):
+    def crate(n):
+        return "".join(
+            f"fn f{k}(a: i32, b: i32) -> i32 {{\n    let mut s = a;\n    let mut i = 0;\n"
+            f"    while i < b {{\n        s = s + i * {k};\n        i += 1;\n    }}\n"
+            f"    if s > 10 {{\n        return s - f{k}(a, 1);\n    }}\n    return s;\n}}\n"
+            for k in range(n)
+        )
+
+    def pass_times(n):
+        src = tmp_path / f"crate{n}.rs"
+        src.write_text(crate(n), encoding="utf8")
+        result = subprocess.run(
+            [str(rustc_ppc), str(src), "-C", "opt-level=2", "-Z", "time-passes",
+             "-o", str(tmp_path / f"crate{n}.s")],
+            check=True, capture_output=True, text=True,
+        )
+        return {line.split("\t")[1]: float(line.split()[1])
+                for line in result.stderr.splitlines() if line.startswith("time:")}
+
+    small, large = pass_times(1000), pass_times(4000)
+    # four times the functions: a pass doing per-function work over the whole
+    # file would take sixteen times as long
+    for name, seconds in large.items():
+        assert seconds <= 8 * small[name] + 0.05, (name, small[name], seconds)
+
+
+def test_emit_ir_dumps_blocks_vregs_and_explicit_memory(rustc_ppc, tmp_path):
+    source = (
+        "fn sum(n: i32) -> i32 {\n    let total = 0;\n    let i = 0;\n"
+        "    while i < n {\n        total = total + i;\n        i = i + 1;\n    }\n"
+        "    return total;\n}\nfn main() {\n    let s = sum(10);\n}\n"
+    )
+    import re
+
+    ir = compile_rs(rustc_ppc, tmp_path, source, "--emit=ir")
+
+    # the frame the entry sets up is the one the function header records
+    frame = re.search(r"^fn _sum frame (\d+)\nb0 _sum: -> b1\n    enter (\d+)\n", ir, re.M)
+    assert frame and frame.group(1) == frame.group(2) and int(frame.group(1)) % 16 == 0
+    assert "b1 Lwhile_0: -> b3, b2\n" in ir
+    # block-local temporaries get vregs; the r3 argument and result stay r3
+    assert re.search(r"    (v\d+) = load\.w \[r1 \+ \d+\]\n    (v\d+) = load\.w \[r1 \+ \d+\]\n"
+                     r"    cmp\.s cr0, \1, \2\n    branch ge cr0, b3\n", ir)
+    total = re.search(r"    (v\d+) = add v\d+, v\d+\n    store\.w \[r1 \+ (\d+)\], \1\n", ir)
+    assert total
+    # the loop's running total is what comes back
+    assert f"    r3 = load.w [r1 + {total.group(2)}]\n" in ir
+    assert "    r3 = const 10\n    call _sum\n" in ir
+
+
+def test_const_items_and_const_fn_fold_at_compile_time(rustc_ppc, tmp_path):
+    source = (
+        "const LIMIT: i32 = 7;\nconst MASK: u32 = (1 << 12) - 1;\n"
+        "const TABLE: [u16; 4] = [1, 2, 4, 8];\nconst DEBUG: bool = false;\n"
+        "static mut COUNTER: u32 = 10;\nstatic BIG: u64 = 0x1234_5678_9ABC_DEF0;\n"
+        "const fn fact(n: u32) -> u32 {\n    let mut acc = 1;\n    let mut i = n;\n"
+        "    while i > 1 {\n        acc *= i;\n        i -= 1;\n    }\n    return acc;\n}\n"
+        "const F5: u32 = fact(5);\n"
+        "fn scale(n: i32) -> i32 {\n    let a = F5 + TABLE[3] as i32;\n    let m = MASK;\n"
+        "    if DEBUG {\n        return 0;\n    }\n    COUNTER += 1;\n    return n * LIMIT;\n}\n"
+        "fn main() {\n    let x = scale(3);\n}\n"
+    )
+    o0 = compile_rs(rustc_ppc, tmp_path, source)
+    o1 = compile_rs(rustc_ppc, tmp_path, source, "-C", "opt-level=1")
+
+    assert "    li r14, 128\n    stw r14, 76(r1)   ; a\n" in o0
+    assert "    li r14, 4095\n    stw r14, 80(r1)   ; m\n" in o0
+    assert "    b Lelse_0\n" in o0
+    # statics live in .data; only const items vanish into immediates
+    assert "_COUNTER:\n    .long 10\n" in o0
+    assert ".align 3\n_BIG:\n    .long 305419896, 2596069104\n" in o0
+    assert "_LIMIT:" not in o0 and "_TABLE:" not in o0
+    assert "    lwz r14, lo16(_COUNTER)(r14)   ; static COUNTER\n" in o0
+    assert "    stw r14, lo16(_COUNTER)(r16)   ; static COUNTER\n" in o0
+    # const-fold turns the materialized operands into immediates
+    assert "    addi r14, r14, 1\n" in o1
+
+
+def test_const_overflow_is_a_compile_error(rustc_ppc, tmp_path):
+    source = (
+        "const fn sq(x: u32) -> u32 {\n    x * x\n}\n"
+        "const J2: u32 = sq(70000);\nconst J1: u32 = sq(65535);\n"
+        "fn f() -> i32 {\n    let a = i32::MAX + 1;\n    let b = 200u8 + 100;\n"
+        "    let c = 7 / 0;\n    return a;\n}\n"
+        "fn main() {\n    let x = J2;\n}\n"
+    )
+    src = tmp_path / "input.rs"
+    src.write_text(source, encoding="utf8")
+    out = tmp_path / "input.s"
+    result = subprocess.run([str(rustc_ppc), str(src), "-o", str(out)], capture_output=True, text=True)
+
+    assert result.returncode != 0 and not out.exists()
+    errors = sorted(result.stderr.splitlines())
+    assert errors == [
+        f"{src}:2: error: evaluation of constant `J2` failed: attempt to multiply with overflow",
+        f"{src}:7: error: attempt to add with overflow",
+        f"{src}:8: error: attempt to add with overflow",
+        f"{src}:9: error: attempt to divide by zero",
+    ]
+    # the same arithmetic in range, or in a branch not taken, still folds
+    ok = compile_rs(rustc_ppc, tmp_path, source.replace("70000", "3").replace(" + 1;", " - 1;")
+                    .replace("200u8 + 100", "200u8 + 55").replace("7 / 0", "if false { 7 / 0 } else { 1 }"))
+    assert "    li r14, 255\n    stw r14, 76(r1)   ; b\n" in ok
+
+
+def test_constant_divisors_become_shifts_and_multiply_high(rustc_ppc, tmp_path):
+    source = (
+        "const BYTES_PER_SECTOR: u32 = 512;\n"
+        "fn sectors(offset: u32) -> u32 {\n    let sector = offset / BYTES_PER_SECTOR;\n"
+        "    let within = offset % BYTES_PER_SECTOR;\n    let tens = offset / 10;\n"
+        "    return within;\n}\n"
+        "fn signed(x: i32) -> i32 {\n    let q = x / 10;\n    let h = x / 4;\n"
+        "    let r = x % -8;\n    let m = x * 9;\n    return q;\n}\n"
+        "fn main() {\n    let c = sectors(4096);\n    let s = signed(-7);\n}\n"
+    )
+    asm = compile_rs(rustc_ppc, tmp_path, source)
+    o2 = compile_rs(rustc_ppc, tmp_path, source, "-C", "opt-level=2")
+
+    for out in (asm, o2):
+        assert "divw" not in out
+    assert "    srwi r14, r14, 9\n    stw r14, 76(r1)   ; sector\n" in asm
+    assert "    clrlwi r14, r14, 23\n    stw r14, 80(r1)   ; within\n" in asm
+    # unsigned / 10: 0xCCCCCCCD, mulhwu, >> 3
+    assert ("    lis r15, 0xCCCC\n    ori r15, r15, 0xCCCD\n    mulhwu r15, r14, r15\n"
+            "    srwi r14, r15, 3\n") in asm
+    # signed / 10: 0x66666667, mulhw, >> 2, then add the sign bit
+    assert ("    mulhw r15, r14, r15\n    srawi r15, r15, 2\n    srwi r0, r15, 31\n"
+            "    add r14, r15, r0\n") in asm
+    # signed / 4 rounds toward zero without divw
+    assert ("    srawi r15, r14, 31\n    srwi r15, r15, 30\n    add r15, r14, r15\n"
+            "    srawi r14, r15, 2\n") in asm
+    assert "    slwi r15, r14, 3\n    add r14, r14, r15\n    stw r14, 88(r1)   ; m\n" in asm
+
+
+def test_unsigned_divisors_with_the_top_bit_set(rustc_ppc, tmp_path):
+    from ppc_sim import Program
+
+    source = (
+        "fn q_max(x: u32) -> u32 {\n    return x / 4294967295;\n}\n"
+        "fn r_max(x: u32) -> u32 {\n    return x % 4294967295;\n}\n"
+        "fn q_3g(x: u32) -> u32 {\n    return x / 3000000000;\n}\n"
+        "fn r_3g(x: u32) -> u32 {\n    return x % 3000000000;\n}\n"
+        "fn main() {\n    let a = q_max(1);\n}\n"
+    )
+    for level in ("0", "1", "2"):
+        asm = compile_rs(rustc_ppc, tmp_path, source, "-C", "opt-level=" + level)
+        # the quotient is 0 or 1: no divide, signed or not
+        assert "divw" not in asm
+        program = Program(asm)
+        for x in (0, 1, 2999999999, 3000000000, 3000000001, 0x7FFFFFFF, 0x80000000, 4294967294, 4294967295):
+            assert program.call("q_max", x)[0] == x // 4294967295, (level, x)
+            assert program.call("r_max", x)[0] == x % 4294967295, (level, x)
+            assert program.call("q_3g", x)[0] == x // 3000000000, (level, x)
+            assert program.call("r_3g", x)[0] == x % 3000000000, (level, x)
+
+
+def test_counted_for_loops_use_ctr_and_register_induction_variables(rustc_ppc, tmp_path):
+    source = (
+        "fn tri(n: i32) -> i32 {\n    let mut s = 0;\n    for i in 1..=n {\n        s = s + i;\n    }\n"
+        "    return s;\n}\n"
+        "fn down(n: i32) -> i32 {\n    let mut s = 0;\n    for i in (0..n).step_by(4).rev() {\n"
+        "        s = s * 3 + i;\n    }\n    return s;\n}\n"
+        "fn dot(n: i32) -> i32 {\n    let a = [3, 5, 7, 9];\n    let mut s = n;\n"
+        "    for (i, x) in a.iter().enumerate() {\n        s = s + *x;\n        s = s + i;\n    }\n"
+        "    return s;\n}\n"
+        "fn main() {\n    let a = tri(10);\n    let b = down(9);\n    let c = dot(1);\n}\n"
+    )
+    asm = compile_rs(rustc_ppc, tmp_path, source)
+    o2 = compile_rs(rustc_ppc, tmp_path, source, "-C", "opt-level=2")
+
+    # 1..=n: guard, inclusive trip count into CTR, i lives in r12
+    assert ("    li r12, 1\n    lwz r14, 72(r1)   ; load n\n    cmpw r12, r14\n    bgt Lendfor_0\n"
+            "    sub r15, r14, r12\n    addi r15, r15, 1\n    mtctr r15\n") in asm
+    assert "    addi r12, r12, 1\n    bdnz Lfor_0\n" in asm
+    # step_by(4).rev() starts at the last stepped element and counts down
+    assert "    add r12, r12, r14\n    mtctr r15\n" in asm
+    assert "    addi r12, r12, -4\n    bdnz Lfor_1\n" in asm
+    # enumerate walks the array with lwzu and counts the index in a register
+    assert "    la r10, 76(r1)   ; &a, 16 bytes\n    addi r10, r10, -4\n    li r11, 0\n" in asm
+    assert "    lwzu r12, 4(r10)\n" in asm
+    for out in (asm, o2):
+        assert "b Lfor_" not in out
+    for label in ("Lfor_0:", "Lfor_1:", "Lfor_2:"):
+        body = o2.split(label + "\n")[1].split("bdnz")[0]
+        assert "(r1)" not in body
+
+
+def test_dense_matches_use_jump_tables_and_sparse_ones_binary_search(rustc_ppc, tmp_path):
+    source = (
+        "enum Op {\n    Nop,\n    Load,\n    Store,\n    Add,\n    Jump = 10,\n    Call,\n}\n"
+        "fn dense(x: i32) -> i32 {\n    let mut s = 1;\n    match x {\n"
+        "        Op::Nop => { s = 10; }\n        Op::Load => { s = 11; }\n        Op::Store => { s = 12; }\n"
+        "        Op::Add => { s = 13; }\n        Op::Jump => { s = 14; }\n        Op::Call => { s = 15; }\n"
+        "    }\n    return s;\n}\n"
+        "fn sparse(x: i32) -> i32 {\n    let r = match x {\n        1 => 1,\n        10 => 2,\n"
+        "        100 => 3,\n        1000 | 1001 => 4,\n        -5 => 7,\n        _ => 0,\n    };\n    return r;\n}\n"
+        "fn main() {\n    let a = dense(1);\n    let b = sparse(2);\n}\n"
+    )
+    src = tmp_path / "match.rs"
+    src.write_text(source, encoding="utf8")
+    result = subprocess.run(
+        [str(rustc_ppc), str(src), "-C", "opt-level=2", "-Z", "match-stats"],
+        check=True, capture_output=True, text=True,
+    )
+    import re
+
+    asm = result.stdout
+    dense = asm.split("_dense:")[1].split("_sparse:")[0]
+
+    assert "match: line 11, 6 arms, 6 cases, span 12: jump table" in result.stderr
+    assert "match: line 22, 6 arms, 6 cases, span 1007: binary search" in result.stderr
+    # bounds check, then an indirect branch through a table in __TEXT,__const
+    assert re.search(r"    cmplwi r\d+, 11\n    bgt Lmatch_stmt_end_0\n", dense)
+    assert re.search(r"    mtctr r\d+\n    bctr\n    \.section __TEXT,__const\n    \.align 2\n"
+                     r"Lmatch_stmt_table_0:\n", dense)
+    table = asm.split("Lmatch_stmt_table_0:\n")[1].split("    .text\n")[0].splitlines()
+    assert len(table) == 12
+    assert table[3] == "    .long Lmatch_stmt_arm_0_3"
+    assert table[4] == "    .long Lmatch_stmt_end_0"
+    assert table[10] == "    .long Lmatch_stmt_arm_0_4"
+    # the promoted local survives the dispatch: every arm sets the register
+    # the end returns, and nothing goes through the stack
+    s_reg = re.search(r"Lmatch_stmt_arm_0_0:\n    li (r\d+), 10\n", dense).group(1)
+    assert f"Lmatch_stmt_arm_0_5:\n    li {s_reg}, 15\nLmatch_stmt_end_0:\n    mr r3, {s_reg} " in dense
+    assert "(r1)" not in dense
+    # sparse values: one compare per search node
+    assert re.search(r"    cmpwi r\d+, 10\n    beq Lmatch_let_arm_0_1\n    blt Lmatch_let_lt_0_0\n", asm)
+    assert "bctr" not in asm.split("_sparse:")[1].split("blr")[0]
+
+
+def test_conditions_branch_on_cr_fields_and_short_circuit(rustc_ppc, tmp_path):
+    source = (
+        "fn both(a: i32, b: i32, c: i32) -> i32 {\n    if a < b && b < c || c == 7 {\n"
+        "        return 1;\n    }\n    return 0;\n}\n"
+        "fn count(a: i32, b: i32, c: i32) -> i32 {\n    let mut n = 0;\n    let mut i = a;\n"
+        "    while i < b && !(n >= c) {\n        n = n + 1;\n        i = i + 1;\n    }\n    return n;\n}\n"
+        "fn main() {\n    let x = both(1, 2, 3);\n    let y = count(0, 5, 3);\n}\n"
+    )
+    asm = compile_rs(rustc_ppc, tmp_path, source, "-C", "opt-level=2")
+    both = asm.split("_both:")[1].split("blr")[0]
+    count = asm.split("_count:")[1].split("blr")[0]
+
+    assert "mfcr" not in asm
+    # both compares of the && run issue before either branch, in cr0 and cr1
+    assert "    cmpw r3, r4\n    cmpw cr1, r4, r5\n    bge Lcond_1\n    blt cr1, Lcond_0\nLcond_1:\n" in both
+    assert "    cmpwi r12, 7\n    bne Lelse_0\nLcond_0:\n" in both
+    # the negated group folds into the branch sense
+    assert "Lwhile_0:\n    cmpw r8, r9\n    bge Lendwhile_0\n    cmpw r11, r10\n    bge Lendwhile_0\n" in count
+
+
+def test_leaf_functions_drop_the_frame_and_use_the_red_zone(rustc_ppc, tmp_path):
+    wide = "".join("    let v%d = a + %d;\n" % (i, i) for i in range(22))
+    source = (
+        "fn wide(a: i32) -> i32 {\n" + wide
+        + "    let t = " + " + ".join("v%d" % i for i in range(22)) + ";\n    return t;\n}\n"
+        "#[inline(never)]\nfn inc(a: i32) -> i32 {\n    return a + 1;\n}\n"
+        "fn twice(x: i32) -> i32 {\n    let y = inc(x);\n    let z = inc(y);\n    return y + z;\n}\n"
+        "fn main() {\n    let r = wide(3);\n    let s = twice(4);\n}\n"
+    )
+    src = tmp_path / "leaf.rs"
+    src.write_text(source, encoding="utf8")
+    result = subprocess.run(
+        [str(rustc_ppc), str(src), "-C", "opt-level=2", "-Z", "peephole-stats"],
+        check=True, capture_output=True, text=True,
+    )
+    asm = result.stdout
+    leaf = asm.split("_wide:")[1].split("blr")[0]
+    inc = asm.split("_inc:")[1].split("blr")[0]
+    twice = asm.split("_twice:")[1].split(".globl")[0]
+
+    assert "frame: 3 leaf functions, 3 without a frame" in result.stderr
+    # no LR save and no frame: spills and saves live below the caller's r1
+    assert "mflr" not in leaf and "stwu" not in leaf
+    assert "    stw r31, -4(r1)   ; save r31\n" in leaf
+    assert "lwz r31, -4(r1)   ; restore r31" in leaf
+    assert "(r1)  ; v15" in leaf and "-72(r1)" in leaf
+    # small leaves keep everything in volatile registers
+    assert "; save r" not in inc and "(r1)" not in inc
+    # a caller keeps its LR save but its frame shrinks to what it holds
+    assert "    mflr r0\n    stw r0, 8(r1)\n    stwu r1, -96(r1)" in twice
+    assert twice.count("addi r1, r1, 96") == twice.count("blr") == 2
+    assert "stw r31, 92(r1)   ; save r31" in twice
+
+
+def test_small_functions_and_inline_metadata_are_inlined(rustc_ppc, tmp_path):
+    lib = tmp_path / "byteorder.rs"
+    lib.write_text(
+        "#[inline]\npub fn lo8(x: u32) -> u32 {\n    let v = x & 255;\n    return v;\n}\n"
+        "#[inline]\npub fn hi8(x: u32) -> u32 {\n    let v = x >> 8;\n    let w = v & 255;\n    return w;\n}\n"
+        "pub fn plain(x: u32) -> u32 {\n    return x + 1;\n}\n",
+        encoding="utf8",
+    )
+    app = tmp_path / "app.rs"
+    app.write_text(
+        "use byteorder::lo8;\n"
+        "fn sq(a: u32) -> u32 {\n    return a * a;\n}\n"
+        "#[inline(never)]\nfn kept(a: u32) -> u32 {\n    return a + 2;\n}\n"
+        "fn total(n: u32) -> u32 {\n    let mut s = 0;\n    let mut i = 0;\n"
+        "    while i < n {\n        let a = lo8(i);\n        let b = byteorder::hi8(i);\n"
+        "        let c = sq(a);\n        let d = kept(b);\n"
+        "        s = s + c + d;\n        i = i + 1;\n    }\n    return s;\n}\n"
+        "fn main() {\n    let t = total(10);\n}\n",
+        encoding="utf8",
+    )
+    subprocess.run(
+        [str(rustc_ppc), str(lib), "-C", "opt-level=2", "--emit=asm,metadata",
+         "-o", str(tmp_path / "byteorder.s")],
+        check=True, capture_output=True, text=True,
+    )
+    meta = (tmp_path / "byteorder.rmeta").read_text(encoding="utf8")
+    result = subprocess.run(
+        [str(rustc_ppc), str(app), "-C", "opt-level=2", "-Z", "peephole-stats",
+         "--extern", "byteorder=" + str(tmp_path / "byteorder.rmeta")],
+        check=True, capture_output=True, text=True,
+    )
+    total = result.stdout.split("_total:")[1].split(".globl")[0]
+
+    # only the exported #[inline] bodies go into the metadata
+    assert meta.startswith("rustc_ppc metadata 1\n")
+    assert "inline _lo8 hint\n" in meta and "inline _hi8 hint\n" in meta
+    assert "_plain" not in meta
+    assert "inline: 3 calls inlined, 2 from other crates" in result.stderr
+    assert "bl _sq" not in total and "bl _byteorder" not in total
+    assert "bl _kept" in total
+
+
+def test_stack_slots_with_disjoint_lifetimes_share_offsets(rustc_ppc, tmp_path):
+    src = tmp_path / "slots.rs"
+    src.write_text(
+        "fn chain(n: i32) -> i32 {\n    let a = n + 1;\n    let b = a * 3;\n"
+        "    let c = b - n;\n    let d = c * c;\n    return d;\n}\n"
+        "fn both(n: i32) -> i32 {\n    let a = n + 1;\n    let b = n + 2;\n"
+        "    let c = a * b;\n    return c;\n}\n"
+        "fn main() {\n    let x = chain(4);\n    let y = both(5);\n}\n",
+        encoding="utf8",
+    )
+
+    def compile(level):
+        return subprocess.run(
+            [str(rustc_ppc), str(src), "-C", "opt-level=" + level, "-Z", "peephole-stats"],
+            check=True, capture_output=True, text=True,
+        )
+
+    o0 = compile("0").stdout
+    o1 = compile("1")
+    chain = o1.stdout.split("_chain:")[1].split("_both:")[0]
+    both = o1.stdout.split("_both:")[1].split("_main:")[0]
+
+    assert "stw r14, 88(r1)   ; d" in o0 and "stwu r1, -256(r1)  ; frame for chain" in o0
+    assert "stack-color: 6 slots shared" in o1.stderr
+    # each binding takes the slot of one that is already dead ...
+    assert "stw r14, 76(r1)   ; b" in chain
+    assert "stw r14, 72(r1)   ; c" in chain and "stw r14, 72(r1)   ; d" in chain
+    # ... but never one still to be read
+    assert "stw r14, 76(r1)   ; a" in both and "stw r14, 72(r1)   ; b" in both
+    # and the frame holds the slots left plus the save area
+    assert "stwu r1, -160(r1) ; frame for chain" in chain
+    assert chain.count("addi r1, r1, 160") == 2
+
+
+def test_altivec_kernel_model_matches_plain_loops(tmp_path):
+    cc = shutil.which("gcc") or shutil.which("cc")
+    if cc is None:
+        pytest.skip("no host C compiler")
+    exe = tmp_path / "altivec_model"
+    subprocess.run([cc, "-O2", "-o", str(exe), str(ROOT / "tests" / "altivec_model.c")], check=True)
+    result = subprocess.run([str(exe)], capture_output=True, text=True)
+    assert result.returncode == 0, result.stdout
+    assert result.stdout.endswith(" 0 failures\n")
+
+
+def test_slice_loops_vectorize_with_altivec(rustc_ppc, tmp_path):
+    source = (
+        "fn total(a: &[u8]) -> u32 {\n    let mut s: u32 = 0;\n"
+        "    for x in a.iter() {\n        s += *x as u32;\n    }\n    return s;\n}\n"
+        "fn threes(a: &[u16]) -> u32 {\n    let mut c: u32 = 0;\n"
+        "    for x in a {\n        if *x == 3 { c += 1; }\n    }\n    return c;\n}\n"
+        "fn scale(a: &mut [f32], b: &[f32]) {\n"
+        "    for (d, s) in a.iter_mut().zip(b.iter()) {\n        *d = *d * *s;\n    }\n}\n"
+        "fn fill(a: &mut [u32]) {\n    for x in a.iter_mut() {\n        *x = 7;\n    }\n}\n"
+        "fn main() {\n    let v = [1, 2, 3];\n}\n"
+    )
+    altivec = ("-C", "target-feature=+altivec", "-C", "opt-level=2")
+    vector = compile_rs(rustc_ppc, tmp_path, source, *altivec, "-C", "fp-contract=fast")
+    total = vector.split("_total:")[1].split("_threes:")[0]
+    threes = vector.split("_threes:")[1].split("_scale:")[0]
+    scale = vector.split("_scale:")[1].split("_fill:")[0]
+    fill = vector.split("_fill:")[1].split("_main:")[0]
+
+    assert "; for x in a.iter(): sum, 16 lanes" in total
+    # scalar head to a quadword boundary, whole quadwords, scalar tail
+    assert "andi. " in total and "lvx v0, 0, r3" in total and "vmsumubm v7, v0, v6, v7" in total
+    assert "mfspr r0, 256" in total and "mtspr 256, r0" in total
+    assert "Lvtail_" in total and "lbz " in total
+    assert "vcmpequh v0, v0, v4" in threes and "vmsumuhm" in threes
+    # the source is realigned to the destination
+    assert "lvsl v3, 0, r4" in scale and "vperm v1, v1, v2, v3" in scale
+    assert "vmaddfp v0, v0, v1, v5" in scale and "stvx v0, 0, r3" in scale
+    # a fill only stores, and the parameters need no copies around it
+    fill_loop = fill.split("Lvloop_")[1].split("bdnz")[0]
+    assert "stvx " in fill_loop and "lvx " not in fill_loop
+    assert "; param a" not in fill
+
+    # f32 arithmetic flushes denormals in AltiVec: vector only under fp-contract=fast
+    exact = compile_rs(rustc_ppc, tmp_path, source, *altivec)
+    scale = exact.split("_scale:")[1].split("_fill:")[0]
+    assert ": map, scalar" in scale and "fmuls f0, f0, f3" in scale and "vmaddfp" not in scale
+    assert "; for x in a.iter(): sum, 16 lanes" in exact
+
+    # without AltiVec, or below opt-level 2, only the scalar loop is left
+    for flags in (("-C", "opt-level=2"), ("-C", "target-feature=+altivec", "-C", "opt-level=1")):
+        scalar = compile_rs(rustc_ppc, tmp_path, source, *flags)
+        assert "; for x in a.iter(): sum, scalar" in scalar
+        assert "lvx" not in scalar and "VRSAVE" not in scalar
+        assert "lbz " in scalar.split("_total:")[1].split("_threes:")[0]
+
+
+def test_64_bit_integers_match_the_host_c_compiler(rustc_ppc, tmp_path):
+    from ppc_sim import Program
+
+    cc = shutil.which("gcc") or shutil.which("cc")
+    host = tmp_path / "wide64_host"
+    subprocess.run([cc, "-std=c99", "-O2", "-o", str(host), str(ROOT / "tests" / "wide64_host.c")], check=True)
+    calls = subprocess.run([str(host)], check=True, capture_output=True, text=True).stdout.splitlines()
+
+    # the scheduled code of each pipeline computes the same; plain opt-level=2 last
+    for level in ("0", "1", "2 -C target-cpu=750", "2 -C target-cpu=7450", "2 -C target-cpu=970", "2"):
+        asm = subprocess.run(
+            [str(rustc_ppc), str(ROOT / "tests" / "wide64.rs"), "-C", *("opt-level=" + level).split()],
+            check=True, capture_output=True, text=True,
+        ).stdout
+        program = Program(asm)
+        wrong = []
+        for line in calls:
+            fn, *args, _, want = line.split()
+            words = []
+            for arg in args:
+                kind, value = arg[0], int(arg[2:], 16)
+                words += [value >> 32, value & 0xFFFFFFFF] if kind == "q" else [value]
+            hi, lo = program.call(fn, *words)
+            got = "q:%x" % (hi << 32 | lo) if want[0] == "q" else "w:%x" % hi
+            if got != want:
+                wrong.append("%s: got %s" % (line, got))
+        assert not wrong, "opt-level=%s, %d wrong:\n%s" % (level, len(wrong), "\n".join(wrong[:10]))
+
+    # register pairs: carries through XER, partial products, libgcc for /
+    add = asm.split("_add:")[1].split("_sub:")[0]
+    assert "addc r" in add and "adde r" in add
+    mul = asm.split("_mul:")[1].split("_affine:")[0]
+    assert "mulhwu" in mul and "bl " not in mul
+    udiv = asm.split("_udiv:")[1].split("_sdiv:")[0]
+    assert "bl ___udivdi3" in udiv and "bl ___umoddi3" in udiv
+    # a power-of-two divisor or modulus needs no call
+    assert udiv.count("bl ___") == 2
+    assert "bl ___divdi3" in asm.split("_sdiv:")[1].split("_less:")[0]
+
+
+def test_scheduler_tunes_for_the_target_cpu(rustc_ppc):
+    import re
+
+    def run(cpu):
+        return subprocess.run(
+            [str(rustc_ppc), str(ROOT / "tests" / "floats.rs"), "-C", "opt-level=2", "-C", "target-cpu=" + cpu,
+             "-Z", "schedule-stats"],
+            check=True, capture_output=True, text=True,
+        )
+
+    g4, g5 = run("7450"), run("970")
+    for result, cpu in ((g4, "7450"), (g5, "970")):
+        report = re.findall(r"^schedule: (_\w+) (\d+) -> (\d+) cycles$", result.stderr, re.M)
+        total = re.search(r"^schedule: (\d+) functions, (\d+) -> (\d+) cycles, \d+ of \d+ runs reordered "
+                          r"for the (\w+)$", result.stderr, re.M)
+        # one estimate per function, never worse than the order codegen gave
+        assert {"_mixed", "_eta", "_loop_sum"} <= {name for name, _, _ in report}
+        assert all(int(after) <= int(before) for _, before, after in report)
+        assert total.group(4) == cpu and int(total.group(1)) == len(report)
+        assert int(total.group(3)) < int(total.group(2))
+        # the literal pool address is formed ahead of the frame load
+        mixed = result.stdout.split("_mixed:")[1].split("_percent:")[0]
+        pool = re.search(r"lis r\d+, ha16\(Lfconst_", mixed)
+        frame_load = re.search(r"lfd f\d+, -\d+\(r1\)", mixed)
+        assert pool and frame_load and pool.start() < frame_load.start()
+    # different pipelines, different code
+    assert g4.stdout.replace("ppc7450", "") != g5.stdout.replace("ppc970", "")
+    assert "schedule:" not in subprocess.run(
+        [str(rustc_ppc), str(ROOT / "tests" / "floats.rs"), "-C", "opt-level=1", "-Z", "schedule-stats"],
+        check=True, capture_output=True, text=True,
+    ).stderr
+
+
+def test_floats_match_the_host_c_compiler(rustc_ppc, tmp_path):
+    import math
+    import re
+    import struct
+    from fractions import Fraction
+
+    from ppc_sim import Program, bits_of, double, single
+
+    cc = shutil.which("gcc") or shutil.which("cc")
+    host = tmp_path / "floats_host"
+    subprocess.run([cc, "-std=c99", "-O2", "-ffp-contract=off", "-o", str(host),
+                    str(ROOT / "tests" / "floats_host.c"), "-lm"], check=True)
+    calls = subprocess.run([str(host)], check=True, capture_output=True, text=True).stdout.splitlines()
+
+    def f32(bits):
+        return struct.unpack(">f", struct.pack(">I", bits))[0]
+
+    def f32_bits(x):
+        return struct.unpack(">I", struct.pack(">f", single(x)))[0]
+
+    def is_nan(tag):
+        return tag[0] in "ds" and math.isnan(double(int(tag[2:], 16)) if tag[0] == "d" else f32(int(tag[2:], 16)))
+
+    for level in ("0", "1", "2 -C target-cpu=750", "2 -C target-cpu=7450", "2 -C target-cpu=970", "2"):
+        asm = subprocess.run(
+            [str(rustc_ppc), str(ROOT / "tests" / "floats.rs"), "-C", *("opt-level=" + level).split()],
+            check=True, capture_output=True, text=True,
+        ).stdout
+        program = Program(asm)
+        wrong = []
+        for line in calls:
+            fn, *args, _, want = line.split()
+            # floats go to f1 up and still take their GPR words
+            words, fprs = [], []
+            for arg in args:
+                kind, value = arg[0], int(arg[2:], 16)
+                if kind == "d":
+                    fprs.append(double(value))
+                    words += [0, 0]
+                elif kind == "s":
+                    fprs.append(f32(value))
+                    words += [0]
+                else:
+                    words += [value >> 32, value & 0xFFFFFFFF] if kind == "q" else [value]
+            hi, lo = program.call(fn, *words, fprs=fprs)
+            got = {"d": lambda: "d:%x" % bits_of(program.f1), "s": lambda: "s:%x" % f32_bits(program.f1),
+                   "q": lambda: "q:%x" % (hi << 32 | lo), "w": lambda: "w:%x" % hi}[want[0]]()
+            # a NaN's sign is the host's
+            if got != want and not (is_nan(want) and is_nan(got)):
+                wrong.append("%s: got %s" % (line, got))
+        assert not wrong, "opt-level=%s, %d wrong:\n%s" % (level, len(wrong), "\n".join(wrong[:10]))
+
+    # compares in CR fields, conversions through fctiwz and the frame
+    assert "fcmpu cr0" in asm.split("_order:")[1].split("_dot:")[0]
+    assert "fctiwz" in asm.split("_to_i32:")[1].split("_to_u8:")[0]
+    assert "bl ___fixdfdi" in asm.split("_to_i64:")[1].split("_to_u64:")[0]
+    assert "fmadd f1, f1, f2, f3" in asm.split("_fused:")[1].split("_call_chain:")[0]
+    # at opt-level=2 the loop's f64 locals stay in FPRs
+    loop_sum = asm.split("_loop_sum:")[1].split("_single:")[0]
+    assert not re.search(r"(lfd|stfd) f\d+, -?\d+\(r1\)", loop_sum) and "fmr f13, f1" in loop_sum
+    assert "regalloc: " in subprocess.run(
+        [str(rustc_ppc), str(ROOT / "tests" / "floats.rs"), "-C", "opt-level=2", "-Z", "peephole-stats"],
+        check=True, capture_output=True, text=True,
+    ).stderr
+
+    # a * b + c contracts only when asked, and then rounds once
+    assert "fmsub" not in asm.split("_poly:")[1].split("_mixed:")[0]
+    fast = subprocess.run(
+        [str(rustc_ppc), str(ROOT / "tests" / "floats.rs"), "-C", "opt-level=2", "-C", "fp-contract=fast"],
+        check=True, capture_output=True, text=True,
+    ).stdout
+    assert "fmsub f1" in fast.split("_poly:")[1].split("_mixed:")[0]
+    program = Program(fast)
+    for x in (0.1, 1.0 / 3, 2.75, -98765.4321):
+        want = float(Fraction(3.0 * x) * Fraction(x) - Fraction(2.0 * x)) + 0.5
+        program.call("poly", 0, 0, fprs=[x])
+        assert program.f1 == want
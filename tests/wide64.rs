@@ -0,0 +1,86 @@
+fn add(a: u64, b: u64) -> u64 {
+    return a + b;
+}
+
+fn sub(a: u64, b: u64) -> u64 {
+    return a - b;
+}
+
+fn mul(a: u64, b: u64) -> u64 {
+    return a * b;
+}
+
+fn affine(a: u64, b: u64) -> u64 {
+    return a * 1000003 + b * 3 - 7;
+}
+
+fn shl(a: u64, n: u32) -> u64 {
+    return a << n;
+}
+
+fn shr(a: u64, n: u32) -> u64 {
+    return a >> n;
+}
+
+fn sar(a: i64, n: u32) -> i64 {
+    return a >> n;
+}
+
+fn rotate(a: u64, b: u64) -> u64 {
+    return (a << 13 | a >> 51) ^ (b << 32) ^ (b >> 40) ^ (a as i64 >> 33) as u64;
+}
+
+fn udiv(a: u64, b: u64) -> u64 {
+    return a / b + a % b * 3 + a / 16 + a % 4096;
+}
+
+fn sdiv(a: i64, b: i64) -> i64 {
+    return a / b * 3 + a % b;
+}
+
+fn less(a: u64, b: u64) -> u32 {
+    if a < b {
+        return 1;
+    }
+    return 0;
+}
+
+fn sless(a: i64, b: i64) -> u32 {
+    if a <= b {
+        return 1;
+    }
+    return 0;
+}
+
+fn same(a: u64, b: u64) -> u32 {
+    if a == b || a > 0xFFFFFFFF && b != 0 {
+        return 1;
+    }
+    return 0;
+}
+
+fn widen(x: i32, y: u32) -> i64 {
+    return x as i64 * y as i64 - x as i64 + (x as u8) as i64 + (y as i16) as i64;
+}
+
+fn narrow(a: u64) -> u32 {
+    return (a >> 32) as u32 ^ a as u32;
+}
+
+fn mixed(a: u64, b: u64) -> u64 {
+    let mut acc: u64 = a;
+    acc += b * 3;
+    acc ^= acc >> 17;
+    acc -= 12345;
+    acc *= 0x9E3779B97F4A7C15;
+    let c = acc & 0xFFFF0000FFFF;
+    return c | acc % 4096 + acc / 16 + (acc & 0xFF00);
+}
+
+fn caller(a: u64, b: u64) -> u64 {
+    return add(a, 1u64 << 40) + mul(a, b) - sub(b, a);
+}
+
+fn main() {
+    let z = add(1u64, 2);
+}
@@ -0,0 +1,93 @@
+/*
+ * wide64_host.c — the functions of wide64.rs in C, for the host
+ *
+ * Prints one line per call: the function, its arguments and the result,
+ * each tagged q (64-bit) or w (32-bit), for the test to replay on the
+ * compiled PowerPC code. Unsigned arithmetic stands in for Rust's
+ * wrapping where signed C would overflow.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef uint64_t u64;
+typedef int64_t i64;
+typedef uint32_t u32;
+typedef int32_t i32;
+
+static u64 add(u64 a, u64 b) { return a + b; }
+static u64 sub(u64 a, u64 b) { return a - b; }
+static u64 mul(u64 a, u64 b) { return a * b; }
+static u64 affine(u64 a, u64 b) { return a * 1000003 + b * 3 - 7; }
+static u64 shl(u64 a, u32 n) { return a << n; }
+static u64 shr(u64 a, u32 n) { return a >> n; }
+static i64 sar(i64 a, u32 n) { return a >> n; }
+
+static u64 rotate(u64 a, u64 b) {
+    return (a << 13 | a >> 51) ^ (b << 32) ^ (b >> 40) ^ (u64)((i64)a >> 33);
+}
+
+static u64 udiv(u64 a, u64 b) { return a / b + a % b * 3 + a / 16 + a % 4096; }
+static i64 sdiv(i64 a, i64 b) { return (i64)((u64)(a / b) * 3 + (u64)(a % b)); }
+static u32 less(u64 a, u64 b) { return a < b; }
+static u32 sless(i64 a, i64 b) { return a <= b; }
+static u32 same(u64 a, u64 b) { return a == b || (a > 0xFFFFFFFF && b != 0); }
+
+static i64 widen(i32 x, u32 y) {
+    return (i64)((u64)(i64)x * (u64)y - (u64)(i64)x + (uint8_t)x + (u64)(i64)(int16_t)y);
+}
+
+static u32 narrow(u64 a) { return (u32)(a >> 32) ^ (u32)a; }
+
+static u64 mixed(u64 a, u64 b) {
+    u64 acc = a;
+    acc += b * 3;
+    acc ^= acc >> 17;
+    acc -= 12345;
+    acc *= 0x9E3779B97F4A7C15ull;
+    u64 c = acc & 0xFFFF0000FFFFull;
+    return c | (acc % 4096 + acc / 16 + (acc & 0xFF00));
+}
+
+static u64 caller(u64 a, u64 b) { return add(a, 1ull << 40) + mul(a, b) - sub(b, a); }
+
+static const u64 values[] = {
+    0, 1, 7, 1000000007, 0xFFFFFFFF, 0x100000000, 5ull << 33, 0x123456789ABCDEF0,
+    0x7FFFFFFFFFFFFFFF, 0x8000000000000000, 0xFEDCBA9876543210, 0xFFFFFFFFFFFFFFF9, 0xFFFFFFFFFFFFFFFF,
+};
+static const u32 shifts[] = { 0, 1, 13, 31, 32, 33, 47, 63 };
+#define COUNT(x) (sizeof(x) / sizeof((x)[0]))
+
+#define Q(v) (unsigned long long)(u64)(v)
+#define QQ_Q(f, a, b) printf(#f " q:%llx q:%llx = q:%llx\n", Q(a), Q(b), Q(f(a, b)))
+#define QQ_W(f, a, b) printf(#f " q:%llx q:%llx = w:%x\n", Q(a), Q(b), (unsigned)f(a, b))
+
+int main(void) {
+    unsigned i, j;
+    for (i = 0; i < COUNT(values); i++) {
+        u64 a = values[i];
+        printf("narrow q:%llx = w:%x\n", Q(a), narrow(a));
+        for (j = 0; j < COUNT(shifts); j++) {
+            printf("shl q:%llx w:%x = q:%llx\n", Q(a), shifts[j], Q(shl(a, shifts[j])));
+            printf("shr q:%llx w:%x = q:%llx\n", Q(a), shifts[j], Q(shr(a, shifts[j])));
+            printf("sar q:%llx w:%x = q:%llx\n", Q(a), shifts[j], Q(sar((i64)a, shifts[j])));
+        }
+        for (j = 0; j < COUNT(values); j++) {
+            u64 b = values[j];
+            QQ_Q(add, a, b);
+            QQ_Q(sub, a, b);
+            QQ_Q(mul, a, b);
+            QQ_Q(affine, a, b);
+            QQ_Q(rotate, a, b);
+            QQ_Q(mixed, a, b);
+            QQ_Q(caller, a, b);
+            if (b) QQ_Q(udiv, a, b);
+            if (b && !(a == 0x8000000000000000 && b == ~0ull)) QQ_Q(sdiv, (i64)a, (i64)b);
+            QQ_W(less, a, b);
+            QQ_W(sless, (i64)a, (i64)b);
+            QQ_W(same, a, b);
+            printf("widen w:%x w:%x = q:%llx\n", (u32)a, (u32)b, Q(widen((i32)a, (u32)b)));
+        }
+    }
+    return 0;
+}